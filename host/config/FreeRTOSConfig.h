@@ -0,0 +1,85 @@
+/******************************************************************************
+* File Name: FreeRTOSConfig.h
+*
+* Description: FreeRTOS configuration for the host (POSIX port) build
+*              Mirrors proj_cm33_ns/FreeRTOSConfig.h where the application can
+*              observe the difference (tick rate, priorities, timers); memory
+*              and interrupt settings follow the POSIX port's requirements
+*
+*******************************************************************************/
+
+#ifndef FREERTOS_CONFIG_H
+#define FREERTOS_CONFIG_H
+
+/* Scheduler - same tick and priority levels as the target */
+#define configCPU_CLOCK_HZ                              ( ( unsigned long ) 100000000 )
+#define configTICK_RATE_HZ                              ( ( TickType_t ) 1000 )
+#define configUSE_PREEMPTION                            1
+#define configUSE_TIME_SLICING                          1
+#define configUSE_PORT_OPTIMISED_TASK_SELECTION         0
+#define configUSE_TICKLESS_IDLE                         0
+#define configMAX_PRIORITIES                            ( 7 )
+#define configMINIMAL_STACK_SIZE                        ( ( unsigned short ) 4096 )
+#define configMAX_TASK_NAME_LEN                         ( 16 )
+#define configUSE_16_BIT_TICKS                          0
+#define configIDLE_SHOULD_YIELD                         1
+
+/* Memory - heap_3 (malloc), tasks get host sized stacks (see sim_main.c) */
+#define configSUPPORT_STATIC_ALLOCATION                 0
+#define configSUPPORT_DYNAMIC_ALLOCATION                1
+#define configTOTAL_HEAP_SIZE                           ( ( size_t ) ( 64 * 1024 * 1024 ) )
+#define configAPPLICATION_ALLOCATED_HEAP                0
+
+/* Hooks - the application's hooks halt the CPU, which is not useful here */
+#define configUSE_IDLE_HOOK                             0
+#define configUSE_TICK_HOOK                             0
+#define configCHECK_FOR_STACK_OVERFLOW                  0
+#define configUSE_MALLOC_FAILED_HOOK                    0
+#define configUSE_DAEMON_TASK_STARTUP_HOOK              0
+
+/* Run time and task stats */
+#define configGENERATE_RUN_TIME_STATS                   0
+#define configUSE_TRACE_FACILITY                        1
+#define configUSE_STATS_FORMATTING_FUNCTIONS            0
+
+/* Co-routines */
+#define configUSE_CO_ROUTINES                           0
+#define configMAX_CO_ROUTINE_PRIORITIES                 ( 2 )
+
+/* Software timers */
+#define configUSE_TIMERS                                1
+#define configTIMER_TASK_PRIORITY                       ( configMAX_PRIORITIES - 1 )
+#define configTIMER_QUEUE_LENGTH                        10
+#define configTIMER_TASK_STACK_DEPTH                    ( configMINIMAL_STACK_SIZE * 2 )
+
+/* Optional API functions */
+#define INCLUDE_vTaskPrioritySet                        1
+#define INCLUDE_uxTaskPriorityGet                       1
+#define INCLUDE_vTaskDelete                             1
+#define INCLUDE_vTaskCleanUpResources                   0
+#define INCLUDE_vTaskSuspend                            1
+#define INCLUDE_vTaskDelayUntil                         1
+#define INCLUDE_vTaskDelay                              1
+#define INCLUDE_xTaskGetSchedulerState                  1
+#define INCLUDE_xTimerPendFunctionCall                  1
+#define INCLUDE_xQueueGetMutexHolder                    1
+#define INCLUDE_uxTaskGetStackHighWaterMark             1
+#define INCLUDE_eTaskGetState                           1
+#define INCLUDE_xTaskGetCurrentTaskHandle               1
+
+/* Synchronization */
+#define configUSE_MUTEXES                               1
+#define configUSE_RECURSIVE_MUTEXES                     1
+#define configUSE_COUNTING_SEMAPHORES                   1
+#define configUSE_QUEUE_SETS                            0
+#define configUSE_TASK_NOTIFICATIONS                    1
+
+/* Interrupt priorities are not modelled by the POSIX port */
+#define configKERNEL_INTERRUPT_PRIORITY                 ( 255 )
+#define configMAX_SYSCALL_INTERRUPT_PRIORITY            ( 191 )
+
+/* Assertion - report and stop the simulation */
+void sim_assert_failed(const char *file, int line);
+#define configASSERT( x )    if( ( x ) == 0 ) { sim_assert_failed( __FILE__, __LINE__ ); }
+
+#endif /* FREERTOS_CONFIG_H */
@@ -0,0 +1,128 @@
+/******************************************************************************
+* File Name: FS.h
+*
+* Description: Host build stand-in for the emFile API
+*              host/sim/sim_fs.c maps the volume onto a directory of the host
+*              file system and can add SD card latency and bandwidth limits
+*
+*******************************************************************************/
+
+#ifndef __FS_H__
+#define __FS_H__
+
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Types
+*******************************************************************************/
+typedef uint8_t  U8;
+typedef uint16_t U16;
+typedef uint32_t U32;
+typedef int8_t   I8;
+typedef int16_t  I16;
+typedef int32_t  I32;
+
+typedef struct FS_FILE FS_FILE;
+
+typedef struct {
+    U8    Attributes;
+    U32   CreationTime;
+    U32   LastAccessTime;
+    U32   LastWriteTime;
+    U32   FileSize;
+    char *sFileName;
+    int   SizeofFileName;
+    void *pDir;                 /* Host directory stream */
+} FS_FIND_DATA;
+
+typedef struct {
+    U8    Attributes;
+    U32   CreationTime;
+    U32   LastAccessTime;
+    U32   LastWriteTime;
+    U32   FileSize;
+} FS_FILE_INFO;
+
+typedef struct {
+    U16 Year;
+    U16 Month;
+    U16 Day;
+    U16 Hour;
+    U16 Minute;
+    U16 Second;
+} FS_FILETIME;
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define FS_SEEK_SET                 (0)
+#define FS_SEEK_CUR                 (1)
+#define FS_SEEK_END                 (2)
+
+#define FS_ATTR_READ_ONLY           (0x01u)
+#define FS_ATTR_HIDDEN              (0x02u)
+#define FS_ATTR_SYSTEM              (0x04u)
+#define FS_ATTR_ARCHIVE             (0x20u)
+#define FS_ATTR_DIRECTORY           (0x10u)
+
+#define FS_FILETIME_CREATE          (0)
+#define FS_FILETIME_ACCESS          (1)
+#define FS_FILETIME_MODIFY          (2)
+
+#define FS_ERRCODE_OK               (0)
+#define FS_ERRCODE_FILE_DIR_NOT_FOUND (-4)
+#define FS_ERRCODE_WRITE_FAILURE    (-21)
+#define FS_ERRCODE_READ_FAILURE     (-22)
+
+/*******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+/* Volume */
+void FS_Init(void);
+void FS_DeInit(void);
+int FS_IsHLFormatted(const char *sVolumeName);
+int FS_Format(const char *sVolumeName, const void *pFormatInfo);
+U32 FS_GetVolumeSizeKB(const char *sVolumeName);
+U32 FS_GetVolumeFreeSpace(const char *sVolumeName);
+U32 FS_GetVolumeFreeSpaceKB(const char *sVolumeName);
+void FS_Unmount(const char *sVolumeName);
+int FS_Sync(const char *sVolumeName);
+const char *FS_ErrorNo2Text(int ErrCode);
+
+/* Files */
+FS_FILE *FS_FOpen(const char *sFileName, const char *sMode);
+int FS_FOpenEx(const char *sFileName, const char *sMode, FS_FILE **ppFile);
+int FS_FClose(FS_FILE *pFile);
+U32 FS_Read(FS_FILE *pFile, void *pData, U32 NumBytes);
+U32 FS_Write(FS_FILE *pFile, const void *pData, U32 NumBytes);
+int FS_FSeek(FS_FILE *pFile, I32 Offset, int Origin);
+I32 FS_FTell(FS_FILE *pFile);
+U32 FS_GetFileSize(const FS_FILE *pFile);
+int FS_SetEndOfFile(FS_FILE *pFile);
+int FS_SyncFile(FS_FILE *pFile);
+int FS_FError(FS_FILE *pFile);
+int FS_Remove(const char *sFileName);
+int FS_Rename(const char *sNameOld, const char *sNameNew);
+int FS_Move(const char *sNameOld, const char *sNameNew);
+int FS_GetFileInfo(const char *sName, FS_FILE_INFO *pInfo);
+
+/* Directories */
+int FS_FindFirstFile(FS_FIND_DATA *pFD, const char *sDirName, char *sFileName, int SizeofFileName);
+int FS_FindNextFile(FS_FIND_DATA *pFD);
+void FS_FindClose(FS_FIND_DATA *pFD);
+
+/* Time stamps */
+int FS_GetFileTime(const char *sName, U32 *pTimeStamp);
+int FS_GetFileTimeEx(const char *sName, U32 *pTimeStamp, int Index);
+void FS_FileTimeToTimeStamp(const FS_FILETIME *pFileTime, U32 *pTimeStamp);
+void FS_TimeStampToFileTime(U32 TimeStamp, FS_FILETIME *pFileTime);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __FS_H__ */
@@ -0,0 +1,311 @@
+/******************************************************************************
+* File Name: cy_pdl.h
+*
+* Description: Host build stand-in for the PSoC Edge peripheral driver library
+*              Declares the subset of PDL types and functions the application
+*              uses; the PDM, TDM and interrupt functions are implemented by
+*              the simulators in host/sim, the rest are no-ops
+*
+*******************************************************************************/
+
+#ifndef __CY_PDL_H__
+#define __CY_PDL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Common
+*******************************************************************************/
+typedef uint32_t cy_rslt_t;
+
+#define CY_RSLT_SUCCESS                 ((cy_rslt_t)0u)
+#define CY_RSLT_TYPE_ERROR              (2u)
+
+#define __STATIC_INLINE                 static inline
+#define CY_SECTION(name)                __attribute__((section(name)))
+#define CY_ALIGN(align)                 __attribute__((aligned(align)))
+#define CY_SECTION_RAMFUNC_BEGIN
+#define CY_SECTION_RAMFUNC_END
+#define CY_UNUSED_PARAMETER(x)          ((void)(x))
+
+void sim_assert_failed(const char *file, int line);
+#define CY_ASSERT(x)                    do { if (!(x)) { sim_assert_failed(__FILE__, __LINE__); } } while (0)
+
+/*******************************************************************************
+* Interrupts (host/sim/sim_irq.c)
+*******************************************************************************/
+typedef int IRQn_Type;
+
+typedef struct {
+    IRQn_Type intrSrc;
+    uint32_t intrPriority;
+} cy_stc_sysint_t;
+
+typedef enum {
+    CY_SYSINT_SUCCESS   = 0,
+    CY_SYSINT_BAD_PARAM = 1
+} cy_en_sysint_status_t;
+
+typedef void (*cy_israddress)(void);
+
+cy_en_sysint_status_t Cy_SysInt_Init(const cy_stc_sysint_t *config, cy_israddress userIsr);
+void NVIC_EnableIRQ(IRQn_Type irq);
+void NVIC_DisableIRQ(IRQn_Type irq);
+void NVIC_ClearPendingIRQ(IRQn_Type irq);
+void NVIC_SetPriority(IRQn_Type irq, uint32_t priority);
+
+/* Simulated hardware runs in the highest priority task, so masking is moot */
+__STATIC_INLINE void __disable_irq(void) {}
+__STATIC_INLINE void __enable_irq(void) {}
+__STATIC_INLINE void __WFI(void) {}
+__STATIC_INLINE void __DSB(void) {}
+__STATIC_INLINE void __ISB(void) {}
+
+/*******************************************************************************
+* System
+*******************************************************************************/
+extern uint32_t SystemCoreClock;
+
+void Cy_SysLib_Delay(uint32_t milliseconds);
+void Cy_SysLib_DelayUs(uint16_t microseconds);
+uint32_t Cy_SysLib_EnterCriticalSection(void);
+void Cy_SysLib_ExitCriticalSection(uint32_t savedIntrStatus);
+uint64_t Cy_SysLib_GetUniqueId(void);
+
+/* Debug blocks; the cycle counter never advances, so the bench command
+ * reports it as not running */
+typedef struct { volatile uint32_t DEMCR; } DCB_Type;
+typedef struct { volatile uint32_t CTRL; volatile uint32_t CYCCNT; } DWT_Type;
+
+#define DCB_DEMCR_TRCENA_Msk            (1u << 24)
+#define DWT_CTRL_CYCCNTENA_Msk          (1u)
+
+extern DCB_Type *const DCB;
+extern DWT_Type *const DWT;
+
+/*******************************************************************************
+* GPIO
+*******************************************************************************/
+typedef struct { uint32_t reserved; } GPIO_PRT_Type;
+
+void Cy_GPIO_Write(GPIO_PRT_Type *base, uint32_t pinNum, uint32_t value);
+uint32_t Cy_GPIO_Read(GPIO_PRT_Type *base, uint32_t pinNum);
+void Cy_GPIO_Inv(GPIO_PRT_Type *base, uint32_t pinNum);
+void Cy_GPIO_ClearInterrupt(GPIO_PRT_Type *base, uint32_t pinNum);
+
+/*******************************************************************************
+* PDM/PCM (host/sim/sim_pdm.c)
+*******************************************************************************/
+typedef struct { uint32_t instance; } PDM_Type;
+
+typedef enum {
+    CY_PDM_PCM_SEL_GAIN_NEGATIVE_103DB = 0,
+    CY_PDM_PCM_SEL_GAIN_NEGATIVE_97DB,
+    CY_PDM_PCM_SEL_GAIN_NEGATIVE_91DB,
+    CY_PDM_PCM_SEL_GAIN_NEGATIVE_85DB,
+    CY_PDM_PCM_SEL_GAIN_NEGATIVE_79DB,
+    CY_PDM_PCM_SEL_GAIN_NEGATIVE_73DB,
+    CY_PDM_PCM_SEL_GAIN_NEGATIVE_67DB,
+    CY_PDM_PCM_SEL_GAIN_NEGATIVE_61DB,
+    CY_PDM_PCM_SEL_GAIN_NEGATIVE_55DB,
+    CY_PDM_PCM_SEL_GAIN_NEGATIVE_49DB,
+    CY_PDM_PCM_SEL_GAIN_NEGATIVE_43DB,
+    CY_PDM_PCM_SEL_GAIN_NEGATIVE_37DB,
+    CY_PDM_PCM_SEL_GAIN_NEGATIVE_31DB,
+    CY_PDM_PCM_SEL_GAIN_NEGATIVE_25DB,
+    CY_PDM_PCM_SEL_GAIN_NEGATIVE_19DB,
+    CY_PDM_PCM_SEL_GAIN_NEGATIVE_13DB,
+    CY_PDM_PCM_SEL_GAIN_NEGATIVE_7DB,
+    CY_PDM_PCM_SEL_GAIN_NEGATIVE_1DB,
+    CY_PDM_PCM_SEL_GAIN_5DB,
+    CY_PDM_PCM_SEL_GAIN_11DB,
+    CY_PDM_PCM_SEL_GAIN_17DB,
+    CY_PDM_PCM_SEL_GAIN_23DB,
+    CY_PDM_PCM_SEL_GAIN_29DB,
+    CY_PDM_PCM_SEL_GAIN_35DB,
+    CY_PDM_PCM_SEL_GAIN_41DB,
+    CY_PDM_PCM_SEL_GAIN_47DB,
+    CY_PDM_PCM_SEL_GAIN_53DB,
+    CY_PDM_PCM_SEL_GAIN_59DB,
+    CY_PDM_PCM_SEL_GAIN_65DB,
+    CY_PDM_PCM_SEL_GAIN_71DB,
+    CY_PDM_PCM_SEL_GAIN_77DB,
+    CY_PDM_PCM_SEL_GAIN_83DB
+} cy_en_pdm_pcm_gain_sel_t;
+
+typedef enum {
+    CY_PDM_PCM_SUCCESS   = 0,
+    CY_PDM_PCM_BAD_PARAM = 1
+} cy_en_pdm_pcm_status_t;
+
+typedef struct {
+    uint32_t clkDiv;
+    uint32_t clksel;
+    uint32_t halverate;
+    uint32_t route;
+} cy_stc_pdm_pcm_config_v2_t;
+
+typedef struct {
+    bool sampledelay;
+    uint32_t wordSize;
+    bool signExtension;
+    uint32_t rxFifoTriglevel;
+    bool fir0_enable;
+    uint32_t cic_decim_code;
+    uint32_t fir0_decim_code;
+    uint32_t fir0_scale;
+    uint32_t fir1_decim_code;
+    uint32_t fir1_scale;
+    bool dc_block_disable;
+    uint32_t dc_block_code;
+} cy_stc_pdm_pcm_channel_config_t;
+
+/* Channel filter codes, values as in the PDL enumerations */
+#define CY_PDM_PCM_CHAN_CIC_DECIM_2         (0u)
+#define CY_PDM_PCM_CHAN_CIC_DECIM_4         (1u)
+#define CY_PDM_PCM_CHAN_CIC_DECIM_8         (2u)
+#define CY_PDM_PCM_CHAN_CIC_DECIM_16        (3u)
+#define CY_PDM_PCM_CHAN_CIC_DECIM_32        (4u)
+#define CY_PDM_PCM_CHAN_FIR0_DECIM_1        (0u)
+#define CY_PDM_PCM_CHAN_FIR0_DECIM_2        (1u)
+#define CY_PDM_PCM_CHAN_FIR0_DECIM_3        (2u)
+#define CY_PDM_PCM_CHAN_FIR0_DECIM_4        (3u)
+#define CY_PDM_PCM_CHAN_FIR0_DECIM_5        (4u)
+#define CY_PDM_PCM_CHAN_FIR1_DECIM_1        (0u)
+#define CY_PDM_PCM_CHAN_FIR1_DECIM_2        (1u)
+#define CY_PDM_PCM_CHAN_FIR1_DECIM_3        (2u)
+#define CY_PDM_PCM_CHAN_FIR1_DECIM_4        (3u)
+#define CY_PDM_PCM_CHAN_DCBLOCK_CODE_1      (0u)
+#define CY_PDM_PCM_CHAN_DCBLOCK_CODE_2      (1u)
+#define CY_PDM_PCM_CHAN_DCBLOCK_CODE_4      (2u)
+#define CY_PDM_PCM_CHAN_DCBLOCK_CODE_8      (3u)
+#define CY_PDM_PCM_CHAN_DCBLOCK_CODE_16     (4u)
+#define CY_PDM_PCM_CHAN_DCBLOCK_CODE_32     (5u)
+#define CY_PDM_PCM_CHAN_DCBLOCK_CODE_64     (6u)
+#define CY_PDM_PCM_CHAN_DCBLOCK_CODE_128    (7u)
+
+#define CY_PDM_PCM_INTR_RX_TRIGGER          (0x00000001u)
+#define CY_PDM_PCM_INTR_RX_UNDERFLOW        (0x00000002u)
+#define CY_PDM_PCM_INTR_RX_OVERFLOW         (0x00000004u)
+#define CY_PDM_PCM_INTR_RX_FIR_OVERFLOW     (0x00000008u)
+#define CY_PDM_PCM_INTR_RX_IF_OVERFLOW      (0x00000010u)
+#define CY_PDM_PCM_INTR_MASK                (0x0000001Fu)
+
+extern PDM_Type *const PDM0;
+
+cy_en_pdm_pcm_status_t Cy_PDM_PCM_Init(PDM_Type *base, const cy_stc_pdm_pcm_config_v2_t *config);
+void Cy_PDM_PCM_DeInit(PDM_Type *base);
+cy_en_pdm_pcm_status_t Cy_PDM_PCM_Channel_Init(PDM_Type *base,
+                                               const cy_stc_pdm_pcm_channel_config_t *config,
+                                               uint8_t channel_num);
+void Cy_PDM_PCM_Channel_DeInit(PDM_Type *base, uint8_t channel_num);
+void Cy_PDM_PCM_Channel_Enable(PDM_Type *base, uint8_t channel_num);
+void Cy_PDM_PCM_Channel_Disable(PDM_Type *base, uint8_t channel_num);
+void Cy_PDM_PCM_Activate_Channel(PDM_Type *base, uint8_t channel_num);
+void Cy_PDM_PCM_DeActivate_Channel(PDM_Type *base, uint8_t channel_num);
+void Cy_PDM_PCM_SetGain(PDM_Type *base, uint8_t channel_num, cy_en_pdm_pcm_gain_sel_t gain);
+uint32_t Cy_PDM_PCM_Channel_ReadFifo(PDM_Type *base, uint8_t channel_num);
+uint32_t Cy_PDM_PCM_Channel_GetNumInFifo(PDM_Type *base, uint8_t channel_num);
+uint32_t Cy_PDM_PCM_Channel_GetInterruptStatusMasked(PDM_Type *base, uint8_t channel_num);
+void Cy_PDM_PCM_Channel_ClearInterrupt(PDM_Type *base, uint8_t channel_num, uint32_t mask);
+void Cy_PDM_PCM_Channel_SetInterruptMask(PDM_Type *base, uint8_t channel_num, uint32_t mask);
+
+/*******************************************************************************
+* Audio TDM (host/sim/sim_tdm.c)
+*******************************************************************************/
+typedef struct { uint32_t instance; } TDM_STRUCT_Type;
+typedef struct { uint32_t instance; } TDM_TX_STRUCT_Type;
+
+typedef enum {
+    CY_TDM_SUCCESS   = 0,
+    CY_TDM_BAD_PARAM = 1
+} cy_en_tdm_status_t;
+
+typedef struct {
+    uint32_t wordSize;
+    uint32_t clkDiv;            /* Interface clock to bit clock */
+    uint32_t channelNum;        /* Slots per frame */
+    uint32_t channelSize;       /* Bit clocks per slot */
+    uint32_t fifoTriggerLevel;
+    uint32_t chEn;              /* Slots enabled, one bit each */
+    bool i2sMode;               /* I2S format, else TDM */
+} cy_stc_tdm_config_tx_t;
+
+typedef struct {
+    const cy_stc_tdm_config_tx_t *tx_config;
+    const void *rx_config;
+} cy_stc_tdm_config_t;
+
+#define CY_TDM_INTR_TX_FIFO_TRIGGER         (0x00000001u)
+#define CY_TDM_INTR_TX_FIFO_OVERFLOW        (0x00000002u)
+#define CY_TDM_INTR_TX_FIFO_UNDERFLOW       (0x00000004u)
+#define CY_TDM_INTR_TX_IF_UNDERFLOW         (0x00000008u)
+#define CY_TDM_INTR_TX_MASK                 (0x0000000Fu)
+
+extern TDM_STRUCT_Type *const TDM_STRUCT0;
+extern TDM_TX_STRUCT_Type *const TDM_STRUCT0_TX;
+#define TDM0_TDM_STRUCT0_TDM_TX_STRUCT      TDM_STRUCT0_TX
+
+cy_en_tdm_status_t Cy_AudioTDM_Init(TDM_STRUCT_Type *base, const cy_stc_tdm_config_t *config);
+void Cy_AudioTDM_DeInit(TDM_STRUCT_Type *base);
+void Cy_AudioTDM_EnableTx(TDM_TX_STRUCT_Type *base);
+void Cy_AudioTDM_DisableTx(TDM_TX_STRUCT_Type *base);
+void Cy_AudioTDM_ActivateTx(TDM_TX_STRUCT_Type *base);
+void Cy_AudioTDM_DeActivateTx(TDM_TX_STRUCT_Type *base);
+void Cy_AudioTDM_WriteTxData(TDM_TX_STRUCT_Type *base, uint32_t data);
+uint32_t Cy_AudioTDM_GetNumInTxFifo(TDM_TX_STRUCT_Type *base);
+uint32_t Cy_AudioTDM_GetTxInterruptStatusMasked(TDM_TX_STRUCT_Type *base);
+void Cy_AudioTDM_ClearTxInterrupt(TDM_TX_STRUCT_Type *base, uint32_t mask);
+void Cy_AudioTDM_SetTxInterruptMask(TDM_TX_STRUCT_Type *base, uint32_t mask);
+
+/*******************************************************************************
+* SCB I2C (codec control, host/sim/sim_i2c.c)
+*******************************************************************************/
+#define CY_SCB_I2C_MASTER_WR_CMPLT_EVENT    (0x00020000UL)
+#define CY_SCB_I2C_MASTER_ERR_EVENT         (0x00080000UL)
+
+typedef void (*cy_cb_scb_i2c_handle_events_t)(uint32_t event);
+
+typedef struct { uint32_t instance; } CySCB_Type;
+typedef struct {
+    uint32_t state;
+    cy_cb_scb_i2c_handle_events_t cbEvents;
+} cy_stc_scb_i2c_context_t;
+typedef struct { uint32_t dataRate; } cy_stc_scb_i2c_config_t;
+
+typedef struct {
+    uint8_t slaveAddress;
+    uint8_t *buffer;
+    uint32_t bufferSize;
+    bool xferPending;           /* No stop condition at the end */
+} cy_stc_scb_i2c_master_xfer_config_t;
+
+typedef enum {
+    CY_SCB_I2C_SUCCESS          = 0,
+    CY_SCB_I2C_BAD_PARAM        = 1,
+    CY_SCB_I2C_MASTER_NOT_READY = 2
+} cy_en_scb_i2c_status_t;
+
+cy_en_scb_i2c_status_t Cy_SCB_I2C_Init(CySCB_Type *base, const cy_stc_scb_i2c_config_t *config,
+                                       cy_stc_scb_i2c_context_t *context);
+void Cy_SCB_I2C_Enable(CySCB_Type *base);
+void Cy_SCB_I2C_Disable(CySCB_Type *base, cy_stc_scb_i2c_context_t *context);
+cy_en_scb_i2c_status_t Cy_SCB_I2C_MasterWrite(CySCB_Type *base,
+                                              cy_stc_scb_i2c_master_xfer_config_t *xferConfig,
+                                              cy_stc_scb_i2c_context_t *context);
+void Cy_SCB_I2C_Interrupt(CySCB_Type *base, cy_stc_scb_i2c_context_t *context);
+void Cy_SCB_I2C_RegisterEventCallback(CySCB_Type const *base,
+                                      cy_cb_scb_i2c_handle_events_t callback,
+                                      cy_stc_scb_i2c_context_t *context);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __CY_PDL_H__ */
@@ -0,0 +1,14 @@
+/******************************************************************************
+* File Name: cy_retarget_io.h
+*
+* Description: Host build stand-in for retarget-io (stdio is already the
+*              console on the host)
+*
+*******************************************************************************/
+
+#ifndef __CY_RETARGET_IO_H__
+#define __CY_RETARGET_IO_H__
+
+#include "mtb_hal.h"
+
+#endif /* __CY_RETARGET_IO_H__ */
@@ -0,0 +1,74 @@
+/******************************************************************************
+* File Name: cybsp.h
+*
+* Description: Host build stand-in for the board support package
+*              Provides the configurator-generated names the application uses
+*
+*******************************************************************************/
+
+#ifndef __CYBSP_H__
+#define __CYBSP_H__
+
+#include "cy_pdl.h"
+#include "mtb_hal.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+/* Simulated interrupt lines (indices into the host/sim/sim_irq.c table) */
+#define tdm_0_interrupts_tx_0_IRQn      (2)
+#define CYBSP_DEBUG_UART_IRQ            (3)
+#define CYBSP_I2C_CONTROLLER_IRQ        (4)
+#define CYBSP_USER_BTN1_IRQ             (5)
+#define CYBSP_USER_BTN2_IRQ             (6)
+#define CYBSP_PDM_CHANNEL_0_IRQ         (8)
+#define CYBSP_PDM_CHANNEL_1_IRQ         (9)
+#define CYBSP_PDM_CHANNEL_2_IRQ         (10)
+#define CYBSP_PDM_CHANNEL_3_IRQ         (11)
+#define CYBSP_PDM_CHANNEL_IRQ(n)        (8 + (n))
+
+#define CYBSP_USER_LED_PORT             (&sim_gpio_port)
+#define CYBSP_USER_LED_PIN              (0u)
+#define CYBSP_USER_BTN_PORT             (&sim_gpio_port)
+#define CYBSP_USER_BTN_PIN              (1u)
+#define CYBSP_USER_BTN2_PORT            (&sim_gpio_port)
+#define CYBSP_USER_BTN2_PIN             (2u)
+#define CYBSP_LED_STATE_ON              (1u)
+#define CYBSP_LED_STATE_OFF             (0u)
+
+#define CYBSP_I2C_CONTROLLER_HW         (&sim_i2c_scb)
+
+/* SOCMEM shared with the CM55: no CM55 here, so only the membench mailbox at
+ * its end is used, and it never reports the CM55 ready */
+#define SIM_SHARED_SOCMEM_SIZE          (4096u)
+#define CYMEM_CM33_0_m33_m55_shared_START   (&sim_shared_socmem[0])
+#define CYMEM_CM33_0_m33_m55_shared_SIZE    SIM_SHARED_SOCMEM_SIZE
+
+/*******************************************************************************
+* Global Variables
+*******************************************************************************/
+extern GPIO_PRT_Type sim_gpio_port;
+extern CySCB_Type sim_i2c_scb;
+extern uint8_t sim_shared_socmem[SIM_SHARED_SOCMEM_SIZE];
+
+extern const cy_stc_pdm_pcm_config_v2_t CYBSP_PDM_config;
+extern const cy_stc_pdm_pcm_channel_config_t channel_2_config;
+extern const cy_stc_pdm_pcm_channel_config_t channel_3_config;
+extern const cy_stc_tdm_config_t CYBSP_TDM_CONTROLLER_0_config;
+extern const cy_stc_scb_i2c_config_t CYBSP_I2C_CONTROLLER_config;
+extern const mtb_hal_i2c_configurator_t CYBSP_I2C_CONTROLLER_hal_config;
+
+/*******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+cy_rslt_t cybsp_init(void);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __CYBSP_H__ */
@@ -0,0 +1,49 @@
+/******************************************************************************
+* File Name: mtb_hal.h
+*
+* Description: Host build stand-in for the ModusToolbox HAL (I2C only)
+*
+*******************************************************************************/
+
+#ifndef __MTB_HAL_H__
+#define __MTB_HAL_H__
+
+#include "cy_pdl.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define MTB_HAL_I2C_DEFAULT_ADDR_MASK   (0xFEu)
+
+typedef struct {
+    uint32_t reserved;
+} mtb_hal_i2c_configurator_t;
+
+typedef struct {
+    CySCB_Type *base;
+} mtb_hal_i2c_t;
+
+typedef struct {
+    bool is_target;
+    uint16_t address;
+    uint32_t frequency_hz;
+    uint8_t address_mask;
+    bool enable_address_callback;
+} mtb_hal_i2c_cfg_t;
+
+cy_rslt_t mtb_hal_i2c_setup(mtb_hal_i2c_t *obj, const mtb_hal_i2c_configurator_t *config,
+                            cy_stc_scb_i2c_context_t *context, const void *clock);
+cy_rslt_t mtb_hal_i2c_configure(mtb_hal_i2c_t *obj, const mtb_hal_i2c_cfg_t *cfg);
+cy_rslt_t mtb_hal_i2c_controller_write(mtb_hal_i2c_t *obj, uint16_t address,
+                                       const uint8_t *data, uint16_t size,
+                                       uint32_t timeout, bool send_stop);
+cy_rslt_t mtb_hal_i2c_controller_read(mtb_hal_i2c_t *obj, uint16_t address,
+                                      uint8_t *data, uint16_t size,
+                                      uint32_t timeout, bool send_stop);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __MTB_HAL_H__ */
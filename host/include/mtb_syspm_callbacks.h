@@ -0,0 +1,14 @@
+/******************************************************************************
+* File Name: mtb_syspm_callbacks.h
+*
+* Description: Host build stand-in for the system power management callbacks
+*              (there is no deep sleep on the host)
+*
+*******************************************************************************/
+
+#ifndef __MTB_SYSPM_CALLBACKS_H__
+#define __MTB_SYSPM_CALLBACKS_H__
+
+#include "cy_pdl.h"
+
+#endif /* __MTB_SYSPM_CALLBACKS_H__ */
@@ -0,0 +1,48 @@
+/******************************************************************************
+* File Name: mtb_tlv320dac3100.h
+*
+* Description: Host build stand-in for the TLV320DAC3100 codec driver
+*              (host/sim/sim_board.c keeps the register writes in a table)
+*
+*******************************************************************************/
+
+#ifndef __MTB_TLV320DAC3100_H__
+#define __MTB_TLV320DAC3100_H__
+
+#include "mtb_hal.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define TLV320DAC3100_DAC_SAMPLE_RATE_8_KHZ     (8000u)
+#define TLV320DAC3100_DAC_SAMPLE_RATE_16_KHZ    (16000u)
+#define TLV320DAC3100_DAC_SAMPLE_RATE_22_05_KHZ (22050u)
+#define TLV320DAC3100_DAC_SAMPLE_RATE_32_KHZ    (32000u)
+#define TLV320DAC3100_DAC_SAMPLE_RATE_44_1_KHZ  (44100u)
+#define TLV320DAC3100_DAC_SAMPLE_RATE_48_KHZ    (48000u)
+
+#define TLV320DAC3100_I2S_WORD_SIZE_16          (16u)
+#define TLV320DAC3100_I2S_WORD_SIZE_20          (20u)
+#define TLV320DAC3100_I2S_WORD_SIZE_24          (24u)
+#define TLV320DAC3100_I2S_WORD_SIZE_32          (32u)
+
+#define TLV320DAC3100_SPK_AUDIO_OUTPUT          (0u)
+#define TLV320DAC3100_HP_AUDIO_OUTPUT           (1u)
+
+cy_rslt_t mtb_tlv320dac3100_init(mtb_hal_i2c_t *i2c_inst);
+void mtb_tlv320dac3100_free(void);
+cy_rslt_t mtb_tlv320dac3100_configure_clocking(uint32_t mclk_hz, uint32_t sample_rate,
+                                               uint32_t word_length, uint32_t output);
+cy_rslt_t mtb_tlv320dac3100_activate(void);
+cy_rslt_t mtb_tlv320dac3100_deactivate(void);
+cy_rslt_t mtb_tlv320dac3100_adjust_speaker_output_volume(uint8_t volume);
+cy_rslt_t mtb_tlv320dac3100_adjust_headphone_output_volume(uint8_t volume);
+cy_rslt_t mtb_tlv320dac3100_write_byte(uint8_t reg, uint8_t data);
+uint8_t mtb_tlv320dac3100_read_byte(uint8_t reg);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __MTB_TLV320DAC3100_H__ */
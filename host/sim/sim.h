@@ -0,0 +1,107 @@
+/******************************************************************************
+* File Name: sim.h
+*
+* Description: Host simulator - shared configuration and hardware model hooks
+*
+*******************************************************************************/
+
+#ifndef __SIM_H__
+#define __SIM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cy_pdl.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define SIM_HW_TASK_PRIORITY        (configMAX_PRIORITIES - 1)
+#define SIM_HW_TASK_STACK_SIZE      (configMINIMAL_STACK_SIZE)
+#define SIM_DEFAULT_SAMPLE_RATE     (16000u)
+#define SIM_DEFAULT_TONE_HZ         (1000u)
+#define SIM_DEFAULT_TONE_DBFS       (-20)
+#define SIM_DEFAULT_SD_DIR          "sd"
+#define SIM_DEFAULT_LOOPBACK_DB     (-20)
+#define SIM_LOOPBACK_MAX_MS         (1000u)
+#define SIM_IRQ_COUNT               (16)
+
+/*******************************************************************************
+* Enumerations
+*******************************************************************************/
+typedef enum {
+    SIM_SOURCE_TONE,            /* Sine generator, same on both channels */
+    SIM_SOURCE_NOISE,           /* White noise at the tone level */
+    SIM_SOURCE_SILENCE,
+    SIM_SOURCE_WAV,             /* 16-bit PCM file, mono or stereo */
+    SIM_SOURCE_RAMP             /* Frame number since activation: low 16 bits left,
+                                 * high 16 bits right */
+} sim_source_t;
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+typedef struct {
+    const char *sd_dir;         /* Directory that stands in for the SD card */
+    uint32_t sd_latency_ms;     /* Added to every FS read/write call */
+    uint32_t sd_kbps;           /* FS read/write bandwidth limit, 0 = none */
+
+    sim_source_t pdm_source;
+    const char *pdm_wav;        /* SIM_SOURCE_WAV input */
+    bool pdm_loop;              /* Restart the WAV at its end */
+    uint32_t tone_hz;
+    int32_t tone_dbfs;
+    uint32_t burst_on_ms;       /* Source gated on for this long... */
+    uint32_t burst_off_ms;      /* ...then silent for this long; 0 = always on */
+
+    const char *i2s_out;        /* WAV file capturing the I2S output, NULL = none */
+    bool loopback;              /* Add the I2S output to the PDM source... */
+    double loopback_ms;         /* ...this much later, at least one frame... */
+    int32_t loopback_db;        /* ...at this gain */
+
+    uint32_t speed;             /* Audio frames per tick multiplier (1 = real time) */
+    uint32_t linger_ms;         /* Run time after stdin ends before exiting */
+    uint32_t i2c_error_every;   /* NAK every Nth codec_ctrl transfer, 0 = never */
+    bool verbose;
+} sim_config_t;
+
+/*******************************************************************************
+* Global Variables
+*******************************************************************************/
+extern sim_config_t sim_config;
+extern uint32_t sim_sample_rate;    /* Set by the codec clock configuration */
+
+/*******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+/* sim_irq.c */
+void sim_irq_raise(IRQn_Type irq);
+
+/* sim_pdm.c */
+int sim_pdm_open(void);
+void sim_pdm_step(uint32_t frames);
+
+/* sim_tdm.c */
+int sim_tdm_open(void);
+void sim_tdm_step(uint32_t frames);
+void sim_tdm_close(void);
+int16_t sim_tdm_history(uint32_t delay, uint32_t channel);
+
+/* sim_i2c.c */
+void sim_i2c_step(void);
+
+/* sim_console.c */
+bool sim_console_step(void);
+
+/* sim_main.c */
+void sim_log(const char *format, ...) __attribute__((format(printf, 1, 2)));
+void sim_exit(int status);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __SIM_H__ */
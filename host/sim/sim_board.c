@@ -0,0 +1,213 @@
+/******************************************************************************
+* File Name: sim_board.c
+*
+* Description: Host simulator - board support and codec
+*              Provides the configurator-generated configuration structures
+*              with the values the application relies on, and stands in for
+*              the TLV320DAC3100 driver: the clock configuration sets the
+*              simulated audio sample rate. Its register accesses go to the
+*              codec model of sim_i2c.c.
+*
+*******************************************************************************/
+
+#include "sim.h"
+#include "cybsp.h"
+#include "mtb_tlv320dac3100.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define SIM_PDM_RX_FIFO_TRIGGER     (31u)   /* Trigger above 31, i.e. at half of 64 */
+#define SIM_TDM_TX_FIFO_TRIGGER     (64u)   /* Trigger at half of 128 */
+#define SIM_TDM_CHANNELS            (2u)
+#define SIM_TDM_CLK_DIV             (8u)    /* Divisible by 4, so 8 slots keep the frame rate */
+
+/*******************************************************************************
+* Global Variables
+*******************************************************************************/
+GPIO_PRT_Type sim_gpio_port = { 0 };
+CySCB_Type sim_i2c_scb = { 0 };
+uint8_t sim_shared_socmem[SIM_SHARED_SOCMEM_SIZE] CY_ALIGN(32);
+
+const cy_stc_pdm_pcm_config_v2_t CYBSP_PDM_config = { 0 };
+
+const cy_stc_pdm_pcm_channel_config_t channel_2_config = {
+    .wordSize = 16u,
+    .signExtension = true,
+    .rxFifoTriglevel = SIM_PDM_RX_FIFO_TRIGGER,
+    .cic_decim_code = CY_PDM_PCM_CHAN_CIC_DECIM_32,
+    .fir0_decim_code = CY_PDM_PCM_CHAN_FIR0_DECIM_1,
+    .fir1_decim_code = CY_PDM_PCM_CHAN_FIR1_DECIM_3,
+    .fir1_scale = 10u,
+    .dc_block_disable = true,
+    .dc_block_code = CY_PDM_PCM_CHAN_DCBLOCK_CODE_16,
+};
+
+const cy_stc_pdm_pcm_channel_config_t channel_3_config = {
+    .wordSize = 16u,
+    .signExtension = true,
+    .rxFifoTriglevel = SIM_PDM_RX_FIFO_TRIGGER,
+    .cic_decim_code = CY_PDM_PCM_CHAN_CIC_DECIM_32,
+    .fir0_decim_code = CY_PDM_PCM_CHAN_FIR0_DECIM_1,
+    .fir1_decim_code = CY_PDM_PCM_CHAN_FIR1_DECIM_3,
+    .fir1_scale = 10u,
+    .dc_block_disable = true,
+    .dc_block_code = CY_PDM_PCM_CHAN_DCBLOCK_CODE_16,
+};
+
+static const cy_stc_tdm_config_tx_t sim_tdm_tx_config = {
+    .wordSize = 16u,
+    .clkDiv = SIM_TDM_CLK_DIV,
+    .channelNum = SIM_TDM_CHANNELS,
+    .channelSize = 16u,
+    .fifoTriggerLevel = SIM_TDM_TX_FIFO_TRIGGER,
+    .chEn = (1u << SIM_TDM_CHANNELS) - 1u,
+    .i2sMode = true,
+};
+
+const cy_stc_tdm_config_t CYBSP_TDM_CONTROLLER_0_config = {
+    .tx_config = &sim_tdm_tx_config,
+    .rx_config = NULL,
+};
+
+const cy_stc_scb_i2c_config_t CYBSP_I2C_CONTROLLER_config = { .dataRate = 400000u };
+const mtb_hal_i2c_configurator_t CYBSP_I2C_CONTROLLER_hal_config = { 0 };
+
+uint32_t sim_sample_rate = SIM_DEFAULT_SAMPLE_RATE;
+uint32_t SystemCoreClock = 200000000u;
+
+static DCB_Type sim_dcb;
+static DWT_Type sim_dwt;
+DCB_Type *const DCB = &sim_dcb;
+DWT_Type *const DWT = &sim_dwt;
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static uint32_t sim_gpio_state = 0xFFFFFFFFu;      /* Buttons released (active low) */
+
+/*******************************************************************************
+* Board
+*******************************************************************************/
+cy_rslt_t cybsp_init(void)
+{
+    return CY_RSLT_SUCCESS;
+}
+
+void sim_assert_failed(const char *file, int line)
+{
+    fprintf(stderr, "sim: assertion failed at %s:%d\n", file, line);
+    sim_exit(EXIT_FAILURE);
+}
+
+void Cy_SysLib_Delay(uint32_t milliseconds)
+{
+    if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) {
+        vTaskDelay(pdMS_TO_TICKS(milliseconds));
+    }
+}
+
+void Cy_SysLib_DelayUs(uint16_t microseconds)
+{
+    (void)microseconds;
+}
+
+uint32_t Cy_SysLib_EnterCriticalSection(void)
+{
+    taskENTER_CRITICAL();
+    return 0;
+}
+
+void Cy_SysLib_ExitCriticalSection(uint32_t savedIntrStatus)
+{
+    (void)savedIntrStatus;
+    taskEXIT_CRITICAL();
+}
+
+uint64_t Cy_SysLib_GetUniqueId(void)
+{
+    return 0x53494D0000000001ull;   /* "SIM" */
+}
+
+/*******************************************************************************
+* GPIO
+*******************************************************************************/
+void Cy_GPIO_Write(GPIO_PRT_Type *base, uint32_t pinNum, uint32_t value)
+{
+    (void)base;
+    if (value != 0u) {
+        sim_gpio_state |= (1u << pinNum);
+    }
+    else {
+        sim_gpio_state &= ~(1u << pinNum);
+    }
+}
+
+uint32_t Cy_GPIO_Read(GPIO_PRT_Type *base, uint32_t pinNum)
+{
+    (void)base;
+    return (sim_gpio_state >> pinNum) & 1u;
+}
+
+void Cy_GPIO_Inv(GPIO_PRT_Type *base, uint32_t pinNum)
+{
+    (void)base;
+    sim_gpio_state ^= (1u << pinNum);
+}
+
+void Cy_GPIO_ClearInterrupt(GPIO_PRT_Type *base, uint32_t pinNum)
+{
+    (void)base;
+    (void)pinNum;
+}
+
+/*******************************************************************************
+* TLV320DAC3100
+*******************************************************************************/
+cy_rslt_t mtb_tlv320dac3100_init(mtb_hal_i2c_t *i2c_inst)
+{
+    (void)i2c_inst;
+    return CY_RSLT_SUCCESS;
+}
+
+void mtb_tlv320dac3100_free(void)
+{
+}
+
+cy_rslt_t mtb_tlv320dac3100_configure_clocking(uint32_t mclk_hz, uint32_t sample_rate,
+                                               uint32_t word_length, uint32_t output)
+{
+    (void)output;
+    sim_sample_rate = sample_rate;
+    sim_log("Codec: MCLK %u Hz, %u Hz, %u bit\n", (unsigned int)mclk_hz,
+            (unsigned int)sample_rate, (unsigned int)word_length);
+    return CY_RSLT_SUCCESS;
+}
+
+cy_rslt_t mtb_tlv320dac3100_activate(void)
+{
+    sim_log("Codec: active\n");
+    return CY_RSLT_SUCCESS;
+}
+
+cy_rslt_t mtb_tlv320dac3100_deactivate(void)
+{
+    sim_log("Codec: inactive\n");
+    return CY_RSLT_SUCCESS;
+}
+
+cy_rslt_t mtb_tlv320dac3100_adjust_speaker_output_volume(uint8_t volume)
+{
+    sim_log("Codec: speaker volume %u\n", (unsigned int)volume);
+    return CY_RSLT_SUCCESS;
+}
+
+cy_rslt_t mtb_tlv320dac3100_adjust_headphone_output_volume(uint8_t volume)
+{
+    sim_log("Codec: headphone volume %u\n", (unsigned int)volume);
+    return CY_RSLT_SUCCESS;
+}
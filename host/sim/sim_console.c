@@ -0,0 +1,277 @@
+/******************************************************************************
+* File Name: sim_console.c
+*
+* Description: Host simulator - debug UART
+*              Implements the retarget_io_init.h interface on stdin/stdout.
+*              stdin is polled once per tick and fed to the CLI RX queue, or to
+*              the attached RX stream during a file transfer; the TX stream is
+*              drained to stdout. Both directions are limited to the bytes the
+*              configured baud rate carries in a tick.
+*
+*              Lines starting with '!' are simulator directives and are not
+*              passed to the CLI:
+*                !sleep <ms>   stop reading stdin for <ms> of simulated time
+*                !quit         end the simulation
+*
+*******************************************************************************/
+
+#include "sim.h"
+#include "retarget_io_init.h"
+#include "cli_task.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "stream_buffer.h"
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define SIM_CONSOLE_BAUD_RATE       (115200u)
+#define SIM_CONSOLE_MIN_BAUD        (9600u)
+#define SIM_CONSOLE_MAX_BAUD        (4000000u)
+#define SIM_CONSOLE_BUFFER_SIZE     (4096u)
+#define SIM_DIRECTIVE_MAX_LENGTH    (64u)
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static StreamBufferHandle_t sim_rx_stream = NULL;
+static StreamBufferHandle_t sim_tx_stream = NULL;
+static bool sim_tx_kicked = false;
+static uint32_t sim_baud_rate = SIM_CONSOLE_BAUD_RATE;
+static uint32_t sim_byte_credit = 0;         /* Link capacity left, in bytes x 10000 */
+
+/* stdin data not yet delivered */
+static char sim_input[SIM_CONSOLE_BUFFER_SIZE];
+static size_t sim_input_head = 0;
+static size_t sim_input_count = 0;
+static bool sim_input_eof = false;
+
+/* Directive parsing */
+static bool sim_line_start = true;
+static bool sim_in_directive = false;
+static char sim_directive[SIM_DIRECTIVE_MAX_LENGTH];
+static size_t sim_directive_length = 0;
+
+static TickType_t sim_sleep_until = 0;
+static TickType_t sim_eof_tick = 0;
+
+/*******************************************************************************
+* Function Name: sim_console_fill
+********************************************************************************
+* Summary:
+*  Read whatever stdin has without blocking
+*
+*******************************************************************************/
+static void sim_console_fill(void)
+{
+    struct pollfd fd = { .fd = STDIN_FILENO, .events = POLLIN };
+
+    if (sim_input_eof || (sim_input_count != 0u) || (poll(&fd, 1, 0) <= 0)) {
+        return;
+    }
+
+    ssize_t count = read(STDIN_FILENO, sim_input, sizeof(sim_input));
+    if (count <= 0) {
+        sim_input_eof = true;
+        sim_eof_tick = xTaskGetTickCount();
+        sim_log("stdin closed, running %u ms more\n", (unsigned int)sim_config.linger_ms);
+        return;
+    }
+    sim_input_head = 0;
+    sim_input_count = (size_t)count;
+}
+
+/*******************************************************************************
+* Function Name: sim_console_directive
+********************************************************************************
+* Summary:
+*  Execute a '!' line
+*
+*******************************************************************************/
+static void sim_console_directive(const char *line)
+{
+    unsigned long value;
+
+    if (sscanf(line, "sleep %lu", &value) == 1) {
+        sim_sleep_until = xTaskGetTickCount() + pdMS_TO_TICKS(value);
+    }
+    else if (strncmp(line, "quit", 4) == 0) {
+        sim_exit(EXIT_SUCCESS);
+    }
+    else {
+        fprintf(stderr, "sim: unknown directive '!%s'\n", line);
+    }
+}
+
+/*******************************************************************************
+* Function Name: sim_console_deliver
+********************************************************************************
+* Summary:
+*  Pass one received byte on
+*
+* Return:
+*  false if the receiver is full and the byte must be offered again
+*
+*******************************************************************************/
+static bool sim_console_deliver(char ch)
+{
+    BaseType_t woken = pdFALSE;
+
+    if (sim_rx_stream != NULL) {
+        /* Binary transfer - no directives, bytes lost on overflow like the FIFO */
+        (void)xStreamBufferSendFromISR(sim_rx_stream, &ch, 1, &woken);
+        return true;
+    }
+
+    if (sim_line_start && (ch == '!')) {
+        sim_in_directive = true;
+        sim_directive_length = 0;
+        sim_line_start = false;
+        return true;
+    }
+    if (sim_in_directive) {
+        if ((ch == '\n') || (ch == '\r')) {
+            sim_directive[sim_directive_length] = '\0';
+            sim_in_directive = false;
+            sim_line_start = true;
+            sim_console_directive(sim_directive);
+        }
+        else if (sim_directive_length < (SIM_DIRECTIVE_MAX_LENGTH - 1u)) {
+            sim_directive[sim_directive_length++] = ch;
+        }
+        return true;
+    }
+
+    if ((cli_rx_queue == NULL) ||
+        (xQueueSendFromISR(cli_rx_queue, &ch, &woken) != pdTRUE)) {
+        return false;
+    }
+    sim_line_start = (ch == '\n') || (ch == '\r');
+    return true;
+}
+
+/*******************************************************************************
+* Function Name: sim_console_step
+********************************************************************************
+* Summary:
+*  Move one tick's worth of bytes in each direction
+*
+* Return:
+*  false once stdin has ended and the linger time has passed
+*
+*******************************************************************************/
+bool sim_console_step(void)
+{
+    uint32_t budget;
+
+    /* Bytes per tick at 10 bits per byte, with the fraction carried over */
+    sim_byte_credit += (uint32_t)(((uint64_t)sim_baud_rate * 1000u) / configTICK_RATE_HZ);
+    budget = sim_byte_credit / 10000u;
+    sim_byte_credit %= 10000u;
+
+    /* Host -> device */
+    if (xTaskGetTickCount() >= sim_sleep_until) {
+        uint32_t rx_budget = budget;
+        while (rx_budget > 0u) {
+            sim_console_fill();
+            if (sim_input_count == 0u) {
+                break;
+            }
+            if (!sim_console_deliver(sim_input[sim_input_head])) {
+                break;
+            }
+            sim_input_head++;
+            sim_input_count--;
+            rx_budget--;
+            if (xTaskGetTickCount() < sim_sleep_until) {
+                break;
+            }
+        }
+    }
+
+    /* Device -> host */
+    if ((sim_tx_stream != NULL) && sim_tx_kicked) {
+        uint8_t chunk[SIM_CONSOLE_BUFFER_SIZE];
+        BaseType_t woken = pdFALSE;
+        size_t count = xStreamBufferReceiveFromISR(sim_tx_stream, chunk,
+                                                   (budget < sizeof(chunk)) ? budget : sizeof(chunk),
+                                                   &woken);
+        if (count > 0u) {
+            /* Not stdio - an application task may be preempted holding its lock */
+            (void)write(STDOUT_FILENO, chunk, count);
+        }
+        else {
+            sim_tx_kicked = false;
+        }
+    }
+
+    if (sim_input_eof && (sim_input_count == 0u) &&
+        ((xTaskGetTickCount() - sim_eof_tick) >= pdMS_TO_TICKS(sim_config.linger_ms))) {
+        return false;
+    }
+    return true;
+}
+
+/*******************************************************************************
+* retarget_io_init.h interface
+*******************************************************************************/
+void init_retarget_io(void)
+{
+    setvbuf(stdout, NULL, _IOLBF, 0);
+}
+
+void uart_rx_interrupt_init(void)
+{
+    /* stdin is polled by sim_console_step() */
+}
+
+void uart_stream_attach(StreamBufferHandle_t rx_stream,
+                        StreamBufferHandle_t tx_stream)
+{
+    sim_rx_stream = rx_stream;
+    sim_tx_stream = tx_stream;
+}
+
+void uart_stream_detach(void)
+{
+    sim_rx_stream = NULL;
+    sim_tx_stream = NULL;
+    sim_tx_kicked = false;
+    sim_line_start = true;
+}
+
+void uart_tx_kick(void)
+{
+    sim_tx_kicked = true;
+}
+
+bool uart_tx_idle(void)
+{
+    return (sim_tx_stream == NULL) || xStreamBufferIsEmpty(sim_tx_stream);
+}
+
+bool uart_baud_rate_valid(uint32_t baud_rate)
+{
+    return (baud_rate >= SIM_CONSOLE_MIN_BAUD) && (baud_rate <= SIM_CONSOLE_MAX_BAUD);
+}
+
+int uart_set_baud_rate(uint32_t baud_rate)
+{
+    if (!uart_baud_rate_valid(baud_rate)) {
+        return -1;
+    }
+    sim_baud_rate = baud_rate;
+    sim_byte_credit = 0;
+    return 0;
+}
+
+uint32_t uart_get_baud_rate(void)
+{
+    return sim_baud_rate;
+}
@@ -0,0 +1,497 @@
+/******************************************************************************
+* File Name: sim_fs.c
+*
+* Description: Host simulator - emFile on a host directory
+*              The SD card volume is the --sd directory; file handles wrap
+*              stdio streams. FS_Read() and FS_Write() can be slowed down to
+*              SD card speed with a fixed per-call latency and a bandwidth
+*              limit, both spent in vTaskDelay() so other tasks keep running.
+*              Like emFile with FS_OS_LOCKING, one read or write call at a
+*              time holds the card, so a long write delays other tasks' reads.
+*
+*******************************************************************************/
+
+#include "sim.h"
+#include "FS.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <time.h>
+#include <unistd.h>
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define SIM_FS_PATH_MAX             (512u)
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+struct FS_FILE {
+    FILE *stream;
+    int error;
+};
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static uint32_t sim_fs_delay_us = 0;    /* Access time owed, below one tick */
+static SemaphoreHandle_t sim_fs_lock = NULL;    /* Priority inheriting, as emFile's */
+
+/*******************************************************************************
+* Function Name: sim_fs_path
+********************************************************************************
+* Summary:
+*  Map an emFile name ("[volume:]\\dir\\name") into the SD directory
+*
+*******************************************************************************/
+static const char *sim_fs_path(const char *name, char *path)
+{
+    const char *colon = strrchr(name, ':');
+    size_t length;
+
+    if (colon != NULL) {
+        name = colon + 1;
+    }
+    while ((*name == '\\') || (*name == '/')) {
+        name++;
+    }
+
+    length = (size_t)snprintf(path, SIM_FS_PATH_MAX, "%s/%s", sim_config.sd_dir, name);
+    for (size_t i = strlen(sim_config.sd_dir); i < length; i++) {
+        if (path[i] == '\\') {
+            path[i] = '/';
+        }
+    }
+    return path;
+}
+
+/*******************************************************************************
+* Function Name: sim_fs_lock_take / sim_fs_lock_give
+********************************************************************************
+* Summary:
+*  Hold the card for one read or write call
+*
+*******************************************************************************/
+static void sim_fs_lock_take(void)
+{
+    if ((sim_fs_lock != NULL) && (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)) {
+        (void)xSemaphoreTake(sim_fs_lock, portMAX_DELAY);
+    }
+}
+
+static void sim_fs_lock_give(void)
+{
+    if ((sim_fs_lock != NULL) && (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)) {
+        (void)xSemaphoreGive(sim_fs_lock);
+    }
+}
+
+/*******************************************************************************
+* Function Name: sim_fs_access
+********************************************************************************
+* Summary:
+*  Spend the simulated SD card time for one read or write call
+*
+*******************************************************************************/
+static void sim_fs_access(U32 num_bytes)
+{
+    TickType_t ticks;
+
+    if ((sim_config.sd_latency_ms == 0u) && (sim_config.sd_kbps == 0u)) {
+        return;
+    }
+
+    sim_fs_delay_us += sim_config.sd_latency_ms * 1000u;
+    if (sim_config.sd_kbps != 0u) {
+        /* KB/s is bytes per ms */
+        sim_fs_delay_us += (uint32_t)(((uint64_t)num_bytes * 1000u) / sim_config.sd_kbps);
+    }
+
+    ticks = (TickType_t)(sim_fs_delay_us / (1000000u / configTICK_RATE_HZ));
+    if (ticks > 0u) {
+        sim_fs_delay_us -= ticks * (1000000u / configTICK_RATE_HZ);
+        vTaskDelay(ticks);
+    }
+}
+
+/*******************************************************************************
+* Volume
+*******************************************************************************/
+void FS_Init(void)
+{
+    (void)mkdir(sim_config.sd_dir, 0777);
+    sim_fs_lock = xSemaphoreCreateMutex();
+}
+
+void FS_DeInit(void)
+{
+}
+
+int FS_IsHLFormatted(const char *sVolumeName)
+{
+    (void)sVolumeName;
+    return 1;
+}
+
+int FS_Format(const char *sVolumeName, const void *pFormatInfo)
+{
+    (void)sVolumeName;
+    (void)pFormatInfo;
+    return FS_ERRCODE_OK;
+}
+
+U32 FS_GetVolumeSizeKB(const char *sVolumeName)
+{
+    struct statvfs info;
+
+    (void)sVolumeName;
+    if (statvfs(sim_config.sd_dir, &info) != 0) {
+        return 0;
+    }
+    return (U32)(((uint64_t)info.f_blocks * info.f_frsize) / 1024u);
+}
+
+U32 FS_GetVolumeFreeSpace(const char *sVolumeName)
+{
+    struct statvfs info;
+    uint64_t bytes;
+
+    (void)sVolumeName;
+    if (statvfs(sim_config.sd_dir, &info) != 0) {
+        return 0;
+    }
+    bytes = (uint64_t)info.f_bavail * info.f_frsize;
+    return (bytes > UINT32_MAX) ? UINT32_MAX : (U32)bytes;
+}
+
+U32 FS_GetVolumeFreeSpaceKB(const char *sVolumeName)
+{
+    struct statvfs info;
+
+    (void)sVolumeName;
+    if (statvfs(sim_config.sd_dir, &info) != 0) {
+        return 0;
+    }
+    return (U32)(((uint64_t)info.f_bavail * info.f_frsize) / 1024u);
+}
+
+void FS_Unmount(const char *sVolumeName)
+{
+    (void)sVolumeName;
+}
+
+int FS_Sync(const char *sVolumeName)
+{
+    (void)sVolumeName;
+    return FS_ERRCODE_OK;
+}
+
+const char *FS_ErrorNo2Text(int ErrCode)
+{
+    switch (ErrCode) {
+        case FS_ERRCODE_OK:                 return "OK";
+        case FS_ERRCODE_FILE_DIR_NOT_FOUND: return "File or directory not found";
+        case FS_ERRCODE_WRITE_FAILURE:      return "Write failure";
+        case FS_ERRCODE_READ_FAILURE:       return "Read failure";
+        default:                            return "Unknown error";
+    }
+}
+
+/*******************************************************************************
+* Files
+*******************************************************************************/
+int FS_FOpenEx(const char *sFileName, const char *sMode, FS_FILE **ppFile)
+{
+    char path[SIM_FS_PATH_MAX];
+    char mode[8];
+    FS_FILE *file;
+    size_t length = 0;
+
+    /* emFile modes are the stdio ones; the host always opens in binary */
+    for (const char *c = sMode; (*c != '\0') && (length < sizeof(mode) - 2u); c++) {
+        if (*c != 'b') {
+            mode[length++] = *c;
+        }
+    }
+    mode[length++] = 'b';
+    mode[length] = '\0';
+
+    *ppFile = NULL;
+    file = calloc(1, sizeof(FS_FILE));
+    if (file == NULL) {
+        return FS_ERRCODE_WRITE_FAILURE;
+    }
+    file->stream = fopen(sim_fs_path(sFileName, path), mode);
+    if (file->stream == NULL) {
+        free(file);
+        return FS_ERRCODE_FILE_DIR_NOT_FOUND;
+    }
+    *ppFile = file;
+    return FS_ERRCODE_OK;
+}
+
+FS_FILE *FS_FOpen(const char *sFileName, const char *sMode)
+{
+    FS_FILE *file;
+
+    (void)FS_FOpenEx(sFileName, sMode, &file);
+    return file;
+}
+
+int FS_FClose(FS_FILE *pFile)
+{
+    int result;
+
+    if (pFile == NULL) {
+        return FS_ERRCODE_OK;
+    }
+    result = (fclose(pFile->stream) == 0) ? FS_ERRCODE_OK : FS_ERRCODE_WRITE_FAILURE;
+    free(pFile);
+    return result;
+}
+
+U32 FS_Read(FS_FILE *pFile, void *pData, U32 NumBytes)
+{
+    size_t count;
+
+    if (pFile == NULL) {
+        return 0;
+    }
+    sim_fs_lock_take();
+    sim_fs_access(NumBytes);
+    count = fread(pData, 1, NumBytes, pFile->stream);
+    if (ferror(pFile->stream)) {
+        pFile->error = FS_ERRCODE_READ_FAILURE;
+    }
+    sim_fs_lock_give();
+    return (U32)count;
+}
+
+U32 FS_Write(FS_FILE *pFile, const void *pData, U32 NumBytes)
+{
+    size_t count;
+
+    if (pFile == NULL) {
+        return 0;
+    }
+    sim_fs_lock_take();
+    sim_fs_access(NumBytes);
+    count = fwrite(pData, 1, NumBytes, pFile->stream);
+    if (count != NumBytes) {
+        pFile->error = FS_ERRCODE_WRITE_FAILURE;
+    }
+    sim_fs_lock_give();
+    return (U32)count;
+}
+
+int FS_FSeek(FS_FILE *pFile, I32 Offset, int Origin)
+{
+    static const int whence[] = { SEEK_SET, SEEK_CUR, SEEK_END };
+
+    if ((pFile == NULL) || (Origin < FS_SEEK_SET) || (Origin > FS_SEEK_END)) {
+        return -1;
+    }
+    return (fseek(pFile->stream, Offset, whence[Origin]) == 0) ? 0 : -1;
+}
+
+I32 FS_FTell(FS_FILE *pFile)
+{
+    return (pFile == NULL) ? -1 : (I32)ftell(pFile->stream);
+}
+
+U32 FS_GetFileSize(const FS_FILE *pFile)
+{
+    struct stat info;
+
+    if (pFile == NULL) {
+        return 0;
+    }
+    fflush(pFile->stream);
+    if (fstat(fileno(pFile->stream), &info) != 0) {
+        return 0;
+    }
+    return (U32)info.st_size;
+}
+
+int FS_SetEndOfFile(FS_FILE *pFile)
+{
+    if (pFile == NULL) {
+        return -1;
+    }
+    fflush(pFile->stream);
+    return (ftruncate(fileno(pFile->stream), ftell(pFile->stream)) == 0) ? 0 : -1;
+}
+
+int FS_SyncFile(FS_FILE *pFile)
+{
+    if (pFile == NULL) {
+        return -1;
+    }
+    return (fflush(pFile->stream) == 0) ? 0 : FS_ERRCODE_WRITE_FAILURE;
+}
+
+int FS_FError(FS_FILE *pFile)
+{
+    return (pFile == NULL) ? FS_ERRCODE_OK : pFile->error;
+}
+
+int FS_Remove(const char *sFileName)
+{
+    char path[SIM_FS_PATH_MAX];
+
+    return (remove(sim_fs_path(sFileName, path)) == 0) ? 0 : FS_ERRCODE_FILE_DIR_NOT_FOUND;
+}
+
+int FS_Rename(const char *sNameOld, const char *sNameNew)
+{
+    char path_old[SIM_FS_PATH_MAX];
+    char path_new[SIM_FS_PATH_MAX];
+    struct stat info;
+
+    /* emFile refuses to overwrite; the new name is in the same directory */
+    sim_fs_path(sNameOld, path_old);
+    sim_fs_path(sNameNew, path_new);
+    if (stat(path_new, &info) == 0) {
+        return -1;
+    }
+    return (rename(path_old, path_new) == 0) ? 0 : FS_ERRCODE_FILE_DIR_NOT_FOUND;
+}
+
+int FS_Move(const char *sNameOld, const char *sNameNew)
+{
+    return FS_Rename(sNameOld, sNameNew);
+}
+
+/* The directory entry, without opening the file */
+int FS_GetFileInfo(const char *sName, FS_FILE_INFO *pInfo)
+{
+    char path[SIM_FS_PATH_MAX];
+    struct stat info;
+
+    if (stat(sim_fs_path(sName, path), &info) != 0) {
+        return FS_ERRCODE_FILE_DIR_NOT_FOUND;
+    }
+    pInfo->Attributes = S_ISDIR(info.st_mode) ? FS_ATTR_DIRECTORY : FS_ATTR_ARCHIVE;
+    pInfo->FileSize = (U32)info.st_size;
+    (void)FS_GetFileTime(sName, &pInfo->LastWriteTime);
+    pInfo->CreationTime = pInfo->LastWriteTime;
+    pInfo->LastAccessTime = pInfo->LastWriteTime;
+    return FS_ERRCODE_OK;
+}
+
+/*******************************************************************************
+* Directories
+*******************************************************************************/
+static int sim_fs_next_entry(FS_FIND_DATA *pFD)
+{
+    struct dirent *entry;
+
+    while ((entry = readdir((DIR *)pFD->pDir)) != NULL) {
+        if ((strcmp(entry->d_name, ".") == 0) || (strcmp(entry->d_name, "..") == 0)) {
+            continue;
+        }
+
+        char name[SIM_FS_PATH_MAX];
+        char path[SIM_FS_PATH_MAX];
+        struct stat info;
+
+        snprintf(name, sizeof(name), "%s", entry->d_name);
+        if (stat(sim_fs_path(name, path), &info) != 0) {
+            continue;
+        }
+        snprintf(pFD->sFileName, (size_t)pFD->SizeofFileName, "%s", entry->d_name);
+        pFD->Attributes = S_ISDIR(info.st_mode) ? FS_ATTR_DIRECTORY : FS_ATTR_ARCHIVE;
+        pFD->FileSize = (U32)info.st_size;
+        (void)FS_GetFileTime(name, &pFD->LastWriteTime);
+        pFD->CreationTime = pFD->LastWriteTime;
+        pFD->LastAccessTime = pFD->LastWriteTime;
+        return 0;
+    }
+    return 1;
+}
+
+int FS_FindFirstFile(FS_FIND_DATA *pFD, const char *sDirName, char *sFileName, int SizeofFileName)
+{
+    char path[SIM_FS_PATH_MAX];
+
+    memset(pFD, 0, sizeof(*pFD));
+    pFD->sFileName = sFileName;
+    pFD->SizeofFileName = SizeofFileName;
+    pFD->pDir = opendir(sim_fs_path(sDirName, path));
+    if (pFD->pDir == NULL) {
+        return -1;
+    }
+    return sim_fs_next_entry(pFD);
+}
+
+int FS_FindNextFile(FS_FIND_DATA *pFD)
+{
+    /* emFile returns 1 while there are entries */
+    return (sim_fs_next_entry(pFD) == 0) ? 1 : 0;
+}
+
+void FS_FindClose(FS_FIND_DATA *pFD)
+{
+    if (pFD->pDir != NULL) {
+        closedir((DIR *)pFD->pDir);
+        pFD->pDir = NULL;
+    }
+}
+
+/*******************************************************************************
+* Time stamps (FAT format)
+*******************************************************************************/
+int FS_GetFileTime(const char *sName, U32 *pTimeStamp)
+{
+    char path[SIM_FS_PATH_MAX];
+    struct stat info;
+    struct tm local;
+    FS_FILETIME file_time;
+
+    if (stat(sim_fs_path(sName, path), &info) != 0) {
+        return FS_ERRCODE_FILE_DIR_NOT_FOUND;
+    }
+    localtime_r(&info.st_mtime, &local);
+    file_time.Year = (U16)(local.tm_year + 1900);
+    file_time.Month = (U16)(local.tm_mon + 1);
+    file_time.Day = (U16)local.tm_mday;
+    file_time.Hour = (U16)local.tm_hour;
+    file_time.Minute = (U16)local.tm_min;
+    file_time.Second = (U16)local.tm_sec;
+    FS_FileTimeToTimeStamp(&file_time, pTimeStamp);
+    return FS_ERRCODE_OK;
+}
+
+/* The host keeps one time per file that matters here: all three are mtime */
+int FS_GetFileTimeEx(const char *sName, U32 *pTimeStamp, int Index)
+{
+    (void)Index;
+    return FS_GetFileTime(sName, pTimeStamp);
+}
+
+void FS_FileTimeToTimeStamp(const FS_FILETIME *pFileTime, U32 *pTimeStamp)
+{
+    *pTimeStamp = ((U32)(pFileTime->Year - 1980u) << 25) |
+                  ((U32)pFileTime->Month << 21) |
+                  ((U32)pFileTime->Day << 16) |
+                  ((U32)pFileTime->Hour << 11) |
+                  ((U32)pFileTime->Minute << 5) |
+                  ((U32)pFileTime->Second / 2u);
+}
+
+void FS_TimeStampToFileTime(U32 TimeStamp, FS_FILETIME *pFileTime)
+{
+    pFileTime->Year = (U16)(1980u + (TimeStamp >> 25));
+    pFileTime->Month = (U16)((TimeStamp >> 21) & 0x0Fu);
+    pFileTime->Day = (U16)((TimeStamp >> 16) & 0x1Fu);
+    pFileTime->Hour = (U16)((TimeStamp >> 11) & 0x1Fu);
+    pFileTime->Minute = (U16)((TimeStamp >> 5) & 0x3Fu);
+    pFileTime->Second = (U16)((TimeStamp & 0x1Fu) * 2u);
+}
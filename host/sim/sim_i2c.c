@@ -0,0 +1,265 @@
+/******************************************************************************
+* File Name: sim_i2c.c
+*
+* Description: Host simulator - codec I2C bus and TLV320DAC3100 registers
+*              The codec is modelled as 256 pages of 128 registers. Register
+*              0 of every page selects the page and reads back as the
+*              selected page. A write sets the register pointer from its
+*              first byte and auto-increments it, as does a read. The
+*              blocking HAL calls (the driver at boot, the readback of
+*              codec_ctrl.c) complete at once. A PDL interrupt transfer
+*              (Cy_SCB_I2C_MasterWrite) takes the bus time of its bytes at
+*              I2C_FREQUENCY_HZ, nine bit times each with the address byte,
+*              and then raises the I2C interrupt with the completion or,
+*              every --i2c-errors transfers, a NAK.
+*
+*******************************************************************************/
+
+#include "sim.h"
+#include "cybsp.h"
+#include "mtb_hal.h"
+#include "FreeRTOS.h"
+#include <string.h>
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define SIM_I2C_CODEC_ADDRESS       (0x18u)
+#define SIM_I2C_RATE_HZ             (400000u)
+#define SIM_I2C_BITS_PER_BYTE       (9u)        /* 8 data bits and the acknowledge */
+#define SIM_I2C_PAGES               (256u)
+#define SIM_I2C_PAGE_REGS           (128u)
+#define SIM_I2C_RSLT_BUSY           ((cy_rslt_t)CY_RSLT_TYPE_ERROR << 16)  /* Or no such device */
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static struct {
+    uint8_t regs[SIM_I2C_PAGES][SIM_I2C_PAGE_REGS];
+    uint8_t page;
+    uint8_t pointer;
+} sim_codec;
+
+static struct {
+    cy_stc_scb_i2c_master_xfer_config_t *xfer;  /* Interrupt transfer on the bus */
+    uint32_t bytes_left;        /* Address byte included */
+    uint32_t bit_credit;        /* Bus time carried over from the last tick */
+    uint32_t events;            /* For the next Cy_SCB_I2C_Interrupt() */
+    uint32_t transfers;
+} sim_i2c;
+
+/*******************************************************************************
+* Function Name: sim_i2c_codec_write / sim_i2c_codec_read
+********************************************************************************
+* Summary:
+*  One register access at the codec's pointer, which then moves on
+*
+*******************************************************************************/
+static void sim_i2c_codec_write(uint8_t value)
+{
+    uint8_t reg = sim_codec.pointer;
+
+    if (reg == 0u) {
+        sim_codec.page = value;
+    } else {
+        sim_codec.regs[sim_codec.page][reg] = value;
+    }
+    sim_codec.pointer = (uint8_t)((reg + 1u) % SIM_I2C_PAGE_REGS);
+}
+
+static uint8_t sim_i2c_codec_read(void)
+{
+    uint8_t value = (sim_codec.pointer == 0u) ? sim_codec.page :
+                    sim_codec.regs[sim_codec.page][sim_codec.pointer];
+
+    sim_codec.pointer = (uint8_t)((sim_codec.pointer + 1u) % SIM_I2C_PAGE_REGS);
+    return value;
+}
+
+/*******************************************************************************
+* Function Name: sim_i2c_codec_transfer
+********************************************************************************
+* Summary:
+*  Codec side of a write: register address, then data bytes
+*
+*******************************************************************************/
+static void sim_i2c_codec_transfer(const uint8_t *data, uint32_t size)
+{
+    if (size == 0u) {
+        return;
+    }
+    sim_codec.pointer = (uint8_t)(data[0] % SIM_I2C_PAGE_REGS);
+    for (uint32_t i = 1; i < size; i++) {
+        sim_i2c_codec_write(data[i]);
+    }
+}
+
+/*******************************************************************************
+* Function Name: sim_i2c_step
+********************************************************************************
+* Summary:
+*  One tick of bus time for the interrupt transfer, if there is one
+*
+*******************************************************************************/
+void sim_i2c_step(void)
+{
+    cy_stc_scb_i2c_master_xfer_config_t *xfer = sim_i2c.xfer;
+    uint32_t bytes;
+
+    if (xfer == NULL) {
+        sim_i2c.bit_credit = 0;
+        return;
+    }
+
+    sim_i2c.bit_credit += SIM_I2C_RATE_HZ / configTICK_RATE_HZ;
+    bytes = sim_i2c.bit_credit / SIM_I2C_BITS_PER_BYTE;
+    if (bytes < sim_i2c.bytes_left) {
+        sim_i2c.bytes_left -= bytes;
+        sim_i2c.bit_credit -= bytes * SIM_I2C_BITS_PER_BYTE;
+        return;
+    }
+    sim_i2c.bit_credit -= sim_i2c.bytes_left * SIM_I2C_BITS_PER_BYTE;
+    sim_i2c.bytes_left = 0;
+
+    sim_i2c.transfers++;
+    if ((xfer->slaveAddress != SIM_I2C_CODEC_ADDRESS) ||
+        ((sim_config.i2c_error_every != 0u) &&
+         ((sim_i2c.transfers % sim_config.i2c_error_every) == 0u))) {
+        sim_log("I2C: transfer %u NAK\n", (unsigned int)sim_i2c.transfers);
+        sim_i2c.events |= CY_SCB_I2C_MASTER_ERR_EVENT;
+    } else {
+        sim_log("I2C: transfer %u, page %u register %u, %u bytes\n",
+                (unsigned int)sim_i2c.transfers, (unsigned int)sim_codec.page,
+                (unsigned int)xfer->buffer[0], (unsigned int)xfer->bufferSize);
+        sim_i2c_codec_transfer(xfer->buffer, xfer->bufferSize);
+        sim_i2c.events |= CY_SCB_I2C_MASTER_WR_CMPLT_EVENT;
+    }
+    sim_i2c.xfer = NULL;
+    sim_irq_raise((IRQn_Type)CYBSP_I2C_CONTROLLER_IRQ);
+}
+
+/*******************************************************************************
+* PDL
+*******************************************************************************/
+cy_en_scb_i2c_status_t Cy_SCB_I2C_Init(CySCB_Type *base, const cy_stc_scb_i2c_config_t *config,
+                                       cy_stc_scb_i2c_context_t *context)
+{
+    (void)base;
+    (void)config;
+    memset(context, 0, sizeof(*context));
+    return CY_SCB_I2C_SUCCESS;
+}
+
+void Cy_SCB_I2C_Enable(CySCB_Type *base)
+{
+    (void)base;
+}
+
+void Cy_SCB_I2C_Disable(CySCB_Type *base, cy_stc_scb_i2c_context_t *context)
+{
+    (void)base;
+    (void)context;
+}
+
+cy_en_scb_i2c_status_t Cy_SCB_I2C_MasterWrite(CySCB_Type *base,
+                                              cy_stc_scb_i2c_master_xfer_config_t *xferConfig,
+                                              cy_stc_scb_i2c_context_t *context)
+{
+    (void)base;
+    (void)context;
+    if ((xferConfig == NULL) || (xferConfig->buffer == NULL) || (xferConfig->bufferSize == 0u)) {
+        return CY_SCB_I2C_BAD_PARAM;
+    }
+    if (sim_i2c.xfer != NULL) {
+        return CY_SCB_I2C_MASTER_NOT_READY;
+    }
+    sim_i2c.xfer = xferConfig;
+    sim_i2c.bytes_left = xferConfig->bufferSize + 1u;
+    return CY_SCB_I2C_SUCCESS;
+}
+
+void Cy_SCB_I2C_Interrupt(CySCB_Type *base, cy_stc_scb_i2c_context_t *context)
+{
+    uint32_t events = sim_i2c.events;
+
+    (void)base;
+    sim_i2c.events = 0;
+    if ((events != 0u) && (context->cbEvents != NULL)) {
+        context->cbEvents(events);
+    }
+}
+
+void Cy_SCB_I2C_RegisterEventCallback(CySCB_Type const *base,
+                                      cy_cb_scb_i2c_handle_events_t callback,
+                                      cy_stc_scb_i2c_context_t *context)
+{
+    (void)base;
+    context->cbEvents = callback;
+}
+
+/*******************************************************************************
+* HAL (blocking)
+*******************************************************************************/
+cy_rslt_t mtb_hal_i2c_setup(mtb_hal_i2c_t *obj, const mtb_hal_i2c_configurator_t *config,
+                            cy_stc_scb_i2c_context_t *context, const void *clock)
+{
+    (void)config;
+    (void)context;
+    (void)clock;
+    obj->base = &sim_i2c_scb;
+    return CY_RSLT_SUCCESS;
+}
+
+cy_rslt_t mtb_hal_i2c_configure(mtb_hal_i2c_t *obj, const mtb_hal_i2c_cfg_t *cfg)
+{
+    (void)obj;
+    (void)cfg;
+    return CY_RSLT_SUCCESS;
+}
+
+cy_rslt_t mtb_hal_i2c_controller_write(mtb_hal_i2c_t *obj, uint16_t address,
+                                       const uint8_t *data, uint16_t size,
+                                       uint32_t timeout, bool send_stop)
+{
+    (void)obj;
+    (void)timeout;
+    (void)send_stop;
+    if ((sim_i2c.xfer != NULL) || (address != SIM_I2C_CODEC_ADDRESS)) {
+        return SIM_I2C_RSLT_BUSY;
+    }
+    sim_i2c_codec_transfer(data, size);
+    return CY_RSLT_SUCCESS;
+}
+
+cy_rslt_t mtb_hal_i2c_controller_read(mtb_hal_i2c_t *obj, uint16_t address,
+                                      uint8_t *data, uint16_t size,
+                                      uint32_t timeout, bool send_stop)
+{
+    (void)obj;
+    (void)timeout;
+    (void)send_stop;
+    if ((sim_i2c.xfer != NULL) || (address != SIM_I2C_CODEC_ADDRESS)) {
+        return SIM_I2C_RSLT_BUSY;
+    }
+    for (uint16_t i = 0; i < size; i++) {
+        data[i] = sim_i2c_codec_read();
+    }
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+* TLV320DAC3100 driver register access
+*******************************************************************************/
+cy_rslt_t mtb_tlv320dac3100_write_byte(uint8_t reg, uint8_t data)
+{
+    uint8_t bytes[2] = { reg, data };
+
+    sim_i2c_codec_transfer(bytes, sizeof(bytes));
+    return CY_RSLT_SUCCESS;
+}
+
+uint8_t mtb_tlv320dac3100_read_byte(uint8_t reg)
+{
+    sim_codec.pointer = (uint8_t)(reg % SIM_I2C_PAGE_REGS);
+    return sim_i2c_codec_read();
+}
@@ -0,0 +1,103 @@
+/******************************************************************************
+* File Name: sim_irq.c
+*
+* Description: Host simulator - interrupt controller
+*              Handlers registered with Cy_SysInt_Init() are called directly
+*              by the hardware models from the simulator task, which runs at
+*              the highest priority and so cannot be preempted by the
+*              application, like an ISR
+*
+*******************************************************************************/
+
+#include "sim.h"
+#include "FreeRTOS.h"
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+typedef struct {
+    cy_israddress handler;
+    bool enabled;
+    bool active;                /* Handler running - no nesting */
+} sim_irq_line_t;
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static sim_irq_line_t sim_irq_lines[SIM_IRQ_COUNT];
+
+/*******************************************************************************
+* Function Name: Cy_SysInt_Init
+*******************************************************************************/
+cy_en_sysint_status_t Cy_SysInt_Init(const cy_stc_sysint_t *config, cy_israddress userIsr)
+{
+    if ((config == NULL) || (config->intrSrc < 0) || (config->intrSrc >= SIM_IRQ_COUNT)) {
+        return CY_SYSINT_BAD_PARAM;
+    }
+    sim_irq_lines[config->intrSrc].handler = userIsr;
+    return CY_SYSINT_SUCCESS;
+}
+
+/*******************************************************************************
+* Function Name: NVIC_EnableIRQ
+*******************************************************************************/
+void NVIC_EnableIRQ(IRQn_Type irq)
+{
+    if ((irq >= 0) && (irq < SIM_IRQ_COUNT)) {
+        sim_irq_lines[irq].enabled = true;
+    }
+}
+
+/*******************************************************************************
+* Function Name: NVIC_DisableIRQ
+*******************************************************************************/
+void NVIC_DisableIRQ(IRQn_Type irq)
+{
+    if ((irq >= 0) && (irq < SIM_IRQ_COUNT)) {
+        sim_irq_lines[irq].enabled = false;
+    }
+}
+
+/*******************************************************************************
+* Function Name: NVIC_ClearPendingIRQ
+*******************************************************************************/
+void NVIC_ClearPendingIRQ(IRQn_Type irq)
+{
+    (void)irq;      /* Nothing is ever left pending */
+}
+
+/*******************************************************************************
+* Function Name: NVIC_SetPriority
+*******************************************************************************/
+void NVIC_SetPriority(IRQn_Type irq, uint32_t priority)
+{
+    (void)irq;
+    (void)priority;
+}
+
+/*******************************************************************************
+* Function Name: sim_irq_raise
+********************************************************************************
+* Summary:
+*  Run the handler of an interrupt line if it is registered and enabled
+*
+* Parameters:
+*  irq: Interrupt line
+*
+*******************************************************************************/
+void sim_irq_raise(IRQn_Type irq)
+{
+    sim_irq_line_t *line;
+
+    if ((irq < 0) || (irq >= SIM_IRQ_COUNT)) {
+        return;
+    }
+    line = &sim_irq_lines[irq];
+    if (!line->enabled || (line->handler == NULL) || line->active) {
+        return;
+    }
+
+    line->active = true;
+    line->handler();
+    line->active = false;
+}
@@ -0,0 +1,351 @@
+/******************************************************************************
+* File Name: sim_main.c
+*
+* Description: Host simulator - entry point
+*              Parses the simulator options, opens the audio source and sink,
+*              starts the hardware model task and hands over to the
+*              application's freertos_system_init() exactly like main() does
+*              on the target.
+*
+*              The hardware model task runs once per tick at the highest
+*              priority and advances the PDM and TDM blocks by one tick of
+*              audio frames, calling the application's ISRs as the FIFOs
+*              cross their trigger levels. --speed shortens the host timer
+*              period of the tick, so audio and RTOS time are accelerated
+*              together.
+*
+*******************************************************************************/
+
+#include "sim.h"
+#include "freertos_setup.h"
+#include "retarget_io_init.h"
+#include "FS.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define SIM_HOST_MIN_STACK_WORDS    (16384u)    /* 64 KB per task thread */
+#define SIM_LOG_LINE_SIZE           (256u)
+#define SIM_MAX_SPEED               (50u)
+
+/*******************************************************************************
+* Global Variables
+*******************************************************************************/
+sim_config_t sim_config = {
+    .sd_dir = SIM_DEFAULT_SD_DIR,
+    .pdm_source = SIM_SOURCE_TONE,
+    .tone_hz = SIM_DEFAULT_TONE_HZ,
+    .tone_dbfs = SIM_DEFAULT_TONE_DBFS,
+    .speed = 1u,
+    .linger_ms = 1000u,
+};
+
+/*******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+BaseType_t __real_xTaskCreate(TaskFunction_t pxTaskCode, const char *const pcName,
+                              const configSTACK_DEPTH_TYPE usStackDepth,
+                              void *const pvParameters, UBaseType_t uxPriority,
+                              TaskHandle_t *const pxCreatedTask);
+int __real_setitimer(int which, const struct itimerval *new_value,
+                     struct itimerval *old_value);
+
+/*******************************************************************************
+* Function Name: __wrap_xTaskCreate
+********************************************************************************
+* Summary:
+*  Give every task a host sized stack; the target sizes are far below what a
+*  pthread running glibc's printf needs
+*
+*******************************************************************************/
+BaseType_t __wrap_xTaskCreate(TaskFunction_t pxTaskCode, const char *const pcName,
+                              const configSTACK_DEPTH_TYPE usStackDepth,
+                              void *const pvParameters, UBaseType_t uxPriority,
+                              TaskHandle_t *const pxCreatedTask)
+{
+    configSTACK_DEPTH_TYPE depth = usStackDepth;
+
+    if (depth < SIM_HOST_MIN_STACK_WORDS) {
+        depth = SIM_HOST_MIN_STACK_WORDS;
+    }
+    return __real_xTaskCreate(pxTaskCode, pcName, depth, pvParameters, uxPriority,
+                              pxCreatedTask);
+}
+
+/*******************************************************************************
+* Function Name: __wrap_setitimer
+********************************************************************************
+* Summary:
+*  Divide the tick timer period set up by the POSIX port by --speed
+*
+*******************************************************************************/
+int __wrap_setitimer(int which, const struct itimerval *new_value,
+                     struct itimerval *old_value)
+{
+    struct itimerval scaled = *new_value;
+    uint64_t interval = (uint64_t)scaled.it_interval.tv_sec * 1000000u +
+                        (uint64_t)scaled.it_interval.tv_usec;
+    uint64_t value = (uint64_t)scaled.it_value.tv_sec * 1000000u +
+                     (uint64_t)scaled.it_value.tv_usec;
+
+    if ((sim_config.speed > 1u) && (interval != 0u)) {
+        interval /= sim_config.speed;
+        value /= sim_config.speed;
+        scaled.it_interval.tv_sec = (time_t)(interval / 1000000u);
+        scaled.it_interval.tv_usec = (suseconds_t)(interval % 1000000u);
+        scaled.it_value.tv_sec = (time_t)(value / 1000000u);
+        scaled.it_value.tv_usec = (suseconds_t)(value % 1000000u);
+    }
+    return __real_setitimer(which, &scaled, old_value);
+}
+
+/*******************************************************************************
+* Function Name: sim_log
+********************************************************************************
+* Summary:
+*  Simulator diagnostics on stderr, shown with -v
+*
+*******************************************************************************/
+void sim_log(const char *format, ...)
+{
+    char line[SIM_LOG_LINE_SIZE];
+    va_list args;
+    int length;
+
+    if (!sim_config.verbose) {
+        return;
+    }
+    length = snprintf(line, sizeof(line), "[Sim] ");
+    va_start(args, format);
+    length += vsnprintf(&line[length], sizeof(line) - (size_t)length, format, args);
+    va_end(args);
+    if (length > (int)sizeof(line) - 1) {
+        length = (int)sizeof(line) - 1;
+    }
+    /* write() rather than stdio, see sim_console.c */
+    (void)write(STDERR_FILENO, line, (size_t)length);
+}
+
+/*******************************************************************************
+* Function Name: sim_exit
+********************************************************************************
+* Summary:
+*  Finish the output files and end the process
+*
+*******************************************************************************/
+void sim_exit(int status)
+{
+    sim_tdm_close();
+    fflush(stdout);
+    _exit(status);
+}
+
+/*******************************************************************************
+* Function Name: sim_hw_task
+********************************************************************************
+* Summary:
+*  Hardware model - one tick of PDM, TDM and UART activity per iteration
+*
+*******************************************************************************/
+static void sim_hw_task(void *pvParameters)
+{
+    TickType_t last_wake = xTaskGetTickCount();
+    uint32_t frame_credit = 0;
+
+    (void)pvParameters;
+
+    while (1) {
+        uint32_t frames;
+
+        vTaskDelayUntil(&last_wake, 1);
+
+        /* Audio frames in this tick, fraction carried (44.1 kHz) */
+        frame_credit += sim_sample_rate;
+        frames = frame_credit / configTICK_RATE_HZ;
+        frame_credit %= configTICK_RATE_HZ;
+
+        /* Interleave in small slices so both FIFOs see realistic timing;
+         * frame by frame for an exact loopback delay */
+        while (frames > 0u) {
+            uint32_t limit = sim_config.loopback ? 1u : 4u;
+            uint32_t slice = (frames < limit) ? frames : limit;
+            sim_pdm_step(slice);
+            sim_tdm_step(slice);
+            frames -= slice;
+        }
+        sim_i2c_step();
+
+        if (!sim_console_step()) {
+            sim_exit(EXIT_SUCCESS);
+        }
+    }
+}
+
+/*******************************************************************************
+* Function Name: sim_usage
+*******************************************************************************/
+static void sim_usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [options] < script\n"
+            "  --sd DIR              directory used as the SD card (default %s)\n"
+            "  --sd-latency-ms MS    added to every FS_Read/FS_Write call\n"
+            "  --sd-kbps KB          FS_Read/FS_Write bandwidth in KB/s\n"
+            "  --tone HZ[,DBFS]      PDM source: sine (default %u Hz, %d dBFS)\n"
+            "  --noise               PDM source: white noise at the tone level\n"
+            "  --silence             PDM source: zeros\n"
+            "  --ramp                PDM source: frame number since activation (L low, R high 16 bits)\n"
+            "  --pdm-wav FILE        PDM source: 16-bit PCM WAV file\n"
+            "  --pdm-loop            restart the PDM WAV file at its end\n"
+            "  --bursts ON,OFF       gate the PDM source: ON ms of signal, OFF ms of zeros\n"
+            "  --i2s-out FILE        capture the I2S output to a WAV file\n"
+            "  --loopback MS[,DB]    add the I2S output to the PDM source MS later (default %d dB)\n"
+            "  --speed N             run audio and RTOS time N times faster (max %u)\n"
+            "  --linger MS           keep running after stdin ends (default 1000)\n"
+            "  --i2c-errors N        NAK every Nth interrupt-driven codec I2C transfer\n"
+            "  -v                    simulator diagnostics on stderr\n",
+            name, SIM_DEFAULT_SD_DIR, SIM_DEFAULT_TONE_HZ, SIM_DEFAULT_TONE_DBFS,
+            SIM_DEFAULT_LOOPBACK_DB, SIM_MAX_SPEED);
+}
+
+/*******************************************************************************
+* Function Name: sim_parse_options
+*******************************************************************************/
+static int sim_parse_options(int argc, char *argv[])
+{
+    enum {
+        OPT_SD = 256, OPT_SD_LATENCY, OPT_SD_KBPS, OPT_TONE, OPT_NOISE, OPT_SILENCE, OPT_RAMP,
+        OPT_PDM_WAV, OPT_PDM_LOOP, OPT_BURSTS, OPT_I2S_OUT, OPT_LOOPBACK, OPT_SPEED, OPT_LINGER,
+        OPT_I2C_ERRORS
+    };
+    static const struct option options[] = {
+        { "sd",             required_argument, NULL, OPT_SD },
+        { "sd-latency-ms",  required_argument, NULL, OPT_SD_LATENCY },
+        { "sd-kbps",        required_argument, NULL, OPT_SD_KBPS },
+        { "tone",           required_argument, NULL, OPT_TONE },
+        { "noise",          no_argument,       NULL, OPT_NOISE },
+        { "silence",        no_argument,       NULL, OPT_SILENCE },
+        { "ramp",           no_argument,       NULL, OPT_RAMP },
+        { "pdm-wav",        required_argument, NULL, OPT_PDM_WAV },
+        { "pdm-loop",       no_argument,       NULL, OPT_PDM_LOOP },
+        { "bursts",         required_argument, NULL, OPT_BURSTS },
+        { "i2s-out",        required_argument, NULL, OPT_I2S_OUT },
+        { "loopback",       required_argument, NULL, OPT_LOOPBACK },
+        { "speed",          required_argument, NULL, OPT_SPEED },
+        { "linger",         required_argument, NULL, OPT_LINGER },
+        { "i2c-errors",     required_argument, NULL, OPT_I2C_ERRORS },
+        { "help",           no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int option;
+
+    while ((option = getopt_long(argc, argv, "vh", options, NULL)) != -1) {
+        switch (option) {
+            case OPT_SD:            sim_config.sd_dir = optarg; break;
+            case OPT_SD_LATENCY:    sim_config.sd_latency_ms = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case OPT_SD_KBPS:       sim_config.sd_kbps = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case OPT_NOISE:         sim_config.pdm_source = SIM_SOURCE_NOISE; break;
+            case OPT_SILENCE:       sim_config.pdm_source = SIM_SOURCE_SILENCE; break;
+            case OPT_RAMP:          sim_config.pdm_source = SIM_SOURCE_RAMP; break;
+            case OPT_PDM_LOOP:      sim_config.pdm_loop = true; break;
+            case OPT_I2S_OUT:       sim_config.i2s_out = optarg; break;
+            case OPT_LINGER:        sim_config.linger_ms = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case OPT_I2C_ERRORS:    sim_config.i2c_error_every = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'v':               sim_config.verbose = true; break;
+
+            case OPT_TONE: {
+                char *end;
+                sim_config.pdm_source = SIM_SOURCE_TONE;
+                sim_config.tone_hz = (uint32_t)strtoul(optarg, &end, 0);
+                if (*end == ',') {
+                    sim_config.tone_dbfs = (int32_t)strtol(end + 1, NULL, 0);
+                }
+                break;
+            }
+
+            case OPT_BURSTS: {
+                char *end;
+                sim_config.burst_on_ms = (uint32_t)strtoul(optarg, &end, 0);
+                sim_config.burst_off_ms = (*end == ',') ? (uint32_t)strtoul(end + 1, NULL, 0) : 0u;
+                if ((sim_config.burst_on_ms == 0u) || (sim_config.burst_off_ms == 0u)) {
+                    fprintf(stderr, "sim: --bursts needs ON,OFF in ms, both above 0\n");
+                    return -1;
+                }
+                break;
+            }
+
+            case OPT_LOOPBACK: {
+                char *end;
+                sim_config.loopback = true;
+                sim_config.loopback_ms = strtod(optarg, &end);
+                sim_config.loopback_db = (*end == ',') ? (int32_t)strtol(end + 1, NULL, 0) :
+                                         SIM_DEFAULT_LOOPBACK_DB;
+                if ((end == optarg) || (sim_config.loopback_ms < 0.0) ||
+                    (sim_config.loopback_ms > SIM_LOOPBACK_MAX_MS)) {
+                    fprintf(stderr, "sim: --loopback needs a delay of 0..%u ms\n", SIM_LOOPBACK_MAX_MS);
+                    return -1;
+                }
+                break;
+            }
+
+            case OPT_PDM_WAV:
+                sim_config.pdm_source = SIM_SOURCE_WAV;
+                sim_config.pdm_wav = optarg;
+                break;
+
+            case OPT_SPEED:
+                sim_config.speed = (uint32_t)strtoul(optarg, NULL, 0);
+                if ((sim_config.speed < 1u) || (sim_config.speed > SIM_MAX_SPEED)) {
+                    fprintf(stderr, "sim: --speed must be 1..%u\n", SIM_MAX_SPEED);
+                    return -1;
+                }
+                break;
+
+            default:
+                sim_usage(argv[0]);
+                return -1;
+        }
+    }
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: main
+*******************************************************************************/
+int main(int argc, char *argv[])
+{
+    if (sim_parse_options(argc, argv) != 0) {
+        return EXIT_FAILURE;
+    }
+    if ((sim_pdm_open() != 0) || (sim_tdm_open() != 0)) {
+        return EXIT_FAILURE;
+    }
+
+    handle_app_error(cybsp_init());
+    init_retarget_io();
+    FS_Init();      /* Creates the --sd directory if needed */
+
+    printf("****************** \r\n");
+    printf("PSoC Edge MCU: Audio Recorder with FreeRTOS (host simulation)\r\n");
+    printf("PDM Recording + WAV File Storage + I2S Playback\r\n");
+    printf("****************** \r\n\r\n");
+
+    if (xTaskCreate(sim_hw_task, "SimHW", SIM_HW_TASK_STACK_SIZE, NULL,
+                    SIM_HW_TASK_PRIORITY, NULL) != pdPASS) {
+        fprintf(stderr, "sim: cannot create the hardware model task\n");
+        return EXIT_FAILURE;
+    }
+
+    /* Does not return */
+    freertos_system_init();
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,446 @@
+/******************************************************************************
+* File Name: sim_pdm.c
+*
+* Description: Host simulator - PDM/PCM block
+*              Each active channel gets one sample per audio frame from the
+*              configured source (tone, noise, silence, a WAV file or a
+*              frame-number ramp) into a 64-entry FIFO. The source can be gated into bursts of sound
+*              and silence. --loopback adds the I2S output, delayed and
+*              scaled, as if the speaker played into the mics. Even channel
+*              numbers take the left source channel, odd ones the right. The FIFO trigger, overflow and
+*              underflow interrupts behave like the hardware; the gain setting
+*              is recorded but not applied.
+*
+*******************************************************************************/
+
+#include "sim.h"
+#include "cybsp.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define SIM_PDM_NUM_CHANNELS        (8u)
+#define SIM_PDM_FIFO_SIZE           (64u)
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+typedef struct {
+    bool enabled;
+    bool active;
+    uint32_t trigger_level;     /* Trigger when more entries than this */
+    uint32_t status;
+    uint32_t mask;
+    cy_en_pdm_pcm_gain_sel_t gain;
+    int16_t fifo[SIM_PDM_FIFO_SIZE];
+    uint32_t head;
+    uint32_t count;
+} sim_pdm_channel_t;
+
+/*******************************************************************************
+* Global Variables
+*******************************************************************************/
+static PDM_Type sim_pdm0 = { 0 };
+PDM_Type *const PDM0 = &sim_pdm0;
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static sim_pdm_channel_t sim_pdm_channels[SIM_PDM_NUM_CHANNELS];
+
+/* Source state */
+static int16_t *sim_wav_samples = NULL;     /* Interleaved stereo */
+static uint32_t sim_wav_frames = 0;
+static uint32_t sim_wav_position = 0;
+static double sim_tone_phase = 0.0;
+static uint32_t sim_noise_state = 0x12345678u;
+static uint32_t sim_ramp_frame = 0;         /* Frames since the channels were activated */
+static uint32_t sim_burst_position = 0;     /* Frames into the burst cycle */
+
+/*******************************************************************************
+* Function Name: sim_pdm_load_wav
+********************************************************************************
+* Summary:
+*  Load a 16-bit PCM WAV file (mono or stereo) as interleaved stereo
+*
+* Return:
+*  0 on success, -1 on error
+*
+*******************************************************************************/
+static int sim_pdm_load_wav(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    uint8_t riff[12];
+    uint8_t chunk[8];
+    uint16_t format = 0;
+    uint16_t channels = 0;
+    uint32_t rate = 0;
+    uint16_t bits = 0;
+
+    if (file == NULL) {
+        fprintf(stderr, "sim: cannot open %s\n", path);
+        return -1;
+    }
+    if ((fread(riff, 1, sizeof(riff), file) != sizeof(riff)) ||
+        (memcmp(riff, "RIFF", 4) != 0) || (memcmp(&riff[8], "WAVE", 4) != 0)) {
+        fprintf(stderr, "sim: %s is not a WAV file\n", path);
+        fclose(file);
+        return -1;
+    }
+
+    while (fread(chunk, 1, sizeof(chunk), file) == sizeof(chunk)) {
+        uint32_t size;
+        memcpy(&size, &chunk[4], sizeof(size));
+
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            uint8_t fmt[16];
+            if ((size < sizeof(fmt)) || (fread(fmt, 1, sizeof(fmt), file) != sizeof(fmt))) {
+                break;
+            }
+            memcpy(&format, &fmt[0], 2);
+            memcpy(&channels, &fmt[2], 2);
+            memcpy(&rate, &fmt[4], 4);
+            memcpy(&bits, &fmt[14], 2);
+            fseek(file, (long)(size - sizeof(fmt) + (size & 1u)), SEEK_CUR);
+        }
+        else if (memcmp(chunk, "data", 4) == 0) {
+            if (((format != 1u) && (format != 0xFFFEu)) || (bits != 16u) ||
+                (channels < 1u) || (channels > 2u)) {
+                fprintf(stderr, "sim: %s must be 16-bit PCM, mono or stereo\n", path);
+                break;
+            }
+            if (rate != sim_sample_rate) {
+                fprintf(stderr, "sim: %s is %u Hz, PDM runs at %u Hz - played as is\n",
+                        path, (unsigned int)rate, (unsigned int)sim_sample_rate);
+            }
+
+            uint32_t frames = size / (2u * channels);
+            int16_t *raw = malloc((size_t)frames * channels * sizeof(int16_t));
+            sim_wav_samples = malloc((size_t)frames * 2u * sizeof(int16_t));
+            if ((raw == NULL) || (sim_wav_samples == NULL)) {
+                free(raw);
+                break;
+            }
+            frames = (uint32_t)fread(raw, 2u * channels, frames, file);
+            for (uint32_t i = 0; i < frames; i++) {
+                sim_wav_samples[2u * i] = raw[i * channels];
+                sim_wav_samples[2u * i + 1u] = raw[i * channels + channels - 1u];
+            }
+            free(raw);
+            sim_wav_frames = frames;
+            fclose(file);
+            sim_log("PDM source: %s, %u frames\n", path, (unsigned int)frames);
+            return 0;
+        }
+        else {
+            fseek(file, (long)(size + (size & 1u)), SEEK_CUR);
+        }
+    }
+
+    fprintf(stderr, "sim: no usable audio in %s\n", path);
+    fclose(file);
+    return -1;
+}
+
+/*******************************************************************************
+* Function Name: sim_pdm_next_frame
+********************************************************************************
+* Summary:
+*  Produce the next left/right sample pair from the configured source
+*
+*******************************************************************************/
+static void sim_pdm_next_frame(int16_t frame[2])
+{
+    double amplitude = 32767.0 * pow(10.0, (double)sim_config.tone_dbfs / 20.0);
+
+    switch (sim_config.pdm_source) {
+        case SIM_SOURCE_TONE:
+            frame[0] = (int16_t)lrint(amplitude * sin(sim_tone_phase));
+            frame[1] = frame[0];
+            sim_tone_phase += 2.0 * M_PI * (double)sim_config.tone_hz / (double)sim_sample_rate;
+            if (sim_tone_phase > 2.0 * M_PI) {
+                sim_tone_phase -= 2.0 * M_PI;
+            }
+            break;
+
+        case SIM_SOURCE_NOISE:
+            for (uint32_t ch = 0; ch < 2u; ch++) {
+                sim_noise_state = sim_noise_state * 1664525u + 1013904223u;
+                double unit = ((double)(sim_noise_state >> 8) / (double)(1u << 24)) * 2.0 - 1.0;
+                frame[ch] = (int16_t)lrint(amplitude * unit);
+            }
+            break;
+
+        case SIM_SOURCE_WAV:
+            if ((sim_wav_position >= sim_wav_frames) && sim_config.pdm_loop) {
+                sim_wav_position = 0;
+            }
+            if (sim_wav_position < sim_wav_frames) {
+                frame[0] = sim_wav_samples[2u * sim_wav_position];
+                frame[1] = sim_wav_samples[2u * sim_wav_position + 1u];
+                sim_wav_position++;
+                break;
+            }
+            frame[0] = 0;
+            frame[1] = 0;
+            break;
+
+        case SIM_SOURCE_RAMP:
+            frame[0] = (int16_t)(uint16_t)(sim_ramp_frame & 0xFFFFu);
+            frame[1] = (int16_t)(uint16_t)(sim_ramp_frame >> 16);
+            sim_ramp_frame++;
+            break;
+
+        case SIM_SOURCE_SILENCE:
+        default:
+            frame[0] = 0;
+            frame[1] = 0;
+            break;
+    }
+
+    if (sim_config.burst_off_ms > 0u) {
+        uint32_t on = (sim_config.burst_on_ms * sim_sample_rate) / 1000u;
+        uint32_t period = on + (sim_config.burst_off_ms * sim_sample_rate) / 1000u;
+        if (sim_burst_position >= on) {
+            frame[0] = 0;
+            frame[1] = 0;
+        }
+        if (++sim_burst_position >= period) {
+            sim_burst_position = 0;
+        }
+    }
+
+    if (sim_config.loopback) {
+        uint32_t delay = (uint32_t)lrint(sim_config.loopback_ms * (double)sim_sample_rate / 1000.0);
+        double gain = pow(10.0, (double)sim_config.loopback_db / 20.0);
+
+        if (delay == 0u) {
+            delay = 1u;
+        }
+        for (uint32_t ch = 0; ch < 2u; ch++) {
+            long value = frame[ch] + lrint(gain * (double)sim_tdm_history(delay, ch));
+            frame[ch] = (int16_t)((value > 32767) ? 32767 : ((value < -32768) ? -32768 : value));
+        }
+    }
+}
+
+/*******************************************************************************
+* Function Name: sim_pdm_open
+********************************************************************************
+* Summary:
+*  Prepare the PDM source
+*
+* Return:
+*  0 on success, -1 on error
+*
+*******************************************************************************/
+int sim_pdm_open(void)
+{
+    if (sim_config.pdm_source == SIM_SOURCE_WAV) {
+        return sim_pdm_load_wav(sim_config.pdm_wav);
+    }
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: sim_pdm_step
+********************************************************************************
+* Summary:
+*  Advance the PDM block by a number of audio frames, raising channel
+*  interrupts as the FIFOs fill
+*
+*******************************************************************************/
+void sim_pdm_step(uint32_t frames)
+{
+    bool any_active = false;
+
+    for (uint32_t ch = 0; ch < SIM_PDM_NUM_CHANNELS; ch++) {
+        any_active |= sim_pdm_channels[ch].active;
+    }
+    if (!any_active) {
+        return;
+    }
+
+    while (frames-- > 0u) {
+        int16_t frame[2];
+        sim_pdm_next_frame(frame);
+
+        for (uint32_t ch = 0; ch < SIM_PDM_NUM_CHANNELS; ch++) {
+            sim_pdm_channel_t *channel = &sim_pdm_channels[ch];
+            if (!channel->active) {
+                continue;
+            }
+            if (channel->count == SIM_PDM_FIFO_SIZE) {
+                channel->status |= CY_PDM_PCM_INTR_RX_OVERFLOW;
+            }
+            else {
+                channel->fifo[(channel->head + channel->count) % SIM_PDM_FIFO_SIZE] = frame[ch & 1u];
+                channel->count++;
+            }
+            if (channel->count > channel->trigger_level) {
+                channel->status |= CY_PDM_PCM_INTR_RX_TRIGGER;
+            }
+        }
+
+        for (uint32_t ch = 0; ch < SIM_PDM_NUM_CHANNELS; ch++) {
+            if ((sim_pdm_channels[ch].status & sim_pdm_channels[ch].mask) != 0u) {
+                sim_irq_raise(CYBSP_PDM_CHANNEL_IRQ(ch));
+            }
+        }
+    }
+}
+
+/*******************************************************************************
+* PDL functions
+*******************************************************************************/
+cy_en_pdm_pcm_status_t Cy_PDM_PCM_Init(PDM_Type *base, const cy_stc_pdm_pcm_config_v2_t *config)
+{
+    (void)base;
+    (void)config;
+    memset(sim_pdm_channels, 0, sizeof(sim_pdm_channels));
+    return CY_PDM_PCM_SUCCESS;
+}
+
+void Cy_PDM_PCM_DeInit(PDM_Type *base)
+{
+    (void)base;
+    memset(sim_pdm_channels, 0, sizeof(sim_pdm_channels));
+}
+
+cy_en_pdm_pcm_status_t Cy_PDM_PCM_Channel_Init(PDM_Type *base,
+                                               const cy_stc_pdm_pcm_channel_config_t *config,
+                                               uint8_t channel_num)
+{
+    (void)base;
+    if ((config == NULL) || (channel_num >= SIM_PDM_NUM_CHANNELS) ||
+        (config->rxFifoTriglevel >= SIM_PDM_FIFO_SIZE)) {
+        return CY_PDM_PCM_BAD_PARAM;
+    }
+    sim_pdm_channels[channel_num].trigger_level = config->rxFifoTriglevel;
+    return CY_PDM_PCM_SUCCESS;
+}
+
+void Cy_PDM_PCM_Channel_DeInit(PDM_Type *base, uint8_t channel_num)
+{
+    (void)base;
+    if (channel_num < SIM_PDM_NUM_CHANNELS) {
+        memset(&sim_pdm_channels[channel_num], 0, sizeof(sim_pdm_channel_t));
+    }
+}
+
+void Cy_PDM_PCM_Channel_Enable(PDM_Type *base, uint8_t channel_num)
+{
+    (void)base;
+    if (channel_num < SIM_PDM_NUM_CHANNELS) {
+        sim_pdm_channels[channel_num].enabled = true;
+    }
+}
+
+void Cy_PDM_PCM_Channel_Disable(PDM_Type *base, uint8_t channel_num)
+{
+    (void)base;
+    if (channel_num < SIM_PDM_NUM_CHANNELS) {
+        sim_pdm_channels[channel_num].enabled = false;
+        sim_pdm_channels[channel_num].active = false;
+    }
+}
+
+void Cy_PDM_PCM_Activate_Channel(PDM_Type *base, uint8_t channel_num)
+{
+    bool any_active = false;
+
+    (void)base;
+    for (uint32_t ch = 0; ch < SIM_PDM_NUM_CHANNELS; ch++) {
+        any_active |= sim_pdm_channels[ch].active;
+    }
+    if (!any_active) {
+        sim_ramp_frame = 0;     /* The ramp counts from the start of each take */
+    }
+    if ((channel_num < SIM_PDM_NUM_CHANNELS) && sim_pdm_channels[channel_num].enabled) {
+        sim_pdm_channels[channel_num].active = true;
+    }
+}
+
+void Cy_PDM_PCM_DeActivate_Channel(PDM_Type *base, uint8_t channel_num)
+{
+    (void)base;
+    if (channel_num < SIM_PDM_NUM_CHANNELS) {
+        sim_pdm_channel_t *channel = &sim_pdm_channels[channel_num];
+        channel->active = false;
+        channel->head = 0;
+        channel->count = 0;
+        channel->status = 0;
+    }
+}
+
+void Cy_PDM_PCM_SetGain(PDM_Type *base, uint8_t channel_num, cy_en_pdm_pcm_gain_sel_t gain)
+{
+    (void)base;
+    if (channel_num < SIM_PDM_NUM_CHANNELS) {
+        sim_pdm_channels[channel_num].gain = gain;
+        sim_log("PDM channel %u gain code %d\n", (unsigned int)channel_num, (int)gain);
+    }
+}
+
+uint32_t Cy_PDM_PCM_Channel_ReadFifo(PDM_Type *base, uint8_t channel_num)
+{
+    sim_pdm_channel_t *channel;
+    int16_t sample;
+
+    (void)base;
+    if (channel_num >= SIM_PDM_NUM_CHANNELS) {
+        return 0;
+    }
+    channel = &sim_pdm_channels[channel_num];
+    if (channel->count == 0u) {
+        channel->status |= CY_PDM_PCM_INTR_RX_UNDERFLOW;
+        return 0;
+    }
+
+    sample = channel->fifo[channel->head];
+    channel->head = (channel->head + 1u) % SIM_PDM_FIFO_SIZE;
+    channel->count--;
+
+    /* Sign extended, as configured by signExtension */
+    return (uint32_t)(int32_t)sample;
+}
+
+uint32_t Cy_PDM_PCM_Channel_GetNumInFifo(PDM_Type *base, uint8_t channel_num)
+{
+    (void)base;
+    return (channel_num < SIM_PDM_NUM_CHANNELS) ? sim_pdm_channels[channel_num].count : 0u;
+}
+
+uint32_t Cy_PDM_PCM_Channel_GetInterruptStatusMasked(PDM_Type *base, uint8_t channel_num)
+{
+    (void)base;
+    if (channel_num >= SIM_PDM_NUM_CHANNELS) {
+        return 0;
+    }
+    return sim_pdm_channels[channel_num].status & sim_pdm_channels[channel_num].mask;
+}
+
+void Cy_PDM_PCM_Channel_ClearInterrupt(PDM_Type *base, uint8_t channel_num, uint32_t mask)
+{
+    (void)base;
+    if (channel_num < SIM_PDM_NUM_CHANNELS) {
+        sim_pdm_channel_t *channel = &sim_pdm_channels[channel_num];
+        channel->status &= ~mask;
+        /* Level trigger - still above the threshold after the read */
+        if (channel->count > channel->trigger_level) {
+            channel->status |= CY_PDM_PCM_INTR_RX_TRIGGER;
+        }
+    }
+}
+
+void Cy_PDM_PCM_Channel_SetInterruptMask(PDM_Type *base, uint8_t channel_num, uint32_t mask)
+{
+    (void)base;
+    if (channel_num < SIM_PDM_NUM_CHANNELS) {
+        sim_pdm_channels[channel_num].mask = mask;
+    }
+}
@@ -0,0 +1,383 @@
+/******************************************************************************
+* File Name: sim_tdm.c
+*
+* Description: Host simulator - audio TDM (I2S) transmitter
+*              Once enabled and activated, the transmitter takes one frame
+*              (channelNum words) per audio sample period from a 128-word
+*              FIFO. The trigger interrupt is raised while the FIFO holds no
+*              more than fifoTriggerLevel words; an empty FIFO raises the
+*              underflow interrupt and sends silence. Transmitted frames are
+*              appended to the --i2s-out WAV file, one channel per slot, and
+*              slots 0 and 1 kept in a delay line for --loopback, which also
+*              advances while the transmitter is idle.
+*
+*              As the consumer of the frames it checks what a TDM receiver
+*              would notice: a reconfiguration that changes the frame rate
+*              (bit clock divider times slots) is refused, an underflow in
+*              the middle of a frame counts as a slot slip, and the peak of
+*              each slot is reported when the file is closed.
+*
+*******************************************************************************/
+
+#include "sim.h"
+#include "cybsp.h"
+#include <stdio.h>
+#include <string.h>
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define SIM_TDM_FIFO_SIZE           (128u)
+#define SIM_TDM_MAX_CHANNELS        (8u)
+#define SIM_WAV_HEADER_SIZE         (44u)
+#define SIM_TDM_HISTORY_FRAMES      (65536u)    /* Over SIM_LOOPBACK_MAX_MS at 48 kHz */
+
+/*******************************************************************************
+* Global Variables
+*******************************************************************************/
+static TDM_STRUCT_Type sim_tdm_struct0 = { 0 };
+static TDM_TX_STRUCT_Type sim_tdm_struct0_tx = { 0 };
+TDM_STRUCT_Type *const TDM_STRUCT0 = &sim_tdm_struct0;
+TDM_TX_STRUCT_Type *const TDM_STRUCT0_TX = &sim_tdm_struct0_tx;
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static struct {
+    bool enabled;
+    bool active;
+    uint32_t channels;
+    uint32_t trigger_level;     /* Trigger while at most this many words */
+    uint32_t status;
+    uint32_t mask;
+    uint32_t fifo[SIM_TDM_FIFO_SIZE];
+    uint32_t head;
+    uint32_t count;
+    uint32_t frame_div;         /* clkDiv * channelNum of the first configuration */
+    uint32_t slips;             /* Underflows with part of a frame in the FIFO */
+    int32_t peak[SIM_TDM_MAX_CHANNELS];
+} sim_tdm;
+
+static FILE *sim_tdm_sink = NULL;
+static uint32_t sim_tdm_sink_frames = 0;
+static uint32_t sim_tdm_sink_channels = 2;  /* Slots of the first frame written */
+static bool sim_tdm_sink_mismatch = false;
+
+/* Left and right of the frames sent, for the loopback */
+static int16_t sim_tdm_line[SIM_TDM_HISTORY_FRAMES][2];
+static uint32_t sim_tdm_line_head = 0;      /* Next frame written */
+
+/*******************************************************************************
+* Function Name: sim_tdm_update_trigger
+*******************************************************************************/
+static void sim_tdm_update_trigger(void)
+{
+    if (sim_tdm.enabled && (sim_tdm.count <= sim_tdm.trigger_level)) {
+        sim_tdm.status |= CY_TDM_INTR_TX_FIFO_TRIGGER;
+    }
+}
+
+/*******************************************************************************
+* Function Name: sim_tdm_write_header
+********************************************************************************
+* Summary:
+*  Write the sink WAV header for the frames captured so far
+*
+*******************************************************************************/
+static void sim_tdm_write_header(void)
+{
+    uint8_t header[SIM_WAV_HEADER_SIZE];
+    uint32_t data_size = sim_tdm_sink_frames * sim_tdm_sink_channels * 2u;
+    uint32_t value;
+    uint16_t value16;
+
+    memcpy(&header[0], "RIFF", 4);
+    value = data_size + SIM_WAV_HEADER_SIZE - 8u;
+    memcpy(&header[4], &value, 4);
+    memcpy(&header[8], "WAVEfmt ", 8);
+    value = 16u;
+    memcpy(&header[16], &value, 4);
+    value16 = 1u;
+    memcpy(&header[20], &value16, 2);
+    value16 = (uint16_t)sim_tdm_sink_channels;
+    memcpy(&header[22], &value16, 2);
+    memcpy(&header[24], &sim_sample_rate, 4);
+    value = sim_sample_rate * sim_tdm_sink_channels * 2u;
+    memcpy(&header[28], &value, 4);
+    value16 = (uint16_t)(sim_tdm_sink_channels * 2u);
+    memcpy(&header[32], &value16, 2);
+    value16 = 16u;
+    memcpy(&header[34], &value16, 2);
+    memcpy(&header[36], "data", 4);
+    memcpy(&header[40], &data_size, 4);
+
+    fseek(sim_tdm_sink, 0, SEEK_SET);
+    fwrite(header, 1, sizeof(header), sim_tdm_sink);
+    fseek(sim_tdm_sink, 0, SEEK_END);
+}
+
+/*******************************************************************************
+* Function Name: sim_tdm_open
+********************************************************************************
+* Summary:
+*  Create the I2S output WAV file if one was requested. Its channel count
+*  is that of the first frame sent after this call.
+*
+* Return:
+*  0 on success, -1 on error
+*
+*******************************************************************************/
+int sim_tdm_open(void)
+{
+    if (sim_config.i2s_out == NULL) {
+        return 0;
+    }
+    sim_tdm_sink_frames = 0;
+    sim_tdm_sink_mismatch = false;
+    sim_tdm_sink = fopen(sim_config.i2s_out, "w+b");
+    if (sim_tdm_sink == NULL) {
+        fprintf(stderr, "sim: cannot create %s\n", sim_config.i2s_out);
+        return -1;
+    }
+    sim_tdm_write_header();
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: sim_tdm_close
+********************************************************************************
+* Summary:
+*  Finalize the I2S output WAV file
+*
+*******************************************************************************/
+void sim_tdm_close(void)
+{
+    if (sim_tdm_sink != NULL) {
+        char peaks[SIM_TDM_MAX_CHANNELS * 7u + 1u] = "";
+
+        for (uint32_t ch = 0; ch < sim_tdm_sink_channels; ch++) {
+            snprintf(&peaks[strlen(peaks)], sizeof(peaks) - strlen(peaks), " %ld",
+                     (long)sim_tdm.peak[ch]);
+        }
+        sim_tdm_write_header();
+        fclose(sim_tdm_sink);
+        sim_tdm_sink = NULL;
+        sim_log("I2S output: %s, %u frames of %u slots, slot peaks%s, %u slot slips\n",
+                sim_config.i2s_out, (unsigned int)sim_tdm_sink_frames,
+                (unsigned int)sim_tdm_sink_channels, peaks, (unsigned int)sim_tdm.slips);
+    }
+}
+
+/*******************************************************************************
+* Function Name: sim_tdm_history
+********************************************************************************
+* Summary:
+*  Sample sent a number of frames ago; 1 is the last frame sent
+*
+* Parameters:
+*  delay: 1..SIM_TDM_HISTORY_FRAMES - 1
+*  channel: 0 left, 1 right
+*
+*******************************************************************************/
+int16_t sim_tdm_history(uint32_t delay, uint32_t channel)
+{
+    uint32_t index = (sim_tdm_line_head + SIM_TDM_HISTORY_FRAMES - delay) % SIM_TDM_HISTORY_FRAMES;
+    return sim_tdm_line[index][channel & 1u];
+}
+
+/*******************************************************************************
+* Function Name: sim_tdm_record
+********************************************************************************
+* Summary:
+*  Append a sent frame to the loopback delay line
+*
+*******************************************************************************/
+static void sim_tdm_record(const int16_t *frame)
+{
+    sim_tdm_line[sim_tdm_line_head][0] = frame[0];
+    sim_tdm_line[sim_tdm_line_head][1] = frame[1];
+    sim_tdm_line_head = (sim_tdm_line_head + 1u) % SIM_TDM_HISTORY_FRAMES;
+}
+
+/*******************************************************************************
+* Function Name: sim_tdm_step
+********************************************************************************
+* Summary:
+*  Advance the transmitter by a number of audio frames
+*
+*******************************************************************************/
+void sim_tdm_step(uint32_t frames)
+{
+    if (!sim_tdm.enabled || !sim_tdm.active) {
+        /* The line is silent, but the loopback delay still runs */
+        static const int16_t silence[2] = { 0, 0 };
+        while (frames-- > 0u) {
+            sim_tdm_record(silence);
+        }
+        return;
+    }
+
+    while (frames-- > 0u) {
+        int16_t frame[SIM_TDM_MAX_CHANNELS] = { 0 };
+
+        if ((sim_tdm.status & sim_tdm.mask) != 0u) {
+            sim_irq_raise(tdm_0_interrupts_tx_0_IRQn);
+        }
+
+        if (sim_tdm.count < sim_tdm.channels) {
+            if (sim_tdm.count != 0u) {
+                sim_tdm.slips++;
+            }
+            sim_tdm.status |= CY_TDM_INTR_TX_FIFO_UNDERFLOW;
+            sim_tdm.head = (sim_tdm.head + sim_tdm.count) % SIM_TDM_FIFO_SIZE;
+            sim_tdm.count = 0;
+        }
+        else {
+            for (uint32_t ch = 0; ch < sim_tdm.channels; ch++) {
+                int32_t level;
+
+                frame[ch] = (int16_t)sim_tdm.fifo[sim_tdm.head];
+                sim_tdm.head = (sim_tdm.head + 1u) % SIM_TDM_FIFO_SIZE;
+                level = (frame[ch] < 0) ? -(int32_t)frame[ch] : frame[ch];
+                if (level > sim_tdm.peak[ch]) {
+                    sim_tdm.peak[ch] = level;
+                }
+            }
+            sim_tdm.count -= sim_tdm.channels;
+        }
+        sim_tdm_update_trigger();
+        sim_tdm_record(frame);
+
+        if (sim_tdm_sink != NULL) {
+            /* A WAV file has one channel count: the first frame's */
+            if (sim_tdm_sink_frames == 0u) {
+                sim_tdm_sink_channels = sim_tdm.channels;
+            } else if ((sim_tdm.channels != sim_tdm_sink_channels) && !sim_tdm_sink_mismatch) {
+                sim_tdm_sink_mismatch = true;
+                sim_log("TDM: now %u slots, %s keeps %u channels\n", (unsigned int)sim_tdm.channels,
+                        sim_config.i2s_out, (unsigned int)sim_tdm_sink_channels);
+            }
+            fwrite(frame, sizeof(int16_t), sim_tdm_sink_channels, sim_tdm_sink);
+            sim_tdm_sink_frames++;
+        }
+    }
+}
+
+/*******************************************************************************
+* PDL functions
+*******************************************************************************/
+cy_en_tdm_status_t Cy_AudioTDM_Init(TDM_STRUCT_Type *base, const cy_stc_tdm_config_t *config)
+{
+    const cy_stc_tdm_config_tx_t *tx;
+    uint32_t frame_div;
+
+    (void)base;
+    if ((config == NULL) || (config->tx_config == NULL)) {
+        return CY_TDM_BAD_PARAM;
+    }
+    tx = config->tx_config;
+    frame_div = tx->clkDiv * tx->channelNum;
+    if ((tx->channelNum == 0u) || (tx->channelNum > SIM_TDM_MAX_CHANNELS) ||
+        (tx->fifoTriggerLevel >= SIM_TDM_FIFO_SIZE) ||
+        (tx->i2sMode && (tx->channelNum != 2u)) ||
+        (tx->chEn != ((1u << tx->channelNum) - 1u))) {  /* Disabled slots are not modelled */
+        return CY_TDM_BAD_PARAM;
+    }
+    if ((sim_tdm.frame_div != 0u) && (frame_div != sim_tdm.frame_div)) {
+        sim_log("TDM: %u slots with divider %u would change the frame rate\n",
+                (unsigned int)tx->channelNum, (unsigned int)tx->clkDiv);
+        return CY_TDM_BAD_PARAM;
+    }
+    if (sim_tdm.frame_div != 0u) {
+        sim_log("TDM: %u slots, %s format\n", (unsigned int)tx->channelNum,
+                tx->i2sMode ? "I2S" : "TDM");
+    }
+
+    /* The consumer's counts carry over a reconfiguration */
+    sim_tdm.enabled = false;
+    sim_tdm.active = false;
+    sim_tdm.status = 0;
+    sim_tdm.mask = 0;
+    sim_tdm.head = 0;
+    sim_tdm.count = 0;
+    sim_tdm.channels = tx->channelNum;
+    sim_tdm.trigger_level = tx->fifoTriggerLevel;
+    sim_tdm.frame_div = frame_div;
+    return CY_TDM_SUCCESS;
+}
+
+void Cy_AudioTDM_DeInit(TDM_STRUCT_Type *base)
+{
+    (void)base;
+    sim_tdm.enabled = false;
+    sim_tdm.active = false;
+}
+
+void Cy_AudioTDM_EnableTx(TDM_TX_STRUCT_Type *base)
+{
+    (void)base;
+    sim_tdm.enabled = true;
+    sim_tdm_update_trigger();
+}
+
+void Cy_AudioTDM_DisableTx(TDM_TX_STRUCT_Type *base)
+{
+    (void)base;
+    /* Disabling flushes the FIFO */
+    sim_tdm.enabled = false;
+    sim_tdm.active = false;
+    sim_tdm.head = 0;
+    sim_tdm.count = 0;
+    sim_tdm.status = 0;
+}
+
+void Cy_AudioTDM_ActivateTx(TDM_TX_STRUCT_Type *base)
+{
+    (void)base;
+    sim_tdm.active = sim_tdm.enabled;
+}
+
+void Cy_AudioTDM_DeActivateTx(TDM_TX_STRUCT_Type *base)
+{
+    (void)base;
+    sim_tdm.active = false;
+}
+
+void Cy_AudioTDM_WriteTxData(TDM_TX_STRUCT_Type *base, uint32_t data)
+{
+    (void)base;
+    if (!sim_tdm.enabled) {
+        return;
+    }
+    if (sim_tdm.count == SIM_TDM_FIFO_SIZE) {
+        sim_tdm.status |= CY_TDM_INTR_TX_FIFO_OVERFLOW;
+        return;
+    }
+    sim_tdm.fifo[(sim_tdm.head + sim_tdm.count) % SIM_TDM_FIFO_SIZE] = data;
+    sim_tdm.count++;
+}
+
+uint32_t Cy_AudioTDM_GetNumInTxFifo(TDM_TX_STRUCT_Type *base)
+{
+    (void)base;
+    return sim_tdm.count;
+}
+
+uint32_t Cy_AudioTDM_GetTxInterruptStatusMasked(TDM_TX_STRUCT_Type *base)
+{
+    (void)base;
+    return sim_tdm.status & sim_tdm.mask;
+}
+
+void Cy_AudioTDM_ClearTxInterrupt(TDM_TX_STRUCT_Type *base, uint32_t mask)
+{
+    (void)base;
+    sim_tdm.status &= ~mask;
+    sim_tdm_update_trigger();
+}
+
+void Cy_AudioTDM_SetTxInterruptMask(TDM_TX_STRUCT_Type *base, uint32_t mask)
+{
+    (void)base;
+    sim_tdm.mask = mask;
+}
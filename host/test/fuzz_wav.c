@@ -0,0 +1,480 @@
+/******************************************************************************
+* File Name: fuzz_wav.c
+*
+* Description: Host test - fuzz harness for the RIFF chunk walker
+*              Runs wav_chunk_first(), wav_chunk_next(), wav_parse() and
+*              parse_wav_header() from wav_file.c on every seed file and
+*              on random mutations of them, with emFile replaced by a file
+*              in memory. Built with AddressSanitizer and UBSan, so a read
+*              past a buffer or an overflow stops the run. On top of that
+*              every result is checked against what the functions promise:
+*              - riff_end never lies past the end of the file
+*              - each chunk starts where the previous one said, its body
+*                ends inside the RIFF list and the next header is further on
+*              - a parsed file has a valid format and its samples, a whole
+*                number of frames, are inside the file, where it is positioned
+*              A failing input is written to fuzz-failure.wav.
+*
+*              fuzz_wav [-n ITERATIONS] [-s SEED] SEED_FILE_OR_DIR...
+*
+*              Built with -DFUZZ_LIBFUZZER the file provides only
+*              LLVMFuzzerTestOneInput(), for clang -fsanitize=fuzzer.
+*
+*******************************************************************************/
+
+#include "wav_file.h"
+#include "settings.h"
+#include "FS.h"
+#include <dirent.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define FUZZ_MAX_SEEDS              (256u)
+#define FUZZ_MAX_INPUT              (65536u)
+#define FUZZ_MAX_WALK               (100000u)   /* Chunks, far more than any input holds */
+#define FUZZ_DEFAULT_ITERATIONS     (100000u)
+#define FUZZ_FAILURE_FILENAME       "fuzz-failure.wav"
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+/* emFile stand-in: a read-only file in memory */
+struct FS_FILE {
+    const uint8_t *data;
+    uint32_t size;
+    uint32_t position;
+};
+
+typedef struct {
+    uint8_t *data;
+    uint32_t size;
+} fuzz_input_t;
+
+/*******************************************************************************
+* Global Variables
+*******************************************************************************/
+settings_t app_settings;        /* wav_file.c reads the write slice size */
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static const uint8_t *fuzz_data;    /* Input being checked, for the report */
+static uint32_t fuzz_size;
+static uint64_t fuzz_state = 1u;
+
+/*******************************************************************************
+* emFile stand-in
+*******************************************************************************/
+int FS_FSeek(FS_FILE *pFile, I32 Offset, int Origin)
+{
+    int64_t base = (Origin == FS_SEEK_CUR) ? pFile->position :
+                   (Origin == FS_SEEK_END) ? pFile->size : 0;
+
+    /* Like emFile, seeking past the end is allowed; reads there return 0 */
+    if ((base + Offset) < 0) {
+        return -1;
+    }
+    pFile->position = (uint32_t)(base + Offset);
+    return 0;
+}
+
+I32 FS_FTell(FS_FILE *pFile)
+{
+    return (I32)pFile->position;
+}
+
+U32 FS_Read(FS_FILE *pFile, void *pData, U32 NumBytes)
+{
+    uint32_t available = (pFile->position < pFile->size) ? (pFile->size - pFile->position) : 0u;
+    uint32_t count = (NumBytes < available) ? NumBytes : available;
+
+    memcpy(pData, &pFile->data[pFile->position], count);
+    pFile->position += count;
+    return count;
+}
+
+U32 FS_GetFileSize(const FS_FILE *pFile)
+{
+    return pFile->size;
+}
+
+/* The writers in wav_file.c are linked but not exercised */
+FS_FILE *FS_FOpen(const char *pFileName, const char *pMode)
+{
+    (void)pFileName;
+    (void)pMode;
+    return NULL;
+}
+
+U32 FS_Write(FS_FILE *pFile, const void *pData, U32 NumBytes)
+{
+    (void)pFile;
+    (void)pData;
+    (void)NumBytes;
+    return 0;
+}
+
+int FS_FClose(FS_FILE *pFile)
+{
+    (void)pFile;
+    return -1;
+}
+
+/* bext time stamps are not exercised either */
+uint32_t wall_clock_ms_since_midnight(const wall_clock_time_t *time)
+{
+    (void)time;
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: fuzz_fail
+********************************************************************************
+* Summary:
+*  Report a broken promise, save the input and stop
+*
+*******************************************************************************/
+static void fuzz_fail(const char *format, ...)
+{
+    va_list args;
+    FILE *out;
+
+    fprintf(stderr, "fuzz_wav: ");
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fprintf(stderr, " (%u byte input saved as %s)\n", (unsigned int)fuzz_size, FUZZ_FAILURE_FILENAME);
+
+    out = fopen(FUZZ_FAILURE_FILENAME, "wb");
+    if (out != NULL) {
+        (void)fwrite(fuzz_data, 1, fuzz_size, out);
+        fclose(out);
+    }
+    abort();
+}
+
+/*******************************************************************************
+* Function Name: fuzz_check_walk
+********************************************************************************
+* Summary:
+*  Walk the chunk list the way wav_parse() does, without its chunk limit,
+*  and check every step
+*
+*******************************************************************************/
+static void fuzz_check_walk(FS_FILE *file)
+{
+    wav_chunk_t chunk;
+    uint32_t riff_end;
+    uint32_t position = WAV_RIFF_HEADER_SIZE;
+    uint32_t count;
+
+    if (wav_chunk_first(file, &riff_end) != 0) {
+        return;
+    }
+    if (riff_end > file->size) {
+        fuzz_fail("riff_end %u past the %u byte file", riff_end, file->size);
+    }
+
+    for (count = 0; count < FUZZ_MAX_WALK; count++) {
+        if (wav_chunk_next(file, position, riff_end, &chunk) != 0) {
+            return;
+        }
+        if (chunk.offset != position + WAV_CHUNK_HEADER_SIZE) {
+            fuzz_fail("chunk at %u has its body at %u", position, chunk.offset);
+        }
+        if ((uint64_t)chunk.offset + chunk.size > riff_end) {
+            fuzz_fail("chunk '%.4s' at %u: %u bytes run past riff_end %u",
+                      (const char *)chunk.id, position, chunk.size, riff_end);
+        }
+        if ((chunk.next < chunk.offset + chunk.size) || (chunk.next > riff_end) ||
+            (chunk.next <= position)) {
+            fuzz_fail("chunk '%.4s' at %u: next %u (body end %u, riff_end %u)",
+                      (const char *)chunk.id, position, chunk.next,
+                      chunk.offset + chunk.size, riff_end);
+        }
+        if ((chunk.next != chunk.offset + chunk.size + (chunk.size & 1u)) && (chunk.next != riff_end)) {
+            fuzz_fail("chunk '%.4s' at %u: next %u skips or misses the pad byte",
+                      (const char *)chunk.id, position, chunk.next);
+        }
+        position = chunk.next;
+    }
+    fuzz_fail("chunk walk did not end after %u chunks", FUZZ_MAX_WALK);
+}
+
+/*******************************************************************************
+* Function Name: fuzz_check_parse
+********************************************************************************
+* Summary:
+*  Check what wav_parse() and parse_wav_header() report for an input
+*
+*******************************************************************************/
+static void fuzz_check_parse(FS_FILE *file)
+{
+    wav_info_t info;
+    uint32_t total_samples;
+
+    if (wav_parse(file, &info) == 0) {
+        if ((info.audio_format != WAV_FORMAT_PCM) || (info.num_channels == 0u) ||
+            (info.block_align == 0u)) {
+            fuzz_fail("accepted format %u, %u channels, block_align %u",
+                      info.audio_format, info.num_channels, info.block_align);
+        }
+        if ((uint64_t)info.data_offset + info.data_bytes > file->size) {
+            fuzz_fail("data %u+%u past the %u byte file", info.data_offset, info.data_bytes, file->size);
+        }
+        if ((info.data_bytes % info.block_align) != 0u) {
+            fuzz_fail("%u data bytes are not whole %u byte frames", info.data_bytes, info.block_align);
+        }
+        if (file->position != info.data_offset) {
+            fuzz_fail("left at %u instead of the data at %u", file->position, info.data_offset);
+        }
+    }
+
+    if (parse_wav_header(file, &total_samples) == 0) {
+        if ((uint64_t)file->position + total_samples * sizeof(int16_t) > file->size) {
+            fuzz_fail("%u samples at %u run past the %u byte file",
+                      total_samples, file->position, file->size);
+        }
+    }
+}
+
+/*******************************************************************************
+* Function Name: LLVMFuzzerTestOneInput
+********************************************************************************
+* Summary:
+*  Check one input
+*
+*******************************************************************************/
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    FS_FILE file = { .data = data, .size = (uint32_t)size, .position = 0 };
+
+    fuzz_data = data;
+    fuzz_size = (uint32_t)size;
+
+    fuzz_check_walk(&file);
+    file.position = 0;
+    fuzz_check_parse(&file);
+    return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+
+/*******************************************************************************
+* Function Name: fuzz_random
+********************************************************************************
+* Summary:
+*  xorshift64*, so a run can be repeated with -s
+*
+*******************************************************************************/
+static uint32_t fuzz_random(uint32_t limit)
+{
+    fuzz_state ^= fuzz_state >> 12;
+    fuzz_state ^= fuzz_state << 25;
+    fuzz_state ^= fuzz_state >> 27;
+    return (limit == 0u) ? 0u : (uint32_t)(((fuzz_state * 0x2545F4914F6CDD1Dull) >> 32) % limit);
+}
+
+/*******************************************************************************
+* Function Name: fuzz_mutate
+********************************************************************************
+* Summary:
+*  Apply one random change to an input, aimed at the chunk structure: sizes
+*  near the interesting boundaries, chunk IDs, truncation, and bytes added
+*  or removed so that padding and offsets shift
+*
+*******************************************************************************/
+static void fuzz_mutate(uint8_t *data, uint32_t *size)
+{
+    static const uint32_t sizes[] = {
+        0u, 1u, 2u, 7u, 8u, 15u, 16u, 17u, 18u, 39u, 40u, 41u,
+        0x7FFFFFFFu, 0x80000000u, 0xFFFFFFF7u, 0xFFFFFFF8u, 0xFFFFFFFFu
+    };
+    static const char *const ids[] = { "RIFF", "WAVE", "fmt ", "data", "LIST", "JUNK", "bext", "take" };
+    uint32_t at;
+    uint32_t value;
+
+    switch (fuzz_random(7)) {
+        case 0:     /* Flip a bit */
+            if (*size > 0u) {
+                data[fuzz_random(*size)] ^= (uint8_t)(1u << fuzz_random(8));
+            }
+            break;
+
+        case 1:     /* A 32-bit field near a boundary, mostly on a chunk size */
+            if (*size >= 4u) {
+                at = fuzz_random(*size - 3u);
+                value = sizes[fuzz_random(sizeof(sizes) / sizeof(sizes[0]))];
+                if (fuzz_random(2) == 0u) {
+                    value = *size - at + fuzz_random(9) - 4u;   /* Around the end of the file */
+                }
+                data[at] = (uint8_t)value;
+                data[at + 1u] = (uint8_t)(value >> 8);
+                data[at + 2u] = (uint8_t)(value >> 16);
+                data[at + 3u] = (uint8_t)(value >> 24);
+            }
+            break;
+
+        case 2:     /* A chunk ID */
+            if (*size >= 4u) {
+                memcpy(&data[fuzz_random(*size - 3u)], ids[fuzz_random(sizeof(ids) / sizeof(ids[0]))], 4);
+            }
+            break;
+
+        case 3:     /* Truncate */
+            *size = fuzz_random(*size + 1u);
+            break;
+
+        case 4:     /* Remove 1 to 8 bytes */
+            if (*size > 0u) {
+                uint32_t count = 1u + fuzz_random(8);
+                at = fuzz_random(*size);
+                count = (count > *size - at) ? (*size - at) : count;
+                memmove(&data[at], &data[at + count], *size - at - count);
+                *size -= count;
+            }
+            break;
+
+        case 5:     /* Insert 1 to 8 bytes */
+            if (*size + 8u <= FUZZ_MAX_INPUT) {
+                uint32_t count = 1u + fuzz_random(8);
+                at = fuzz_random(*size + 1u);
+                memmove(&data[at + count], &data[at], *size - at);
+                for (uint32_t i = 0; i < count; i++) {
+                    data[at + i] = (uint8_t)fuzz_random(256);
+                }
+                *size += count;
+            }
+            break;
+
+        default:    /* Copy a stretch over another, duplicating chunk headers */
+            if (*size >= 16u) {
+                uint32_t count = 1u + fuzz_random(64);
+                uint32_t from = fuzz_random(*size);
+                at = fuzz_random(*size);
+                count = (count > *size - from) ? (*size - from) : count;
+                count = (count > *size - at) ? (*size - at) : count;
+                memmove(&data[at], &data[from], count);
+            }
+            break;
+    }
+}
+
+/*******************************************************************************
+* Function Name: fuzz_load
+********************************************************************************
+* Summary:
+*  Load a seed file, or every file of a seed directory
+*
+* Return:
+*  Number of seeds now loaded
+*
+*******************************************************************************/
+static uint32_t fuzz_load(const char *path, fuzz_input_t *seeds, uint32_t count)
+{
+    struct stat info;
+    FILE *in;
+
+    if (stat(path, &info) != 0) {
+        fprintf(stderr, "fuzz_wav: cannot open %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    if (S_ISDIR(info.st_mode)) {
+        DIR *dir = opendir(path);
+        struct dirent *entry;
+        char name[1024];
+
+        while ((dir != NULL) && ((entry = readdir(dir)) != NULL)) {
+            if (entry->d_name[0] != '.') {
+                snprintf(name, sizeof(name), "%s/%s", path, entry->d_name);
+                count = fuzz_load(name, seeds, count);
+            }
+        }
+        if (dir != NULL) {
+            closedir(dir);
+        }
+        return count;
+    }
+
+    if ((count >= FUZZ_MAX_SEEDS) || (info.st_size > (off_t)FUZZ_MAX_INPUT)) {
+        fprintf(stderr, "fuzz_wav: skipping %s\n", path);
+        return count;
+    }
+    in = fopen(path, "rb");
+    seeds[count].data = malloc(FUZZ_MAX_INPUT);
+    if ((in == NULL) || (seeds[count].data == NULL)) {
+        fprintf(stderr, "fuzz_wav: cannot read %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    seeds[count].size = (uint32_t)fread(seeds[count].data, 1, FUZZ_MAX_INPUT, in);
+    fclose(in);
+    return count + 1u;
+}
+
+/*******************************************************************************
+* Function Name: main
+*******************************************************************************/
+int main(int argc, char *argv[])
+{
+    static fuzz_input_t seeds[FUZZ_MAX_SEEDS];
+    static uint8_t input[FUZZ_MAX_INPUT];
+    unsigned long iterations = FUZZ_DEFAULT_ITERATIONS;
+    unsigned long long seed = 1;
+    uint32_t count = 0;
+    int option;
+
+    while ((option = getopt(argc, argv, "n:s:")) != -1) {
+        switch (option) {
+            case 'n': iterations = strtoul(optarg, NULL, 0); break;
+            case 's': seed = strtoull(optarg, NULL, 0); break;
+            default:
+                fprintf(stderr, "Usage: %s [-n ITERATIONS] [-s SEED] SEED_FILE_OR_DIR...\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    for (int i = optind; i < argc; i++) {
+        count = fuzz_load(argv[i], seeds, count);
+    }
+    if (count == 0u) {
+        fprintf(stderr, "fuzz_wav: no seeds\n");
+        return EXIT_FAILURE;
+    }
+    fuzz_state = (seed * 0x9E3779B97F4A7C15ull) ^ 0xD1B54A32D192ED03ull;
+    if (fuzz_state == 0u) {
+        fuzz_state = 1u;    /* xorshift stays at zero */
+    }
+
+    /* The parser reports every malformed file on the console */
+    if (freopen("/dev/null", "w", stdout) == NULL) {
+        return EXIT_FAILURE;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        (void)LLVMFuzzerTestOneInput(seeds[i].data, seeds[i].size);
+    }
+
+    for (unsigned long n = 0; n < iterations; n++) {
+        const fuzz_input_t *from = &seeds[fuzz_random(count)];
+        uint32_t size = from->size;
+        uint32_t changes = 1u + fuzz_random(4);
+
+        memcpy(input, from->data, size);
+        while (changes-- > 0u) {
+            fuzz_mutate(input, &size);
+        }
+        (void)LLVMFuzzerTestOneInput(input, size);
+    }
+
+    fprintf(stderr, "fuzz_wav: %u seeds and %lu mutations checked\n", (unsigned int)count, iterations);
+    return EXIT_SUCCESS;
+}
+
+#endif /* FUZZ_LIBFUZZER */
@@ -0,0 +1,325 @@
+#!/usr/bin/env python3
+"""
+Scripted sessions on the host simulator, checked against the console
+output and the files they leave behind.
+
+Each scenario runs build/audio_sim in a scratch directory with its own SD
+card directory, feeds it a CLI script on stdin and then inspects the takes
+on the card and the I2S output (--i2s-out). A scenario fails with the first
+check that does not hold.
+
+Usage:
+    scenarios.py build/audio_sim [scenario ...] [--keep]
+
+`make test` runs all of them.
+"""
+
+import argparse
+import array
+import math
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import wave
+
+FULL_SCALE = 32768.0
+SAMPLE_RATE = 16000
+SIM_TIMEOUT_S = 120
+
+SCENARIOS = []
+
+
+def scenario(func):
+    """Register a scenario; it runs in the order of definition."""
+    SCENARIOS.append(func)
+    return func
+
+
+class Failure(Exception):
+    pass
+
+
+def check(condition, message, *args):
+    if not condition:
+        raise Failure(message % args)
+
+
+class Wav:
+    """16-bit PCM WAV file: samples[channel] is an array of that channel."""
+
+    def __init__(self, path):
+        check(os.path.exists(path), "%s was not written", os.path.basename(path))
+        with wave.open(path, "rb") as wav:
+            check(wav.getsampwidth() == 2, "%s is not 16-bit", path)
+            self.channels = wav.getnchannels()
+            self.rate = wav.getframerate()
+            self.frames = wav.getnframes()
+            data = array.array("h", wav.readframes(self.frames))
+        if sys.byteorder != "little":
+            data.byteswap()
+        self.samples = [data[c :: self.channels] for c in range(self.channels)]
+
+    def active(self, channel, threshold=1):
+        """First and last frame whose magnitude reaches threshold."""
+        samples = self.samples[channel]
+        loud = [i for i, v in enumerate(samples) if abs(v) >= threshold]
+        return (loud[0], loud[-1]) if loud else (None, None)
+
+
+def write_tone(path, seconds, hz=1000, dbfs=-12.0, channels=2):
+    """Write a 16-bit WAV file of a sine at the simulator's sample rate."""
+    amplitude = FULL_SCALE * 10.0 ** (dbfs / 20.0)
+    data = array.array("h")
+    for n in range(int(seconds * SAMPLE_RATE)):
+        value = int(round(amplitude * math.sin(2.0 * math.pi * hz * n / SAMPLE_RATE)))
+        data.extend([value] * channels)
+    if sys.byteorder != "little":
+        data.byteswap()
+    with wave.open(path, "wb") as wav:
+        wav.setnchannels(channels)
+        wav.setsampwidth(2)
+        wav.setframerate(SAMPLE_RATE)
+        wav.writeframes(data.tobytes())
+
+
+def read_bytes(path):
+    with open(path, "rb") as f:
+        return f.read()
+
+
+def rms_dbfs(samples):
+    if len(samples) == 0:
+        return -math.inf
+    power = sum(float(v) * v for v in samples) / len(samples)
+    return 10.0 * math.log10(power / (FULL_SCALE * FULL_SCALE)) if power > 0 else -math.inf
+
+
+class Sim:
+    """One run of the simulator, with the SD card and outputs in workdir."""
+
+    def __init__(self, binary, workdir):
+        self.binary = binary
+        self.workdir = workdir
+        self.sd = os.path.join(workdir, "sd")
+        os.makedirs(self.sd, exist_ok=True)
+        self.console = ""
+
+    def path(self, name):
+        return os.path.join(self.workdir, name)
+
+    def card(self, name):
+        return os.path.join(self.sd, name)
+
+    def run(self, script, *options, expected_errors=()):
+        """Feed script to the CLI and return the console output. Console
+        errors fail the scenario unless they contain one of expected_errors."""
+        command = [self.binary, "--sd", self.sd] + [str(o) for o in options]
+        result = subprocess.run(command, input=script.encode(), cwd=self.workdir,
+                                stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                                timeout=SIM_TIMEOUT_S)
+        self.console = result.stdout.decode(errors="replace").replace("\r\n", "\n")
+        with open(self.path("console.txt"), "a") as log:
+            log.write("$ %s\n%s" % (" ".join(command), self.console))
+        check(result.returncode == 0, "audio_sim exited with %d: %s", result.returncode,
+              result.stderr.decode(errors="replace").strip())
+        errors = [line for line in self.console.splitlines() if "Error:" in line and
+                  not any(expected in line for expected in expected_errors)]
+        check(not errors, "console reported: %s", "; ".join(errors))
+        return self.console
+
+
+@scenario
+def record_play(sim):
+    """A 1 s take of a -12 dBFS tone is saved and played back unchanged."""
+    sim.run("record 1\n!sleep 2000\nls\nplay audio_001.wav\n!sleep 2000\n",
+            "--speed", 10, "--tone", "1000,-12", "--i2s-out", "out.wav")
+
+    take = Wav(sim.card("audio_001.wav"))
+    check(take.channels == 2 and take.rate == SAMPLE_RATE,
+          "take is %d channels at %d Hz", take.channels, take.rate)
+    check(take.frames == SAMPLE_RATE, "take has %d frames, expected %d", take.frames, SAMPLE_RATE)
+    level = rms_dbfs(take.samples[0])
+    check(abs(level - (-12.0 - 3.01)) < 1.0, "take RMS %.1f dBFS, expected -15.0", level)
+
+    out = Wav(sim.path("out.wav"))
+    first, last = out.active(0)
+    check(first is not None, "nothing was played")
+    length = last - first + 1
+    check(abs(length - take.frames) <= 16, "played %d frames of a %d frame take", length, take.frames)
+    middle = out.samples[0][first + 1600 : last - 1600]
+    played = rms_dbfs(middle)
+    check(abs(played - level) < 0.5, "played RMS %.1f dBFS, take %.1f dBFS", played, level)
+
+
+@scenario
+def exact_length(sim):
+    """Timed takes of the frame-number ramp hold exactly the frames asked
+    for, starting after the 'filter settle' frames, with none lost. A length
+    whose milliseconds overflow is refused. The settle frames are a setting
+    that 'config save' keeps across a reset."""
+    console = sim.run("record 5000000\nrecord 2.5\n!sleep 3500\nrecord 1001 frames\n!sleep 1000\n"
+                      "filter settle 0\nrecord 0.1\n!sleep 1000\nconfig save\nls\n",
+                      "--speed", 10, "--ramp")
+    check("Usage: record" in console, "record 5000000 was not refused")
+    check(not os.path.exists(sim.card("audio_004.wav")), "a fourth take was recorded")
+    takes = [("audio_001.wav", 40000, 64), ("audio_002.wav", 1001, 64), ("audio_003.wav", 1600, 0)]
+    check_takes(sim, takes)
+
+    # After a reset the numbering starts over, so this take replaces the first
+    sim.run("record 1000 frames\n!sleep 1000\n", "--speed", 10, "--ramp")
+    check_takes(sim, [("audio_001.wav", 1000, 0)])
+
+
+def check_takes(sim, takes):
+    """Each (name, frames, first) take holds frames frames of the ramp,
+    starting at frame number first."""
+    for name, frames, first in takes:
+        take = Wav(sim.card(name))
+        check(take.frames == frames, "%s has %d frames, expected %d", name, take.frames, frames)
+        # The ramp is the frame number: low 16 bits left, high 16 bits right
+        for n in range(take.frames):
+            number = first + n
+            expected = (number & 0xFFFF) - (0x10000 if number & 0x8000 else 0)
+            left, right = take.samples[0][n], take.samples[1][n]
+            check(left == expected and right == number >> 16,
+                  "%s frame %d is ramp frame %d, expected %d", name, n,
+                  (left & 0xFFFF) | (right << 16), number)
+
+
+@scenario
+def end_fade(sim):
+    """A file that plays to its end fades out over its last 10 ms instead of
+    being cut off."""
+    write_tone(sim.card("tone.wav"), 0.5, hz=1000, dbfs=-6.0)
+    sim.run("play tone.wav\n!sleep 1500\n", "--speed", 10, "--i2s-out", "out.wav")
+
+    out = Wav(sim.path("out.wav"))
+    first, last = out.active(0)
+    check(first is not None, "nothing was played")
+    samples = out.samples[0]
+    period = SAMPLE_RATE // 1000
+    ramp = SAMPLE_RATE // 100
+
+    def peak(end):
+        """Peak of the cycle that ends at frame end."""
+        return max(abs(v) for v in samples[end - period + 1 : end + 1])
+
+    level = peak(last - ramp - period)
+    check(level > 0.8 * FULL_SCALE * 10.0 ** (-6.0 / 20.0),
+          "peak %d before the fade, expected the tone's", level)
+    # Cycle by cycle back from the end: the last one quiet, each one louder
+    cycles = [peak(last - k * period) for k in range(ramp // period)]
+    check(cycles[0] < 0.15 * level, "last cycle peaks at %d of %d: cut off", cycles[0], level)
+    check(all(later <= earlier + 2 for later, earlier in zip(cycles, cycles[1:])),
+          "the level rises during the fade: %s", cycles[::-1])
+
+
+@scenario
+def stop_fade(sim):
+    """'stop' ends a file play early with the same fade, and the next play
+    is not affected."""
+    write_tone(sim.card("long.wav"), 2.0, hz=1000, dbfs=-6.0)
+    console = sim.run("play long.wav\n!sleep 500\nstop\n!sleep 500\nplay long.wav\n!sleep 3000\n",
+                      "--speed", 10, "--i2s-out", "out.wav")
+    check("Playback stopped." in console, "stop did not end the play")
+    check("Playback complete" in console, "the next play did not finish")
+
+    out = Wav(sim.path("out.wav"))
+    samples = out.samples[0]
+    period = SAMPLE_RATE // 1000
+    first, _ = out.active(0)
+    check(first is not None, "nothing was played")
+    # The stopped play ends at the first silent stretch longer than a cycle
+    end = first
+    while any(samples[end : end + 2 * period]):
+        end += period
+    end = max(n for n in range(end - period, end + 2 * period) if samples[n] != 0)
+    check(end - first < SAMPLE_RATE, "stopped play lasted %d frames", end - first + 1)
+    level = max(abs(v) for v in samples[first + period : end - 2 * SAMPLE_RATE // 100])
+    last = max(abs(v) for v in samples[end - period + 1 : end + 1])
+    check(last < 0.15 * level, "last cycle peaks at %d of %d: cut off", last, level)
+    second = [n for n in range(end + 2 * period, len(samples)) if samples[n] != 0]
+    length = second[-1] - second[0] + 1 if second else 0
+    check(abs(length - 2 * SAMPLE_RATE) <= 16, "the next play has %d frames", length)
+
+
+@scenario
+def upload_recovery(sim):
+    """An upload commit cut off by a reset is finished or rolled back at boot."""
+    old = sim.path("old.wav")
+    new = sim.path("new.wav")
+    write_tone(old, 0.5, hz=440)
+    write_tone(new, 0.25, hz=880)
+
+    def reset_card(target, backup, temp):
+        for name in os.listdir(sim.sd):
+            os.remove(sim.card(name))
+        for name, source in (("up.wav", target), ("upload.bak", backup), ("upload.tmp", temp)):
+            if source is not None:
+                shutil.copyfile(source, sim.card(name))
+
+    def leftovers():
+        return sorted(n for n in os.listdir(sim.sd) if n.startswith("upload."))
+
+    # Reset after the old file was moved aside: the new one is moved into place
+    reset_card(None, old, new)
+    with open(sim.card("upload.dst"), "w") as f:
+        f.write("up.wav")
+    console = sim.run("ls\n")
+    check("Finished the interrupted upload of 'up.wav'" in console, "commit was not finished")
+    check(read_bytes(sim.card("up.wav")) == read_bytes(new), "up.wav is not the new upload")
+    check(not leftovers(), "left behind: %s", " ".join(leftovers()))
+
+    # Same, but the upload cannot be used: the old file is moved back
+    reset_card(None, old, None)
+    with open(sim.card("upload.tmp"), "wb") as f:
+        f.write(read_bytes(new)[:30])
+    with open(sim.card("upload.dst"), "w") as f:
+        f.write("up.wav")
+    console = sim.run("ls\n", expected_errors=("[WavFile] Error:",))
+    check("Restored 'up.wav'" in console, "old file was not restored")
+    check(read_bytes(sim.card("up.wav")) == read_bytes(old), "up.wav is not the old file")
+    check(not leftovers(), "left behind: %s", " ".join(leftovers()))
+
+    # Reset during the transfer: the partial upload goes, the old file stays
+    reset_card(old, None, new)
+    sim.run("ls\n")
+    check(read_bytes(sim.card("up.wav")) == read_bytes(old), "up.wav was replaced")
+    check(not leftovers(), "left behind: %s", " ".join(leftovers()))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("binary", help="path to audio_sim")
+    parser.add_argument("names", nargs="*", help="scenarios to run (default all)")
+    parser.add_argument("--keep", action="store_true", help="keep the scratch directories")
+    args = parser.parse_args()
+
+    binary = os.path.abspath(args.binary)
+    selected = [s for s in SCENARIOS if not args.names or s.__name__ in args.names]
+    unknown = set(args.names) - set(s.__name__ for s in SCENARIOS)
+    if unknown:
+        parser.error("unknown scenario: %s" % ", ".join(sorted(unknown)))
+
+    failed = 0
+    for func in selected:
+        workdir = tempfile.mkdtemp(prefix="sim_%s_" % func.__name__)
+        try:
+            func(Sim(binary, workdir))
+            print("PASS %s" % func.__name__)
+        except (Failure, subprocess.TimeoutExpired) as error:
+            print("FAIL %s: %s (%s)" % (func.__name__, error, workdir))
+            failed += 1
+            continue
+        if not args.keep:
+            shutil.rmtree(workdir)
+
+    print("%d of %d scenarios passed" % (len(selected) - failed, len(selected)))
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,136 @@
+/******************************************************************************
+* File Name: test.c
+*
+* Description: Host unit tests - checks and reporting
+*              Also stands in for the parts of sim_main.c that the board and
+*              hardware models call, since the tests have their own main().
+*
+*******************************************************************************/
+
+#include "test.h"
+#include "sim.h"
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static uint32_t test_checks = 0;
+static uint32_t test_failures = 0;
+static uint32_t test_seed = 12345u;     /* The same numbers in every run */
+
+/*******************************************************************************
+* Function Name: test_check
+********************************************************************************
+* Summary:
+*  Count a check and report it if it failed
+*
+* Parameters:
+*  condition: Result of the check
+*  file, line: Location of the check
+*  format: printf format of the failure message
+*
+* Return:
+*  condition
+*
+*******************************************************************************/
+bool test_check(bool condition, const char *file, int line, const char *format, ...)
+{
+    va_list args;
+
+    test_checks++;
+    if (!condition) {
+        test_failures++;
+        fprintf(stderr, "%s:%d: ", file, line);
+        va_start(args, format);
+        vfprintf(stderr, format, args);
+        va_end(args);
+        fputc('\n', stderr);
+    }
+    return condition;
+}
+
+/*******************************************************************************
+* Function Name: test_finish
+********************************************************************************
+* Summary:
+*  Print the result line of a test program
+*
+* Return:
+*  Exit status for main()
+*
+*******************************************************************************/
+int test_finish(const char *name)
+{
+    if (test_failures != 0u) {
+        printf("FAIL %s: %u of %u checks failed\n", name,
+               (unsigned int)test_failures, (unsigned int)test_checks);
+        return EXIT_FAILURE;
+    }
+    printf("PASS %s (%u checks)\n", name, (unsigned int)test_checks);
+    return EXIT_SUCCESS;
+}
+
+/*******************************************************************************
+* Function Name: test_db
+********************************************************************************
+* Summary:
+*  Amplitude ratio in dB
+*
+*******************************************************************************/
+double test_db(double ratio)
+{
+    return 20.0 * log10(ratio);
+}
+
+/*******************************************************************************
+* Function Name: test_random
+********************************************************************************
+* Summary:
+*  Repeatable pseudo-random numbers (xorshift32)
+*
+*******************************************************************************/
+uint32_t test_random(void)
+{
+    test_seed ^= test_seed << 13;
+    test_seed ^= test_seed >> 17;
+    test_seed ^= test_seed << 5;
+    return test_seed;
+}
+
+/*******************************************************************************
+* Function Name: test_range
+********************************************************************************
+* Summary:
+*  Repeatable pseudo-random number in low..high
+*
+*******************************************************************************/
+uint32_t test_range(uint32_t low, uint32_t high)
+{
+    return low + (test_random() % (high - low + 1u));
+}
+
+/*******************************************************************************
+* sim_main.c stand-ins
+*******************************************************************************/
+sim_config_t sim_config = {
+    .speed = 1u,
+};
+
+void sim_log(const char *format, ...)
+{
+    va_list args;
+
+    if (sim_config.verbose) {
+        va_start(args, format);
+        vfprintf(stderr, format, args);
+        va_end(args);
+    }
+}
+
+void sim_exit(int status)
+{
+    exit(status);
+}
@@ -0,0 +1,44 @@
+/******************************************************************************
+* File Name: test.h
+*
+* Description: Host unit tests - checks and reporting
+*              Each test program links the application modules it exercises
+*              and the FreeRTOS kernel, checks them with TEST_CHECK() and
+*              ends with test_finish(). A failed check is reported with its
+*              location and the test carries on, so one run shows every
+*              failure. test_random() gives the same numbers in every run,
+*              so a failure can be repeated.
+*
+*******************************************************************************/
+
+#ifndef __TEST_H__
+#define __TEST_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define TEST_CHECK(condition, ...) \
+    test_check((condition), __FILE__, __LINE__, __VA_ARGS__)
+
+/*******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+bool test_check(bool condition, const char *file, int line, const char *format, ...)
+    __attribute__((format(printf, 4, 5)));
+int test_finish(const char *name);
+double test_db(double ratio);
+uint32_t test_random(void);
+uint32_t test_range(uint32_t low, uint32_t high);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TEST_H__ */
@@ -0,0 +1,302 @@
+/******************************************************************************
+* File Name: test_biquad.c
+*
+* Description: Host unit test - capture high-pass and equalizer biquads
+*              Measures the magnitude of the 16-bit high-pass on sine waves
+*              against the Butterworth response it is designed for, checks
+*              that DC is removed completely, and that filtering in blocks
+*              of any size gives the same bits as one pass, as the record
+*              task and the playback equalizer rely on.
+*
+*******************************************************************************/
+
+#include "test.h"
+#include "biquad.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define TEST_MAX_RATE               (48000u)
+#define TEST_AMPLITUDE              (16000.0)
+#define TEST_NOISE_FRAMES           (20000u)
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static int16_t test_pcm[2u * TEST_MAX_RATE * 2u];
+static int16_t test_ref[TEST_NOISE_FRAMES * 2u];
+static int32_t test_q31[TEST_NOISE_FRAMES * 2u];
+static int32_t test_q31_ref[TEST_NOISE_FRAMES * 2u];
+
+/*******************************************************************************
+* Function Name: test_butterworth_db
+********************************************************************************
+* Summary:
+*  Second order Butterworth high-pass through the bilinear transform with
+*  the cutoff prewarped, which is what the RBJ design is
+*
+*******************************************************************************/
+static double test_butterworth_db(double freq_hz, double cutoff_hz, double rate)
+{
+    double r = tan(M_PI * freq_hz / rate) / tan(M_PI * cutoff_hz / rate);
+    double r4 = r * r * r * r;
+
+    return 10.0 * log10(r4 / (1.0 + r4));
+}
+
+/*******************************************************************************
+* Function Name: test_measure_db
+********************************************************************************
+* Summary:
+*  Gain of one channel of the high-pass at one frequency: filter 1 s of a
+*  sine to settle, then correlate the next second with the input frequency
+*
+*******************************************************************************/
+static double test_measure_db(biquad_t *bq, uint32_t rate, double freq_hz)
+{
+    uint32_t frames = 2u * rate;
+    double re = 0.0;
+    double im = 0.0;
+    uint32_t mixed = 0;
+
+    for (uint32_t n = 0; n < frames; n++) {
+        int16_t sample = (int16_t)lrint(TEST_AMPLITUDE * sin(2.0 * M_PI * freq_hz * n / rate));
+
+        /* The right channel is the inverse, so the channels must not mix */
+        test_pcm[2u * n] = sample;
+        test_pcm[2u * n + 1u] = (int16_t)-sample;
+    }
+    biquad_process(bq, test_pcm, frames);
+
+    for (uint32_t n = rate; n < frames; n++) {
+        double phase = 2.0 * M_PI * freq_hz * n / rate;
+
+        re += test_pcm[2u * n] * cos(phase);
+        im += test_pcm[2u * n] * sin(phase);
+        mixed += (abs(test_pcm[2u * n] + test_pcm[2u * n + 1u]) > 1) ? 1u : 0u;
+    }
+    TEST_CHECK(mixed == 0u, "%.0f Hz: right is not the inverse of left in %u frames",
+               freq_hz, mixed);
+    return 20.0 * log10(2.0 * sqrt(re * re + im * im) / rate / TEST_AMPLITUDE);
+}
+
+/*******************************************************************************
+* Function Name: test_highpass_response
+********************************************************************************
+* Summary:
+*  Magnitude from below to well above the cutoff, at the capture rate and at
+*  48 kHz
+*
+*******************************************************************************/
+static void test_highpass_response(void)
+{
+    static const struct {
+        uint32_t rate;
+        uint32_t cutoff_hz;
+    } designs[] = {
+        { 16000u, 80u }, { 16000u, 200u }, { 16000u, 10u }, { 48000u, 100u }, { 16000u, 2000u },
+    };
+    static const double ratios[] = { 0.125, 0.25, 0.5, 1.0, 2.0, 4.0, 10.0 };
+
+    for (uint32_t d = 0; d < sizeof(designs) / sizeof(designs[0]); d++) {
+        uint32_t rate = designs[d].rate;
+        double cutoff = designs[d].cutoff_hz;
+        biquad_t bq;
+
+        if (!TEST_CHECK(biquad_highpass(&bq, designs[d].cutoff_hz, rate, 2u) == 0,
+                        "%u Hz high-pass at %u Hz refused", designs[d].cutoff_hz, rate)) {
+            continue;
+        }
+        for (uint32_t r = 0; r < sizeof(ratios) / sizeof(ratios[0]); r++) {
+            /* Whole cycles in the measured second */
+            double freq = round(cutoff * ratios[r]);
+            double expected;
+            double measured;
+            double tolerance;
+
+            if ((freq < 1.0) || (freq > 0.45 * rate)) {
+                continue;
+            }
+            expected = test_butterworth_db(freq, cutoff, rate);
+            biquad_reset(&bq);
+            measured = test_measure_db(&bq, rate, freq);
+
+            /* Rounding the output to 16 bits limits how well a deep
+             * attenuation can be measured */
+            tolerance = (expected > -30.0) ? 0.01 : 0.05;
+            TEST_CHECK(fabs(measured - expected) <= tolerance,
+                       "%.0f Hz high-pass at %u Hz: %.0f Hz measured %.3f dB, expected %.3f dB",
+                       cutoff, rate, freq, measured, expected);
+            TEST_CHECK(fabs(biquad_response_db(&bq, (float)freq, rate) - expected) <= 0.01,
+                       "%.0f Hz high-pass: biquad_response_db(%.0f Hz) is %.3f dB, expected %.3f dB",
+                       cutoff, freq, biquad_response_db(&bq, (float)freq, rate), expected);
+        }
+    }
+}
+
+/*******************************************************************************
+* Function Name: test_highpass_dc
+********************************************************************************
+* Summary:
+*  A DC input settles to exactly zero, for the lowest cutoff and a large
+*  offset of either sign
+*
+*******************************************************************************/
+static void test_highpass_dc(void)
+{
+    static const int16_t offsets[] = { 12000, -3, -32768 };
+    biquad_t bq;
+
+    for (uint32_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++) {
+        uint32_t nonzero = 0;
+
+        (void)biquad_highpass(&bq, BIQUAD_HPF_MIN_HZ, 16000u, 1u);
+        for (uint32_t block = 0; block < 4u; block++) {
+            for (uint32_t n = 0; n < 16000u; n++) {
+                test_pcm[n] = offsets[i];
+            }
+            biquad_process(&bq, test_pcm, 16000u);
+        }
+        /* After 3 s of settling, the last second must be silent */
+        for (uint32_t n = 0; n < 16000u; n++) {
+            nonzero += (test_pcm[n] != 0) ? 1u : 0u;
+        }
+        TEST_CHECK(nonzero == 0u, "DC %d: %u non-zero samples after settling",
+                   offsets[i], nonzero);
+    }
+}
+
+/*******************************************************************************
+* Function Name: test_blocks
+********************************************************************************
+* Summary:
+*  Filtering noise in blocks of random sizes, down to one frame, gives the
+*  same bits as one pass, for the 16-bit high-pass and a cascade of
+*  equalizer bands
+*
+*******************************************************************************/
+static void test_blocks(void)
+{
+    biquad_t hpf_one;
+    biquad_t hpf_blocks;
+    biquad_t eq_one[3];
+    biquad_t eq_blocks[3];
+    uint32_t blocks = 0;
+
+    for (uint32_t n = 0; n < TEST_NOISE_FRAMES * 2u; n++) {
+        /* Full scale noise, so saturation is covered too */
+        test_ref[n] = (int16_t)test_random();
+        test_q31_ref[n] = (int32_t)test_random() >> 2;
+    }
+    memcpy(test_pcm, test_ref, sizeof(test_ref));
+    memcpy(test_q31, test_q31_ref, sizeof(test_q31_ref));
+
+    (void)biquad_highpass(&hpf_one, 80u, 16000u, 2u);
+    (void)biquad_design(&eq_one[0], BIQUAD_LOW_SHELF, 100u, 6.0f, 0.7f, 16000u, 2u);
+    (void)biquad_design(&eq_one[1], BIQUAD_PEAK, 1000u, -9.0f, 2.0f, 16000u, 2u);
+    (void)biquad_design(&eq_one[2], BIQUAD_LOWPASS, 5000u, 0.0f, 0.707f, 16000u, 2u);
+    hpf_blocks = hpf_one;
+    memcpy(eq_blocks, eq_one, sizeof(eq_one));
+
+    biquad_process(&hpf_one, test_ref, TEST_NOISE_FRAMES);
+    for (uint32_t b = 0; b < 3u; b++) {
+        biquad_process_q31(&eq_one[b], test_q31_ref, TEST_NOISE_FRAMES);
+    }
+
+    for (uint32_t position = 0; position < TEST_NOISE_FRAMES; blocks++) {
+        /* Mostly short and odd blocks, sometimes a single frame */
+        uint32_t length = ((blocks % 5u) == 0u) ? 1u : test_range(1u, 700u);
+
+        if (length > (TEST_NOISE_FRAMES - position)) {
+            length = TEST_NOISE_FRAMES - position;
+        }
+        biquad_process(&hpf_blocks, &test_pcm[position * 2u], length);
+        for (uint32_t b = 0; b < 3u; b++) {
+            biquad_process_q31(&eq_blocks[b], &test_q31[position * 2u], length);
+        }
+        position += length;
+    }
+
+    TEST_CHECK(memcmp(test_pcm, test_ref, sizeof(test_ref)) == 0,
+               "high-pass in %u blocks differs from one pass", blocks);
+    TEST_CHECK(memcmp(test_q31, test_q31_ref, sizeof(test_q31_ref)) == 0,
+               "equalizer in %u blocks differs from one pass", blocks);
+    TEST_CHECK(memcmp(hpf_one.state, hpf_blocks.state, sizeof(hpf_one.state)) == 0,
+               "high-pass history differs after blocks");
+}
+
+/*******************************************************************************
+* Function Name: test_equalizer_response
+********************************************************************************
+* Summary:
+*  A peak band measured through biquad_process_q31 matches
+*  biquad_response_db, which the "eq" command prints
+*
+*******************************************************************************/
+static void test_equalizer_response(void)
+{
+    static const double freqs[] = { 100.0, 500.0, 1000.0, 2000.0, 6000.0 };
+    biquad_t bq;
+
+    (void)biquad_design(&bq, BIQUAD_PEAK, 1000u, 9.0f, 1.0f, 16000u, 1u);
+    for (uint32_t f = 0; f < sizeof(freqs) / sizeof(freqs[0]); f++) {
+        double re = 0.0;
+        double im = 0.0;
+        double measured;
+        double expected = biquad_response_db(&bq, (float)freqs[f], 16000u);
+
+        biquad_reset(&bq);
+        for (uint32_t n = 0; n < TEST_NOISE_FRAMES; n++) {
+            test_q31[n] = (int32_t)lrint(0x08000000 * sin(2.0 * M_PI * freqs[f] * n / 16000.0));
+        }
+        biquad_process_q31(&bq, test_q31, TEST_NOISE_FRAMES);
+        for (uint32_t n = 4000u; n < 20000u; n++) {
+            double phase = 2.0 * M_PI * freqs[f] * n / 16000.0;
+
+            re += test_q31[n] * cos(phase);
+            im += test_q31[n] * sin(phase);
+        }
+        measured = 20.0 * log10(2.0 * sqrt(re * re + im * im) / 16000.0 / 0x08000000);
+        TEST_CHECK(fabs(measured - expected) <= 0.01,
+                   "peak band at %.0f Hz: measured %.3f dB, response %.3f dB",
+                   freqs[f], measured, expected);
+    }
+    TEST_CHECK(fabs(biquad_response_db(&bq, 1000.0f, 16000u) - 9.0) <= 0.01,
+               "peak band gain at its centre is %.3f dB", biquad_response_db(&bq, 1000.0f, 16000u));
+}
+
+/*******************************************************************************
+* Function Name: test_limits
+*******************************************************************************/
+static void test_limits(void)
+{
+    biquad_t bq;
+
+    TEST_CHECK(biquad_highpass(&bq, BIQUAD_HPF_MIN_HZ - 1u, 16000u, 2u) != 0, "cutoff below minimum accepted");
+    TEST_CHECK(biquad_highpass(&bq, BIQUAD_HPF_MAX_HZ + 1u, 48000u, 2u) != 0, "cutoff above maximum accepted");
+    TEST_CHECK(biquad_highpass(&bq, 1001u, 4000u, 2u) != 0, "cutoff above a quarter of the rate accepted");
+    TEST_CHECK(biquad_highpass(&bq, 100u, 16000u, 0u) != 0, "no channels accepted");
+    TEST_CHECK(biquad_highpass(&bq, 100u, 16000u, BIQUAD_MAX_CHANNELS + 1u) != 0, "too many channels accepted");
+    TEST_CHECK(biquad_design(&bq, BIQUAD_PEAK, 1000u, BIQUAD_MAX_GAIN_DB + 1.0f, 1.0f, 16000u, 2u) != 0,
+               "gain above maximum accepted");
+    TEST_CHECK(biquad_design(&bq, BIQUAD_PEAK, 7300u, 0.0f, 1.0f, 16000u, 2u) != 0,
+               "band above 0.45 of the rate accepted");
+    TEST_CHECK(biquad_design(&bq, BIQUAD_PEAK, 1000u, 0.0f, NAN, 16000u, 2u) != 0, "NaN Q accepted");
+}
+
+/*******************************************************************************
+* Function Name: main
+*******************************************************************************/
+int main(void)
+{
+    test_highpass_response();
+    test_highpass_dc();
+    test_blocks();
+    test_equalizer_response();
+    test_limits();
+    return test_finish("biquad");
+}
@@ -0,0 +1,476 @@
+/******************************************************************************
+* File Name: test_codec_ctrl.c
+*
+* Description: Host unit test - codec register cache against the I2C model
+*              codec_ctrl.c runs on the codec and bus of sim_i2c.c. The test
+*              advances the bus one tick at a time itself, since
+*              codec_ctrl_sync() needs the scheduler, and after every
+*              transaction it compares the codec's registers with the
+*              state before the transaction. The result is the sequence of
+*              transactions as the codec saw them: its page and the
+*              registers that changed. It checks that redundant writes
+*              never reach the bus, that writes to a register still
+*              queued merge, that consecutive registers go out in one
+*              burst of at most CODEC_CTRL_MAX_BURST, that the registers of
+*              the selected page go before a page change, and that a
+*              failed transaction is queued again after a page select.
+*
+*******************************************************************************/
+
+#include "test.h"
+#include "sim.h"
+#include "codec_ctrl.h"
+#include "cybsp.h"
+#include "mtb_hal.h"
+#include "mtb_tlv320dac3100.h"
+#include <string.h>
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define TEST_MAX_XFERS              (16u)
+#define TEST_DRAIN_TICKS            (100u)
+
+/* Value the codec holds before a test writes it */
+#define TEST_PRESET(page, reg)      ((uint8_t)(((page) << 7) ^ ((reg) * 3u) ^ 0x5Au))
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+/* One transaction as the codec saw it */
+typedef struct {
+    uint8_t page;               /* Selected on the codec afterwards */
+    uint8_t first;              /* First register that changed, 0: none */
+    uint8_t count;              /* Registers that changed */
+    uint8_t bytes;              /* Sent, register address included; 0: failed */
+} test_xfer_t;
+
+/*******************************************************************************
+* Global Variables
+*******************************************************************************/
+/* Handles of app_i2s.c */
+mtb_hal_i2c_t MW_I2C_hal_obj;
+cy_stc_scb_i2c_context_t MW_CYBSP_I2C_CONTROLLER_0_context;
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static test_xfer_t test_xfers[TEST_MAX_XFERS];
+static uint32_t test_num_xfers;
+static uint32_t test_bus_xfers;     /* Completed on the bus since the start */
+
+/*******************************************************************************
+* Function Name: test_codec_page
+********************************************************************************
+* Summary:
+*  Page selected on the codec model
+*
+*******************************************************************************/
+static uint8_t test_codec_page(void)
+{
+    /* Register 0 of the selected page holds its number */
+    return mtb_tlv320dac3100_read_byte(0);
+}
+
+/*******************************************************************************
+* Function Name: test_codec_regs
+********************************************************************************
+* Summary:
+*  Copy the codec model's registers of both pages, leaving its page alone
+*
+*******************************************************************************/
+static void test_codec_regs(uint8_t regs[CODEC_CTRL_PAGES][CODEC_CTRL_PAGE_REGS])
+{
+    uint8_t page = test_codec_page();
+
+    for (uint32_t p = 0; p < CODEC_CTRL_PAGES; p++) {
+        mtb_tlv320dac3100_write_byte(0, (uint8_t)p);
+        for (uint32_t reg = 0; reg < CODEC_CTRL_PAGE_REGS; reg++) {
+            regs[p][reg] = mtb_tlv320dac3100_read_byte((uint8_t)reg);
+        }
+    }
+    mtb_tlv320dac3100_write_byte(0, page);
+}
+
+/*******************************************************************************
+* Function Name: test_codec_reg
+*******************************************************************************/
+static uint8_t test_codec_reg(codec_reg_t reg)
+{
+    uint8_t regs[CODEC_CTRL_PAGES][CODEC_CTRL_PAGE_REGS];
+
+    test_codec_regs(regs);
+    return regs[CODEC_REG_PAGE(reg)][CODEC_REG_NUMBER(reg)];
+}
+
+/*******************************************************************************
+* Function Name: test_preset
+********************************************************************************
+* Summary:
+*  Load the codec model with TEST_PRESET values, as the boot-time driver
+*  would leave it, and start codec_ctrl on it. codec_ctrl_init() also
+*  clears the statistics.
+*
+*******************************************************************************/
+static void test_preset(void)
+{
+    for (uint32_t page = 0; page < CODEC_CTRL_PAGES; page++) {
+        mtb_tlv320dac3100_write_byte(0, (uint8_t)page);
+        for (uint32_t reg = 1; reg < CODEC_CTRL_PAGE_REGS; reg++) {
+            mtb_tlv320dac3100_write_byte((uint8_t)reg, TEST_PRESET(page, reg));
+        }
+    }
+    mtb_tlv320dac3100_write_byte(0, 0);
+    TEST_CHECK(codec_ctrl_init() == 0, "codec_ctrl_init failed");
+}
+
+/*******************************************************************************
+* Function Name: test_drain
+********************************************************************************
+* Summary:
+*  Advance the bus until the queue is empty or stops after a failure, and
+*  record each transaction in test_xfers
+*
+*******************************************************************************/
+static void test_drain(void)
+{
+    uint8_t before[CODEC_CTRL_PAGES][CODEC_CTRL_PAGE_REGS];
+    uint8_t after[CODEC_CTRL_PAGES][CODEC_CTRL_PAGE_REGS];
+    codec_ctrl_stats_t stats;
+    uint32_t tick;
+
+    test_num_xfers = 0;
+    for (tick = 0; tick < TEST_DRAIN_TICKS; tick++) {
+        uint32_t done;
+        uint32_t bytes;
+
+        codec_ctrl_get_stats(&stats);
+        if (!stats.busy) {
+            break;
+        }
+        done = stats.transactions + stats.errors;
+        bytes = stats.bytes;
+        test_codec_regs(before);
+        sim_i2c_step();
+        codec_ctrl_get_stats(&stats);
+        if ((stats.transactions + stats.errors) == done) {
+            continue;
+        }
+
+        test_codec_regs(after);
+        test_bus_xfers++;
+        if (test_num_xfers < TEST_MAX_XFERS) {
+            test_xfer_t *xfer = &test_xfers[test_num_xfers];
+
+            memset(xfer, 0, sizeof(*xfer));
+            xfer->page = test_codec_page();
+            xfer->bytes = (uint8_t)(stats.bytes - bytes);
+            for (uint32_t page = 0; page < CODEC_CTRL_PAGES; page++) {
+                for (uint32_t reg = 1; reg < CODEC_CTRL_PAGE_REGS; reg++) {
+                    if (before[page][reg] != after[page][reg]) {
+                        xfer->first = (xfer->count == 0u) ? (uint8_t)reg : xfer->first;
+                        xfer->count++;
+                    }
+                }
+            }
+        }
+        test_num_xfers++;
+    }
+    TEST_CHECK(tick < TEST_DRAIN_TICKS, "bus still busy after %u ticks", TEST_DRAIN_TICKS);
+}
+
+/*******************************************************************************
+* Function Name: test_check_xfers
+********************************************************************************
+* Summary:
+*  Compare the transactions of the last test_drain() with the expected ones
+*
+*******************************************************************************/
+static void test_check_xfers(const char *name, const test_xfer_t *expected, uint32_t count)
+{
+    TEST_CHECK(test_num_xfers == count, "%s: %u transactions, expected %u", name,
+               test_num_xfers, count);
+    for (uint32_t i = 0; (i < count) && (i < test_num_xfers); i++) {
+        const test_xfer_t *got = &test_xfers[i];
+
+        TEST_CHECK(memcmp(got, &expected[i], sizeof(*got)) == 0,
+                   "%s: transaction %u is page %u, %u registers from %u, %u bytes; "
+                   "expected page %u, %u registers from %u, %u bytes", name, i,
+                   got->page, got->count, got->first, got->bytes, expected[i].page,
+                   expected[i].count, expected[i].first, expected[i].bytes);
+    }
+}
+
+/*******************************************************************************
+* Function Name: test_fail_next
+********************************************************************************
+* Summary:
+*  Make the next bus transaction, and no other one soon, fail
+*
+*******************************************************************************/
+static void test_fail_next(void)
+{
+    sim_config.i2c_error_every = test_bus_xfers + 1u;
+}
+
+/*******************************************************************************
+* Function Name: test_readback
+********************************************************************************
+* Summary:
+*  codec_ctrl_init() takes the codec's registers into the shadow
+*
+*******************************************************************************/
+static void test_readback(void)
+{
+    uint8_t block[8] = { 0 };
+    codec_ctrl_stats_t stats;
+    uint8_t value = 0;
+
+    test_preset();
+    for (uint32_t page = 0; page < CODEC_CTRL_PAGES; page++) {
+        for (uint32_t reg = 1; reg < CODEC_CTRL_PAGE_REGS; reg++) {
+            if ((codec_ctrl_read(CODEC_REG(page, reg), &value) == 0) &&
+                (value != TEST_PRESET(page, reg))) {
+                TEST_CHECK(false, "P%u R%u reads 0x%02X, codec 0x%02X", page, reg, value,
+                           TEST_PRESET(page, reg));
+            }
+        }
+    }
+    TEST_CHECK(codec_ctrl_read(CODEC_P0_DAC_LEFT_VOLUME, &value) == 0,
+               "P0 R65 is not in the shadow");
+    /* The software reset only ever reads back as 0: not cached */
+    TEST_CHECK(codec_ctrl_read(CODEC_REG(0, 1), &value) == -1, "P0 R1 is cached");
+    TEST_CHECK(codec_ctrl_read(CODEC_REG(0, 0), &value) == -1, "page select is cached");
+    TEST_CHECK(codec_ctrl_read(CODEC_REG(CODEC_CTRL_PAGES, 1), &value) == -1,
+               "page %u is cached", CODEC_CTRL_PAGES);
+    TEST_CHECK(codec_ctrl_write_block(CODEC_REG(0, 121), block, sizeof(block)) == -1,
+               "a block past register 127 was taken");
+
+    codec_ctrl_get_stats(&stats);
+    TEST_CHECK(stats.ready && !stats.busy && (stats.pending == 0u) && (stats.requested == 0u),
+               "after init: ready %d busy %d pending %u requested %u", stats.ready,
+               stats.busy, stats.pending, stats.requested);
+}
+
+/*******************************************************************************
+* Function Name: test_redundant
+********************************************************************************
+* Summary:
+*  Writing the value a register already holds costs no bus time, except
+*  for registers with status bits
+*
+*******************************************************************************/
+static void test_redundant(void)
+{
+    static const test_xfer_t expected[] = {
+        { 1, 0, 0, 2 },         /* Sent, but the codec value did not change */
+    };
+    codec_reg_t spk = CODEC_P1_SPK_DRIVER;
+    codec_ctrl_stats_t stats;
+
+    test_preset();
+    codec_ctrl_write(CODEC_P0_DAC_LEFT_VOLUME, TEST_PRESET(0, 65));
+    codec_ctrl_update(CODEC_P0_DAC_VOLUME_CTRL, 0x0Cu, TEST_PRESET(0, 64));
+    codec_ctrl_get_stats(&stats);
+    TEST_CHECK((stats.requested == 2u) && (stats.redundant == 2u) && (stats.pending == 0u) &&
+               !stats.busy, "same values: requested %u redundant %u pending %u busy %d",
+               stats.requested, stats.redundant, stats.pending, stats.busy);
+    test_drain();
+    test_check_xfers("same values", NULL, 0);
+
+    /* Bit 0 of the speaker driver register is status: always sent. Init
+       read page 1 last, so it is still selected. */
+    codec_ctrl_write(spk, TEST_PRESET(1, CODEC_REG_NUMBER(spk)));
+    test_drain();
+    test_check_xfers("status register", expected, 1);
+    codec_ctrl_get_stats(&stats);
+    TEST_CHECK((stats.requested == 3u) && (stats.redundant == 2u) &&
+               (stats.transactions == 1u) && (stats.page_selects == 0u) && (stats.bytes == 2u),
+               "status register: requested %u redundant %u transactions %u page selects %u "
+               "bytes %u", stats.requested, stats.redundant, stats.transactions,
+               stats.page_selects, stats.bytes);
+}
+
+/*******************************************************************************
+* Function Name: test_merge
+********************************************************************************
+* Summary:
+*  Writes to a register that is still queued replace each other, and
+*  consecutive registers go out together, CODEC_CTRL_MAX_BURST at most
+*
+*******************************************************************************/
+static void test_merge(void)
+{
+    static const test_xfer_t expected[] = {
+        { 0, 0,   0,  2 },      /* Page select, started by the first write */
+        { 0, 65,  2,  3 },      /* Left and right DAC volume */
+        { 0, 70,  16, 17 },     /* The 20-register block, split */
+        { 0, 86,  4,  5 },
+        { 0, 100, 1,  2 },
+        { 1, 0,   0,  2 },
+        { 1, 33,  1,  2 },
+        { 1, 36,  4,  5 },
+    };
+    static const uint8_t block4[4] = { 1, 2, 3, 4 };
+    uint8_t block20[20];
+    codec_ctrl_stats_t stats;
+    uint8_t value = 0;
+
+    test_preset();
+    for (uint32_t i = 0; i < 10u; i++) {
+        codec_ctrl_write(CODEC_P0_DAC_LEFT_VOLUME, (uint8_t)(0x80u + i));
+    }
+    codec_ctrl_write(CODEC_P0_DAC_RIGHT_VOLUME, 0x70);
+    for (uint32_t i = 0; i < sizeof(block20); i++) {
+        block20[i] = (uint8_t)~TEST_PRESET(0, 70u + i);
+    }
+    codec_ctrl_write_block(CODEC_REG(0, 70), block20, sizeof(block20));
+    codec_ctrl_write(CODEC_REG(0, 100), (uint8_t)~TEST_PRESET(0, 100));
+    codec_ctrl_write_block(CODEC_P1_HPL_ANALOG_VOLUME, block4, sizeof(block4));
+    codec_ctrl_update(CODEC_REG(1, 33), 0x0Fu, (uint8_t)~TEST_PRESET(1, 33));
+
+    TEST_CHECK((codec_ctrl_read(CODEC_P0_DAC_LEFT_VOLUME, &value) == 0) && (value == 0x89u),
+               "queued P0 R65 reads 0x%02X, expected 0x89", value);
+    codec_ctrl_get_stats(&stats);
+    TEST_CHECK((stats.requested == 37u) && (stats.merged == 9u) && (stats.pending == 28u),
+               "queued: requested %u merged %u pending %u", stats.requested, stats.merged,
+               stats.pending);
+
+    test_drain();
+    test_check_xfers("merge", expected, sizeof(expected) / sizeof(expected[0]));
+    TEST_CHECK(test_codec_reg(CODEC_P0_DAC_LEFT_VOLUME) == 0x89u,
+               "codec P0 R65 0x%02X, expected the last value 0x89",
+               test_codec_reg(CODEC_P0_DAC_LEFT_VOLUME));
+    TEST_CHECK(test_codec_reg(CODEC_REG(1, 33)) ==
+               (uint8_t)((TEST_PRESET(1, 33) & 0xF0u) | (~TEST_PRESET(1, 33) & 0x0Fu)),
+               "codec P1 R33 0x%02X after the update", test_codec_reg(CODEC_REG(1, 33)));
+    codec_ctrl_get_stats(&stats);
+    TEST_CHECK((stats.transactions == 8u) && (stats.page_selects == 2u) &&
+               (stats.bytes == 38u) && (stats.pending == 0u) && (stats.errors == 0u),
+               "sent: transactions %u page selects %u bytes %u pending %u errors %u",
+               stats.transactions, stats.page_selects, stats.bytes, stats.pending,
+               stats.errors);
+    TEST_CHECK(codec_ctrl_verify() == 0, "codec differs from the shadow");
+}
+
+/*******************************************************************************
+* Function Name: test_page_order
+********************************************************************************
+* Summary:
+*  The registers of the selected page go before a page change, whichever
+*  page was written first
+*
+*******************************************************************************/
+static void test_page_order(void)
+{
+    static const test_xfer_t expected_p1[] = {
+        { 1, 38, 1, 2 },        /* Page 1 is selected after init */
+        { 1, 36, 2, 3 },        /* Written after page 0 */
+        { 0, 0,  0, 2 },
+        { 0, 64, 1, 2 },
+    };
+    static const test_xfer_t expected_p0[] = {
+        { 0, 66, 1, 2 },
+        { 0, 63, 1, 2 },        /* Written after page 1 */
+        { 1, 0,  0, 2 },
+        { 1, 35, 1, 2 },
+    };
+    codec_ctrl_stats_t stats;
+
+    test_preset();
+    codec_ctrl_write(CODEC_P1_SPK_ANALOG_VOLUME, 0x11);     /* Sent at once */
+    codec_ctrl_write(CODEC_P0_DAC_VOLUME_CTRL, 0x0C);
+    codec_ctrl_write(CODEC_P1_HPL_ANALOG_VOLUME, 0x22);
+    codec_ctrl_write(CODEC_P1_HPR_ANALOG_VOLUME, 0x33);
+    test_drain();
+    test_check_xfers("page 1 selected", expected_p1, 4);
+
+    codec_ctrl_write(CODEC_P0_DAC_RIGHT_VOLUME, 0x44);      /* Sent at once */
+    codec_ctrl_write(CODEC_P1_DAC_MIXER_ROUTING, 0x55);
+    codec_ctrl_write(CODEC_P0_DAC_DATA_PATH, 0x66);
+    test_drain();
+    test_check_xfers("page 0 selected", expected_p0, 4);
+
+    codec_ctrl_get_stats(&stats);
+    TEST_CHECK(stats.page_selects == 2u, "%u page selects, expected 2", stats.page_selects);
+    TEST_CHECK(codec_ctrl_verify() == 0, "codec differs from the shadow");
+}
+
+/*******************************************************************************
+* Function Name: test_failure
+********************************************************************************
+* Summary:
+*  A failed transaction leaves its registers queued and the page unknown;
+*  the next write or codec_ctrl_flush() sends them again after a page
+*  select
+*
+*******************************************************************************/
+static void test_failure(void)
+{
+    static const test_xfer_t expected_nak[] = {
+        { 1, 0, 0, 0 },
+    };
+    static const test_xfer_t expected_write[] = {
+        { 1, 0,  0, 2 },        /* The codec may have taken part: select again */
+        { 1, 36, 4, 5 },
+        { 1, 50, 1, 2 },        /* The write that restarted the queue */
+    };
+    static const test_xfer_t expected_flush[] = {
+        { 0, 0,  0, 2 },
+        { 0, 64, 1, 2 },
+    };
+    static const uint8_t block[4] = { 1, 2, 3, 4 };
+    codec_ctrl_stats_t stats;
+
+    test_preset();
+    test_fail_next();
+    codec_ctrl_write_block(CODEC_P1_HPL_ANALOG_VOLUME, block, sizeof(block));
+    test_drain();
+    test_check_xfers("failed burst", expected_nak, 1);
+    codec_ctrl_get_stats(&stats);
+    TEST_CHECK((stats.errors == 1u) && (stats.pending == 4u) && !stats.busy &&
+               (stats.transactions == 0u),
+               "failed burst: errors %u pending %u busy %d transactions %u", stats.errors,
+               stats.pending, stats.busy, stats.transactions);
+    TEST_CHECK(test_codec_reg(CODEC_P1_HPL_ANALOG_VOLUME) == TEST_PRESET(1, 36),
+               "codec took the failed burst");
+
+    sim_config.i2c_error_every = 0;
+    codec_ctrl_write(CODEC_REG(1, 50), 0x77);
+    test_drain();
+    test_check_xfers("restart by a write", expected_write, 3);
+
+    /* A failed page select */
+    test_fail_next();
+    codec_ctrl_write(CODEC_P0_DAC_VOLUME_CTRL, 0x0C);
+    test_drain();
+    test_check_xfers("failed page select", expected_nak, 1);
+    sim_config.i2c_error_every = 0;
+    TEST_CHECK(codec_ctrl_flush() == 1, "codec_ctrl_flush: not 1 register pending");
+    test_drain();
+    test_check_xfers("restart by flush", expected_flush, 2);
+
+    codec_ctrl_get_stats(&stats);
+    TEST_CHECK((stats.errors == 2u) && (stats.pending == 0u) && (stats.transactions == 5u) &&
+               (stats.page_selects == 2u) && (stats.bytes == 13u),
+               "end: errors %u pending %u transactions %u page selects %u bytes %u",
+               stats.errors, stats.pending, stats.transactions, stats.page_selects,
+               stats.bytes);
+    TEST_CHECK(codec_ctrl_verify() == 0, "codec differs from the shadow");
+}
+
+/*******************************************************************************
+* Function Name: main
+*******************************************************************************/
+int main(void)
+{
+    Cy_SCB_I2C_Init(CYBSP_I2C_CONTROLLER_HW, NULL, &MW_CYBSP_I2C_CONTROLLER_0_context);
+
+    test_readback();
+    test_redundant();
+    test_merge();
+    test_page_order();
+    test_failure();
+
+    return test_finish("test_codec_ctrl");
+}
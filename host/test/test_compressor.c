@@ -0,0 +1,398 @@
+/******************************************************************************
+* File Name: test_compressor.c
+*
+* Description: Host unit test - capture compressor and look-ahead limiter
+*              Runs random configurations over takes made of random
+*              segments (silence, noise, tones, full-scale squares, single
+*              full-scale clicks) and checks that no output sample exceeds
+*              the ceiling, that feeding the take as it is captured gives
+*              the same bits as one pass, that every frame is processed once
+*              the take ends and that the gain only ever ramps. Fixed cases
+*              check the static curve, the makeup gain, an unprocessed
+*              pass-through and the limits.
+*
+*******************************************************************************/
+
+#include "test.h"
+#include "compressor.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define TEST_CONFIGS                (400u)
+#define TEST_MAX_FRAMES             (24000u)    /* 0.5 s at 48 kHz */
+#define TEST_MAX_SEGMENT            (4000u)
+#define TEST_CURVE_DB               (0.1)       /* Static curve tolerance */
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static int16_t test_input[TEST_MAX_FRAMES * COMP_MAX_CHANNELS];
+static int16_t test_once[TEST_MAX_FRAMES * COMP_MAX_CHANNELS];
+static int16_t test_fed[TEST_MAX_FRAMES * COMP_MAX_CHANNELS];
+static comp_trace_t test_trace;
+
+/*******************************************************************************
+* Function Name: test_make_take
+********************************************************************************
+* Summary:
+*  Fill a take with random segments; channels differ so that either one can
+*  hold the peak
+*
+*******************************************************************************/
+static void test_make_take(uint32_t frames, uint16_t channels, uint32_t rate)
+{
+    uint32_t n = 0;
+
+    while (n < frames) {
+        uint32_t length = test_range(1u, TEST_MAX_SEGMENT);
+        uint32_t kind = test_range(0u, 4u);
+        double level = 32767.0 * pow(10.0, -(double)test_range(0u, 40u) / 20.0);
+        double freq = test_range(20u, rate / 2u - 1u);
+
+        if (length > frames - n) {
+            length = frames - n;
+        }
+        for (uint32_t i = 0; i < length; i++, n++) {
+            for (uint16_t c = 0; c < channels; c++) {
+                double value = 0.0;
+
+                switch (kind) {
+                    case 0:     /* Silence */
+                        break;
+                    case 1:     /* Noise */
+                        value = level * ((double)(test_random() % 65536u) / 32768.0 - 1.0);
+                        break;
+                    case 2:     /* Tone, the second channel inverted */
+                        value = level * sin(2.0 * M_PI * freq * i / rate) * ((c == 0u) ? 1.0 : -1.0);
+                        break;
+                    case 3:     /* Full-scale square */
+                        value = (((i * 2u * 440u) / rate) % 2u == 0u) ? 32767.0 : -32768.0;
+                        break;
+                    default:    /* Single full-scale clicks on one channel */
+                        value = ((i == length / 2u) && (c == (n % channels))) ?
+                                (((n & 1u) != 0u) ? 32767.0 : -32768.0) : 0.0;
+                        break;
+                }
+                test_input[n * channels + c] = (int16_t)lround(fmax(-32768.0, fmin(32767.0, value)));
+            }
+        }
+    }
+}
+
+/*******************************************************************************
+* Function Name: test_feed
+********************************************************************************
+* Summary:
+*  Process a take as the record task does: the captured count grows by
+*  random amounts, each call starts at the first unprocessed frame, and a
+*  final call ends the take
+*
+* Return:
+*  Frames processed
+*
+*******************************************************************************/
+static uint32_t test_feed(compressor_t *comp, int16_t *pcm, uint32_t frames, uint16_t channels)
+{
+    uint32_t captured = 0;
+    uint32_t done = 0;
+
+    while (captured < frames) {
+        captured += test_range(1u, 700u);
+        if (captured > frames) {
+            captured = frames;
+        }
+        done += compressor_process(comp, &pcm[done * channels], captured - done, false);
+    }
+    done += compressor_process(comp, &pcm[done * channels], frames - done, true);
+    return done;
+}
+
+/*******************************************************************************
+* Function Name: test_random_configs
+*******************************************************************************/
+static void test_random_configs(void)
+{
+    uint32_t overshoots = 0;
+    uint32_t mismatches = 0;
+    uint32_t short_takes = 0;
+    uint32_t trace_errors = 0;
+    uint32_t limited = 0;
+    int32_t worst = 0;
+    uint32_t worst_config = 0;
+
+    for (uint32_t t = 0; t < TEST_CONFIGS; t++) {
+        compressor_config_t config = {
+            .enabled = true,
+            .threshold_db = test_range(0u, COMP_MAX_THRESHOLD_DB),
+            .ratio = test_range(1u, COMP_MAX_RATIO),
+            .attack_ms = test_range(1u, COMP_MAX_ATTACK_MS),
+            .release_ms = test_range(COMP_MIN_RELEASE_MS, COMP_MAX_RELEASE_MS),
+            .lookahead_ms = test_range(0u, COMP_MAX_LOOKAHEAD_MS),
+            .ceiling_db = test_range(0u, COMP_MAX_CEILING_DB),
+            .makeup_db = test_range(0u, COMP_MAX_MAKEUP_DB),
+            .trace = true,
+        };
+        uint32_t rate = ((t & 1u) != 0u) ? 48000u : 16000u;
+        uint16_t channels = ((t & 2u) != 0u) ? 2u : 1u;
+        uint32_t frames = test_range(1u, rate / 2u);
+        int32_t ceiling = (int32_t)(32767.0f * powf(10.0f, -(float)config.ceiling_db / 20.0f));
+        compressor_t comp;
+        uint32_t done_once;
+        uint32_t done_fed;
+        float reduction;
+        float traced = 0.0f;
+
+        /* Short attacks and ratios near 1 are where the limiter does the
+         * work, so they get extra weight */
+        if ((t % 4u) == 0u) {
+            config.attack_ms = test_range(1u, 3u);
+        }
+        if ((t % 5u) == 0u) {
+            config.ratio = 1u;
+        }
+
+        test_make_take(frames, channels, rate);
+        memcpy(test_once, test_input, frames * channels * sizeof(int16_t));
+        memcpy(test_fed, test_input, frames * channels * sizeof(int16_t));
+
+        (void)compressor_init(&comp, &config, channels, rate, NULL);
+        done_once = compressor_process(&comp, test_once, frames, true);
+
+        (void)compressor_init(&comp, &config, channels, rate, &test_trace);
+        done_fed = test_feed(&comp, test_fed, frames, channels);
+        short_takes += ((done_once != frames) || (done_fed != frames)) ? 1u : 0u;
+        limited += (comp.limited > 0u) ? 1u : 0u;
+        mismatches += (memcmp(test_once, test_fed, frames * channels * sizeof(int16_t)) != 0) ? 1u : 0u;
+
+        for (uint32_t i = 0; i < frames * channels; i++) {
+            int32_t excess = abs(test_fed[i]) - ceiling;
+
+            if (excess > 0) {
+                overshoots++;
+                if (excess > worst) {
+                    worst = excess;
+                    worst_config = t;
+                }
+            }
+        }
+
+        /* The trace keeps the largest reduction, rounded to its steps */
+        reduction = compressor_max_reduction_db(&comp);
+        for (uint32_t i = 0; i < test_trace.count; i++) {
+            traced = fmaxf(traced, (float)test_trace.reduction[i] / COMP_TRACE_STEPS_PER_DB);
+        }
+        if ((reduction < 127.0f) &&
+            (fabsf(traced - reduction) > 0.5f / COMP_TRACE_STEPS_PER_DB + 0.01f)) {
+            trace_errors++;
+        }
+    }
+
+    /* Otherwise the ceiling was never tested */
+    TEST_CHECK(limited >= TEST_CONFIGS / 2u, "the limiter acted in only %u of %u takes", limited,
+               TEST_CONFIGS);
+    TEST_CHECK(overshoots == 0u, "%u samples above the ceiling, worst by %d in configuration %u",
+               overshoots, (int)worst, worst_config);
+    TEST_CHECK(mismatches == 0u, "%u of %u takes differ when fed as captured", mismatches, TEST_CONFIGS);
+    TEST_CHECK(short_takes == 0u, "%u of %u takes not processed to the end", short_takes, TEST_CONFIGS);
+    TEST_CHECK(trace_errors == 0u, "%u of %u traces disagree with the largest reduction",
+               trace_errors, TEST_CONFIGS);
+}
+
+/*******************************************************************************
+* Function Name: test_gain_ramps
+********************************************************************************
+* Summary:
+*  The gain moves along per-block ramps, never in a jump: with an input
+*  that never comes near zero the gain of every frame can be read back as
+*  output / input, and after the first block (which may have to start low)
+*  it changes by at most the makeup gain / COMP_BLOCK_FRAMES per frame
+*
+*******************************************************************************/
+static void test_gain_ramps(void)
+{
+    double worst = 0.0;
+    uint32_t worst_config = 0;
+
+    for (uint32_t t = 0; t < TEST_CONFIGS / 4u; t++) {
+        compressor_config_t config = {
+            .enabled = true,
+            .threshold_db = test_range(0u, COMP_MAX_THRESHOLD_DB),
+            .ratio = test_range(1u, COMP_MAX_RATIO),
+            .attack_ms = test_range(1u, 10u),
+            .release_ms = test_range(COMP_MIN_RELEASE_MS, 200u),
+            .lookahead_ms = test_range(0u, COMP_MAX_LOOKAHEAD_MS),
+            .ceiling_db = test_range(0u, COMP_MAX_CEILING_DB),
+            .makeup_db = test_range(0u, COMP_MAX_MAKEUP_DB),
+        };
+        uint32_t rate = ((t & 1u) != 0u) ? 48000u : 16000u;
+        uint32_t frames = rate / 4u;
+        double makeup = pow(10.0, config.makeup_db / 20.0);
+        double last = 0.0;
+        int32_t level = 32767;
+        compressor_t comp;
+
+        /* Alternating samples, the level stepping between segments */
+        for (uint32_t n = 0; n < frames; n++) {
+            if ((n % 500u) == 0u) {
+                level = (int32_t)test_range(4096u, 32767u);
+            }
+            test_input[n] = (int16_t)(((n & 1u) != 0u) ? level : -level);
+        }
+        memcpy(test_fed, test_input, frames * sizeof(int16_t));
+        (void)compressor_init(&comp, &config, 1u, rate, NULL);
+        (void)test_feed(&comp, test_fed, frames, 1u);
+
+        for (uint32_t n = 0; n < frames; n++) {
+            double gain = (double)test_fed[n] / test_input[n];
+            /* Out of the rounding of a sample of at least 4096 */
+            double change = fabs(gain - last) - makeup / COMP_BLOCK_FRAMES - 1.0 / 4096.0;
+
+            if ((n >= COMP_BLOCK_FRAMES) && (change > worst)) {
+                worst = change;
+                worst_config = t;
+            }
+            last = gain;
+        }
+    }
+    TEST_CHECK(worst <= 0.0, "gain jumped %.4f more than a ramp allows in configuration %u", worst,
+               worst_config);
+}
+
+/*******************************************************************************
+* Function Name: test_tone_level_db
+********************************************************************************
+* Summary:
+*  Compress one second of a 1 kHz tone at 16 kHz (a whole cycle per block)
+*  and return the output peak over the last half second, in dBFS
+*
+*******************************************************************************/
+static double test_tone_level_db(const compressor_config_t *config, double level_db)
+{
+    compressor_t comp;
+    double amplitude = 32767.0 * pow(10.0, level_db / 20.0);
+    int32_t peak = 0;
+
+    for (uint32_t n = 0; n < 16000u; n++) {
+        test_input[n] = (int16_t)lround(amplitude * sin(2.0 * M_PI * 1000.0 * n / 16000.0 + 0.3));
+    }
+    (void)compressor_init(&comp, config, 1u, 16000u, NULL);
+    (void)compressor_process(&comp, test_input, 16000u, true);
+    for (uint32_t n = 8000u; n < 16000u; n++) {
+        peak = (abs(test_input[n]) > peak) ? abs(test_input[n]) : peak;
+    }
+    return 20.0 * log10(peak / 32767.0);
+}
+
+/*******************************************************************************
+* Function Name: test_static_curve
+********************************************************************************
+* Summary:
+*  A steady tone above the threshold comes out at
+*  threshold + (level - threshold) / ratio, below it at level + makeup
+*
+*******************************************************************************/
+static void test_static_curve(void)
+{
+    static const struct {
+        uint32_t threshold_db;
+        uint32_t ratio;
+        uint32_t makeup_db;
+        double level_db;
+    } cases[] = {
+        { 12u, 4u, 0u, -1.0 }, { 12u, 4u, 0u, -6.0 }, { 20u, 2u, 0u, -3.0 }, { 30u, 20u, 0u, -10.0 },
+        { 20u, 4u, 6u, -6.0 }, { 12u, 4u, 0u, -20.0 }, { 20u, 2u, 12u, -40.0 }, { 6u, 1u, 3u, -12.0 },
+    };
+
+    for (uint32_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        compressor_config_t config = {
+            .enabled = true,
+            .threshold_db = cases[i].threshold_db,
+            .ratio = cases[i].ratio,
+            .attack_ms = 5u,
+            .release_ms = 100u,
+            .lookahead_ms = 2u,
+            .ceiling_db = 0u,
+            .makeup_db = cases[i].makeup_db,
+        };
+        double in_db = cases[i].level_db + cases[i].makeup_db;
+        double threshold_db = -(double)cases[i].threshold_db;
+        double expected = (in_db > threshold_db) ?
+                          threshold_db + (in_db - threshold_db) / cases[i].ratio : in_db;
+        double measured = test_tone_level_db(&config, cases[i].level_db);
+
+        TEST_CHECK(fabs(measured - expected) <= TEST_CURVE_DB,
+                   "%.0f dBFS tone, -%u dB %u:1 +%u dB: %.2f dBFS, expected %.2f", cases[i].level_db,
+                   cases[i].threshold_db, cases[i].ratio, cases[i].makeup_db, measured, expected);
+    }
+}
+
+/*******************************************************************************
+* Function Name: test_pass_through
+********************************************************************************
+* Summary:
+*  Below the threshold and the ceiling with no makeup the take is unchanged
+*
+*******************************************************************************/
+static void test_pass_through(void)
+{
+    compressor_config_t config;
+    compressor_t comp;
+
+    compressor_config_get(&config);
+    config.enabled = true;
+    test_make_take(TEST_MAX_FRAMES / 2u, 2u, 16000u);
+    for (uint32_t i = 0; i < TEST_MAX_FRAMES; i++) {
+        test_input[i] /= 8;                     /* -18 dB, under the -12 dB threshold */
+    }
+    memcpy(test_fed, test_input, TEST_MAX_FRAMES * sizeof(int16_t));
+    (void)compressor_init(&comp, &config, 2u, 16000u, NULL);
+    TEST_CHECK(test_feed(&comp, test_fed, TEST_MAX_FRAMES / 2u, 2u) == TEST_MAX_FRAMES / 2u,
+               "quiet take not processed to the end");
+    TEST_CHECK(memcmp(test_fed, test_input, TEST_MAX_FRAMES * sizeof(int16_t)) == 0,
+               "quiet take changed");
+    TEST_CHECK(compressor_max_reduction_db(&comp) == 0.0f, "quiet take reduced by %.2f dB",
+               compressor_max_reduction_db(&comp));
+}
+
+/*******************************************************************************
+* Function Name: test_limits
+*******************************************************************************/
+static void test_limits(void)
+{
+    compressor_config_t config;
+    compressor_config_t saved;
+    compressor_t comp;
+
+    compressor_config_get(&saved);
+    config = saved;
+    config.ratio = 0u;
+    TEST_CHECK(compressor_config_set(&config) != 0, "ratio 0 accepted");
+    config = saved;
+    config.makeup_db = COMP_MAX_MAKEUP_DB + 1u;
+    TEST_CHECK(compressor_config_set(&config) != 0, "makeup beyond maximum accepted");
+    config = saved;
+    config.release_ms = COMP_MIN_RELEASE_MS - 1u;
+    TEST_CHECK(compressor_config_set(&config) != 0, "release below minimum accepted");
+    config = saved;
+    config.lookahead_ms = COMP_MAX_LOOKAHEAD_MS + 1u;
+    TEST_CHECK(compressor_config_set(&config) != 0, "look-ahead beyond maximum accepted");
+    TEST_CHECK(compressor_init(&comp, &saved, 3u, 16000u, NULL) != 0, "three channels accepted");
+}
+
+/*******************************************************************************
+* Function Name: main
+*******************************************************************************/
+int main(void)
+{
+    test_random_configs();
+    test_gain_ramps();
+    test_static_curve();
+    test_pass_through();
+    test_limits();
+    return test_finish("compressor");
+}
@@ -0,0 +1,179 @@
+/******************************************************************************
+* File Name: test_mls.c
+*
+* Description: Host unit test - MLS cross-correlation for the latency command
+*              Delays the sequence by fractional lags through a band-limited
+*              (windowed sinc) delay, optionally low-passes or inverts it,
+*              adds Gaussian noise and checks that mls_correlate() finds the
+*              lag within TEST_LAG_ERROR frames, the polarity, and a peak
+*              level that clears LATENCY_MIN_PEAK_DB only when the sequence
+*              is there.
+*
+*******************************************************************************/
+
+#include "test.h"
+#include "mls.h"
+#include "latency.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define TEST_LAGS                   (3200u)     /* 200 ms at 16 kHz, as latency.c searches */
+#define TEST_WINDOW_FRAMES          (TEST_LAGS + MLS_FRAMES)
+#define TEST_DELAY_HALF_TAPS        (32)        /* Windowed sinc, each side */
+#define TEST_AMPLITUDE              (3277.0)    /* -20 dBFS, the latency default */
+#define TEST_LAG_ERROR              (0.1)       /* Frames */
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static double test_signal[TEST_WINDOW_FRAMES];
+static int16_t test_window[TEST_WINDOW_FRAMES];
+static int32_t test_corr[TEST_LAGS];
+static uint32_t test_seed = 12345u;
+
+/*******************************************************************************
+* Function Name: test_gauss
+********************************************************************************
+* Summary:
+*  Standard normal value, Box-Muller on a 32-bit LCG
+*
+*******************************************************************************/
+static double test_gauss(void)
+{
+    double u1;
+    double u2;
+
+    test_seed = test_seed * 1664525u + 1013904223u;
+    u1 = ((test_seed >> 8) + 1.0) / 16777217.0;
+    test_seed = test_seed * 1664525u + 1013904223u;
+    u2 = (test_seed >> 8) / 16777216.0;
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+/*******************************************************************************
+* Function Name: test_make
+********************************************************************************
+* Summary:
+*  The sequence at +-amplitude delayed by 'delay' frames through a
+*  Blackman-windowed sinc, then an optional [1 4 6 4 1]/16 low-pass (two
+*  frames of group delay, added by the caller) and noise of noise_db
+*  relative to the sequence's RMS, rounded to int16
+*
+*******************************************************************************/
+static void test_make(double delay, double amplitude, bool lowpass, double noise_db)
+{
+    const uint8_t *mls = mls_sequence();
+    double noise = amplitude * pow(10.0, noise_db / 20.0);
+
+    memset(test_signal, 0, sizeof(test_signal));
+    for (uint32_t k = 0; k < MLS_FRAMES; k++) {
+        double value = (mls[k] != 0u) ? amplitude : -amplitude;
+        int32_t centre = (int32_t)floor(delay) + (int32_t)k;
+
+        for (int32_t n = centre - TEST_DELAY_HALF_TAPS + 1; n <= centre + TEST_DELAY_HALF_TAPS; n++) {
+            double x = n - k - delay;
+            double w = 0.42 + 0.5 * cos(M_PI * x / TEST_DELAY_HALF_TAPS) +
+                       0.08 * cos(2.0 * M_PI * x / TEST_DELAY_HALF_TAPS);
+            double sinc = (fabs(x) < 1e-9) ? 1.0 : sin(M_PI * x) / (M_PI * x);
+
+            if ((n >= 0) && (n < (int32_t)TEST_WINDOW_FRAMES) && (fabs(x) < TEST_DELAY_HALF_TAPS)) {
+                test_signal[n] += value * sinc * w;
+            }
+        }
+    }
+    if (lowpass) {
+        for (uint32_t n = TEST_WINDOW_FRAMES - 1u; n >= 4u; n--) {
+            test_signal[n] = (test_signal[n] + 4.0 * test_signal[n - 1u] + 6.0 * test_signal[n - 2u] +
+                              4.0 * test_signal[n - 3u] + test_signal[n - 4u]) / 16.0;
+        }
+    }
+    for (uint32_t n = 0; n < TEST_WINDOW_FRAMES; n++) {
+        double value = round(test_signal[n] + noise * test_gauss());
+
+        test_window[n] = (int16_t)fmax(-32768.0, fmin(32767.0, value));
+    }
+}
+
+/*******************************************************************************
+* Function Name: test_lag
+********************************************************************************
+* Summary:
+*  Correlate the prepared window and check the lag and polarity
+*
+*******************************************************************************/
+static void test_lag(const char *what, double expected, bool inverted)
+{
+    mls_peak_t peak;
+
+    mls_correlate(test_window, TEST_LAGS, test_corr, &peak);
+    TEST_CHECK(fabs(peak.lag - expected) <= TEST_LAG_ERROR,
+               "%s: lag %.3f, expected %.3f (limit %.1f frame)", what, peak.lag, expected, TEST_LAG_ERROR);
+    TEST_CHECK(peak.inverted == inverted, "%s: polarity %s", what, peak.inverted ? "inverted" : "normal");
+    TEST_CHECK(peak.peak_db >= LATENCY_MIN_PEAK_DB, "%s: peak only %.1f dB over the rest", what, peak.peak_db);
+}
+
+/*******************************************************************************
+* Function Name: main
+*******************************************************************************/
+int main(void)
+{
+    static const double delays[] = { 1.5, 2.25, 17.1, 100.37, 511.9, 999.5, 1600.63, 3100.05, 3197.8 };
+    char what[80];
+    mls_peak_t peak;
+    double worst = 0.0;
+
+    /* Every tenth of a frame, clean and at 0 dB SNR */
+    for (uint32_t i = 0; i <= 20u; i++) {
+        double delay = 500.0 + (i * 0.05);
+
+        test_make(delay, TEST_AMPLITUDE, false, -200.0);
+        snprintf(what, sizeof(what), "clean, %.2f frames", delay);
+        test_lag(what, delay, false);
+
+        test_make(delay, TEST_AMPLITUDE, false, 0.0);
+        snprintf(what, sizeof(what), "0 dB SNR, %.2f frames", delay);
+        test_lag(what, delay, false);
+    }
+
+    /* Across the searched range, with noise, inverted and low-passed */
+    for (uint32_t i = 0; i < sizeof(delays) / sizeof(delays[0]); i++) {
+        test_make(delays[i], TEST_AMPLITUDE, false, 0.0);
+        snprintf(what, sizeof(what), "%.2f frames", delays[i]);
+        test_lag(what, delays[i], false);
+
+        test_make(delays[i], -TEST_AMPLITUDE, false, -10.0);
+        snprintf(what, sizeof(what), "inverted, %.2f frames", delays[i]);
+        test_lag(what, delays[i], true);
+
+        if (delays[i] + 2.0 < TEST_LAGS - 1u) {
+            test_make(delays[i], TEST_AMPLITUDE, true, -10.0);
+            snprintf(what, sizeof(what), "low-passed, %.2f frames", delays[i]);
+            test_lag(what, delays[i] + 2.0, false);
+        }
+    }
+
+    /* A -40 dBFS sequence under noise 3 dB louder */
+    for (uint32_t i = 0; i < 20u; i++) {
+        double delay = 200.0 + (i * 37.31);
+
+        test_make(delay, 328.0, false, 3.0);
+        mls_correlate(test_window, TEST_LAGS, test_corr, &peak);
+        worst = fmax(worst, fabs(peak.lag - delay));
+    }
+    TEST_CHECK(worst <= TEST_LAG_ERROR, "-3 dB SNR: lag off by up to %.3f frames", worst);
+
+    /* Noise alone is not a measurement */
+    test_make(0.0, 0.0, false, 0.0);
+    for (uint32_t n = 0; n < TEST_WINDOW_FRAMES; n++) {
+        test_window[n] = (int16_t)lround(1000.0 * test_gauss());
+    }
+    mls_correlate(test_window, TEST_LAGS, test_corr, &peak);
+    TEST_CHECK(peak.peak_db < LATENCY_MIN_PEAK_DB, "noise alone gave a %.1f dB peak", peak.peak_db);
+
+    return test_finish("mls");
+}
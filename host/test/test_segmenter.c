@@ -0,0 +1,404 @@
+/******************************************************************************
+* File Name: test_segmenter.c
+*
+* Description: Host unit test - silence trimming and splitting
+*              Feeds generated takes of tone bursts to segmenter.c in blocks,
+*              as the record task does, and checks the saved ranges against
+*              the burst positions: the pre-padding (at most one block, never
+*              back into the previous segment), the post-padding (cut at the
+*              end of the take), the split at a long enough gap and the level
+*              threshold.
+*
+*******************************************************************************/
+
+#include "test.h"
+#include "segmenter.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define TEST_RATE                   (16000u)
+#define TEST_CHANNELS               (2u)
+#define TEST_MAX_FRAMES             (64u * SEGMENT_BLOCK_FRAMES)
+#define TEST_MAX_SEGMENTS           (8u)
+#define TEST_BLOCK                  SEGMENT_BLOCK_FRAMES
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+typedef struct {
+    uint32_t start;             /* Frame */
+    uint32_t frames;
+    int16_t peak;               /* Largest |sample| of the burst */
+    uint32_t channel;           /* 0, 1, or 2 for both */
+} test_burst_t;
+
+typedef struct {
+    segment_t segment[TEST_MAX_SEGMENTS];
+    uint32_t count;
+} test_result_t;
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static int16_t test_take[TEST_MAX_FRAMES * TEST_CHANNELS];
+
+/*******************************************************************************
+* Function Name: test_make_take
+********************************************************************************
+* Summary:
+*  Silence with 1 kHz bursts whose peak is exactly the given level
+*
+*******************************************************************************/
+static void test_make_take(uint32_t frames, const test_burst_t *bursts, uint32_t count)
+{
+    memset(test_take, 0, frames * TEST_CHANNELS * sizeof(int16_t));
+
+    for (uint32_t b = 0; b < count; b++) {
+        for (uint32_t n = 0; n < bursts[b].frames; n++) {
+            /* Phase offset so that the first sample of every cycle is the peak */
+            double value = bursts[b].peak * cos(2.0 * M_PI * 1000.0 * n / TEST_RATE);
+            int16_t sample = (int16_t)lrint(value);
+            uint32_t frame = bursts[b].start + n;
+
+            for (uint32_t c = 0; c < TEST_CHANNELS; c++) {
+                if ((bursts[b].channel == 2u) || (bursts[b].channel == c)) {
+                    test_take[frame * TEST_CHANNELS + c] = sample;
+                }
+            }
+        }
+    }
+}
+
+/*******************************************************************************
+* Function Name: test_run
+********************************************************************************
+* Summary:
+*  Segment a take in blocks of up to block_frames, the last one partial
+*
+*******************************************************************************/
+static void test_run(const segment_config_t *config, uint32_t frames, uint32_t block_frames,
+                     test_result_t *result)
+{
+    segmenter_t seg;
+    segment_t segment;
+
+    result->count = 0;
+    segmenter_init(&seg, config, TEST_CHANNELS, TEST_RATE);
+
+    for (uint32_t position = 0; position < frames; position += block_frames) {
+        uint32_t length = ((frames - position) < block_frames) ? (frames - position) : block_frames;
+
+        if (segmenter_process(&seg, &test_take[position * TEST_CHANNELS], length, &segment) &&
+            (result->count < TEST_MAX_SEGMENTS)) {
+            result->segment[result->count++] = segment;
+        }
+    }
+    if (segmenter_finish(&seg, &segment) && (result->count < TEST_MAX_SEGMENTS)) {
+        result->segment[result->count++] = segment;
+    }
+}
+
+/*******************************************************************************
+* Function Name: test_expect
+********************************************************************************
+* Summary:
+*  Check the segments found against the expected [start, end) ranges
+*
+*******************************************************************************/
+static void test_expect(const char *name, const test_result_t *result,
+                        const uint32_t (*expected)[2], uint32_t count)
+{
+    if (!TEST_CHECK(result->count == count, "%s: %u segments, expected %u",
+                    name, (unsigned int)result->count, (unsigned int)count)) {
+        return;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        const segment_t *segment = &result->segment[i];
+
+        TEST_CHECK((segment->start == expected[i][0]) &&
+                   (segment->start + segment->frames == expected[i][1]),
+                   "%s: segment %u is [%u, %u), expected [%u, %u)", name, (unsigned int)i,
+                   (unsigned int)segment->start, (unsigned int)(segment->start + segment->frames),
+                   (unsigned int)expected[i][0], (unsigned int)expected[i][1]);
+    }
+}
+
+/*******************************************************************************
+* Function Name: test_config
+*******************************************************************************/
+static segment_config_t test_config(segment_mode_t mode, uint32_t gap_ms,
+                                    uint32_t pre_pad_ms, uint32_t post_pad_ms)
+{
+    segment_config_t config = {
+        .mode = mode,
+        .level_db = SEGMENT_DEFAULT_LEVEL_DB,
+        .gap_ms = gap_ms,
+        .pre_pad_ms = pre_pad_ms,
+        .post_pad_ms = post_pad_ms,
+    };
+    return config;
+}
+
+/*******************************************************************************
+* Function Name: test_trim
+********************************************************************************
+* Summary:
+*  One burst: leading and trailing silence go, the padding stays
+*
+*******************************************************************************/
+static void test_trim(void)
+{
+    segment_config_t config = test_config(SEGMENT_MODE_TRIM, 1000u, 64u, 250u);
+    test_result_t result;
+
+    /* Burst in blocks 3 and 4: one block (64 ms) before, 4000 frames (250 ms) after */
+    {
+        test_burst_t burst = { 3u * TEST_BLOCK + 100u, 1500u, 8000, 2u };
+        static const uint32_t expected[][2] = { { 2u * TEST_BLOCK, 5u * TEST_BLOCK + 4000u } };
+
+        test_make_take(10u * TEST_BLOCK, &burst, 1);
+        test_run(&config, 10u * TEST_BLOCK, TEST_BLOCK, &result);
+        test_expect("trim", &result, expected, 1);
+    }
+
+    /* Burst in the first block: the pre-padding stops at the start of the take */
+    {
+        test_burst_t burst = { 10u, 200u, 8000, 2u };
+        static const uint32_t expected[][2] = { { 0u, TEST_BLOCK + 4000u } };
+
+        test_make_take(10u * TEST_BLOCK, &burst, 1);
+        test_run(&config, 10u * TEST_BLOCK, TEST_BLOCK, &result);
+        test_expect("trim at start", &result, expected, 1);
+    }
+
+    /* Burst in the partial last block: the post-padding stops at the end */
+    {
+        uint32_t frames = 9u * TEST_BLOCK + 300u;
+        test_burst_t burst = { 9u * TEST_BLOCK + 50u, 100u, 8000, 2u };
+        static const uint32_t expected[][2] = { { 8u * TEST_BLOCK, 9u * TEST_BLOCK + 300u } };
+
+        test_make_take(frames, &burst, 1);
+        test_run(&config, frames, TEST_BLOCK, &result);
+        test_expect("trim at end", &result, expected, 1);
+    }
+
+    /* Other padding: 32 ms = 512 frames before, 100 ms = 1600 frames after */
+    {
+        segment_config_t padded = test_config(SEGMENT_MODE_TRIM, 1000u, 32u, 100u);
+        test_burst_t burst = { 4u * TEST_BLOCK, 10u, 8000, 2u };
+        static const uint32_t expected[][2] = { { 4u * TEST_BLOCK - 512u, 5u * TEST_BLOCK + 1600u } };
+
+        test_make_take(10u * TEST_BLOCK, &burst, 1);
+        test_run(&padded, 10u * TEST_BLOCK, TEST_BLOCK, &result);
+        test_expect("trim padding", &result, expected, 1);
+    }
+
+    /* Pre-padding is limited to one block */
+    {
+        segment_config_t padded = test_config(SEGMENT_MODE_TRIM, 1000u, 500u, 0u);
+        test_burst_t burst = { 6u * TEST_BLOCK, 10u, 8000, 2u };
+        static const uint32_t expected[][2] = { { 5u * TEST_BLOCK, 7u * TEST_BLOCK } };
+
+        test_make_take(10u * TEST_BLOCK, &burst, 1);
+        test_run(&padded, 10u * TEST_BLOCK, TEST_BLOCK, &result);
+        test_expect("trim pre-pad limit", &result, expected, 1);
+    }
+
+    /* Two bursts far apart stay in one segment when trimming */
+    {
+        test_burst_t bursts[] = { { 2u * TEST_BLOCK, 100u, 8000, 2u }, { 40u * TEST_BLOCK, 100u, 8000, 2u } };
+        static const uint32_t expected[][2] = { { TEST_BLOCK, 41u * TEST_BLOCK + 4000u } };
+
+        test_make_take(50u * TEST_BLOCK, bursts, 2);
+        test_run(&config, 50u * TEST_BLOCK, TEST_BLOCK, &result);
+        test_expect("trim two bursts", &result, expected, 1);
+    }
+
+    /* No activity: nothing to save */
+    test_make_take(10u * TEST_BLOCK, NULL, 0);
+    test_run(&config, 10u * TEST_BLOCK, TEST_BLOCK, &result);
+    TEST_CHECK(result.count == 0u, "silent take gave %u segments", (unsigned int)result.count);
+}
+
+/*******************************************************************************
+* Function Name: test_split
+********************************************************************************
+* Summary:
+*  Bursts separated by more and by less than the gap
+*
+*******************************************************************************/
+static void test_split(void)
+{
+    segment_config_t config = test_config(SEGMENT_MODE_SPLIT, 1000u, 64u, 250u);
+    test_result_t result;
+
+    /* A 1000 ms gap is 16000 frames: the segment closes 16 quiet blocks after
+     * the last active one (15 blocks are only 15360 frames) */
+    {
+        test_burst_t bursts[] = { { 2u * TEST_BLOCK, 2u * TEST_BLOCK, 8000, 2u },
+                                  { 21u * TEST_BLOCK, 500u, 8000, 2u } };
+        static const uint32_t expected[][2] = {
+            { 1u * TEST_BLOCK, 4u * TEST_BLOCK + 4000u },
+            { 20u * TEST_BLOCK, 22u * TEST_BLOCK + 4000u },
+        };
+
+        test_make_take(30u * TEST_BLOCK, bursts, 2);
+        test_run(&config, 30u * TEST_BLOCK, TEST_BLOCK, &result);
+        test_expect("split", &result, expected, 2);
+    }
+
+    /* Gap shorter than 1000 ms: one segment */
+    {
+        test_burst_t bursts[] = { { 2u * TEST_BLOCK, 100u, 8000, 2u },
+                                  { 17u * TEST_BLOCK, 100u, 8000, 2u } };
+        static const uint32_t expected[][2] = { { TEST_BLOCK, 18u * TEST_BLOCK + 4000u } };
+
+        test_make_take(30u * TEST_BLOCK, bursts, 2);
+        test_run(&config, 30u * TEST_BLOCK, TEST_BLOCK, &result);
+        test_expect("split short gap", &result, expected, 1);
+    }
+
+    /* A 200 ms gap (3200 frames) limits the post-padding to 3200 frames, and
+     * the next segment's pre-padding stops where the previous one ended */
+    {
+        segment_config_t short_gap = test_config(SEGMENT_MODE_SPLIT, 200u, 64u, 250u);
+        test_burst_t bursts[] = { { 2u * TEST_BLOCK, 100u, 8000, 2u },
+                                  { 7u * TEST_BLOCK, 100u, 8000, 2u } };
+        static const uint32_t expected[][2] = {
+            { 1u * TEST_BLOCK, 3u * TEST_BLOCK + 3200u },
+            { 3u * TEST_BLOCK + 3200u, 8u * TEST_BLOCK + 3200u },
+        };
+
+        test_make_take(20u * TEST_BLOCK, bursts, 2);
+        test_run(&short_gap, 20u * TEST_BLOCK, TEST_BLOCK, &result);
+        test_expect("split pre-pad floor", &result, expected, 2);
+    }
+
+    /* A 128 ms gap is exactly two blocks: two quiet blocks close the segment,
+     * one does not */
+    {
+        segment_config_t two_blocks = test_config(SEGMENT_MODE_SPLIT, 128u, 64u, 250u);
+        test_burst_t bursts[] = { { 2u * TEST_BLOCK, 100u, 8000, 2u },
+                                  { 5u * TEST_BLOCK, 100u, 8000, 2u } };
+        static const uint32_t split[][2] = {
+            { 1u * TEST_BLOCK, 5u * TEST_BLOCK },
+            { 5u * TEST_BLOCK, 8u * TEST_BLOCK },
+        };
+        static const uint32_t joined[][2] = { { 1u * TEST_BLOCK, 7u * TEST_BLOCK } };
+
+        test_make_take(12u * TEST_BLOCK, bursts, 2);
+        test_run(&two_blocks, 12u * TEST_BLOCK, TEST_BLOCK, &result);
+        test_expect("split gap boundary", &result, split, 2);
+
+        bursts[1].start = 4u * TEST_BLOCK;
+        test_make_take(12u * TEST_BLOCK, bursts, 2);
+        test_run(&two_blocks, 12u * TEST_BLOCK, TEST_BLOCK, &result);
+        test_expect("split under gap", &result, joined, 1);
+    }
+
+    /* Three bursts, 300 ms on and 1000 ms off as with --bursts 300,1000: three
+     * segments, the last one cut at the end of the 4 s take */
+    {
+        test_burst_t bursts[3];
+        uint32_t frames = 4u * TEST_RATE;
+        segment_config_t gap500 = test_config(SEGMENT_MODE_SPLIT, 500u, 64u, 250u);
+
+        for (uint32_t i = 0; i < 3u; i++) {
+            bursts[i] = (test_burst_t){ i * 20800u, 4800u, 8000, 2u };
+        }
+        test_make_take(frames, bursts, 3);
+        test_run(&gap500, frames, TEST_BLOCK, &result);
+        if (TEST_CHECK(result.count == 3u, "bursts: %u segments, expected 3", (unsigned int)result.count)) {
+            for (uint32_t i = 0; i < 3u; i++) {
+                uint32_t start = bursts[i].start;
+                uint32_t end = start + bursts[i].frames;
+                const segment_t *segment = &result.segment[i];
+
+                /* Block granularity: the burst is inside, with at most one
+                 * block plus the padding around it */
+                TEST_CHECK((segment->start <= start) && (start - segment->start <= 2u * TEST_BLOCK),
+                           "bursts: segment %u starts at %u for a burst at %u",
+                           (unsigned int)i, (unsigned int)segment->start, (unsigned int)start);
+                TEST_CHECK((segment->start + segment->frames >= end) &&
+                           (segment->start + segment->frames <= end + TEST_BLOCK + 4000u),
+                           "bursts: segment %u ends at %u for a burst ending at %u", (unsigned int)i,
+                           (unsigned int)(segment->start + segment->frames), (unsigned int)end);
+            }
+        }
+    }
+}
+
+/*******************************************************************************
+* Function Name: test_level
+********************************************************************************
+* Summary:
+*  The default -45 dBFS threshold is a peak of 184; either channel and
+*  either polarity counts
+*
+*******************************************************************************/
+static void test_level(void)
+{
+    segment_config_t config = test_config(SEGMENT_MODE_TRIM, 1000u, 0u, 0u);
+    static const uint32_t expected[][2] = { { 4u * TEST_BLOCK, 5u * TEST_BLOCK } };
+    test_result_t result;
+    test_burst_t burst = { 4u * TEST_BLOCK, 16u, 184, 2u };
+
+    test_make_take(8u * TEST_BLOCK, &burst, 1);
+    test_run(&config, 8u * TEST_BLOCK, TEST_BLOCK, &result);
+    TEST_CHECK(result.count == 0u, "a peak of 184 is above -45 dBFS");
+
+    burst.peak = 185;
+    test_make_take(8u * TEST_BLOCK, &burst, 1);
+    test_run(&config, 8u * TEST_BLOCK, TEST_BLOCK, &result);
+    test_expect("level 185", &result, expected, 1);
+
+    burst.peak = -185;
+    burst.channel = 1u;
+    test_make_take(8u * TEST_BLOCK, &burst, 1);
+    test_run(&config, 8u * TEST_BLOCK, TEST_BLOCK, &result);
+    test_expect("level -185 right", &result, expected, 1);
+
+    /* The block size the caller uses does not matter below SEGMENT_BLOCK_FRAMES */
+    test_run(&config, 8u * TEST_BLOCK, TEST_BLOCK / 4u, &result);
+    {
+        static const uint32_t quarter[][2] = { { 4u * TEST_BLOCK, 4u * TEST_BLOCK + TEST_BLOCK / 4u } };
+        test_expect("level quarter blocks", &result, quarter, 1);
+    }
+}
+
+/*******************************************************************************
+* Function Name: test_config_limits
+*******************************************************************************/
+static void test_config_limits(void)
+{
+    segment_config_t config = test_config(SEGMENT_MODE_SPLIT, 1000u, 64u, 250u);
+    segment_config_t saved;
+
+    segment_config_get(&saved);
+    TEST_CHECK(segment_config_set(&config) == 0, "valid config refused");
+    config.level_db = 0u;
+    TEST_CHECK(segment_config_set(&config) != 0, "level 0 dB accepted");
+    config.level_db = SEGMENT_MAX_LEVEL_DB + 1u;
+    TEST_CHECK(segment_config_set(&config) != 0, "level beyond the maximum accepted");
+    config.level_db = SEGMENT_DEFAULT_LEVEL_DB;
+    config.gap_ms = 0u;
+    TEST_CHECK(segment_config_set(&config) != 0, "zero gap accepted");
+    (void)segment_config_set(&saved);
+}
+
+/*******************************************************************************
+* Function Name: main
+*******************************************************************************/
+int main(void)
+{
+    test_trim();
+    test_split();
+    test_level();
+    test_config_limits();
+    return test_finish("segmenter");
+}
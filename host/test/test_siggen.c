@@ -0,0 +1,387 @@
+/******************************************************************************
+* File Name: test_siggen.c
+*
+* Description: Host unit test - test-signal generator
+*              Renders the signals in blocks of varying size, as the I2S
+*              refill does, and measures them: harmonic distortion and
+*              THD+N of tones against the 16-bit quantization floor, tone
+*              frequency from the phase drift over ten seconds, the sweep's
+*              instantaneous frequency against the logarithmic law, levels,
+*              exact lengths and click spacing.
+*
+*******************************************************************************/
+
+#include "test.h"
+#include "siggen.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define TEST_MAX_FRAMES             (10u * 48000u)
+#define TEST_HARMONICS              (10u)
+
+/* Tolerances */
+#define TEST_THD_DB                 (-90.0)     /* Harmonics, full scale tone */
+#define TEST_THDN_MARGIN_DB         (3.0)       /* Interpolation error on top of rounding */
+#define TEST_SWEEP_ERROR            (1e-5)      /* Relative, per window */
+#define TEST_SWEEP_WINDOW           (1024u)
+#define TEST_LEVEL_DB               (0.01)
+#define TEST_LEVEL_LSB              (0.5)       /* Rounding dominates quiet tones */
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static int16_t test_out[TEST_MAX_FRAMES * 2u];
+static uint32_t test_seed = 1u;
+
+/*******************************************************************************
+* Function Name: test_render
+********************************************************************************
+* Summary:
+*  Render up to 'frames' frames in blocks of 1 to 64 frames
+*
+* Return:
+*  Frames rendered; every block must return what was asked until the end
+*
+*******************************************************************************/
+static uint32_t test_render(siggen_t *gen, uint32_t frames)
+{
+    uint32_t done = 0;
+
+    while (done < frames) {
+        uint32_t block;
+        uint32_t got;
+
+        test_seed = test_seed * 1103515245u + 12345u;
+        block = 1u + ((test_seed >> 16) % 64u);
+        if (block > frames - done) {
+            block = frames - done;
+        }
+        got = siggen_render(gen, &test_out[2u * done], block);
+        done += got;
+        if (got < block) {
+            break;
+        }
+    }
+    return done;
+}
+
+/*******************************************************************************
+* Function Name: test_correlate
+********************************************************************************
+* Summary:
+*  Amplitude and phase of one frequency in the left channel, over frames
+*  first..first+count-1
+*
+*******************************************************************************/
+static double test_correlate(uint32_t first, uint32_t count, double freq_hz, double rate,
+                             double *phase)
+{
+    double re = 0.0;
+    double im = 0.0;
+
+    for (uint32_t n = first; n < first + count; n++) {
+        double angle = 2.0 * M_PI * freq_hz * n / rate;
+
+        re += test_out[2u * n] * cos(angle);
+        im += test_out[2u * n] * sin(angle);
+    }
+    if (phase != NULL) {
+        *phase = atan2(re, im);
+    }
+    return 2.0 * sqrt(re * re + im * im) / count;
+}
+
+/*******************************************************************************
+* Function Name: test_tone_quality
+********************************************************************************
+* Summary:
+*  Level, THD and THD+N of one second of a tone with a whole number of
+*  cycles, and the channels identical
+*
+*******************************************************************************/
+static void test_tone_quality(uint32_t freq_hz, uint32_t rate, uint32_t atten_db)
+{
+    siggen_config_t config = { SIGGEN_TONE, freq_hz, 0u, 0u, SIGGEN_CONTINUOUS, atten_db };
+    siggen_t gen;
+    double fundamental;
+    double harmonics = 0.0;
+    double residual = 0.0;
+    double phase;
+    double expected;
+    double thd_db;
+    double thdn_db;
+    double floor_db;
+    uint32_t mismatched = 0;
+
+    if (!TEST_CHECK(siggen_init(&gen, &config, rate) == 0, "tone %u Hz at %u Hz refused", freq_hz, rate)) {
+        return;
+    }
+    TEST_CHECK(test_render(&gen, rate) == rate, "continuous tone ended early");
+
+    fundamental = test_correlate(0u, rate, freq_hz, rate, &phase);
+    for (uint32_t k = 2u; k <= TEST_HARMONICS; k++) {
+        /* Harmonics above Nyquist fold back */
+        uint32_t harmonic = (k * freq_hz) % rate;
+        double amplitude;
+
+        if (harmonic > rate / 2u) {
+            harmonic = rate - harmonic;
+        }
+        if ((harmonic == 0u) || (harmonic == rate / 2u)) {
+            continue;
+        }
+        amplitude = test_correlate(0u, rate, harmonic, rate, NULL);
+        harmonics += amplitude * amplitude;
+    }
+    for (uint32_t n = 0; n < rate; n++) {
+        double ideal = fundamental * sin(2.0 * M_PI * freq_hz * n / rate + phase);
+        double error = test_out[2u * n] - ideal;
+
+        residual += error * error;
+        mismatched += (test_out[2u * n] != test_out[2u * n + 1u]) ? 1u : 0u;
+    }
+
+    expected = round(32767.0 * pow(10.0, -(double)atten_db / 20.0));
+    thd_db = 10.0 * log10(harmonics / (fundamental * fundamental) + 1e-30);
+    /* Residual RMS against the fundamental's RMS */
+    thdn_db = 10.0 * log10((residual / rate) / (fundamental * fundamental / 2.0));
+    /* Rounding to 16 bits alone: 1/12 LSB^2 */
+    floor_db = 10.0 * log10((1.0 / 12.0) / (expected * expected / 2.0));
+
+    TEST_CHECK((fabs(20.0 * log10(fundamental / expected)) <= TEST_LEVEL_DB) ||
+               (fabs(fundamental - expected) <= TEST_LEVEL_LSB),
+               "tone %u Hz -%u dB: amplitude %.2f, expected %.0f", freq_hz, atten_db, fundamental, expected);
+    TEST_CHECK(fabs(phase) <= 1e-3, "tone %u Hz: starts at phase %.4f rad, expected 0", freq_hz, phase);
+    TEST_CHECK(thd_db <= TEST_THD_DB + (double)atten_db,
+               "tone %u Hz at %u Hz, -%u dB: THD %.1f dB, limit %.1f dB", freq_hz, rate, atten_db,
+               thd_db, TEST_THD_DB + (double)atten_db);
+    TEST_CHECK(thdn_db <= floor_db + TEST_THDN_MARGIN_DB,
+               "tone %u Hz at %u Hz, -%u dB: THD+N %.1f dB, quantization floor %.1f dB", freq_hz, rate,
+               atten_db, thdn_db, floor_db);
+    TEST_CHECK(mismatched == 0u, "tone %u Hz: %u frames with different channels", freq_hz, mismatched);
+}
+
+/*******************************************************************************
+* Function Name: test_tone_frequency
+********************************************************************************
+* Summary:
+*  Frequency from the phase drift between the first and the tenth second;
+*  one-second windows hold whole cycles, so the phases are unbiased
+*
+*******************************************************************************/
+static void test_tone_frequency(uint32_t freq_hz, uint32_t rate)
+{
+    siggen_config_t config = { SIGGEN_TONE, freq_hz, 0u, 0u, 10u * rate, 6u };
+    siggen_t gen;
+    double phase_first;
+    double phase_last;
+    double drift;
+    double error_hz;
+    double limit_hz = (double)rate / 8589934592.0;  /* siggen.h: below rate / 2^33 */
+    uint32_t window = rate;
+
+    (void)siggen_init(&gen, &config, rate);
+    TEST_CHECK(test_render(&gen, 10u * rate) == 10u * rate, "10 s tone is short");
+
+    /* Both phases are relative to the nominal frequency's own phase at
+     * that time, so a drift is a frequency error */
+    (void)test_correlate(0u, window, freq_hz, rate, &phase_first);
+    (void)test_correlate(10u * rate - window, window, freq_hz, rate, &phase_last);
+    drift = remainder(phase_last - phase_first, 2.0 * M_PI);
+    error_hz = drift / (2.0 * M_PI * 9.0);
+
+    TEST_CHECK(fabs(error_hz) <= limit_hz,
+               "tone %u Hz at %u Hz: off by %.2e Hz, limit %.2e Hz", freq_hz, rate, error_hz, limit_hz);
+}
+
+/*******************************************************************************
+* Function Name: test_sweep
+********************************************************************************
+* Summary:
+*  Instantaneous frequency of a logarithmic sweep against f0 * (f1/f0)^(n/N).
+*  Each window is fitted, by least squares, as a phase offset from the ideal
+*  sweep (phase summed in double); the change of that offset from one window
+*  to the next is the frequency error between them.
+*
+*******************************************************************************/
+static void test_sweep(uint32_t from_hz, uint32_t to_hz, uint32_t frames, uint32_t rate)
+{
+    siggen_config_t config = { SIGGEN_SWEEP, from_hz, to_hz, 0u, frames, 0u };
+    siggen_t gen;
+    double phase = 0.0;
+    double last_offset = 0.0;
+    double worst = 0.0;
+    double worst_at = 0.0;
+    double ss = 0.0, cc = 0.0, sc = 0.0, ys = 0.0, yc = 0.0;
+
+    if (!TEST_CHECK(siggen_init(&gen, &config, rate) == 0, "sweep %u-%u Hz refused", from_hz, to_hz)) {
+        return;
+    }
+    TEST_CHECK(test_render(&gen, frames) == frames, "sweep %u-%u Hz is short", from_hz, to_hz);
+
+    for (uint32_t n = 0; n < frames; n++) {
+        double s = sin(phase);
+        double c = cos(phase);
+        double freq_hz = from_hz * pow((double)to_hz / from_hz, (double)n / frames);
+
+        ss += s * s;
+        cc += c * c;
+        sc += s * c;
+        ys += test_out[2u * n] * s;
+        yc += test_out[2u * n] * c;
+        if (((n + 1u) % TEST_SWEEP_WINDOW) == 0u) {
+            /* y = a sin + b cos = r sin(phase + offset) */
+            double det = ss * cc - sc * sc;
+            double a = (ys * cc - yc * sc) / det;
+            double b = (yc * ss - ys * sc) / det;
+            double offset = atan2(b, a);
+
+            if (n + 1u > TEST_SWEEP_WINDOW) {
+                double drift = remainder(offset - last_offset, 2.0 * M_PI);
+                double error = fabs(drift * rate / (2.0 * M_PI * TEST_SWEEP_WINDOW)) / freq_hz;
+
+                if (error > worst) {
+                    worst = error;
+                    worst_at = (double)n / rate;
+                }
+            }
+            last_offset = offset;
+            ss = cc = sc = ys = yc = 0.0;
+        }
+        phase = fmod(phase + 2.0 * M_PI * freq_hz / rate, 2.0 * M_PI);
+    }
+
+    TEST_CHECK(worst <= TEST_SWEEP_ERROR,
+               "sweep %u-%u Hz at %u Hz: frequency %.1f ppm off the log law near %.3f s (limit %.0f ppm)",
+               from_hz, to_hz, rate, 1e6 * worst, worst_at, 1e6 * TEST_SWEEP_ERROR);
+}
+
+/*******************************************************************************
+* Function Name: test_length_and_clicks
+********************************************************************************
+* Summary:
+*  A signal ends on its exact frame, siggen_stop() ends a continuous one,
+*  and clicks land every period_frames starting at frame 0
+*
+*******************************************************************************/
+static void test_length_and_clicks(void)
+{
+    siggen_config_t config = { SIGGEN_CLICK, 0u, 0u, 480u, 48001u, 20u };
+    siggen_t gen;
+    int16_t block[2u * 100u];
+    uint32_t wrong = 0;
+    int16_t peak = (int16_t)lround(32767.0 * pow(10.0, -20.0 / 20.0));
+
+    (void)siggen_init(&gen, &config, 48000u);
+    TEST_CHECK(test_render(&gen, TEST_MAX_FRAMES) == 48001u, "click train is not 48001 frames");
+    TEST_CHECK(siggen_render(&gen, block, 100u) == 0u, "render after the end returned frames");
+    for (uint32_t n = 0; n < 48001u; n++) {
+        int16_t expected = ((n % 480u) == 0u) ? peak : 0;
+
+        wrong += ((test_out[2u * n] != expected) || (test_out[2u * n + 1u] != expected)) ? 1u : 0u;
+    }
+    TEST_CHECK(wrong == 0u, "click train: %u frames wrong", wrong);
+
+    config = (siggen_config_t){ SIGGEN_TONE, 1000u, 0u, 0u, SIGGEN_CONTINUOUS, 0u };
+    (void)siggen_init(&gen, &config, 16000u);
+    TEST_CHECK(siggen_render(&gen, block, 100u) == 100u, "continuous tone refused a block");
+    siggen_stop(&gen);
+    TEST_CHECK(siggen_render(&gen, block, 100u) == 0u, "tone went on after siggen_stop()");
+}
+
+/*******************************************************************************
+* Function Name: test_noise
+********************************************************************************
+* Summary:
+*  White noise is uniform up to the peak; pink noise stays under it
+*
+*******************************************************************************/
+static void test_noise(void)
+{
+    siggen_config_t config = { SIGGEN_WHITE, 0u, 0u, 0u, 160000u, 6u };
+    siggen_t gen;
+    double sum = 0.0;
+    double square = 0.0;
+    double amplitude = round(32767.0 * pow(10.0, -6.0 / 20.0));
+    int32_t largest = 0;
+    double rms_db;
+
+    (void)siggen_init(&gen, &config, 16000u);
+    (void)test_render(&gen, 160000u);
+    for (uint32_t n = 0; n < 160000u; n++) {
+        sum += test_out[2u * n];
+        square += (double)test_out[2u * n] * test_out[2u * n];
+        largest = (abs(test_out[2u * n]) > largest) ? abs(test_out[2u * n]) : largest;
+    }
+    /* Uniform noise: RMS is the peak / sqrt(3) */
+    rms_db = 10.0 * log10(square / 160000.0 / (amplitude * amplitude / 3.0));
+    TEST_CHECK(fabs(rms_db) <= 0.05, "white noise RMS %.3f dB off peak/sqrt(3)", rms_db);
+    TEST_CHECK(fabs(sum / 160000.0) <= amplitude * 0.01, "white noise mean %.1f", sum / 160000.0);
+    TEST_CHECK(largest <= (int32_t)amplitude, "white noise peak %d above %.0f", (int)largest, amplitude);
+
+    config.type = SIGGEN_PINK;
+    config.atten_db = 0u;
+    (void)siggen_init(&gen, &config, 16000u);
+    (void)test_render(&gen, 160000u);
+    largest = 0;
+    for (uint32_t n = 0; n < 160000u; n++) {
+        largest = (abs(test_out[2u * n]) > largest) ? abs(test_out[2u * n]) : largest;
+    }
+    TEST_CHECK(largest <= 32767, "pink noise peak %d clips", (int)largest);
+}
+
+/*******************************************************************************
+* Function Name: test_limits
+*******************************************************************************/
+static void test_limits(void)
+{
+    siggen_t gen;
+    siggen_config_t config = { SIGGEN_TONE, 8000u, 0u, 0u, 100u, 0u };
+
+    TEST_CHECK(siggen_init(&gen, &config, 16000u) != 0, "tone at Nyquist accepted");
+    config.freq_hz = 1000u;
+    config.atten_db = SIGGEN_MAX_ATTEN_DB + 1u;
+    TEST_CHECK(siggen_init(&gen, &config, 16000u) != 0, "attenuation beyond maximum accepted");
+    config.atten_db = 0u;
+    config.frames = 0u;
+    TEST_CHECK(siggen_init(&gen, &config, 16000u) != 0, "zero length accepted");
+    config = (siggen_config_t){ SIGGEN_SWEEP, 100u, 1000u, 0u, SIGGEN_CONTINUOUS, 0u };
+    TEST_CHECK(siggen_init(&gen, &config, 16000u) != 0, "continuous sweep accepted");
+    config = (siggen_config_t){ SIGGEN_CLICK, 0u, 0u, 0u, 100u, 0u };
+    TEST_CHECK(siggen_init(&gen, &config, 16000u) != 0, "click period 0 accepted");
+}
+
+/*******************************************************************************
+* Function Name: main
+*******************************************************************************/
+int main(void)
+{
+    static const struct {
+        uint32_t freq_hz;
+        uint32_t rate;
+        uint32_t atten_db;
+    } tones[] = {
+        { 1000u, 16000u, 0u }, { 997u, 16000u, 0u }, { 440u, 16000u, 6u }, { 7001u, 16000u, 0u },
+        { 53u, 16000u, 20u }, { 1000u, 48000u, 0u }, { 19997u, 48000u, 3u }, { 1000u, 16000u, 60u },
+    };
+
+    for (uint32_t i = 0; i < sizeof(tones) / sizeof(tones[0]); i++) {
+        test_tone_quality(tones[i].freq_hz, tones[i].rate, tones[i].atten_db);
+    }
+    test_tone_frequency(997u, 16000u);
+    test_tone_frequency(1u, 16000u);
+    test_tone_frequency(7919u, 16000u);
+    test_tone_frequency(12345u, 48000u);
+    test_sweep(20u, 4000u, 5u * 16000u, 16000u);
+    test_sweep(5000u, 100u, 2u * 16000u, 16000u);
+    test_sweep(20u, 20000u, 10u * 48000u, 48000u);
+    test_length_and_clicks();
+    test_noise();
+    test_limits();
+    return test_finish("siggen");
+}
@@ -0,0 +1,375 @@
+/******************************************************************************
+* File Name: test_tdm_slots.c
+*
+* Description: Host unit test - TDM slot maps against the transmitter model
+*              Every map of 2, 4 and 8 slots (65808 of them) is taken
+*              through tdm_slots_begin() like a playback does, and a full
+*              and a partial FIFO refill are written with
+*              tdm_slots_write_fifo() to the transmitter of sim_tdm.c. The
+*              frames it sends go to a WAV file, one channel per slot,
+*              which is then read back: every slot must carry the left or
+*              right sample, the mix or silence its letter asks for, and a
+*              partial refill must end in silent frames. It also checks the
+*              kernel picked for each map, the codec format switch on a new
+*              slot count, and that a refused slot count or a bad map keeps
+*              the last layout.
+*
+*              app_i2s.c, settings.c and codec_ctrl.c are replaced by
+*              stand-ins below; the one of app_i2s_set_slots() configures
+*              the transmitter model as the real one does.
+*
+*******************************************************************************/
+
+#include "test.h"
+#include "sim.h"
+#include "tdm_slots.h"
+#include "app_i2s.h"
+#include "codec_ctrl.h"
+#include "settings.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define TEST_SOURCE_FRAMES          (64u)
+#define TEST_PARTIAL_FRAMES         (3u)
+#define TEST_LETTERS                "-LRM"      /* In tdm_source_t order */
+#define TEST_WAV_HEADER_SIZE        (44u)
+
+/*******************************************************************************
+* Global Variables
+*******************************************************************************/
+/* Stand-ins for settings.c */
+settings_t app_settings;
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static int16_t test_source[TEST_SOURCE_FRAMES * 2u];
+
+/* Stand-in state of app_i2s.c and codec_ctrl.c */
+static cy_stc_tdm_config_tx_t test_tx_config;
+static const cy_stc_tdm_config_t test_tdm_config = { .tx_config = &test_tx_config };
+static uint32_t test_slots = 2u;
+static bool test_refuse_slots = false;
+static uint32_t test_codec_updates = 0;
+static uint8_t test_codec_format = 0;
+
+/*******************************************************************************
+* Function Name: settings_copy_text
+*******************************************************************************/
+void settings_copy_text(const char *field, char *dst, uint32_t size)
+{
+    strncpy(dst, field, size - 1u);
+    dst[size - 1u] = '\0';
+}
+
+/*******************************************************************************
+* Function Name: app_i2s_set_slots / app_i2s_get_slots
+********************************************************************************
+* Summary:
+*  The transmitter reconfiguration of app_i2s.c: the bit clock divider
+*  shrinks as the frame grows, which the model checks
+*
+*******************************************************************************/
+bool app_i2s_set_slots(uint32_t slots)
+{
+    const cy_stc_tdm_config_tx_t *bsp = CYBSP_TDM_CONTROLLER_0_config.tx_config;
+    uint32_t frame_div = bsp->clkDiv * bsp->channelNum;
+
+    if (slots == test_slots) {
+        return true;
+    }
+    if (test_refuse_slots || ((HW_FIFO_HALF_SIZE % slots) != 0u) || ((frame_div % slots) != 0u)) {
+        return false;
+    }
+    test_tx_config.channelNum = slots;
+    test_tx_config.chEn = (1u << slots) - 1u;
+    test_tx_config.clkDiv = frame_div / slots;
+    test_tx_config.i2sMode = (slots == 2u);
+    Cy_AudioTDM_DeInit(TDM_STRUCT0);
+    if (Cy_AudioTDM_Init(TDM_STRUCT0, &test_tdm_config) != CY_TDM_SUCCESS) {
+        return false;
+    }
+    test_slots = slots;
+    return true;
+}
+
+uint32_t app_i2s_get_slots(void)
+{
+    return test_slots;
+}
+
+/*******************************************************************************
+* Function Name: codec_ctrl_update / codec_ctrl_sync
+********************************************************************************
+* Summary:
+*  Record the codec interface format tdm_slots_begin() asks for
+*
+*******************************************************************************/
+int codec_ctrl_update(codec_reg_t reg, uint8_t mask, uint8_t value)
+{
+    if (reg == CODEC_P0_CODEC_INTERFACE) {
+        test_codec_updates++;
+        test_codec_format = (uint8_t)((test_codec_format & (uint8_t)~mask) | (value & mask));
+    }
+    return 0;
+}
+
+int codec_ctrl_sync(uint32_t timeout_ms)
+{
+    (void)timeout_ms;
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: test_map
+********************************************************************************
+* Summary:
+*  Map number index of a slot count: one letter of TEST_LETTERS per base-4
+*  digit
+*
+*******************************************************************************/
+static void test_map(uint32_t index, uint32_t slots, char *map)
+{
+    for (uint32_t s = 0; s < slots; s++) {
+        map[s] = TEST_LETTERS[index % 4u];
+        index /= 4u;
+    }
+    map[slots] = '\0';
+}
+
+/*******************************************************************************
+* Function Name: test_slot_value
+********************************************************************************
+* Summary:
+*  What a slot should carry for one L/R frame
+*
+*******************************************************************************/
+static int16_t test_slot_value(char letter, int16_t left, int16_t right)
+{
+    switch (letter) {
+        case 'L': return left;
+        case 'R': return right;
+        case 'M': return (int16_t)floor(((double)left + (double)right) / 2.0);  /* Rounded down */
+        default:  return 0;
+    }
+}
+
+/*******************************************************************************
+* Function Name: test_expected_kernel
+*******************************************************************************/
+static tdm_kernel_t test_expected_kernel(const char *map, uint32_t slots)
+{
+    bool pairs = (strncmp(map, "LRLRLRLR", slots) == 0);
+
+    switch (slots) {
+        case 2u: return pairs ? TDM_KERNEL_STEREO : TDM_KERNEL_MAP2;
+        case 4u: return pairs ? TDM_KERNEL_PAIRS4 : TDM_KERNEL_MAP4;
+        default: return pairs ? TDM_KERNEL_PAIRS8 : TDM_KERNEL_MAP8;
+    }
+}
+
+/*******************************************************************************
+* Function Name: test_begin
+********************************************************************************
+* Summary:
+*  Start a playback with a map, as playback_start() does
+*
+*******************************************************************************/
+static int test_begin(const char *map)
+{
+    int result;
+
+    strcpy(app_settings.tdm_map, map);
+    result = tdm_slots_begin();
+    Cy_AudioTDM_EnableTx(TDM_STRUCT0_TX);
+    Cy_AudioTDM_ActivateTx(TDM_STRUCT0_TX);
+    return result;
+}
+
+/*******************************************************************************
+* Function Name: test_slot_count
+********************************************************************************
+* Summary:
+*  Send every map of one slot count through the transmitter model and check
+*  the frames it sent
+*
+*******************************************************************************/
+static void test_slot_count(uint32_t slots)
+{
+    uint32_t maps = 1u << (2u * slots);
+    uint32_t refill = HW_FIFO_HALF_SIZE / slots;
+    uint32_t updates = test_codec_updates;
+    uint32_t wrong_setup = 0;
+    uint32_t wrong_frames = 0;
+    char first_wrong[96] = "";
+    char map[TDM_MAX_SLOTS + 1u];
+    char path[64];
+    uint8_t header[TEST_WAV_HEADER_SIZE];
+    uint16_t channels;
+    uint32_t data_size;
+    FILE *file;
+
+    snprintf(path, sizeof(path), "/tmp/test_tdm_slots_%ld.wav", (long)getpid());
+    sim_config.i2s_out = path;
+    TEST_CHECK(sim_tdm_open() == 0, "cannot create %s", path);
+
+    for (uint32_t index = 0; index < maps; index++) {
+        uint32_t offset = index % (TEST_SOURCE_FRAMES - refill + 1u);
+        const int16_t *src = &test_source[2u * offset];
+        char active[TDM_MAX_SLOTS + 1u];
+        tdm_layout_t layout;
+        uint32_t full;
+        uint32_t partial;
+
+        test_map(index, slots, map);
+        if (test_begin(map) != 0) {
+            wrong_setup++;
+            continue;
+        }
+        tdm_slots_get_layout(&layout, active, sizeof(active));
+        /* Offer more than a refill, then an odd count: whole frames only */
+        full = tdm_slots_write_fifo(src, 2u * (TEST_SOURCE_FRAMES - offset));
+        sim_tdm_step(refill);
+        partial = tdm_slots_write_fifo(src, 2u * TEST_PARTIAL_FRAMES + 1u);
+        sim_tdm_step(refill);
+
+        if ((strcmp(active, map) != 0) || (layout.slots != slots) ||
+            (layout.refill_frames != refill) || (tdm_slots_refill_frames() != refill) ||
+            (layout.kernel != test_expected_kernel(map, slots)) ||
+            (full != 2u * refill) || (partial != 2u * TEST_PARTIAL_FRAMES)) {
+            if (wrong_setup++ == 0u) {
+                TEST_CHECK(false, "map %s: layout %s, %u slots, %u frames per refill, kernel "
+                           "%s; took %u and %u samples", map, active, layout.slots,
+                           layout.refill_frames, tdm_kernel_name(layout.kernel), full, partial);
+            }
+        }
+    }
+    sim_tdm_close();
+    TEST_CHECK(wrong_setup == 0u, "%u of %u %u-slot maps set up wrong", wrong_setup, maps, slots);
+    TEST_CHECK(test_codec_updates - updates == ((slots == 2u) ? 0u : 1u),
+               "%u codec format writes for the %u-slot maps", test_codec_updates - updates, slots);
+    TEST_CHECK(test_codec_format == ((slots == 2u) ? 0x00u : 0x40u),
+               "codec format 0x%02X with %u slots", test_codec_format, slots);
+
+    /* What the transmitter sent */
+    file = fopen(path, "rb");
+    if (!TEST_CHECK(file != NULL, "%s was not written", path)) {
+        return;
+    }
+    if (fread(header, 1, sizeof(header), file) != sizeof(header)) {
+        memset(header, 0, sizeof(header));
+    }
+    memcpy(&channels, &header[22], sizeof(channels));
+    memcpy(&data_size, &header[40], sizeof(data_size));
+    TEST_CHECK((channels == slots) && (data_size == maps * 2u * refill * slots * 2u),
+               "%u-slot maps: %u channels and %u bytes sent", slots, channels, data_size);
+
+    for (uint32_t index = 0; (index < maps) && (channels == slots); index++) {
+        uint32_t offset = index % (TEST_SOURCE_FRAMES - refill + 1u);
+
+        test_map(index, slots, map);
+        for (uint32_t n = 0; n < 2u * refill; n++) {
+            /* The full refill, then the partial one from the same frame */
+            uint32_t frame = (n < refill) ? n : (n - refill);
+            bool silent = (n >= refill) && (frame >= TEST_PARTIAL_FRAMES);
+            int16_t left = silent ? 0 : test_source[2u * (offset + frame)];
+            int16_t right = silent ? 0 : test_source[2u * (offset + frame) + 1u];
+            int16_t sent[TDM_MAX_SLOTS];
+
+            if (fread(sent, sizeof(int16_t), slots, file) != slots) {
+                memset(sent, 0x55, sizeof(sent));
+            }
+            for (uint32_t s = 0; s < slots; s++) {
+                int16_t expected = test_slot_value(map[s], left, right);
+
+                if ((sent[s] != expected) && (wrong_frames++ == 0u)) {
+                    snprintf(first_wrong, sizeof(first_wrong),
+                             "map %s frame %u slot %u sent %d, expected %d", map, n, s,
+                             sent[s], expected);
+                }
+            }
+        }
+    }
+    fclose(file);
+    remove(path);
+    TEST_CHECK(wrong_frames == 0u, "%u wrong slots in the %u-slot maps, first: %s",
+               wrong_frames, slots, first_wrong);
+}
+
+/*******************************************************************************
+* Function Name: test_bad_maps
+********************************************************************************
+* Summary:
+*  Maps of another length or with other letters are refused; a refused map
+*  or slot count leaves the layout in use
+*
+*******************************************************************************/
+static void test_bad_maps(void)
+{
+    static const char *const bad[] = {
+        "", "L", "LRM", "LRLRL", "LRLRLR", "LRLRLRL", "LRLRLRLRL", "lr", "LX", "L R-", "LRLRLRL0"
+    };
+    tdm_layout_t layout;
+    char active[TDM_MAX_SLOTS + 1u];
+    uint32_t updates;
+
+    for (uint32_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        TEST_CHECK(tdm_slots_check_map(bad[i], (uint32_t)strlen(bad[i])) == -1,
+                   "map '%s' accepted", bad[i]);
+        TEST_CHECK(tdm_slots_compile(bad[i], &layout) == -1, "map '%s' compiled", bad[i]);
+    }
+    TEST_CHECK(tdm_slots_check_map("LRLRLRLR", 4u) == 0, "the first 4 letters refused");
+
+    TEST_CHECK(test_begin("LM") == 0, "LM refused");
+    updates = test_codec_updates;
+    TEST_CHECK(test_begin("LRX-") == -1, "LRX- taken by tdm_slots_begin");
+    test_refuse_slots = true;
+    TEST_CHECK(test_begin("MMMM") == -1, "a refused slot count taken by tdm_slots_begin");
+    test_refuse_slots = false;
+    tdm_slots_get_layout(&layout, active, sizeof(active));
+    TEST_CHECK((strcmp(active, "LM") == 0) && (tdm_slots_count() == 2u) &&
+               (layout.kernel == TDM_KERNEL_MAP2) && (test_codec_updates == updates),
+               "after refused maps: layout %s, %u slots, kernel %s, %u codec writes", active,
+               tdm_slots_count(), tdm_kernel_name(layout.kernel), test_codec_updates - updates);
+    TEST_CHECK(strcmp(tdm_kernel_name(TDM_KERNEL_COUNT), "?") == 0, "name of no kernel");
+}
+
+/*******************************************************************************
+* Function Name: main
+*******************************************************************************/
+int main(void)
+{
+    /* Distinct frames, the full-scale corners first */
+    static const int16_t corners[][2] = {
+        { 32767, 32767 }, { -32768, -32768 }, { 32767, -32768 }, { -32768, 32767 }, { -1, 0 },
+        { -3, 0 }
+    };
+    uint32_t seed = 1u;
+
+    for (uint32_t i = 0; i < TEST_SOURCE_FRAMES; i++) {
+        for (uint32_t ch = 0; ch < 2u; ch++) {
+            seed = seed * 1664525u + 1013904223u;
+            test_source[2u * i + ch] = (i < sizeof(corners) / sizeof(corners[0])) ?
+                                       corners[i][ch] : (int16_t)(seed >> 16);
+        }
+    }
+    test_tx_config = *CYBSP_TDM_CONTROLLER_0_config.tx_config;
+    test_slots = test_tx_config.channelNum;
+    Cy_AudioTDM_Init(TDM_STRUCT0, &test_tdm_config);
+
+    test_slot_count(2u);
+    test_slot_count(4u);
+    test_slot_count(8u);
+    TEST_CHECK(test_begin("LR") == 0, "back to LR refused");
+    TEST_CHECK(test_codec_format == 0x00u, "codec format 0x%02X back at 2 slots",
+               test_codec_format);
+    test_bad_maps();
+
+    return test_finish("test_tdm_slots");
+}
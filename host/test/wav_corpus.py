@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""
+Write the seed corpus for fuzz_wav: WAV files that the RIFF chunk walker in
+proj_cm33_ns/source/wav_file.c must handle, good and bad.
+
+    ok_*        files wav_parse() accepts: the plain 44-byte header, a take
+                as the recorder writes it, WAVE_FORMAT_EXTENSIBLE, data
+                before fmt, odd-sized chunks with their pad byte
+    trunc_*     files cut off inside a chunk header, inside fmt, inside
+                the data (a recording whose header was never finalized)
+    big_*       oversized RIFF and chunk sizes, up to 0xFFFFFFFF
+    odd_*       odd-sized chunks whose pad byte is missing or at the end
+    many_*      more chunks than WAV_MAX_CHUNKS before the data
+
+Usage:
+    wav_corpus.py OUTPUT_DIR
+"""
+
+import os
+import struct
+import sys
+
+RATE = 16000
+CHANNELS = 2
+PCM_SUBFORMAT = bytes([0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00,
+                       0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71])
+
+
+def chunk(cid, body, size=None, pad=True):
+    """One chunk; size overrides the stored size, pad adds the pad byte."""
+    header = cid.encode() + struct.pack("<I", len(body) if size is None else size)
+    return header + body + (b"\0" if pad and len(body) % 2 else b"")
+
+
+def riff(chunks, size=None):
+    body = b"WAVE" + b"".join(chunks)
+    return b"RIFF" + struct.pack("<I", len(body) if size is None else size) + body
+
+
+def fmt(channels=CHANNELS, bits=16, rate=RATE):
+    align = channels * ((bits + 7) // 8)
+    return chunk("fmt ", struct.pack("<HHIIHH", 1, channels, rate, rate * align, align, bits))
+
+
+def fmt_extensible(valid_bits=16, subformat=PCM_SUBFORMAT):
+    align = CHANNELS * 2
+    body = struct.pack("<HHIIHHHHI", 0xFFFE, CHANNELS, RATE, RATE * align, align, 16,
+                       22, valid_bits, 3) + subformat
+    return chunk("fmt ", body)
+
+
+def samples(frames):
+    return b"".join(struct.pack("<hh", n * 64, -n * 64) for n in range(frames))
+
+
+def data(frames, extra=0, size=None):
+    return chunk("data", samples(frames) + b"\x11" * extra, size=size)
+
+
+def corpus():
+    pcm = data(64)
+    take = chunk("take", b"\x01\x00" + b"\x00" * 80)
+    bext = chunk("bext", b"\x00" * 602)
+    # The recorder pads with JUNK so that the samples start at 512
+    junk = chunk("JUNK", b"\x00" * (512 - (12 + len(fmt()) + len(bext) + 16) % 512))
+    full = riff([fmt(), bext, junk, pcm, take])
+
+    files = {
+        "ok_plain": riff([fmt(), pcm]),
+        "ok_take": full,
+        "ok_extensible": riff([fmt_extensible(), pcm]),
+        "ok_data_first": riff([data(16), fmt()]),
+        "ok_odd_list": riff([fmt(), chunk("LIST", b"INFOISFT\x03\x00\x00\x00ab\0"), pcm]),
+        "ok_odd_data": riff([fmt(), data(16, extra=3), chunk("LIST", b"INFO")]),
+        "ok_mono_8bit": riff([fmt(channels=1, bits=8), chunk("data", bytes(range(101)))]),
+        "ok_empty_data": riff([fmt(), chunk("data", b"")]),
+
+        "trunc_riff_header": full[:10],
+        "trunc_chunk_header": riff([fmt()]) + b"da",
+        "trunc_fmt": riff([fmt()])[:30],
+        "trunc_data": full[: len(full) - 300],
+        "trunc_data_size": riff([fmt(), data(64, size=0x7FFFFFF0)]),
+        "trunc_riff_size_zero": riff([fmt(), pcm], size=0),
+        "trunc_in_pad": riff([fmt(), chunk("LIST", b"abc")])[:-1],
+
+        "big_riff_size": riff([fmt(), pcm], size=0xFFFFFFFF),
+        "big_riff_size_signed": riff([fmt(), pcm], size=0x7FFFFFFF),
+        "big_list": riff([fmt(), chunk("LIST", b"INFO", size=0xFFFFFFF0), pcm]),
+        "big_fmt": riff([chunk("fmt ", fmt()[8:], size=0xFFFFFFFF), pcm]),
+        "big_data_size": riff([fmt(), data(8, size=0xFFFFFFFF)], size=0xFFFFFFFF),
+        "big_wrap": riff([fmt(), chunk("JUNK", b"", size=0xFFFFFFF8), pcm]),
+
+        "odd_no_pad": riff([fmt(), chunk("LIST", b"abc", pad=False), pcm]),
+        "odd_pad_at_end": riff([fmt(), pcm, chunk("note", b"x")]),
+        "odd_fmt_size": riff([chunk("fmt ", fmt()[8:] + b"\x00", size=17), pcm]),
+        "odd_riff_size": riff([fmt(), chunk("data", samples(4) + b"\x01")], size=None)[:-1],
+
+        "many_chunks": riff([fmt()] + [chunk("JUNK", b"\x00" * 2)] * 40 + [pcm]),
+        "many_fmt": riff([fmt(channels=1)] + [fmt()] * 3 + [pcm]),
+    }
+    return files
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit(__doc__.strip())
+    os.makedirs(sys.argv[1], exist_ok=True)
+    for name, content in corpus().items():
+        with open(os.path.join(sys.argv[1], name + ".wav"), "wb") as f:
+            f.write(content)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+"""
+End-to-end test of tools/xfer.py against the simulator over a pseudo-
+terminal.
+
+audio_sim runs with stdin and stdout on the master side of a pty, as socat
+would connect it, and xfer.py opens the slave side as its serial port. The
+transfers therefore go through the real CLI, FileXferTask and the
+simulated UART, at the baud rate xfer.py asks for.
+
+The test uploads a file, downloads it again and compares the two, then
+replaces it with a second file and finally tries to replace it with a file
+the device must reject. The second file has to survive that, and no
+upload.* file may be left on the card.
+
+Usage:
+    xfer_loopback.py build/audio_sim [--keep]
+
+`make xfer-test` runs it; xfer.py needs pyserial.
+"""
+
+import argparse
+import os
+import pty
+import random
+import select
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+import tty
+
+from scenarios import Failure, check, read_bytes, write_tone
+
+XFER = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "tools", "xfer.py")
+BOOT_TIMEOUT_S = 30.0
+XFER_TIMEOUT_S = 120.0
+
+
+class Device:
+    """audio_sim behind a pty; port is the slave to hand to xfer.py."""
+
+    def __init__(self, binary, workdir):
+        self.sd = os.path.join(workdir, "sd")
+        os.makedirs(self.sd, exist_ok=True)
+        master, self.slave = pty.openpty()
+        tty.setraw(self.slave)
+        self.port = os.ttyname(self.slave)
+        self.console = bytearray()
+        self.log = open(os.path.join(workdir, "console.txt"), "wb")
+        self.proc = subprocess.Popen([binary, "--sd", self.sd, "--speed", "4"],
+                                     stdin=master, stdout=master, stderr=self.log, cwd=workdir)
+        os.close(master)
+
+    def read_until(self, text, timeout):
+        """Collect console output until text appears in it."""
+        deadline = time.monotonic() + timeout
+        while text.encode() not in self.console:
+            remaining = deadline - time.monotonic()
+            check(remaining > 0, "no '%s' on the console", text)
+            check(self.proc.poll() is None, "audio_sim exited with %s", self.proc.returncode)
+            if select.select([self.slave], [], [], min(remaining, 0.1))[0]:
+                data = os.read(self.slave, 4096)
+                self.console += data
+                self.log.write(data)
+
+    def xfer(self, *args):
+        """Run xfer.py on the port; return (exit status, output)."""
+        result = subprocess.run([sys.executable, XFER, args[0], self.port] + list(args[1:]),
+                                stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                                timeout=XFER_TIMEOUT_S)
+        output = result.stdout.decode(errors="replace")
+        self.log.write(("$ xfer.py %s\n%s" % (" ".join(args), output)).encode())
+        return result.returncode, output
+
+    def close(self):
+        os.write(self.slave, b"\r!quit\r")
+        try:
+            self.proc.wait(timeout=10)
+        except subprocess.TimeoutExpired:
+            self.proc.kill()
+            self.proc.wait()
+        os.close(self.slave)
+        self.log.close()
+
+
+def put(device, path, name):
+    status, output = device.xfer("put", path, "--name", name)
+    check(status == 0, "put %s failed: %s", os.path.basename(path), output.strip())
+    check("verified" in output, "put %s: CRC not verified", os.path.basename(path))
+
+
+def get_and_compare(device, name, path, expected):
+    status, output = device.xfer("get", name, "-o", path)
+    check(status == 0, "get %s failed: %s", name, output.strip())
+    check(read_bytes(path) == read_bytes(expected), "%s differs from %s after the round trip",
+          name, os.path.basename(expected))
+
+
+def loopback(device, workdir):
+    first = os.path.join(workdir, "first.wav")
+    second = os.path.join(workdir, "second.wav")
+    junk = os.path.join(workdir, "junk.wav")
+    back = os.path.join(workdir, "back.wav")
+    write_tone(first, 1.0, hz=440)
+    write_tone(second, 0.5, hz=880, dbfs=-6.0)
+    with open(junk, "wb") as f:
+        f.write(bytes(random.Random(1).getrandbits(8) for _ in range(20000)))
+
+    device.read_until("File Transfer Task Started", BOOT_TIMEOUT_S)
+
+    put(device, first, "up.wav")
+    get_and_compare(device, "up.wav", back, first)
+
+    put(device, second, "up.wav")
+    get_and_compare(device, "up.wav", back, second)
+
+    status, output = device.xfer("put", junk, "--name", "up.wav")
+    check(status != 0, "a file that is not a WAV file was accepted")
+    check("not a playable WAV file" in output, "unexpected rejection: %s", output.strip())
+    get_and_compare(device, "up.wav", back, second)
+
+    leftovers = sorted(n for n in os.listdir(device.sd) if n.startswith("upload."))
+    check(not leftovers, "left on the card: %s", " ".join(leftovers))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("binary", help="path to audio_sim")
+    parser.add_argument("--keep", action="store_true", help="keep the scratch directory")
+    args = parser.parse_args()
+
+    workdir = tempfile.mkdtemp(prefix="sim_xfer_")
+    device = Device(os.path.abspath(args.binary), workdir)
+    try:
+        loopback(device, workdir)
+    except (Failure, subprocess.TimeoutExpired) as error:
+        print("FAIL xfer_loopback: %s (%s)" % (error, workdir))
+        return 1
+    finally:
+        device.close()
+
+    print("PASS xfer_loopback")
+    if not args.keep:
+        shutil.rmtree(workdir)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -47,6 +47,12 @@
 #include "queue.h"
 #include "source/cli_task.h"
 
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+/* Bytes moved from the TX stream to the FIFO per refill */
+#define UART_TX_CHUNK_SIZE      (64U)
+
 /*******************************************************************************
 * Global Variables
 *******************************************************************************/
@@ -54,6 +60,14 @@
 static cy_stc_scb_uart_context_t    DEBUG_UART_context;  
 static mtb_hal_uart_t               DEBUG_UART_hal_obj;  
 
+/* Binary stream mode (file transfer) - NULL while the CLI owns the UART */
+static StreamBufferHandle_t volatile uart_rx_stream = NULL;
+static StreamBufferHandle_t volatile uart_tx_stream = NULL;
+
+/* Undivided UART source clock and current baud rate */
+static uint32_t uart_clk_hz = 0u;
+static uint32_t uart_baud_rate = 115200u;
+
 /* Retarget-io deepsleep callback parameters  */
 #if (CY_CFG_PWR_SYS_IDLE_MODE == CY_CFG_PWR_MODE_DEEPSLEEP)
 
@@ -147,7 +161,11 @@ void init_retarget_io(void)
 * Function Name: uart_rx_isr
 ********************************************************************************
 * Summary:
-*  UART RX interrupt handler - puts received characters into CLI RX queue
+*  Debug UART interrupt handler.
+*  - RX: drains the FIFO into the CLI RX queue, or into the attached RX stream
+*    while a binary file transfer owns the link
+*  - TX: in stream mode, refills the FIFO from the attached TX stream so the
+*    sending task can read the SD card while the line is busy
 *
 * Parameters:
 *  None
@@ -161,14 +179,19 @@ static void uart_rx_isr(void)
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
     uint32_t rx_data;
     
-    /* Check if RX FIFO has data */
-    if (Cy_SCB_UART_GetNumInRxFifo(CYBSP_DEBUG_UART_HW) > 0) {
+    /* Drain every byte in the RX FIFO (one interrupt per byte is too slow at
+     * transfer baud rates) */
+    while (Cy_SCB_UART_GetNumInRxFifo(CYBSP_DEBUG_UART_HW) > 0) {
         /* Read character from UART */
         rx_data = Cy_SCB_UART_Get(CYBSP_DEBUG_UART_HW);
+        char ch = (char)rx_data;
         
-        /* Put character into CLI RX queue (from ISR) */
-        if (cli_rx_queue != NULL) {
-            char ch = (char)rx_data;
+        if (uart_rx_stream != NULL) {
+            /* Binary transfer in progress - bypass the CLI */
+            xStreamBufferSendFromISR(uart_rx_stream, &ch, 1, &xHigherPriorityTaskWoken);
+        }
+        else if (cli_rx_queue != NULL) {
+            /* Put character into CLI RX queue (from ISR) */
             xQueueSendFromISR(cli_rx_queue, &ch, &xHigherPriorityTaskWoken);
         }
     }
@@ -176,6 +199,31 @@ static void uart_rx_isr(void)
     /* Clear RX interrupt */
     Cy_SCB_ClearRxInterrupt(CYBSP_DEBUG_UART_HW, CY_SCB_RX_INTR_NOT_EMPTY);
     
+    /* Refill TX FIFO from the transfer stream */
+    if (0u != (Cy_SCB_GetTxInterruptStatusMasked(CYBSP_DEBUG_UART_HW) & 
+               CY_SCB_TX_INTR_LEVEL)) {
+        uint8_t tx_chunk[UART_TX_CHUNK_SIZE];
+        uint32_t space = Cy_SCB_GetFifoSize(CYBSP_DEBUG_UART_HW) - 
+                         Cy_SCB_UART_GetNumInTxFifo(CYBSP_DEBUG_UART_HW);
+        size_t count = 0;
+        
+        if (space > sizeof(tx_chunk)) {
+            space = sizeof(tx_chunk);
+        }
+        if (uart_tx_stream != NULL) {
+            count = xStreamBufferReceiveFromISR(uart_tx_stream, tx_chunk, space,
+                                                &xHigherPriorityTaskWoken);
+        }
+        if (count > 0u) {
+            (void)Cy_SCB_UART_PutArray(CYBSP_DEBUG_UART_HW, tx_chunk, (uint32_t)count);
+        }
+        else {
+            /* Nothing queued - stop the level interrupt until the next kick */
+            Cy_SCB_SetTxInterruptMask(CYBSP_DEBUG_UART_HW, 0u);
+        }
+        Cy_SCB_ClearTxInterrupt(CYBSP_DEBUG_UART_HW, CY_SCB_TX_INTR_LEVEL);
+    }
+    
     /* Yield to higher priority task if needed */
     portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
@@ -197,15 +245,204 @@ void uart_rx_interrupt_init(void)
 {
     cy_stc_sysint_t uart_rx_intr_cfg = {
         .intrSrc = (IRQn_Type)CYBSP_DEBUG_UART_IRQ,
-        .intrPriority = 7  /* Lower than FreeRTOS configMAX_SYSCALL_INTERRUPT_PRIORITY */
+        .intrPriority = UART_ISR_PRIORITY  /* Lower than FreeRTOS configMAX_SYSCALL_INTERRUPT_PRIORITY */
     };
     
     /* Initialize and enable UART RX interrupt */
     Cy_SysInt_Init(&uart_rx_intr_cfg, uart_rx_isr);
     NVIC_EnableIRQ(uart_rx_intr_cfg.intrSrc);
     
+    /* TX level interrupt is only unmasked while a TX stream is attached */
+    Cy_SCB_SetTxFifoLevel(CYBSP_DEBUG_UART_HW, UART_TX_FIFO_LEVEL);
+    
     /* Enable UART RX interrupt in SCB */
     Cy_SCB_SetRxInterruptMask(CYBSP_DEBUG_UART_HW, CY_SCB_RX_INTR_NOT_EMPTY);
 }
 
+/*******************************************************************************
+* Function Name: uart_stream_attach
+********************************************************************************
+* Summary:
+*  Hand the debug UART to a binary stream user (file transfer). Received bytes
+*  go to rx_stream instead of the CLI; bytes written to tx_stream are sent by
+*  the ISR after uart_tx_kick(). Either stream may be NULL.
+*
+* Parameters:
+*  rx_stream: Stream that receives incoming bytes
+*  tx_stream: Stream drained into the TX FIFO
+*
+* Return:
+*  None
+*
+*******************************************************************************/
+void uart_stream_attach(StreamBufferHandle_t rx_stream,
+                        StreamBufferHandle_t tx_stream)
+{
+    NVIC_DisableIRQ((IRQn_Type)CYBSP_DEBUG_UART_IRQ);
+    uart_rx_stream = rx_stream;
+    uart_tx_stream = tx_stream;
+    NVIC_EnableIRQ((IRQn_Type)CYBSP_DEBUG_UART_IRQ);
+}
+
+/*******************************************************************************
+* Function Name: uart_stream_detach
+********************************************************************************
+* Summary:
+*  Return the debug UART to the CLI
+*
+*******************************************************************************/
+void uart_stream_detach(void)
+{
+    NVIC_DisableIRQ((IRQn_Type)CYBSP_DEBUG_UART_IRQ);
+    Cy_SCB_SetTxInterruptMask(CYBSP_DEBUG_UART_HW, 0u);
+    uart_rx_stream = NULL;
+    uart_tx_stream = NULL;
+    NVIC_EnableIRQ((IRQn_Type)CYBSP_DEBUG_UART_IRQ);
+}
+
+/*******************************************************************************
+* Function Name: uart_tx_kick
+********************************************************************************
+* Summary:
+*  Unmask the TX level interrupt after data was added to the TX stream
+*
+*******************************************************************************/
+void uart_tx_kick(void)
+{
+    Cy_SCB_SetTxInterruptMask(CYBSP_DEBUG_UART_HW, CY_SCB_TX_INTR_LEVEL);
+}
+
+/*******************************************************************************
+* Function Name: uart_tx_idle
+********************************************************************************
+* Summary:
+*  Check that the TX stream is empty and the last bit has left the shifter
+*
+* Return:
+*  true when the line is idle
+*
+*******************************************************************************/
+bool uart_tx_idle(void)
+{
+    if ((uart_tx_stream != NULL) && !xStreamBufferIsEmpty(uart_tx_stream)) {
+        return false;
+    }
+    return Cy_SCB_UART_IsTxComplete(CYBSP_DEBUG_UART_HW);
+}
+
+/*******************************************************************************
+* Function Name: uart_compute_divider
+********************************************************************************
+* Summary:
+*  Find the clock divider for a baud rate and check the resulting error
+*
+* Parameters:
+*  baud_rate: Requested baud rate
+*  divider: Output - divide ratio (register value + 1)
+*  actual: Output - baud rate the divider really produces
+*
+* Return:
+*  0 on success, -1 if the error exceeds UART_MAX_BAUD_ERROR
+*
+*******************************************************************************/
+static int uart_compute_divider(uint32_t baud_rate, uint32_t *divider, 
+                                uint32_t *actual)
+{
+    uint32_t oversample = CYBSP_DEBUG_UART_config.oversample;
+    uint32_t error;
+    
+    if (baud_rate == 0u) {
+        return -1;
+    }
+    
+    /* Recover the undivided peripheral clock once, from the BSP settings */
+    if (uart_clk_hz == 0u) {
+        uint32_t bsp_divider = Cy_SysClk_PeriPclkGetDivider(CYBSP_DEBUG_UART_CLK_DIV_GRP_NUM,
+                                                            CYBSP_DEBUG_UART_CLK_DIV_HW,
+                                                            CYBSP_DEBUG_UART_CLK_DIV_NUM);
+        uart_clk_hz = Cy_SysClk_PeriPclkGetFrequency(CYBSP_DEBUG_UART_CLK_DIV_GRP_NUM,
+                                                     CYBSP_DEBUG_UART_CLK_DIV_HW,
+                                                     CYBSP_DEBUG_UART_CLK_DIV_NUM) *
+                      (bsp_divider + 1u);
+    }
+    
+    /* Round to the nearest divider */
+    *divider = (uart_clk_hz + (baud_rate * oversample) / 2u) / (baud_rate * oversample);
+    if (*divider == 0u) {
+        return -1;
+    }
+    *actual = uart_clk_hz / (*divider * oversample);
+    error = (*actual > baud_rate) ? (*actual - baud_rate) : (baud_rate - *actual);
+    
+    return (((error * 1000u) / baud_rate) > UART_MAX_BAUD_ERROR) ? -1 : 0;
+}
+
+/*******************************************************************************
+* Function Name: uart_baud_rate_valid
+********************************************************************************
+* Summary:
+*  Check whether the debug UART can run at a baud rate
+*
+*******************************************************************************/
+bool uart_baud_rate_valid(uint32_t baud_rate)
+{
+    uint32_t divider;
+    uint32_t actual;
+    
+    return (0 == uart_compute_divider(baud_rate, &divider, &actual));
+}
+
+/*******************************************************************************
+* Function Name: uart_set_baud_rate
+********************************************************************************
+* Summary:
+*  Re-program the debug UART clock divider for a new baud rate. The caller
+*  must make sure the TX line is idle (see uart_tx_idle()).
+*
+* Parameters:
+*  baud_rate: Requested baud rate
+*
+* Return:
+*  0 on success, -1 if the rate cannot be met within UART_MAX_BAUD_ERROR
+*
+*******************************************************************************/
+int uart_set_baud_rate(uint32_t baud_rate)
+{
+    uint32_t divider;
+    uint32_t actual;
+    
+    if (0 != uart_compute_divider(baud_rate, &divider, &actual)) {
+        return -1;
+    }
+    
+    taskENTER_CRITICAL();
+    Cy_SCB_UART_Disable(CYBSP_DEBUG_UART_HW, &DEBUG_UART_context);
+    Cy_SysClk_PeriPclkDisableDivider(CYBSP_DEBUG_UART_CLK_DIV_GRP_NUM,
+                                     CYBSP_DEBUG_UART_CLK_DIV_HW,
+                                     CYBSP_DEBUG_UART_CLK_DIV_NUM);
+    Cy_SysClk_PeriPclkSetDivider(CYBSP_DEBUG_UART_CLK_DIV_GRP_NUM,
+                                 CYBSP_DEBUG_UART_CLK_DIV_HW,
+                                 CYBSP_DEBUG_UART_CLK_DIV_NUM, divider - 1u);
+    Cy_SysClk_PeriPclkEnableDivider(CYBSP_DEBUG_UART_CLK_DIV_GRP_NUM,
+                                    CYBSP_DEBUG_UART_CLK_DIV_HW,
+                                    CYBSP_DEBUG_UART_CLK_DIV_NUM);
+    Cy_SCB_UART_Enable(CYBSP_DEBUG_UART_HW);
+    taskEXIT_CRITICAL();
+    
+    uart_baud_rate = actual;
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: uart_get_baud_rate
+********************************************************************************
+* Summary:
+*  Current debug UART baud rate (as actually generated by the divider)
+*
+*******************************************************************************/
+uint32_t uart_get_baud_rate(void)
+{
+    return uart_baud_rate;
+}
+
 /* [] END OF FILE */
\ No newline at end of file
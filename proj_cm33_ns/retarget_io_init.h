@@ -49,6 +49,8 @@
 #include "mtb_hal.h"
 #include "cy_retarget_io.h"
 #include "mtb_syspm_callbacks.h"
+#include "FreeRTOS.h"
+#include "stream_buffer.h"
 
 /*******************************************************************************
 * Macros
@@ -62,11 +64,27 @@
 #define SYSPM_SKIP_MODE         (0U)
 #define SYSPM_CALLBACK_ORDER    (1U)
 
+/* Debug UART interrupt priority (below configMAX_SYSCALL_INTERRUPT_PRIORITY) */
+#define UART_ISR_PRIORITY       (7U)
+/* TX FIFO level that raises the refill interrupt in stream mode */
+#define UART_TX_FIFO_LEVEL      (16U)
+/* Largest tolerated baud rate error in tenths of a percent */
+#define UART_MAX_BAUD_ERROR     (20U)
+
 
 /*******************************************************************************
 * Function prototypes
 *******************************************************************************/
-void init_retarget_io(void);void uart_rx_interrupt_init(void);
+void init_retarget_io(void);
+void uart_rx_interrupt_init(void);
+void uart_stream_attach(StreamBufferHandle_t rx_stream,
+                        StreamBufferHandle_t tx_stream);
+void uart_stream_detach(void);
+void uart_tx_kick(void);
+bool uart_tx_idle(void);
+bool uart_baud_rate_valid(uint32_t baud_rate);
+int uart_set_baud_rate(uint32_t baud_rate);
+uint32_t uart_get_baud_rate(void);
 /*******************************************************************************
 * Function Name: handle_app_error
 ********************************************************************************
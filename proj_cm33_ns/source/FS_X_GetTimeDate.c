@@ -7,6 +7,7 @@
 *******************************************************************************/
 
 #include "FS.h"
+#include "wall_clock.h"
 
 /*******************************************************************************
 * Function Name: FS_X_GetTimeDate
@@ -26,17 +27,17 @@
 U32 FS_X_GetTimeDate(void)
 {
     FS_FILETIME filetime;
+    wall_clock_time_t now;
     U32 timestamp;
     
-    /* Set fixed time: 2026-01-21 12:00:00
-     * In production, replace with RTC or system tick-based time
-     */
-    filetime.Year   = 2026;
-    filetime.Month  = 1;
-    filetime.Day    = 21;
-    filetime.Hour   = 12;
-    filetime.Minute = 0;
-    filetime.Second = 0;
+    /* Calendar time from the wall clock (fixed default until 'time' sets it) */
+    wall_clock_get(&now);
+    filetime.Year   = now.year;
+    filetime.Month  = now.month;
+    filetime.Day    = now.day;
+    filetime.Hour   = now.hour;
+    filetime.Minute = now.minute;
+    filetime.Second = now.second;
     
     /* Convert to DOS timestamp format */
     FS_FileTimeToTimeStamp(&filetime, &timestamp);
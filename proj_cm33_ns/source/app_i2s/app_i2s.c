@@ -39,7 +39,10 @@
 * Header Files
 *******************************************************************************/
 #include "app_i2s.h"
-#include "playback_task.h"
+#include "audio_ramfunc.h"
+#include "isr_timing.h"
+#include "tdm_slots.h"
+#include <string.h>
 
 /*******************************************************************************
 * Global Variables
@@ -63,7 +66,14 @@ const cy_stc_sysint_t i2s_isr_txcfg =
 
 /* Audio playback tracking variables */
 uint32_t i2s_txcount = 0;
-volatile bool i2s_flag = false;
+
+/* Stream the TX ISR reads, NULL sends silence */
+static app_i2s_stream_t *volatile i2s_stream = NULL;
+
+/* The BSP configuration with the slot count of app_i2s_set_slots() */
+static cy_stc_tdm_config_tx_t i2s_tx_config;
+static cy_stc_tdm_config_t i2s_tdm_config;
+static uint32_t i2s_slots = 0;
 
 uint16_t zeros_data[HW_FIFO_HALF_SIZE/2] = {0};
 /*******************************************************************************
@@ -84,9 +94,15 @@ void app_i2s_init(void)
     Cy_SysInt_Init(&i2s_isr_txcfg, i2s_tx_interrupt_handler);
     NVIC_EnableIRQ(i2s_isr_txcfg.intrSrc);
 
+    /* Start from the BSP frame; app_i2s_set_slots() changes the slot count */
+    i2s_tx_config = *CYBSP_TDM_CONTROLLER_0_config.tx_config;
+    i2s_tdm_config = CYBSP_TDM_CONTROLLER_0_config;
+    i2s_tdm_config.tx_config = &i2s_tx_config;
+    i2s_slots = i2s_tx_config.channelNum;
+
    /* Initialize the I2S */
     cy_en_tdm_status_t volatile return_status = Cy_AudioTDM_Init(TDM_STRUCT0, 
-                                                &CYBSP_TDM_CONTROLLER_0_config);
+                                                &i2s_tdm_config);
     if (CY_TDM_SUCCESS != return_status)
     {
         CY_ASSERT(0);
@@ -165,7 +181,9 @@ void tlv_codec_i2c_init(void)
 /*******************************************************************************
  * Function Name: i2s_tx_interrupt_handler
  *******************************************************************************
-* Summary: I2S transmit interrupt handler function.
+* Summary: I2S transmit interrupt handler function. Runs from SRAM
+*  (audio_ramfunc.h); entry interval and time inside are counted for the
+*  'isr' command.
 *
 * Parameters:
 *  None
@@ -174,62 +192,102 @@ void tlv_codec_i2c_init(void)
 *  None
 *
 *******************************************************************************/
+AUDIO_RAMFUNC_BEGIN
 void i2s_tx_interrupt_handler(void)
 {
+    uint32_t entry = isr_timing_enter(&isr_timing[ISR_TIMING_I2S]);
     /*get intr status and look for errors*/
     uint32_t intr = Cy_AudioTDM_GetTxInterruptStatusMasked(TDM_STRUCT0_TX);
 
+    app_i2s_stream_t *stream = i2s_stream;
+    /* Half the FIFO in whole frames of the TDM layout */
+    uint32_t refill_frames = tdm_slots_refill_frames();
+
     if(CY_TDM_INTR_TX_FIFO_TRIGGER & intr)
     {
-        /* Check if playback is active */
-        if (playback_active && playback_buffer_ptr != NULL && playback_samples_remaining > 0)
+        /* Move on to the queued buffer once the current one is sent */
+        if ((stream != NULL) && (stream->current_samples < 2u) && (stream->pending != NULL))
         {
-            /* Write playback data to I2S FIFO */
-            for(int i=0; i < HW_FIFO_HALF_SIZE/2; i++)
+            stream->current = stream->pending;
+            stream->current_samples = stream->pending_samples;
+            stream->pending = NULL;
+        }
+
+        if ((stream != NULL) && (stream->render != NULL))
+        {
+            /* Generated source: render this refill straight into the FIFO */
+            int16_t block[HW_FIFO_HALF_SIZE];
+            uint32_t frames = stream->render(stream->render_context, block, refill_frames);
+
+            if ((stream->process != NULL) && (frames > 0u))
             {
-                if (playback_samples_remaining > 0)
-                {
-                    /* Write stereo samples (L/R channels) */
-                    Cy_AudioTDM_WriteTxData(TDM_STRUCT0_TX, 
-                                            (uint32_t) (*playback_buffer_ptr++));
-                    Cy_AudioTDM_WriteTxData(TDM_STRUCT0_TX, 
-                                            (uint32_t) (*playback_buffer_ptr++));
-                    playback_samples_remaining -= 2;
-                }
-                else
+                stream->process(stream->process_context, block, frames);
+            }
+            (void)tdm_slots_write_fifo(block, frames * 2u);
+            if (frames < refill_frames)
+            {
+                stream->render = NULL;
+                stream->buffers_done++;
+            }
+        }
+        else if ((stream != NULL) && (stream->current_samples >= 2u))
+        {
+            uint32_t used;
+
+            if (stream->process != NULL)
+            {
+                /* Process a copy; the buffer belongs to the task (or the clip cache) */
+                int16_t block[HW_FIFO_HALF_SIZE];
+
+                used = stream->current_samples & ~1u;
+                if (used > refill_frames * 2u)
                 {
-                    /* No more data - write zeros */
-                    Cy_AudioTDM_WriteTxData(TDM_STRUCT0_TX, 0);
-                    Cy_AudioTDM_WriteTxData(TDM_STRUCT0_TX, 0);
+                    used = refill_frames * 2u;
                 }
+                memcpy(block, (const int16_t *)stream->current, used * sizeof(int16_t));
+                stream->process(stream->process_context, block, used / 2u);
+                (void)tdm_slots_write_fifo(block, used);
             }
+            else
+            {
+                /* Write playback data to I2S FIFO */
+                used = tdm_slots_write_fifo(stream->current, stream->current_samples);
+            }
+            stream->current += used;
+            stream->current_samples -= used;
             
-            /* Check if playback finished */
-            if (playback_samples_remaining == 0)
+            /* Buffer finished (an odd trailing sample is dropped) */
+            if (stream->current_samples < 2u)
             {
-                playback_active = false;
-                playback_buffer_ptr = NULL;
-                i2s_flag = true;  /* Signal playback complete */
+                stream->current_samples = 0;
+                stream->current = NULL;
+                stream->buffers_done++;
             }
         }
         else
         {
-            /* No active playback - write zeros to prevent underflow */
-            for(int i=0; i < HW_FIFO_HALF_SIZE/2; i++)
+            /* Nothing queued - write zeros to prevent underflow */
+            (void)tdm_slots_write_fifo(NULL, 0);
+            if ((stream != NULL) && !stream->ending)
             {
-                Cy_AudioTDM_WriteTxData(TDM_STRUCT0_TX, 0);
-                Cy_AudioTDM_WriteTxData(TDM_STRUCT0_TX, 0);
+                stream->starved_refills++;
             }
         }
     }
     else if(CY_TDM_INTR_TX_FIFO_UNDERFLOW & intr)
     {
-        printf("Error: I2S transmit underflowed");
+        /* Counted, not printed: the tasks may be using the console */
+        if (stream != NULL)
+        {
+            stream->fifo_underflows++;
+        }
     }
 
     /* Clear all Tx I2S Interrupt */
     Cy_AudioTDM_ClearTxInterrupt(TDM_STRUCT0_TX, CY_TDM_INTR_TX_MASK);
+    isr_timing_exit(&isr_timing[ISR_TIMING_I2S], entry);
 }
+AUDIO_RAMFUNC_END
 
 /*******************************************************************************
  * Function Name: app_i2s_disable
@@ -315,4 +373,184 @@ void app_i2s_deactivate(void)
 {
     /* Deactivate and enable I2S TX interrupts */
     Cy_AudioTDM_DeActivateTx(TDM_STRUCT0_TX);
-}
\ No newline at end of file
+}
+
+/*******************************************************************************
+ * Function Name: app_i2s_set_stream
+ *******************************************************************************
+* Summary: Select the samples the TX ISR sends. Call before app_i2s_enable()
+*  with a cleared stream, and with NULL after app_i2s_disable().
+*
+* Parameters:
+*  stream : Stream of the playback session, or NULL for silence
+*
+* Return:
+*  None
+*
+*******************************************************************************/
+void app_i2s_set_stream(app_i2s_stream_t *stream)
+{
+    i2s_stream = stream;
+}
+
+/*******************************************************************************
+ * Function Name: app_i2s_stream_queue
+ *******************************************************************************
+* Summary: Queue a buffer behind the one being sent. Called from task
+*  context; the buffer must stay valid until buffers_done has counted it.
+*
+* Parameters:
+*  stream  : Stream set with app_i2s_set_stream()
+*  samples : Interleaved L/R samples
+*  count   : Samples at samples (L and R counted separately)
+*
+* Return:
+*  true if queued, false if the pending slot is still taken
+*
+*******************************************************************************/
+bool app_i2s_stream_queue(app_i2s_stream_t *stream, const int16_t *samples, uint32_t count)
+{
+    if (stream->pending != NULL)
+    {
+        return false;
+    }
+    /* The ISR checks pending first, so the count must already be in place */
+    stream->pending_samples = count;
+    stream->pending = samples;
+    return true;
+}
+
+/*******************************************************************************
+ * Function Name: app_i2s_stream_render
+ *******************************************************************************
+* Summary: Queue a source that the TX ISR renders refill by refill, e.g. a
+*  test signal. Called from task context once no buffer is queued; the
+*  source counts as one buffer in buffers_done when it returns fewer frames
+*  than asked, and the rest of that refill is padded with zeros.
+*
+* Parameters:
+*  stream  : Stream set with app_i2s_set_stream()
+*  render  : Called from the ISR for HW_FIFO_HALF_SIZE/2 frames at a time
+*  context : Passed to render
+*
+* Return:
+*  true if queued, false while a buffer or source is still queued
+*
+*******************************************************************************/
+bool app_i2s_stream_render(app_i2s_stream_t *stream, app_i2s_render_t render, void *context)
+{
+    if ((stream->current != NULL) || (stream->pending != NULL) || (stream->render != NULL))
+    {
+        return false;
+    }
+    /* The ISR checks render first, so the context must already be in place */
+    stream->render_context = context;
+    stream->render = render;
+    return true;
+}
+
+/*******************************************************************************
+ * Function Name: app_i2s_stream_frames_left
+ *******************************************************************************
+* Summary: Frames the stream still has to send once nothing more will be
+*  queued. Called from the process hook, where the refill being processed
+*  is still counted.
+*
+* Parameters:
+*  stream  : Stream set with app_i2s_set_stream()
+*
+* Return:
+*  Frames left, or UINT32_MAX while more may be queued or a render source
+*  plays, whose end is not known ahead
+*
+*******************************************************************************/
+AUDIO_RAMFUNC_BEGIN
+uint32_t app_i2s_stream_frames_left(const app_i2s_stream_t *stream)
+{
+    uint32_t samples;
+
+    if (!stream->ending || (stream->render != NULL))
+    {
+        return UINT32_MAX;
+    }
+    samples = stream->current_samples;
+    if (stream->pending != NULL)
+    {
+        samples += stream->pending_samples;
+    }
+    return samples / 2u;
+}
+AUDIO_RAMFUNC_END
+
+/*******************************************************************************
+ * Function Name: app_i2s_set_slots
+ *******************************************************************************
+* Summary: Reconfigure the transmitter for a TDM frame of another slot count,
+*  I2S format for 2 slots. The bit clock divider shrinks as the frame grows,
+*  so the frame rate stays SAMPLE_RATE_HZ. Call only while it is disabled.
+*
+* Parameters:
+*  slots : Slots per frame; must divide HW_FIFO_HALF_SIZE
+*
+* Return:
+*  true if the transmitter runs with this slot count, false if the divider
+*  or the FIFO do not allow it (the last slot count stays)
+*
+*******************************************************************************/
+bool app_i2s_set_slots(uint32_t slots)
+{
+    const cy_stc_tdm_config_tx_t *bsp = CYBSP_TDM_CONTROLLER_0_config.tx_config;
+    /* Bit clock divider for a one-slot frame at the same frame rate */
+    uint32_t frame_div = (uint32_t)bsp->clkDiv * bsp->channelNum;
+
+    if (slots == i2s_slots)
+    {
+        return true;
+    }
+    if ((slots < 2u) || ((HW_FIFO_HALF_SIZE % slots) != 0u) || ((frame_div % slots) != 0u))
+    {
+        return false;
+    }
+
+    i2s_tx_config.channelNum = slots;
+    i2s_tx_config.chEn = (1u << slots) - 1u;
+    i2s_tx_config.clkDiv = frame_div / slots;
+    i2s_tx_config.i2sMode = (slots == 2u);
+
+    Cy_AudioTDM_DeInit(TDM_STRUCT0);
+    if (CY_TDM_SUCCESS != Cy_AudioTDM_Init(TDM_STRUCT0, &i2s_tdm_config))
+    {
+        /* Back to the last frame that worked */
+        i2s_tx_config.channelNum = i2s_slots;
+        i2s_tx_config.chEn = (1u << i2s_slots) - 1u;
+        i2s_tx_config.clkDiv = frame_div / i2s_slots;
+        i2s_tx_config.i2sMode = (i2s_slots == 2u);
+        (void)Cy_AudioTDM_Init(TDM_STRUCT0, &i2s_tdm_config);
+        slots = 0;
+    }
+    else
+    {
+        i2s_slots = slots;
+    }
+
+    Cy_AudioTDM_ClearTxInterrupt(TDM_STRUCT0_TX, CY_TDM_INTR_TX_MASK);
+    Cy_AudioTDM_SetTxInterruptMask(TDM_STRUCT0_TX, CY_TDM_INTR_TX_MASK);
+    return (slots != 0u);
+}
+
+/*******************************************************************************
+ * Function Name: app_i2s_get_slots
+ *******************************************************************************
+* Summary: Slots per frame the transmitter is configured for
+*
+* Parameters:
+*  None
+*
+* Return:
+*  Slot count
+*
+*******************************************************************************/
+uint32_t app_i2s_get_slots(void)
+{
+    return i2s_slots;
+}
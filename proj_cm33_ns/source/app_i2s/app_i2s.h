@@ -67,18 +67,53 @@ extern "C" {
 
 /* I2S hardware FIFO size */
 #define I2S_HW_FIFO_SIZE                  (128u)
-/* I2S hardware half FIFO size is 64 */
+/* I2S hardware half FIFO size is 64 words: 32 stereo frames, fewer in a
+ * TDM frame of more slots (tdm_slots.h) */
 #define HW_FIFO_HALF_SIZE                 (I2S_HW_FIFO_SIZE/2)
 
 /* I2S interrupt priority */
 #define I2S_ISR_PRIORITY                  (7u)
 
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+/* Renders up to frames L/R frames into samples; returns fewer once done */
+typedef uint32_t (*app_i2s_render_t)(void *context, int16_t *samples, uint32_t frames);
+
+/* Processes frames L/R frames in place just before they go to the FIFO */
+typedef void (*app_i2s_process_t)(void *context, int16_t *samples, uint32_t frames);
+
+/* Samples for the TX ISR, owned by the playback session. Two buffers can be
+ * queued so the ISR moves on to the next one without a gap; the task queues
+ * with app_i2s_stream_queue() and reuses a buffer once buffers_done counts it.
+ * A render source (app_i2s_stream_render()) takes the place of a buffer: the
+ * ISR renders each refill itself and counts it in buffers_done when it ends.
+ * An optional process hook (e.g. the playback equalizer) sees every refill
+ * of buffer or rendered samples; set it before app_i2s_enable(). Once
+ * ending is set, app_i2s_stream_frames_left() tells the hook how much of
+ * the queued buffers is left to send. Samples stay L/R up to the FIFO
+ * write, which spreads each frame over the TDM slots (tdm_slots.h). */
+typedef struct {
+    const int16_t *volatile current;    /* Being sent */
+    volatile uint32_t current_samples;  /* Left at current */
+    const int16_t *volatile pending;    /* Next buffer, NULL if the slot is free */
+    volatile uint32_t pending_samples;
+    volatile app_i2s_render_t render;   /* Source rendered in the ISR, NULL if none */
+    void *volatile render_context;
+    volatile app_i2s_process_t process; /* Applied to each refill, NULL if none */
+    void *volatile process_context;
+    volatile uint32_t buffers_done;     /* Buffers fully sent */
+    volatile bool ending;               /* Nothing more will be queued */
+    volatile uint32_t starved_refills;  /* Refills padded with zeros before the end */
+    volatile uint32_t fifo_underflows;  /* Hardware FIFO ran dry */
+} app_i2s_stream_t;
+
 /*******************************************************************************
 * Global Variables
 *******************************************************************************/
-extern volatile int16_t *audio_data_ptr;
-extern int32_t recorded_data_size;
-extern volatile bool i2s_flag;
+/* Codec I2C, shared with codec_ctrl.c once app_tlv_codec_init() is done */
+extern mtb_hal_i2c_t MW_I2C_hal_obj;
+extern cy_stc_scb_i2c_context_t MW_CYBSP_I2C_CONTROLLER_0_context;
 
 /*******************************************************************************
 * Functions Prototypes
@@ -90,6 +125,12 @@ void app_i2s_enable(void);
 void app_i2s_disable(void);
 void app_i2s_activate(void);
 void app_i2s_deactivate(void);
+void app_i2s_set_stream(app_i2s_stream_t *stream);
+bool app_i2s_stream_queue(app_i2s_stream_t *stream, const int16_t *samples, uint32_t count);
+bool app_i2s_stream_render(app_i2s_stream_t *stream, app_i2s_render_t render, void *context);
+uint32_t app_i2s_stream_frames_left(const app_i2s_stream_t *stream);
+bool app_i2s_set_slots(uint32_t slots);
+uint32_t app_i2s_get_slots(void);
 
 void tlv_codec_i2c_init(void);
 
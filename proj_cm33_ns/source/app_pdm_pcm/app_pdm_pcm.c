@@ -39,6 +39,9 @@
 * Header Files
 *******************************************************************************/
 #include "app_pdm_pcm.h"
+#include "biquad.h"
+#include "audio_ramfunc.h"
+#include "isr_timing.h"
 
 /*******************************************************************************
 * Global Variables
@@ -49,11 +52,16 @@ const cy_stc_sysint_t PDM_IRQ_cfg = {
     .intrPriority = PDM_PCM_ISR_PRIORITY
 };
 
-/* Array containing the recorded data (stereo) */
-int16_t recorded_data[NUM_CHANNELS * BUFFER_SIZE] __attribute__((section(".cy_shared_socmem"))) = {0};
+/* Stream the RX ISR fills, NULL while no capture session is active */
+static app_pdm_pcm_stream_t *volatile pdm_stream = NULL;
 
-int32_t recorded_data_size;
-volatile int16_t *audio_data_ptr = NULL;
+/* Working copies of the BSP channel configurations, changed by
+ * app_pdm_pcm_set_filter() */
+static cy_stc_pdm_pcm_channel_config_t left_ch_config;
+static cy_stc_pdm_pcm_channel_config_t right_ch_config;
+static cy_en_pdm_pcm_gain_sel_t pdm_gain = CY_PDM_PCM_SEL_GAIN_NEGATIVE_37DB;
+static uint16_t pdm_hpf_hz = 0;
+static uint16_t pdm_settle_frames = IGNORED_SAMPLES;
 
 /*******************************************************************************
 * Function Name: app_pdm_pcm_init
@@ -82,8 +90,10 @@ void app_pdm_pcm_init(void)
     Cy_PDM_PCM_Channel_Enable(PDM0, LEFT_CH_INDEX);
     Cy_PDM_PCM_Channel_Enable(PDM0, RIGHT_CH_INDEX);
 
-    Cy_PDM_PCM_Channel_Init(PDM0, &LEFT_CH_CONFIG, (uint8_t)LEFT_CH_INDEX);
-    Cy_PDM_PCM_Channel_Init(PDM0, &RIGHT_CH_CONFIG, (uint8_t)RIGHT_CH_INDEX);
+    left_ch_config = LEFT_CH_CONFIG;
+    right_ch_config = RIGHT_CH_CONFIG;
+    Cy_PDM_PCM_Channel_Init(PDM0, &left_ch_config, (uint8_t)LEFT_CH_INDEX);
+    Cy_PDM_PCM_Channel_Init(PDM0, &right_ch_config, (uint8_t)RIGHT_CH_INDEX);
     
     /* Set the gain for both left and right channels. */
     
@@ -106,19 +116,30 @@ void app_pdm_pcm_init(void)
 /*******************************************************************************
  * Function Name: app_pdm_pcm_activate
  ********************************************************************************
-* Summary: This function activates the left and right channel.
+* Summary: This function starts a capture stream and activates the left and
+*  right channel.
 *
 * Parameters:
-*  None
+*  stream : Capture session's stream; skip_frames, timed, on_full and
+*           context are set by the caller, the rest is cleared here
+*  buffer : Destination of the interleaved frames
+*  capacity : Samples the buffer holds, whole frames; the ISR stops at
+*             exactly this count
 *
 * Return:
 *  none
 *
 *******************************************************************************/
-void app_pdm_pcm_activate(void)
+void app_pdm_pcm_activate(app_pdm_pcm_stream_t *stream, int16_t *buffer, uint32_t capacity)
 {
-    /* Reset audio data pointer to beginning of buffer */
-    audio_data_ptr = recorded_data;
+    /* Start at the beginning of the buffer */
+    stream->buffer = buffer;
+    stream->end = &buffer[capacity];
+    stream->write_ptr = buffer;
+    stream->overflow_count = 0;
+    stream->underflow_count = 0;
+    stream->dropped_samples = 0;
+    pdm_stream = stream;
     
     /* Activate recording from channel after init Activate Channel */
     Cy_PDM_PCM_Activate_Channel(PDM0, LEFT_CH_INDEX);
@@ -288,35 +309,171 @@ cy_en_pdm_pcm_gain_sel_t convert_db_to_pdm_scale(double db)
  *******************************************************************************/
 void set_pdm_pcm_gain(cy_en_pdm_pcm_gain_sel_t gain)
 {
+    pdm_gain = gain;
 
     Cy_PDM_PCM_SetGain(PDM0, RIGHT_CH_INDEX, gain);
     Cy_PDM_PCM_SetGain(PDM0, LEFT_CH_INDEX, gain);
 
 }
 
+/*******************************************************************************
+* Function Name: app_pdm_pcm_get_filter
+********************************************************************************
+* Summary: Read the capture filter settings
+*
+* Parameters:
+*  filter : Output
+*
+* Return :
+*  none
+*
+*******************************************************************************/
+void app_pdm_pcm_get_filter(app_pdm_pcm_filter_t *filter)
+{
+    filter->dc_block = !left_ch_config.dc_block_disable;
+    filter->dc_block_code = (uint8_t)(left_ch_config.dc_block_code - CY_PDM_PCM_CHAN_DCBLOCK_CODE_1);
+    filter->fir0 = left_ch_config.fir0_enable;
+    filter->fir1_scale = (uint8_t)left_ch_config.fir1_scale;
+    filter->hpf_hz = pdm_hpf_hz;
+    filter->settle_frames = pdm_settle_frames;
+}
+
+/*******************************************************************************
+* Function Name: app_pdm_pcm_set_filter
+********************************************************************************
+* Summary: Change the capture filter settings of both channels. The hardware
+*  settings are written by disabling and re-initializing the channels, so
+*  this must not be called while recording. Only decimation splits that
+*  keep the total at 96 are offered, so the sample rate does not change.
+*
+* Parameters:
+*  filter : New settings; hpf_hz and settle_frames apply from the next take
+*
+* Return :
+*  0 on success, -1 if a setting is out of range or a channel rejects it
+*
+*******************************************************************************/
+int app_pdm_pcm_set_filter(const app_pdm_pcm_filter_t *filter)
+{
+    cy_stc_pdm_pcm_channel_config_t *configs[NUM_CHANNELS] = { &left_ch_config, &right_ch_config };
+    const uint8_t channels[NUM_CHANNELS] = { LEFT_CH_INDEX, RIGHT_CH_INDEX };
+    int result = 0;
+
+    if ((filter->dc_block_code > PDM_PCM_DC_BLOCK_CODE_MAX) ||
+        (filter->fir1_scale > PDM_PCM_FIR_SCALE_MAX) ||
+        ((filter->hpf_hz != 0u) &&
+         ((filter->hpf_hz < BIQUAD_HPF_MIN_HZ) || (filter->hpf_hz > BIQUAD_HPF_MAX_HZ))) ||
+        (filter->settle_frames > PDM_PCM_MAX_SETTLE_FRAMES))
+    {
+        return -1;
+    }
+
+    for(uint32_t i = 0; i < NUM_CHANNELS; i++)
+    {
+        cy_stc_pdm_pcm_channel_config_t *config = configs[i];
+
+        config->dc_block_disable = !filter->dc_block;
+        config->dc_block_code = CY_PDM_PCM_CHAN_DCBLOCK_CODE_1 + filter->dc_block_code;
+        config->fir0_enable = filter->fir0;
+        config->cic_decim_code = filter->fir0 ? CY_PDM_PCM_CHAN_CIC_DECIM_16 : CY_PDM_PCM_CHAN_CIC_DECIM_32;
+        config->fir0_decim_code = filter->fir0 ? CY_PDM_PCM_CHAN_FIR0_DECIM_2 : CY_PDM_PCM_CHAN_FIR0_DECIM_1;
+        config->fir1_scale = filter->fir1_scale;
+
+        Cy_PDM_PCM_Channel_Disable(PDM0, channels[i]);
+        if(CY_PDM_PCM_SUCCESS != Cy_PDM_PCM_Channel_Init(PDM0, config, channels[i]))
+        {
+            result = -1;
+        }
+        Cy_PDM_PCM_Channel_Enable(PDM0, channels[i]);
+    }
+
+    /* Channel_Init rewrites the channel registers; restore gain and interrupts */
+    set_pdm_pcm_gain(pdm_gain);
+    Cy_PDM_PCM_Channel_ClearInterrupt(PDM0, RIGHT_CH_INDEX, CY_PDM_PCM_INTR_MASK);
+    Cy_PDM_PCM_Channel_SetInterruptMask(PDM0, RIGHT_CH_INDEX, CY_PDM_PCM_INTR_MASK);
+    pdm_hpf_hz = filter->hpf_hz;
+    pdm_settle_frames = filter->settle_frames;
+
+    return result;
+}
+
+/*******************************************************************************
+* Function Name: app_pdm_pcm_set_settle
+********************************************************************************
+* Summary: Set the frames discarded at the start of each take, from the next
+*  take. Unlike app_pdm_pcm_set_filter() the channels are not touched, so
+*  this may be called while recording.
+*
+* Parameters:
+*  frames : 0..PDM_PCM_MAX_SETTLE_FRAMES
+*
+* Return :
+*  none
+*
+*******************************************************************************/
+void app_pdm_pcm_set_settle(uint16_t frames)
+{
+    pdm_settle_frames = frames;
+}
+
 /*******************************************************************************
 * Function Name: pdm_interrupt_handler
 ********************************************************************************
 * Summary: 
 *  PDM Overflow ISR handler. 
 *  Read RX_FIFO_TRIG_LEVEL number of samples from each channel.
+*  - Frames still to be skipped at the start of a take are discarded
+*  - Only the frames that fit are stored, so a take ends at exactly the
+*    buffer's capacity; the session is told once the buffer is full
+*  - Runs from SRAM (audio_ramfunc.h); entry interval and time inside are
+*    counted for the 'isr' command
 *
 *******************************************************************************/
+AUDIO_RAMFUNC_BEGIN
 void pdm_interrupt_handler(void)
 {
+    uint32_t entry = isr_timing_enter(&isr_timing[ISR_TIMING_PDM]);
     volatile uint32_t int_stat;
+    app_pdm_pcm_stream_t *stream = pdm_stream;
     int_stat = Cy_PDM_PCM_Channel_GetInterruptStatusMasked(PDM0, RIGHT_CH_INDEX);
     if(CY_PDM_PCM_INTR_RX_TRIGGER & int_stat)
     {
-        for(uint8_t i=0; i < RX_FIFO_TRIG_LEVEL; i++)
+        /* Trigger left over from a stopped session, or frames past the end
+         * of the buffer: the memory after it may hold another take */
+        int16_t discard[NUM_CHANNELS * RX_FIFO_TRIG_LEVEL];
+        uint32_t frames = RX_FIFO_TRIG_LEVEL;
+
+        if(stream != NULL)
+        {
+            uint32_t skip = stream->skip_frames;
+            uint32_t room = (uint32_t)(stream->end - stream->write_ptr) / NUM_CHANNELS;
+
+            if(skip > 0u)
+            {
+                skip = (skip < frames) ? skip : frames;
+                (void)app_pdm_pcm_read_fifo(discard, skip);
+                stream->skip_frames -= skip;
+                frames -= skip;
+            }
+            if((room > 0u) && (frames > 0u))
+            {
+                uint32_t count = (room < frames) ? room : frames;
+                stream->write_ptr = (int16_t *)app_pdm_pcm_read_fifo(stream->write_ptr, count);
+                frames -= count;
+                if((count == room) && (stream->on_full != NULL))
+                {
+                    stream->on_full(stream->context);
+                }
+            }
+            if((frames > 0u) && !stream->timed)
             {
-                int32_t data = (int32_t)Cy_PDM_PCM_Channel_ReadFifo(PDM0, LEFT_CH_INDEX);
-                *(audio_data_ptr) = (int16_t)(data);
-                audio_data_ptr++;
-                data = (int32_t)Cy_PDM_PCM_Channel_ReadFifo(PDM0, RIGHT_CH_INDEX);
-                *(audio_data_ptr) = (int16_t)(data);
-                audio_data_ptr++;
+                stream->dropped_samples += NUM_CHANNELS * frames;
             }
+        }
+        if(frames > 0u)
+        {
+            (void)app_pdm_pcm_read_fifo(discard, frames);
+        }
 
         Cy_PDM_PCM_Channel_ClearInterrupt(PDM0, RIGHT_CH_INDEX, 
                                           CY_PDM_PCM_INTR_RX_TRIGGER);
@@ -324,9 +481,20 @@ void pdm_interrupt_handler(void)
     if((CY_PDM_PCM_INTR_RX_FIR_OVERFLOW | CY_PDM_PCM_INTR_RX_OVERFLOW|
     CY_PDM_PCM_INTR_RX_IF_OVERFLOW | CY_PDM_PCM_INTR_RX_UNDERFLOW) & int_stat)
     {
+        if((stream != NULL) && ((CY_PDM_PCM_INTR_RX_FIR_OVERFLOW | CY_PDM_PCM_INTR_RX_OVERFLOW |
+            CY_PDM_PCM_INTR_RX_IF_OVERFLOW) & int_stat))
+        {
+            stream->overflow_count++;
+        }
+        if((stream != NULL) && (CY_PDM_PCM_INTR_RX_UNDERFLOW & int_stat))
+        {
+            stream->underflow_count++;
+        }
         Cy_PDM_PCM_Channel_ClearInterrupt(PDM0, RIGHT_CH_INDEX, CY_PDM_PCM_INTR_MASK);
     }
+    isr_timing_exit(&isr_timing[ISR_TIMING_PDM], entry);
 }
+AUDIO_RAMFUNC_END
 
 /*******************************************************************************
 * Function Name: app_pdm_pcm_deactivate
@@ -344,41 +512,24 @@ void app_pdm_pcm_deactivate(void)
 {
     Cy_PDM_PCM_DeActivate_Channel(PDM0, LEFT_CH_INDEX);
     Cy_PDM_PCM_DeActivate_Channel(PDM0, RIGHT_CH_INDEX);
-}
 
-/*******************************************************************************
-* Function Name: get_audio_data_index
-********************************************************************************
-* Summary: Get current audio data pointer index (number of samples recorded)
-*
-* Parameters:
-*  none
-*
-* Return :
-*  uint32_t - Number of samples recorded
-*
-*******************************************************************************/
-uint32_t get_audio_data_index(void)
-{
-    if (audio_data_ptr == NULL) {
-        return 0;
-    }
-    return (uint32_t)(audio_data_ptr - recorded_data);
+    /* The stream keeps its final position for the session to read */
+    pdm_stream = NULL;
 }
 
 /*******************************************************************************
-* Function Name: get_recorded_data_buffer
+* Function Name: app_pdm_pcm_samples
 ********************************************************************************
-* Summary: Get pointer to recorded audio buffer
+* Summary: Number of samples a capture stream holds so far
 *
 * Parameters:
-*  none
+*  stream : Stream passed to app_pdm_pcm_activate()
 *
 * Return :
-*  int16_t* - Pointer to recorded_data buffer
+*  uint32_t - Samples recorded, L and R counted separately
 *
 *******************************************************************************/
-int16_t* get_recorded_data_buffer(void)
+uint32_t app_pdm_pcm_samples(const app_pdm_pcm_stream_t *stream)
 {
-    return recorded_data;
+    return (uint32_t)(stream->write_ptr - stream->buffer);
 }
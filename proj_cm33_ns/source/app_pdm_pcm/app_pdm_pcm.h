@@ -65,13 +65,16 @@ extern "C" {
 /* PDM Half FIFO Size */
 #define PDM_HALF_FIFO_SIZE             (PDM_HW_FIFO_SIZE/2)
 
-/* Recording time in seconds */
+/* Recording time in seconds: the longest take, when the capture pool
+ * (capture_pool.h) holds no earlier take */
 #define RECORDING_DURATION_SEC         (4u)
-/* Size of the recorded buffer */
+/* Size of the capture pool, frames */
 #define BUFFER_SIZE                    (RECORDING_DURATION_SEC * SAMPLE_RATE_HZ)
 
-/* Number of samples to ignore in the beginning of a recording */
+/* Frames (samples per channel) discarded at the start of a recording while
+ * the decimation filters settle; the default of 'filter settle' */
 #define IGNORED_SAMPLES                (PDM_HW_FIFO_SIZE)
+#define PDM_PCM_MAX_SETTLE_FRAMES      (SAMPLE_RATE_HZ)
 
 /* PDM PCM interrupt priority */
 #define PDM_PCM_ISR_PRIORITY            (7u)
@@ -81,6 +84,10 @@ extern "C" {
 #define PDM_PCM_MAX_GAIN                        (83.0)
 #define PDM_MIC_GAIN_VALUE                      (20)
 
+/* Capture filter limits, see app_pdm_pcm_set_filter() */
+#define PDM_PCM_DC_BLOCK_CODE_MAX               (7u)    /* CY_PDM_PCM_CHAN_DCBLOCK_CODE_128 */
+#define PDM_PCM_FIR_SCALE_MAX                   (31u)
+
 /* Gain to Scale mapping */
 
 #define PDM_PCM_SEL_GAIN_83DB                   (83.0)
@@ -117,22 +124,80 @@ extern "C" {
 #define PDM_PCM_SEL_GAIN_NEGATIVE_103DB         (-103.0)
 
 /*******************************************************************************
-* Global Variables
+* Structures
 *******************************************************************************/
-extern int16_t recorded_data[NUM_CHANNELS * BUFFER_SIZE];
+/* Capture path filtering, applied to both channels */
+typedef struct {
+    bool dc_block;              /* Hardware DC blocker */
+    uint8_t dc_block_code;      /* 0..7: CY_PDM_PCM_CHAN_DCBLOCK_CODE_1..128, higher is a lower corner */
+    bool fir0;                  /* CIC /16 + FIR0 /2 instead of CIC /32; decimation stays 96 */
+    uint8_t fir1_scale;         /* FIR1 output shift; CIC gain is 2^5 lower with fir0 */
+    uint16_t hpf_hz;            /* Software high-pass cutoff, 0 = off */
+    uint16_t settle_frames;     /* Discarded at the start of each take, by the record task */
+} app_pdm_pcm_filter_t;
+
+/* Called from the RX ISR when the stream's buffer has just been filled */
+typedef void (*app_pdm_pcm_full_t)(void *context);
+
+/* Where the RX ISR stores frames, owned by the capture session */
+typedef struct {
+    int16_t *buffer;
+    int16_t *end;                       /* Frames that would not fit are dropped */
+    int16_t *volatile write_ptr;        /* Next sample the ISR stores */
+    volatile uint32_t skip_frames;      /* Set by the session: still to discard while
+                                         * the filters settle */
+    volatile uint32_t overflow_count;   /* Error interrupts since activation */
+    volatile uint32_t underflow_count;
+    volatile uint32_t dropped_samples;  /* Read while the buffer was full */
+    bool timed;                         /* Set by the session: a full buffer is the
+                                         * requested length, nothing after it is dropped */
+    app_pdm_pcm_full_t on_full;         /* Set by the session, NULL if not needed */
+    void *context;
+} app_pdm_pcm_stream_t;
 
 
 /*******************************************************************************
 * Functions Prototypes
 *******************************************************************************/
 void app_pdm_pcm_init(void);
-void app_pdm_pcm_activate(void);
+void app_pdm_pcm_activate(app_pdm_pcm_stream_t *stream, int16_t *buffer, uint32_t capacity);
 void app_pdm_pcm_deactivate(void);
 cy_en_pdm_pcm_gain_sel_t convert_db_to_pdm_scale(double db);
 void set_pdm_pcm_gain(cy_en_pdm_pcm_gain_sel_t gain);
 void pdm_interrupt_handler(void);
-uint32_t get_audio_data_index(void);
-int16_t* get_recorded_data_buffer(void);
+uint32_t app_pdm_pcm_samples(const app_pdm_pcm_stream_t *stream);
+void app_pdm_pcm_get_filter(app_pdm_pcm_filter_t *filter);
+int app_pdm_pcm_set_filter(const app_pdm_pcm_filter_t *filter);
+void app_pdm_pcm_set_settle(uint16_t frames);
+
+/*******************************************************************************
+* Function Name: app_pdm_pcm_read_fifo
+********************************************************************************
+* Summary: Drain interleaved left/right frames from the channel FIFOs. This is
+*  the body of pdm_interrupt_handler(), inline so the bench command measures
+*  the same code the ISR runs.
+*
+* Parameters:
+*  dst    : Destination, NUM_CHANNELS samples per frame
+*  frames : Frames to read
+*
+* Return :
+*  Pointer just past the last sample written
+*
+*******************************************************************************/
+__STATIC_INLINE volatile int16_t *app_pdm_pcm_read_fifo(volatile int16_t *dst, uint32_t frames)
+{
+    for(uint32_t i=0; i < frames; i++)
+    {
+        int32_t data = (int32_t)Cy_PDM_PCM_Channel_ReadFifo(PDM0, LEFT_CH_INDEX);
+        *(dst) = (int16_t)(data);
+        dst++;
+        data = (int32_t)Cy_PDM_PCM_Channel_ReadFifo(PDM0, RIGHT_CH_INDEX);
+        *(dst) = (int16_t)(data);
+        dst++;
+    }
+    return dst;
+}
 
 
 #ifdef __cplusplus
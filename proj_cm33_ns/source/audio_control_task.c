@@ -10,9 +10,34 @@
 #include "app_i2s.h"
 #include "freertos_setup.h"
 #include "file_read_task.h"
+#include "file_xfer_task.h"
+#include "playback_task.h"
+#include "audio_record_task.h"
+#include "bench.h"
+#include "membench.h"
+#include "codec_ctrl.h"
+#include "output_ctrl.h"
+#include "tdm_slots.h"
+#include "wav_file.h"
+#include "peak_file.h"
+#include "segmenter.h"
+#include "biquad.h"
+#include "capture_pool.h"
+#include "clip_cache.h"
+#include "siggen.h"
+#include "latency.h"
+#include "playback_dsp.h"
+#include "loudness.h"
+#include "compressor.h"
+#include "settings.h"
+#include "wall_clock.h"
+#include "audio_ramfunc.h"
+#include "isr_timing.h"
 #include "FS.h"
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 
 /*******************************************************************************
 * Global Variables
@@ -22,29 +47,161 @@ TaskHandle_t audio_control_task_handle = NULL;
 /*******************************************************************************
 * Local Variables
 *******************************************************************************/
+/* Capture and playback are independent sessions; either can start while
+ * the other runs. Playback is tracked with EVENT_PLAYING, which
+ * PlaybackTask clears when the file has been sent. */
 static bool recording_active = false;
+static char playback_filename[32];      /* Of the current or last playback */
+static peak_builder_t peak_scratch;     /* For rebuilding missing sidecars */
+static siggen_t test_signal;            /* 'gen', rendered by the I2S ISR */
+static loudness_meter_t clip_meter;     /* For cached clips not measured yet */
+
+/*******************************************************************************
+* Function Name: playback_busy
+********************************************************************************
+* Summary:
+*  True from a play command until PlaybackTask has sent the whole file
+*
+*******************************************************************************/
+static bool playback_busy(void)
+{
+    return (xEventGroupGetBits(audio_state_events) & EVENT_PLAYING) != 0u;
+}
+
+/*******************************************************************************
+* Function Name: update_idle_state
+********************************************************************************
+* Summary:
+*  EVENT_IDLE is set while neither session runs
+*
+*******************************************************************************/
+static void update_idle_state(void)
+{
+    if (recording_active || playback_busy()) {
+        xEventGroupClearBits(audio_state_events, EVENT_IDLE);
+    } else {
+        xEventGroupSetBits(audio_state_events, EVENT_IDLE);
+    }
+}
+
+/*******************************************************************************
+* Function Name: playback_begin
+********************************************************************************
+* Summary:
+*  Mark a playback session as started, before its first chunk is sent
+*
+*******************************************************************************/
+static void playback_begin(const char *name)
+{
+    xEventGroupClearBits(audio_state_events, EVENT_IDLE | EVENT_PLAYBACK_DONE);
+    xEventGroupSetBits(audio_state_events, EVENT_PLAYING);
+    strncpy(playback_filename, name, sizeof(playback_filename) - 1);
+    playback_filename[sizeof(playback_filename) - 1] = '\0';
+}
+
+/* Release hooks for PCM that PlaybackTask plays straight from RAM */
+static void release_take(void *owner)
+{
+    capture_pool_release((capture_buffer_t *)owner);
+}
+
+static void release_clip(void *owner)
+{
+    clip_cache_release((clip_entry_t *)owner);
+}
+
+static void release_signal(void *owner)
+{
+    ((siggen_t *)owner)->active = false;
+}
+
+/* Test signal source, called from the I2S ISR */
+AUDIO_RAMFUNC_BEGIN
+static uint32_t render_signal(void *owner, int16_t *samples, uint32_t frames)
+{
+    return siggen_render((siggen_t *)owner, samples, frames);
+}
+AUDIO_RAMFUNC_END
+
+/*******************************************************************************
+* Function Name: playback_send_ram
+********************************************************************************
+* Summary:
+*  Hand PCM in RAM to PlaybackTask as a single last chunk, bypassing
+*  FileReadTask and the card
+*
+* Parameters:
+*  pcm: Interleaved samples
+*  sample_count: L and R counted separately
+*  release: Called with owner once the samples are sent, or here on failure
+*  owner: Reference that keeps pcm valid
+*  loudness: Of the clip, LUFS, or LOUDNESS_UNKNOWN
+*
+*******************************************************************************/
+static void playback_send_ram(int16_t *pcm, uint32_t sample_count,
+                              void (*release)(void *owner), void *owner, float loudness)
+{
+    pcm_playback_msg_t pcm_msg;
+    
+    pcm_msg.buffer_ptr = pcm;
+    pcm_msg.sample_count = sample_count;
+    pcm_msg.is_last_chunk = true;
+    pcm_msg.release = release;
+    pcm_msg.owner = owner;
+    pcm_msg.render = NULL;
+    pcm_msg.loudness = loudness;
+    if (xQueueSend(pcm_playback_queue, &pcm_msg, pdMS_TO_TICKS(100)) != pdPASS) {
+        printf("Error: Failed to send PCM to PlaybackTask\r\n");
+        release(owner);
+        xEventGroupClearBits(audio_state_events, EVENT_PLAYING);
+        update_idle_state();
+    }
+}
 
 /*******************************************************************************
 * Function Name: handle_start_record
 ********************************************************************************
 * Summary:
 *  Start PDM recording
+*  - "record <seconds>" or "record <n> frames" stops at exactly that many
+*    frames; the length must fit the largest free run of the capture pool
 *
 * Parameters:
-*  None
+*  cmd_msg: CLI command (length in args, ms or frames as named in filename)
 *
 * Return:
 *  None
 *
 *******************************************************************************/
-static void handle_start_record(void)
+static void handle_start_record(const audio_command_msg_t *cmd_msg)
 {
+    capture_pool_status_t pool;
+    uint32_t frames = 0;
+    
     /* Check if already recording */
     if (recording_active) {
         printf("Already recording. Stop first.\r\n");
         return;
     }
     
+    if (cmd_msg->num_args > 0) {
+        uint32_t limit;
+        
+        capture_pool_get_status(&pool);
+        limit = (pool.largest_free * CAPTURE_POOL_BLOCK_SAMPLES) / NUM_CHANNELS;
+        if (strcmp(cmd_msg->filename, "frames") == 0) {
+            frames = cmd_msg->args[0];
+        } else {
+            frames = (uint32_t)(((uint64_t)cmd_msg->args[0] * SAMPLE_RATE_HZ) / 1000u);
+        }
+        if ((frames == 0u) || (frames > limit)) {
+            printf("Error: Length must be 1..%lu frames (%.3f s) with the capture buffers free now\r\n",
+                   (unsigned long)limit, (double)limit / SAMPLE_RATE_HZ);
+            return;
+        }
+    }
+    audio_record_set_length(frames);
+    
     /* Clear idle state */
     xEventGroupClearBits(audio_state_events, EVENT_IDLE | EVENT_RECORDING_DONE);
     
@@ -52,10 +209,24 @@ static void handle_start_record(void)
     printf("Starting PDM recording...\r\n");
     xEventGroupSetBits(audio_state_events, EVENT_RECORDING);
     
+    /* AudioRecordTask runs at a higher priority, so by now it has taken a
+     * capture buffer or refused the take */
+    if (xEventGroupGetBits(audio_state_events) & EVENT_RECORDING_DONE) {
+        xEventGroupClearBits(audio_state_events, EVENT_RECORDING_DONE);
+        printf("Recording not started: no free capture buffer until a take is saved.\r\n");
+        update_idle_state();
+        return;
+    }
+    
     /* Update local state */
     recording_active = true;
     
-    printf("Recording started. Type 'stop' to finish.\r\n");
+    if (frames != 0u) {
+        printf("Recording %lu frames (%.3f s). Type 'stop' to finish early.\r\n",
+               (unsigned long)frames, (double)frames / SAMPLE_RATE_HZ);
+    } else {
+        printf("Recording started. Type 'stop' to finish.\r\n");
+    }
 }
 
 /*******************************************************************************
@@ -107,15 +278,83 @@ static void handle_stop_record(void)
     
     printf("[DEBUG] Stop complete\r\n");
     
-    /* Return to idle state */
-    xEventGroupSetBits(audio_state_events, EVENT_IDLE);
+    /* Idle unless a playback session is still running */
+    update_idle_state();
+}
+
+/*******************************************************************************
+* Function Name: handle_stop_play
+********************************************************************************
+* Summary:
+*  Stop a file, clip or test signal play: the output fades out over
+*  OUTPUT_RAMP_MS, then PlaybackTask drops the rest of it
+*
+*******************************************************************************/
+static void handle_stop_play(void)
+{
+    EventBits_t bits;
+    
+    (void)output_ctrl_fade_out();
+    if (test_signal.active) {
+        siggen_stop(&test_signal);
+    } else {
+        playback_stop_requested = true;
+    }
+    
+    bits = xEventGroupWaitBits(audio_state_events, EVENT_PLAYBACK_DONE,
+                               pdFALSE, pdFALSE, pdMS_TO_TICKS(1000));
+    if (bits & EVENT_PLAYBACK_DONE) {
+        /* Already clear unless the play ended on its own first */
+        playback_stop_requested = false;
+        printf("Playback stopped.\r\n");
+    } else {
+        printf("WARNING: Playback stop timeout\r\n");
+    }
+    update_idle_state();
+}
+
+/*******************************************************************************
+* Function Name: handle_stop
+********************************************************************************
+* Summary:
+*  'stop': end the recording and the play, whichever are running
+*
+*******************************************************************************/
+static void handle_stop(void)
+{
+    if (!recording_active && !playback_busy()) {
+        printf("Nothing to stop.\r\n");
+        return;
+    }
+    if (recording_active) {
+        handle_stop_record();
+    }
+    if (playback_busy()) {
+        handle_stop_play();
+    }
+}
+
+/*******************************************************************************
+* Function Name: level_dbfs
+********************************************************************************
+* Summary:
+*  Convert a 16-bit sample magnitude to dB relative to full scale
+*
+*******************************************************************************/
+static float level_dbfs(uint16_t level)
+{
+    if (level == 0) {
+        return -99.9f;
+    }
+    return 20.0f * log10f((float)level / 32768.0f);
 }
 
 /*******************************************************************************
 * Function Name: handle_list_files
 ********************************************************************************
 * Summary:
-*  List WAV files on SD card
+*  List WAV files on SD card, with the recording time and take statistics
+*  when the file carries bext/take chunks (read without touching the audio)
 *
 * Parameters:
 *  None
@@ -126,24 +365,79 @@ static void handle_stop_record(void)
 *******************************************************************************/
 static void handle_list_files(void)
 {
-    printf("Listing recent WAV files:\r\n");
+    wav_metadata_t meta;
+    FS_FIND_DATA find;
+    char filename[32];
     
-    /* Check for recently created files */
-    for (int i = 1; i <= 10; i++) {
-        char filename[32];
-        snprintf(filename, sizeof(filename), "audio_%03d.wav", i);
-        
-        FS_FILE *file = FS_FOpen(filename, "r");
-        if (file != NULL) {
+    printf("Listing WAV files:\r\n");
+    
+    /* Every WAV in the root directory; splitting makes many small ones */
+    if (FS_FindFirstFile(&find, "", filename, sizeof(filename)) == 0) {
+        do {
+            size_t length = strlen(filename);
+            if (((find.Attributes & FS_ATTR_DIRECTORY) != 0u) || (length < 4u) ||
+                (strcasecmp(&filename[length - 4u], ".wav") != 0)) {
+                continue;
+            }
+            
+            FS_FILE *file = FS_FOpen(filename, "r");
+            if (file == NULL) {
+                continue;
+            }
             U32 size = FS_GetFileSize(file);
+            int result = wav_read_metadata(file, &meta);
             FS_FClose(file);
+            clip_cache_check(filename, size, find.LastWriteTime);
             printf("  %s  (%u bytes)\r\n", filename, (unsigned int)size);
-        }
+            
+            if ((result == 0) && meta.has_bext) {
+                printf("      recorded %s %s\r\n", meta.date, meta.time);
+            }
+            if ((result == 0) && meta.has_take && (meta.take.sample_rate > 0)) {
+                printf("      %.2f s, peak %.1f/%.1f dBFS, rms %.1f/%.1f dBFS, gain %d dB, "
+                       "faults %u%s\r\n",
+                       (double)meta.take.frames / meta.take.sample_rate,
+                       (double)level_dbfs(meta.take.peak[0]), (double)level_dbfs(meta.take.peak[1]),
+                       (double)level_dbfs(meta.take.rms[0]), (double)level_dbfs(meta.take.rms[1]),
+                       meta.take.gain_db,
+                       (unsigned int)(meta.take.pdm_overflows + meta.take.pdm_underflows +
+                                      meta.take.frames_dropped),
+                       ((meta.take.flags & WAV_TAKE_FLAG_COMPRESSED) != 0u) ? ", compressed" : "");
+            }
+        } while (FS_FindNextFile(&find) != 0);
+        FS_FindClose(&find);
     }
     
     printf("(Use 'play <filename>' to play a file)\r\n");
 }
 
+/*******************************************************************************
+* Function Name: clip_loudness
+********************************************************************************
+* Summary:
+*  Loudness of a cached clip: from the loudness cache, or with the
+*  normalizer on measured here from RAM, which needs no card access
+*
+*******************************************************************************/
+static float clip_loudness(const clip_entry_t *clip)
+{
+    playback_dsp_config_t config;
+    float loudness;
+    
+    if (loudness_cache_get(clip->name, clip->file_size, clip->file_time, &loudness)) {
+        return loudness;
+    }
+    playback_dsp_get_config(&config);
+    if (!config.normalize ||
+        (loudness_init(&clip_meter, WAV_SAMPLE_RATE, WAV_NUM_CHANNELS) != 0)) {
+        return LOUDNESS_UNKNOWN;
+    }
+    loudness_add(&clip_meter, clip->pcm, clip->sample_count / WAV_NUM_CHANNELS);
+    loudness = loudness_integrated(&clip_meter);
+    loudness_cache_put(clip->name, clip->file_size, clip->file_time, loudness);
+    return loudness;
+}
+
 /*******************************************************************************
 * Function Name: handle_play_file
 ********************************************************************************
@@ -160,12 +454,33 @@ static void handle_list_files(void)
 static void handle_play_file(const char *filename)
 {
     file_read_msg_t read_msg;
+    FS_FILE_INFO info;
+    clip_entry_t *clip = NULL;
     BaseType_t result;
     
-    printf("Playing file: %s\r\n", filename);
+    /* One playback session at a time; recording may go on alongside */
+    if (playback_busy()) {
+        printf("Already playing %s. Wait for it to finish.\r\n", playback_filename);
+        return;
+    }
     
-    /* Clear idle state */
-    xEventGroupClearBits(audio_state_events, EVENT_IDLE);
+    /* Played recently and unchanged since: straight from the clip cache,
+     * with only a directory lookup on the card */
+    if (FS_GetFileInfo(filename, &info) == 0) {
+        clip = clip_cache_get(filename, info.FileSize, info.LastWriteTime);
+    }
+    if (clip != NULL) {
+        printf("Playing file: %s (cached)%s\r\n", filename,
+               recording_active ? " (while recording)" : "");
+        playback_begin(filename);
+        playback_send_ram(clip->pcm, clip->sample_count, release_clip, clip, clip_loudness(clip));
+        return;
+    }
+    
+    printf("Playing file: %s%s\r\n", filename, recording_active ? " (while recording)" : "");
+    
+    /* Clear idle state, start the playback session */
+    playback_begin(filename);
     
     /* Send filename to FileReadTask */
     strncpy(read_msg.filename, filename, sizeof(read_msg.filename) - 1);
@@ -174,13 +489,55 @@ static void handle_play_file(const char *filename)
     result = xQueueSend(file_read_queue, &read_msg, pdMS_TO_TICKS(100));
     if (result != pdPASS) {
         printf("Error: Failed to send read command\r\n");
-        xEventGroupSetBits(audio_state_events, EVENT_IDLE);
+        xEventGroupClearBits(audio_state_events, EVENT_PLAYING);
+        update_idle_state();
         return;
     }
     
     printf("Read command sent to FileReadTask\r\n");
 }
 
+/*******************************************************************************
+* Function Name: handle_replay
+********************************************************************************
+* Summary:
+*  Play the last take straight from the capture pool while FileWriteTask
+*  may still be saving it; needs no SD card
+*  - The playback session holds its own reference to the take, so the
+*    memory is freed only when both the save and the replay are done
+*  - The whole take is one chunk; segmenting does not apply
+*
+* Parameters:
+*  None
+*
+* Return:
+*  None
+*
+*******************************************************************************/
+static void handle_replay(void)
+{
+    capture_buffer_t *take;
+    uint32_t sample_count;
+    
+    if (playback_busy()) {
+        printf("Already playing %s. Wait for it to finish.\r\n", playback_filename);
+        return;
+    }
+    
+    take = audio_record_last_take(&sample_count);
+    if (take == NULL) {
+        printf("Nothing to replay: the last take is released when a new recording starts.\r\n");
+        return;
+    }
+    
+    printf("Replaying last take from RAM: %.2f s%s\r\n",
+           (double)(sample_count / NUM_CHANNELS) / SAMPLE_RATE_HZ,
+           recording_active ? " (while recording)" : "");
+    
+    playback_begin("(last take)");
+    playback_send_ram(take->samples, sample_count, release_take, take, LOUDNESS_UNKNOWN);
+}
+
 /*******************************************************************************
 * Function Name: handle_delete_file
 ********************************************************************************
@@ -200,8 +557,11 @@ static void handle_delete_file(const char *filename)
     
     printf("Deleting file: %s\r\n", filename);
     
-    /* Delete file from SD card */
+    /* Delete file from SD card, then its peaks */
+    clip_cache_invalidate(filename);
+    loudness_cache_invalidate(filename);
     result = FS_Remove(filename);
+    peak_file_remove(filename);
     if (result == 0) {
         printf("File deleted successfully\r\n");
     } else {
@@ -211,79 +571,1507 @@ static void handle_delete_file(const char *filename)
 }
 
 /*******************************************************************************
-* Function Name: audio_control_task
+* Function Name: handle_get_file
 ********************************************************************************
 * Summary:
-*  Main Audio Control Task - processes commands from CLI and manages audio state
+*  Hand a download request to FileXferTask
 *
 * Parameters:
-*  pvParameters: Task parameters (unused)
+*  cmd_msg: CLI command (filename, optional offset and baud rate)
 *
 * Return:
-*  None (infinite loop)
+*  None
 *
 *******************************************************************************/
-void audio_control_task(void *pvParameters)
+static void handle_get_file(const audio_command_msg_t *cmd_msg)
 {
-    (void)pvParameters;
-    audio_command_msg_t cmd_msg;
-    EventBits_t event_bits;
+    file_xfer_msg_t xfer_msg;
     
-    printf("\r\n=== Audio Control Task Started ===\r\n");
+    if (recording_active) {
+        printf("Error: Stop recording before a transfer\r\n");
+        return;
+    }
     
-    /* Set initial state to IDLE */
-    xEventGroupSetBits(audio_state_events, EVENT_IDLE);
+    memset(&xfer_msg, 0, sizeof(xfer_msg));
+    xfer_msg.direction = XFER_DIR_GET;
+    strncpy(xfer_msg.filename, cmd_msg->filename, sizeof(xfer_msg.filename) - 1);
+    xfer_msg.filename[sizeof(xfer_msg.filename) - 1] = '\0';
+    xfer_msg.offset = (cmd_msg->num_args > 0) ? cmd_msg->args[0] : 0;
+    xfer_msg.baud_rate = (cmd_msg->num_args > 1) ? cmd_msg->args[1] : 0;
     
-    /* Main command processing loop */
-    while (1) {
-        /* Wait for command from CLI (with timeout to check auto-stop) */
-        if (xQueueReceive(audio_cmd_queue, &cmd_msg, pdMS_TO_TICKS(200)) == pdPASS) {
-            
-            /* Process command */
-            switch (cmd_msg.cmd) {
-                case CMD_START_RECORD:
-                    handle_start_record();
-                    break;
-                    
-                case CMD_STOP_RECORD:
-                    handle_stop_record();
-                    break;
-                    
-                case CMD_LIST_FILES:
-                    handle_list_files();
-                    break;
-                    
-                case CMD_PLAY_FILE:
-                    handle_play_file(cmd_msg.filename);
-                    break;
-                    
-                case CMD_DELETE_FILE:
-                    handle_delete_file(cmd_msg.filename);
-                    break;
-                    
-                default:
-                    printf("Unknown command received\r\n");
-                    break;
-            }
-        }
-        
-        /* Check for auto-stop (buffer full during recording) */
-        if (recording_active) {
-            event_bits = xEventGroupGetBits(audio_state_events);
-            
-            /* If recording done but user didn't manually stop */
-            if (event_bits & EVENT_RECORDING_DONE) {
-                printf("[AutoStop] Recording finished (buffer full)\r\n");
-                
-                /* Update state */
-                recording_active = false;
-                
-                /* Clear done flag and return to idle */
-                xEventGroupClearBits(audio_state_events, EVENT_RECORDING_DONE);
-                xEventGroupSetBits(audio_state_events, EVENT_IDLE);
-            }
+    if (xQueueSend(file_xfer_queue, &xfer_msg, pdMS_TO_TICKS(100)) != pdPASS) {
+        printf("Error: Failed to send transfer request\r\n");
+    }
+}
+
+/*******************************************************************************
+* Function Name: handle_put_file
+********************************************************************************
+* Summary:
+*  Hand an upload request to FileXferTask
+*
+* Parameters:
+*  cmd_msg: CLI command (filename, size, optional baud rate)
+*
+* Return:
+*  None
+*
+*******************************************************************************/
+static void handle_put_file(const audio_command_msg_t *cmd_msg)
+{
+    file_xfer_msg_t xfer_msg;
+    
+    if (recording_active) {
+        printf("Error: Stop recording before a transfer\r\n");
+        return;
+    }
+    
+    memset(&xfer_msg, 0, sizeof(xfer_msg));
+    xfer_msg.direction = XFER_DIR_PUT;
+    strncpy(xfer_msg.filename, cmd_msg->filename, sizeof(xfer_msg.filename) - 1);
+    xfer_msg.filename[sizeof(xfer_msg.filename) - 1] = '\0';
+    xfer_msg.file_size = cmd_msg->args[0];
+    xfer_msg.baud_rate = (cmd_msg->num_args > 1) ? cmd_msg->args[1] : 0;
+    
+    if (xQueueSend(file_xfer_queue, &xfer_msg, pdMS_TO_TICKS(100)) != pdPASS) {
+        printf("Error: Failed to send transfer request\r\n");
+    }
+}
+
+/*******************************************************************************
+* Function Name: handle_peaks
+********************************************************************************
+* Summary:
+*  Make sure a WAV file has a current peak sidecar and describe it
+*  - A missing or stale sidecar is rebuilt from the audio
+*  - Prints "PEAKS,<sidecar>,<frames>,<rate>,<channels>" then
+*    ",<frames per entry>,<entries>" per level; with a level argument each
+*    entry of that level follows as "PEAK,<index>,<min>,<max>..." and
+*    "PEAKS_END". tools/xfer.py fetches the sidecar itself with 'get'.
+*
+* Parameters:
+*  cmd_msg: CLI command (WAV filename, optional level)
+*
+* Return:
+*  None
+*
+*******************************************************************************/
+static void handle_peaks(const audio_command_msg_t *cmd_msg)
+{
+    peak_file_header_t header;
+    peak_entry_t entry[PEAK_MAX_CHANNELS];
+    char peak_name[40];
+    FS_FILE *file;
+    
+    if (recording_active) {
+        printf("PEAKS_ERROR,stop recording first\r\n");
+        return;
+    }
+    
+    if (peak_file_check(cmd_msg->filename, &header) != 0) {
+        printf("[Peaks] Rebuilding peaks of %s\r\n", cmd_msg->filename);
+        if ((peak_file_rebuild(cmd_msg->filename, &peak_scratch) != 0) ||
+            (peak_file_check(cmd_msg->filename, &header) != 0)) {
+            printf("PEAKS_ERROR,cannot build peaks for %s\r\n", cmd_msg->filename);
+            return;
         }
     }
+    (void)peak_file_name(cmd_msg->filename, peak_name, sizeof(peak_name));
+    
+    printf("PEAKS,%s,%u,%u,%u", peak_name, (unsigned int)header.frames,
+           (unsigned int)header.sample_rate, (unsigned int)header.num_channels);
+    for (uint32_t level = 0; level < PEAK_NUM_LEVELS; level++) {
+        printf(",%u,%u", (unsigned int)header.level[level].frames_per_entry,
+               (unsigned int)header.level[level].num_entries);
+    }
+    printf("\r\n");
+    
+    if (cmd_msg->num_args == 0) {
+        return;
+    }
+    if (cmd_msg->args[0] >= PEAK_NUM_LEVELS) {
+        printf("PEAKS_ERROR,level must be below %u\r\n", (unsigned int)PEAK_NUM_LEVELS);
+        return;
+    }
+    
+    file = FS_FOpen(peak_name, "r");
+    if (file == NULL) {
+        printf("PEAKS_ERROR,cannot open %s\r\n", peak_name);
+        return;
+    }
+    for (uint32_t i = 0; i < header.level[cmd_msg->args[0]].num_entries; i++) {
+        if (peak_file_read_entry(file, &header, cmd_msg->args[0], i, entry) != 0) {
+            printf("PEAKS_ERROR,read failed at entry %u\r\n", (unsigned int)i);
+            break;
+        }
+        printf("PEAK,%u", (unsigned int)i);
+        for (uint16_t ch = 0; ch < header.num_channels; ch++) {
+            printf(",%d,%d", entry[ch].min, entry[ch].max);
+        }
+        printf("\r\n");
+    }
+    FS_FClose(file);
+    printf("PEAKS_END\r\n");
+}
+
+/*******************************************************************************
+* Function Name: handle_filter
+********************************************************************************
+* Summary:
+*  Change the capture filter settings, then print them
+*  - "filter hpf <hz>" sets the software high-pass cutoff, 0 turns it off
+*  - "filter dc <0..8>" sets the hardware DC blocker code + 1, 0 turns it off
+*  - "filter fir0 <0|1>" moves decimation from the CIC to FIR0
+*  - "filter scale <0..31>" sets the FIR1 output shift
+*  - "filter settle <frames>" sets the frames discarded at the start of a
+*    take while the decimation filters settle; it is the "settle" setting,
+*    so "config save" keeps it
+*
+* Parameters:
+*  cmd_msg: CLI command (setting name in filename, value in args)
+*
+* Return:
+*  None
+*
+*******************************************************************************/
+static void handle_filter(const audio_command_msg_t *cmd_msg)
+{
+    app_pdm_pcm_filter_t filter;
+    uint32_t value = cmd_msg->args[0];
+    
+    app_pdm_pcm_get_filter(&filter);
+    
+    if (cmd_msg->filename[0] != '\0') {
+        if (recording_active) {
+            printf("Error: Stop recording first\r\n");
+            return;
+        }
+        if (cmd_msg->num_args < 1) {
+            printf("Usage: filter [hpf|dc|fir0|scale|settle] <value>\r\n");
+            return;
+        }
+        if (strcmp(cmd_msg->filename, "hpf") == 0) {
+            if ((value != 0u) && ((value < BIQUAD_HPF_MIN_HZ) || (value > BIQUAD_HPF_MAX_HZ))) {
+                printf("Error: Cutoff must be 0 or %u..%u Hz\r\n",
+                       (unsigned int)BIQUAD_HPF_MIN_HZ, (unsigned int)BIQUAD_HPF_MAX_HZ);
+                return;
+            }
+            filter.hpf_hz = (uint16_t)value;
+        } else if (strcmp(cmd_msg->filename, "dc") == 0) {
+            if (value > PDM_PCM_DC_BLOCK_CODE_MAX + 1u) {
+                printf("Error: DC blocker code must be 0..%u\r\n",
+                       (unsigned int)PDM_PCM_DC_BLOCK_CODE_MAX + 1u);
+                return;
+            }
+            filter.dc_block = (value != 0u);
+            if (value != 0u) {
+                filter.dc_block_code = (uint8_t)(value - 1u);
+            }
+        } else if (strcmp(cmd_msg->filename, "fir0") == 0) {
+            filter.fir0 = (value != 0u);
+        } else if (strcmp(cmd_msg->filename, "scale") == 0) {
+            if (value > PDM_PCM_FIR_SCALE_MAX) {
+                printf("Error: Scale must be 0..%u\r\n", (unsigned int)PDM_PCM_FIR_SCALE_MAX);
+                return;
+            }
+            filter.fir1_scale = (uint8_t)value;
+        } else if (strcmp(cmd_msg->filename, "settle") == 0) {
+            char text[SETTINGS_MAX_VALUE_LENGTH];
+            
+            (void)snprintf(text, sizeof(text), "%lu", (unsigned long)value);
+            if (settings_set(settings_find("settle"), text) != 0) {
+                printf("Error: Settle must be 0..%u frames\r\n",
+                       (unsigned int)PDM_PCM_MAX_SETTLE_FRAMES);
+                return;
+            }
+            filter.settle_frames = (uint16_t)value;
+        } else {
+            printf("Usage: filter [hpf|dc|fir0|scale|settle] <value>\r\n");
+            return;
+        }
+        if (app_pdm_pcm_set_filter(&filter) != 0) {
+            printf("Error: PDM channels rejected the settings\r\n");
+            app_pdm_pcm_get_filter(&filter);
+        }
+    }
+    
+    printf("Filter: DC blocker %s", filter.dc_block ? "on" : "off");
+    if (filter.dc_block) {
+        printf(" (code %u)", (unsigned int)(1u << filter.dc_block_code));
+    }
+    printf(", decimation %s, FIR1 scale %u, high-pass ",
+           filter.fir0 ? "CIC/16 FIR0/2 FIR1/3" : "CIC/32 FIR1/3", (unsigned int)filter.fir1_scale);
+    if (filter.hpf_hz != 0u) {
+        printf("%u Hz", (unsigned int)filter.hpf_hz);
+    } else {
+        printf("off");
+    }
+    printf(", settle %u frames\r\n", (unsigned int)filter.settle_frames);
+}
+
+/*******************************************************************************
+* Function Name: handle_segment
+********************************************************************************
+* Summary:
+*  Change the silence trimming/splitting settings, then print them
+*  - "segment off|trim|split [gap_ms] [level_db]" sets the mode
+*  - "segment pad <pre_ms> <post_ms>" sets the padding around activity
+*
+* Parameters:
+*  cmd_msg: CLI command (mode or "pad" in filename, numbers in args)
+*
+* Return:
+*  None
+*
+*******************************************************************************/
+static void handle_segment(const audio_command_msg_t *cmd_msg)
+{
+    static const char *const mode_names[] = { "off", "trim", "split" };
+    const uint32_t block_ms = (SEGMENT_BLOCK_FRAMES * 1000u) / SAMPLE_RATE_HZ;
+    segment_config_t config;
+    
+    segment_config_get(&config);
+    
+    if (cmd_msg->filename[0] != '\0') {
+        if (strcmp(cmd_msg->filename, "pad") == 0) {
+            if (cmd_msg->num_args < 2) {
+                printf("Usage: segment pad <pre_ms> <post_ms>\r\n");
+                return;
+            }
+            config.pre_pad_ms = cmd_msg->args[0];
+            config.post_pad_ms = cmd_msg->args[1];
+        } else {
+            uint32_t mode;
+            for (mode = 0; mode < 3u; mode++) {
+                if (strcmp(cmd_msg->filename, mode_names[mode]) == 0) {
+                    break;
+                }
+            }
+            if (mode == 3u) {
+                printf("Usage: segment [off|trim|split] [gap_ms] [level_db]\r\n");
+                return;
+            }
+            config.mode = (segment_mode_t)mode;
+            if (cmd_msg->num_args > 0) {
+                config.gap_ms = cmd_msg->args[0];
+            }
+            if (cmd_msg->num_args > 1) {
+                config.level_db = cmd_msg->args[1];
+            }
+        }
+        if (segment_config_set(&config) != 0) {
+            printf("Error: Gap must be above 0 and level 1..%u dB\r\n",
+                   (unsigned int)SEGMENT_MAX_LEVEL_DB);
+            return;
+        }
+    }
+    
+    printf("Segment: %s, active above -%u dBFS, split after %u ms of silence, "
+           "pad %u ms before / %u ms after\r\n",
+           mode_names[config.mode], (unsigned int)config.level_db, (unsigned int)config.gap_ms,
+           (unsigned int)config.pre_pad_ms, (unsigned int)config.post_pad_ms);
+    if (config.pre_pad_ms > block_ms) {
+        printf("  (padding before activity is limited to one %u ms block)\r\n",
+               (unsigned int)block_ms);
+    }
+    if ((config.mode == SEGMENT_MODE_SPLIT) && (config.post_pad_ms > config.gap_ms)) {
+        printf("  (padding after activity is limited to the gap)\r\n");
+    }
+}
+
+/*******************************************************************************
+* Function Name: handle_comp
+********************************************************************************
+* Summary:
+*  Change the capture compressor settings, then print them; they apply from
+*  the next recording
+*  - "comp on|off [threshold_db] [ratio]" switches it and sets the curve
+*  - "comp time <attack_ms> <release_ms> [lookahead_ms]" sets the timing
+*  - "comp limit <ceiling_db> [makeup_db]" sets the output ceiling and the
+*    gain applied before the threshold and ceiling
+*  - "comp trace|notrace" keeps the gain reduction in each file, or not
+*
+* Parameters:
+*  cmd_msg: CLI command (setting name in filename, numbers in args)
+*
+* Return:
+*  None
+*
+*******************************************************************************/
+static void handle_comp(const audio_command_msg_t *cmd_msg)
+{
+    compressor_config_t config;
+    const char *name = cmd_msg->filename;
+    
+    compressor_config_get(&config);
+    
+    if (name[0] != '\0') {
+        if ((strcmp(name, "on") == 0) || (strcmp(name, "off") == 0)) {
+            config.enabled = (strcmp(name, "on") == 0);
+            if (cmd_msg->num_args > 0) {
+                config.threshold_db = cmd_msg->args[0];
+            }
+            if (cmd_msg->num_args > 1) {
+                config.ratio = cmd_msg->args[1];
+            }
+        } else if (strcmp(name, "time") == 0) {
+            if (cmd_msg->num_args < 2) {
+                printf("Usage: comp time <attack_ms> <release_ms> [lookahead_ms]\r\n");
+                return;
+            }
+            config.attack_ms = cmd_msg->args[0];
+            config.release_ms = cmd_msg->args[1];
+            if (cmd_msg->num_args > 2) {
+                config.lookahead_ms = cmd_msg->args[2];
+            }
+        } else if (strcmp(name, "limit") == 0) {
+            if (cmd_msg->num_args < 1) {
+                printf("Usage: comp limit <ceiling_db> [makeup_db]\r\n");
+                return;
+            }
+            config.ceiling_db = cmd_msg->args[0];
+            if (cmd_msg->num_args > 1) {
+                config.makeup_db = cmd_msg->args[1];
+            }
+        } else if ((strcmp(name, "trace") == 0) || (strcmp(name, "notrace") == 0)) {
+            config.trace = (strcmp(name, "trace") == 0);
+        } else {
+            printf("Usage: comp [on|off] [threshold_db] [ratio], comp trace|notrace,\r\n"
+                   "       comp time <attack_ms> <release_ms> [lookahead_ms],\r\n"
+                   "       comp limit <ceiling_db> [makeup_db]\r\n");
+            return;
+        }
+        if (compressor_config_set(&config) != 0) {
+            printf("Error: Threshold up to %u dB, ratio 1..%u, attack 1..%u ms, release %u..%u ms, "
+                   "look-ahead up to %u ms, ceiling up to %u dB, makeup up to %u dB\r\n",
+                   (unsigned int)COMP_MAX_THRESHOLD_DB, (unsigned int)COMP_MAX_RATIO,
+                   (unsigned int)COMP_MAX_ATTACK_MS, (unsigned int)COMP_MIN_RELEASE_MS,
+                   (unsigned int)COMP_MAX_RELEASE_MS, (unsigned int)COMP_MAX_LOOKAHEAD_MS,
+                   (unsigned int)COMP_MAX_CEILING_DB, (unsigned int)COMP_MAX_MAKEUP_DB);
+            return;
+        }
+    }
+    
+    printf("Compressor: %s, -%u dBFS %u:1, attack %u ms, release %u ms, look-ahead %u ms\r\n",
+           config.enabled ? "on" : "off", (unsigned int)config.threshold_db,
+           (unsigned int)config.ratio, (unsigned int)config.attack_ms,
+           (unsigned int)config.release_ms, (unsigned int)config.lookahead_ms);
+    printf("  Limiter: -%u dBFS ceiling, makeup +%u dB, gain reduction trace %s\r\n",
+           (unsigned int)config.ceiling_db, (unsigned int)config.makeup_db,
+           config.trace ? "saved" : "off");
+}
+
+/*******************************************************************************
+* Function Name: handle_time
+********************************************************************************
+* Summary:
+*  Set the wall clock if a date and time were given, then print it
+*
+* Parameters:
+*  cmd_msg: CLI command; args[0] = YYYYMMDD, args[1] = HHMMSS when setting
+*
+* Return:
+*  None
+*
+*******************************************************************************/
+static void handle_time(const audio_command_msg_t *cmd_msg)
+{
+    wall_clock_time_t now;
+    
+    if (cmd_msg->num_args == 2) {
+        memset(&now, 0, sizeof(now));
+        now.year = (uint16_t)(cmd_msg->args[0] / 10000u);
+        now.month = (uint8_t)((cmd_msg->args[0] / 100u) % 100u);
+        now.day = (uint8_t)(cmd_msg->args[0] % 100u);
+        now.hour = (uint8_t)(cmd_msg->args[1] / 10000u);
+        now.minute = (uint8_t)((cmd_msg->args[1] / 100u) % 100u);
+        now.second = (uint8_t)(cmd_msg->args[1] % 100u);
+        if (wall_clock_set(&now) != 0) {
+            printf("Error: Invalid date or time\r\n");
+            return;
+        }
+    }
+    
+    wall_clock_get(&now);
+    printf("%04u-%02u-%02u %02u:%02u:%02u%s\r\n",
+           (unsigned int)now.year, (unsigned int)now.month, (unsigned int)now.day,
+           (unsigned int)now.hour, (unsigned int)now.minute, (unsigned int)now.second,
+           now.valid ? "" : " (not set)");
+}
+
+/*******************************************************************************
+* Function Name: handle_status
+********************************************************************************
+* Summary:
+*  Print the state of the capture and playback sessions and of the capture
+*  buffer pool
+*
+* Parameters:
+*  None
+*
+* Return:
+*  None
+*
+*******************************************************************************/
+static void handle_status(void)
+{
+    audio_record_status_t record;
+    playback_status_t playback;
+    capture_pool_status_t pool;
+    
+    audio_record_get_status(&record);
+    playback_get_status(&playback);
+    
+    capture_pool_get_status(&pool);
+    
+    printf("Capture:  %s, %.2f s", record.active ? "recording" : "idle",
+           (double)record.frames / SAMPLE_RATE_HZ);
+    if (record.target_frames != 0u) {
+        printf(" of %lu frames", (unsigned long)record.target_frames);
+    }
+    printf(", PDM faults %u\r\n", (unsigned int)record.pdm_faults);
+    printf("Pool:     %u of %u blocks free, next take up to %.1f s, %u held, exhausted %u\r\n",
+           (unsigned int)pool.free_blocks, (unsigned int)CAPTURE_POOL_BLOCKS,
+           (double)(pool.largest_free * CAPTURE_POOL_BLOCK_SAMPLES / NUM_CHANNELS) / SAMPLE_RATE_HZ,
+           (unsigned int)pool.takes, (unsigned int)pool.exhausted);
+    if (playback_busy()) {
+        printf("Playback: playing %s", playback_filename);
+    } else {
+        printf("Playback: idle");
+        if (playback_filename[0] != '\0') {
+            printf(", last %s", playback_filename);
+        }
+    }
+    printf(", %.2f s, starved refills %u, FIFO underflows %u\r\n",
+           (double)(playback.samples / NUM_CHANNELS) / SAMPLE_RATE_HZ,
+           (unsigned int)playback.starved_refills, (unsigned int)playback.fifo_underflows);
+}
+
+/*******************************************************************************
+* Function Name: handle_cache
+********************************************************************************
+* Summary:
+*  Show the clip cache statistics and contents, or empty it
+*
+* Parameters:
+*  cmd_msg: CLI command ("clear" or nothing)
+*
+* Return:
+*  None
+*
+*******************************************************************************/
+static void handle_cache(const audio_command_msg_t *cmd_msg)
+{
+    clip_cache_stats_t stats;
+    uint32_t lookups;
+    
+    if (strcmp(cmd_msg->filename, "clear") == 0) {
+        clip_cache_clear();
+        printf("Clip cache cleared\r\n");
+        return;
+    }
+    if (cmd_msg->filename[0] != '\0') {
+        printf("Usage: cache [clear]\r\n");
+        return;
+    }
+    
+    clip_cache_get_stats(&stats);
+    lookups = stats.hits + stats.misses;
+    printf("Clip cache: %u clips, %u of %u KB\r\n", (unsigned int)stats.clips,
+           (unsigned int)(stats.bytes / 1024u), (unsigned int)(CLIP_CACHE_BYTES / 1024u));
+    printf("  hits %u, misses %u (%u%% hit), fills %u, skipped %u, evictions %u, "
+           "invalidations %u\r\n",
+           (unsigned int)stats.hits, (unsigned int)stats.misses,
+           (unsigned int)((lookups > 0u) ? ((100u * (uint64_t)stats.hits) / lookups) : 0u),
+           (unsigned int)stats.fills, (unsigned int)stats.skipped,
+           (unsigned int)stats.evictions, (unsigned int)stats.invalidations);
+    clip_cache_list();
+}
+
+/*******************************************************************************
+* Function Name: handle_gen
+********************************************************************************
+* Summary:
+*  Play a test signal through the playback path, or stop it
+*  - The I2S ISR renders each FIFO refill from the generator, so the signal
+*    needs no buffer, file or card, and its length is exact to the frame
+*  - Durations are in ms (SAMPLE_RATE_HZ / 1000 frames each); 0 plays until
+*    "gen stop", except for a sweep
+*  - "gen stop" fades the signal out before it ends
+*
+* Parameters:
+*  cmd_msg: CLI command (signal type or "stop" in filename, numbers in args)
+*
+* Return:
+*  None
+*
+*******************************************************************************/
+static void handle_gen(const audio_command_msg_t *cmd_msg)
+{
+    siggen_config_t config;
+    const uint32_t *args = cmd_msg->args;
+    uint32_t num_args = cmd_msg->num_args;
+    uint32_t first = 0;                 /* Index of the optional [ms] argument */
+    uint32_t length_ms;
+    uint64_t frames;
+    pcm_playback_msg_t pcm_msg;
+    
+    if (strcmp(cmd_msg->filename, "stop") == 0) {
+        if (test_signal.active) {
+            (void)output_ctrl_fade_out();
+            siggen_stop(&test_signal);
+            printf("Test signal stopped\r\n");
+        } else {
+            printf("No test signal playing\r\n");
+        }
+        return;
+    }
+    
+    memset(&config, 0, sizeof(config));
+    if (strcmp(cmd_msg->filename, "tone") == 0) {
+        config.type = SIGGEN_TONE;
+        config.freq_hz = args[0];
+        first = 1;
+    } else if (strcmp(cmd_msg->filename, "sweep") == 0) {
+        config.type = SIGGEN_SWEEP;
+        config.freq_hz = args[0];
+        config.end_freq_hz = args[1];
+        first = 2;
+    } else if (strcmp(cmd_msg->filename, "noise") == 0) {
+        config.type = SIGGEN_WHITE;
+    } else if (strcmp(cmd_msg->filename, "pink") == 0) {
+        config.type = SIGGEN_PINK;
+    } else if (strcmp(cmd_msg->filename, "click") == 0) {
+        config.type = SIGGEN_CLICK;
+        config.period_frames = args[0] * (SAMPLE_RATE_HZ / 1000u);
+        first = 1;
+    } else {
+        if (test_signal.active) {
+            printf("Test signal: %s, %.3f s played\r\n", siggen_type_name(test_signal.type),
+                   (double)test_signal.position / SAMPLE_RATE_HZ);
+        }
+        printf("Usage: gen tone <hz> [ms] [atten_db]\r\n"
+               "       gen sweep <from_hz> <to_hz> <ms> [atten_db]\r\n"
+               "       gen noise|pink [ms] [atten_db]\r\n"
+               "       gen click <period_ms> [ms] [atten_db]\r\n"
+               "       gen stop\r\n");
+        return;
+    }
+    
+    if ((num_args < first) || ((config.type == SIGGEN_SWEEP) && (num_args < 3u))) {
+        printf("Error: Missing arguments, see 'gen'\r\n");
+        return;
+    }
+    length_ms = (num_args > first) ? args[first] : GEN_DEFAULT_MS;
+    config.atten_db = (num_args > first + 1u) ? args[first + 1u] : GEN_DEFAULT_ATTEN_DB;
+    frames = ((uint64_t)length_ms * SAMPLE_RATE_HZ) / 1000u;
+    if (length_ms == 0u) {
+        frames = SIGGEN_CONTINUOUS;
+    } else if (frames >= SIGGEN_CONTINUOUS) {
+        printf("Error: Signal too long\r\n");
+        return;
+    }
+    config.frames = (uint32_t)frames;
+    
+    if (playback_busy()) {
+        printf("Already playing %s. Wait for it to finish.\r\n", playback_filename);
+        return;
+    }
+    if (siggen_init(&test_signal, &config, SAMPLE_RATE_HZ) != 0) {
+        printf("Error: Frequencies must be 1..%u Hz, a sweep needs a length, "
+               "attenuation up to %u dB\r\n",
+               (unsigned int)(SAMPLE_RATE_HZ / 2u - 1u), (unsigned int)SIGGEN_MAX_ATTEN_DB);
+        return;
+    }
+    
+    printf("Playing %s at -%u dBFS peak", siggen_type_name(config.type), (unsigned int)config.atten_db);
+    if (length_ms != 0u) {
+        printf(" for %u frames", (unsigned int)config.frames);
+    } else {
+        printf(" until 'gen stop'");
+    }
+    printf("%s\r\n", recording_active ? " (while recording)" : "");
+    
+    playback_begin(siggen_type_name(config.type));
+    pcm_msg.buffer_ptr = NULL;
+    pcm_msg.sample_count = (length_ms != 0u) ? (config.frames * 2u) : 0u;
+    pcm_msg.is_last_chunk = true;
+    pcm_msg.release = release_signal;
+    pcm_msg.owner = &test_signal;
+    pcm_msg.render = render_signal;
+    pcm_msg.loudness = LOUDNESS_UNKNOWN;
+    if (xQueueSend(pcm_playback_queue, &pcm_msg, pdMS_TO_TICKS(100)) != pdPASS) {
+        printf("Error: Failed to send test signal to PlaybackTask\r\n");
+        release_signal(&test_signal);
+        xEventGroupClearBits(audio_state_events, EVENT_PLAYING);
+        update_idle_state();
+    }
+}
+
+/*******************************************************************************
+* Function Name: handle_latency
+********************************************************************************
+* Summary:
+*  Measure the speaker to mic round trip in this task while the audio paths
+*  are idle; the stimulus and capture bypass the playback and record tasks
+*
+* Parameters:
+*  cmd_msg: CLI command (optional trials and level in args)
+*
+* Return:
+*  None
+*
+*******************************************************************************/
+static void handle_latency(const audio_command_msg_t *cmd_msg)
+{
+    if (recording_active || playback_busy()) {
+        printf("Error: Stop recording and playback before measuring latency\r\n");
+        return;
+    }
+    
+    (void)latency_run((cmd_msg->num_args > 0) ? cmd_msg->args[0] : 0,
+                      (cmd_msg->num_args > 1) ? cmd_msg->args[1] : LATENCY_DEFAULT_ATTEN_DB);
+}
+
+/*******************************************************************************
+* Function Name: isr_cycles_to_ns
+********************************************************************************
+* Summary:
+*  Cycle count as ns at the core clock
+*
+*******************************************************************************/
+static unsigned long isr_cycles_to_ns(uint64_t cycles)
+{
+    return (unsigned long)((cycles * 1000000000ull) / SystemCoreClock);
+}
+
+/*******************************************************************************
+* Function Name: handle_isr
+********************************************************************************
+* Summary:
+*  Show the time spent in the PDM and I2S interrupts and the jitter of their
+*  entry, or clear the counts
+*  - Counted from boot or the last "isr reset"; reset once a stream runs to
+*    leave the gap before it out of the interval range
+*  - The first line names the code placement, so the output of a default
+*    build and an AUDIO_XIP_ONLY build can be compared
+*
+* Parameters:
+*  cmd_msg: CLI command ("reset" or nothing)
+*
+* Return:
+*  None
+*
+*******************************************************************************/
+static void handle_isr(const audio_command_msg_t *cmd_msg)
+{
+    if (strcmp(cmd_msg->filename, "reset") == 0) {
+        isr_timing_reset();
+        printf("ISR timing cleared\r\n");
+        return;
+    }
+    if (cmd_msg->filename[0] != '\0') {
+        printf("Usage: isr [reset]\r\n");
+        return;
+    }
+    if (!isr_timing_start()) {
+        printf("Error: DWT cycle counter not running\r\n");
+        return;
+    }
+    
+#if defined(AUDIO_XIP_ONLY)
+    printf("ISR timing, audio code in XIP flash, %lu Hz core clock\r\n",
+           (unsigned long)SystemCoreClock);
+#else
+    printf("ISR timing, audio code in SRAM, %lu Hz core clock\r\n",
+           (unsigned long)SystemCoreClock);
+#endif
+    for (uint32_t id = 0; id < ISR_TIMING_COUNT; id++) {
+        isr_timing_t timing;
+        
+        isr_timing_get((isr_timing_id_t)id, &timing);
+        printf("  %s: %lu entries", isr_timing_name((isr_timing_id_t)id),
+               (unsigned long)timing.count);
+        if (timing.count == 0u) {
+            printf("\r\n");
+            continue;
+        }
+        printf(", inside mean %lu max %lu ns",
+               isr_cycles_to_ns(timing.total_cycles / timing.count),
+               isr_cycles_to_ns(timing.max_cycles));
+        if (timing.intervals > 0u) {
+            printf(", interval %lu..%lu ns (mean %lu), jitter %lu ns",
+                   isr_cycles_to_ns(timing.min_interval), isr_cycles_to_ns(timing.max_interval),
+                   isr_cycles_to_ns(timing.total_interval / timing.intervals),
+                   isr_cycles_to_ns(timing.max_interval - timing.min_interval));
+        }
+        printf("\r\n");
+    }
+}
+
+/*******************************************************************************
+* Function Name: eq_show
+********************************************************************************
+* Summary:
+*  Print the playback DSP settings and the cost of the current or last play
+*
+*******************************************************************************/
+static void eq_show(void)
+{
+    playback_dsp_config_t config;
+    playback_dsp_status_t status;
+    
+    playback_dsp_get_config(&config);
+    playback_dsp_get_status(&status);
+    
+    printf("Playback DSP: %s, %u bands, preamp %.1f dB\r\n", status.active ? "on" : "bypassed",
+           (unsigned int)status.bands, (double)status.preamp_db);
+    for (uint32_t b = 0; b < PLAYBACK_DSP_MAX_BANDS; b++) {
+        const playback_dsp_band_t *band = &config.band[b];
+        
+        if (band->enabled) {
+            printf("  %u: %-9s %5u Hz %+4d dB  q %.2f\r\n", (unsigned int)(b + 1u),
+                   playback_dsp_type_name(band->type), (unsigned int)band->freq_hz,
+                   (int)band->gain_db, (double)band->q_x100 / 100.0);
+        }
+    }
+    printf("  Normalizer: ");
+    if (config.normalize) {
+        printf("-%u LUFS", (unsigned int)config.target_lu);
+    } else {
+        printf("off");
+    }
+    printf(", limiter: ");
+    if (config.limit) {
+        printf("-%u dBFS ceiling\r\n", (unsigned int)config.ceiling_db);
+    } else {
+        printf("off\r\n");
+    }
+    printf("  Loudness cache: %u files\r\n", (unsigned int)loudness_cache_count());
+    
+    if (status.refills == 0u) {
+        return;
+    }
+    printf("  Last play: ");
+    if (status.loudness > LOUDNESS_UNKNOWN) {
+        printf("%.1f LUFS, ", (double)status.loudness);
+    }
+    printf("gain %+.1f dB, limited up to %.1f dB, %u samples clipped\r\n",
+           (double)status.gain_db, (double)status.reduction_db, (unsigned int)status.clipped);
+    printf("  Cost: %u refills, max %u cycles of a %u budget (%u%% of a refill), %u over\r\n",
+           (unsigned int)status.refills, (unsigned int)status.max_cycles,
+           (unsigned int)status.budget_cycles, (unsigned int)PLAYBACK_DSP_BUDGET_PERCENT,
+           (unsigned int)status.over_budget);
+    if (status.max_cycles == 0u) {
+        printf("  (Cycle counts need the DWT counter; run 'bench' once to start it)\r\n");
+    }
+}
+
+/*******************************************************************************
+* Function Name: handle_eq
+********************************************************************************
+* Summary:
+*  Show or change the playback DSP chain; changes apply at once, also to a
+*  file that is playing
+*  - Bands are numbered 1..PLAYBACK_DSP_MAX_BANDS; lowpass and highpass
+*    ignore the gain, a shelf takes q as its slope
+*  - The normalizer level and limiter ceiling are dB below full scale
+*
+* Parameters:
+*  cmd_msg: CLI command (the text after "eq" in filename)
+*
+* Return:
+*  None
+*
+*******************************************************************************/
+static void handle_eq(const audio_command_msg_t *cmd_msg)
+{
+    playback_dsp_config_t config;
+    char word[16];
+    char setting[16];
+    unsigned long number;
+    long freq_hz;
+    long gain_db;
+    unsigned long q_x100 = PLAYBACK_DSP_DEFAULT_Q_X100;
+    int count;
+    
+    playback_dsp_get_config(&config);
+    count = sscanf(cmd_msg->filename, "%15s %15s", word, setting);
+    
+    if (count < 1) {
+        eq_show();
+        return;
+    } else if (strcmp(word, "clear") == 0) {
+        for (uint32_t b = 0; b < PLAYBACK_DSP_MAX_BANDS; b++) {
+            config.band[b].enabled = false;
+        }
+    } else if ((count == 2) && ((strcmp(word, "norm") == 0) || (strcmp(word, "limit") == 0))) {
+        bool on = (strcmp(setting, "off") != 0);
+        
+        if (on && ((sscanf(setting, "%lu", &number) != 1) || (number > UINT8_MAX))) {
+            printf("Usage: eq norm <off|lu>, eq limit <off|db>\r\n");
+            return;
+        }
+        if (strcmp(word, "norm") == 0) {
+            config.normalize = on;
+            config.target_lu = on ? (uint8_t)number : config.target_lu;
+        } else {
+            config.limit = on;
+            config.ceiling_db = on ? (uint8_t)number : config.ceiling_db;
+        }
+    } else if ((count == 2) && (sscanf(word, "%lu", &number) == 1) &&
+               (number >= 1u) && (number <= PLAYBACK_DSP_MAX_BANDS)) {
+        playback_dsp_band_t *band = &config.band[number - 1u];
+        uint32_t type;
+        
+        if (strcmp(setting, "off") == 0) {
+            band->enabled = false;
+        } else {
+            for (type = 0; type <= (uint32_t)BIQUAD_HIGHPASS; type++) {
+                if (strcmp(setting, playback_dsp_type_name((biquad_type_t)type)) == 0) {
+                    break;
+                }
+            }
+            if ((type > (uint32_t)BIQUAD_HIGHPASS) ||
+                (sscanf(cmd_msg->filename, "%*s %*s %ld %ld %lu", &freq_hz, &gain_db, &q_x100) < 2)) {
+                printf("Usage: eq <band> peak|lowshelf|highshelf|lowpass|highpass "
+                       "<hz> <gain_db> [q_x100]\r\n");
+                return;
+            }
+            if ((freq_hz < 0) || (freq_hz > UINT16_MAX) ||
+                (gain_db < -BIQUAD_MAX_GAIN_DB) || (gain_db > BIQUAD_MAX_GAIN_DB) ||
+                (q_x100 > UINT16_MAX)) {
+                printf("Error: Gain must be within +/-%d dB\r\n", BIQUAD_MAX_GAIN_DB);
+                return;
+            }
+            band->enabled = true;
+            band->type = (biquad_type_t)type;
+            band->freq_hz = (uint16_t)freq_hz;
+            band->gain_db = (int8_t)gain_db;
+            band->q_x100 = (uint16_t)q_x100;
+        }
+    } else {
+        printf("Usage: eq <band> <type> <hz> <gain_db> [q_x100], eq <band> off, eq clear,\r\n"
+               "       eq norm <off|lu>, eq limit <off|db>\r\n");
+        return;
+    }
+    
+    if (playback_dsp_set_config(&config) != 0) {
+        printf("Error: Bands take %u..%u Hz and q_x100 %u..%u (a steep shelf needs a "
+               "lower slope), norm %u..%u LU, limit up to %u dB\r\n",
+               (unsigned int)BIQUAD_MIN_HZ, (unsigned int)(SAMPLE_RATE_HZ * 45u / 100u),
+               (unsigned int)(BIQUAD_MIN_Q * 100.0f), (unsigned int)(BIQUAD_MAX_Q * 100.0f),
+               (unsigned int)PLAYBACK_DSP_MIN_TARGET_LU, (unsigned int)PLAYBACK_DSP_MAX_TARGET_LU,
+               (unsigned int)PLAYBACK_DSP_MAX_CEILING_DB);
+        return;
+    }
+    eq_show();
+}
+
+/*******************************************************************************
+* Function Name: handle_bench
+********************************************************************************
+* Summary:
+*  Run benchmarks in this task while the audio paths are idle
+*
+* Parameters:
+*  cmd_msg: CLI command (case name, optional repetitions and irq mode)
+*
+* Return:
+*  None
+*
+*******************************************************************************/
+static void handle_bench(const audio_command_msg_t *cmd_msg)
+{
+    bench_irq_mode_t irq_mode = BENCH_IRQ_DEFAULT;
+    
+    if (cmd_msg->filename[0] == '\0') {
+        bench_list();
+        return;
+    }
+    
+    if (recording_active || playback_busy()) {
+        printf("Error: Stop recording and playback before benchmarking\r\n");
+        return;
+    }
+    
+    if (cmd_msg->num_args > 1) {
+        irq_mode = (cmd_msg->args[1] != 0) ? BENCH_IRQ_MASKED : BENCH_IRQ_UNMASKED;
+    }
+    
+    (void)bench_run(cmd_msg->filename, (cmd_msg->num_args > 0) ? cmd_msg->args[0] : 0, irq_mode);
+}
+
+/*******************************************************************************
+* Function Name: handle_membench
+********************************************************************************
+* Summary:
+*  Run the memory benchmark in this task while the audio paths are idle
+*
+* Parameters:
+*  cmd_msg: CLI command (the words after "membench" in filename)
+*
+* Return:
+*  None
+*
+*******************************************************************************/
+static void handle_membench(const audio_command_msg_t *cmd_msg)
+{
+    char words[3][8];
+    uint32_t options = 0;
+    int count;
+    
+    count = sscanf(cmd_msg->filename, "%7s %7s %7s", words[0], words[1], words[2]);
+    for (int i = 0; i < count; i++) {
+        if (strcmp(words[i], "cm33") == 0) {
+            options |= MEMBENCH_OPT_CM33;
+        } else if (strcmp(words[i], "cm55") == 0) {
+            options |= MEMBENCH_OPT_CM55;
+        } else if (strcmp(words[i], "all") == 0) {
+            options |= MEMBENCH_OPT_CM33 | MEMBENCH_OPT_CM55;
+        } else if (strcmp(words[i], "load") == 0) {
+            options |= MEMBENCH_OPT_LOAD;
+        } else if (strcmp(words[i], "save") == 0) {
+            options |= MEMBENCH_OPT_SAVE;
+        } else {
+            options = 0;
+            break;
+        }
+    }
+    if ((options & (MEMBENCH_OPT_CM33 | MEMBENCH_OPT_CM55)) == 0u) {
+        printf("Usage: membench <cm33|cm55|all> [load] [save]\r\n");
+        printf("  load: also with the other core copying SOCMEM\r\n");
+        printf("  save: also write the results to %s\r\n", MEMBENCH_FILENAME);
+        return;
+    }
+    
+    if (recording_active || playback_busy()) {
+        printf("Error: Stop recording and playback before benchmarking\r\n");
+        return;
+    }
+    
+    (void)membench_run(options);
+}
+
+/*******************************************************************************
+* Function Name: handle_codec
+********************************************************************************
+* Summary:
+*  Codec register cache: statistics, a readback check, or one register read
+*  from the shadow or written through it
+*
+* Parameters:
+*  cmd_msg: CLI command (the words after "codec" in filename)
+*
+* Return:
+*  None
+*
+*******************************************************************************/
+static void handle_codec(const audio_command_msg_t *cmd_msg)
+{
+    codec_ctrl_stats_t stats;
+    unsigned long page;
+    unsigned long reg;
+    long value = 0;
+    uint8_t current;
+    int count;
+    int differ;
+    
+    if (cmd_msg->filename[0] == '\0') {
+        codec_ctrl_get_stats(&stats);
+        printf("Codec register cache: %s\r\n", stats.ready ? "ready" : "not ready");
+        printf("  Writes: %lu requested, %lu redundant, %lu merged, %lu pending\r\n",
+               (unsigned long)stats.requested, (unsigned long)stats.redundant,
+               (unsigned long)stats.merged, (unsigned long)stats.pending);
+        printf("  I2C: %lu transactions (%lu page selects), %lu bytes, %lu errors%s\r\n",
+               (unsigned long)stats.transactions, (unsigned long)stats.page_selects,
+               (unsigned long)stats.bytes, (unsigned long)stats.errors,
+               stats.busy ? ", busy" : "");
+        return;
+    }
+    
+    if (strcmp(cmd_msg->filename, "verify") == 0) {
+        differ = codec_ctrl_verify();
+        if (differ < 0) {
+            printf("Error: Codec readback failed\r\n");
+        } else {
+            printf("Codec matches the shadow%s (%d registers differ)\r\n",
+                   (differ == 0) ? "" : " except as listed", differ);
+        }
+        return;
+    }
+    
+    count = sscanf(cmd_msg->filename, "%lu %lu %li", &page, &reg, &value);
+    if ((count < 2) || (page >= CODEC_CTRL_PAGES) || (reg == 0u) ||
+        (reg >= CODEC_CTRL_PAGE_REGS) || ((count == 3) && ((value < 0) || (value > 0xFF)))) {
+        printf("Usage: codec [verify] | codec <page> <reg> [value]\r\n");
+        printf("  page 0-%u, reg 1-%u, value 0-255 (0x.. for hex)\r\n",
+               (unsigned int)(CODEC_CTRL_PAGES - 1u), (unsigned int)(CODEC_CTRL_PAGE_REGS - 1u));
+        return;
+    }
+    
+    if (count == 3) {
+        if (codec_ctrl_write(CODEC_REG(page, reg), (uint8_t)value) != 0) {
+            printf("Error: Codec register cache not ready\r\n");
+        } else if (codec_ctrl_sync(CODEC_CTRL_SYNC_TIMEOUT_MS) != 0) {
+            printf("Error: Codec write still pending, see 'codec'\r\n");
+        } else {
+            printf("P%lu R%lu = 0x%02lX\r\n", page, reg, (unsigned long)value);
+        }
+        return;
+    }
+    
+    if (codec_ctrl_read(CODEC_REG(page, reg), &current) != 0) {
+        printf("P%lu R%lu: not in the shadow (status register or no readback)\r\n", page, reg);
+    } else {
+        printf("P%lu R%lu = 0x%02X\r\n", page, reg, (unsigned int)current);
+    }
+}
+
+/*******************************************************************************
+* Function Name: handle_output_show
+********************************************************************************
+* Summary:
+*  Print the playback volume, mute state and route
+*
+*******************************************************************************/
+static void handle_output_show(void)
+{
+    output_status_t status;
+    
+    output_ctrl_get_status(&status);
+    printf("Output: %ld dB%s, %s", (long)status.volume_db, status.muted ? ", muted" : "",
+           output_route_name(status.route));
+    if (status.running) {
+        printf(", ramp %.2f", (double)status.ramp_gain);
+    }
+    printf(" (%u fades, %u codec errors)\r\n", (unsigned int)status.fades,
+           (unsigned int)status.codec_errors);
+}
+
+/*******************************************************************************
+* Function Name: handle_volume
+********************************************************************************
+* Summary:
+*  Show or set the playback volume; it is the "volume" setting, so
+*  "config save" keeps it
+*
+* Parameters:
+*  cmd_msg: CLI command (the level in filename, if any)
+*
+* Return:
+*  None
+*
+*******************************************************************************/
+static void handle_volume(const audio_command_msg_t *cmd_msg)
+{
+    if ((cmd_msg->filename[0] != '\0') &&
+        (settings_set(settings_find("volume"), cmd_msg->filename) != 0)) {
+        printf("Usage: vol [db]  (%d..%d, whole dB)\r\n", OUTPUT_MIN_VOLUME_DB,
+               OUTPUT_MAX_VOLUME_DB);
+        return;
+    }
+    handle_output_show();
+}
+
+/*******************************************************************************
+* Function Name: handle_mute
+********************************************************************************
+* Summary:
+*  Fade the playback to silence and mute the DAC, or the reverse
+*
+* Parameters:
+*  cmd_msg: CLI command ("on", "off" or nothing in filename)
+*
+* Return:
+*  None
+*
+*******************************************************************************/
+static void handle_mute(const audio_command_msg_t *cmd_msg)
+{
+    bool mute;
+    
+    if ((cmd_msg->filename[0] == '\0') || (strcmp(cmd_msg->filename, "on") == 0)) {
+        mute = true;
+    } else if (strcmp(cmd_msg->filename, "off") == 0) {
+        mute = false;
+    } else {
+        printf("Usage: mute [on|off]\r\n");
+        return;
+    }
+    if (output_ctrl_set_mute(mute) != 0) {
+        printf("Error: Codec not updated, see 'codec'\r\n");
+    }
+    handle_output_show();
+}
+
+/*******************************************************************************
+* Function Name: handle_route
+********************************************************************************
+* Summary:
+*  Show or switch the output route; it is the "route" setting, so
+*  "config save" keeps it
+*
+* Parameters:
+*  cmd_msg: CLI command (route name in filename, if any)
+*
+* Return:
+*  None
+*
+*******************************************************************************/
+static void handle_route(const audio_command_msg_t *cmd_msg)
+{
+    char value[4];
+    uint32_t route;
+    
+    if (cmd_msg->filename[0] != '\0') {
+        for (route = 0; route < OUTPUT_ROUTE_COUNT; route++) {
+            if (strcmp(cmd_msg->filename, output_route_name((output_route_t)route)) == 0) {
+                break;
+            }
+        }
+        if (route >= OUTPUT_ROUTE_COUNT) {
+            printf("Usage: route [spk|hp|both]\r\n");
+            return;
+        }
+        snprintf(value, sizeof(value), "%u", (unsigned int)route);
+        if (settings_set(settings_find("route"), value) != 0) {
+            printf("Error: Route setting refused\r\n");
+            return;
+        }
+    }
+    handle_output_show();
+}
+
+/*******************************************************************************
+* Function Name: handle_tdm
+********************************************************************************
+* Summary:
+*  Show the TDM slot layout or set the map for the next play; it is the
+*  "tdm_map" setting, so "config save" keeps it
+*  - One letter per slot: L, R, M (the L/R mix) or - (silence); 2, 4 or 8
+*    slots. The codec plays slots 0 and 1.
+*
+* Parameters:
+*  cmd_msg: CLI command (map in filename, if any)
+*
+* Return:
+*  None
+*
+*******************************************************************************/
+static void handle_tdm(const audio_command_msg_t *cmd_msg)
+{
+    tdm_layout_t layout;
+    char map[SETTINGS_TDM_MAP_SIZE];
+    char next[SETTINGS_TDM_MAP_SIZE];
+    
+    if (cmd_msg->filename[0] != '\0') {
+        /* Letters in either case */
+        strncpy(next, cmd_msg->filename, sizeof(next) - 1u);
+        next[sizeof(next) - 1u] = '\0';
+        for (char *c = next; *c != '\0'; c++) {
+            if ((*c >= 'a') && (*c <= 'z')) {
+                *c = (char)(*c - 'a' + 'A');
+            }
+        }
+        if ((strlen(cmd_msg->filename) >= sizeof(next)) ||
+            (settings_set(settings_find("tdm_map"), next) != 0)) {
+            printf("Usage: tdm [map]  (2, 4 or 8 of L, R, M, -)\r\n");
+            return;
+        }
+    }
+    
+    tdm_slots_get_layout(&layout, map, sizeof(map));
+    printf("TDM: %s, %u slots, kernel %s, %u frames per refill (%u us)\r\n", map,
+           (unsigned int)layout.slots, tdm_kernel_name(layout.kernel),
+           (unsigned int)layout.refill_frames,
+           (unsigned int)((layout.refill_frames * 1000000u) / SAMPLE_RATE_HZ));
+    settings_copy_text(app_settings.tdm_map, next, sizeof(next));
+    if (strcmp(next, map) != 0) {
+        printf("  Next play: %s\r\n", next);
+    }
+    if (tdm_slots_codec_errors() != 0u) {
+        printf("  Codec format not switched %u times, see 'codec'\r\n",
+               (unsigned int)tdm_slots_codec_errors());
+    }
+}
+
+/*******************************************************************************
+* Function Name: handle_config_show
+********************************************************************************
+* Summary:
+*  Print one parameter: value, range and when a change takes effect
+*
+*******************************************************************************/
+static void handle_config_show(const setting_desc_t *desc)
+{
+    char value[SETTINGS_MAX_VALUE_LENGTH];
+    
+    settings_format(desc, value, sizeof(value));
+    printf("  %-12s %s%s%s", desc->name, value, (desc->unit[0] != '\0') ? " " : "", desc->unit);
+    if ((desc->flags & SETTING_READ_ONLY) != 0u) {
+        printf(" (fixed at build time)\r\n");
+        return;
+    }
+    if (desc->type == SETTING_INT) {
+        printf(" (%ld..%ld", (long)desc->min, (long)desc->max);
+        if (desc->step > 1) {
+            printf(" in steps of %ld", (long)desc->step);
+        }
+    } else {
+        printf(" (%ld..%ld characters", (long)desc->min, (long)desc->max);
+    }
+    printf("%s%s)\r\n", settings_is_default(desc) ? ", default" : "",
+           ((desc->flags & SETTING_NEXT_SESSION) != 0u) ? ", next session" : "");
+}
+
+/*******************************************************************************
+* Function Name: handle_config
+********************************************************************************
+* Summary:
+*  Show, change or save the persistent settings
+*  - "config [get] [name]" shows one parameter or all of them
+*  - "config set <name> <value>" changes a parameter until the next boot;
+*    buffer sizes apply from the next take, file or playback
+*  - "config save" keeps the current values on the SD card for the next
+*    boot
+*
+* Parameters:
+*  cmd_msg: CLI command (the text after "config" in filename)
+*
+* Return:
+*  None
+*
+*******************************************************************************/
+static void handle_config(const audio_command_msg_t *cmd_msg)
+{
+    char verb[8] = "get";
+    char name[16] = "";
+    char value[SETTINGS_MAX_VALUE_LENGTH] = "";
+    const setting_desc_t *desc = NULL;
+    int count;
+    
+    count = sscanf(cmd_msg->filename, "%7s %15s %15s", verb, name, value);
+    if ((count == 1) && (strcmp(verb, "get") != 0) && (strcmp(verb, "save") != 0) &&
+        (strcmp(verb, "set") != 0)) {
+        strcpy(name, verb);             /* "config <name>" */
+        strcpy(verb, "get");
+    }
+    if (name[0] != '\0') {
+        desc = settings_find(name);
+        if (desc == NULL) {
+            printf("Error: No setting '%s'; 'config' lists them\r\n", name);
+            return;
+        }
+    }
+    
+    if (strcmp(verb, "save") == 0) {
+        if (settings_save() != 0) {
+            printf("Error: Could not save %s\r\n", SETTINGS_FILENAME);
+        } else {
+            printf("Settings saved to %s\r\n", SETTINGS_FILENAME);
+        }
+    } else if (strcmp(verb, "set") == 0) {
+        if ((desc == NULL) || (value[0] == '\0')) {
+            printf("Usage: config set <name> <value>\r\n");
+            return;
+        }
+        if (settings_set(desc, value) != 0) {
+            printf("Error: Invalid value for %s\r\n", desc->name);
+        }
+        handle_config_show(desc);
+    } else if (strcmp(verb, "get") == 0) {
+        if (desc != NULL) {
+            handle_config_show(desc);
+        } else {
+            printf("Settings (%s):\r\n", SETTINGS_FILENAME);
+            for (uint32_t i = 0; i < settings_count(); i++) {
+                handle_config_show(settings_at(i));
+            }
+        }
+    } else {
+        printf("Usage: config [get] [name] | config set <name> <value> | config save\r\n");
+    }
+}
+
+/*******************************************************************************
+* Function Name: audio_control_task
+********************************************************************************
+* Summary:
+*  Main Audio Control Task - processes commands from CLI and manages audio state
+*
+* Parameters:
+*  pvParameters: Task parameters (unused)
+*
+* Return:
+*  None (infinite loop)
+*
+*******************************************************************************/
+void audio_control_task(void *pvParameters)
+{
+    (void)pvParameters;
+    audio_command_msg_t cmd_msg;
+    EventBits_t event_bits;
+    
+    printf("\r\n=== Audio Control Task Started ===\r\n");
+    
+    /* Stored settings, before any session can start */
+    (void)settings_load();
+    
+    /* Cycle counter for the ISR timing; 'isr' reports if it stays stopped */
+    (void)isr_timing_start();
+    
+    /* Set initial state to IDLE */
+    xEventGroupSetBits(audio_state_events, EVENT_IDLE);
+    
+    /* Main command processing loop */
+    while (1) {
+        /* Wait for command from CLI (with timeout to check auto-stop) */
+        if (xQueueReceive(audio_cmd_queue, &cmd_msg, pdMS_TO_TICKS(200)) == pdPASS) {
+            
+            /* Process command */
+            switch (cmd_msg.cmd) {
+                case CMD_START_RECORD:
+                    handle_start_record(&cmd_msg);
+                    break;
+                    
+                case CMD_STOP:
+                    handle_stop();
+                    break;
+                    
+                case CMD_LIST_FILES:
+                    handle_list_files();
+                    break;
+                    
+                case CMD_PLAY_FILE:
+                    handle_play_file(cmd_msg.filename);
+                    break;
+                    
+                case CMD_DELETE_FILE:
+                    handle_delete_file(cmd_msg.filename);
+                    break;
+                    
+                case CMD_GET_FILE:
+                    handle_get_file(&cmd_msg);
+                    break;
+                    
+                case CMD_PUT_FILE:
+                    handle_put_file(&cmd_msg);
+                    break;
+                    
+                case CMD_BENCH:
+                    handle_bench(&cmd_msg);
+                    break;
+                    
+                case CMD_TIME:
+                    handle_time(&cmd_msg);
+                    break;
+                    
+                case CMD_PEAKS:
+                    handle_peaks(&cmd_msg);
+                    break;
+                    
+                case CMD_SEGMENT:
+                    handle_segment(&cmd_msg);
+                    break;
+                    
+                case CMD_FILTER:
+                    handle_filter(&cmd_msg);
+                    break;
+                    
+                case CMD_STATUS:
+                    handle_status();
+                    break;
+                    
+                case CMD_REPLAY:
+                    handle_replay();
+                    break;
+                    
+                case CMD_CACHE:
+                    handle_cache(&cmd_msg);
+                    break;
+                    
+                case CMD_GEN:
+                    handle_gen(&cmd_msg);
+                    break;
+                    
+                case CMD_LATENCY:
+                    handle_latency(&cmd_msg);
+                    break;
+                    
+                case CMD_EQ:
+                    handle_eq(&cmd_msg);
+                    break;
+                    
+                case CMD_COMP:
+                    handle_comp(&cmd_msg);
+                    break;
+                    
+                case CMD_CONFIG:
+                    handle_config(&cmd_msg);
+                    break;
+                    
+                case CMD_ISR:
+                    handle_isr(&cmd_msg);
+                    break;
+                    
+                case CMD_MEMBENCH:
+                    handle_membench(&cmd_msg);
+                    break;
+                    
+                case CMD_CODEC:
+                    handle_codec(&cmd_msg);
+                    break;
+                    
+                case CMD_VOLUME:
+                    handle_volume(&cmd_msg);
+                    break;
+                    
+                case CMD_MUTE:
+                    handle_mute(&cmd_msg);
+                    break;
+                    
+                case CMD_ROUTE:
+                    handle_route(&cmd_msg);
+                    break;
+                    
+                case CMD_TDM:
+                    handle_tdm(&cmd_msg);
+                    break;
+                    
+                default:
+                    printf("Unknown command received\r\n");
+                    break;
+            }
+        }
+        
+        /* Check for auto-stop (buffer full during recording) */
+        if (recording_active) {
+            event_bits = xEventGroupGetBits(audio_state_events);
+            
+            /* If recording done but user didn't manually stop */
+            if (event_bits & EVENT_RECORDING_DONE) {
+                audio_record_status_t status;
+                
+                audio_record_get_status(&status);
+                if (status.target_frames != 0u) {
+                    printf("[AutoStop] Recording finished (%lu frames)\r\n",
+                           (unsigned long)status.target_frames);
+                } else {
+                    printf("[AutoStop] Recording finished (buffer full)\r\n");
+                }
+                
+                /* Update state */
+                recording_active = false;
+                
+                /* Clear done flag */
+                xEventGroupClearBits(audio_state_events, EVENT_RECORDING_DONE);
+            }
+        }
+        
+        /* Playback sessions end in PlaybackTask */
+        update_idle_state();
+    }
 }
 
 /*******************************************************************************
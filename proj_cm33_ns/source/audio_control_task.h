@@ -25,6 +25,10 @@ extern "C" {
 #define AUDIO_CONTROL_TASK_STACK_SIZE   (2048u)
 #define AUDIO_CONTROL_TASK_PRIORITY     (3u)  /* Higher than CLI */
 
+/* 'gen' defaults */
+#define GEN_DEFAULT_MS                  (1000u)
+#define GEN_DEFAULT_ATTEN_DB            (20u)   /* -20 dBFS peak */
+
 /* Event Group Bits - Audio System State */
 #define EVENT_IDLE              (1 << 0)  /* System idle */
 #define EVENT_RECORDING         (1 << 1)  /* Recording in progress */
@@ -0,0 +1,33 @@
+/******************************************************************************
+* File Name: audio_ramfunc.h
+*
+* Description: Placement of the audio interrupt path
+*              The PDM and I2S interrupt handlers, the callbacks they make and
+*              the DSP kernels they run are marked with AUDIO_RAMFUNC_BEGIN /
+*              AUDIO_RAMFUNC_END. The marked functions go to the
+*              .audio_ramfunc section, which the linker scripts place in the
+*              CM33 code SRAM with the other .app_code_ram code; the startup
+*              code copies it there from external flash. An interrupt then
+*              does not wait on an XIP cache miss behind SMIF traffic. The
+*              CM33 has no TCM; its data, stacks and heap are already in
+*              SRAM. tools/placement.py lists where each function ended up.
+*
+*              Build with DEFINES+=AUDIO_XIP_ONLY to leave these functions in
+*              flash, for comparing 'isr' timings against the default build.
+*
+*******************************************************************************/
+
+#ifndef __AUDIO_RAMFUNC_H__
+#define __AUDIO_RAMFUNC_H__
+
+#include "cy_pdl.h"
+
+#if defined(AUDIO_XIP_ONLY)
+#define AUDIO_RAMFUNC_BEGIN
+#define AUDIO_RAMFUNC_END
+#else
+#define AUDIO_RAMFUNC_BEGIN         CY_SECTION(".audio_ramfunc")
+#define AUDIO_RAMFUNC_END
+#endif
+
+#endif /* __AUDIO_RAMFUNC_H__ */
@@ -4,8 +4,14 @@
 * Description: Audio recording task implementation
 *              - Monitors EVENT_RECORDING flag
 *              - Activates/deactivates PDM hardware
+*              - Takes a buffer from the capture pool for each recording
 *              - Detects buffer overflow
-*              - Sends completed buffers to FileWriteTask
+*              - Stops a timed take at exactly the requested frame count,
+*                counted by the PDM ISR (see 'record <seconds>')
+*              - High-pass filters and compresses the take in place as it
+*                arrives (see 'filter' and 'comp')
+*              - Hands completed buffers over to FileWriteTask
+*              - Keeps the last take in RAM for 'replay'
 *
 *******************************************************************************/
 
@@ -13,6 +19,11 @@
 #include "freertos_setup.h"
 #include "app_pdm_pcm.h"
 #include "wav_file.h"
+#include "biquad.h"
+#include "capture_pool.h"
+#include "compressor.h"
+#include "settings.h"
+#include "audio_ramfunc.h"
 #include <stdio.h>
 
 /*******************************************************************************
@@ -24,7 +35,210 @@ TaskHandle_t audio_record_task_handle = NULL;
 /*******************************************************************************
 * Local Variables
 *******************************************************************************/
-static uint32_t last_sample_count = 0;
+/* Capture session: everything one take owns, independent of playback */
+typedef struct {
+    volatile bool active;
+    capture_buffer_t *buffer;       /* From the pool, owned until handed to FileWriteTask */
+    app_pdm_pcm_stream_t stream;    /* Filled by the PDM ISR */
+    uint32_t filtered;              /* Samples high-pass filtered */
+    uint32_t processed;             /* Samples compressed and folded into the statistics */
+    wav_stats_t stats;
+    peak_builder_t *peaks;          /* The buffer's entry in record_peaks[] */
+    biquad_t hpf;
+    bool hpf_enabled;
+    compressor_t comp;              /* Lags the filter by its look-ahead */
+    bool comp_enabled;
+    comp_trace_t *trace;            /* The buffer's entry in record_traces[], or NULL */
+    uint32_t capacity;              /* Samples the take stops at */
+    bool timed;                     /* capacity is the requested length */
+    wall_clock_time_t start_time;
+} record_session_t;
+
+static record_session_t record_session;
+
+/* Peaks live as long as the buffer they describe: FileWriteTask reads them
+ * while the next take is being recorded */
+static peak_builder_t record_peaks[CAPTURE_POOL_MAX_TAKES];
+static comp_trace_t record_traces[CAPTURE_POOL_MAX_TAKES];
+
+/* Reference to the most recent take, for replay without the SD card; given
+ * up when the next recording starts */
+static capture_buffer_t *last_take = NULL;
+static uint32_t last_take_samples = 0;
+
+/* Length of the next take in frames, 0 = until stopped; consumed when the
+ * take starts */
+static uint32_t next_take_frames = 0;
+
+/*******************************************************************************
+* Function Name: record_update_stats
+********************************************************************************
+* Summary:
+*  Add the samples captured since the last call to the take statistics and
+*  the waveform peaks, high-pass filtering and compressing them in place
+*  first if enabled
+*  - The compressor holds back its look-ahead until the take ends, so the
+*    statistics trail the capture by a few milliseconds
+*
+* Parameters:
+*  session: Capture session
+*  sample_count: app_pdm_pcm_samples()
+*  final: The take has ended; process everything
+*
+*******************************************************************************/
+static void record_update_stats(record_session_t *session, uint32_t sample_count, bool final)
+{
+    int16_t *buffer = session->stream.buffer;
+    uint32_t ready;
+    
+    /* Whole frames only; the ISR may be between the L and R writes */
+    sample_count -= sample_count % NUM_CHANNELS;
+    if (sample_count > session->filtered) {
+        if (session->hpf_enabled) {
+            biquad_process(&session->hpf, &buffer[session->filtered],
+                           (sample_count - session->filtered) / NUM_CHANNELS);
+        }
+        session->filtered = sample_count;
+    }
+    
+    ready = session->filtered;
+    if (session->comp_enabled) {
+        ready = session->processed + NUM_CHANNELS *
+                compressor_process(&session->comp, &buffer[session->processed],
+                                   (session->filtered - session->processed) / NUM_CHANNELS, final);
+    }
+    if (ready > session->processed) {
+        int16_t *pcm = &buffer[session->processed];
+        uint32_t count = ready - session->processed;
+        
+        wav_stats_update(&session->stats, pcm, count);
+        peak_builder_update(session->peaks, pcm, count);
+        session->processed = ready;
+    }
+}
+
+/*******************************************************************************
+* Function Name: record_fill_msg
+********************************************************************************
+* Summary:
+*  Finish the statistics, return the unused end of the buffer to the pool
+*  and describe the take for FileWriteTask
+*  - Samples read after the buffer was full are not saved; they are counted
+*    in samples_dropped unless the take was timed and ended as requested
+*
+* Parameters:
+*  session: Capture session, stopped
+*  msg: Output
+*
+*******************************************************************************/
+static void record_fill_msg(record_session_t *session, audio_record_msg_t *msg)
+{
+    uint32_t saved = app_pdm_pcm_samples(&session->stream);
+    
+    saved -= saved % NUM_CHANNELS;
+    record_update_stats(session, saved, true);
+    capture_pool_trim(session->buffer, saved);
+    
+    msg->buffer = session->buffer;
+    msg->buffer_ptr = session->stream.buffer;
+    msg->sample_count = saved;
+    msg->sample_rate = SAMPLE_RATE_HZ;
+    msg->num_channels = NUM_CHANNELS;
+    msg->start_time = session->start_time;
+    msg->stats = session->stats;
+    msg->pdm_overflows = session->stream.overflow_count;
+    msg->pdm_underflows = session->stream.underflow_count;
+    msg->samples_dropped = session->stream.dropped_samples;
+    msg->peaks = session->peaks;
+    msg->compressed = session->comp_enabled;
+    msg->gain_trace = session->comp_enabled ? session->trace : NULL;
+    
+    if (session->comp_enabled) {
+        printf("[RecordTask] Compressor: max reduction %.1f dB, ceiling reached in %u of %u ms\r\n",
+               (double)compressor_max_reduction_db(&session->comp),
+               (unsigned int)((session->comp.limited * COMP_BLOCK_FRAMES * 1000u) / SAMPLE_RATE_HZ),
+               (unsigned int)((session->comp.blocks * COMP_BLOCK_FRAMES * 1000u) / SAMPLE_RATE_HZ));
+    }
+}
+
+/*******************************************************************************
+* Function Name: record_hand_over
+********************************************************************************
+* Summary:
+*  Pass the finished take, and ownership of its buffer, to FileWriteTask
+*
+* Parameters:
+*  session: Capture session, stopped
+*
+* Return:
+*  true if FileWriteTask has it; otherwise the take is lost and its buffer
+*  is back in the pool
+*
+*******************************************************************************/
+static bool record_hand_over(record_session_t *session)
+{
+    audio_record_msg_t record_msg;
+    
+    record_fill_msg(session, &record_msg);
+    session->buffer = NULL;
+    
+    /* Second owner: the take stays replayable after it has been saved */
+    capture_pool_retain(record_msg.buffer);
+    taskENTER_CRITICAL();
+    last_take = record_msg.buffer;
+    last_take_samples = record_msg.sample_count;
+    taskEXIT_CRITICAL();
+    
+    /* The queue has room for every buffer the pool can hand out */
+    if (xQueueSend(audio_record_queue, &record_msg, pdMS_TO_TICKS(100)) != pdPASS)
+    {
+        capture_pool_release(record_msg.buffer);
+        return false;
+    }
+    return true;
+}
+
+/*******************************************************************************
+* Function Name: record_on_full
+********************************************************************************
+* Summary:
+*  PDM ISR callback: the buffer has just been filled, wake the record task
+*  instead of leaving the take to the next poll
+*
+* Parameters:
+*  context: Record task handle
+*
+*******************************************************************************/
+AUDIO_RAMFUNC_BEGIN
+static void record_on_full(void *context)
+{
+    BaseType_t woken = pdFALSE;
+    
+    vTaskNotifyGiveFromISR((TaskHandle_t)context, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+AUDIO_RAMFUNC_END
+
+/*******************************************************************************
+* Function Name: record_drop_last_take
+********************************************************************************
+* Summary:
+*  Give up the reference to the previous take so its blocks can go to the
+*  next one; a replay still playing it keeps its own reference
+*
+*******************************************************************************/
+static void record_drop_last_take(void)
+{
+    capture_buffer_t *take;
+    
+    taskENTER_CRITICAL();
+    take = last_take;
+    last_take = NULL;
+    last_take_samples = 0;
+    taskEXIT_CRITICAL();
+    
+    capture_pool_release(take);
+}
 
 /*******************************************************************************
 * Function Name: audio_record_task
@@ -32,9 +246,9 @@ static uint32_t last_sample_count = 0;
 * Summary:
 *  Audio recording management task
 *  - Waits for EVENT_RECORDING flag from AudioControlTask
-*  - Activates PDM hardware
+*  - Takes a buffer from the capture pool and activates PDM hardware
 *  - Monitors buffer fill status
-*  - Sends completed recording to FileWriteTask via queue
+*  - Sends completed recording, and its buffer, to FileWriteTask via queue
 *
 * Parameters:
 *  arg: Unused task parameter
@@ -45,7 +259,12 @@ static void audio_record_task(void *arg)
     (void)arg;
     EventBits_t event_bits;
     uint32_t current_sample_count;
-    audio_record_msg_t record_msg;
+    record_session_t *session = &record_session;
+    app_pdm_pcm_filter_t filter;
+    compressor_config_t comp_config;
+    capture_pool_status_t pool;
+    uint32_t take_frames;
+    wall_clock_time_t now;
     
     /* Small delay to avoid printf collision with other tasks */
     vTaskDelay(pdMS_TO_TICKS(100));
@@ -65,13 +284,72 @@ static void audio_record_task(void *arg)
         
         if (event_bits & EVENT_RECORDING)
         {
-            printf("[RecordTask] Recording event detected, activating PDM...\r\n");
+            taskENTER_CRITICAL();
+            take_frames = next_take_frames;
+            next_take_frames = 0;
+            taskEXIT_CRITICAL();
+            
+            /* Never wait for FileWriteTask: without a free buffer the take
+             * is refused rather than recorded over one not yet saved */
+            record_drop_last_take();
+            session->buffer = capture_pool_acquire();
+            if (session->buffer == NULL)
+            {
+                capture_pool_get_status(&pool);
+                printf("[RecordTask] ERROR: Capture pool exhausted (%u takes waiting to be saved)\r\n",
+                       (unsigned int)pool.takes);
+                xEventGroupClearBits(audio_state_events, EVENT_RECORDING);
+                xEventGroupSetBits(audio_state_events, EVENT_RECORDING_DONE);
+                continue;
+            }
+            
+            /* A timed take is shorter than the buffer; the ISR stops at
+             * its last frame. Otherwise 'take_ms' limits the take. */
+            session->capacity = session->buffer->capacity;
+            session->timed = (take_frames != 0u) &&
+                             (take_frames * NUM_CHANNELS <= session->capacity);
+            if (session->timed) {
+                session->capacity = take_frames * NUM_CHANNELS;
+            } else {
+                uint32_t limit = ((uint32_t)app_settings.take_ms * SAMPLE_RATE_HZ / 1000u) * NUM_CHANNELS;
+                if (limit < session->capacity) {
+                    session->capacity = limit;
+                }
+            }
+            
+            printf("[RecordTask] Recording event detected, activating PDM (buffer %u, %.1f s%s)...\r\n",
+                   (unsigned int)session->buffer->index,
+                   (double)(session->capacity / NUM_CHANNELS) / SAMPLE_RATE_HZ,
+                   session->timed ? " timed" : "");
             
             /* Initialize tracking */
-            last_sample_count = 0;
+            session->filtered = 0;
+            session->processed = 0;
+            session->peaks = &record_peaks[session->buffer->index];
+            wav_stats_reset(&session->stats);
+            peak_builder_reset(session->peaks, NUM_CHANNELS, SAMPLE_RATE_HZ);
+            app_pdm_pcm_get_filter(&filter);
+            session->hpf_enabled = (filter.hpf_hz != 0u) &&
+                (biquad_highpass(&session->hpf, filter.hpf_hz, SAMPLE_RATE_HZ, NUM_CHANNELS) == 0);
+            compressor_config_get(&comp_config);
+            session->trace = comp_config.trace ? &record_traces[session->buffer->index] : NULL;
+            session->comp_enabled = comp_config.enabled &&
+                (compressor_init(&session->comp, &comp_config, NUM_CHANNELS, SAMPLE_RATE_HZ,
+                                 session->trace) == 0);
+            wall_clock_get(&now);
+            wall_clock_add_ms(&now, ((uint32_t)filter.settle_frames * 1000u) / SAMPLE_RATE_HZ,
+                              &session->start_time);
             
-            /* Activate PDM hardware (audio_data_ptr is reset inside) */
-            app_pdm_pcm_activate();
+            /* Activate PDM hardware, capturing into the pool buffer once the
+             * settling frames have been discarded */
+            session->stream.skip_frames = filter.settle_frames;
+            session->stream.timed = session->timed;
+            session->stream.on_full = record_on_full;
+            session->stream.context = xTaskGetCurrentTaskHandle();
+            (void)ulTaskNotifyTake(pdTRUE, 0);     /* Stale wake-up from the last take */
+            app_pdm_pcm_activate(&session->stream, session->buffer->samples,
+                                 session->capacity);
+            session->active = true;
             
             /* Monitor recording progress */
             while (1)
@@ -84,21 +362,16 @@ static void audio_record_task(void *arg)
                     /* Recording stopped by AudioControlTask */
                     printf("[RecordTask] Stop requested, deactivating PDM...\r\n");
                     app_pdm_pcm_deactivate();
+                    session->active = false;
                     
                     /* Get final sample count */
-                    current_sample_count = get_audio_data_index();
+                    current_sample_count = app_pdm_pcm_samples(&session->stream);
                     
                     printf("[RecordTask] Recording complete: %lu samples\r\n", 
                            current_sample_count);
                     
-                    /* Prepare message for FileWriteTask */
-                    record_msg.buffer_ptr = (int16_t *)get_recorded_data_buffer();
-                    record_msg.sample_count = current_sample_count;
-                    record_msg.sample_rate = SAMPLE_RATE_HZ;
-                    record_msg.num_channels = NUM_CHANNELS;
-                    
-                    /* Send to FileWriteTask (non-blocking, 100ms timeout) */
-                    if (xQueueSend(audio_record_queue, &record_msg, pdMS_TO_TICKS(100)) != pdPASS)
+                    /* Hand the buffer over to FileWriteTask */
+                    if (!record_hand_over(session))
                     {
                         printf("[RecordTask] ERROR: Failed to send to FileWriteTask queue\r\n");
                     }
@@ -115,26 +388,30 @@ static void audio_record_task(void *arg)
                 }
                 
                 /* Check buffer overflow (full buffer condition) */
-                current_sample_count = get_audio_data_index();
+                current_sample_count = app_pdm_pcm_samples(&session->stream);
                 
-                if (current_sample_count >= (NUM_CHANNELS * BUFFER_SIZE))
+                if (current_sample_count >= session->capacity)
                 {
-                    printf("[RecordTask] WARNING: Buffer full (%lu samples), stopping...\r\n",
-                           current_sample_count);
+                    if (session->timed)
+                    {
+                        printf("[RecordTask] Requested length reached (%lu samples), stopping...\r\n",
+                               current_sample_count);
+                    }
+                    else
+                    {
+                        printf("[RecordTask] WARNING: Buffer full (%lu samples), stopping...\r\n",
+                               current_sample_count);
+                    }
                     
                     /* Auto-stop recording */
                     app_pdm_pcm_deactivate();
+                    session->active = false;
                     
                     /* Clear recording flag */
                     xEventGroupClearBits(audio_state_events, EVENT_RECORDING);
                     
-                    /* Prepare and send message */
-                    record_msg.buffer_ptr = (int16_t *)get_recorded_data_buffer();
-                    record_msg.sample_count = current_sample_count;
-                    record_msg.sample_rate = SAMPLE_RATE_HZ;
-                    record_msg.num_channels = NUM_CHANNELS;
-                    
-                    if (xQueueSend(audio_record_queue, &record_msg, pdMS_TO_TICKS(100)) != pdPASS)
+                    /* Hand the buffer over */
+                    if (!record_hand_over(session))
                     {
                         printf("[RecordTask] ERROR: Failed to send full buffer\r\n");
                     }
@@ -144,13 +421,89 @@ static void audio_record_task(void *arg)
                     break;
                 }
                 
-                /* Sleep for 100ms before next check */
-                vTaskDelay(pdMS_TO_TICKS(100));
+                /* Statistics for what arrived since the last check */
+                record_update_stats(session, current_sample_count, false);
+                
+                /* Sleep until the next check, or until the ISR reports the
+                 * buffer full */
+                (void)ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
             }
         }
     }
 }
 
+/*******************************************************************************
+* Function Name: audio_record_get_status
+********************************************************************************
+* Summary:
+*  Read the progress of the current or last capture session
+*
+* Parameters:
+*  status: Output
+*
+*******************************************************************************/
+void audio_record_get_status(audio_record_status_t *status)
+{
+    record_session_t *session = &record_session;
+    
+    status->active = session->active;
+    status->frames = (session->stream.buffer != NULL) ?
+                     (app_pdm_pcm_samples(&session->stream) / NUM_CHANNELS) : 0u;
+    status->pdm_faults = session->stream.overflow_count + session->stream.underflow_count;
+    status->target_frames = session->timed ? (session->capacity / NUM_CHANNELS) : 0u;
+}
+
+/*******************************************************************************
+* Function Name: audio_record_set_length
+********************************************************************************
+* Summary:
+*  Set the length of the next take; call before setting EVENT_RECORDING
+*  - The PDM ISR stops storing at exactly this frame count, after the
+*    'filter settle' frames have been discarded
+*  - Applies to one take only
+*
+* Parameters:
+*  frames: Frames per channel, 0 to record until stopped or the buffer is
+*          full
+*
+*******************************************************************************/
+void audio_record_set_length(uint32_t frames)
+{
+    taskENTER_CRITICAL();
+    next_take_frames = frames;
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+* Function Name: audio_record_last_take
+********************************************************************************
+* Summary:
+*  Take a reference to the most recent take, which may still be on its way
+*  to the SD card
+*
+* Parameters:
+*  sample_count: Output - samples in the take, L and R counted separately
+*
+* Return:
+*  Buffer to release with capture_pool_release() when done, or NULL if no
+*  take has been kept
+*
+*******************************************************************************/
+capture_buffer_t *audio_record_last_take(uint32_t *sample_count)
+{
+    capture_buffer_t *take;
+    
+    taskENTER_CRITICAL();
+    take = last_take;
+    *sample_count = last_take_samples;
+    if (take != NULL) {
+        capture_pool_retain(take);      /* Nests; last_take cannot be dropped meanwhile */
+    }
+    taskEXIT_CRITICAL();
+    
+    return take;
+}
+
 /*******************************************************************************
 * Function Name: audio_record_task_create
 ********************************************************************************
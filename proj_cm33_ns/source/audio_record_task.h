@@ -12,6 +12,12 @@
 #include "task.h"
 #include "queue.h"
 #include <stdint.h>
+#include <stdbool.h>
+#include "wav_file.h"
+#include "wall_clock.h"
+#include "peak_file.h"
+#include "capture_pool.h"
+#include "compressor.h"
 
 #if defined(__cplusplus)
 extern "C" {
@@ -22,18 +28,35 @@ extern "C" {
 *******************************************************************************/
 #define AUDIO_RECORD_TASK_PRIORITY    (4)
 #define AUDIO_RECORD_TASK_STACK_SIZE  (1024)
-#define AUDIO_RECORD_QUEUE_LENGTH     (2)
+#define AUDIO_RECORD_QUEUE_LENGTH     (CAPTURE_POOL_MAX_TAKES)
 
 /*******************************************************************************
 * Data Structures
 *******************************************************************************/
 typedef struct {
+    capture_buffer_t *buffer; /* Owned by the receiver, which releases it */
     int16_t *buffer_ptr;      /* Pointer to recorded audio buffer */
     uint32_t sample_count;    /* Number of samples (total, not per channel) */
     uint32_t sample_rate;     /* Sampling rate in Hz */
     uint16_t num_channels;    /* Number of audio channels */
+    wall_clock_time_t start_time;   /* When capture started */
+    wav_stats_t stats;        /* Level statistics, built while recording */
+    uint32_t pdm_overflows;   /* PDM error interrupts during the take */
+    uint32_t pdm_underflows;
+    uint32_t samples_dropped; /* Captured after the buffer was full */
+    const peak_builder_t *peaks;    /* Waveform peaks of the saved samples */
+    bool compressed;          /* Samples went through the capture compressor */
+    const comp_trace_t *gain_trace; /* Its gain reduction, NULL if not traced */
 } audio_record_msg_t;
 
+/* Progress of the current or last capture session */
+typedef struct {
+    bool active;
+    uint32_t frames;          /* Captured so far */
+    uint32_t pdm_faults;      /* Overflow and underflow interrupts */
+    uint32_t target_frames;   /* Length of a timed take, 0 if untimed */
+} audio_record_status_t;
+
 /*******************************************************************************
 * Global Variables
 *******************************************************************************/
@@ -44,6 +67,9 @@ extern TaskHandle_t audio_record_task_handle;
 * Function Prototypes
 *******************************************************************************/
 void audio_record_task_create(void);
+void audio_record_get_status(audio_record_status_t *status);
+void audio_record_set_length(uint32_t frames);
+capture_buffer_t *audio_record_last_take(uint32_t *sample_count);
 
 #ifdef __cplusplus
 }
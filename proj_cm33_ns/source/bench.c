@@ -0,0 +1,618 @@
+/******************************************************************************
+* File Name: bench.c
+*
+* Description: On-target microbenchmarks timed with the DWT cycle counter
+*
+* Output (one line each, comma separated):
+*   BENCH_INFO,clock_hz,<Hz>,overhead_cycles,<n>,build,<date time>
+*   BENCH,case,irq,reps,samples,min,median,max,cycles_per_sample
+*   BENCH,<case>,<masked|unmasked>,<reps>,<samples>,<min>,<median>,<max>,<c/s>
+*   BENCH_END,<cases run>
+* Cycle counts have the timer overhead removed. cycles_per_sample is the
+* median divided by the samples one run processes, empty where that does not
+* apply.
+*
+*******************************************************************************/
+
+#include "bench.h"
+#include "app_pdm_pcm.h"
+#include "app_i2s.h"
+#include "wav_file.h"
+#include "biquad.h"
+#include "capture_pool.h"
+#include "siggen.h"
+#include "playback_dsp.h"
+#include "loudness.h"
+#include "compressor.h"
+#include "codec_ctrl.h"
+#include "output_ctrl.h"
+#include "tdm_slots.h"
+#include "FS.h"
+#include "cy_pdl.h"
+#include <stdio.h>
+#include <string.h>
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+typedef struct {
+    const char *name;
+    const char *description;
+    uint32_t samples;           /* Samples one run processes, 0 if not applicable */
+    bool needs_irq;             /* Waits for interrupts; never run masked */
+    int (*setup)(void);         /* Optional, before warm-up */
+    void (*run)(void);
+    void (*teardown)(void);     /* Optional, after the last run */
+} bench_case_t;
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static uint32_t bench_cycles[BENCH_MAX_REPS];
+static uint32_t bench_overhead;
+static FS_FILE *bench_file;
+static biquad_t bench_biquad;
+static siggen_t bench_siggen;
+static playback_dsp_config_t bench_dsp_saved;
+static compressor_t bench_comp;
+static uint8_t bench_codec_volume;
+static uint8_t bench_codec_saved;
+static output_ramp_t bench_ramp;
+static tdm_layout_t bench_tdm_layout;
+
+/* SRAM copy buffers; the SOCMEM side of the copy cases is a capture pool
+ * buffer, so the benchmark costs no SOCMEM of its own */
+static uint32_t bench_sram_src[BENCH_COPY_BYTES / sizeof(uint32_t)];
+static uint32_t bench_sram_dst[BENCH_COPY_BYTES / sizeof(uint32_t)];
+static int16_t *bench_socmem;
+#define BENCH_SOCMEM_BYTES          (32768u)    /* Largest write case */
+#define BENCH_SOCMEM_SRC            ((void *)&bench_socmem[0])
+#define BENCH_SOCMEM_DST            ((void *)&bench_socmem[BENCH_COPY_BYTES / sizeof(int16_t)])
+#define BENCH_HPF_FRAMES            (BENCH_COPY_BYTES / (NUM_CHANNELS * sizeof(int16_t)))
+#define BENCH_HPF_CUTOFF_HZ         (80u)
+#define BENCH_SIGGEN_FRAMES         (HW_FIFO_HALF_SIZE / 2u)    /* One I2S refill */
+#define BENCH_DSP_LOUDNESS          (-30.0f)    /* Quiet file: the normalizer drives the limiter */
+
+/*******************************************************************************
+* Cases
+*******************************************************************************/
+static void __attribute__((noinline)) bench_empty(void)
+{
+    __asm volatile ("" ::: "memory");
+}
+
+static void bench_pdm_drain(void)
+{
+    (void)app_pdm_pcm_read_fifo((volatile int16_t *)bench_sram_dst, RX_FIFO_TRIG_LEVEL);
+}
+
+static void bench_pdm_teardown(void)
+{
+    /* Reading the idle FIFO flags underflow */
+    Cy_PDM_PCM_Channel_ClearInterrupt(PDM0, RIGHT_CH_INDEX, CY_PDM_PCM_INTR_MASK);
+}
+
+static void bench_i2s_refill(void)
+{
+    (void)tdm_slots_write_fifo((const int16_t *)bench_sram_src, HW_FIFO_HALF_SIZE);
+}
+
+/* One refill in each TDM interleave kernel: half the FIFO whatever the slot
+ * count, so cycles_per_sample is per FIFO word */
+static int bench_tdm_setup(const char *map)
+{
+    return tdm_slots_compile(map, &bench_tdm_layout);
+}
+
+static int bench_tdm_stereo_setup(void)
+{
+    return bench_tdm_setup("LR");
+}
+
+static int bench_tdm_pairs4_setup(void)
+{
+    return bench_tdm_setup("LRLR");
+}
+
+static int bench_tdm_pairs8_setup(void)
+{
+    return bench_tdm_setup("LRLRLRLR");
+}
+
+static int bench_tdm_map2_setup(void)
+{
+    return bench_tdm_setup("RL");
+}
+
+static int bench_tdm_map4_setup(void)
+{
+    return bench_tdm_setup("LRMM");
+}
+
+static int bench_tdm_map8_setup(void)
+{
+    return bench_tdm_setup("LRM--MLR");
+}
+
+static void bench_tdm_write(void)
+{
+    (void)tdm_slots_write(&bench_tdm_layout, (const int16_t *)bench_sram_src, HW_FIFO_HALF_SIZE);
+}
+
+static void bench_i2s_teardown(void)
+{
+    /* Flush what the runs left in the FIFO and drop the overflow flags */
+    app_i2s_disable();
+    Cy_AudioTDM_ClearTxInterrupt(TDM_STRUCT0_TX, CY_TDM_INTR_TX_MASK);
+}
+
+static void bench_wav_header_init(void)
+{
+    wav_header_t header;
+
+    wav_header_init(&header, BUFFER_SIZE);
+    __asm volatile ("" : : "r" (&header) : "memory");
+}
+
+static int bench_file_open(void)
+{
+    bench_file = FS_FOpen(BENCH_FILENAME, "w");
+    return (bench_file != NULL) ? 0 : -1;
+}
+
+static void bench_file_close(void)
+{
+    FS_FClose(bench_file);
+    bench_file = NULL;
+    (void)FS_Remove(BENCH_FILENAME);
+}
+
+/* Writes come from a capture buffer, as in FileWriteTask */
+static void bench_fs_write_512(void)
+{
+    (void)FS_Write(bench_file, bench_socmem, 512u);
+}
+
+static void bench_fs_write_4k(void)
+{
+    (void)FS_Write(bench_file, bench_socmem, 4096u);
+}
+
+static void bench_fs_write_32k(void)
+{
+    (void)FS_Write(bench_file, bench_socmem, 32768u);
+}
+
+static void bench_copy_sram_sram(void)
+{
+    memcpy(bench_sram_dst, bench_sram_src, BENCH_COPY_BYTES);
+}
+
+static void bench_copy_sram_socmem(void)
+{
+    memcpy(BENCH_SOCMEM_DST, bench_sram_src, BENCH_COPY_BYTES);
+}
+
+static void bench_copy_socmem_sram(void)
+{
+    memcpy(bench_sram_dst, BENCH_SOCMEM_SRC, BENCH_COPY_BYTES);
+}
+
+static void bench_copy_socmem_socmem(void)
+{
+    memcpy(BENCH_SOCMEM_DST, BENCH_SOCMEM_SRC, BENCH_COPY_BYTES);
+}
+
+static int bench_hpf_setup(void)
+{
+    return biquad_highpass(&bench_biquad, BENCH_HPF_CUTOFF_HZ, SAMPLE_RATE_HZ, NUM_CHANNELS);
+}
+
+/* The capture high-pass as the record task runs it, on an SRAM block */
+static void bench_hpf_biquad(void)
+{
+    biquad_process(&bench_biquad, (int16_t *)bench_sram_dst, BENCH_HPF_FRAMES);
+}
+
+static int bench_siggen_setup(siggen_type_t type)
+{
+    siggen_config_t config = { type, 1000u, 7000u, SAMPLE_RATE_HZ / 10u, SIGGEN_CONTINUOUS, 6u };
+
+    /* A sweep needs a finite length; the runs stay well inside it */
+    if (type == SIGGEN_SWEEP) {
+        config.frames = 10u * SAMPLE_RATE_HZ;
+    }
+    return siggen_init(&bench_siggen, &config, SAMPLE_RATE_HZ);
+}
+
+static int bench_siggen_tone_setup(void)
+{
+    return bench_siggen_setup(SIGGEN_TONE);
+}
+
+static int bench_siggen_sweep_setup(void)
+{
+    return bench_siggen_setup(SIGGEN_SWEEP);
+}
+
+static int bench_siggen_pink_setup(void)
+{
+    return bench_siggen_setup(SIGGEN_PINK);
+}
+
+/* What the I2S ISR renders per refill while 'gen' plays */
+static void bench_siggen_render(void)
+{
+    (void)siggen_render(&bench_siggen, (int16_t *)bench_sram_dst, BENCH_SIGGEN_FRAMES);
+}
+
+/* Worst case of the playback chain: every band, the normalizer and the limiter */
+static int bench_dsp_setup(void)
+{
+    playback_dsp_config_t config;
+
+    playback_dsp_get_config(&bench_dsp_saved);
+    memset(&config, 0, sizeof(config));
+    for (uint32_t b = 0; b < PLAYBACK_DSP_MAX_BANDS; b++) {
+        config.band[b].enabled = true;
+        config.band[b].type = BIQUAD_PEAK;
+        config.band[b].freq_hz = (uint16_t)(100u << (b / 2u));
+        config.band[b].gain_db = (b & 1u) ? -6 : 6;
+        config.band[b].q_x100 = PLAYBACK_DSP_DEFAULT_Q_X100;
+    }
+    config.normalize = true;
+    config.target_lu = PLAYBACK_DSP_DEFAULT_TARGET_LU;
+    config.limit = true;
+    config.ceiling_db = PLAYBACK_DSP_DEFAULT_CEILING_DB;
+    if ((playback_dsp_set_config(&config) != 0) || (bench_siggen_setup(SIGGEN_PINK) != 0)) {
+        return -1;
+    }
+    playback_dsp_begin(BENCH_DSP_LOUDNESS);
+    (void)siggen_render(&bench_siggen, (int16_t *)bench_sram_src, BENCH_SIGGEN_FRAMES);
+    return 0;
+}
+
+/* What the I2S ISR does per refill of a file: copy the block, then process it */
+static void bench_dsp_refill(void)
+{
+    memcpy(bench_sram_dst, bench_sram_src, BENCH_SIGGEN_FRAMES * 2u * sizeof(int16_t));
+    playback_dsp_process(NULL, (int16_t *)bench_sram_dst, BENCH_SIGGEN_FRAMES);
+}
+
+static void bench_dsp_teardown(void)
+{
+    (void)playback_dsp_set_config(&bench_dsp_saved);
+    playback_dsp_begin(LOUDNESS_UNKNOWN);
+}
+
+/* Capture compressor with makeup gain, so the limiter works on most blocks */
+static int bench_comp_setup(void)
+{
+    compressor_config_t config;
+    siggen_config_t noise = { SIGGEN_PINK, 0u, 0u, 0u, SIGGEN_CONTINUOUS, 0u };
+
+    compressor_config_get(&config);
+    config.enabled = true;
+    config.threshold_db = 20u;
+    config.makeup_db = COMP_MAX_MAKEUP_DB;
+    if ((siggen_init(&bench_siggen, &noise, SAMPLE_RATE_HZ) != 0) ||
+        (compressor_init(&bench_comp, &config, NUM_CHANNELS, SAMPLE_RATE_HZ, NULL) != 0)) {
+        return -1;
+    }
+    (void)siggen_render(&bench_siggen, (int16_t *)bench_sram_dst, BENCH_HPF_FRAMES);
+    return 0;
+}
+
+/* As the record task runs it at the end of a take: every frame, look-ahead included */
+static void bench_comp_process(void)
+{
+    (void)compressor_process(&bench_comp, (int16_t *)bench_sram_dst, BENCH_HPF_FRAMES, true);
+}
+
+/* Caller's side of a codec register write: shadow update and, with the bus
+ * idle, the start of the transaction. The value alternates so no write is
+ * dropped as redundant. */
+static int bench_codec_setup(void)
+{
+    if (codec_ctrl_read(CODEC_P0_DAC_LEFT_VOLUME, &bench_codec_saved) != 0) {
+        return -1;
+    }
+    bench_codec_volume = bench_codec_saved;
+    return 0;
+}
+
+static void bench_codec_write(void)
+{
+    bench_codec_volume ^= 1u;
+    (void)codec_ctrl_write(CODEC_P0_DAC_LEFT_VOLUME, bench_codec_volume);
+}
+
+static void bench_codec_teardown(void)
+{
+    (void)codec_ctrl_write(CODEC_P0_DAC_LEFT_VOLUME, bench_codec_saved);
+    (void)codec_ctrl_sync(CODEC_CTRL_SYNC_TIMEOUT_MS);
+}
+
+/* Output fade, one I2S refill. The ramp is long enough that no run reaches
+ * the target and falls into the constant-gain path. */
+static int bench_ramp_setup(void)
+{
+    bench_ramp.gain = 0;
+    output_ramp_start(&bench_ramp, OUTPUT_RAMP_UNITY, 1u << 20);
+    return 0;
+}
+
+static void bench_ramp_process(void)
+{
+    output_ramp_process(&bench_ramp, (int16_t *)bench_sram_dst, BENCH_SIGGEN_FRAMES);
+}
+
+static const bench_case_t bench_cases[] = {
+    { "pdm_drain",      "PDM ISR FIFO drain, RX_FIFO_TRIG_LEVEL frames",
+      RX_FIFO_TRIG_LEVEL * NUM_CHANNELS, false, NULL, bench_pdm_drain, bench_pdm_teardown },
+    { "i2s_refill",     "I2S ISR FIFO refill, half FIFO, current TDM map",
+      HW_FIFO_HALF_SIZE, false, NULL, bench_i2s_refill, bench_i2s_teardown },
+    { "tdm_stereo",     "TDM interleave LR, one refill",
+      HW_FIFO_HALF_SIZE, false, bench_tdm_stereo_setup, bench_tdm_write, bench_i2s_teardown },
+    { "tdm_pairs4",     "TDM interleave LRLR, one refill",
+      HW_FIFO_HALF_SIZE, false, bench_tdm_pairs4_setup, bench_tdm_write, bench_i2s_teardown },
+    { "tdm_pairs8",     "TDM interleave LRLRLRLR, one refill",
+      HW_FIFO_HALF_SIZE, false, bench_tdm_pairs8_setup, bench_tdm_write, bench_i2s_teardown },
+    { "tdm_map2",       "TDM interleave RL, one refill",
+      HW_FIFO_HALF_SIZE, false, bench_tdm_map2_setup, bench_tdm_write, bench_i2s_teardown },
+    { "tdm_map4",       "TDM interleave LRMM, one refill",
+      HW_FIFO_HALF_SIZE, false, bench_tdm_map4_setup, bench_tdm_write, bench_i2s_teardown },
+    { "tdm_map8",       "TDM interleave LRM--MLR, one refill",
+      HW_FIFO_HALF_SIZE, false, bench_tdm_map8_setup, bench_tdm_write, bench_i2s_teardown },
+    { "wav_header",     "wav_header_init()",
+      0, false, NULL, bench_wav_header_init, NULL },
+    { "fs_write_512",   "FS_Write 512 B, SOCMEM source",
+      512u / sizeof(int16_t), true, bench_file_open, bench_fs_write_512, bench_file_close },
+    { "fs_write_4k",    "FS_Write 4 KB, SOCMEM source",
+      4096u / sizeof(int16_t), true, bench_file_open, bench_fs_write_4k, bench_file_close },
+    { "fs_write_32k",   "FS_Write 32 KB, SOCMEM source",
+      32768u / sizeof(int16_t), true, bench_file_open, bench_fs_write_32k, bench_file_close },
+    { "copy_sram_sram",     "memcpy 4 KB SRAM -> SRAM",
+      BENCH_COPY_BYTES / sizeof(int16_t), false, NULL, bench_copy_sram_sram, NULL },
+    { "copy_sram_socmem",   "memcpy 4 KB SRAM -> SOCMEM",
+      BENCH_COPY_BYTES / sizeof(int16_t), false, NULL, bench_copy_sram_socmem, NULL },
+    { "copy_socmem_sram",   "memcpy 4 KB SOCMEM -> SRAM",
+      BENCH_COPY_BYTES / sizeof(int16_t), false, NULL, bench_copy_socmem_sram, NULL },
+    { "copy_socmem_socmem", "memcpy 4 KB SOCMEM -> SOCMEM",
+      BENCH_COPY_BYTES / sizeof(int16_t), false, NULL, bench_copy_socmem_socmem, NULL },
+    { "hpf_biquad",     "Capture high-pass, 1024 stereo frames in SRAM",
+      BENCH_HPF_FRAMES * NUM_CHANNELS, false, bench_hpf_setup, bench_hpf_biquad, NULL },
+    { "compressor",     "Capture compressor and limiter, 1024 stereo frames in SRAM",
+      BENCH_HPF_FRAMES * NUM_CHANNELS, false, bench_comp_setup, bench_comp_process, NULL },
+    { "siggen_tone",    "Test tone, one I2S refill",
+      BENCH_SIGGEN_FRAMES * 2u, false, bench_siggen_tone_setup, bench_siggen_render, NULL },
+    { "siggen_sweep",   "Test sweep, one I2S refill",
+      BENCH_SIGGEN_FRAMES * 2u, false, bench_siggen_sweep_setup, bench_siggen_render, NULL },
+    { "siggen_pink",    "Pink noise, one I2S refill",
+      BENCH_SIGGEN_FRAMES * 2u, false, bench_siggen_pink_setup, bench_siggen_render, NULL },
+    { "playback_dsp",   "8 EQ bands, normalizer and limiter, one I2S refill",
+      BENCH_SIGGEN_FRAMES * 2u, false, bench_dsp_setup, bench_dsp_refill, bench_dsp_teardown },
+    { "codec_write",    "Codec register write through the cache, DAC volume",
+      0, false, bench_codec_setup, bench_codec_write, bench_codec_teardown },
+    { "output_ramp",    "Output fade ramp, one I2S refill",
+      BENCH_SIGGEN_FRAMES * 2u, false, bench_ramp_setup, bench_ramp_process, NULL },
+};
+
+#define BENCH_NUM_CASES             (sizeof(bench_cases) / sizeof(bench_cases[0]))
+
+/*******************************************************************************
+* Function Name: bench_cycle_counter_init
+********************************************************************************
+* Summary:
+*  Enable the DWT cycle counter and check that it counts (the secure side or
+*  a debugger configuration can keep it stopped)
+*
+* Return:
+*  true if the counter is running
+*
+*******************************************************************************/
+static bool bench_cycle_counter_init(void)
+{
+    uint32_t start;
+
+    DCB->DEMCR |= DCB_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    start = DWT->CYCCNT;
+    bench_empty();
+    return (DWT->CYCCNT != start);
+}
+
+/*******************************************************************************
+* Function Name: bench_measure
+********************************************************************************
+* Summary:
+*  Time one run of a case, optionally with interrupts masked
+*
+* Return:
+*  Elapsed cycles, timer overhead included
+*
+*******************************************************************************/
+static uint32_t bench_measure(void (*run)(void), bool masked)
+{
+    uint32_t state = 0;
+    uint32_t start;
+    uint32_t cycles;
+
+    if (masked) {
+        state = Cy_SysLib_EnterCriticalSection();
+    }
+    start = DWT->CYCCNT;
+    run();
+    cycles = DWT->CYCCNT - start;
+    if (masked) {
+        Cy_SysLib_ExitCriticalSection(state);
+    }
+
+    return cycles;
+}
+
+/*******************************************************************************
+* Function Name: bench_sort
+********************************************************************************
+* Summary:
+*  Sort cycle counts in place (insertion sort, at most BENCH_MAX_REPS)
+*
+*******************************************************************************/
+static void bench_sort(uint32_t *values, uint32_t count)
+{
+    for (uint32_t i = 1; i < count; i++) {
+        uint32_t value = values[i];
+        uint32_t j = i;
+        while ((j > 0) && (values[j - 1] > value)) {
+            values[j] = values[j - 1];
+            j--;
+        }
+        values[j] = value;
+    }
+}
+
+/*******************************************************************************
+* Function Name: bench_run_case
+********************************************************************************
+* Summary:
+*  Set up, warm up, time and report one case
+*
+* Return:
+*  0 on success, -1 if setup failed
+*
+*******************************************************************************/
+static int bench_run_case(const bench_case_t *bench, uint32_t reps, bench_irq_mode_t irq_mode)
+{
+    bool masked = (irq_mode != BENCH_IRQ_UNMASKED) && !bench->needs_irq;
+    uint32_t median;
+
+    if ((bench->setup != NULL) && (bench->setup() != 0)) {
+        printf("BENCH_ERROR,%s,setup failed\r\n", bench->name);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < BENCH_WARMUP_REPS; i++) {
+        (void)bench_measure(bench->run, masked);
+    }
+    for (uint32_t i = 0; i < reps; i++) {
+        uint32_t cycles = bench_measure(bench->run, masked);
+        bench_cycles[i] = (cycles > bench_overhead) ? (cycles - bench_overhead) : 0;
+    }
+
+    if (bench->teardown != NULL) {
+        bench->teardown();
+    }
+
+    bench_sort(bench_cycles, reps);
+    median = bench_cycles[reps / 2];
+
+    printf("BENCH,%s,%s,%u,%u,%u,%u,%u,", bench->name, masked ? "masked" : "unmasked",
+           (unsigned int)reps, (unsigned int)bench->samples, (unsigned int)bench_cycles[0],
+           (unsigned int)median, (unsigned int)bench_cycles[reps - 1]);
+    if (bench->samples > 0) {
+        uint32_t centi = (uint32_t)(((uint64_t)median * 100u) / bench->samples);
+        printf("%u.%02u", (unsigned int)(centi / 100u), (unsigned int)(centi % 100u));
+    }
+    printf("\r\n");
+
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: bench_list
+********************************************************************************
+* Summary:
+*  Print the registered cases
+*
+*******************************************************************************/
+void bench_list(void)
+{
+    printf("Benchmark cases:\r\n");
+    for (uint32_t i = 0; i < BENCH_NUM_CASES; i++) {
+        printf("  %-20s %s%s\r\n", bench_cases[i].name, bench_cases[i].description,
+               bench_cases[i].needs_irq ? " (interrupts on)" : "");
+    }
+    printf("Usage: bench <case|all> [reps] [irq]  (irq: 0 unmasked, 1 masked)\r\n");
+}
+
+/*******************************************************************************
+* Function Name: bench_run
+********************************************************************************
+* Summary:
+*  Run one case, or all of them, and print CSV results
+*  - The caller must make sure recording and playback are stopped: the
+*    cases use the PDM and TDM FIFOs
+*  - SOCMEM cases use a buffer from the capture pool, so takes still
+*    being saved are not touched
+*
+* Parameters:
+*  name: Case name or "all"
+*  reps: Timed repetitions, 0 for BENCH_DEFAULT_REPS
+*  irq_mode: Interrupt masking during the timed runs
+*
+* Return:
+*  0 on success, -1 on error
+*
+*******************************************************************************/
+int bench_run(const char *name, uint32_t reps, bench_irq_mode_t irq_mode)
+{
+    bool all = (strcmp(name, "all") == 0);
+    capture_buffer_t *buffer;
+    uint32_t count = 0;
+    int result = 0;
+
+    if (reps == 0) {
+        reps = BENCH_DEFAULT_REPS;
+    }
+    if (reps > BENCH_MAX_REPS) {
+        reps = BENCH_MAX_REPS;
+    }
+
+    if (!bench_cycle_counter_init()) {
+        printf("BENCH_ERROR,DWT cycle counter not running\r\n");
+        return -1;
+    }
+
+    /* Smallest empty measurement is the cost of the timing itself */
+    bench_overhead = UINT32_MAX;
+    for (uint32_t i = 0; i < BENCH_CALIBRATION_REPS; i++) {
+        uint32_t cycles = bench_measure(bench_empty, true);
+        if (cycles < bench_overhead) {
+            bench_overhead = cycles;
+        }
+    }
+
+    buffer = capture_pool_acquire();
+    if ((buffer == NULL) || ((buffer->capacity * sizeof(int16_t)) < BENCH_SOCMEM_BYTES)) {
+        printf("BENCH_ERROR,capture pool busy, wait for takes to be saved\r\n");
+        capture_pool_release(buffer);
+        return -1;
+    }
+    bench_socmem = buffer->samples;
+
+    printf("BENCH_INFO,clock_hz,%u,overhead_cycles,%u,build,%s %s\r\n",
+           (unsigned int)SystemCoreClock, (unsigned int)bench_overhead, __DATE__, __TIME__);
+    printf("BENCH,case,irq,reps,samples,min,median,max,cycles_per_sample\r\n");
+
+    for (uint32_t i = 0; i < BENCH_NUM_CASES; i++) {
+        if (all || (strcmp(name, bench_cases[i].name) == 0)) {
+            if (bench_run_case(&bench_cases[i], reps, irq_mode) != 0) {
+                result = -1;
+            }
+            count++;
+        }
+    }
+
+    capture_pool_release(buffer);
+    bench_socmem = NULL;
+
+    if (count == 0) {
+        printf("BENCH_ERROR,%s,unknown case\r\n", name);
+        bench_list();
+        return -1;
+    }
+
+    printf("BENCH_END,%u\r\n", (unsigned int)count);
+    return result;
+}
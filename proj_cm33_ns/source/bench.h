@@ -0,0 +1,52 @@
+/******************************************************************************
+* File Name: bench.h
+*
+* Description: On-target microbenchmarks timed with the DWT cycle counter
+*              Registered cases cover the ISR FIFO loops, WAV header setup,
+*              emFile writes, memory copies, the capture high-pass and
+*              compressor and the test-signal generator; results are printed
+*              as CSV lines so runs of different firmware versions can be
+*              diffed
+*
+*******************************************************************************/
+
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define BENCH_DEFAULT_REPS          (32u)       /* Timed repetitions per case */
+#define BENCH_MAX_REPS              (256u)
+#define BENCH_WARMUP_REPS           (4u)        /* Untimed runs to settle caches and FS state */
+#define BENCH_CALIBRATION_REPS      (16u)       /* Empty runs to measure timer overhead */
+#define BENCH_COPY_BYTES            (4096u)     /* memcpy case size */
+#define BENCH_FILENAME              "bench.tmp" /* Scratch file for the write cases */
+
+/*******************************************************************************
+* Enumerations
+*******************************************************************************/
+typedef enum {
+    BENCH_IRQ_DEFAULT,          /* Case decides: masked unless it needs interrupts */
+    BENCH_IRQ_MASKED,           /* Each timed run inside a critical section */
+    BENCH_IRQ_UNMASKED          /* Interrupts and task switches may add cycles */
+} bench_irq_mode_t;
+
+/*******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+void bench_list(void);
+int bench_run(const char *name, uint32_t reps, bench_irq_mode_t irq_mode);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BENCH_H__ */
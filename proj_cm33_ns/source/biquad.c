@@ -0,0 +1,380 @@
+/******************************************************************************
+* File Name: biquad.c
+*
+* Description: Fixed-point biquad filters for the capture and playback paths
+*              Each output is five 32x32->64 multiply-accumulates (SMLAL on
+*              the CM33). The accumulator bits below the Q31 output are fed
+*              into the next sample instead of being dropped, which removes
+*              the DC offset and limit cycles that truncation would leave in
+*              a high-pass with a low cutoff. Channels are filtered one at a
+*              time so the coefficients and history stay in registers.
+*
+*******************************************************************************/
+
+#include "biquad.h"
+#include "audio_ramfunc.h"
+#include <math.h>
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define BIQUAD_ERR_MASK             ((((int64_t)1) << BIQUAD_COEF_SHIFT) - 1)
+#define BIQUAD_HPF_Q                (0.70710678)    /* Butterworth */
+
+/*******************************************************************************
+* Function Name: biquad_to_q28
+********************************************************************************
+* Summary:
+*  Round a coefficient to Q28
+*
+*******************************************************************************/
+static int32_t biquad_to_q28(double value)
+{
+    return (int32_t)lround(value * (double)(1u << BIQUAD_COEF_SHIFT));
+}
+
+/*******************************************************************************
+* Function Name: biquad_highpass
+********************************************************************************
+* Summary:
+*  Design a second order Butterworth high-pass (RBJ cookbook) and clear the
+*  history
+*
+* Parameters:
+*  bq: Filter
+*  cutoff_hz: -3 dB frequency, BIQUAD_HPF_MIN_HZ..BIQUAD_HPF_MAX_HZ
+*  sample_rate: Of the PCM that will be filtered
+*  num_channels: Interleaved channels, at most BIQUAD_MAX_CHANNELS
+*
+* Return:
+*  0 on success, -1 if a parameter is out of range
+*
+*******************************************************************************/
+int biquad_highpass(biquad_t *bq, uint32_t cutoff_hz, uint32_t sample_rate, uint16_t num_channels)
+{
+    double w0;
+    double cos_w0;
+    double alpha;
+    double a0;
+
+    if ((cutoff_hz < BIQUAD_HPF_MIN_HZ) || (cutoff_hz > BIQUAD_HPF_MAX_HZ) ||
+        ((cutoff_hz * 4u) > sample_rate) ||
+        (num_channels == 0u) || (num_channels > BIQUAD_MAX_CHANNELS)) {
+        return -1;
+    }
+
+    w0 = 2.0 * M_PI * (double)cutoff_hz / (double)sample_rate;
+    cos_w0 = cos(w0);
+    alpha = sin(w0) / (2.0 * BIQUAD_HPF_Q);
+    a0 = 1.0 + alpha;
+
+    bq->b0 = biquad_to_q28((1.0 + cos_w0) / (2.0 * a0));
+    /* Exactly -2 * b0 so the zeros sit on DC and no offset leaks through */
+    bq->b1 = -2 * bq->b0;
+    bq->b2 = bq->b0;
+    bq->a1 = biquad_to_q28(2.0 * cos_w0 / a0);
+    bq->a2 = biquad_to_q28(-(1.0 - alpha) / a0);
+    bq->num_channels = num_channels;
+    biquad_reset(bq);
+
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: biquad_design
+********************************************************************************
+* Summary:
+*  Design an equalizer band (RBJ cookbook) and clear the history
+*
+* Parameters:
+*  bq: Filter
+*  type: Response
+*  freq_hz: Centre, corner or shelf midpoint; BIQUAD_MIN_HZ up to 0.45 of
+*           the sample rate
+*  gain_db: Peak and shelf gain, +/-BIQUAD_MAX_GAIN_DB; ignored otherwise
+*  q: BIQUAD_MIN_Q..BIQUAD_MAX_Q; a shelf takes it as its slope S
+*  sample_rate: Of the samples that will be filtered
+*  num_channels: Interleaved channels, at most BIQUAD_MAX_CHANNELS
+*
+* Return:
+*  0 on success, -1 if a parameter is out of range
+*
+*******************************************************************************/
+int biquad_design(biquad_t *bq, biquad_type_t type, uint32_t freq_hz, float gain_db, float q,
+                  uint32_t sample_rate, uint16_t num_channels)
+{
+    double w0;
+    double cos_w0;
+    double alpha;
+    double amp;
+    double root;
+    double b[3];
+    double a[3];
+
+    if ((freq_hz < BIQUAD_MIN_HZ) || ((double)freq_hz > 0.45 * (double)sample_rate) ||
+        (gain_db < -BIQUAD_MAX_GAIN_DB) || (gain_db > BIQUAD_MAX_GAIN_DB) ||
+        !(q >= BIQUAD_MIN_Q) || (q > BIQUAD_MAX_Q) ||
+        (num_channels == 0u) || (num_channels > BIQUAD_MAX_CHANNELS)) {
+        return -1;
+    }
+
+    w0 = 2.0 * M_PI * (double)freq_hz / (double)sample_rate;
+    cos_w0 = cos(w0);
+    amp = pow(10.0, (double)gain_db / 40.0);
+
+    switch (type) {
+        case BIQUAD_PEAK:
+            alpha = sin(w0) / (2.0 * q);
+            b[0] = 1.0 + alpha * amp;
+            b[1] = -2.0 * cos_w0;
+            b[2] = 1.0 - alpha * amp;
+            a[0] = 1.0 + alpha / amp;
+            a[1] = -2.0 * cos_w0;
+            a[2] = 1.0 - alpha / amp;
+            break;
+
+        case BIQUAD_LOW_SHELF:
+        case BIQUAD_HIGH_SHELF:
+            root = (amp + 1.0 / amp) * (1.0 / q - 1.0) + 2.0;
+            if (root <= 0.0) {
+                return -1;      /* Slope too steep for this gain */
+            }
+            alpha = sin(w0) / 2.0 * sqrt(root);
+            root = 2.0 * sqrt(amp) * alpha;
+            if (type == BIQUAD_LOW_SHELF) {
+                b[0] = amp * ((amp + 1.0) - (amp - 1.0) * cos_w0 + root);
+                b[1] = 2.0 * amp * ((amp - 1.0) - (amp + 1.0) * cos_w0);
+                b[2] = amp * ((amp + 1.0) - (amp - 1.0) * cos_w0 - root);
+                a[0] = (amp + 1.0) + (amp - 1.0) * cos_w0 + root;
+                a[1] = -2.0 * ((amp - 1.0) + (amp + 1.0) * cos_w0);
+                a[2] = (amp + 1.0) + (amp - 1.0) * cos_w0 - root;
+            } else {
+                b[0] = amp * ((amp + 1.0) + (amp - 1.0) * cos_w0 + root);
+                b[1] = -2.0 * amp * ((amp - 1.0) + (amp + 1.0) * cos_w0);
+                b[2] = amp * ((amp + 1.0) + (amp - 1.0) * cos_w0 - root);
+                a[0] = (amp + 1.0) - (amp - 1.0) * cos_w0 + root;
+                a[1] = 2.0 * ((amp - 1.0) - (amp + 1.0) * cos_w0);
+                a[2] = (amp + 1.0) - (amp - 1.0) * cos_w0 - root;
+            }
+            break;
+
+        case BIQUAD_LOWPASS:
+            alpha = sin(w0) / (2.0 * q);
+            b[0] = (1.0 - cos_w0) / 2.0;
+            b[1] = 1.0 - cos_w0;
+            b[2] = b[0];
+            a[0] = 1.0 + alpha;
+            a[1] = -2.0 * cos_w0;
+            a[2] = 1.0 - alpha;
+            break;
+
+        case BIQUAD_HIGHPASS:
+            alpha = sin(w0) / (2.0 * q);
+            b[0] = (1.0 + cos_w0) / 2.0;
+            b[1] = -(1.0 + cos_w0);
+            b[2] = b[0];
+            a[0] = 1.0 + alpha;
+            a[1] = -2.0 * cos_w0;
+            a[2] = 1.0 - alpha;
+            break;
+
+        default:
+            return -1;
+    }
+
+    bq->b0 = biquad_to_q28(b[0] / a[0]);
+    bq->b1 = biquad_to_q28(b[1] / a[0]);
+    bq->b2 = biquad_to_q28(b[2] / a[0]);
+    bq->a1 = biquad_to_q28(-a[1] / a[0]);
+    bq->a2 = biquad_to_q28(-a[2] / a[0]);
+    bq->num_channels = num_channels;
+    biquad_reset(bq);
+
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: biquad_response_db
+********************************************************************************
+* Summary:
+*  Magnitude response of the quantized coefficients at one frequency
+*
+*******************************************************************************/
+float biquad_response_db(const biquad_t *bq, float freq_hz, uint32_t sample_rate)
+{
+    const double scale = 1.0 / (double)(1u << BIQUAD_COEF_SHIFT);
+    double w = 2.0 * M_PI * (double)freq_hz / (double)sample_rate;
+    double c1 = cos(w);
+    double s1 = sin(w);
+    double c2 = cos(2.0 * w);
+    double s2 = sin(2.0 * w);
+    /* H(z) = (b0 + b1 z^-1 + b2 z^-2) / (1 - a1 z^-1 - a2 z^-2), z = e^jw */
+    double num_re = (bq->b0 + bq->b1 * c1 + bq->b2 * c2) * scale;
+    double num_im = -(bq->b1 * s1 + bq->b2 * s2) * scale;
+    double den_re = 1.0 - (bq->a1 * c1 + bq->a2 * c2) * scale;
+    double den_im = (bq->a1 * s1 + bq->a2 * s2) * scale;
+    double num = num_re * num_re + num_im * num_im;
+    double den = den_re * den_re + den_im * den_im;
+
+    if ((num <= 0.0) || (den <= 0.0)) {
+        return (num <= 0.0) ? -200.0f : 200.0f;
+    }
+    return (float)(10.0 * log10(num / den));
+}
+
+/*******************************************************************************
+* Function Name: biquad_reset
+********************************************************************************
+* Summary:
+*  Clear the history, e.g. before a new take
+*
+*******************************************************************************/
+void biquad_reset(biquad_t *bq)
+{
+    for (uint32_t ch = 0; ch < BIQUAD_MAX_CHANNELS; ch++) {
+        bq->state[ch].x1 = 0;
+        bq->state[ch].x2 = 0;
+        bq->state[ch].y1 = 0;
+        bq->state[ch].y2 = 0;
+        bq->state[ch].err = 0;
+    }
+}
+
+/*******************************************************************************
+* Function Name: biquad_process
+********************************************************************************
+* Summary:
+*  Filter interleaved samples in place, continuing from the previous call
+*  - Outputs beyond 16 bits saturate
+*
+* Parameters:
+*  bq: Filter from biquad_highpass()
+*  pcm: bq->num_channels samples per frame
+*  frames: Frames to filter
+*
+*******************************************************************************/
+AUDIO_RAMFUNC_BEGIN
+void biquad_process(biquad_t *bq, int16_t *pcm, uint32_t frames)
+{
+    const int32_t b0 = bq->b0;
+    const int32_t b1 = bq->b1;
+    const int32_t b2 = bq->b2;
+    const int32_t a1 = bq->a1;
+    const int32_t a2 = bq->a2;
+    const uint32_t stride = bq->num_channels;
+
+    for (uint32_t ch = 0; ch < stride; ch++) {
+        biquad_state_t *state = &bq->state[ch];
+        int32_t x1 = state->x1;
+        int32_t x2 = state->x2;
+        int32_t y1 = state->y1;
+        int32_t y2 = state->y2;
+        int64_t err = state->err;
+        int16_t *sample = &pcm[ch];
+
+        for (uint32_t i = 0; i < frames; i++) {
+            int32_t x0 = (int32_t)*sample * 65536;
+            int64_t acc = err;
+            int64_t y0;
+            int32_t out;
+
+            acc += (int64_t)b0 * x0;
+            acc += (int64_t)b1 * x1;
+            acc += (int64_t)b2 * x2;
+            acc += (int64_t)a1 * y1;
+            acc += (int64_t)a2 * y2;
+            y0 = acc >> BIQUAD_COEF_SHIFT;
+            err = acc & BIQUAD_ERR_MASK;
+            if (y0 > INT32_MAX) {
+                y0 = INT32_MAX;
+            } else if (y0 < INT32_MIN) {
+                y0 = INT32_MIN;
+            }
+
+            x2 = x1;
+            x1 = x0;
+            y2 = y1;
+            y1 = (int32_t)y0;
+
+            out = (int32_t)((y0 + 0x8000) >> 16);
+            *sample = (out > INT16_MAX) ? INT16_MAX : (int16_t)out;
+            sample += stride;
+        }
+
+        state->x1 = x1;
+        state->x2 = x2;
+        state->y1 = y1;
+        state->y2 = y2;
+        state->err = err;
+    }
+}
+AUDIO_RAMFUNC_END
+
+/*******************************************************************************
+* Function Name: biquad_process_q31
+********************************************************************************
+* Summary:
+*  Filter interleaved 32-bit values in place, continuing from the previous
+*  call; the playback equalizer runs its bands one after the other on the
+*  same block, so nothing is rounded between them
+*  - Outputs beyond 32 bits saturate
+*
+* Parameters:
+*  bq: Filter from biquad_design()
+*  samples: bq->num_channels values per frame, scaled with headroom
+*  frames: Frames to filter
+*
+*******************************************************************************/
+AUDIO_RAMFUNC_BEGIN
+void biquad_process_q31(biquad_t *bq, int32_t *samples, uint32_t frames)
+{
+    const int32_t b0 = bq->b0;
+    const int32_t b1 = bq->b1;
+    const int32_t b2 = bq->b2;
+    const int32_t a1 = bq->a1;
+    const int32_t a2 = bq->a2;
+    const uint32_t stride = bq->num_channels;
+
+    for (uint32_t ch = 0; ch < stride; ch++) {
+        biquad_state_t *state = &bq->state[ch];
+        int32_t x1 = state->x1;
+        int32_t x2 = state->x2;
+        int32_t y1 = state->y1;
+        int32_t y2 = state->y2;
+        int64_t err = state->err;
+        int32_t *sample = &samples[ch];
+
+        for (uint32_t i = 0; i < frames; i++) {
+            int32_t x0 = *sample;
+            int64_t acc = err;
+            int64_t y0;
+
+            acc += (int64_t)b0 * x0;
+            acc += (int64_t)b1 * x1;
+            acc += (int64_t)b2 * x2;
+            acc += (int64_t)a1 * y1;
+            acc += (int64_t)a2 * y2;
+            y0 = acc >> BIQUAD_COEF_SHIFT;
+            err = acc & BIQUAD_ERR_MASK;
+            if (y0 > INT32_MAX) {
+                y0 = INT32_MAX;
+            } else if (y0 < INT32_MIN) {
+                y0 = INT32_MIN;
+            }
+
+            x2 = x1;
+            x1 = x0;
+            y2 = y1;
+            y1 = (int32_t)y0;
+            *sample = y1;
+            sample += stride;
+        }
+
+        state->x1 = x1;
+        state->x2 = x2;
+        state->y1 = y1;
+        state->y2 = y2;
+        state->err = err;
+    }
+}
+AUDIO_RAMFUNC_END
@@ -0,0 +1,85 @@
+/******************************************************************************
+* File Name: biquad.h
+*
+* Description: Fixed-point biquad filters for the capture and playback paths
+*              Direct form I on interleaved samples, filtered in place:
+*              16-bit PCM for the capture high-pass, 32-bit values for the
+*              playback equalizer, whose bands are cascaded without rounding
+*              to 16 bits between them. Coefficients are Q28 and the state
+*              is kept as Q31 so a filter with a low cutoff stays quiet;
+*              state carries over between calls, so audio can be filtered
+*              in blocks as it arrives.
+*
+*******************************************************************************/
+
+#ifndef __BIQUAD_H__
+#define __BIQUAD_H__
+
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define BIQUAD_COEF_SHIFT           (28u)       /* Q28: coefficients up to +/-8 */
+#define BIQUAD_MAX_CHANNELS         (2u)
+#define BIQUAD_HPF_MIN_HZ           (10u)
+#define BIQUAD_HPF_MAX_HZ           (2000u)
+#define BIQUAD_MIN_HZ               (20u)       /* Equalizer bands */
+#define BIQUAD_MAX_GAIN_DB          (15)        /* Keeps the coefficients inside Q28 */
+#define BIQUAD_MIN_Q                (0.1f)
+#define BIQUAD_MAX_Q                (10.0f)
+
+/*******************************************************************************
+* Enumerations
+*******************************************************************************/
+/* RBJ cookbook responses; gain applies to the peak and shelves */
+typedef enum {
+    BIQUAD_PEAK,
+    BIQUAD_LOW_SHELF,
+    BIQUAD_HIGH_SHELF,
+    BIQUAD_LOWPASS,
+    BIQUAD_HIGHPASS
+} biquad_type_t;
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+/* History of one channel */
+typedef struct {
+    int32_t x1;                 /* Inputs, Q31 */
+    int32_t x2;
+    int32_t y1;                 /* Outputs, Q31 */
+    int32_t y2;
+    int64_t err;                /* Accumulator bits dropped from the last output */
+} biquad_state_t;
+
+typedef struct {
+    int32_t b0;                 /* Q28 */
+    int32_t b1;
+    int32_t b2;
+    int32_t a1;                 /* Q28, negated: y += a1 * y1 + a2 * y2 */
+    int32_t a2;
+    uint16_t num_channels;
+    biquad_state_t state[BIQUAD_MAX_CHANNELS];
+} biquad_t;
+
+/*******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+int biquad_highpass(biquad_t *bq, uint32_t cutoff_hz, uint32_t sample_rate, uint16_t num_channels);
+int biquad_design(biquad_t *bq, biquad_type_t type, uint32_t freq_hz, float gain_db, float q,
+                  uint32_t sample_rate, uint16_t num_channels);
+float biquad_response_db(const biquad_t *bq, float freq_hz, uint32_t sample_rate);
+void biquad_reset(biquad_t *bq);
+void biquad_process(biquad_t *bq, int16_t *pcm, uint32_t frames);
+void biquad_process_q31(biquad_t *bq, int32_t *samples, uint32_t frames);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BIQUAD_H__ */
@@ -0,0 +1,213 @@
+/******************************************************************************
+* File Name: capture_pool.c
+*
+* Description: Pool of capture buffers in shared SOCMEM
+*              Takes are usually released in the order they were recorded,
+*              so the free blocks stay in long runs. Acquire never waits:
+*              when no block or descriptor is free it fails and the caller
+*              reports it, instead of recording over a take that has not
+*              been saved yet.
+*
+*******************************************************************************/
+
+#include "capture_pool.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+/* Record memory, shared with the CM55 region; the whole of it is one take
+ * of BUFFER_SIZE frames when nothing else is held */
+static int16_t capture_pool_data[CAPTURE_POOL_SAMPLES] __attribute__((section(".cy_shared_socmem")));
+
+static capture_buffer_t capture_buffers[CAPTURE_POOL_MAX_TAKES];
+static uint8_t block_owner[CAPTURE_POOL_BLOCKS];   /* Buffer index + 1, 0 if free */
+static uint32_t capture_pool_exhausted;
+
+/*******************************************************************************
+* Function Name: capture_pool_largest_run
+********************************************************************************
+* Summary:
+*  Find the longest run of free blocks; call inside a critical section
+*
+* Parameters:
+*  first: Output - first block of the run, if any
+*
+* Return:
+*  Blocks in the run, 0 if all are held
+*
+*******************************************************************************/
+static uint32_t capture_pool_largest_run(uint32_t *first)
+{
+    uint32_t best = 0;
+    uint32_t run = 0;
+
+    for (uint32_t i = 0; i < CAPTURE_POOL_BLOCKS; i++) {
+        if (block_owner[i] != 0u) {
+            run = 0;
+            continue;
+        }
+        run++;
+        if (run > best) {
+            best = run;
+            *first = i + 1u - run;
+        }
+    }
+    return best;
+}
+
+/*******************************************************************************
+* Function Name: capture_pool_acquire
+********************************************************************************
+* Summary:
+*  Claim the longest free run of blocks for a new take, without waiting
+*
+* Return:
+*  Buffer owned by the caller, or NULL if the pool is exhausted
+*
+*******************************************************************************/
+capture_buffer_t *capture_pool_acquire(void)
+{
+    capture_buffer_t *buffer = NULL;
+    uint32_t first = 0;
+    uint32_t blocks;
+
+    taskENTER_CRITICAL();
+    for (uint32_t i = 0; i < CAPTURE_POOL_MAX_TAKES; i++) {
+        if (capture_buffers[i].refs == 0u) {
+            buffer = &capture_buffers[i];
+            break;
+        }
+    }
+    blocks = capture_pool_largest_run(&first);
+    if ((buffer == NULL) || (blocks == 0u)) {
+        capture_pool_exhausted++;
+        taskEXIT_CRITICAL();
+        return NULL;
+    }
+
+    buffer->index = (uint8_t)(buffer - capture_buffers);
+    buffer->first_block = (uint8_t)first;
+    buffer->num_blocks = (uint8_t)blocks;
+    buffer->samples = &capture_pool_data[first * CAPTURE_POOL_BLOCK_SAMPLES];
+    buffer->capacity = blocks * CAPTURE_POOL_BLOCK_SAMPLES;
+    buffer->refs = 1;
+    for (uint32_t i = first; i < first + blocks; i++) {
+        block_owner[i] = (uint8_t)(buffer->index + 1u);
+    }
+    taskEXIT_CRITICAL();
+
+    return buffer;
+}
+
+/*******************************************************************************
+* Function Name: capture_pool_trim
+********************************************************************************
+* Summary:
+*  Give back the blocks past the end of a finished take so the next take
+*  can use them; the first block is always kept
+*
+* Parameters:
+*  buffer: Buffer from capture_pool_acquire(), not yet handed over
+*  samples: Samples the take holds
+*
+*******************************************************************************/
+void capture_pool_trim(capture_buffer_t *buffer, uint32_t samples)
+{
+    uint32_t keep = (samples + CAPTURE_POOL_BLOCK_SAMPLES - 1u) / CAPTURE_POOL_BLOCK_SAMPLES;
+
+    if (keep == 0u) {
+        keep = 1;
+    }
+
+    taskENTER_CRITICAL();
+    if (keep < buffer->num_blocks) {
+        for (uint32_t i = buffer->first_block + keep; i < (uint32_t)buffer->first_block + buffer->num_blocks; i++) {
+            block_owner[i] = 0;
+        }
+        buffer->num_blocks = (uint8_t)keep;
+        buffer->capacity = keep * CAPTURE_POOL_BLOCK_SAMPLES;
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+* Function Name: capture_pool_retain
+********************************************************************************
+* Summary:
+*  Add an owner to a buffer, e.g. a playback session reading the take while
+*  FileWriteTask saves it
+*
+* Parameters:
+*  buffer: Buffer the caller already holds a reference to
+*
+*******************************************************************************/
+void capture_pool_retain(capture_buffer_t *buffer)
+{
+    taskENTER_CRITICAL();
+    buffer->refs++;
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+* Function Name: capture_pool_release
+********************************************************************************
+* Summary:
+*  Drop one owner's hold; the blocks return to the pool with the last one
+*
+* Parameters:
+*  buffer: Buffer the caller owns, NULL is ignored
+*
+*******************************************************************************/
+void capture_pool_release(capture_buffer_t *buffer)
+{
+    if (buffer == NULL) {
+        return;
+    }
+
+    taskENTER_CRITICAL();
+    if (buffer->refs > 0u) {
+        buffer->refs--;
+        if (buffer->refs == 0u) {
+            for (uint32_t i = buffer->first_block; i < (uint32_t)buffer->first_block + buffer->num_blocks; i++) {
+                block_owner[i] = 0;
+            }
+            buffer->num_blocks = 0;
+            buffer->capacity = 0;
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+* Function Name: capture_pool_get_status
+********************************************************************************
+* Summary:
+*  Occupancy of the pool
+*
+* Parameters:
+*  status: Output
+*
+*******************************************************************************/
+void capture_pool_get_status(capture_pool_status_t *status)
+{
+    uint32_t first = 0;
+
+    taskENTER_CRITICAL();
+    status->free_blocks = 0;
+    for (uint32_t i = 0; i < CAPTURE_POOL_BLOCKS; i++) {
+        if (block_owner[i] == 0u) {
+            status->free_blocks++;
+        }
+    }
+    status->largest_free = capture_pool_largest_run(&first);
+    status->takes = 0;
+    for (uint32_t i = 0; i < CAPTURE_POOL_MAX_TAKES; i++) {
+        if (capture_buffers[i].refs != 0u) {
+            status->takes++;
+        }
+    }
+    status->exhausted = capture_pool_exhausted;
+    taskEXIT_CRITICAL();
+}
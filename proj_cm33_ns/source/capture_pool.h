@@ -0,0 +1,68 @@
+/******************************************************************************
+* File Name: capture_pool.h
+*
+* Description: Pool of capture buffers in shared SOCMEM
+*              The record memory is divided into blocks. A take claims the
+*              longest run of free blocks when it starts, gives back the
+*              blocks it did not fill when it stops, and the rest stay with
+*              the take until its last owner releases it. A new take can
+*              therefore start while earlier ones are still being saved,
+*              and a take can be played from RAM while it is written.
+*
+*******************************************************************************/
+
+#ifndef __CAPTURE_POOL_H__
+#define __CAPTURE_POOL_H__
+
+#include <stdint.h>
+#include "app_pdm_pcm.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define CAPTURE_POOL_SAMPLES        (NUM_CHANNELS * BUFFER_SIZE)
+#define CAPTURE_POOL_BLOCKS         (8u)        /* 0.5 s each at 16 kHz stereo */
+#define CAPTURE_POOL_BLOCK_SAMPLES  (CAPTURE_POOL_SAMPLES / CAPTURE_POOL_BLOCKS)
+#define CAPTURE_POOL_MAX_TAKES      (3u)        /* Recording plus two waiting to be saved */
+/* Default 'take_ms': two takes of this length fit in the pool, so a take
+ * can record while the previous one is saved */
+#define CAPTURE_POOL_DEFAULT_TAKE_MS ((RECORDING_DURATION_SEC * 1000u) / 2u)
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+/* One take's share of the pool; pass the pointer on to hand over ownership */
+typedef struct {
+    int16_t *samples;           /* Interleaved frames */
+    uint32_t capacity;          /* Samples, a whole number of blocks */
+    uint8_t index;              /* 0..CAPTURE_POOL_MAX_TAKES-1, for per-take state kept elsewhere */
+    uint8_t first_block;
+    uint8_t num_blocks;
+    uint8_t refs;               /* Owners; 0 while the descriptor is free */
+} capture_buffer_t;
+
+typedef struct {
+    uint32_t free_blocks;
+    uint32_t largest_free;      /* Blocks in the longest free run: the next take's limit */
+    uint32_t takes;             /* Buffers held */
+    uint32_t exhausted;         /* Acquires refused since boot */
+} capture_pool_status_t;
+
+/*******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+capture_buffer_t *capture_pool_acquire(void);
+void capture_pool_trim(capture_buffer_t *buffer, uint32_t samples);
+void capture_pool_retain(capture_buffer_t *buffer);
+void capture_pool_release(capture_buffer_t *buffer);
+void capture_pool_get_status(capture_pool_status_t *status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CAPTURE_POOL_H__ */
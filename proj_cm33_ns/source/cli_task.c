@@ -6,7 +6,9 @@
 *******************************************************************************/
 
 #include "cli_task.h"
+#include "output_ctrl.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 /*******************************************************************************
@@ -21,6 +23,69 @@ TaskHandle_t cli_task_handle = NULL;
 *******************************************************************************/
 static char cmd_buffer[CLI_MAX_CMD_LENGTH];
 
+/*******************************************************************************
+* Function Name: cli_print_help
+********************************************************************************
+* Summary:
+*  Print the list of available commands
+*
+*******************************************************************************/
+static void cli_print_help(void)
+{
+    printf("Available commands:\r\n");
+    printf("  help            - Show this help message\r\n");
+    printf("  record [seconds] | record <n> frames\r\n");
+    printf("                  - Start recording, until 'stop' or exactly this long\r\n");
+    printf("  stop            - Stop recording and playback\r\n");
+    printf("  ls              - List files\r\n");
+    printf("  status          - Show the capture and playback sessions\r\n");
+    printf("  play <filename> - Play WAV file\r\n");
+    printf("  replay          - Play the last take from RAM, card or not\r\n");
+    printf("  cache [clear]   - Clip cache statistics and contents\r\n");
+    printf("  gen tone <hz> [ms] [atten_db]\r\n");
+    printf("  gen sweep <from_hz> <to_hz> <ms> [atten_db]\r\n");
+    printf("  gen noise|pink [ms] [atten_db]\r\n");
+    printf("  gen click <period_ms> [ms] [atten_db]\r\n");
+    printf("                  - Play a test signal (ms 0: until 'gen stop')\r\n");
+    printf("  latency [trials] [atten_db]\r\n");
+    printf("                  - Speaker to mic round trip, mean and jitter\r\n");
+    printf("  eq <band> <type> <hz> <gain_db> [q_x100]\r\n");
+    printf("  eq <band> off | eq clear | eq norm <off|lu> | eq limit <off|db>\r\n");
+    printf("                  - Playback equalizer, loudness normalizer, limiter\r\n");
+    printf("  vol [db]        - Playback volume, %d..%d dB\r\n", OUTPUT_MIN_VOLUME_DB, OUTPUT_MAX_VOLUME_DB);
+    printf("  mute [on|off]   - Fade the playback out and mute the DAC, or back in\r\n");
+    printf("  route [spk|hp|both]\r\n");
+    printf("                  - Speaker and/or headphone output, faded over the switch\r\n");
+    printf("  tdm [map]       - TDM slot sources from the next play, e.g. LRLR, LRM--MLR\r\n");
+    printf("  rm <filename>   - Delete file\r\n");
+    printf("  get <filename> [offset] [baud]\r\n");
+    printf("                  - Send file to host (use tools/xfer.py)\r\n");
+    printf("  put <filename> <size> [baud]\r\n");
+    printf("                  - Receive file from host (use tools/xfer.py)\r\n");
+    printf("  peaks <filename> [level]\r\n");
+    printf("                  - Check/rebuild waveform peaks, CSV output\r\n");
+    printf("  segment [off|trim|split] [gap_ms] [level_db]\r\n");
+    printf("  segment pad <pre_ms> <post_ms>\r\n");
+    printf("                  - Save only the active parts of recordings\r\n");
+    printf("  filter [hpf|dc|fir0|scale|settle] [value]\r\n");
+    printf("                  - Capture DC blocker, decimation and high-pass\r\n");
+    printf("  comp [on|off] [threshold_db] [ratio] | comp trace|notrace\r\n");
+    printf("  comp time <attack_ms> <release_ms> [lookahead_ms]\r\n");
+    printf("  comp limit <ceiling_db> [makeup_db]\r\n");
+    printf("                  - Capture compressor and look-ahead limiter\r\n");
+    printf("  config [get] [name] | config set <name> <value> | config save\r\n");
+    printf("                  - Settings kept on the SD card, loaded at boot\r\n");
+    printf("  isr [reset]     - PDM and I2S interrupt time and entry jitter\r\n");
+    printf("  time [YYYY-MM-DD HH:MM:SS]\r\n");
+    printf("                  - Show or set the recording clock\r\n");
+    printf("  bench [case|all] [reps] [irq]\r\n");
+    printf("                  - Cycle benchmarks, CSV output (no case: list)\r\n");
+    printf("  membench <cm33|cm55|all> [load] [save]\r\n");
+    printf("                  - SRAM, SOCMEM and XIP bandwidth and latency\r\n");
+    printf("  codec [verify] | codec <page> <reg> [value]\r\n");
+    printf("                  - Codec register cache: statistics, read, write\r\n");
+}
+
 /*******************************************************************************
 * Function Name: cli_parse_command
 ********************************************************************************
@@ -39,42 +104,94 @@ static bool cli_parse_command(const char *cmd_str, audio_command_msg_t *msg)
 {
     char cmd[16];
     char arg[32];
+    unsigned long num[CLI_MAX_NUM_ARGS];
     int num_parsed;
     
     /* Clear message structure */
     memset(msg, 0, sizeof(audio_command_msg_t));
     msg->cmd = CMD_UNKNOWN;
     
-    /* Parse command and optional argument */
-    num_parsed = sscanf(cmd_str, "%15s %31s", cmd, arg);
+    /* Parse command, optional argument and optional numeric arguments */
+    num_parsed = sscanf(cmd_str, "%15s %31s %lu %lu %lu %lu", cmd, arg,
+                        &num[0], &num[1], &num[2], &num[3]);
     
     if (num_parsed < 1) {
         return false;
     }
     
+    /* Numeric arguments follow the filename argument */
+    for (int i = 2; i < num_parsed; i++) {
+        msg->args[msg->num_args++] = (uint32_t)num[i - 2];
+    }
+    
     /* Match command */
     if (strcmp(cmd, "help") == 0) {
-        printf("Available commands:\r\n");
-        printf("  help            - Show this help message\r\n");
-        printf("  record          - Start recording\r\n");
-        printf("  stop            - Stop recording\r\n");
-        printf("  ls              - List files\r\n");
-        printf("  play <filename> - Play WAV file\r\n");
-        printf("  rm <filename>   - Delete file\r\n");
+        cli_print_help();
         return false;  /* Don't send to audio task */
     }
     else if (strcmp(cmd, "record") == 0) {
+        char unit[8];
+        char *end;
+        unsigned long value;
+        int units;
+        
+        /* Length in ms in args[0], or in frames with "frames" in filename */
         msg->cmd = CMD_START_RECORD;
+        msg->num_args = 0;
+        if (num_parsed >= 2) {
+            value = ((arg[0] >= '0') && (arg[0] <= '9')) ? strtoul(arg, &end, 10) : 0u;
+            units = sscanf(cmd_str, "%*s %*s %7s", unit);
+            if ((arg[0] < '0') || (arg[0] > '9') || (value > UINT32_MAX)) {
+                printf("Usage: record [seconds] | record <n> frames\r\n");
+                return false;
+            }
+            if (units == 1) {
+                /* A whole number of frames; nothing but "frames" may follow */
+                if ((*end != '\0') || (strcmp(unit, "frames") != 0)) {
+                    printf("Usage: record [seconds] | record <n> frames\r\n");
+                    return false;
+                }
+                strcpy(msg->filename, "frames");
+                msg->args[0] = (uint32_t)value;
+            } else {
+                /* Seconds, to the millisecond */
+                uint64_t ms = (uint64_t)value * 1000u;
+                uint32_t scale = 1000u;
+                
+                if (*end == '.') {
+                    for (end++; (*end >= '0') && (*end <= '9'); end++) {
+                        if (scale > 1u) {
+                            scale /= 10u;
+                            ms += (uint64_t)(*end - '0') * scale;
+                        }
+                    }
+                }
+                if ((*end != '\0') || (ms > UINT32_MAX)) {
+                    printf("Usage: record [seconds] | record <n> frames\r\n");
+                    return false;
+                }
+                msg->args[0] = (uint32_t)ms;
+            }
+            msg->num_args = 1;
+        }
         return true;
     }
     else if (strcmp(cmd, "stop") == 0) {
-        msg->cmd = CMD_STOP_RECORD;
+        msg->cmd = CMD_STOP;
         return true;
     }
     else if (strcmp(cmd, "ls") == 0) {
         msg->cmd = CMD_LIST_FILES;
         return true;
     }
+    else if (strcmp(cmd, "status") == 0) {
+        msg->cmd = CMD_STATUS;
+        return true;
+    }
+    else if (strcmp(cmd, "replay") == 0) {
+        msg->cmd = CMD_REPLAY;
+        return true;
+    }
     else if (strcmp(cmd, "play") == 0) {
         if (num_parsed >= 2) {
             msg->cmd = CMD_PLAY_FILE;
@@ -99,15 +216,254 @@ static bool cli_parse_command(const char *cmd_str, audio_command_msg_t *msg)
             return false;
         }
     }
+    else if (strcmp(cmd, "get") == 0) {
+        if (num_parsed >= 2) {
+            msg->cmd = CMD_GET_FILE;
+            strncpy(msg->filename, arg, sizeof(msg->filename) - 1);
+            msg->filename[sizeof(msg->filename) - 1] = '\0';
+            return true;
+        }
+        else {
+            printf("Usage: get <filename> [offset] [baud]\r\n");
+            return false;
+        }
+    }
+    else if (strcmp(cmd, "put") == 0) {
+        if (num_parsed >= 3) {
+            msg->cmd = CMD_PUT_FILE;
+            strncpy(msg->filename, arg, sizeof(msg->filename) - 1);
+            msg->filename[sizeof(msg->filename) - 1] = '\0';
+            return true;
+        }
+        else {
+            printf("Usage: put <filename> <size> [baud]\r\n");
+            return false;
+        }
+    }
+    else if (strcmp(cmd, "peaks") == 0) {
+        if (num_parsed >= 2) {
+            msg->cmd = CMD_PEAKS;
+            strncpy(msg->filename, arg, sizeof(msg->filename) - 1);
+            msg->filename[sizeof(msg->filename) - 1] = '\0';
+            return true;
+        }
+        else {
+            printf("Usage: peaks <filename> [level]\r\n");
+            return false;
+        }
+    }
+    else if (strcmp(cmd, "segment") == 0) {
+        /* Mode or "pad" is optional; without it the settings are shown */
+        msg->cmd = CMD_SEGMENT;
+        if (num_parsed >= 2) {
+            strncpy(msg->filename, arg, sizeof(msg->filename) - 1);
+            msg->filename[sizeof(msg->filename) - 1] = '\0';
+        }
+        return true;
+    }
+    else if (strcmp(cmd, "filter") == 0) {
+        /* Setting name is optional; without it the settings are shown */
+        msg->cmd = CMD_FILTER;
+        if (num_parsed >= 2) {
+            strncpy(msg->filename, arg, sizeof(msg->filename) - 1);
+            msg->filename[sizeof(msg->filename) - 1] = '\0';
+        }
+        return true;
+    }
+    else if (strcmp(cmd, "comp") == 0) {
+        /* Setting name is optional; without it the settings are shown */
+        msg->cmd = CMD_COMP;
+        if (num_parsed >= 2) {
+            strncpy(msg->filename, arg, sizeof(msg->filename) - 1);
+            msg->filename[sizeof(msg->filename) - 1] = '\0';
+        }
+        return true;
+    }
+    else if (strcmp(cmd, "time") == 0) {
+        unsigned int year, month, day, hour, minute, second;
+        
+        msg->cmd = CMD_TIME;
+        msg->num_args = 0;
+        if (num_parsed >= 2) {
+            /* Date and time packed as YYYYMMDD and HHMMSS */
+            if (sscanf(cmd_str, "%*s %u-%u-%u %u:%u:%u",
+                       &year, &month, &day, &hour, &minute, &second) != 6) {
+                printf("Usage: time [YYYY-MM-DD HH:MM:SS]\r\n");
+                return false;
+            }
+            msg->args[0] = year * 10000u + month * 100u + day;
+            msg->args[1] = hour * 10000u + minute * 100u + second;
+            msg->num_args = 2;
+        }
+        return true;
+    }
+    else if (strcmp(cmd, "cache") == 0) {
+        /* "clear" is optional; without it the statistics are shown */
+        msg->cmd = CMD_CACHE;
+        if (num_parsed >= 2) {
+            strncpy(msg->filename, arg, sizeof(msg->filename) - 1);
+            msg->filename[sizeof(msg->filename) - 1] = '\0';
+        }
+        return true;
+    }
+    else if (strcmp(cmd, "gen") == 0) {
+        /* Signal type is optional; without it the generator state is shown */
+        msg->cmd = CMD_GEN;
+        if (num_parsed >= 2) {
+            strncpy(msg->filename, arg, sizeof(msg->filename) - 1);
+            msg->filename[sizeof(msg->filename) - 1] = '\0';
+        }
+        return true;
+    }
+    else if (strcmp(cmd, "latency") == 0) {
+        unsigned long trials, atten_db = 0;
+        
+        /* Both numbers are optional; the defaults are in latency.h */
+        msg->cmd = CMD_LATENCY;
+        msg->num_args = 0;
+        if (num_parsed >= 2) {
+            int count = sscanf(cmd_str, "%*s %lu %lu", &trials, &atten_db);
+            if (count < 1) {
+                printf("Usage: latency [trials] [atten_db]\r\n");
+                return false;
+            }
+            msg->args[0] = (uint32_t)trials;
+            msg->args[1] = (uint32_t)atten_db;
+            msg->num_args = (uint8_t)count;
+        }
+        return true;
+    }
+    else if (strcmp(cmd, "eq") == 0) {
+        const char *settings = strstr(cmd_str, "eq") + 2;
+        
+        /* Settings are optional; AudioControl parses the text, as a gain
+         * can be negative */
+        msg->cmd = CMD_EQ;
+        while (*settings == ' ') {
+            settings++;
+        }
+        if (strlen(settings) >= sizeof(msg->filename)) {
+            printf("Usage: eq <band> <type> <hz> <gain_db> [q_x100]\r\n");
+            return false;
+        }
+        strcpy(msg->filename, settings);
+        msg->num_args = 0;
+        return true;
+    }
+    else if (strcmp(cmd, "config") == 0) {
+        const char *settings = strstr(cmd_str, "config") + 6;
+        
+        /* AudioControl parses the text, as a value can be negative or a
+         * name */
+        msg->cmd = CMD_CONFIG;
+        while (*settings == ' ') {
+            settings++;
+        }
+        if (strlen(settings) >= sizeof(msg->filename)) {
+            printf("Usage: config [get] [name] | config set <name> <value> | config save\r\n");
+            return false;
+        }
+        strcpy(msg->filename, settings);
+        msg->num_args = 0;
+        return true;
+    }
+    else if (strcmp(cmd, "isr") == 0) {
+        /* "reset" is optional; without it the timings are shown */
+        msg->cmd = CMD_ISR;
+        if (num_parsed >= 2) {
+            strncpy(msg->filename, arg, sizeof(msg->filename) - 1);
+            msg->filename[sizeof(msg->filename) - 1] = '\0';
+        }
+        return true;
+    }
+    else if (strcmp(cmd, "bench") == 0) {
+        /* Case name is optional; without it the cases are listed */
+        msg->cmd = CMD_BENCH;
+        if (num_parsed >= 2) {
+            strncpy(msg->filename, arg, sizeof(msg->filename) - 1);
+            msg->filename[sizeof(msg->filename) - 1] = '\0';
+        }
+        return true;
+    }
+    else if (strcmp(cmd, "membench") == 0) {
+        const char *options = strstr(cmd_str, "membench") + 8;
+        
+        /* Options are words in any order; AudioControl parses the text */
+        msg->cmd = CMD_MEMBENCH;
+        while (*options == ' ') {
+            options++;
+        }
+        if (strlen(options) >= sizeof(msg->filename)) {
+            printf("Usage: membench <cm33|cm55|all> [load] [save]\r\n");
+            return false;
+        }
+        strcpy(msg->filename, options);
+        msg->num_args = 0;
+        return true;
+    }
+    else if (strcmp(cmd, "vol") == 0) {
+        const char *value = strstr(cmd_str, "vol") + 3;
+        
+        /* Optional; AudioControl parses the text, as the level is negative */
+        msg->cmd = CMD_VOLUME;
+        while (*value == ' ') {
+            value++;
+        }
+        if (strlen(value) >= sizeof(msg->filename)) {
+            printf("Usage: vol [db]\r\n");
+            return false;
+        }
+        strcpy(msg->filename, value);
+        msg->num_args = 0;
+        return true;
+    }
+    else if (strcmp(cmd, "mute") == 0) {
+        /* "on" is the default */
+        msg->cmd = CMD_MUTE;
+        if (num_parsed >= 2) {
+            strncpy(msg->filename, arg, sizeof(msg->filename) - 1);
+            msg->filename[sizeof(msg->filename) - 1] = '\0';
+        }
+        return true;
+    }
+    else if (strcmp(cmd, "route") == 0) {
+        /* Without a route the current one is shown */
+        msg->cmd = CMD_ROUTE;
+        if (num_parsed >= 2) {
+            strncpy(msg->filename, arg, sizeof(msg->filename) - 1);
+            msg->filename[sizeof(msg->filename) - 1] = '\0';
+        }
+        return true;
+    }
+    else if (strcmp(cmd, "tdm") == 0) {
+        /* Without a map the current layout is shown */
+        msg->cmd = CMD_TDM;
+        if (num_parsed >= 2) {
+            strncpy(msg->filename, arg, sizeof(msg->filename) - 1);
+            msg->filename[sizeof(msg->filename) - 1] = '\0';
+        }
+        return true;
+    }
+    else if (strcmp(cmd, "codec") == 0) {
+        const char *words = strstr(cmd_str, "codec") + 5;
+        
+        /* Words are optional; AudioControl parses the text, as a value can
+         * be hexadecimal */
+        msg->cmd = CMD_CODEC;
+        while (*words == ' ') {
+            words++;
+        }
+        if (strlen(words) >= sizeof(msg->filename)) {
+            printf("Usage: codec [verify] | codec <page> <reg> [value]\r\n");
+            return false;
+        }
+        strcpy(msg->filename, words);
+        msg->num_args = 0;
+        return true;
+    }
     else {
         printf("Unknown command: %s\r\n", cmd);
-        printf("Available commands:\r\n");
-        printf("  help            - Show this help message\r\n");
-        printf("  record          - Start recording\r\n");
-        printf("  stop            - Stop recording\r\n");
-        printf("  ls              - List files\r\n");
-        printf("  play <filename> - Play WAV file\r\n");
-        printf("  rm <filename>   - Delete file\r\n");
+        cli_print_help();
         return false;
     }
 }
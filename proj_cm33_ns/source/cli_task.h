@@ -25,16 +25,39 @@ extern "C" {
 #define CLI_TASK_PRIORITY           (2u)
 #define CLI_RX_QUEUE_LENGTH         (10u)
 #define CLI_MAX_CMD_LENGTH          (64u)
+#define CLI_MAX_NUM_ARGS            (4u)
 
 /*******************************************************************************
 * Enumerations
 *******************************************************************************/
 typedef enum {
     CMD_START_RECORD,
-    CMD_STOP_RECORD,
+    CMD_STOP,
     CMD_LIST_FILES,
     CMD_PLAY_FILE,
     CMD_DELETE_FILE,
+    CMD_GET_FILE,
+    CMD_PUT_FILE,
+    CMD_BENCH,
+    CMD_TIME,
+    CMD_PEAKS,
+    CMD_SEGMENT,
+    CMD_FILTER,
+    CMD_STATUS,
+    CMD_REPLAY,
+    CMD_CACHE,
+    CMD_GEN,
+    CMD_LATENCY,
+    CMD_EQ,
+    CMD_COMP,
+    CMD_CONFIG,
+    CMD_ISR,
+    CMD_MEMBENCH,
+    CMD_CODEC,
+    CMD_VOLUME,
+    CMD_MUTE,
+    CMD_ROUTE,
+    CMD_TDM,
     CMD_UNKNOWN
 } audio_cmd_t;
 
@@ -44,6 +67,8 @@ typedef enum {
 typedef struct {
     audio_cmd_t cmd;
     char filename[32];
+    uint32_t args[CLI_MAX_NUM_ARGS];    /* Numeric arguments, command specific */
+    uint8_t num_args;                   /* Number of valid entries in args */
 } audio_command_msg_t;
 
 /*******************************************************************************
@@ -0,0 +1,429 @@
+/******************************************************************************
+* File Name: clip_cache.c
+*
+* Description: RAM cache of played clips
+*              A clip is copied in while FileReadTask streams it for its
+*              first playback and played straight from RAM afterwards.
+*              Each clip is one run of blocks, so it can be queued to the
+*              I2S stream as a single buffer. The cache is invalidated by
+*              every firmware path that changes a file ('rm', uploads, new
+*              recordings); 'ls' also drops entries whose size or time no
+*              longer match the card.
+*
+*******************************************************************************/
+
+#include "clip_cache.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+/* The graphics region of SOCMEM; this application drives no display */
+static int16_t clip_cache_data[CLIP_CACHE_BYTES / sizeof(int16_t)] __attribute__((section(".cy_gpu_buf")));
+
+static clip_entry_t clip_entries[CLIP_CACHE_MAX_CLIPS];
+static uint8_t clip_block_used[CLIP_CACHE_BLOCKS];
+static uint32_t clip_sequence;
+static clip_cache_stats_t clip_stats;
+
+/*******************************************************************************
+* Function Name: clip_find
+********************************************************************************
+* Summary:
+*  Entry of a name that has not been invalidated; call inside a critical
+*  section
+*
+*******************************************************************************/
+static clip_entry_t *clip_find(const char *name)
+{
+    for (uint32_t i = 0; i < CLIP_CACHE_MAX_CLIPS; i++) {
+        clip_entry_t *clip = &clip_entries[i];
+        if ((clip->state != CLIP_FREE) && !clip->stale &&
+            (strcasecmp(clip->name, name) == 0)) {
+            return clip;
+        }
+    }
+    return NULL;
+}
+
+/*******************************************************************************
+* Function Name: clip_free
+********************************************************************************
+* Summary:
+*  Return an entry and its blocks; call inside a critical section
+*
+*******************************************************************************/
+static void clip_free(clip_entry_t *clip)
+{
+    for (uint32_t i = clip->first_block; i < clip->first_block + clip->num_blocks; i++) {
+        clip_block_used[i] = 0;
+    }
+    clip->state = CLIP_FREE;
+    clip->num_blocks = 0;
+    clip->refs = 0;
+    clip->stale = false;
+}
+
+/*******************************************************************************
+* Function Name: clip_drop
+********************************************************************************
+* Summary:
+*  Invalidate an entry: freed now if unused, otherwise by its last user;
+*  call inside a critical section
+*
+*******************************************************************************/
+static void clip_drop(clip_entry_t *clip)
+{
+    if ((clip->state == CLIP_READY) && (clip->refs == 0u)) {
+        clip_free(clip);
+    } else {
+        clip->stale = true;
+    }
+}
+
+/*******************************************************************************
+* Function Name: clip_evict_lru
+********************************************************************************
+* Summary:
+*  Free the least recently played clip that is not playing; call inside a
+*  critical section
+*
+* Return:
+*  false if there is nothing to evict
+*
+*******************************************************************************/
+static bool clip_evict_lru(void)
+{
+    clip_entry_t *oldest = NULL;
+
+    for (uint32_t i = 0; i < CLIP_CACHE_MAX_CLIPS; i++) {
+        clip_entry_t *clip = &clip_entries[i];
+        if ((clip->state == CLIP_READY) && (clip->refs == 0u) &&
+            ((oldest == NULL) || (clip->last_used < oldest->last_used))) {
+            oldest = clip;
+        }
+    }
+    if (oldest == NULL) {
+        return false;
+    }
+    clip_free(oldest);
+    clip_stats.evictions++;
+    return true;
+}
+
+/*******************************************************************************
+* Function Name: clip_find_blocks
+********************************************************************************
+* Summary:
+*  First run of free blocks long enough; call inside a critical section
+*
+* Return:
+*  First block of the run, or CLIP_CACHE_BLOCKS if there is none
+*
+*******************************************************************************/
+static uint32_t clip_find_blocks(uint32_t count)
+{
+    uint32_t run = 0;
+
+    for (uint32_t i = 0; i < CLIP_CACHE_BLOCKS; i++) {
+        run = (clip_block_used[i] != 0u) ? 0u : (run + 1u);
+        if (run == count) {
+            return i + 1u - count;
+        }
+    }
+    return CLIP_CACHE_BLOCKS;
+}
+
+/*******************************************************************************
+* Function Name: clip_cache_get
+********************************************************************************
+* Summary:
+*  Look a file up for playback and count the hit or miss
+*  - A clip whose size or time differs from the file's directory entry was
+*    changed outside this firmware (e.g. on a PC); it is forgotten and the
+*    lookup misses
+*
+* Parameters:
+*  name: File name
+*  file_size: Size of the WAV file now
+*  file_time: emFile timestamp of the file's last write now
+*
+* Return:
+*  Clip to play, held until clip_cache_release(), or NULL on a miss
+*
+*******************************************************************************/
+clip_entry_t *clip_cache_get(const char *name, uint32_t file_size, uint32_t file_time)
+{
+    clip_entry_t *clip;
+
+    taskENTER_CRITICAL();
+    clip = clip_find(name);
+    if ((clip != NULL) && (clip->state == CLIP_READY) &&
+        ((clip->file_size != file_size) || (clip->file_time != file_time))) {
+        clip_drop(clip);
+        clip_stats.invalidations++;
+        clip = NULL;
+    }
+    if ((clip != NULL) && (clip->state == CLIP_READY)) {
+        clip->refs++;
+        clip->last_used = ++clip_sequence;
+        clip_stats.hits++;
+    } else {
+        clip = NULL;
+        clip_stats.misses++;
+    }
+    taskEXIT_CRITICAL();
+
+    return clip;
+}
+
+/*******************************************************************************
+* Function Name: clip_cache_release
+********************************************************************************
+* Summary:
+*  End one playback of a clip from clip_cache_get()
+*
+*******************************************************************************/
+void clip_cache_release(clip_entry_t *clip)
+{
+    taskENTER_CRITICAL();
+    if (clip->refs > 0u) {
+        clip->refs--;
+    }
+    if ((clip->refs == 0u) && clip->stale) {
+        clip_free(clip);
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+* Function Name: clip_cache_fill_begin
+********************************************************************************
+* Summary:
+*  Reserve space for a file being read for playback after a miss, evicting
+*  the least recently played clips as needed
+*
+* Parameters:
+*  name: File name
+*  file_size: Size of the WAV file, part of the key
+*  file_time: emFile timestamp of the file, part of the key
+*  sample_count: PCM samples the file holds
+*
+* Return:
+*  Entry to copy the PCM into, then pass to clip_cache_fill_end(); NULL if
+*  the clip does not fit
+*
+*******************************************************************************/
+clip_entry_t *clip_cache_fill_begin(const char *name, uint32_t file_size, uint32_t file_time,
+                                    uint32_t sample_count)
+{
+    uint32_t blocks;
+    clip_entry_t *clip = NULL;
+    uint32_t first = CLIP_CACHE_BLOCKS;
+
+    if ((sample_count == 0u) || (sample_count > (CLIP_CACHE_BYTES / sizeof(int16_t))) ||
+        (strlen(name) >= CLIP_CACHE_NAME_LENGTH)) {
+        taskENTER_CRITICAL();
+        clip_stats.skipped++;
+        taskEXIT_CRITICAL();
+        return NULL;
+    }
+    blocks = ((sample_count * sizeof(int16_t)) + CLIP_CACHE_BLOCK_BYTES - 1u) / CLIP_CACHE_BLOCK_BYTES;
+
+    taskENTER_CRITICAL();
+    clip = clip_find(name);
+    if (clip != NULL) {
+        clip_drop(clip);
+        clip = NULL;
+    }
+
+    do {
+        if (clip == NULL) {
+            for (uint32_t i = 0; i < CLIP_CACHE_MAX_CLIPS; i++) {
+                if (clip_entries[i].state == CLIP_FREE) {
+                    clip = &clip_entries[i];
+                    break;
+                }
+            }
+        }
+        if (clip != NULL) {
+            first = clip_find_blocks(blocks);
+            if (first < CLIP_CACHE_BLOCKS) {
+                break;
+            }
+        }
+    } while (clip_evict_lru());
+
+    if ((clip == NULL) || (first >= CLIP_CACHE_BLOCKS)) {
+        clip_stats.skipped++;
+        taskEXIT_CRITICAL();
+        return NULL;
+    }
+
+    for (uint32_t i = first; i < first + blocks; i++) {
+        clip_block_used[i] = 1;
+    }
+    clip->state = CLIP_FILLING;
+    strcpy(clip->name, name);
+    clip->file_size = file_size;
+    clip->file_time = file_time;
+    clip->pcm = &clip_cache_data[(first * CLIP_CACHE_BLOCK_BYTES) / sizeof(int16_t)];
+    clip->sample_count = sample_count;
+    clip->first_block = first;
+    clip->num_blocks = blocks;
+    clip->last_used = ++clip_sequence;
+    clip->refs = 0;
+    clip->stale = false;
+    taskEXIT_CRITICAL();
+
+    return clip;
+}
+
+/*******************************************************************************
+* Function Name: clip_cache_fill_end
+********************************************************************************
+* Summary:
+*  Finish a fill; the clip can be played from RAM if it was read completely
+*  and the file has not changed meanwhile
+*
+* Parameters:
+*  clip: Entry from clip_cache_fill_begin()
+*  complete: All of clip->sample_count was copied in
+*
+*******************************************************************************/
+void clip_cache_fill_end(clip_entry_t *clip, bool complete)
+{
+    taskENTER_CRITICAL();
+    if (complete && !clip->stale) {
+        clip->state = CLIP_READY;
+        clip_stats.fills++;
+    } else {
+        clip_free(clip);
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+* Function Name: clip_cache_invalidate
+********************************************************************************
+* Summary:
+*  Forget a file that is being removed, replaced or written
+*
+*******************************************************************************/
+void clip_cache_invalidate(const char *name)
+{
+    clip_entry_t *clip;
+
+    taskENTER_CRITICAL();
+    clip = clip_find(name);
+    if (clip != NULL) {
+        clip_drop(clip);
+        clip_stats.invalidations++;
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+* Function Name: clip_cache_check
+********************************************************************************
+* Summary:
+*  Compare a cached clip with the directory entry of its file, e.g. while
+*  listing, and forget it if the file was changed outside this firmware
+*
+*******************************************************************************/
+void clip_cache_check(const char *name, uint32_t file_size, uint32_t file_time)
+{
+    clip_entry_t *clip;
+
+    taskENTER_CRITICAL();
+    clip = clip_find(name);
+    if ((clip != NULL) && (clip->state == CLIP_READY) &&
+        ((clip->file_size != file_size) || (clip->file_time != file_time))) {
+        clip_drop(clip);
+        clip_stats.invalidations++;
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+* Function Name: clip_cache_clear
+********************************************************************************
+* Summary:
+*  Forget every clip; clips that are playing go when they finish
+*
+*******************************************************************************/
+void clip_cache_clear(void)
+{
+    taskENTER_CRITICAL();
+    for (uint32_t i = 0; i < CLIP_CACHE_MAX_CLIPS; i++) {
+        if (clip_entries[i].state != CLIP_FREE) {
+            clip_drop(&clip_entries[i]);
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+* Function Name: clip_cache_get_stats
+********************************************************************************
+* Summary:
+*  Counters since boot and current occupancy
+*
+*******************************************************************************/
+void clip_cache_get_stats(clip_cache_stats_t *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = clip_stats;
+    stats->clips = 0;
+    stats->bytes = 0;
+    for (uint32_t i = 0; i < CLIP_CACHE_MAX_CLIPS; i++) {
+        if (clip_entries[i].state != CLIP_FREE) {
+            stats->clips++;
+            stats->bytes += clip_entries[i].num_blocks * CLIP_CACHE_BLOCK_BYTES;
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+* Function Name: clip_cache_list
+********************************************************************************
+* Summary:
+*  Print the cached clips, most recently played first
+*
+*******************************************************************************/
+void clip_cache_list(void)
+{
+    uint32_t newest = UINT32_MAX;
+
+    for (;;) {
+        clip_entry_t entry;
+        bool found = false;
+
+        /* Next older clip; copied so printing happens outside the lock */
+        taskENTER_CRITICAL();
+        for (uint32_t i = 0; i < CLIP_CACHE_MAX_CLIPS; i++) {
+            const clip_entry_t *clip = &clip_entries[i];
+            if ((clip->state != CLIP_FREE) && (clip->last_used < newest) &&
+                (!found || (clip->last_used > entry.last_used))) {
+                entry = *clip;
+                found = true;
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        if (!found) {
+            break;
+        }
+        newest = entry.last_used;
+        printf("  %-24s %7u bytes%s%s%s\r\n", entry.name,
+               (unsigned int)(entry.sample_count * sizeof(int16_t)),
+               (entry.state == CLIP_FILLING) ? "  filling" : "",
+               (entry.refs > 0u) ? "  playing" : "",
+               entry.stale ? "  stale" : "");
+    }
+}
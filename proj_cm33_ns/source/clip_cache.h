@@ -0,0 +1,87 @@
+/******************************************************************************
+* File Name: clip_cache.h
+*
+* Description: RAM cache of played clips
+*              Keeps the PCM of recently played WAV files in otherwise unused
+*              SOCMEM, so playing a cached file again needs no SD access.
+*              Entries are keyed by name, file size and modification time;
+*              the least recently played ones are evicted when space is
+*              needed.
+*
+*******************************************************************************/
+
+#ifndef __CLIP_CACHE_H__
+#define __CLIP_CACHE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define CLIP_CACHE_BYTES            (1024u * 1024u)     /* 32 s of 16 kHz stereo */
+#define CLIP_CACHE_BLOCK_BYTES      (8192u)
+#define CLIP_CACHE_BLOCKS           (CLIP_CACHE_BYTES / CLIP_CACHE_BLOCK_BYTES)
+#define CLIP_CACHE_MAX_CLIPS        (16u)
+#define CLIP_CACHE_NAME_LENGTH      (32u)
+
+/*******************************************************************************
+* Enumerations
+*******************************************************************************/
+typedef enum {
+    CLIP_FREE,
+    CLIP_FILLING,               /* Being copied in by FileReadTask */
+    CLIP_READY
+} clip_state_t;
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+typedef struct {
+    clip_state_t state;
+    char name[CLIP_CACHE_NAME_LENGTH];
+    uint32_t file_size;         /* Key, with the name and time */
+    uint32_t file_time;         /* emFile timestamp of the last write */
+    int16_t *pcm;
+    uint32_t sample_count;      /* L and R counted separately */
+    uint32_t first_block;
+    uint32_t num_blocks;
+    uint32_t last_used;         /* Play sequence number, for LRU */
+    uint8_t refs;               /* Playback sessions using the PCM */
+    bool stale;                 /* Invalidated while in use; freed with the last reference */
+} clip_entry_t;
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t fills;             /* Misses copied into the cache */
+    uint32_t skipped;           /* Misses too large for the cache, or no space free */
+    uint32_t evictions;
+    uint32_t invalidations;
+    uint32_t clips;
+    uint32_t bytes;             /* Allocated, whole blocks */
+} clip_cache_stats_t;
+
+/*******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+clip_entry_t *clip_cache_get(const char *name, uint32_t file_size, uint32_t file_time);
+void clip_cache_release(clip_entry_t *clip);
+clip_entry_t *clip_cache_fill_begin(const char *name, uint32_t file_size, uint32_t file_time,
+                                    uint32_t sample_count);
+void clip_cache_fill_end(clip_entry_t *clip, bool complete);
+void clip_cache_invalidate(const char *name);
+void clip_cache_check(const char *name, uint32_t file_size, uint32_t file_time);
+void clip_cache_clear(void);
+void clip_cache_get_stats(clip_cache_stats_t *stats);
+void clip_cache_list(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CLIP_CACHE_H__ */
@@ -0,0 +1,644 @@
+/******************************************************************************
+* File Name: codec_ctrl.c
+*
+* Description: Run-time control of the TLV320DAC3100 through a register cache
+*              - The shadow, the dirty bits and the transaction in flight are
+*                shared between the calling tasks and the I2C interrupt;
+*                tasks change them inside a critical section, which also
+*                keeps the interrupt out
+*              - Registers of the current page are sent before the page is
+*                changed, so a burst of writes to one page costs one page
+*                select at most
+*              - A failed transaction leaves its registers dirty and stops
+*                the queue; the next write, codec_ctrl_flush() or
+*                codec_ctrl_sync() starts it again. No retry from the
+*                interrupt: a codec that does not answer would keep the bus
+*                busy for good.
+*
+*******************************************************************************/
+
+#include "codec_ctrl.h"
+#include "app_i2s.h"
+#include "cybsp.h"
+#include "cy_pdl.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <stdio.h>
+#include <string.h>
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define CODEC_CTRL_PAGE_UNKNOWN     (0xFFu)
+#define CODEC_CTRL_BITMAP_WORDS     (CODEC_CTRL_PAGE_REGS / 32u)
+#define CODEC_CTRL_I2C_TIMEOUT_MS   (10u)       /* Blocking readback */
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+/* Register with read-only or self-clearing bits (data sheet register maps) */
+typedef struct {
+    codec_reg_t reg;
+    uint8_t stable_mask;        /* Bits that read back as written; 0: none */
+} codec_ctrl_volatile_t;
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static const codec_ctrl_volatile_t codec_ctrl_volatile[] = {
+    { CODEC_REG(0, 1),   0x00u },   /* Software reset, self-clearing */
+    { CODEC_REG(0, 3),   0x00u },   /* Over-temperature flag */
+    { CODEC_REG(0, 37),  0x00u },   /* DAC flags */
+    { CODEC_REG(0, 38),  0x00u },
+    { CODEC_REG(0, 39),  0x00u },   /* Overflow flags */
+    { CODEC_REG(0, 44),  0x00u },   /* Sticky interrupt flags, cleared on read */
+    { CODEC_REG(0, 45),  0x00u },
+    { CODEC_REG(0, 46),  0x00u },
+    { CODEC_REG(0, 47),  0x00u },
+    { CODEC_REG(0, 67),  0x9Fu },   /* Headset detection: bits 6:5 are status */
+    { CODEC_REG(0, 117), 0x00u },   /* VOL/MICDET-pin gain */
+    { CODEC_REG(1, 31),  0xFEu },   /* Headphone drivers: bit 0 short circuit */
+    { CODEC_REG(1, 32),  0xFEu },   /* Class-D driver: bit 0 short circuit */
+    { CODEC_REG(1, 40),  0xFEu },   /* Driver gains: bit 0 gain applied */
+    { CODEC_REG(1, 41),  0xFEu },
+    { CODEC_REG(1, 42),  0xFEu },
+};
+#define CODEC_CTRL_NUM_VOLATILE     (sizeof(codec_ctrl_volatile) / sizeof(codec_ctrl_volatile[0]))
+
+static struct {
+    uint8_t shadow[CODEC_CTRL_PAGES][CODEC_CTRL_PAGE_REGS];
+    uint32_t known[CODEC_CTRL_PAGES][CODEC_CTRL_BITMAP_WORDS];     /* Shadow holds the value */
+    uint32_t dirty[CODEC_CTRL_PAGES][CODEC_CTRL_BITMAP_WORDS];     /* Not sent yet */
+    uint8_t tx[CODEC_CTRL_MAX_BURST + 1u];      /* Register address, then values */
+    cy_stc_scb_i2c_master_xfer_config_t xfer;
+    uint8_t page;               /* Selected on the codec, or CODEC_CTRL_PAGE_UNKNOWN */
+    uint8_t flight_page;        /* Of the transaction on the bus... */
+    uint8_t flight_first;
+    uint8_t flight_count;       /* ...0 for a page select */
+    bool held;                  /* Bus lent to a blocking readback */
+    codec_ctrl_stats_t stats;
+} codec_ctrl;
+
+/*******************************************************************************
+* Function Name: codec_ctrl_is_set / codec_ctrl_set_bit / codec_ctrl_clear_bit
+********************************************************************************
+* Summary:
+*  Bitmap access, one bit per register of a page
+*
+*******************************************************************************/
+static inline bool codec_ctrl_is_set(const uint32_t *bitmap, uint32_t reg)
+{
+    return ((bitmap[reg / 32u] >> (reg % 32u)) & 1u) != 0u;
+}
+
+static inline void codec_ctrl_set_bit(uint32_t *bitmap, uint32_t reg)
+{
+    bitmap[reg / 32u] |= (1u << (reg % 32u));
+}
+
+static inline void codec_ctrl_clear_bit(uint32_t *bitmap, uint32_t reg)
+{
+    bitmap[reg / 32u] &= ~(1u << (reg % 32u));
+}
+
+/*******************************************************************************
+* Function Name: codec_ctrl_stable_mask
+********************************************************************************
+* Summary:
+*  Bits of a register that read back as written
+*
+*******************************************************************************/
+static uint8_t codec_ctrl_stable_mask(uint32_t page, uint32_t reg)
+{
+    codec_reg_t id = CODEC_REG(page, reg);
+
+    for (uint32_t i = 0; i < CODEC_CTRL_NUM_VOLATILE; i++) {
+        if (codec_ctrl_volatile[i].reg == id) {
+            return codec_ctrl_volatile[i].stable_mask;
+        }
+    }
+    return 0xFFu;
+}
+
+/*******************************************************************************
+* Function Name: codec_ctrl_next_run
+********************************************************************************
+* Summary:
+*  Find the first run of consecutive dirty registers of a page
+*
+* Parameters:
+*  page: Page to search
+*  first: First register of the run
+*  count: Registers in the run, at most CODEC_CTRL_MAX_BURST
+*
+* Return:
+*  false if no register of the page is dirty
+*
+*******************************************************************************/
+static bool codec_ctrl_next_run(uint32_t page, uint32_t *first, uint32_t *count)
+{
+    const uint32_t *dirty = codec_ctrl.dirty[page];
+    uint32_t reg = 1;       /* Register 0 is the page select */
+    uint32_t n = 0;
+
+    while ((reg < CODEC_CTRL_PAGE_REGS) && !codec_ctrl_is_set(dirty, reg)) {
+        if (dirty[reg / 32u] == 0u) {
+            reg = (reg | 31u) + 1u;     /* Skip a clean word */
+        } else {
+            reg++;
+        }
+    }
+    if (reg >= CODEC_CTRL_PAGE_REGS) {
+        return false;
+    }
+
+    *first = reg;
+    while ((reg < CODEC_CTRL_PAGE_REGS) && codec_ctrl_is_set(dirty, reg) &&
+           (n < CODEC_CTRL_MAX_BURST)) {
+        reg++;
+        n++;
+    }
+    *count = n;
+    return true;
+}
+
+/*******************************************************************************
+* Function Name: codec_ctrl_failed
+********************************************************************************
+* Summary:
+*  Put the registers of a failed transaction back in the queue. The codec
+*  may have taken part of it, so its page is no longer known.
+*
+*******************************************************************************/
+static void codec_ctrl_failed(void)
+{
+    for (uint32_t i = 0; i < codec_ctrl.flight_count; i++) {
+        codec_ctrl_set_bit(codec_ctrl.dirty[codec_ctrl.flight_page], codec_ctrl.flight_first + i);
+        codec_ctrl.stats.pending++;
+    }
+    codec_ctrl.flight_count = 0;
+    codec_ctrl.page = CODEC_CTRL_PAGE_UNKNOWN;
+    codec_ctrl.stats.errors++;
+    codec_ctrl.stats.busy = false;
+}
+
+/*******************************************************************************
+* Function Name: codec_ctrl_start
+********************************************************************************
+* Summary:
+*  Start the next transaction if the bus is idle and a register is dirty.
+*  Called from the I2C interrupt, or from a task inside a critical section.
+*
+*******************************************************************************/
+static void codec_ctrl_start(void)
+{
+    uint32_t page = codec_ctrl.page;
+    uint32_t first = 0;
+    uint32_t count = 0;
+    uint32_t size;
+
+    if (codec_ctrl.stats.busy || codec_ctrl.held || !codec_ctrl.stats.ready ||
+        (codec_ctrl.stats.pending == 0u)) {
+        return;
+    }
+
+    if ((page >= CODEC_CTRL_PAGES) || !codec_ctrl_next_run(page, &first, &count)) {
+        /* Nothing left on the selected page: select the next one */
+        for (page = 0; page < CODEC_CTRL_PAGES; page++) {
+            if (codec_ctrl_next_run(page, &first, &count)) {
+                break;
+            }
+        }
+        if (page >= CODEC_CTRL_PAGES) {
+            return;
+        }
+        codec_ctrl.tx[0] = 0;
+        codec_ctrl.tx[1] = (uint8_t)page;
+        size = 2u;
+        count = 0;
+    } else {
+        codec_ctrl.tx[0] = (uint8_t)first;
+        for (uint32_t i = 0; i < count; i++) {
+            codec_ctrl.tx[1u + i] = codec_ctrl.shadow[page][first + i];
+            codec_ctrl_clear_bit(codec_ctrl.dirty[page], first + i);
+        }
+        codec_ctrl.stats.pending -= count;
+        size = count + 1u;
+    }
+
+    codec_ctrl.flight_page = (uint8_t)page;
+    codec_ctrl.flight_first = (uint8_t)first;
+    codec_ctrl.flight_count = (uint8_t)count;
+    codec_ctrl.xfer.slaveAddress = I2C_ADDRESS;
+    codec_ctrl.xfer.buffer = codec_ctrl.tx;
+    codec_ctrl.xfer.bufferSize = size;
+    codec_ctrl.xfer.xferPending = false;
+    codec_ctrl.stats.busy = true;
+    if (Cy_SCB_I2C_MasterWrite(CYBSP_I2C_CONTROLLER_HW, &codec_ctrl.xfer,
+                               &MW_CYBSP_I2C_CONTROLLER_0_context) != CY_SCB_I2C_SUCCESS) {
+        codec_ctrl_failed();
+    }
+}
+
+/*******************************************************************************
+* Function Name: codec_ctrl_i2c_event
+********************************************************************************
+* Summary:
+*  End of a transaction, called by Cy_SCB_I2C_Interrupt(): account for it
+*  and start the next one
+*
+*******************************************************************************/
+static void codec_ctrl_i2c_event(uint32_t events)
+{
+    if (!codec_ctrl.stats.busy) {
+        return;
+    }
+    if ((events & CY_SCB_I2C_MASTER_ERR_EVENT) != 0u) {
+        codec_ctrl_failed();
+        return;
+    }
+    if ((events & CY_SCB_I2C_MASTER_WR_CMPLT_EVENT) != 0u) {
+        codec_ctrl.stats.busy = false;
+        codec_ctrl.stats.transactions++;
+        codec_ctrl.stats.bytes += codec_ctrl.xfer.bufferSize;
+        if (codec_ctrl.flight_count == 0u) {
+            codec_ctrl.page = codec_ctrl.flight_page;
+            codec_ctrl.stats.page_selects++;
+        }
+        codec_ctrl.flight_count = 0;
+        codec_ctrl_start();
+    }
+}
+
+/*******************************************************************************
+* Function Name: codec_ctrl_i2c_isr
+*******************************************************************************/
+static void codec_ctrl_i2c_isr(void)
+{
+    Cy_SCB_I2C_Interrupt(CYBSP_I2C_CONTROLLER_HW, &MW_CYBSP_I2C_CONTROLLER_0_context);
+}
+
+/*******************************************************************************
+* Function Name: codec_ctrl_read_page
+********************************************************************************
+* Summary:
+*  Read registers 1..127 of a page with blocking I2C: page select, then the
+*  first register address and an auto-incrementing read after a repeated
+*  start. Only while no transaction of the queue can start.
+*
+* Parameters:
+*  page: Page to read
+*  values: CODEC_CTRL_PAGE_REGS bytes; element 0 is left alone
+*
+* Return:
+*  0 on success, -1 on I2C error
+*
+*******************************************************************************/
+static int codec_ctrl_read_page(uint32_t page, uint8_t *values)
+{
+    uint8_t select[2] = { 0, (uint8_t)page };
+    uint8_t first = 1;
+
+    if ((mtb_hal_i2c_controller_write(&MW_I2C_hal_obj, I2C_ADDRESS, select, sizeof(select),
+                                      CODEC_CTRL_I2C_TIMEOUT_MS, true) != CY_RSLT_SUCCESS) ||
+        (mtb_hal_i2c_controller_write(&MW_I2C_hal_obj, I2C_ADDRESS, &first, 1u,
+                                      CODEC_CTRL_I2C_TIMEOUT_MS, false) != CY_RSLT_SUCCESS) ||
+        (mtb_hal_i2c_controller_read(&MW_I2C_hal_obj, I2C_ADDRESS, &values[1],
+                                     CODEC_CTRL_PAGE_REGS - 1u, CODEC_CTRL_I2C_TIMEOUT_MS,
+                                     true) != CY_RSLT_SUCCESS)) {
+        return -1;
+    }
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: codec_ctrl_init
+********************************************************************************
+* Summary:
+*  Read the codec registers into the shadow and hand the I2C bus to the
+*  interrupt. Call once, after app_tlv_codec_init() and before any task
+*  writes the codec.
+*
+* Return:
+*  0 on success, -1 if the readback failed: the shadow is then empty and
+*  every register is sent the first time it is written
+*
+*******************************************************************************/
+int codec_ctrl_init(void)
+{
+    cy_stc_sysint_t i2c_isr_cfg = {
+        .intrSrc = (IRQn_Type)CYBSP_I2C_CONTROLLER_IRQ,
+        .intrPriority = CODEC_CTRL_ISR_PRIORITY
+    };
+    int result = 0;
+
+    memset(&codec_ctrl, 0, sizeof(codec_ctrl));
+    codec_ctrl.page = CODEC_CTRL_PAGE_UNKNOWN;
+
+    for (uint32_t page = 0; page < CODEC_CTRL_PAGES; page++) {
+        if (codec_ctrl_read_page(page, codec_ctrl.shadow[page]) != 0) {
+            memset(codec_ctrl.known, 0, sizeof(codec_ctrl.known));
+            result = -1;
+            break;
+        }
+        codec_ctrl.page = (uint8_t)page;
+        for (uint32_t reg = 1; reg < CODEC_CTRL_PAGE_REGS; reg++) {
+            if (codec_ctrl_stable_mask(page, reg) != 0u) {
+                codec_ctrl_set_bit(codec_ctrl.known[page], reg);
+            }
+        }
+    }
+    if (result != 0) {
+        codec_ctrl.page = CODEC_CTRL_PAGE_UNKNOWN;
+    }
+
+    Cy_SCB_I2C_RegisterEventCallback(CYBSP_I2C_CONTROLLER_HW, codec_ctrl_i2c_event,
+                                     &MW_CYBSP_I2C_CONTROLLER_0_context);
+    Cy_SysInt_Init(&i2c_isr_cfg, codec_ctrl_i2c_isr);
+    NVIC_EnableIRQ(i2c_isr_cfg.intrSrc);
+    codec_ctrl.stats.ready = true;
+    return result;
+}
+
+/*******************************************************************************
+* Function Name: codec_ctrl_set
+********************************************************************************
+* Summary:
+*  Put one value in the shadow and mark it dirty unless it is already there.
+*  Registers with read-only or self-clearing bits are always sent; the
+*  shadow keeps their writable bits for codec_ctrl_update(). Called inside
+*  a critical section.
+*
+*******************************************************************************/
+static void codec_ctrl_set(uint32_t page, uint32_t reg, uint8_t value)
+{
+    uint8_t mask = codec_ctrl_stable_mask(page, reg);
+
+    codec_ctrl.stats.requested++;
+    if ((mask == 0xFFu) && codec_ctrl_is_set(codec_ctrl.known[page], reg) &&
+        (codec_ctrl.shadow[page][reg] == value)) {
+        codec_ctrl.stats.redundant++;
+        return;
+    }
+    if (codec_ctrl_is_set(codec_ctrl.dirty[page], reg)) {
+        codec_ctrl.stats.merged++;
+    } else {
+        codec_ctrl_set_bit(codec_ctrl.dirty[page], reg);
+        codec_ctrl.stats.pending++;
+    }
+    codec_ctrl.shadow[page][reg] = value;
+    if (mask != 0u) {
+        codec_ctrl_set_bit(codec_ctrl.known[page], reg);
+    }
+}
+
+/*******************************************************************************
+* Function Name: codec_ctrl_valid
+********************************************************************************
+* Summary:
+*  Check that count registers from reg exist in the shadow
+*
+*******************************************************************************/
+static bool codec_ctrl_valid(codec_reg_t reg, uint32_t count)
+{
+    uint32_t page = CODEC_REG_PAGE(reg);
+    uint32_t number = CODEC_REG_NUMBER(reg);
+
+    return codec_ctrl.stats.ready && (page < CODEC_CTRL_PAGES) && (number >= 1u) &&
+           (count >= 1u) && ((number + count) <= CODEC_CTRL_PAGE_REGS);
+}
+
+/*******************************************************************************
+* Function Name: codec_ctrl_write_block
+********************************************************************************
+* Summary:
+*  Write consecutive registers of one page; they go out together if they
+*  are still dirty when the bus gets to them
+*
+* Parameters:
+*  reg: First register
+*  values: One per register
+*  count: Registers
+*
+* Return:
+*  0 on success, -1 for a register outside the shadow or before init
+*
+*******************************************************************************/
+int codec_ctrl_write_block(codec_reg_t reg, const uint8_t *values, uint32_t count)
+{
+    uint32_t page = CODEC_REG_PAGE(reg);
+    uint32_t number = CODEC_REG_NUMBER(reg);
+
+    if (!codec_ctrl_valid(reg, count)) {
+        return -1;
+    }
+
+    taskENTER_CRITICAL();
+    for (uint32_t i = 0; i < count; i++) {
+        codec_ctrl_set(page, number + i, values[i]);
+    }
+    codec_ctrl_start();
+    taskEXIT_CRITICAL();
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: codec_ctrl_write
+********************************************************************************
+* Summary:
+*  Write one register
+*
+*******************************************************************************/
+int codec_ctrl_write(codec_reg_t reg, uint8_t value)
+{
+    return codec_ctrl_write_block(reg, &value, 1u);
+}
+
+/*******************************************************************************
+* Function Name: codec_ctrl_update
+********************************************************************************
+* Summary:
+*  Change some bits of a register, from the shadow value
+*
+* Parameters:
+*  reg: Register
+*  mask: Bits to change
+*  value: New value of those bits
+*
+* Return:
+*  0 on success, -1 if the register is not in the shadow
+*
+*******************************************************************************/
+int codec_ctrl_update(codec_reg_t reg, uint8_t mask, uint8_t value)
+{
+    uint32_t page = CODEC_REG_PAGE(reg);
+    uint32_t number = CODEC_REG_NUMBER(reg);
+    int result = 0;
+
+    if (!codec_ctrl_valid(reg, 1u)) {
+        return -1;
+    }
+
+    taskENTER_CRITICAL();
+    if (codec_ctrl_is_set(codec_ctrl.known[page], number)) {
+        uint8_t current = codec_ctrl.shadow[page][number];
+
+        codec_ctrl_set(page, number, (uint8_t)((current & (uint8_t)~mask) | (value & mask)));
+        codec_ctrl_start();
+    } else {
+        result = -1;
+    }
+    taskEXIT_CRITICAL();
+    return result;
+}
+
+/*******************************************************************************
+* Function Name: codec_ctrl_read
+********************************************************************************
+* Summary:
+*  Value of a register as last written or read back, without bus access
+*
+* Return:
+*  0 on success, -1 if the shadow does not hold the register
+*
+*******************************************************************************/
+int codec_ctrl_read(codec_reg_t reg, uint8_t *value)
+{
+    uint32_t page = CODEC_REG_PAGE(reg);
+    uint32_t number = CODEC_REG_NUMBER(reg);
+    int result = -1;
+
+    if (!codec_ctrl_valid(reg, 1u)) {
+        return -1;
+    }
+
+    taskENTER_CRITICAL();
+    if (codec_ctrl_is_set(codec_ctrl.known[page], number)) {
+        *value = codec_ctrl.shadow[page][number];
+        result = 0;
+    }
+    taskEXIT_CRITICAL();
+    return result;
+}
+
+/*******************************************************************************
+* Function Name: codec_ctrl_flush
+********************************************************************************
+* Summary:
+*  Restart the queue, e.g. after a failed transaction
+*
+* Return:
+*  Registers still to be sent
+*
+*******************************************************************************/
+int codec_ctrl_flush(void)
+{
+    int pending;
+
+    taskENTER_CRITICAL();
+    codec_ctrl_start();
+    pending = (int)codec_ctrl.stats.pending;
+    taskEXIT_CRITICAL();
+    return pending;
+}
+
+/*******************************************************************************
+* Function Name: codec_ctrl_sync
+********************************************************************************
+* Summary:
+*  Wait until every write has reached the codec, restarting the queue after
+*  a failure
+*
+* Parameters:
+*  timeout_ms: Longest wait
+*
+* Return:
+*  0 once nothing is pending, -1 on timeout
+*
+*******************************************************************************/
+int codec_ctrl_sync(uint32_t timeout_ms)
+{
+    TickType_t start = xTaskGetTickCount();
+
+    for (;;) {
+        bool idle;
+
+        taskENTER_CRITICAL();
+        codec_ctrl_start();
+        idle = !codec_ctrl.stats.busy && (codec_ctrl.stats.pending == 0u);
+        taskEXIT_CRITICAL();
+        if (idle) {
+            return 0;
+        }
+        if ((xTaskGetTickCount() - start) >= pdMS_TO_TICKS(timeout_ms)) {
+            return -1;
+        }
+        vTaskDelay(1);
+    }
+}
+
+/*******************************************************************************
+* Function Name: codec_ctrl_verify
+********************************************************************************
+* Summary:
+*  Read the codec back and print every register that differs from the
+*  shadow, status bits left out. Holds the queue while it reads.
+*
+* Return:
+*  Registers that differ, or -1 if the queue did not drain or the readback
+*  failed
+*
+*******************************************************************************/
+int codec_ctrl_verify(void)
+{
+    uint8_t values[CODEC_CTRL_PAGE_REGS];
+    int differ = 0;
+
+    if (!codec_ctrl.stats.ready || (codec_ctrl_sync(CODEC_CTRL_SYNC_TIMEOUT_MS) != 0)) {
+        return -1;
+    }
+
+    taskENTER_CRITICAL();
+    codec_ctrl.held = true;
+    taskEXIT_CRITICAL();
+
+    for (uint32_t page = 0; (page < CODEC_CTRL_PAGES) && (differ >= 0); page++) {
+        if (codec_ctrl_read_page(page, values) != 0) {
+            differ = -1;
+            break;
+        }
+        for (uint32_t reg = 1; reg < CODEC_CTRL_PAGE_REGS; reg++) {
+            uint8_t mask = codec_ctrl_stable_mask(page, reg);
+            uint8_t shadow;
+
+            taskENTER_CRITICAL();
+            shadow = codec_ctrl.shadow[page][reg];
+            if (!codec_ctrl_is_set(codec_ctrl.known[page], reg)) {
+                mask = 0;
+            }
+            taskEXIT_CRITICAL();
+            if (((values[reg] ^ shadow) & mask) != 0u) {
+                printf("  P%lu R%lu: shadow 0x%02X, codec 0x%02X\r\n", (unsigned long)page,
+                       (unsigned long)reg, (unsigned int)shadow, (unsigned int)values[reg]);
+                differ++;
+            }
+        }
+    }
+
+    taskENTER_CRITICAL();
+    codec_ctrl.held = false;
+    codec_ctrl.page = CODEC_CTRL_PAGE_UNKNOWN;
+    codec_ctrl_start();
+    taskEXIT_CRITICAL();
+    return differ;
+}
+
+/*******************************************************************************
+* Function Name: codec_ctrl_get_stats
+*******************************************************************************/
+void codec_ctrl_get_stats(codec_ctrl_stats_t *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = codec_ctrl.stats;
+    taskEXIT_CRITICAL();
+}
@@ -0,0 +1,100 @@
+/******************************************************************************
+* File Name: codec_ctrl.h
+*
+* Description: Run-time control of the TLV320DAC3100 through a register cache
+*              Every write goes to a shadow copy of the codec's control
+*              registers (pages 0 and 1) first. A value equal to the shadow
+*              is dropped; a new one marks the register dirty, and the I2C
+*              interrupt sends the dirty registers in the background, one
+*              write transaction per run of consecutive registers (the codec
+*              auto-increments the register address), with a page select
+*              only when the page changes. A caller therefore only updates
+*              the shadow and, if the bus is idle, starts the first
+*              transaction.
+*
+*              The blocking driver (mtb_tlv320dac3100) still configures the
+*              codec at boot; codec_ctrl_init() then reads the registers
+*              back into the shadow. After that, write the codec only
+*              through this module.
+*
+*******************************************************************************/
+
+#ifndef __CODEC_CTRL_H__
+#define __CODEC_CTRL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define CODEC_CTRL_PAGES            (2u)        /* Page 0: control, page 1: output stage */
+#define CODEC_CTRL_PAGE_REGS        (128u)      /* Register 0 of each page selects the page */
+#define CODEC_CTRL_MAX_BURST        (16u)       /* Registers per write transaction */
+#define CODEC_CTRL_ISR_PRIORITY     (7u)
+#define CODEC_CTRL_SYNC_TIMEOUT_MS  (50u)
+
+/* Register id: page in the high byte, register in the low byte */
+#define CODEC_REG(page, reg)        ((codec_reg_t)(((uint32_t)(page) << 8) | (uint32_t)(reg)))
+#define CODEC_REG_PAGE(id)          ((uint32_t)(id) >> 8)
+#define CODEC_REG_NUMBER(id)        ((uint32_t)(id) & 0xFFu)
+
+/* Registers of the TLV320DAC3100 data sheet used at run time */
+#define CODEC_P0_CODEC_INTERFACE    CODEC_REG(0, 27)    /* Bits 7:6 I2S, DSP, RJF, LJF */
+#define CODEC_P0_DAC_DATA_PATH      CODEC_REG(0, 63)    /* Bits 1:0 volume soft-stepping */
+#define CODEC_P0_DAC_VOLUME_CTRL    CODEC_REG(0, 64)    /* Bits 3:2 left/right mute */
+#define CODEC_P0_DAC_LEFT_VOLUME    CODEC_REG(0, 65)    /* 0.5 dB steps, signed */
+#define CODEC_P0_DAC_RIGHT_VOLUME   CODEC_REG(0, 66)
+#define CODEC_P1_HP_DRIVERS         CODEC_REG(1, 31)    /* Bits 7:6 HPL/HPR power */
+#define CODEC_P1_SPK_AMP            CODEC_REG(1, 32)    /* Bit 7 class-D power */
+#define CODEC_P1_DAC_MIXER_ROUTING  CODEC_REG(1, 35)
+#define CODEC_P1_HPL_ANALOG_VOLUME  CODEC_REG(1, 36)    /* Bit 7 routed to the driver */
+#define CODEC_P1_HPR_ANALOG_VOLUME  CODEC_REG(1, 37)
+#define CODEC_P1_SPK_ANALOG_VOLUME  CODEC_REG(1, 38)
+#define CODEC_P1_HPL_DRIVER         CODEC_REG(1, 40)    /* Bit 2 unmuted */
+#define CODEC_P1_HPR_DRIVER         CODEC_REG(1, 41)
+#define CODEC_P1_SPK_DRIVER         CODEC_REG(1, 42)
+
+/*******************************************************************************
+* Data Types
+*******************************************************************************/
+typedef uint16_t codec_reg_t;
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+typedef struct {
+    uint32_t requested;         /* Register writes asked for */
+    uint32_t redundant;         /* Dropped: the value was already in the shadow */
+    uint32_t merged;            /* Replaced a write that had not been sent yet */
+    uint32_t transactions;      /* I2C writes completed, page selects included */
+    uint32_t page_selects;
+    uint32_t bytes;             /* Register address and data bytes sent */
+    uint32_t errors;            /* Failed transactions; their registers stay dirty */
+    uint32_t pending;           /* Dirty registers now */
+    bool busy;                  /* A transaction is on the bus */
+    bool ready;                 /* codec_ctrl_init() succeeded */
+} codec_ctrl_stats_t;
+
+/*******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+int codec_ctrl_init(void);
+int codec_ctrl_write(codec_reg_t reg, uint8_t value);
+int codec_ctrl_write_block(codec_reg_t reg, const uint8_t *values, uint32_t count);
+int codec_ctrl_update(codec_reg_t reg, uint8_t mask, uint8_t value);
+int codec_ctrl_read(codec_reg_t reg, uint8_t *value);
+int codec_ctrl_flush(void);
+int codec_ctrl_sync(uint32_t timeout_ms);
+int codec_ctrl_verify(void);
+void codec_ctrl_get_stats(codec_ctrl_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CODEC_CTRL_H__ */
@@ -0,0 +1,406 @@
+/******************************************************************************
+* File Name: compressor.c
+*
+* Description: Look-ahead compressor and limiter on the capture path
+*              The gain is Q28 with the makeup included, so a sample times
+*              the gain stays within 32 bits up to COMP_MAX_MAKEUP_DB. Each
+*              block's gain is the smoothed compressor gain, lowered where
+*              needed so that every block k in the look-ahead is reached by
+*              a straight line: the gain at the end of block b is at most
+*              g(b-1) + (ceiling/peak(k) - g(b-1)) / (k - b). For k = b + 1
+*              that is the bound itself, and both ends of every block's ramp
+*              are then under its bound, so with the ramp and the sample
+*              scaling rounded down no output exceeds the ceiling.
+*
+*******************************************************************************/
+
+#include "compressor.h"
+#include "audio_ramfunc.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <math.h>
+#include <string.h>
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define COMP_GAIN_SHIFT             (28u)
+#define COMP_UNITY_GAIN             (1 << COMP_GAIN_SHIFT)
+#define COMP_SAMPLE_SHIFT           (13u)       /* Q28 gain to Q13 per sample */
+#define COMP_RING_SIZE              (COMP_MAX_LOOKAHEAD_BLOCKS + 1u)
+#define COMP_FULL_SCALE             (32768.0f)
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static compressor_config_t comp_config = {
+    .enabled = false,
+    .threshold_db = COMP_DEFAULT_THRESHOLD_DB,
+    .ratio = COMP_DEFAULT_RATIO,
+    .attack_ms = COMP_DEFAULT_ATTACK_MS,
+    .release_ms = COMP_DEFAULT_RELEASE_MS,
+    .lookahead_ms = COMP_DEFAULT_LOOKAHEAD_MS,
+    .ceiling_db = COMP_DEFAULT_CEILING_DB,
+    .makeup_db = 0u,
+    .trace = false,
+};
+
+/*******************************************************************************
+* Function Name: compressor_config_get
+********************************************************************************
+* Summary:
+*  Copy the settings used for the next recording
+*
+*******************************************************************************/
+void compressor_config_get(compressor_config_t *config)
+{
+    taskENTER_CRITICAL();
+    *config = comp_config;
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+* Function Name: compressor_config_set
+********************************************************************************
+* Summary:
+*  Change the settings used for the next recording
+*
+* Parameters:
+*  config: New settings
+*
+* Return:
+*  0 on success, -1 if a field is out of range
+*
+*******************************************************************************/
+int compressor_config_set(const compressor_config_t *config)
+{
+    if ((config->threshold_db > COMP_MAX_THRESHOLD_DB) ||
+        (config->ratio == 0u) || (config->ratio > COMP_MAX_RATIO) ||
+        (config->attack_ms == 0u) || (config->attack_ms > COMP_MAX_ATTACK_MS) ||
+        (config->release_ms < COMP_MIN_RELEASE_MS) || (config->release_ms > COMP_MAX_RELEASE_MS) ||
+        (config->lookahead_ms > COMP_MAX_LOOKAHEAD_MS) ||
+        (config->ceiling_db > COMP_MAX_CEILING_DB) ||
+        (config->makeup_db > COMP_MAX_MAKEUP_DB)) {
+        return -1;
+    }
+
+    taskENTER_CRITICAL();
+    comp_config = *config;
+    taskEXIT_CRITICAL();
+
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: compressor_init
+********************************************************************************
+* Summary:
+*  Prepare to compress one take
+*
+* Parameters:
+*  comp: Compressor state
+*  config: Settings from compressor_config_get()
+*  num_channels: Interleaved channels, all given the same gain
+*  sample_rate: Converts the millisecond settings to blocks
+*  trace: Receives the gain reduction, or NULL
+*
+* Return:
+*  0 on success, -1 if the channel count is not supported
+*
+*******************************************************************************/
+int compressor_init(compressor_t *comp, const compressor_config_t *config,
+                    uint16_t num_channels, uint32_t sample_rate, comp_trace_t *trace)
+{
+    const float block_ms = (float)COMP_BLOCK_FRAMES * 1000.0f / (float)sample_rate;
+    uint32_t lookahead;
+
+    if ((num_channels == 0u) || (num_channels > COMP_MAX_CHANNELS)) {
+        return -1;
+    }
+
+    memset(comp, 0, sizeof(*comp));
+    comp->num_channels = num_channels;
+
+    /* Rounded up to whole blocks; the limiter needs at least the next one */
+    lookahead = ((uint32_t)config->lookahead_ms * sample_rate + (COMP_BLOCK_FRAMES * 1000u - 1u)) /
+                (COMP_BLOCK_FRAMES * 1000u);
+    if (lookahead < 1u) {
+        lookahead = 1u;
+    } else if (lookahead > COMP_MAX_LOOKAHEAD_BLOCKS) {
+        lookahead = COMP_MAX_LOOKAHEAD_BLOCKS;
+    }
+    comp->lookahead = lookahead;
+
+    comp->ceiling = (int32_t)(32767.0f * powf(10.0f, -(float)config->ceiling_db / 20.0f));
+    comp->makeup = (int32_t)((float)COMP_UNITY_GAIN * powf(10.0f, (float)config->makeup_db / 20.0f));
+    comp->threshold = powf(10.0f, -(float)config->threshold_db / 20.0f);
+    comp->slope = 1.0f - 1.0f / (float)config->ratio;
+    comp->attack = 1.0f - expf(-block_ms / (float)config->attack_ms);
+    comp->release = 1.0f - expf(-block_ms / (float)config->release_ms);
+    comp->gain = comp->makeup;
+    comp->min_gain = comp->makeup;
+
+    comp->trace = trace;
+    if (trace != NULL) {
+        comp->trace_blocks = (sample_rate * COMP_TRACE_MS) / (1000u * COMP_BLOCK_FRAMES);
+        if (comp->trace_blocks == 0u) {
+            comp->trace_blocks = 1u;
+        }
+        comp->trace_min = comp->makeup;
+        trace->config = *config;
+        trace->interval_frames = comp->trace_blocks * COMP_BLOCK_FRAMES;
+        trace->count = 0;
+    }
+
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: compressor_reduction_db
+********************************************************************************
+* Summary:
+*  Gain reduction of a Q28 gain against the makeup gain, in dB
+*
+*******************************************************************************/
+static float compressor_reduction_db(const compressor_t *comp, int32_t gain)
+{
+    if (gain >= comp->makeup) {
+        return 0.0f;
+    }
+    if (gain <= 0) {
+        return 255.0f;
+    }
+    return 20.0f * log10f((float)comp->makeup / (float)gain);
+}
+
+/*******************************************************************************
+* Function Name: compressor_trace_push
+********************************************************************************
+* Summary:
+*  Close one trace interval; once the trace is full the last entry keeps the
+*  largest reduction of the rest of the take
+*
+*******************************************************************************/
+static void compressor_trace_push(compressor_t *comp)
+{
+    comp_trace_t *trace = comp->trace;
+    float steps = compressor_reduction_db(comp, comp->trace_min) * (float)COMP_TRACE_STEPS_PER_DB;
+    uint8_t entry = (steps >= 255.0f) ? 255u : (uint8_t)(steps + 0.5f);
+
+    if (trace->count < COMP_TRACE_ENTRIES) {
+        trace->reduction[trace->count++] = entry;
+    } else if (entry > trace->reduction[COMP_TRACE_ENTRIES - 1u]) {
+        trace->reduction[COMP_TRACE_ENTRIES - 1u] = entry;
+    }
+    comp->trace_fill = 0;
+    comp->trace_min = comp->makeup;
+}
+
+/*******************************************************************************
+* Function Name: compressor_peak
+********************************************************************************
+* Summary:
+*  Largest magnitude in a block, all channels
+*
+*******************************************************************************/
+AUDIO_RAMFUNC_BEGIN
+static uint16_t compressor_peak(const int16_t *pcm, uint32_t num_samples)
+{
+    int32_t peak = 0;
+
+    for (uint32_t i = 0; i < num_samples; i++) {
+        int32_t value = (pcm[i] < 0) ? -(int32_t)pcm[i] : (int32_t)pcm[i];
+        if (value > peak) {
+            peak = value;
+        }
+    }
+    return (uint16_t)peak;
+}
+AUDIO_RAMFUNC_END
+
+/*******************************************************************************
+* Function Name: compressor_block
+********************************************************************************
+* Summary:
+*  Choose the gain for the end of the current block and scale its samples,
+*  ramping from the gain at the end of the previous block
+*
+* Parameters:
+*  comp: Compressor state; the ring holds the current block and comp->ahead
+*        - 1 blocks after it (fewer only at the end of the take)
+*  pcm: The current block
+*  frames: Its length, COMP_BLOCK_FRAMES except for the last block of a take
+*
+*******************************************************************************/
+AUDIO_RAMFUNC_BEGIN
+static void compressor_block(compressor_t *comp, int16_t *pcm, uint32_t frames)
+{
+    int32_t previous = comp->gain;
+    int32_t target;
+    int32_t limit = INT32_MAX;
+    int32_t step;
+    int32_t gain;
+    uint32_t level = 0;
+    float desired;
+    float smoothed;
+
+    /* Ceiling over the look-ahead; the current block bounds both ends of
+     * its ramp, each later block the straight line towards it */
+    for (uint32_t k = 0; k < comp->ahead; k++) {
+        uint32_t peak = comp->peak[(comp->head + k) % COMP_RING_SIZE];
+        int64_t bound;
+
+        if (peak > level) {
+            level = peak;
+        }
+        if (peak == 0u) {
+            continue;
+        }
+        bound = ((int64_t)comp->ceiling << COMP_GAIN_SHIFT) / peak;
+        if (k == 0u) {
+            /* Only binds at the start of a take; later the previous block
+             * has already come down to it */
+            if (previous > bound) {
+                previous = (int32_t)bound;
+            }
+        } else {
+            bound = previous + (bound - previous) / (int64_t)k;
+        }
+        if (bound < limit) {
+            limit = (int32_t)bound;
+        }
+    }
+
+    /* Compressor: static curve on the loudest block ahead, then smoothed */
+    desired = (float)comp->makeup;
+    if (comp->slope > 0.0f) {
+        float x = ((float)level / COMP_FULL_SCALE) * ((float)comp->makeup / (float)COMP_UNITY_GAIN);
+        if (x > comp->threshold) {
+            desired *= powf(comp->threshold / x, comp->slope);
+        }
+    }
+    smoothed = (float)previous;
+    smoothed += ((desired < smoothed) ? comp->attack : comp->release) * (desired - smoothed);
+    target = (int32_t)smoothed;
+    if (target > comp->makeup) {
+        target = comp->makeup;
+    }
+
+    if (limit < target) {
+        target = limit;
+        comp->limited++;
+    }
+
+    /* Truncated steps keep every frame at or below the larger end */
+    step = (target - previous) / (int32_t)frames;
+    gain = previous;
+    for (uint32_t i = 0; i < frames; i++) {
+        int32_t scale;
+
+        gain += step;
+        scale = gain >> (COMP_GAIN_SHIFT - COMP_SAMPLE_SHIFT);
+        for (uint32_t c = 0; c < comp->num_channels; c++) {
+            int32_t value = ((int32_t)*pcm * scale + (1 << (COMP_SAMPLE_SHIFT - 1u))) >> COMP_SAMPLE_SHIFT;
+            if (value > INT16_MAX) {
+                value = INT16_MAX;
+            } else if (value < INT16_MIN) {
+                value = INT16_MIN;
+            }
+            *pcm++ = (int16_t)value;
+        }
+    }
+    comp->gain = target;
+
+    /* Statistics and trace */
+    gain = (target < previous) ? target : previous;
+    if (gain < comp->min_gain) {
+        comp->min_gain = gain;
+    }
+    comp->blocks++;
+    if (comp->trace != NULL) {
+        if (gain < comp->trace_min) {
+            comp->trace_min = gain;
+        }
+        if (++comp->trace_fill >= comp->trace_blocks) {
+            compressor_trace_push(comp);
+        }
+    }
+}
+AUDIO_RAMFUNC_END
+
+/*******************************************************************************
+* Function Name: compressor_process
+********************************************************************************
+* Summary:
+*  Compress the frames that have their look-ahead available, in place
+*  - Until the end of the take the last comp->lookahead blocks, and any
+*    part block, are held back; call again with the same start once more
+*    frames have arrived
+*  - At the end of the take everything is processed and the trace closed
+*
+* Parameters:
+*  comp: Compressor state
+*  pcm: First frame not yet processed
+*  frames: Frames from pcm on, processed or not, that have been captured
+*  final: No more frames will follow
+*
+* Return:
+*  Frames processed, from pcm on
+*
+*******************************************************************************/
+AUDIO_RAMFUNC_BEGIN
+uint32_t compressor_process(compressor_t *comp, int16_t *pcm, uint32_t frames, bool final)
+{
+    uint32_t done = 0;
+
+    for (;;) {
+        uint32_t remaining = frames - done;
+        uint32_t length;
+
+        /* Peaks of the blocks up to the end of the look-ahead */
+        while (comp->ahead <= comp->lookahead) {
+            uint32_t offset = comp->ahead * COMP_BLOCK_FRAMES;
+            if (offset >= remaining) {
+                break;
+            }
+            length = remaining - offset;
+            if (length > COMP_BLOCK_FRAMES) {
+                length = COMP_BLOCK_FRAMES;
+            } else if ((length < COMP_BLOCK_FRAMES) && !final) {
+                break;
+            }
+            comp->peak[(comp->head + comp->ahead) % COMP_RING_SIZE] =
+                compressor_peak(&pcm[(done + offset) * comp->num_channels],
+                                length * comp->num_channels);
+            comp->ahead++;
+        }
+
+        if ((remaining == 0u) || ((comp->ahead <= comp->lookahead) && !final)) {
+            break;
+        }
+
+        length = (remaining < COMP_BLOCK_FRAMES) ? remaining : COMP_BLOCK_FRAMES;
+        compressor_block(comp, &pcm[done * comp->num_channels], length);
+        comp->head = (comp->head + 1u) % COMP_RING_SIZE;
+        comp->ahead--;
+        done += length;
+    }
+
+    if (final && (comp->trace != NULL) && (comp->trace_fill > 0u)) {
+        compressor_trace_push(comp);
+    }
+    return done;
+}
+AUDIO_RAMFUNC_END
+
+/*******************************************************************************
+* Function Name: compressor_max_reduction_db
+********************************************************************************
+* Summary:
+*  Largest gain reduction so far, against the makeup gain
+*
+*******************************************************************************/
+float compressor_max_reduction_db(const compressor_t *comp)
+{
+    return compressor_reduction_db(comp, comp->min_gain);
+}
@@ -0,0 +1,109 @@
+/******************************************************************************
+* File Name: compressor.h
+*
+* Description: Look-ahead compressor and limiter on the capture path
+*              Runs in place on the take as it is recorded, in blocks of
+*              COMP_BLOCK_FRAMES. One gain per block, for all channels, comes
+*              from the loudest block in the look-ahead: above the threshold
+*              the level is reduced by the ratio, with attack and release
+*              smoothing, and the limiter then plans the gain down early
+*              enough that no sample leaves above the ceiling. Samples are
+*              scaled in fixed point with the gain ramped linearly across
+*              each block; only the per-block control uses the FPU.
+*
+*******************************************************************************/
+
+#ifndef __COMPRESSOR_H__
+#define __COMPRESSOR_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define COMP_BLOCK_FRAMES           (16u)       /* Gain update interval: 1 ms at 16 kHz */
+#define COMP_MAX_LOOKAHEAD_BLOCKS   (32u)       /* 10 ms at 48 kHz */
+#define COMP_MAX_CHANNELS           (2u)
+#define COMP_DEFAULT_THRESHOLD_DB   (12u)       /* Compression starts, below full scale */
+#define COMP_DEFAULT_RATIO          (4u)
+#define COMP_DEFAULT_ATTACK_MS      (5u)
+#define COMP_DEFAULT_RELEASE_MS     (100u)
+#define COMP_DEFAULT_LOOKAHEAD_MS   (2u)
+#define COMP_DEFAULT_CEILING_DB     (1u)        /* Limiter output peak, below full scale */
+#define COMP_MAX_THRESHOLD_DB       (60u)
+#define COMP_MAX_RATIO              (20u)       /* 1 limits only */
+#define COMP_MAX_ATTACK_MS          (500u)
+#define COMP_MIN_RELEASE_MS         (10u)
+#define COMP_MAX_RELEASE_MS         (5000u)
+#define COMP_MAX_LOOKAHEAD_MS       (10u)
+#define COMP_MAX_CEILING_DB         (20u)
+#define COMP_MAX_MAKEUP_DB          (12u)       /* Keeps sample x gain within 32 bits */
+#define COMP_TRACE_MS               (20u)       /* Gain reduction trace resolution */
+#define COMP_TRACE_ENTRIES          (256u)      /* 5.1 s at COMP_TRACE_MS */
+#define COMP_TRACE_STEPS_PER_DB     (2u)        /* Trace entries in 0.5 dB steps */
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+typedef struct {
+    bool enabled;
+    uint32_t threshold_db;      /* Compression starts this far below full scale */
+    uint32_t ratio;             /* n:1 above the threshold */
+    uint32_t attack_ms;
+    uint32_t release_ms;
+    uint32_t lookahead_ms;      /* At least one block is always looked ahead */
+    uint32_t ceiling_db;        /* Limiter ceiling below full scale */
+    uint32_t makeup_db;         /* Gain before the threshold and ceiling */
+    bool trace;                 /* Keep the gain reduction with the take */
+} compressor_config_t;
+
+/* Largest gain reduction per interval of a take */
+typedef struct {
+    compressor_config_t config; /* That produced it */
+    uint32_t interval_frames;
+    uint32_t count;             /* Entries; a longer take folds into the last */
+    uint8_t reduction[COMP_TRACE_ENTRIES];  /* dB times COMP_TRACE_STEPS_PER_DB */
+} comp_trace_t;
+
+typedef struct {
+    uint16_t num_channels;
+    uint32_t lookahead;         /* Blocks after the current one */
+    int32_t ceiling;            /* Largest output magnitude */
+    int32_t makeup;             /* Q28 */
+    float threshold;            /* Linear, against full scale after makeup */
+    float slope;                /* 1 - 1/ratio */
+    float attack;               /* Per-block smoothing coefficients */
+    float release;
+    int32_t gain;               /* Q28, makeup included, at the end of the last block */
+    uint16_t peak[COMP_MAX_LOOKAHEAD_BLOCKS + 1u];  /* Ring of block peaks */
+    uint32_t head;              /* Ring index of the current block */
+    uint32_t ahead;             /* Blocks in the ring, the current one included */
+    int32_t min_gain;           /* Q28, lowest of the take */
+    uint32_t blocks;
+    uint32_t limited;           /* Blocks where the ceiling set the gain */
+    comp_trace_t *trace;        /* NULL when not traced */
+    uint32_t trace_blocks;      /* Blocks per entry */
+    uint32_t trace_fill;
+    int32_t trace_min;
+} compressor_t;
+
+/*******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+void compressor_config_get(compressor_config_t *config);
+int compressor_config_set(const compressor_config_t *config);
+int compressor_init(compressor_t *comp, const compressor_config_t *config,
+                    uint16_t num_channels, uint32_t sample_rate, comp_trace_t *trace);
+uint32_t compressor_process(compressor_t *comp, int16_t *pcm, uint32_t frames, bool final);
+float compressor_max_reduction_db(const compressor_t *comp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __COMPRESSOR_H__ */
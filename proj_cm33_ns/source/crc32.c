@@ -0,0 +1,95 @@
+/******************************************************************************
+* File Name: crc32.c
+*
+* Description: CRC-32 (IEEE 802.3, reflected, polynomial 0xEDB88320)
+*              Table driven, one byte per step. Matches zlib.crc32() on the
+*              host side.
+*
+*******************************************************************************/
+
+#include "crc32.h"
+#include <stdbool.h>
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define CRC32_POLYNOMIAL            (0xEDB88320u)
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static uint32_t crc32_table[256];
+static bool crc32_table_ready = false;
+
+/*******************************************************************************
+* Function Name: crc32_build_table
+********************************************************************************
+* Summary:
+*  Build the 256-entry lookup table in RAM on first use
+*
+*******************************************************************************/
+static void crc32_build_table(void)
+{
+    for (uint32_t i = 0; i < 256u; i++) {
+        uint32_t c = i;
+        for (uint32_t bit = 0; bit < 8u; bit++) {
+            c = (c & 1u) ? (CRC32_POLYNOMIAL ^ (c >> 1)) : (c >> 1);
+        }
+        crc32_table[i] = c;
+    }
+    crc32_table_ready = true;
+}
+
+/*******************************************************************************
+* Function Name: crc32_update
+********************************************************************************
+* Summary:
+*  Feed a block of bytes into a running CRC
+*
+* Parameters:
+*  crc: Running CRC (start with CRC32_INIT)
+*  data: Bytes to checksum
+*  length: Number of bytes
+*
+* Return:
+*  Updated running CRC (pass through crc32_final() to get the checksum)
+*
+*******************************************************************************/
+uint32_t crc32_update(uint32_t crc, const void *data, uint32_t length)
+{
+    const uint8_t *p = (const uint8_t *)data;
+
+    if (!crc32_table_ready) {
+        crc32_build_table();
+    }
+
+    while (length-- > 0u) {
+        crc = crc32_table[(crc ^ *p++) & 0xFFu] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+/*******************************************************************************
+* Function Name: crc32_final
+********************************************************************************
+* Summary:
+*  Finalize a running CRC
+*
+*******************************************************************************/
+uint32_t crc32_final(uint32_t crc)
+{
+    return crc ^ 0xFFFFFFFFu;
+}
+
+/*******************************************************************************
+* Function Name: crc32_compute
+********************************************************************************
+* Summary:
+*  One-shot CRC-32 of a buffer
+*
+*******************************************************************************/
+uint32_t crc32_compute(const void *data, uint32_t length)
+{
+    return crc32_final(crc32_update(CRC32_INIT, data, length));
+}
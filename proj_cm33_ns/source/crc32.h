@@ -0,0 +1,33 @@
+/******************************************************************************
+* File Name: crc32.h
+*
+* Description: CRC-32 (IEEE 802.3) checksum used by the file transfer protocol
+*
+*******************************************************************************/
+
+#ifndef __CRC32_H__
+#define __CRC32_H__
+
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define CRC32_INIT                  (0xFFFFFFFFu)
+
+/*******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+uint32_t crc32_update(uint32_t crc, const void *data, uint32_t length);
+uint32_t crc32_final(uint32_t crc);
+uint32_t crc32_compute(const void *data, uint32_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CRC32_H__ */
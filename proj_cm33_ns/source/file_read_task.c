@@ -2,12 +2,21 @@
 * File Name: file_read_task.c
 *
 * Description: WAV file reading task implementation
-*              Reads WAV files from SD card and streams PCM data to PlaybackTask
+*              Reads WAV files from SD card and streams PCM data to PlaybackTask,
+*              copying it into the clip cache on the way; with the loudness
+*              normalizer on, a file not measured before is read through
+*              once first
 *
 *******************************************************************************/
 
 #include "file_read_task.h"
+#include "playback_task.h"
+#include "freertos_setup.h"
 #include "wav_file.h"
+#include "clip_cache.h"
+#include "loudness.h"
+#include "playback_dsp.h"
+#include "settings.h"
 #include "FS.h"
 #include <stdio.h>
 #include <string.h>
@@ -22,85 +31,76 @@ TaskHandle_t file_read_task_handle = NULL;
 /*******************************************************************************
 * Local Variables
 *******************************************************************************/
-/* PCM data buffers for streaming (ping-pong) */
+/* PCM data buffers for streaming (ping-pong); buffer_free_sem counts the
+ * ones the playback session has handed back */
 static int16_t read_ping_buffer[PCM_CHUNK_SIZE] __attribute__((aligned(4)));
 static int16_t read_pong_buffer[PCM_CHUNK_SIZE] __attribute__((aligned(4)));
+static loudness_meter_t read_meter;
 
 /*******************************************************************************
-* Function Name: parse_wav_header
+* Function Name: file_read_loudness
 ********************************************************************************
 * Summary:
-*  Parse and validate WAV file header
+*  Loudness of the file about to be played: from the loudness cache, or with
+*  the normalizer on by reading the PCM through once before playback starts
+*  - The file is left at the start of the PCM again
+*  - Uses the ping buffer, taken from buffer_free_sem like a chunk
 *
 * Parameters:
-*  file: Opened file handle
-*  total_samples: Output - total samples (stereo counted as 2)
+*  file: Open, positioned at the PCM by parse_wav_header()
+*  name: File name, the cache key with the size and time
+*  file_time: emFile timestamp of the last write
+*  total_samples: PCM samples in the file
 *
 * Return:
-*  0 on success, -1 on error
+*  LUFS, or LOUDNESS_UNKNOWN
 *
 *******************************************************************************/
-static int parse_wav_header(FS_FILE *file, uint32_t *total_samples)
+static float file_read_loudness(FS_FILE *file, const char *name, U32 file_time,
+                                uint32_t total_samples)
 {
-    wav_header_t header;
-    uint32_t bytes_read;
-    
-    /* Read WAV header */
-    bytes_read = FS_Read(file, &header, WAV_HEADER_SIZE);
-    if (bytes_read != WAV_HEADER_SIZE) {
-        printf("[FileReadTask] Error: Failed to read WAV header\r\n");
-        return -1;
-    }
-    
-    /* Validate RIFF header */
-    if (header.riff_header[0] != 'R' || header.riff_header[1] != 'I' ||
-        header.riff_header[2] != 'F' || header.riff_header[3] != 'F') {
-        printf("[FileReadTask] Error: Invalid RIFF header\r\n");
-        return -1;
-    }
-    
-    /* Validate WAVE header */
-    if (header.wave_header[0] != 'W' || header.wave_header[1] != 'A' ||
-        header.wave_header[2] != 'V' || header.wave_header[3] != 'E') {
-        printf("[FileReadTask] Error: Invalid WAVE header\r\n");
-        return -1;
-    }
+    playback_dsp_config_t config;
+    float loudness;
+    uint32_t remaining = total_samples;
+    uint32_t samples_read;
+    TickType_t start;
+    I32 data_offset;
     
-    /* Validate PCM format */
-    if (header.audio_format != 1) {
-        printf("[FileReadTask] Error: Only PCM format supported (format=%d)\r\n", 
-               header.audio_format);
-        return -1;
+    if (loudness_cache_get(name, FS_GetFileSize(file), file_time, &loudness)) {
+        return loudness;
     }
-    
-    /* Validate sample rate */
-    if (header.sample_rate != WAV_SAMPLE_RATE) {
-        printf("[FileReadTask] Warning: Sample rate %u Hz (expected %d Hz)\r\n", 
-               (unsigned int)header.sample_rate, WAV_SAMPLE_RATE);
+    playback_dsp_get_config(&config);
+    data_offset = FS_FTell(file);
+    if (!config.normalize || (data_offset < 0) ||
+        (loudness_init(&read_meter, WAV_SAMPLE_RATE, WAV_NUM_CHANNELS) != 0)) {
+        return LOUDNESS_UNKNOWN;
     }
     
-    /* Validate channels */
-    if (header.num_channels != WAV_NUM_CHANNELS) {
-        printf("[FileReadTask] Error: Expected %d channels, got %d\r\n",
-               WAV_NUM_CHANNELS, header.num_channels);
-        return -1;
+    start = xTaskGetTickCount();
+    (void)xSemaphoreTake(buffer_free_sem, portMAX_DELAY);
+    while (remaining > 0u) {
+        uint32_t chunk_samples = (remaining < PCM_CHUNK_SIZE) ? remaining : PCM_CHUNK_SIZE;
+        
+        samples_read = FS_Read(file, read_ping_buffer, chunk_samples * sizeof(int16_t));
+        samples_read /= sizeof(int16_t);
+        if (samples_read == 0u) {
+            break;
+        }
+        loudness_add(&read_meter, read_ping_buffer, samples_read / WAV_NUM_CHANNELS);
+        remaining -= samples_read;
     }
+    xSemaphoreGive(buffer_free_sem);
     
-    /* Validate bit depth */
-    if (header.bits_per_sample != WAV_BITS_PER_SAMPLE) {
-        printf("[FileReadTask] Error: Expected %d-bit, got %d-bit\r\n",
-               WAV_BITS_PER_SAMPLE, header.bits_per_sample);
-        return -1;
+    if ((FS_FSeek(file, data_offset, FS_SEEK_SET) != 0) || (remaining > 0u)) {
+        printf("[FileReadTask] Warning: Loudness scan failed\r\n");
+        (void)FS_FSeek(file, data_offset, FS_SEEK_SET);
+        return LOUDNESS_UNKNOWN;
     }
-    
-    /* Calculate total samples (L+R counted separately) */
-    *total_samples = header.data_bytes / sizeof(int16_t);
-    
-    printf("[FileReadTask] WAV: %u Hz, %d ch, %d bit, %u samples\r\n",
-           (unsigned int)header.sample_rate, header.num_channels, 
-           header.bits_per_sample, (unsigned int)*total_samples);
-    
-    return 0;
+    loudness = loudness_integrated(&read_meter);
+    loudness_cache_put(name, FS_GetFileSize(file), file_time, loudness);
+    printf("[FileReadTask] Loudness %.1f LUFS, measured in %u ms\r\n", (double)loudness,
+           (unsigned int)((xTaskGetTickCount() - start) * portTICK_PERIOD_MS));
+    return loudness;
 }
 
 /*******************************************************************************
@@ -108,6 +108,9 @@ static int parse_wav_header(FS_FILE *file, uint32_t *total_samples)
 ********************************************************************************
 * Summary:
 *  File reading task - reads WAV from SD and sends PCM chunks to PlaybackTask
+*  - Only cache misses get here; each chunk is also copied into the clip
+*    cache, so the next play of the file needs no SD access
+*  - 'stop' ends the read at the next chunk; the partial clip is dropped
 *
 * Parameters:
 *  pvParameters: Task parameters (unused)
@@ -127,6 +130,11 @@ void file_read_task(void *pvParameters)
     uint32_t samples_remaining;
     int16_t *current_buffer;
     bool using_ping;
+    bool last_sent;
+    clip_entry_t *clip;
+    U32 file_time;
+    float loudness;
+    uint32_t chunk_size;
     
     /* Add startup delay */
     vTaskDelay(pdMS_TO_TICKS(350));
@@ -140,32 +148,47 @@ void file_read_task(void *pvParameters)
         }
         
         printf("[FileReadTask] Opening '%s'...\r\n", msg.filename);
+        last_sent = false;
+        total_samples = 0;
+        clip = NULL;
+        loudness = LOUDNESS_UNKNOWN;
         
         /* Open WAV file from SD card */
         file = FS_FOpen(msg.filename, "r");
         if (file == NULL) {
             printf("[FileReadTask] Error: Cannot open '%s'\r\n", msg.filename);
-            continue;
         }
-        
         /* Parse WAV header */
-        if (parse_wav_header(file, &total_samples) != 0) {
-            FS_FClose(file);
+        else if (parse_wav_header(file, &total_samples) != 0) {
             printf("[FileReadTask] Error: Invalid WAV file\r\n");
-            continue;
+            total_samples = 0;
+        }
+        else if (FS_GetFileTimeEx(msg.filename, &file_time, FS_FILETIME_MODIFY) == 0) {
+            loudness = file_read_loudness(file, msg.filename, file_time, total_samples);
+            clip = clip_cache_fill_begin(msg.filename, FS_GetFileSize(file), file_time,
+                                         total_samples);
         }
         
         samples_remaining = total_samples;
         using_ping = true;
+        chunk_size = (uint32_t)app_settings.read_chunk_samples;    /* For the whole file */
         
         /* Stream file in chunks */
         while (samples_remaining > 0) {
+            /* Wait until the playback session has finished with a buffer */
+            (void)xSemaphoreTake(buffer_free_sem, portMAX_DELAY);
+            if (playback_stop_requested) {
+                printf("[FileReadTask] Stopped\r\n");
+                xSemaphoreGive(buffer_free_sem);
+                break;
+            }
+            
             /* Select buffer */
             current_buffer = using_ping ? read_ping_buffer : read_pong_buffer;
             
             /* Determine chunk size */
-            uint32_t chunk_samples = (samples_remaining < PCM_CHUNK_SIZE) ? 
-                                      samples_remaining : PCM_CHUNK_SIZE;
+            uint32_t chunk_samples = (samples_remaining < chunk_size) ? 
+                                      samples_remaining : chunk_size;
             
             /* Read PCM data from SD */
             samples_read = FS_Read(file, current_buffer, chunk_samples * sizeof(int16_t));
@@ -173,26 +196,54 @@ void file_read_task(void *pvParameters)
             
             if (samples_read == 0) {
                 printf("[FileReadTask] Warning: Read 0 samples (EOF)\r\n");
+                xSemaphoreGive(buffer_free_sem);
                 break;
             }
             
+            if (clip != NULL) {
+                memcpy(&clip->pcm[total_samples - samples_remaining], current_buffer,
+                       samples_read * sizeof(int16_t));
+            }
+            
             /* Prepare PCM message */
             pcm_msg.buffer_ptr = current_buffer;
             pcm_msg.sample_count = samples_read;
             pcm_msg.is_last_chunk = (samples_remaining <= samples_read);
+            pcm_msg.release = NULL;
+            pcm_msg.render = NULL;
+            pcm_msg.loudness = loudness;
             
             /* Send to PlaybackTask */
             if (xQueueSend(pcm_playback_queue, &pcm_msg, pdMS_TO_TICKS(500)) != pdPASS) {
                 printf("[FileReadTask] Error: Failed to send PCM chunk\r\n");
+                xSemaphoreGive(buffer_free_sem);
                 break;
             }
             
+            last_sent = pcm_msg.is_last_chunk;
             samples_remaining -= samples_read;
             using_ping = !using_ping;  /* Ping-pong buffer swap */
         }
         
         /* Close file */
-        FS_FClose(file);
+        if (file != NULL) {
+            FS_FClose(file);
+        }
+        if (clip != NULL) {
+            clip_cache_fill_end(clip, (samples_remaining == 0u));
+        }
+        
+        /* The playback session ends on a last chunk; send an empty one if
+         * the file stopped short */
+        if (!last_sent) {
+            pcm_msg.buffer_ptr = NULL;
+            pcm_msg.sample_count = 0;
+            pcm_msg.is_last_chunk = true;
+            pcm_msg.release = NULL;
+            pcm_msg.render = NULL;
+            pcm_msg.loudness = LOUDNESS_UNKNOWN;
+            (void)xQueueSend(pcm_playback_queue, &pcm_msg, portMAX_DELAY);
+        }
         
         printf("[FileReadTask] File read complete\r\n");
     }
@@ -23,8 +23,8 @@ extern "C" {
 * Macros
 *******************************************************************************/
 #define FILE_READ_TASK_STACK_SIZE    (2048u)
-#define FILE_READ_TASK_PRIORITY      (3u)
-#define PCM_CHUNK_SIZE               (4096u)  /* Samples per chunk */
+#define FILE_READ_TASK_PRIORITY      (4u)     /* Above FileWriteTask so playback reads go first */
+#define PCM_CHUNK_SIZE               (4096u)  /* Samples per buffer; 'read_chunk' reads up to this */
 
 /*******************************************************************************
 * Structures
@@ -36,16 +36,23 @@ typedef struct {
 
 /* Message to PlaybackTask (PCM data chunk) */
 typedef struct {
-    int16_t *buffer_ptr;      /* Pointer to PCM buffer */
+    int16_t *buffer_ptr;      /* Pointer to PCM buffer, NULL if sample_count is 0 */
     uint32_t sample_count;    /* Number of samples (stereo: L+R counted as 2) */
     bool is_last_chunk;       /* True if this is the final chunk */
+    void (*release)(void *owner);   /* RAM playback: called once the chunk is sent; */
+    void *owner;                    /* NULL for FileReadTask buffers (buffer_free_sem) */
+    uint32_t (*render)(void *owner, int16_t *samples, uint32_t frames);
+                                    /* Generated in the I2S ISR instead of buffer_ptr;
+                                     * sample_count is the length, 0 if open-ended */
+    float loudness;                 /* First chunk: of the whole file, LUFS, for the
+                                     * normalizer; LOUDNESS_UNKNOWN if not measured */
 } pcm_playback_msg_t;
 
 /*******************************************************************************
 * Global Variables
 *******************************************************************************/
 extern QueueHandle_t file_read_queue;         /* AudioControl → FileRead */
-extern QueueHandle_t pcm_playback_queue;      /* FileRead → Playback */
+extern QueueHandle_t pcm_playback_queue;      /* FileRead (or RAM playback) → Playback */
 extern TaskHandle_t file_read_task_handle;
 
 /*******************************************************************************
@@ -2,9 +2,14 @@
 * File Name: file_write_task.c
 *
 * Description: File write task implementation
-*              - Receives recorded audio buffers from AudioRecordTask
+*              - Receives recorded audio buffers from AudioRecordTask and
+*                returns them to the capture pool once saved
 *              - Generates WAV file headers
 *              - Saves complete WAV files to SD card
+*              - Saves the waveform peaks next to each WAV once it is closed
+*              - Optionally keeps only the active parts of a take, one file
+*                per burst of activity
+*              - Adds the capture compressor's gain reduction when traced
 *
 *******************************************************************************/
 
@@ -12,6 +17,15 @@
 #include "freertos_setup.h"
 #include "audio_record_task.h"
 #include "wav_file.h"
+#include "peak_file.h"
+#include "segmenter.h"
+#include "capture_pool.h"
+#include "clip_cache.h"
+#include "loudness.h"
+#include "compressor.h"
+#include "wall_clock.h"
+#include "app_pdm_pcm.h"
+#include "settings.h"
 #include "FS.h"
 #include <stdio.h>
 #include <string.h>
@@ -31,7 +45,7 @@ static char filename_buffer[64];
 * Function Name: generate_filename
 ********************************************************************************
 * Summary:
-*  Generate auto-incrementing filename
+*  Generate auto-incrementing filename, <file_prefix>_NNN.wav
 *
 * Parameters:
 *  None
@@ -42,19 +56,231 @@ static char filename_buffer[64];
 *******************************************************************************/
 static const char* generate_filename(void)
 {
-    snprintf(filename_buffer, sizeof(filename_buffer), "audio_%03u.wav", (unsigned int)file_counter);
+    char prefix[SETTINGS_PREFIX_SIZE];
+    
+    settings_copy_text(app_settings.file_prefix, prefix, sizeof(prefix));
+    snprintf(filename_buffer, sizeof(filename_buffer), "%s_%03u.wav", prefix, (unsigned int)file_counter);
     file_counter++;
     return filename_buffer;
 }
 
+/*******************************************************************************
+* Function Name: file_write_gred
+********************************************************************************
+* Summary:
+*  Describe the part of the take's gain reduction trace that covers a range
+*  of frames, for the "gred" chunk
+*
+* Parameters:
+*  trace: Trace of the whole take
+*  start: First frame saved
+*  frames: Number of frames
+*  gred: Output - chunk header
+*
+* Return:
+*  First trace entry of the range
+*
+*******************************************************************************/
+static const uint8_t *file_write_gred(const comp_trace_t *trace, uint32_t start, uint32_t frames,
+                                      wav_gred_t *gred)
+{
+    uint32_t interval = trace->interval_frames;
+    uint32_t first = start / interval;
+    uint32_t end = (start + frames + interval - 1u) / interval;
+    
+    if (end > trace->count) {
+        end = trace->count;
+    }
+    if (first > end) {
+        first = end;
+    }
+    
+    memset(gred, 0, sizeof(*gred));
+    gred->version = WAV_GRED_VERSION;
+    gred->steps_per_db = COMP_TRACE_STEPS_PER_DB;
+    gred->interval_frames = interval;
+    gred->lead_frames = start - first * interval;
+    gred->count = end - first;
+    gred->threshold_db = (uint8_t)trace->config.threshold_db;
+    gred->ratio = (uint8_t)trace->config.ratio;
+    gred->ceiling_db = (uint8_t)trace->config.ceiling_db;
+    gred->makeup_db = (uint8_t)trace->config.makeup_db;
+    gred->attack_ms = (uint16_t)trace->config.attack_ms;
+    gred->release_ms = (uint16_t)trace->config.release_ms;
+    gred->lookahead_ms = (uint16_t)trace->config.lookahead_ms;
+    return &trace->reduction[first];
+}
+
+/*******************************************************************************
+* Function Name: file_write_save
+********************************************************************************
+* Summary:
+*  Save a range of a take as the next WAV file, followed by its peak sidecar
+*  - The bext time is that of the first saved frame
+*  - PDM fault counts are those of the whole take
+*  - The gain reduction trace, if kept, is cut to the range
+*
+* Parameters:
+*  msg: Take from AudioRecordTask
+*  start: First frame to save
+*  frames: Number of frames
+*  stats: Level statistics of the range
+*  peaks: Waveform peaks of the range
+*
+* Return:
+*  0 on success, -1 on error
+*
+*******************************************************************************/
+static int file_write_save(const audio_record_msg_t *msg, uint32_t start, uint32_t frames,
+                           const wav_stats_t *stats, const peak_builder_t *peaks)
+{
+    static wav_bext_t bext;
+    wav_take_t take;
+    wav_gred_t gred;
+    const uint8_t *reduction = NULL;
+    wall_clock_time_t start_time;
+    const char *filename = generate_filename();
+    
+    printf("[FileWriteTask] Filename: %s (%.2f s from %.2f s)\r\n", filename,
+           (double)frames / msg->sample_rate, (double)start / msg->sample_rate);
+    
+    /* Provenance and statistics, collected while recording */
+    wall_clock_add_ms(&msg->start_time,
+                      (uint32_t)(((uint64_t)start * 1000u) / msg->sample_rate), &start_time);
+    wav_bext_init(&bext, filename, Cy_SysLib_GetUniqueId(), &start_time, msg->sample_rate);
+    wav_take_init(&take, stats, msg->sample_rate);
+    take.gain_db = PDM_MIC_GAIN_VALUE;
+    take.pdm_overflows = msg->pdm_overflows;
+    take.pdm_underflows = msg->pdm_underflows;
+    take.frames_dropped = msg->samples_dropped / msg->num_channels;
+    take.flags = (msg->start_time.valid ? WAV_TAKE_FLAG_CLOCK_SET : 0u) |
+                 ((msg->samples_dropped > 0) ? WAV_TAKE_FLAG_TRUNCATED : 0u) |
+                 (msg->compressed ? WAV_TAKE_FLAG_COMPRESSED : 0u);
+    if (msg->gain_trace != NULL) {
+        reduction = file_write_gred(msg->gain_trace, start, frames, &gred);
+    }
+    
+    /* A sidecar, or cached PCM or loudness, left from an earlier file of this name is stale */
+    peak_file_remove(filename);
+    clip_cache_invalidate(filename);
+    loudness_cache_invalidate(filename);
+    
+    /* Save to SD card using emFile */
+    FS_FILE *file = FS_FOpen(filename, "w");
+    if (file == NULL) {
+        printf("[FileWriteTask] Error: Cannot create file '%s'\r\n", filename);
+        return -1;
+    }
+    
+    /* Header chunks, PCM data, the take chunk and the gain reduction */
+    if (wav_write_take(file, &msg->buffer_ptr[start * msg->num_channels],
+                       frames * msg->num_channels, &bext, &take,
+                       (reduction != NULL) ? &gred : NULL, reduction) != 0) {
+        printf("[FileWriteTask] Error: Write failed\r\n");
+        FS_FClose(file);
+        return -1;
+    }
+    
+    uint32_t file_size = FS_GetFileSize(file);
+    FS_FClose(file);
+    
+    printf("[FileWriteTask] Peak %u/%u, clipped %u/%u, PDM faults %u, dropped %u frames\r\n",
+           (unsigned int)take.peak[0], (unsigned int)take.peak[1],
+           (unsigned int)take.clipped[0], (unsigned int)take.clipped[1],
+           (unsigned int)(take.pdm_overflows + take.pdm_underflows),
+           (unsigned int)take.frames_dropped);
+    
+    printf("[FileWriteTask] ✓ File saved: %s (%u bytes)\r\n",
+           filename, (unsigned int)file_size);
+    
+    /* Peaks only once the audio they describe is on the card */
+    if (peak_file_write(filename, peaks) != 0) {
+        printf("[FileWriteTask] Warning: Peak file not saved ('peaks %s' rebuilds it)\r\n",
+               filename);
+    }
+    
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: file_write_segment
+********************************************************************************
+* Summary:
+*  Save one segment found by the segmenter, with statistics and peaks of
+*  just that range
+*
+*******************************************************************************/
+static int file_write_segment(const audio_record_msg_t *msg, const segment_t *segment)
+{
+    static wav_stats_t segment_stats;
+    static peak_builder_t segment_peaks;
+    const int16_t *pcm = &msg->buffer_ptr[segment->start * msg->num_channels];
+    
+    wav_stats_reset(&segment_stats);
+    wav_stats_update(&segment_stats, pcm, segment->frames * msg->num_channels);
+    peak_builder_reset(&segment_peaks, msg->num_channels, msg->sample_rate);
+    peak_builder_update(&segment_peaks, pcm, segment->frames * msg->num_channels);
+    
+    return file_write_save(msg, segment->start, segment->frames, &segment_stats, &segment_peaks);
+}
+
+/*******************************************************************************
+* Function Name: file_write_segments
+********************************************************************************
+* Summary:
+*  Pass the take through the segmenter block by block and save each segment
+*  as it closes; silence is never written
+*
+*******************************************************************************/
+static void file_write_segments(const audio_record_msg_t *msg, const segment_config_t *config)
+{
+    static segmenter_t segmenter;
+    segment_t segment;
+    uint32_t total = msg->sample_count / msg->num_channels;
+    uint32_t saved_frames = 0;
+    uint32_t count = 0;
+    
+    segmenter_init(&segmenter, config, msg->num_channels, msg->sample_rate);
+    
+    for (uint32_t position = 0; position < total; position += SEGMENT_BLOCK_FRAMES) {
+        uint32_t frames = total - position;
+        if (frames > SEGMENT_BLOCK_FRAMES) {
+            frames = SEGMENT_BLOCK_FRAMES;
+        }
+        if (segmenter_process(&segmenter, &msg->buffer_ptr[position * msg->num_channels],
+                              frames, &segment)) {
+            if (file_write_segment(msg, &segment) == 0) {
+                saved_frames += segment.frames;
+                count++;
+            }
+        }
+    }
+    if (segmenter_finish(&segmenter, &segment)) {
+        if (file_write_segment(msg, &segment) == 0) {
+            saved_frames += segment.frames;
+            count++;
+        }
+    }
+    
+    if (count == 0) {
+        printf("[FileWriteTask] No audio above -%u dBFS, nothing saved\r\n",
+               (unsigned int)config->level_db);
+    } else {
+        printf("[FileWriteTask] %u file(s), %u of %u frames kept (%u%%)\r\n",
+               (unsigned int)count, (unsigned int)saved_frames, (unsigned int)total,
+               (unsigned int)((total > 0) ? (100u * (uint64_t)saved_frames / total) : 0u));
+    }
+}
+
 /*******************************************************************************
 * Function Name: file_write_task
 ********************************************************************************
 * Summary:
 *  File write task main loop
 *  - Waits for audio_record_msg_t from audio_record_queue
-*  - Generates WAV header based on sample count
-*  - Saves WAV file to SD card (or simulates if SD not available)
+*  - Saves the take as one WAV file, or only its active parts when silence
+*    trimming/splitting is on (see 'segment')
+*  - Releases the take's capture buffer, saved or not
 *  - Notifies completion
 *
 * Parameters:
@@ -65,8 +291,7 @@ static void file_write_task(void *arg)
 {
     (void)arg;
     audio_record_msg_t record_msg;
-    wav_header_t wav_header;
-    const char *filename;
+    segment_config_t segment_config;
     
     /* Small delay to avoid printf collision with other tasks */
     vTaskDelay(pdMS_TO_TICKS(200));
@@ -83,51 +308,23 @@ static void file_write_task(void *arg)
                    (unsigned int)record_msg.num_channels,
                    (unsigned int)record_msg.sample_rate);
             
-            /* Generate filename */
-            filename = generate_filename();
-            
             /* Calculate audio duration */
             float duration_sec = (float)record_msg.sample_count / 
                                 (float)(record_msg.sample_rate * record_msg.num_channels);
             
             printf("[FileWriteTask] Duration: %.2f seconds\r\n", duration_sec);
-            printf("[FileWriteTask] Filename: %s\r\n", filename);
-            
-            /* Initialize WAV header (only needs total_samples parameter) */
-            wav_header_init(&wav_header, record_msg.sample_count);
             
-            printf("[FileWriteTask] WAV header generated (data_bytes=%u)\r\n",
-                   (unsigned int)wav_header.data_bytes);
-            
-            /* Save to SD card using emFile */
-            FS_FILE *file = FS_FOpen(filename, "w");
-            if (file == NULL) {
-                printf("[FileWriteTask] Error: Cannot create file '%s'\r\n", filename);
-                continue;
+            segment_config_get(&segment_config);
+            if (segment_config.mode == SEGMENT_MODE_OFF) {
+                (void)file_write_save(&record_msg, 0,
+                                      record_msg.sample_count / record_msg.num_channels,
+                                      &record_msg.stats, record_msg.peaks);
+            } else {
+                file_write_segments(&record_msg, &segment_config);
             }
             
-            /* Write WAV header */
-            uint32_t written = FS_Write(file, &wav_header, WAV_HEADER_SIZE);
-            if (written != WAV_HEADER_SIZE) {
-                printf("[FileWriteTask] Error: Header write failed\r\n");
-                FS_FClose(file);
-                continue;
-            }
-            
-            /* Write PCM data */
-            uint32_t data_bytes = record_msg.sample_count * sizeof(int16_t);
-            written = FS_Write(file, record_msg.buffer_ptr, data_bytes);
-            if (written != data_bytes) {
-                printf("[FileWriteTask] Error: Data write failed (%u/%u bytes)\r\n",
-                       (unsigned int)written, (unsigned int)data_bytes);
-                FS_FClose(file);
-                continue;
-            }
-            
-            FS_FClose(file);
-            
-            printf("[FileWriteTask] ✓ File saved: %s (%u bytes)\r\n",
-                   filename, (unsigned int)(WAV_HEADER_SIZE + data_bytes));
+            /* The samples are on the card (or lost); the next take may use them */
+            capture_pool_release(record_msg.buffer);
             
             /* Notify completion (could set event flag or send message) */
             printf("[FileWriteTask] Write operation complete, ready for next recording\r\n");
@@ -0,0 +1,1277 @@
+/******************************************************************************
+* File Name: file_xfer_task.c
+*
+* Description: File transfer task implementation
+*              - Streams a file from the SD card to the host over the debug UART
+*              - Go-back-N sliding window, CRC-32 per frame, resume from offset
+*              - Reads ahead from emFile in large sector-aligned chunks while
+*                the UART ISR drains the TX stream, so the link is the limit
+*              - Receives uploads into a temporary file; a writer task commits
+*                full chunks to the SD card while the next one is received,
+*                and the file is renamed into place once its header checks out;
+*                an old file of that name is kept as a backup until then
+*
+*******************************************************************************/
+
+#include "file_xfer_task.h"
+#include "crc32.h"
+#include "retarget_io_init.h"
+#include "wav_file.h"
+#include "peak_file.h"
+#include "clip_cache.h"
+#include "loudness.h"
+#include "stream_buffer.h"
+#include "FS.h"
+#include <stdio.h>
+#include <string.h>
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define XFER_NUM_CHUNKS             (2u)
+#define XFER_WINDOW_BYTES           (XFER_WINDOW_BLOCKS * XFER_BLOCK_SIZE)
+#define XFER_TX_TIMEOUT_MS          (1000u)
+#define XFER_NO_OFFSET              (0xFFFFFFFFu)
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+/* Read-ahead state: two chunk buffers holding file ranges [base, base+length) */
+typedef struct {
+    FS_FILE *file;
+    uint32_t file_size;
+    uint32_t base[XFER_NUM_CHUNKS];
+    uint32_t length[XFER_NUM_CHUNKS];
+} xfer_reader_t;
+
+/* Write-behind request: chunk buffer slot and bytes to append */
+typedef struct {
+    uint32_t slot;
+    uint32_t length;
+} xfer_write_msg_t;
+
+/* Upload receive state */
+typedef struct {
+    uint32_t fill_slot;         /* Chunk buffer being filled from DATA frames */
+    uint32_t fill_length;       /* Bytes in fill_slot */
+    bool holding_slot;          /* fill_slot is owned by the receiver */
+} xfer_writer_t;
+
+/* Sender window */
+typedef struct {
+    uint32_t base;              /* Lowest unacknowledged offset */
+    uint32_t next;              /* Next offset to send */
+    uint32_t rewind_offset;     /* Last NAK acted on, XFER_NO_OFFSET if none */
+    uint32_t retries;           /* Consecutive ACK timeouts */
+} xfer_window_t;
+
+/*******************************************************************************
+* Global Variables
+*******************************************************************************/
+QueueHandle_t file_xfer_queue = NULL;
+TaskHandle_t file_xfer_task_handle = NULL;
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+/* Read-ahead / write-behind buffers (aligned so emFile can transfer whole
+ * sectors directly) */
+static uint8_t xfer_chunk[XFER_NUM_CHUNKS][XFER_CHUNK_SIZE] __attribute__((aligned(32)));
+
+/* Incoming frame assembly */
+static uint8_t xfer_rx_buffer[XFER_MAX_FRAME_SIZE] __attribute__((aligned(4)));
+static uint32_t xfer_rx_count = 0;
+static uint32_t xfer_crc_errors = 0;
+
+/* UART byte streams (ISR <-> task) */
+static StreamBufferHandle_t xfer_tx_stream = NULL;
+static StreamBufferHandle_t xfer_rx_stream = NULL;
+
+static uint16_t xfer_seq = 0;
+
+/* Upload writer (FileXfer -> XferWrite: filled slots, XferWrite -> FileXfer: free slots) */
+static QueueHandle_t xfer_write_queue = NULL;
+static QueueHandle_t xfer_free_queue = NULL;
+static FS_FILE *xfer_write_file = NULL;
+static volatile bool xfer_write_failed = false;
+
+/*******************************************************************************
+* Function Name: xfer_tx_write
+********************************************************************************
+* Summary:
+*  Queue bytes for the UART ISR, blocking while the TX stream is full
+*
+* Return:
+*  0 on success, -1 if the line stalled
+*
+*******************************************************************************/
+static int xfer_tx_write(const void *data, uint32_t length)
+{
+    const uint8_t *p = (const uint8_t *)data;
+
+    while (length > 0u) {
+        size_t sent = xStreamBufferSend(xfer_tx_stream, p, length,
+                                        pdMS_TO_TICKS(XFER_TX_TIMEOUT_MS));
+        uart_tx_kick();
+        if (sent == 0u) {
+            return -1;
+        }
+        p += sent;
+        length -= (uint32_t)sent;
+    }
+
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: xfer_tx_flush
+********************************************************************************
+* Summary:
+*  Wait until every queued byte has left the UART
+*
+*******************************************************************************/
+static void xfer_tx_flush(void)
+{
+    TickType_t start = xTaskGetTickCount();
+
+    while (!uart_tx_idle()) {
+        if ((xTaskGetTickCount() - start) > pdMS_TO_TICKS(XFER_TX_TIMEOUT_MS)) {
+            break;
+        }
+        vTaskDelay(1);
+    }
+}
+
+/*******************************************************************************
+* Function Name: xfer_send_frame
+********************************************************************************
+* Summary:
+*  Send one frame: header, payload and CRC-32 over both (sync excluded)
+*
+* Parameters:
+*  type: Frame type
+*  offset: File offset the frame refers to
+*  payload: Payload bytes (may be NULL when length is 0)
+*  length: Payload length (<= XFER_BLOCK_SIZE)
+*
+* Return:
+*  0 on success, -1 on error
+*
+*******************************************************************************/
+static int xfer_send_frame(xfer_frame_type_t type, uint32_t offset,
+                           const void *payload, uint16_t length)
+{
+    xfer_frame_header_t header;
+    uint32_t crc;
+
+    header.sync[0] = XFER_SYNC0;
+    header.sync[1] = XFER_SYNC1;
+    header.type = (uint8_t)type;
+    header.flags = 0;
+    header.seq = xfer_seq++;
+    header.length = length;
+    header.offset = offset;
+
+    crc = crc32_update(CRC32_INIT, &header.type, sizeof(header) - sizeof(header.sync));
+    crc = crc32_final(crc32_update(crc, payload, length));
+
+    if (xfer_tx_write(&header, sizeof(header)) != 0) {
+        return -1;
+    }
+    if ((length > 0u) && (xfer_tx_write(payload, length) != 0)) {
+        return -1;
+    }
+    return xfer_tx_write(&crc, sizeof(crc));
+}
+
+/*******************************************************************************
+* Function Name: xfer_send_error
+********************************************************************************
+* Summary:
+*  Tell the host why the transfer stopped
+*
+*******************************************************************************/
+static void xfer_send_error(uint32_t offset, const char *reason)
+{
+    (void)xfer_send_frame(XFER_FRAME_ERROR, offset, reason, (uint16_t)strlen(reason));
+}
+
+/*******************************************************************************
+* Function Name: xfer_receive_frame
+********************************************************************************
+* Summary:
+*  Assemble the next valid frame from the RX stream. Hunts for the sync
+*  pattern, rejects oversized lengths and frames with a bad CRC.
+*
+* Parameters:
+*  timeout: Ticks to wait (0 = only use bytes already received)
+*
+* Return:
+*  Pointer to the frame header (payload follows it) or NULL on timeout
+*
+*******************************************************************************/
+static const xfer_frame_header_t *xfer_receive_frame(TickType_t timeout)
+{
+    const xfer_frame_header_t *header = (const xfer_frame_header_t *)xfer_rx_buffer;
+    TickType_t start = xTaskGetTickCount();
+
+    for (;;) {
+        uint32_t need;
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        TickType_t wait = (elapsed < timeout) ? (timeout - elapsed) : 0;
+
+        /* Read exactly what the parser needs next, never past a frame */
+        if (xfer_rx_count < sizeof(header->sync)) {
+            need = 1;
+        }
+        else if (xfer_rx_count < sizeof(xfer_frame_header_t)) {
+            need = sizeof(xfer_frame_header_t) - xfer_rx_count;
+        }
+        else {
+            need = sizeof(xfer_frame_header_t) + header->length +
+                   sizeof(uint32_t) - xfer_rx_count;
+        }
+
+        size_t received = xStreamBufferReceive(xfer_rx_stream,
+                                               &xfer_rx_buffer[xfer_rx_count],
+                                               need, wait);
+        if (received == 0u) {
+            return NULL;
+        }
+        xfer_rx_count += (uint32_t)received;
+
+        /* Sync hunt */
+        if (xfer_rx_buffer[0] != XFER_SYNC0) {
+            xfer_rx_count = 0;
+            continue;
+        }
+        if ((xfer_rx_count >= 2u) && (xfer_rx_buffer[1] != XFER_SYNC1)) {
+            xfer_rx_count = (xfer_rx_buffer[1] == XFER_SYNC0) ? 1u : 0u;
+            continue;
+        }
+        if (xfer_rx_count < sizeof(xfer_frame_header_t)) {
+            continue;
+        }
+
+        /* A corrupted length must not make us wait for a giant payload */
+        if (header->length > XFER_BLOCK_SIZE) {
+            xfer_crc_errors++;
+            xfer_rx_count = 0;
+            continue;
+        }
+
+        uint32_t frame_size = sizeof(xfer_frame_header_t) + header->length;
+        if (xfer_rx_count < (frame_size + sizeof(uint32_t))) {
+            continue;
+        }
+
+        /* Complete frame - verify CRC */
+        uint32_t crc;
+        memcpy(&crc, &xfer_rx_buffer[frame_size], sizeof(crc));
+        xfer_rx_count = 0;
+        if (crc != crc32_compute(&xfer_rx_buffer[sizeof(header->sync)],
+                                 frame_size - sizeof(header->sync))) {
+            xfer_crc_errors++;
+            continue;
+        }
+
+        return header;
+    }
+}
+
+/*******************************************************************************
+* Function Name: xfer_reader_load
+********************************************************************************
+* Summary:
+*  Fill a chunk buffer with the file range starting at a chunk-aligned base
+*
+* Return:
+*  0 on success, -1 on read error
+*
+*******************************************************************************/
+static int xfer_reader_load(xfer_reader_t *reader, uint32_t slot, uint32_t base)
+{
+    uint32_t length = reader->file_size - base;
+
+    if (length > XFER_CHUNK_SIZE) {
+        length = XFER_CHUNK_SIZE;
+    }
+
+    reader->length[slot] = 0;
+    if (FS_FSeek(reader->file, (I32)base, FS_SEEK_SET) != 0) {
+        return -1;
+    }
+    if (FS_Read(reader->file, xfer_chunk[slot], length) != length) {
+        return -1;
+    }
+
+    reader->base[slot] = base;
+    reader->length[slot] = length;
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: xfer_reader_find
+********************************************************************************
+* Summary:
+*  Return the slot holding the chunk that starts at base, loading it into the
+*  slot with the lower file position if necessary
+*
+* Return:
+*  Slot index, or -1 on read error
+*
+*******************************************************************************/
+static int xfer_reader_find(xfer_reader_t *reader, uint32_t base)
+{
+    uint32_t victim = 0;
+
+    for (uint32_t slot = 0; slot < XFER_NUM_CHUNKS; slot++) {
+        if ((reader->length[slot] > 0u) && (reader->base[slot] == base)) {
+            return (int)slot;
+        }
+        if ((reader->length[slot] == 0u) ||
+            ((reader->length[victim] > 0u) && (reader->base[slot] < reader->base[victim]))) {
+            victim = slot;
+        }
+    }
+
+    if (xfer_reader_load(reader, victim, base) != 0) {
+        return -1;
+    }
+    return (int)victim;
+}
+
+/*******************************************************************************
+* Function Name: xfer_reader_get
+********************************************************************************
+* Summary:
+*  Get a pointer to file data at offset. On the first block of a chunk the
+*  next chunk is read ahead, while the TX stream is still draining.
+*
+* Parameters:
+*  reader: Read-ahead state
+*  offset: File offset
+*  length: In - wanted bytes, Out - bytes available at the pointer
+*
+* Return:
+*  Pointer into a chunk buffer, or NULL on read error
+*
+*******************************************************************************/
+static const uint8_t *xfer_reader_get(xfer_reader_t *reader, uint32_t offset,
+                                      uint32_t *length)
+{
+    uint32_t base = offset - (offset % XFER_CHUNK_SIZE);
+    int slot = xfer_reader_find(reader, base);
+
+    if (slot < 0) {
+        return NULL;
+    }
+
+    uint32_t available = reader->length[slot] - (offset - base);
+    if (*length > available) {
+        *length = available;
+    }
+    const uint8_t *data = &xfer_chunk[slot][offset - base];
+
+    /* Read ahead - the other slot holds the previous chunk, which is only
+     * needed again if the host rewinds past a chunk boundary */
+    if ((offset == base) && ((base + XFER_CHUNK_SIZE) < reader->file_size)) {
+        if (xfer_reader_find(reader, base + XFER_CHUNK_SIZE) < 0) {
+            return NULL;
+        }
+    }
+
+    return data;
+}
+
+/*******************************************************************************
+* Function Name: xfer_session_begin
+********************************************************************************
+* Summary:
+*  Take the UART away from the CLI
+*
+*******************************************************************************/
+static void xfer_session_begin(void)
+{
+    /* Let the CLI prompt go out before switching to binary frames */
+    vTaskDelay(pdMS_TO_TICKS(XFER_START_DELAY_MS));
+
+    xStreamBufferReset(xfer_tx_stream);
+    xStreamBufferReset(xfer_rx_stream);
+    xfer_rx_count = 0;
+    xfer_crc_errors = 0;
+    xfer_seq = 0;
+
+    uart_stream_attach(xfer_rx_stream, xfer_tx_stream);
+}
+
+/*******************************************************************************
+* Function Name: xfer_session_end
+********************************************************************************
+* Summary:
+*  Drain the line, go back to the console baud rate and hand the UART back
+*
+*******************************************************************************/
+static void xfer_session_end(void)
+{
+    xfer_tx_flush();
+    if (uart_get_baud_rate() != XFER_CONSOLE_BAUD_RATE) {
+        (void)uart_set_baud_rate(XFER_CONSOLE_BAUD_RATE);
+    }
+    uart_stream_detach();
+}
+
+/*******************************************************************************
+* Function Name: xfer_wait_for_host
+********************************************************************************
+* Summary:
+*  Wait for the host's first ACK at the new baud rate
+*
+* Return:
+*  0 when the host acknowledged the start offset, -1 otherwise
+*
+*******************************************************************************/
+static int xfer_wait_for_host(uint32_t start_offset)
+{
+    TickType_t start = xTaskGetTickCount();
+
+    while ((xTaskGetTickCount() - start) < pdMS_TO_TICKS(XFER_START_TIMEOUT_MS)) {
+        const xfer_frame_header_t *frame = xfer_receive_frame(pdMS_TO_TICKS(100));
+
+        if (frame == NULL) {
+            continue;
+        }
+        if (frame->type == XFER_FRAME_ABORT) {
+            return -1;
+        }
+        if ((frame->type == XFER_FRAME_ACK) && (frame->offset == start_offset)) {
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/*******************************************************************************
+* Function Name: xfer_process_reply
+********************************************************************************
+* Summary:
+*  Apply a host ACK/NAK to the sender window
+*
+* Return:
+*  0 to continue, -1 if the host aborted
+*
+*******************************************************************************/
+static int xfer_process_reply(const xfer_frame_header_t *frame, xfer_window_t *window)
+{
+    switch (frame->type) {
+        case XFER_FRAME_ACK:
+            if ((frame->offset > window->base) && (frame->offset <= window->next)) {
+                window->base = frame->offset;
+                window->retries = 0;
+                if ((window->rewind_offset != XFER_NO_OFFSET) &&
+                    (window->base > window->rewind_offset)) {
+                    window->rewind_offset = XFER_NO_OFFSET;
+                }
+            }
+            break;
+
+        case XFER_FRAME_NAK:
+            /* One rewind per gap - later NAKs for it were already in flight */
+            if ((frame->offset >= window->base) && (frame->offset < window->next) &&
+                (frame->offset != window->rewind_offset)) {
+                window->next = frame->offset;
+                window->rewind_offset = frame->offset;
+            }
+            break;
+
+        case XFER_FRAME_ABORT:
+            return -1;
+
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: xfer_download
+********************************************************************************
+* Summary:
+*  Send one file to the host
+*  - INFO frame at the console baud rate, then switch to the transfer rate
+*  - Go-back-N: keep XFER_WINDOW_BLOCKS unacknowledged, rewind to the last
+*    ACK on NAK or timeout
+*  - END frame carries the CRC-32 of the sent range and link statistics
+*
+* Parameters:
+*  request: File name, resume offset and baud rate
+*
+*******************************************************************************/
+static void xfer_download(const file_xfer_msg_t *request)
+{
+    xfer_reader_t reader;
+    xfer_info_t info;
+    xfer_end_t end;
+    const char *failure = NULL;
+    uint32_t start_offset = request->offset;
+    xfer_window_t window;
+    uint32_t high_water;        /* Highest offset sent so far */
+    uint32_t crc_offset;        /* Range CRC covers [start_offset, crc_offset) */
+    uint32_t crc = CRC32_INIT;
+    TickType_t start_tick = 0;
+
+    memset(&reader, 0, sizeof(reader));
+    memset(&end, 0, sizeof(end));
+
+    reader.file = FS_FOpen(request->filename, "r");
+    if (reader.file == NULL) {
+        printf("[FileXfer] Error: Cannot open '%s'\r\n", request->filename);
+        return;
+    }
+    reader.file_size = FS_GetFileSize(reader.file);
+
+    if (start_offset > reader.file_size) {
+        printf("[FileXfer] Error: Offset %u beyond end of file (%u bytes)\r\n",
+               (unsigned int)start_offset, (unsigned int)reader.file_size);
+        FS_FClose(reader.file);
+        return;
+    }
+
+    info.file_size = reader.file_size;
+    info.baud_rate = (request->baud_rate != 0u) ? request->baud_rate : XFER_DEFAULT_BAUD_RATE;
+    if (!uart_baud_rate_valid(info.baud_rate)) {
+        info.baud_rate = XFER_CONSOLE_BAUD_RATE;
+    }
+    info.block_size = XFER_BLOCK_SIZE;
+    info.window = XFER_WINDOW_BLOCKS;
+
+    /* From here on the UART carries binary frames only */
+    xfer_session_begin();
+
+    (void)xfer_send_frame(XFER_FRAME_INFO, start_offset, &info, sizeof(info));
+    xfer_tx_flush();
+    if (info.baud_rate != uart_get_baud_rate()) {
+        (void)uart_set_baud_rate(info.baud_rate);
+    }
+
+    if (xfer_wait_for_host(start_offset) != 0) {
+        failure = "host did not respond";
+        goto done;
+    }
+
+    window.base = start_offset;
+    window.next = start_offset;
+    window.rewind_offset = XFER_NO_OFFSET;
+    window.retries = 0;
+    high_water = start_offset;
+    crc_offset = start_offset;
+    start_tick = xTaskGetTickCount();
+
+    while (window.base < reader.file_size) {
+        const xfer_frame_header_t *frame;
+
+        /* Fill the window */
+        while ((window.next < reader.file_size) &&
+               ((window.next - window.base) < XFER_WINDOW_BYTES)) {
+            uint32_t offset = window.next;
+            uint32_t length = reader.file_size - offset;
+            if (length > XFER_BLOCK_SIZE) {
+                length = XFER_BLOCK_SIZE;
+            }
+
+            const uint8_t *data = xfer_reader_get(&reader, offset, &length);
+            if (data == NULL) {
+                failure = "SD read error";
+                xfer_send_error(offset, failure);
+                goto done;
+            }
+
+            /* Range CRC follows the first transmission of each byte */
+            if (offset == crc_offset) {
+                crc = crc32_update(crc, data, length);
+                crc_offset += length;
+            }
+            if (offset < high_water) {
+                end.resends++;
+            }
+
+            if (xfer_send_frame(XFER_FRAME_DATA, offset, data, (uint16_t)length) != 0) {
+                failure = "UART stalled";
+                goto done;
+            }
+            end.bytes_sent += length;
+            window.next = offset + length;
+            if (window.next > high_water) {
+                high_water = window.next;
+            }
+
+            /* Pick up replies that already arrived, without blocking */
+            frame = xfer_receive_frame(0);
+            if ((frame != NULL) && (xfer_process_reply(frame, &window) != 0)) {
+                failure = "aborted by host";
+                goto done;
+            }
+        }
+
+        /* Window full or everything sent - wait for the host */
+        frame = xfer_receive_frame(pdMS_TO_TICKS(XFER_ACK_TIMEOUT_MS));
+        if (frame == NULL) {
+            if (++window.retries > XFER_MAX_RETRIES) {
+                /* Host is gone - it can resume from its file size later */
+                failure = "link lost";
+                goto done;
+            }
+            window.next = window.base;
+            continue;
+        }
+        if (xfer_process_reply(frame, &window) != 0) {
+            failure = "aborted by host";
+            goto done;
+        }
+    }
+
+    end.crc32 = crc32_final(crc);
+    end.elapsed_ms = (uint32_t)((xTaskGetTickCount() - start_tick) * portTICK_PERIOD_MS);
+    (void)xfer_send_frame(XFER_FRAME_END, reader.file_size, &end, sizeof(end));
+
+done:
+    xfer_session_end();
+    FS_FClose(reader.file);
+
+    if (failure != NULL) {
+        printf("\r\n[FileXfer] Transfer of '%s' stopped: %s\r\n", request->filename, failure);
+        printf("[FileXfer] Resume with: get %s <bytes received>\r\n", request->filename);
+        return;
+    }
+
+    /* Payload throughput against raw 8N1 line capacity (10 bits per byte) */
+    uint32_t sent = reader.file_size - start_offset;
+    uint32_t elapsed_ms = (end.elapsed_ms > 0u) ? end.elapsed_ms : 1u;
+    uint32_t rate = (uint32_t)(((uint64_t)sent * 1000u) / elapsed_ms);
+    uint32_t link_rate = info.baud_rate / 10u;
+
+    printf("\r\n[FileXfer] Sent '%s' bytes %u-%u (CRC32 %08X)\r\n",
+           request->filename, (unsigned int)start_offset,
+           (unsigned int)reader.file_size, (unsigned int)end.crc32);
+    printf("[FileXfer] %u ms, %u B/s = %u%% of %u baud link, %u resends, %u bad frames\r\n",
+           (unsigned int)elapsed_ms, (unsigned int)rate,
+           (unsigned int)((rate * 100u) / link_rate), (unsigned int)info.baud_rate,
+           (unsigned int)end.resends, (unsigned int)xfer_crc_errors);
+}
+
+/*******************************************************************************
+* Function Name: xfer_writer_task
+********************************************************************************
+* Summary:
+*  Write-behind task for uploads - appends each filled chunk buffer to the
+*  open upload file and hands the buffer back, so SD writes overlap with
+*  UART reception of the next chunk
+*
+* Parameters:
+*  pvParameters: Task parameters (unused)
+*
+*******************************************************************************/
+static void xfer_writer_task(void *pvParameters)
+{
+    (void)pvParameters;
+    xfer_write_msg_t msg;
+
+    while (1) {
+        if (xQueueReceive(xfer_write_queue, &msg, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        /* After one failure the rest is discarded, the upload is aborted */
+        if (!xfer_write_failed &&
+            (FS_Write(xfer_write_file, xfer_chunk[msg.slot], msg.length) != msg.length)) {
+            xfer_write_failed = true;
+        }
+
+        (void)xQueueSend(xfer_free_queue, &msg.slot, portMAX_DELAY);
+    }
+}
+
+/*******************************************************************************
+* Function Name: xfer_writer_begin
+********************************************************************************
+* Summary:
+*  Hand the upload file to the writer task and claim the first buffer
+*
+*******************************************************************************/
+static void xfer_writer_begin(xfer_writer_t *writer, FS_FILE *file)
+{
+    xQueueReset(xfer_write_queue);
+    xQueueReset(xfer_free_queue);
+    for (uint32_t slot = 1; slot < XFER_NUM_CHUNKS; slot++) {
+        (void)xQueueSend(xfer_free_queue, &slot, 0);
+    }
+
+    xfer_write_file = file;
+    xfer_write_failed = false;
+
+    writer->fill_slot = 0;
+    writer->fill_length = 0;
+    writer->holding_slot = true;
+}
+
+/*******************************************************************************
+* Function Name: xfer_writer_append
+********************************************************************************
+* Summary:
+*  Copy received payload into the fill buffer. Full buffers go to the writer
+*  task and the next free one is claimed; this only blocks when the SD card
+*  falls a whole chunk behind the link.
+*
+* Return:
+*  0 on success, -1 on write error or timeout
+*
+*******************************************************************************/
+static int xfer_writer_append(xfer_writer_t *writer, const uint8_t *data, uint32_t length)
+{
+    while (length > 0u) {
+        uint32_t space = XFER_CHUNK_SIZE - writer->fill_length;
+        uint32_t copy = (length < space) ? length : space;
+
+        memcpy(&xfer_chunk[writer->fill_slot][writer->fill_length], data, copy);
+        writer->fill_length += copy;
+        data += copy;
+        length -= copy;
+
+        if (writer->fill_length == XFER_CHUNK_SIZE) {
+            xfer_write_msg_t msg = { writer->fill_slot, writer->fill_length };
+
+            writer->holding_slot = false;
+            (void)xQueueSend(xfer_write_queue, &msg, portMAX_DELAY);
+
+            if (xQueueReceive(xfer_free_queue, &writer->fill_slot,
+                              pdMS_TO_TICKS(XFER_WRITE_TIMEOUT_MS)) != pdTRUE) {
+                return -1;
+            }
+            writer->holding_slot = true;
+            writer->fill_length = 0;
+        }
+    }
+
+    return xfer_write_failed ? -1 : 0;
+}
+
+/*******************************************************************************
+* Function Name: xfer_writer_finish
+********************************************************************************
+* Summary:
+*  Queue the partly filled buffer (if any) and wait until every buffer is
+*  back, i.e. all data has been handed to emFile
+*
+* Parameters:
+*  writer: Receive state
+*  flush: false to drop the partly filled buffer (aborted upload)
+*
+* Return:
+*  0 if everything was written, -1 otherwise
+*
+*******************************************************************************/
+static int xfer_writer_finish(xfer_writer_t *writer, bool flush)
+{
+    uint32_t outstanding = XFER_NUM_CHUNKS;
+    uint32_t slot;
+
+    if (writer->holding_slot) {
+        if (flush && (writer->fill_length > 0u)) {
+            xfer_write_msg_t msg = { writer->fill_slot, writer->fill_length };
+            (void)xQueueSend(xfer_write_queue, &msg, portMAX_DELAY);
+        }
+        else {
+            outstanding--;
+        }
+        writer->holding_slot = false;
+    }
+
+    while (outstanding > 0u) {
+        if (xQueueReceive(xfer_free_queue, &slot, pdMS_TO_TICKS(XFER_WRITE_TIMEOUT_MS)) != pdTRUE) {
+            return -1;
+        }
+        outstanding--;
+    }
+
+    return xfer_write_failed ? -1 : 0;
+}
+
+/*******************************************************************************
+* Function Name: xfer_file_exists
+********************************************************************************
+* Summary:
+*  Check whether a file can be opened for reading
+*
+*******************************************************************************/
+static bool xfer_file_exists(const char *filename)
+{
+    FS_FILE *file = FS_FOpen(filename, "r");
+
+    if (file == NULL) {
+        return false;
+    }
+    FS_FClose(file);
+    return true;
+}
+
+/*******************************************************************************
+* Function Name: xfer_check_upload
+********************************************************************************
+* Summary:
+*  Check the temporary upload file with the playback header parser
+*
+* Return:
+*  NULL if the file is playable, otherwise the reason it is not
+*
+*******************************************************************************/
+static const char *xfer_check_upload(void)
+{
+    uint32_t total_samples;
+    FS_FILE *file = FS_FOpen(XFER_TEMP_FILENAME, "r");
+    int result;
+
+    if (file == NULL) {
+        return "cannot reopen upload";
+    }
+    result = parse_wav_header(file, &total_samples);
+    FS_FClose(file);
+
+    return (result == 0) ? NULL : "not a playable WAV file";
+}
+
+/*******************************************************************************
+* Function Name: xfer_write_target
+********************************************************************************
+* Summary:
+*  Store the name an upload is being committed to in XFER_TARGET_FILENAME,
+*  so that xfer_recover() can finish the commit after a reset
+*
+* Return:
+*  0 on success, -1 on failure
+*
+*******************************************************************************/
+static int xfer_write_target(const char *filename)
+{
+    uint32_t length = (uint32_t)strlen(filename);
+    FS_FILE *file = FS_FOpen(XFER_TARGET_FILENAME, "w");
+    int result = 0;
+
+    if (file == NULL) {
+        return -1;
+    }
+    if (FS_Write(file, filename, length) != length) {
+        result = -1;
+    }
+    if (FS_FClose(file) != 0) {
+        result = -1;
+    }
+    if (result != 0) {
+        (void)FS_Remove(XFER_TARGET_FILENAME);
+    }
+    return result;
+}
+
+/*******************************************************************************
+* Function Name: xfer_read_target
+********************************************************************************
+* Summary:
+*  Read the name stored by xfer_write_target()
+*
+* Parameters:
+*  filename: Receives the name
+*  size: Size of filename
+*
+* Return:
+*  0 if a commit was in progress, -1 if there is no valid XFER_TARGET_FILENAME
+*
+*******************************************************************************/
+static int xfer_read_target(char *filename, uint32_t size)
+{
+    FS_FILE *file = FS_FOpen(XFER_TARGET_FILENAME, "r");
+    uint32_t length;
+
+    if (file == NULL) {
+        return -1;
+    }
+    length = FS_Read(file, filename, size - 1u);
+    FS_FClose(file);
+
+    filename[length] = '\0';
+    return (length > 0u) ? 0 : -1;
+}
+
+/*******************************************************************************
+* Function Name: xfer_recover
+********************************************************************************
+* Summary:
+*  Clean up after an upload that a reset or an SD error cut off, the way
+*  settings_load() finishes a config save:
+*  - In the middle of a commit (XFER_TARGET_FILENAME present) with the target
+*    missing, the validated upload is moved into place, or failing that the
+*    old file is moved back from XFER_BACKUP_FILENAME
+*  - Once the target exists, the backup and the stored name are removed
+*  - Any XFER_TEMP_FILENAME left after that is a partial upload
+*
+* Return:
+*  0 when no upload is pending, -1 if the target could not be restored; the
+*  files are then kept and no new upload may start
+*
+*******************************************************************************/
+static int xfer_recover(void)
+{
+    char target[XFER_FILENAME_SIZE];
+
+    if (xfer_read_target(target, sizeof(target)) == 0) {
+        if (!xfer_file_exists(target)) {
+            if ((xfer_check_upload() == NULL) && (FS_Rename(XFER_TEMP_FILENAME, target) == 0)) {
+                printf("[FileXfer] Finished the interrupted upload of '%s'\r\n", target);
+            }
+            else if (FS_Rename(XFER_BACKUP_FILENAME, target) == 0) {
+                printf("[FileXfer] Restored '%s' after an interrupted upload\r\n", target);
+            }
+            else {
+                printf("[FileXfer] Error: Cannot restore '%s'; it is kept as %s and %s\r\n",
+                       target, XFER_TEMP_FILENAME, XFER_BACKUP_FILENAME);
+                return -1;
+            }
+        }
+        (void)FS_Remove(XFER_BACKUP_FILENAME);
+        (void)FS_Remove(XFER_TARGET_FILENAME);
+    }
+
+    (void)FS_Remove(XFER_TEMP_FILENAME);
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: xfer_commit_upload
+********************************************************************************
+* Summary:
+*  Validate the uploaded temporary file with the playback header parser and
+*  move it to its final name. A file of the same name is moved aside to
+*  XFER_BACKUP_FILENAME first and only removed once the new one is in place;
+*  if the rename fails it is moved back. The target name is stored for
+*  xfer_recover() until the commit is complete.
+*
+* Parameters:
+*  filename: Final name
+*  keep_temp: Set when neither file could be put back under the final name,
+*             so XFER_TEMP_FILENAME must be kept for xfer_recover()
+*
+* Return:
+*  NULL on success, otherwise the reason for the failure
+*
+*******************************************************************************/
+static const char *xfer_commit_upload(const char *filename, bool *keep_temp)
+{
+    const char *failure = xfer_check_upload();
+    bool replacing;
+
+    *keep_temp = false;
+    if (failure != NULL) {
+        return failure;
+    }
+    if (xfer_write_target(filename) != 0) {
+        return "SD write error";
+    }
+
+    /* Peaks of the file being replaced are stale; 'peaks' rebuilds them */
+    peak_file_remove(filename);
+    clip_cache_invalidate(filename);
+    loudness_cache_invalidate(filename);
+
+    replacing = xfer_file_exists(filename);
+    if (replacing && (FS_Rename(filename, XFER_BACKUP_FILENAME) != 0)) {
+        (void)FS_Remove(XFER_TARGET_FILENAME);
+        return "cannot move the old file aside";
+    }
+    if (FS_Rename(XFER_TEMP_FILENAME, filename) != 0) {
+        if (replacing && (FS_Rename(XFER_BACKUP_FILENAME, filename) != 0)) {
+            *keep_temp = true;
+            return "rename failed, old file kept as " XFER_BACKUP_FILENAME;
+        }
+        (void)FS_Remove(XFER_TARGET_FILENAME);
+        return "rename failed";
+    }
+
+    (void)FS_Remove(XFER_BACKUP_FILENAME);
+    (void)FS_Remove(XFER_TARGET_FILENAME);
+    return NULL;
+}
+
+/*******************************************************************************
+* Function Name: xfer_upload
+********************************************************************************
+* Summary:
+*  Receive one file from the host
+*  - INFO frame at the console baud rate, then switch to the transfer rate
+*  - Host sends DATA frames; in-order ones are ACKed and buffered, a gap is
+*    NAKed once, duplicates are re-ACKed
+*  - Data goes to XFER_TEMP_FILENAME, which replaces the target only after
+*    parse_wav_header() accepts it
+*  - END frame carries the CRC-32 of the received data
+*
+* Parameters:
+*  request: File name, size and baud rate
+*
+*******************************************************************************/
+static void xfer_upload(const file_xfer_msg_t *request)
+{
+    xfer_writer_t writer;
+    xfer_info_t info;
+    xfer_end_t end;
+    const char *failure = NULL;
+    bool keep_temp = false;
+    uint32_t file_size = request->file_size;
+    uint32_t expected = 0;          /* All bytes below this are buffered */
+    uint32_t nak_offset = XFER_NO_OFFSET;
+    uint32_t retries = 0;
+    uint32_t crc = CRC32_INIT;
+    TickType_t start_tick = 0;
+    FS_FILE *file;
+
+    memset(&end, 0, sizeof(end));
+
+    if (xfer_recover() != 0) {
+        printf("[FileXfer] Error: An earlier upload is still pending\r\n");
+        return;
+    }
+    if (file_size <= WAV_HEADER_SIZE) {
+        printf("[FileXfer] Error: Upload size %u is too small for a WAV file\r\n",
+               (unsigned int)file_size);
+        return;
+    }
+    if ((file_size / 1024u) >= FS_GetVolumeFreeSpaceKB("")) {
+        printf("[FileXfer] Error: Not enough free space for %u bytes\r\n",
+               (unsigned int)file_size);
+        return;
+    }
+
+    file = FS_FOpen(XFER_TEMP_FILENAME, "w");
+    if (file == NULL) {
+        printf("[FileXfer] Error: Cannot create '%s'\r\n", XFER_TEMP_FILENAME);
+        return;
+    }
+
+    info.file_size = file_size;
+    info.baud_rate = (request->baud_rate != 0u) ? request->baud_rate : XFER_DEFAULT_BAUD_RATE;
+    if (!uart_baud_rate_valid(info.baud_rate)) {
+        info.baud_rate = XFER_CONSOLE_BAUD_RATE;
+    }
+    info.block_size = XFER_BLOCK_SIZE;
+    info.window = XFER_WINDOW_BLOCKS;
+
+    xfer_writer_begin(&writer, file);
+
+    /* From here on the UART carries binary frames only */
+    xfer_session_begin();
+
+    (void)xfer_send_frame(XFER_FRAME_INFO, 0, &info, sizeof(info));
+    xfer_tx_flush();
+    if (info.baud_rate != uart_get_baud_rate()) {
+        (void)uart_set_baud_rate(info.baud_rate);
+    }
+
+    if (xfer_wait_for_host(0) != 0) {
+        failure = "host did not respond";
+        goto done;
+    }
+    (void)xfer_send_frame(XFER_FRAME_ACK, 0, NULL, 0);
+    start_tick = xTaskGetTickCount();
+
+    while (expected < file_size) {
+        const xfer_frame_header_t *frame = xfer_receive_frame(pdMS_TO_TICKS(XFER_ACK_TIMEOUT_MS));
+
+        if (frame == NULL) {
+            if (++retries > XFER_MAX_RETRIES) {
+                failure = "link lost";
+                goto done;
+            }
+            /* Remind the host where we are */
+            (void)xfer_send_frame(XFER_FRAME_ACK, expected, NULL, 0);
+            continue;
+        }
+        retries = 0;
+
+        if (frame->type == XFER_FRAME_ABORT) {
+            failure = "aborted by host";
+            goto done;
+        }
+        if (frame->type != XFER_FRAME_DATA) {
+            /* Late start-up ACKs from the host */
+            (void)xfer_send_frame(XFER_FRAME_ACK, expected, NULL, 0);
+            continue;
+        }
+
+        end.bytes_sent += frame->length;
+
+        if ((frame->offset == expected) && (frame->length > 0u) &&
+            (frame->length <= (file_size - expected))) {
+            const uint8_t *payload = (const uint8_t *)(frame + 1);
+
+            crc = crc32_update(crc, payload, frame->length);
+            expected += frame->length;
+            nak_offset = XFER_NO_OFFSET;
+            (void)xfer_send_frame(XFER_FRAME_ACK, expected, NULL, 0);
+
+            if (xfer_writer_append(&writer, payload, frame->length) != 0) {
+                failure = "SD write error";
+                xfer_send_error(expected, failure);
+                goto done;
+            }
+        }
+        else if (frame->offset > expected) {
+            /* Gap - a frame was lost; ask once, the rest of the window follows */
+            end.resends++;
+            if (nak_offset != expected) {
+                (void)xfer_send_frame(XFER_FRAME_NAK, expected, NULL, 0);
+                nak_offset = expected;
+            }
+        }
+        else {
+            /* Duplicate of data we already have - our ACK was lost */
+            (void)xfer_send_frame(XFER_FRAME_ACK, expected, NULL, 0);
+        }
+    }
+
+    end.elapsed_ms = (uint32_t)((xTaskGetTickCount() - start_tick) * portTICK_PERIOD_MS);
+    end.crc32 = crc32_final(crc);
+    end.resends += xfer_crc_errors;
+
+    if (xfer_writer_finish(&writer, true) != 0) {
+        failure = "SD write error";
+    }
+    else if (FS_FClose(file) != 0) {
+        failure = "SD close error";
+    }
+    file = NULL;
+
+    if (failure == NULL) {
+        failure = xfer_commit_upload(request->filename, &keep_temp);
+    }
+    if (failure != NULL) {
+        xfer_send_error(expected, failure);
+        goto done;
+    }
+
+    (void)xfer_send_frame(XFER_FRAME_END, file_size, &end, sizeof(end));
+
+done:
+    xfer_session_end();
+    if (writer.holding_slot || (file != NULL)) {
+        (void)xfer_writer_finish(&writer, false);
+    }
+    if (file != NULL) {
+        FS_FClose(file);
+    }
+    xfer_write_file = NULL;
+
+    if (failure != NULL) {
+        if (!keep_temp) {
+            (void)FS_Remove(XFER_TEMP_FILENAME);
+        }
+        printf("\r\n[FileXfer] Upload of '%s' failed at %u bytes: %s\r\n",
+               request->filename, (unsigned int)expected, failure);
+        return;
+    }
+
+    uint32_t elapsed_ms = (end.elapsed_ms > 0u) ? end.elapsed_ms : 1u;
+    uint32_t rate = (uint32_t)(((uint64_t)file_size * 1000u) / elapsed_ms);
+    uint32_t link_rate = info.baud_rate / 10u;
+
+    printf("\r\n[FileXfer] Received '%s' %u bytes (CRC32 %08X)\r\n",
+           request->filename, (unsigned int)file_size, (unsigned int)end.crc32);
+    printf("[FileXfer] %u ms, %u B/s = %u%% of %u baud link, %u dropped frames\r\n",
+           (unsigned int)elapsed_ms, (unsigned int)rate,
+           (unsigned int)((rate * 100u) / link_rate), (unsigned int)info.baud_rate,
+           (unsigned int)end.resends);
+}
+
+/*******************************************************************************
+* Function Name: file_xfer_task
+********************************************************************************
+* Summary:
+*  File transfer task - serves download and upload requests from
+*  AudioControlTask
+*
+* Parameters:
+*  pvParameters: Task parameters (unused)
+*
+* Return:
+*  None
+*
+*******************************************************************************/
+void file_xfer_task(void *pvParameters)
+{
+    (void)pvParameters;
+    file_xfer_msg_t msg;
+
+    /* Add startup delay */
+    vTaskDelay(pdMS_TO_TICKS(450));
+
+    printf("=== File Transfer Task Started ===\r\n");
+
+    /* Finish or roll back an upload cut off by a reset */
+    (void)xfer_recover();
+
+    while (1) {
+        /* Wait for transfer request */
+        if (xQueueReceive(file_xfer_queue, &msg, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        if (msg.direction == XFER_DIR_PUT) {
+            xfer_upload(&msg);
+        }
+        else {
+            xfer_download(&msg);
+        }
+    }
+}
+
+/*******************************************************************************
+* Function Name: file_xfer_task_create
+********************************************************************************
+* Summary:
+*  Create File Transfer Task, its upload writer task, UART streams and
+*  writer queues (request queue created in freertos_setup.c)
+*
+*******************************************************************************/
+void file_xfer_task_create(void)
+{
+    xfer_tx_stream = xStreamBufferCreate(XFER_TX_STREAM_SIZE, 1);
+    xfer_rx_stream = xStreamBufferCreate(XFER_RX_STREAM_SIZE, 1);
+    if ((xfer_tx_stream == NULL) || (xfer_rx_stream == NULL)) {
+        printf("Error: Failed to create file transfer streams\r\n");
+        return;
+    }
+
+    xfer_write_queue = xQueueCreate(XFER_NUM_CHUNKS, sizeof(xfer_write_msg_t));
+    xfer_free_queue = xQueueCreate(XFER_NUM_CHUNKS, sizeof(uint32_t));
+    if ((xfer_write_queue == NULL) || (xfer_free_queue == NULL)) {
+        printf("Error: Failed to create file transfer writer queues\r\n");
+        return;
+    }
+
+    if (xTaskCreate(xfer_writer_task, "XferWrite", FILE_XFER_WRITER_STACK_SIZE,
+                    NULL, FILE_XFER_WRITER_PRIORITY, NULL) != pdPASS) {
+        printf("Error: File Transfer writer task creation failed\r\n");
+        return;
+    }
+
+    BaseType_t result = xTaskCreate(
+        file_xfer_task,
+        "FileXfer",
+        FILE_XFER_TASK_STACK_SIZE,
+        NULL,
+        FILE_XFER_TASK_PRIORITY,
+        &file_xfer_task_handle
+    );
+
+    if (result != pdPASS) {
+        printf("Error: File Transfer Task creation failed\r\n");
+        file_xfer_task_handle = NULL;
+    }
+}
@@ -0,0 +1,133 @@
+/******************************************************************************
+* File Name: file_xfer_task.h
+*
+* Description: File transfer task header
+*              Moves WAV files between the SD card and a host PC over the
+*              debug UART using windowed, CRC-protected frames, in either
+*              direction
+*
+*******************************************************************************/
+
+#ifndef __FILE_XFER_TASK_H__
+#define __FILE_XFER_TASK_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define FILE_XFER_TASK_STACK_SIZE   (2048u)
+#define FILE_XFER_TASK_PRIORITY     (2u)
+#define FILE_XFER_QUEUE_LENGTH      (2u)
+#define FILE_XFER_WRITER_STACK_SIZE (1024u)
+#define FILE_XFER_WRITER_PRIORITY   (2u)
+
+/* Link parameters */
+#define XFER_CONSOLE_BAUD_RATE      (115200u)   /* CLI baud rate, restored after a transfer */
+#define XFER_DEFAULT_BAUD_RATE      (921600u)   /* Used when the host does not ask for one */
+#define XFER_BLOCK_SIZE             (1024u)     /* Payload bytes per DATA frame */
+#define XFER_WINDOW_BLOCKS          (8u)        /* Unacknowledged DATA frames in flight */
+#define XFER_CHUNK_SIZE             (16384u)    /* emFile read-ahead size (sector multiple) */
+#define XFER_TX_STREAM_SIZE         (4096u)     /* Bytes buffered ahead of the TX FIFO */
+#define XFER_RX_STREAM_SIZE         (2048u)     /* Bytes buffered from the RX FIFO */
+#define XFER_FILENAME_SIZE          (32u)
+#define XFER_TEMP_FILENAME          "upload.tmp"    /* Upload target until validated */
+#define XFER_BACKUP_FILENAME        "upload.bak"    /* File being replaced, until the commit */
+#define XFER_TARGET_FILENAME        "upload.dst"    /* Name being committed to */
+
+/* Timing */
+#define XFER_START_DELAY_MS         (50u)       /* Let the CLI finish printing */
+#define XFER_START_TIMEOUT_MS       (3000u)     /* Host must ACK within this at the new baud */
+#define XFER_ACK_TIMEOUT_MS         (500u)      /* Resend window after this long without ACK */
+#define XFER_MAX_RETRIES            (6u)        /* Consecutive timeouts before giving up */
+#define XFER_WRITE_TIMEOUT_MS       (2000u)     /* Longest wait for an SD write buffer */
+
+/* Frame layout: header | payload | CRC-32 (header without sync + payload) */
+#define XFER_SYNC0                  (0xA5u)
+#define XFER_SYNC1                  (0x5Au)
+#define XFER_FRAME_OVERHEAD         (sizeof(xfer_frame_header_t) + sizeof(uint32_t))
+#define XFER_MAX_FRAME_SIZE         (XFER_BLOCK_SIZE + XFER_FRAME_OVERHEAD)
+
+/*******************************************************************************
+* Enumerations
+*******************************************************************************/
+typedef enum {
+    XFER_FRAME_INFO  = 0x01,    /* Device -> host: file size and link parameters */
+    XFER_FRAME_DATA  = 0x02,    /* Sender -> receiver: file bytes at offset */
+    XFER_FRAME_END   = 0x03,    /* Device -> host: range CRC and statistics */
+    XFER_FRAME_ERROR = 0x04,    /* Device -> host: text reason, transfer aborted */
+    XFER_FRAME_ACK   = 0x10,    /* Receiver -> sender: all bytes below offset received */
+    XFER_FRAME_NAK   = 0x11,    /* Receiver -> sender: resend starting at offset */
+    XFER_FRAME_ABORT = 0x12     /* Host -> device: stop now */
+} xfer_frame_type_t;
+
+typedef enum {
+    XFER_DIR_GET,               /* SD card -> host */
+    XFER_DIR_PUT                /* Host -> SD card */
+} xfer_direction_t;
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+/* Frame header, little endian on the wire */
+typedef struct __attribute__((packed)) {
+    uint8_t  sync[2];           /* XFER_SYNC0, XFER_SYNC1 */
+    uint8_t  type;              /* xfer_frame_type_t */
+    uint8_t  flags;             /* Reserved, 0 */
+    uint16_t seq;               /* Frame counter, for diagnostics only */
+    uint16_t length;            /* Payload bytes (<= XFER_BLOCK_SIZE) */
+    uint32_t offset;            /* File offset the frame refers to */
+} xfer_frame_header_t;
+
+/* INFO payload */
+typedef struct __attribute__((packed)) {
+    uint32_t file_size;         /* Total file size in bytes */
+    uint32_t baud_rate;         /* Baud rate used after this frame */
+    uint16_t block_size;        /* Max DATA payload */
+    uint16_t window;            /* DATA frames sent ahead of the last ACK */
+} xfer_info_t;
+
+/* END payload */
+typedef struct __attribute__((packed)) {
+    uint32_t crc32;             /* CRC-32 of [start offset, file size) */
+    uint32_t elapsed_ms;        /* From first DATA frame to last ACK */
+    uint32_t bytes_sent;        /* GET: payload bytes put on the wire, resends included
+                                 * PUT: payload bytes received, duplicates included */
+    uint32_t resends;           /* GET: frames sent more than once
+                                 * PUT: frames dropped (bad CRC or out of order) */
+} xfer_end_t;
+
+/* Message to FileXferTask */
+typedef struct {
+    xfer_direction_t direction;
+    char filename[XFER_FILENAME_SIZE];
+    uint32_t offset;            /* GET: resume point (0 for a fresh download) */
+    uint32_t file_size;         /* PUT: bytes the host will send */
+    uint32_t baud_rate;         /* Requested link rate, 0 = XFER_DEFAULT_BAUD_RATE */
+} file_xfer_msg_t;
+
+/*******************************************************************************
+* Global Variables
+*******************************************************************************/
+extern QueueHandle_t file_xfer_queue;         /* AudioControl -> FileXfer */
+extern TaskHandle_t file_xfer_task_handle;
+
+/*******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+void file_xfer_task_create(void);
+void file_xfer_task(void *pvParameters);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FILE_XFER_TASK_H__ */
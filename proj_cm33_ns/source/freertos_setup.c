@@ -12,8 +12,10 @@
 #include "file_write_task.h"
 #include "file_read_task.h"
 #include "playback_task.h"
+#include "file_xfer_task.h"
 #include "app_pdm_pcm.h"
 #include "app_i2s.h"
+#include "codec_ctrl.h"
 #include "retarget_io_init.h"
 #include "sd_card_init.h"
 #include <stdio.h>
@@ -78,6 +80,13 @@ static int freertos_create_ipc_objects(void)
         return -1;
     }
     
+    /* Create file transfer queue (AudioControlTask -> FileXferTask) */
+    file_xfer_queue = xQueueCreate(FILE_XFER_QUEUE_LENGTH, sizeof(file_xfer_msg_t));
+    if (file_xfer_queue == NULL) {
+        printf("Error: Failed to create file transfer queue\r\n");
+        return -1;
+    }
+    
     printf("IPC objects created successfully\r\n");
     return 0;
 }
@@ -145,6 +154,14 @@ static int freertos_create_tasks(void)
     }
     printf("Playback Task created\r\n");
     
+    /* Create File Transfer Task (UART download of files to the host) */
+    file_xfer_task_create();
+    if (file_xfer_task_handle == NULL) {
+        printf("Error: File Transfer task creation failed\r\n");
+        return -1;
+    }
+    printf("File Transfer Task created\r\n");
+    
     return 0;
 }
 
@@ -177,6 +194,9 @@ void freertos_system_init(void)
     /* Step 2: Initialize hardware drivers (PDM, I2S, Codec) */
     printf("Initializing audio hardware...\r\n");
     app_tlv_codec_init();
+    if (codec_ctrl_init() != 0) {
+        printf("WARNING: Codec register readback failed\r\n");
+    }
     app_i2s_init();
     app_pdm_pcm_init();
     printf("Audio hardware initialized\r\n");
@@ -0,0 +1,91 @@
+/******************************************************************************
+* File Name: isr_timing.c
+*
+* Description: Execution time and entry jitter of the audio interrupts
+*              Counts kept by the PDM and I2S handlers, read and cleared
+*              by the 'isr' command.
+*
+*******************************************************************************/
+
+#include "isr_timing.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <string.h>
+
+/*******************************************************************************
+* Global Variables
+*******************************************************************************/
+isr_timing_t isr_timing[ISR_TIMING_COUNT];
+
+static const char *const isr_timing_names[ISR_TIMING_COUNT] = {
+    "PDM RX",
+    "I2S TX"
+};
+
+/*******************************************************************************
+* Function Name: isr_timing_start
+********************************************************************************
+* Summary:
+*  Enable the DWT cycle counter and check that it counts (the secure side or
+*  a debugger configuration can keep it stopped)
+*
+* Return:
+*  true if the counter is running
+*
+*******************************************************************************/
+bool isr_timing_start(void)
+{
+    uint32_t start;
+
+    DCB->DEMCR |= DCB_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    start = DWT->CYCCNT;
+    __asm volatile ("nop");
+    return (DWT->CYCCNT != start);
+}
+
+/*******************************************************************************
+* Function Name: isr_timing_reset
+********************************************************************************
+* Summary:
+*  Clear the counts of both handlers. The next entry of each starts a new
+*  interval, so a pause in the stream before the reset is not counted.
+*
+*******************************************************************************/
+void isr_timing_reset(void)
+{
+    taskENTER_CRITICAL();
+    memset(isr_timing, 0, sizeof(isr_timing));
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+* Function Name: isr_timing_get
+********************************************************************************
+* Summary:
+*  Consistent copy of one handler's counts
+*
+* Parameters:
+*  id: handler
+*  timing: filled with the counts
+*
+*******************************************************************************/
+void isr_timing_get(isr_timing_id_t id, isr_timing_t *timing)
+{
+    taskENTER_CRITICAL();
+    *timing = isr_timing[id];
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+* Function Name: isr_timing_name
+********************************************************************************
+* Summary:
+*  Name of a handler for reports
+*
+*******************************************************************************/
+const char *isr_timing_name(isr_timing_id_t id)
+{
+    return (id < ISR_TIMING_COUNT) ? isr_timing_names[id] : "?";
+}
@@ -0,0 +1,135 @@
+/******************************************************************************
+* File Name: isr_timing.h
+*
+* Description: Execution time and entry jitter of the audio interrupts
+*              The PDM and I2S handlers read the DWT cycle counter on entry
+*              and exit. Per handler the counts give the number of entries,
+*              the mean and longest time spent inside, and the shortest,
+*              mean and longest interval between entries; the spread of the
+*              interval is the jitter of the handler's start. The counter
+*              runs from isr_timing_start(); while it is stopped nothing is
+*              recorded.
+*
+*******************************************************************************/
+
+#ifndef __ISR_TIMING_H__
+#define __ISR_TIMING_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cy_pdl.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Enumerations
+*******************************************************************************/
+typedef enum {
+    ISR_TIMING_PDM,
+    ISR_TIMING_I2S,
+    ISR_TIMING_COUNT
+} isr_timing_id_t;
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+typedef struct {
+    uint32_t count;             /* Timed entries */
+    uint32_t max_cycles;        /* Longest entry to exit */
+    uint64_t total_cycles;
+    uint32_t last_entry;        /* CYCCNT at the previous entry */
+    uint32_t intervals;         /* Entry to entry intervals measured */
+    uint32_t min_interval;
+    uint32_t max_interval;
+    uint64_t total_interval;
+} isr_timing_t;
+
+/*******************************************************************************
+* Global Variables
+*******************************************************************************/
+/* Written by the handlers only; read and cleared with interrupts masked */
+extern isr_timing_t isr_timing[ISR_TIMING_COUNT];
+
+/*******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+bool isr_timing_start(void);
+void isr_timing_reset(void);
+void isr_timing_get(isr_timing_id_t id, isr_timing_t *timing);
+const char *isr_timing_name(isr_timing_id_t id);
+
+/*******************************************************************************
+* Function Name: isr_timing_enter
+********************************************************************************
+* Summary:
+*  Record the interval since the handler's previous entry. Called first thing
+*  in the handler; inline so it runs from wherever the handler runs.
+*
+* Parameters:
+*  timing: the handler's counts
+*
+* Return:
+*  The entry time, for isr_timing_exit()
+*
+*******************************************************************************/
+__STATIC_INLINE uint32_t isr_timing_enter(isr_timing_t *timing)
+{
+    uint32_t now = DWT->CYCCNT;
+
+    if (timing->count > 0u)
+    {
+        uint32_t interval = now - timing->last_entry;
+
+        if ((timing->intervals == 0u) || (interval < timing->min_interval))
+        {
+            timing->min_interval = interval;
+        }
+        if (interval > timing->max_interval)
+        {
+            timing->max_interval = interval;
+        }
+        timing->total_interval += interval;
+        timing->intervals++;
+    }
+    timing->last_entry = now;
+    return now;
+}
+
+/*******************************************************************************
+* Function Name: isr_timing_exit
+********************************************************************************
+* Summary:
+*  Record the time since isr_timing_enter(). A stopped counter reads the same
+*  on entry and exit; such entries are not counted.
+*
+* Parameters:
+*  timing: the handler's counts
+*  entry: value returned by isr_timing_enter()
+*
+* Return:
+*  None
+*
+*******************************************************************************/
+__STATIC_INLINE void isr_timing_exit(isr_timing_t *timing, uint32_t entry)
+{
+    uint32_t cycles = DWT->CYCCNT - entry;
+
+    if (cycles == 0u)
+    {
+        return;
+    }
+    if (cycles > timing->max_cycles)
+    {
+        timing->max_cycles = cycles;
+    }
+    timing->total_cycles += cycles;
+    timing->count++;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ISR_TIMING_H__ */
@@ -0,0 +1,282 @@
+/******************************************************************************
+* File Name: latency.c
+*
+* Description: Round-trip latency measurement through the speaker and mic
+*              Each trial captures while a -atten_db maximum length sequence
+*              (MLS) follows LATENCY_PREROLL_MS of silence on the speaker.
+*              When the TX ISR renders the first MLS frame it notes the TX
+*              FIFO level and the PDM frames produced so far (stored plus
+*              still in the RX FIFO), so the capture index of that moment is
+*              known to the frame. The delay is the lag of the correlation
+*              peak from there: TX FIFO queue, DAC filters, amplifier, air,
+*              mic and PDM decimation filters. The capture sits a further
+*              0..RX_FIFO_TRIG_LEVEL frames in the RX FIFO before the ISR
+*              stores it. The correlation is in mls.c.
+*
+*******************************************************************************/
+
+#include "latency.h"
+#include "mls.h"
+#include "app_pdm_pcm.h"
+#include "app_i2s.h"
+#include "capture_pool.h"
+#include "tdm_slots.h"
+#include "audio_ramfunc.h"
+#include "cy_pdl.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define LATENCY_PREROLL_FRAMES      ((LATENCY_PREROLL_MS * SAMPLE_RATE_HZ) / 1000u)
+#define LATENCY_MAX_LAG_FRAMES      ((LATENCY_MAX_DELAY_MS * SAMPLE_RATE_HZ) / 1000u)
+#define LATENCY_WINDOW_FRAMES       (LATENCY_MAX_LAG_FRAMES + MLS_FRAMES)
+/* Preroll, start-up and the window, rounded to whole RX FIFO triggers */
+#define LATENCY_CAPTURE_FRAMES      (6400u)     /* 400 ms */
+#define LATENCY_CAPTURE_SAMPLES     (NUM_CHANNELS * LATENCY_CAPTURE_FRAMES)
+#define LATENCY_POLL_MS             (10u)
+#define LATENCY_TIMEOUT_MS          (1000u)
+#define LATENCY_GAP_MS              (100u)      /* Between trials, for the room to go quiet */
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+/* Shared with the TX ISR while a trial runs */
+typedef struct {
+    uint32_t position;              /* Frames rendered */
+    const uint8_t *mls;             /* MLS_FRAMES values, 0 or 1 */
+    int16_t amplitude;
+    volatile bool marked;           /* First MLS frame rendered */
+    volatile uint32_t rx_frames;    /* PDM frames produced at that moment */
+    volatile uint32_t tx_frames;    /* Frames in the TX FIFO ahead of it */
+} latency_stimulus_t;
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static int16_t latency_window[LATENCY_WINDOW_FRAMES];   /* Mono capture from the marker */
+static int32_t latency_corr[LATENCY_MAX_LAG_FRAMES];
+
+static latency_stimulus_t latency_stimulus;
+static app_i2s_stream_t latency_stream;
+static app_pdm_pcm_stream_t latency_capture;
+
+/*******************************************************************************
+* Function Name: latency_render
+********************************************************************************
+* Summary:
+*  I2S render source: preroll silence, the MLS, then silence until the trial
+*  stops the transmitter. Notes the TX and RX positions at the first MLS
+*  frame.
+*
+*******************************************************************************/
+AUDIO_RAMFUNC_BEGIN
+static uint32_t latency_render(void *context, int16_t *samples, uint32_t frames)
+{
+    latency_stimulus_t *stimulus = (latency_stimulus_t *)context;
+
+    for (uint32_t i = 0; i < frames; i++) {
+        uint32_t position = stimulus->position + i;
+        int16_t value = 0;
+
+        if ((position >= LATENCY_PREROLL_FRAMES) &&
+            (position < LATENCY_PREROLL_FRAMES + MLS_FRAMES)) {
+            value = (stimulus->mls[position - LATENCY_PREROLL_FRAMES] != 0u) ?
+                    stimulus->amplitude : (int16_t)-stimulus->amplitude;
+        }
+        if (position == LATENCY_PREROLL_FRAMES) {
+            /* The RX ISR has the same priority, so the count cannot move
+             * between the two reads */
+            stimulus->rx_frames = (app_pdm_pcm_samples(&latency_capture) / NUM_CHANNELS) +
+                                  Cy_PDM_PCM_Channel_GetNumInFifo(PDM0, RIGHT_CH_INDEX);
+            stimulus->tx_frames = (Cy_AudioTDM_GetNumInTxFifo(TDM_STRUCT0_TX) / tdm_slots_count()) + i;
+            stimulus->marked = true;
+        }
+        samples[2u * i] = value;
+        samples[2u * i + 1u] = value;
+    }
+    stimulus->position += frames;
+
+    return frames;
+}
+AUDIO_RAMFUNC_END
+
+/*******************************************************************************
+* Function Name: latency_trial
+********************************************************************************
+* Summary:
+*  Play the sequence once while capturing and correlate the capture
+*
+* Parameters:
+*  samples: Capture memory, LATENCY_CAPTURE_SAMPLES at least
+*  amplitude: MLS level, in sample units
+*  peak: Output - delay from the TX FIFO write
+*  tx_frames: Output - part of it spent in the TX FIFO
+*
+* Return:
+*  0 on success, -1 if the capture or stimulus did not complete
+*
+*******************************************************************************/
+static int latency_trial(int16_t *samples, int16_t amplitude, mls_peak_t *peak, uint32_t *tx_frames)
+{
+    uint32_t waited = 0;
+    uint32_t start;
+
+    memset(&latency_stimulus, 0, sizeof(latency_stimulus));
+    latency_stimulus.mls = mls_sequence();
+    latency_stimulus.amplitude = amplitude;
+    memset(&latency_stream, 0, sizeof(latency_stream));
+
+    /* Capture first, so the marker's RX position is in the buffer */
+    app_pdm_pcm_activate(&latency_capture, samples, LATENCY_CAPTURE_SAMPLES);
+    app_i2s_set_stream(&latency_stream);
+    app_i2s_enable();
+    (void)app_i2s_stream_render(&latency_stream, latency_render, &latency_stimulus);
+    app_i2s_activate();
+
+    while ((app_pdm_pcm_samples(&latency_capture) < LATENCY_CAPTURE_SAMPLES) &&
+           (waited < LATENCY_TIMEOUT_MS)) {
+        vTaskDelay(pdMS_TO_TICKS(LATENCY_POLL_MS));
+        waited += LATENCY_POLL_MS;
+    }
+
+    app_i2s_deactivate();
+    app_i2s_disable();
+    app_i2s_set_stream(NULL);
+    app_pdm_pcm_deactivate();
+
+    if (!latency_stimulus.marked) {
+        printf("Error: Sequence was not played\r\n");
+        return -1;
+    }
+    start = latency_stimulus.rx_frames;
+    if ((start + LATENCY_WINDOW_FRAMES) * NUM_CHANNELS > app_pdm_pcm_samples(&latency_capture)) {
+        printf("Error: Capture stopped after %u of %u frames\r\n",
+               (unsigned int)(app_pdm_pcm_samples(&latency_capture) / NUM_CHANNELS),
+               (unsigned int)(start + LATENCY_WINDOW_FRAMES));
+        return -1;
+    }
+
+    /* Both mics, mono */
+    for (uint32_t n = 0; n < LATENCY_WINDOW_FRAMES; n++) {
+        const int16_t *frame = &samples[(start + n) * NUM_CHANNELS];
+        latency_window[n] = (int16_t)(((int32_t)frame[0] + frame[1]) / 2);
+    }
+
+    mls_correlate(latency_window, LATENCY_MAX_LAG_FRAMES, latency_corr, peak);
+    *tx_frames = latency_stimulus.tx_frames;
+
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: latency_run
+********************************************************************************
+* Summary:
+*  Measure the round trip several times and print each trial, the mean,
+*  the jitter and the split at the TX FIFO. Trials whose correlation peak
+*  is under LATENCY_MIN_PEAK_DB are listed but not counted. Call with both
+*  audio paths idle.
+*
+* Parameters:
+*  trials: 1..LATENCY_MAX_TRIALS, 0 for LATENCY_DEFAULT_TRIALS
+*  atten_db: Sequence level below full scale
+*
+* Return:
+*  0 if at least one trial counted, -1 otherwise
+*
+*******************************************************************************/
+int latency_run(uint32_t trials, uint32_t atten_db)
+{
+    capture_buffer_t *buffer;
+    mls_peak_t peak;
+    uint32_t tx_frames;
+    int16_t amplitude;
+    uint32_t valid = 0;
+    double sum = 0.0;
+    double sum_sq = 0.0;
+    double tx_sum = 0.0;
+    double mean;
+    double jitter;
+    double tx_mean;
+    float min_lag = 0.0f;
+    float max_lag = 0.0f;
+    const float ms_per_frame = 1000.0f / (float)SAMPLE_RATE_HZ;
+
+    if (trials == 0u) {
+        trials = LATENCY_DEFAULT_TRIALS;
+    }
+    if ((trials > LATENCY_MAX_TRIALS) || (atten_db > LATENCY_MAX_ATTEN_DB)) {
+        printf("Error: Up to %u trials, level down to -%u dBFS\r\n", (unsigned int)LATENCY_MAX_TRIALS,
+               (unsigned int)LATENCY_MAX_ATTEN_DB);
+        return -1;
+    }
+
+    buffer = capture_pool_acquire();
+    if ((buffer == NULL) || (buffer->capacity < LATENCY_CAPTURE_SAMPLES)) {
+        printf("Error: Capture pool busy, wait for takes to be saved\r\n");
+        capture_pool_release(buffer);
+        return -1;
+    }
+
+    amplitude = (int16_t)lroundf(32767.0f * powf(10.0f, -(float)atten_db / 20.0f));
+
+    printf("Latency: %u trials, %u-frame MLS at -%u dBFS, searching up to %u ms\r\n",
+           (unsigned int)trials, (unsigned int)MLS_FRAMES, (unsigned int)atten_db,
+           (unsigned int)LATENCY_MAX_DELAY_MS);
+    printf("  trial  total_ms  tx_fifo_ms  path_ms  peak_db\r\n");
+
+    for (uint32_t t = 0; t < trials; t++) {
+        if (t > 0u) {
+            vTaskDelay(pdMS_TO_TICKS(LATENCY_GAP_MS));
+        }
+        if (latency_trial(buffer->samples, amplitude, &peak, &tx_frames) != 0) {
+            break;
+        }
+
+        printf("  %5u  %8.3f  %10.3f  %7.3f  %7.1f%s\r\n", (unsigned int)(t + 1u),
+               peak.lag * ms_per_frame, (float)tx_frames * ms_per_frame,
+               (peak.lag - (float)tx_frames) * ms_per_frame, peak.peak_db,
+               (peak.peak_db < LATENCY_MIN_PEAK_DB) ? "  (too weak, dropped)" :
+               (peak.inverted ? "  (inverted)" : ""));
+        if (peak.peak_db < LATENCY_MIN_PEAK_DB) {
+            continue;
+        }
+
+        if ((valid == 0u) || (peak.lag < min_lag)) {
+            min_lag = peak.lag;
+        }
+        if ((valid == 0u) || (peak.lag > max_lag)) {
+            max_lag = peak.lag;
+        }
+        sum += peak.lag;
+        sum_sq += (double)peak.lag * peak.lag;
+        tx_sum += tx_frames;
+        valid++;
+    }
+
+    capture_pool_release(buffer);
+
+    if (valid == 0u) {
+        printf("Error: No trial found the sequence; check the speaker, mic gain and level\r\n");
+        return -1;
+    }
+
+    mean = sum / valid;
+    jitter = sqrt(fmax((sum_sq / valid) - (mean * mean), 0.0));
+    tx_mean = tx_sum / valid;
+
+    printf("Mean %.3f ms (%.2f frames), jitter %.3f ms RMS, range %.3f..%.3f ms, %u of %u trials\r\n",
+           mean * ms_per_frame, mean, jitter * ms_per_frame, min_lag * ms_per_frame,
+           max_lag * ms_per_frame, (unsigned int)valid, (unsigned int)trials);
+    printf("  TX FIFO %.3f ms, DAC + air + mic + PDM filters %.3f ms, then up to %.3f ms in the RX FIFO\r\n",
+           tx_mean * ms_per_frame, (mean - tx_mean) * ms_per_frame,
+           RX_FIFO_TRIG_LEVEL * ms_per_frame);
+
+    return 0;
+}
@@ -0,0 +1,42 @@
+/******************************************************************************
+* File Name: latency.h
+*
+* Description: Round-trip latency measurement through the speaker and mic
+*              Plays a maximum length sequence through the TDM transmitter
+*              while the PDM channels capture, finds the delay by
+*              cross-correlation and reports it split at the TX FIFO and
+*              PDM RX boundaries, with the mean and jitter over several
+*              trials.
+*
+*******************************************************************************/
+
+#ifndef __LATENCY_H__
+#define __LATENCY_H__
+
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define LATENCY_PREROLL_MS          (100u)      /* Silence before the sequence, for the filters to settle */
+#define LATENCY_MAX_DELAY_MS        (200u)      /* Longest delay searched */
+#define LATENCY_DEFAULT_TRIALS      (5u)
+#define LATENCY_MAX_TRIALS          (20u)
+#define LATENCY_DEFAULT_ATTEN_DB    (20u)       /* -20 dBFS sequence */
+#define LATENCY_MAX_ATTEN_DB        (60u)
+#define LATENCY_MIN_PEAK_DB         (15.0f)     /* Correlation peak over the rest; weaker trials are dropped */
+
+/*******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+int latency_run(uint32_t trials, uint32_t atten_db);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LATENCY_H__ */
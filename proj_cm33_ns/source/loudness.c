@@ -0,0 +1,368 @@
+/******************************************************************************
+* File Name: loudness.c
+*
+* Description: Integrated loudness (ITU-R BS.1770 / EBU R128) of PCM, and a
+*              cache of the results per file
+*              The K-weighting filters are designed for the actual sample
+*              rate from their analog prototypes (the BS.1770 coefficients
+*              are given for 48 kHz only) and run in single precision, which
+*              the FPU does in hardware. The gated mean is taken over bin
+*              centres, within 0.05 LU of the exact result.
+*
+*******************************************************************************/
+
+#include "loudness.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <math.h>
+#include <string.h>
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define LOUDNESS_OFFSET             (-0.691f)   /* BS.1770: LUFS = -0.691 + 10 log10(sum of mean squares) */
+#define LOUDNESS_RELATIVE_GATE      (-10.0f)
+#define LOUDNESS_PCM_SCALE          (1.0f / 32768.0f)
+
+/* K-weighting prototypes: high shelf (head effects), then the RLB high-pass */
+#define LOUDNESS_SHELF_HZ           (1681.974450955533)
+#define LOUDNESS_SHELF_GAIN_DB      (3.999843853973347)
+#define LOUDNESS_SHELF_Q            (0.7071752369554196)
+#define LOUDNESS_SHELF_VB_EXP       (0.4996667741545416)
+#define LOUDNESS_RLB_HZ             (38.13547087602444)
+#define LOUDNESS_RLB_Q              (0.5003270373238773)
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+typedef struct {
+    char name[LOUDNESS_NAME_LENGTH];   /* Empty while free */
+    uint32_t file_size;
+    uint32_t file_time;
+    float loudness;
+    uint32_t last_used;
+} loudness_entry_t;
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static loudness_entry_t loudness_cache[LOUDNESS_CACHE_ENTRIES];
+static uint32_t loudness_sequence;
+
+/*******************************************************************************
+* Function Name: loudness_init
+********************************************************************************
+* Summary:
+*  Design the K-weighting filters and clear the meter
+*
+* Parameters:
+*  meter: Meter
+*  sample_rate: Of the PCM that will be measured
+*  num_channels: Interleaved channels, at most LOUDNESS_MAX_CHANNELS, all
+*                weighted 1.0 (left, right or mono)
+*
+* Return:
+*  0 on success, -1 if a parameter is out of range
+*
+*******************************************************************************/
+int loudness_init(loudness_meter_t *meter, uint32_t sample_rate, uint16_t num_channels)
+{
+    double k;
+    double vh;
+    double vb;
+    double a0;
+
+    if ((num_channels == 0u) || (num_channels > LOUDNESS_MAX_CHANNELS) ||
+        (sample_rate < (uint32_t)(4.0 * LOUDNESS_SHELF_HZ))) {
+        return -1;
+    }
+    memset(meter, 0, sizeof(*meter));
+
+    k = tan(M_PI * LOUDNESS_SHELF_HZ / (double)sample_rate);
+    vh = pow(10.0, LOUDNESS_SHELF_GAIN_DB / 20.0);
+    vb = pow(vh, LOUDNESS_SHELF_VB_EXP);
+    a0 = 1.0 + k / LOUDNESS_SHELF_Q + k * k;
+    meter->b[0][0] = (float)((vh + vb * k / LOUDNESS_SHELF_Q + k * k) / a0);
+    meter->b[0][1] = (float)(2.0 * (k * k - vh) / a0);
+    meter->b[0][2] = (float)((vh - vb * k / LOUDNESS_SHELF_Q + k * k) / a0);
+    meter->a[0][0] = (float)(2.0 * (k * k - 1.0) / a0);
+    meter->a[0][1] = (float)((1.0 - k / LOUDNESS_SHELF_Q + k * k) / a0);
+
+    k = tan(M_PI * LOUDNESS_RLB_HZ / (double)sample_rate);
+    a0 = 1.0 + k / LOUDNESS_RLB_Q + k * k;
+    meter->b[1][0] = 1.0f;
+    meter->b[1][1] = -2.0f;
+    meter->b[1][2] = 1.0f;
+    meter->a[1][0] = (float)(2.0 * (k * k - 1.0) / a0);
+    meter->a[1][1] = (float)((1.0 - k / LOUDNESS_RLB_Q + k * k) / a0);
+
+    meter->num_channels = num_channels;
+    meter->step_frames = sample_rate / 10u;
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: loudness_count_block
+********************************************************************************
+* Summary:
+*  Close a 100 ms step; once four are in, count the 400 ms block they make up
+*
+*******************************************************************************/
+static void loudness_count_block(loudness_meter_t *meter)
+{
+    float mean = meter->step_sum / (float)meter->step_frames;
+    float block = 0.0f;
+    float lufs;
+    int32_t bin;
+
+    meter->total_sum += (double)meter->step_sum;
+    meter->steps[meter->step_count % LOUDNESS_STEPS_PER_BLOCK] = mean;
+    meter->step_count++;
+    meter->step_sum = 0.0f;
+    meter->step_fill = 0;
+    if (meter->step_count < LOUDNESS_STEPS_PER_BLOCK) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < LOUDNESS_STEPS_PER_BLOCK; i++) {
+        block += meter->steps[i];
+    }
+    block /= (float)LOUDNESS_STEPS_PER_BLOCK;
+    if (block <= 0.0f) {
+        return;
+    }
+    lufs = LOUDNESS_OFFSET + 10.0f * log10f(block);
+    if (lufs < (float)LOUDNESS_HIST_MIN_LUFS) {
+        return;             /* Below the absolute gate */
+    }
+    bin = (int32_t)((lufs - (float)LOUDNESS_HIST_MIN_LUFS) * (float)LOUDNESS_HIST_BINS_PER_LU);
+    if (bin >= (int32_t)LOUDNESS_HIST_BINS) {
+        bin = (int32_t)LOUDNESS_HIST_BINS - 1;
+    }
+    if (meter->histogram[bin] != UINT16_MAX) {
+        meter->histogram[bin]++;
+    }
+}
+
+/*******************************************************************************
+* Function Name: loudness_add
+********************************************************************************
+* Summary:
+*  Measure more interleaved PCM; blocks continue across calls
+*
+*******************************************************************************/
+void loudness_add(loudness_meter_t *meter, const int16_t *pcm, uint32_t frames)
+{
+    const uint16_t channels = meter->num_channels;
+
+    for (uint32_t i = 0; i < frames; i++) {
+        float energy = 0.0f;
+
+        for (uint16_t ch = 0; ch < channels; ch++) {
+            float x = (float)pcm[ch] * LOUDNESS_PCM_SCALE;
+
+            for (uint32_t s = 0; s < 2u; s++) {
+                float *z = meter->z[ch][s];
+                float y = meter->b[s][0] * x + z[0];
+
+                z[0] = meter->b[s][1] * x - meter->a[s][0] * y + z[1];
+                z[1] = meter->b[s][2] * x - meter->a[s][1] * y;
+                x = y;
+            }
+            energy += x * x;
+        }
+        pcm += channels;
+        meter->step_sum += energy;
+        meter->total_frames++;
+        if (++meter->step_fill == meter->step_frames) {
+            loudness_count_block(meter);
+        }
+    }
+}
+
+/*******************************************************************************
+* Function Name: loudness_integrated
+********************************************************************************
+* Summary:
+*  Gated integrated loudness of everything measured so far
+*  - Input shorter than one block is measured ungated, as one block
+*
+* Return:
+*  LUFS, or LOUDNESS_UNKNOWN for silence or no input
+*
+*******************************************************************************/
+float loudness_integrated(const loudness_meter_t *meter)
+{
+    double sum = 0.0;
+    uint32_t count = 0;
+    float gate;
+
+    if (meter->step_count < LOUDNESS_STEPS_PER_BLOCK) {
+        double total = meter->total_sum + (double)meter->step_sum;
+
+        if ((meter->total_frames == 0u) || (total <= 0.0)) {
+            return LOUDNESS_UNKNOWN;
+        }
+        return LOUDNESS_OFFSET + 10.0f * log10f((float)(total / (double)meter->total_frames));
+    }
+
+    /* Absolute gate: the histogram only holds blocks above it */
+    for (uint32_t bin = 0; bin < LOUDNESS_HIST_BINS; bin++) {
+        if (meter->histogram[bin] != 0u) {
+            float centre = (float)LOUDNESS_HIST_MIN_LUFS +
+                           ((float)bin + 0.5f) / (float)LOUDNESS_HIST_BINS_PER_LU;
+
+            sum += (double)meter->histogram[bin] * (double)powf(10.0f, (centre - LOUDNESS_OFFSET) / 10.0f);
+            count += meter->histogram[bin];
+        }
+    }
+    if (count == 0u) {
+        return LOUDNESS_UNKNOWN;
+    }
+
+    /* Relative gate, 10 LU under the loudness of the blocks above the absolute one */
+    gate = LOUDNESS_OFFSET + 10.0f * log10f((float)(sum / (double)count)) + LOUDNESS_RELATIVE_GATE;
+    sum = 0.0;
+    count = 0;
+    for (uint32_t bin = 0; bin < LOUDNESS_HIST_BINS; bin++) {
+        float centre = (float)LOUDNESS_HIST_MIN_LUFS +
+                       ((float)bin + 0.5f) / (float)LOUDNESS_HIST_BINS_PER_LU;
+
+        if ((meter->histogram[bin] != 0u) && (centre > gate)) {
+            sum += (double)meter->histogram[bin] * (double)powf(10.0f, (centre - LOUDNESS_OFFSET) / 10.0f);
+            count += meter->histogram[bin];
+        }
+    }
+    if (count == 0u) {
+        return LOUDNESS_UNKNOWN;
+    }
+    return LOUDNESS_OFFSET + 10.0f * log10f((float)(sum / (double)count));
+}
+
+/*******************************************************************************
+* Function Name: loudness_cache_find
+********************************************************************************
+* Summary:
+*  Entry of a file name; call inside a critical section
+*
+*******************************************************************************/
+static loudness_entry_t *loudness_cache_find(const char *name)
+{
+    for (uint32_t i = 0; i < LOUDNESS_CACHE_ENTRIES; i++) {
+        if ((loudness_cache[i].name[0] != '\0') &&
+            (strncmp(loudness_cache[i].name, name, LOUDNESS_NAME_LENGTH) == 0)) {
+            return &loudness_cache[i];
+        }
+    }
+    return NULL;
+}
+
+/*******************************************************************************
+* Function Name: loudness_cache_get
+********************************************************************************
+* Summary:
+*  Look up the loudness of a file measured earlier; an entry for an older
+*  version of the file (other size or time) is dropped
+*
+* Return:
+*  true if found
+*
+*******************************************************************************/
+bool loudness_cache_get(const char *name, uint32_t file_size, uint32_t file_time, float *loudness)
+{
+    loudness_entry_t *entry;
+    bool found = false;
+
+    taskENTER_CRITICAL();
+    entry = loudness_cache_find(name);
+    if (entry != NULL) {
+        if ((entry->file_size == file_size) && (entry->file_time == file_time)) {
+            *loudness = entry->loudness;
+            entry->last_used = ++loudness_sequence;
+            found = true;
+        } else {
+            entry->name[0] = '\0';
+        }
+    }
+    taskEXIT_CRITICAL();
+    return found;
+}
+
+/*******************************************************************************
+* Function Name: loudness_cache_put
+********************************************************************************
+* Summary:
+*  Remember the loudness of a file, replacing the least recently used entry
+*  when the cache is full
+*
+*******************************************************************************/
+void loudness_cache_put(const char *name, uint32_t file_size, uint32_t file_time, float loudness)
+{
+    loudness_entry_t *entry;
+
+    if (strlen(name) >= LOUDNESS_NAME_LENGTH) {
+        return;
+    }
+
+    taskENTER_CRITICAL();
+    entry = loudness_cache_find(name);
+    for (uint32_t i = 0; (entry == NULL) && (i < LOUDNESS_CACHE_ENTRIES); i++) {
+        if (loudness_cache[i].name[0] == '\0') {
+            entry = &loudness_cache[i];
+        }
+    }
+    if (entry == NULL) {
+        entry = &loudness_cache[0];
+        for (uint32_t i = 1; i < LOUDNESS_CACHE_ENTRIES; i++) {
+            if (loudness_cache[i].last_used < entry->last_used) {
+                entry = &loudness_cache[i];
+            }
+        }
+    }
+    strcpy(entry->name, name);
+    entry->file_size = file_size;
+    entry->file_time = file_time;
+    entry->loudness = loudness;
+    entry->last_used = ++loudness_sequence;
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+* Function Name: loudness_cache_invalidate
+********************************************************************************
+* Summary:
+*  Forget a file that was deleted or rewritten
+*
+*******************************************************************************/
+void loudness_cache_invalidate(const char *name)
+{
+    loudness_entry_t *entry;
+
+    taskENTER_CRITICAL();
+    entry = loudness_cache_find(name);
+    if (entry != NULL) {
+        entry->name[0] = '\0';
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+* Function Name: loudness_cache_count
+********************************************************************************
+* Summary:
+*  Files whose loudness is cached
+*
+*******************************************************************************/
+uint32_t loudness_cache_count(void)
+{
+    uint32_t count = 0;
+
+    taskENTER_CRITICAL();
+    for (uint32_t i = 0; i < LOUDNESS_CACHE_ENTRIES; i++) {
+        if (loudness_cache[i].name[0] != '\0') {
+            count++;
+        }
+    }
+    taskEXIT_CRITICAL();
+    return count;
+}
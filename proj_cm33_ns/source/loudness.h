@@ -0,0 +1,75 @@
+/******************************************************************************
+* File Name: loudness.h
+*
+* Description: Integrated loudness (ITU-R BS.1770 / EBU R128) of PCM, and a
+*              cache of the results per file
+*              The meter K-weights each channel, takes 400 ms blocks every
+*              100 ms and counts them in a histogram of 0.1 LU bins, so a
+*              file of any length is measured in fixed memory; the absolute
+*              (-70 LUFS) and relative (-10 LU) gates are applied when the
+*              result is read. The cache keeps the loudness of recently
+*              measured files, keyed like the clip cache by name, size and
+*              modification time, so a file is measured once and not on
+*              every play.
+*
+*******************************************************************************/
+
+#ifndef __LOUDNESS_H__
+#define __LOUDNESS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define LOUDNESS_UNKNOWN            (-1000.0f)  /* Not measured, or nothing above the absolute gate */
+#define LOUDNESS_MAX_CHANNELS       (2u)
+#define LOUDNESS_STEPS_PER_BLOCK    (4u)        /* 400 ms blocks, 75 % overlap */
+#define LOUDNESS_HIST_MIN_LUFS      (-70)       /* Absolute gate */
+#define LOUDNESS_HIST_MAX_LUFS      (10)
+#define LOUDNESS_HIST_BINS_PER_LU   (10u)
+#define LOUDNESS_HIST_BINS          ((uint32_t)(LOUDNESS_HIST_MAX_LUFS - LOUDNESS_HIST_MIN_LUFS) * \
+                                     LOUDNESS_HIST_BINS_PER_LU)
+#define LOUDNESS_CACHE_ENTRIES      (32u)
+#define LOUDNESS_NAME_LENGTH        (32u)
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+typedef struct {
+    float b[2][3];              /* Shelf, then RLB high-pass; a0 is 1 */
+    float a[2][2];
+    float z[LOUDNESS_MAX_CHANNELS][2][2];   /* Transposed direct form II state */
+    uint16_t num_channels;
+    uint32_t step_frames;       /* 100 ms */
+    uint32_t step_fill;         /* Frames in the current step */
+    float step_sum;             /* Sum of squares in the current step */
+    float steps[LOUDNESS_STEPS_PER_BLOCK];  /* Mean squares of the last steps */
+    uint32_t step_count;
+    double total_sum;           /* Whole input, for a file shorter than a block */
+    uint32_t total_frames;
+    uint16_t histogram[LOUDNESS_HIST_BINS]; /* Blocks per bin, saturating */
+} loudness_meter_t;
+
+/*******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+int loudness_init(loudness_meter_t *meter, uint32_t sample_rate, uint16_t num_channels);
+void loudness_add(loudness_meter_t *meter, const int16_t *pcm, uint32_t frames);
+float loudness_integrated(const loudness_meter_t *meter);
+
+bool loudness_cache_get(const char *name, uint32_t file_size, uint32_t file_time, float *loudness);
+void loudness_cache_put(const char *name, uint32_t file_size, uint32_t file_time, float loudness);
+void loudness_cache_invalidate(const char *name);
+uint32_t loudness_cache_count(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LOUDNESS_H__ */
@@ -0,0 +1,536 @@
+/******************************************************************************
+* File Name: membench.c
+*
+* Description: Memory bandwidth and latency of SRAM, SOCMEM and XIP flash
+*              - CM33 tests run in the calling task with interrupts masked
+*                per timed run; CM55 tests are sent through the mailbox and
+*                the task sleeps until the reply, so polling does not load
+*                SOCMEM
+*              - SOCMEM is a buffer from the capture pool, cut into slices:
+*                CM33 tests, CM55 tests and the traffic of the other core
+*              - Bandwidth is in MB/s (10^6 bytes; a copy counts the bytes
+*                copied), latency and strided loads in ns per access, both
+*                with two decimals
+*
+*******************************************************************************/
+
+#include "membench.h"
+#include "membench_kernels.h"
+#include "capture_pool.h"
+#include "isr_timing.h"
+#include "cybsp.h"
+#include "cy_pdl.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "FS.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define MEMBENCH_SHARED_START       ((uintptr_t)CYMEM_CM33_0_m33_m55_shared_START)
+#define MEMBENCH_MAILBOX            ((membench_mailbox_t *)(MEMBENCH_SHARED_START + \
+                                     CYMEM_CM33_0_m33_m55_shared_SIZE - MEMBENCH_MAILBOX_BYTES))
+#define MEMBENCH_WINDOW             (0u)        /* Case bytes: the region's whole buffer */
+#define MEMBENCH_OUT_LENGTH         (128u)
+#define MEMBENCH_NOT_RUN            (UINT32_MAX)
+
+/* Slices of the SOCMEM buffer */
+#define MEMBENCH_SLICE_CM33         (0u)
+#define MEMBENCH_SLICE_CM55         (1u)
+#define MEMBENCH_SLICE_TRAFFIC      (2u)
+#define MEMBENCH_SLICES             (3u)
+
+/* Result table indices */
+#define MEMBENCH_CORE_CM33          (0u)
+#define MEMBENCH_CORE_CM55          (1u)
+#define MEMBENCH_CORES              (2u)
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+typedef struct {
+    membench_test_t test;
+    uint32_t bytes;             /* Or MEMBENCH_WINDOW */
+    uint32_t param;
+} membench_case_t;
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static const membench_case_t membench_cases[] = {
+    { MEMBENCH_TEST_READ,    MEMBENCH_BANDWIDTH_BYTES, 0 },
+    { MEMBENCH_TEST_WRITE,   MEMBENCH_BANDWIDTH_BYTES, 0 },
+    { MEMBENCH_TEST_COPY,    MEMBENCH_BANDWIDTH_BYTES, 0 },
+    { MEMBENCH_TEST_STRIDE,  MEMBENCH_WINDOW,          32u },   /* A new line every load */
+    { MEMBENCH_TEST_STRIDE,  MEMBENCH_WINDOW,          128u },
+    { MEMBENCH_TEST_LATENCY, 1024u,                    0 },     /* Fits every cache */
+    { MEMBENCH_TEST_LATENCY, 4096u,                    0 },
+    { MEMBENCH_TEST_LATENCY, 16384u,                   0 },
+    { MEMBENCH_TEST_LATENCY, 65536u,                   0 },     /* Larger than the caches */
+};
+#define MEMBENCH_NUM_CASES          (sizeof(membench_cases) / sizeof(membench_cases[0]))
+
+/* Summary columns: indices into membench_cases */
+static const uint8_t membench_summary_cases[] = { 0, 1, 2, 4, 5, 7, 8 };
+#define MEMBENCH_SUMMARY_COLUMNS    (sizeof(membench_summary_cases) / sizeof(membench_summary_cases[0]))
+
+static const char *const membench_test_names[MEMBENCH_TEST_COUNT] = {
+    "read", "write", "copy", "stride", "latency"
+};
+
+/* Value of each test, hundredths of MB/s or ns; [core][dcache off][load] */
+static uint32_t membench_results[MEMBENCH_CORES][2][2][MEMBENCH_REGION_COUNT][MEMBENCH_NUM_CASES];
+static uint32_t membench_local[MEMBENCH_LOCAL_BYTES / sizeof(uint32_t)] CY_ALIGN(MEMBENCH_LINE_BYTES);
+static uint8_t *membench_socmem;        /* MEMBENCH_SLICES slices, line aligned */
+static FS_FILE *membench_file;
+static uint32_t membench_rows;
+static uint32_t membench_cm55_hz;
+static uint32_t membench_sequence;
+
+/*******************************************************************************
+* Function Name: membench_out
+********************************************************************************
+* Summary:
+*  Print one line, and write it to the results file when saving
+*
+*******************************************************************************/
+static void membench_out(const char *format, ...)
+{
+    char line[MEMBENCH_OUT_LENGTH];
+    va_list args;
+    int length;
+
+    va_start(args, format);
+    length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (length < 0) {
+        return;
+    }
+    if ((uint32_t)length >= sizeof(line)) {
+        length = (int)sizeof(line) - 1;
+    }
+
+    printf("%s\r\n", line);
+    if (membench_file != NULL) {
+        (void)FS_Write(membench_file, line, (uint32_t)length);
+        (void)FS_Write(membench_file, "\r\n", 2u);
+    }
+}
+
+/*******************************************************************************
+* Function Name: membench_format
+********************************************************************************
+* Summary:
+*  Hundredths as "12.34", or "-" for a test that was not run
+*
+*******************************************************************************/
+static const char *membench_format(uint32_t centi, char *text, size_t size)
+{
+    if (centi == MEMBENCH_NOT_RUN) {
+        return "-";
+    }
+    (void)snprintf(text, size, "%u.%02u", (unsigned int)(centi / 100u), (unsigned int)(centi % 100u));
+    return text;
+}
+
+/*******************************************************************************
+* Function Name: membench_region_name
+********************************************************************************
+* Summary:
+*  Name of a region as seen by one core
+*
+*******************************************************************************/
+static const char *membench_region_name(uint32_t core, membench_region_t region)
+{
+    switch (region) {
+        case MEMBENCH_REGION_LOCAL:
+            return (core == MEMBENCH_CORE_CM33) ? "sram" : "dtcm";
+        case MEMBENCH_REGION_SOCMEM:
+            return "socmem";
+        default:
+            return "xip";
+    }
+}
+
+/*******************************************************************************
+* Function Name: membench_value
+********************************************************************************
+* Summary:
+*  Convert the cycles of one run to hundredths of MB/s or of ns per access
+*
+*******************************************************************************/
+static uint32_t membench_value(const membench_case_t *bench, uint32_t bytes, uint32_t cycles,
+                               uint32_t clock_hz)
+{
+    uint32_t accesses = membench_accesses(bench->test, bytes, bench->param);
+    uint64_t value;
+
+    if ((cycles == 0u) || (clock_hz == 0u)) {
+        return 0;
+    }
+    if (accesses == 0u) {
+        uint32_t moved = (bench->test == MEMBENCH_TEST_COPY) ? (bytes / 2u) : bytes;
+
+        value = ((uint64_t)moved * clock_hz) / ((uint64_t)cycles * 10000u);
+    } else {
+        value = ((uint64_t)cycles * 100000000000ull) / ((uint64_t)clock_hz * accesses);
+    }
+    return (value > (MEMBENCH_NOT_RUN - 1u)) ? (MEMBENCH_NOT_RUN - 1u) : (uint32_t)value;
+}
+
+/*******************************************************************************
+* Function Name: membench_record
+********************************************************************************
+* Summary:
+*  Keep one result for the summary and print its CSV line
+*
+*******************************************************************************/
+static void membench_record(uint32_t core, bool dcache_off, bool load, membench_region_t region,
+                            uint32_t index, uint32_t bytes, uint32_t cycles, uint32_t clock_hz)
+{
+    const membench_case_t *bench = &membench_cases[index];
+    uint32_t value = membench_value(bench, bytes, cycles, clock_hz);
+    char text[16];
+
+    membench_results[core][dcache_off][load][region][index] = value;
+    membench_rows++;
+    membench_out("MEMBENCH,%s,%s,%s,%s,%s,%u,%u,%u,%s,%s",
+                 (core == MEMBENCH_CORE_CM33) ? "cm33" : "cm55",
+                 membench_region_name(core, region),
+                 (core == MEMBENCH_CORE_CM33) ? "-" : (dcache_off ? "off" : "on"),
+                 load ? "load" : "idle", membench_test_names[bench->test],
+                 (unsigned int)bytes, (unsigned int)bench->param, (unsigned int)cycles,
+                 membench_format(value, text, sizeof(text)),
+                 (membench_accesses(bench->test, bytes, bench->param) == 0u) ? "MB/s" : "ns");
+}
+
+/*******************************************************************************
+* Function Name: membench_case_bytes
+********************************************************************************
+* Summary:
+*  Working set of a case in a region, or 0 if the case does not apply there
+*
+*******************************************************************************/
+static uint32_t membench_case_bytes(const membench_case_t *bench, membench_region_t region)
+{
+    uint32_t buffer_bytes = membench_region_bytes(region);
+    uint32_t bytes = (bench->bytes == MEMBENCH_WINDOW) ? buffer_bytes : bench->bytes;
+
+    if (!membench_test_valid(bench->test, bytes, bench->param, buffer_bytes,
+                             region != MEMBENCH_REGION_XIP)) {
+        return 0;
+    }
+    return bytes;
+}
+
+/*******************************************************************************
+* Function Name: membench_slice
+********************************************************************************
+* Summary:
+*  Start of one SOCMEM slice
+*
+*******************************************************************************/
+static uint32_t *membench_slice(uint32_t slice)
+{
+    return (uint32_t *)(void *)&membench_socmem[slice * MEMBENCH_SLICE_BYTES];
+}
+
+/*******************************************************************************
+* Function Name: membench_cm55_send
+********************************************************************************
+* Summary:
+*  Send a request to the CM55 and wait for its reply
+*  - With traffic, the CM33 copies the traffic slice until the reply comes;
+*    otherwise it sleeps a tick between looks at the mailbox
+*
+* Parameters:
+*  command: membench_cmd_t
+*  region, test, bytes, param, flags: Of a MEMBENCH_CMD_RUN request
+*  traffic: Copy SOCMEM while waiting
+*  cycles: Reply cycles, or NULL
+*
+* Return:
+*  0 on success, -1 if the request was refused or timed out
+*
+*******************************************************************************/
+static int membench_cm55_send(membench_cmd_t command, membench_region_t region,
+                              membench_test_t test, uint32_t bytes, uint32_t param,
+                              uint32_t flags, bool traffic, uint32_t *cycles)
+{
+    membench_mailbox_t *mailbox = MEMBENCH_MAILBOX;
+    uint32_t slice = (command == MEMBENCH_CMD_LOAD) ? MEMBENCH_SLICE_TRAFFIC : MEMBENCH_SLICE_CM55;
+    uint32_t *traffic_slice = membench_slice(MEMBENCH_SLICE_TRAFFIC);
+    TickType_t start = xTaskGetTickCount();
+    uint32_t request = ++membench_sequence;
+
+    mailbox->command = (uint32_t)command;
+    mailbox->region = (uint32_t)region;
+    mailbox->test = (uint32_t)test;
+    mailbox->bytes = bytes;
+    mailbox->param = param;
+    mailbox->flags = flags;
+    mailbox->socmem_offset = (uint32_t)((uintptr_t)membench_slice(slice) - MEMBENCH_SHARED_START);
+    __DSB();
+    mailbox->request = request;
+    __DSB();
+
+    while (mailbox->done != request) {
+        if ((xTaskGetTickCount() - start) > pdMS_TO_TICKS(MEMBENCH_CM55_TIMEOUT_MS)) {
+            return -1;
+        }
+        if (traffic) {
+            membench_copy(&traffic_slice[MEMBENCH_SLICE_BYTES / (2u * sizeof(uint32_t))],
+                          traffic_slice, MEMBENCH_SLICE_BYTES / 2u);
+        } else {
+            vTaskDelay(1);
+        }
+    }
+
+    if (cycles != NULL) {
+        *cycles = mailbox->cycles;
+    }
+    return (mailbox->status == 0) ? 0 : -1;
+}
+
+/*******************************************************************************
+* Function Name: membench_cm33_pass
+********************************************************************************
+* Summary:
+*  Run every case in every region on the CM33
+*
+*******************************************************************************/
+static void membench_cm33_pass(bool load)
+{
+    for (uint32_t region = 0; region < MEMBENCH_REGION_COUNT; region++) {
+        uint32_t *buf;
+
+        if (region == MEMBENCH_REGION_LOCAL) {
+            buf = membench_local;
+        } else if (region == MEMBENCH_REGION_SOCMEM) {
+            buf = membench_slice(MEMBENCH_SLICE_CM33);
+        } else {
+            buf = (uint32_t *)(uintptr_t)membench_xip_table;      /* Never written: not writable */
+        }
+
+        for (uint32_t i = 0; i < MEMBENCH_NUM_CASES; i++) {
+            const membench_case_t *bench = &membench_cases[i];
+            uint32_t bytes = membench_case_bytes(bench, (membench_region_t)region);
+            uint32_t cycles;
+
+            if (bytes == 0u) {
+                continue;
+            }
+            cycles = membench_measure(buf, bench->test, bytes, bench->param,
+                                      region != MEMBENCH_REGION_XIP);
+            membench_record(MEMBENCH_CORE_CM33, false, load, (membench_region_t)region, i, bytes,
+                            cycles, SystemCoreClock);
+        }
+    }
+}
+
+/*******************************************************************************
+* Function Name: membench_cm55_pass
+********************************************************************************
+* Summary:
+*  Run every case in every region on the CM55
+*
+* Return:
+*  0 on success, -1 if the CM55 stopped answering
+*
+*******************************************************************************/
+static int membench_cm55_pass(bool dcache_off, bool load)
+{
+    for (uint32_t region = 0; region < MEMBENCH_REGION_COUNT; region++) {
+        for (uint32_t i = 0; i < MEMBENCH_NUM_CASES; i++) {
+            const membench_case_t *bench = &membench_cases[i];
+            uint32_t bytes = membench_case_bytes(bench, (membench_region_t)region);
+            uint32_t cycles;
+
+            if (bytes == 0u) {
+                continue;
+            }
+            if (membench_cm55_send(MEMBENCH_CMD_RUN, (membench_region_t)region, bench->test, bytes,
+                                   bench->param, dcache_off ? MEMBENCH_FLAG_DCACHE_OFF : 0u,
+                                   load, &cycles) != 0) {
+                membench_out("MEMBENCH_ERROR,cm55,%s %s %u,no reply",
+                             membench_region_name(MEMBENCH_CORE_CM55, (membench_region_t)region),
+                             membench_test_names[bench->test], (unsigned int)bytes);
+                return -1;
+            }
+            membench_record(MEMBENCH_CORE_CM55, dcache_off, load, (membench_region_t)region, i,
+                            bytes, cycles, membench_cm55_hz);
+        }
+    }
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: membench_summary
+********************************************************************************
+* Summary:
+*  Print the results kept by membench_record() as one row per core,
+*  D-cache and load state and region
+*
+*******************************************************************************/
+static void membench_summary(void)
+{
+    membench_out("# %-4s %-6s %-4s %-6s %9s %9s %9s %9s %9s %9s %9s", "core", "dcache", "load",
+                 "region", "read", "write", "copy", "stride128", "lat1K", "lat16K", "lat64K");
+    membench_out("# %-4s %-6s %-4s %-6s %9s %9s %9s %9s %9s %9s %9s", "", "", "", "",
+                 "MB/s", "MB/s", "MB/s", "ns", "ns", "ns", "ns");
+
+    for (uint32_t core = 0; core < MEMBENCH_CORES; core++) {
+        for (uint32_t dcache_off = 0; dcache_off < 2u; dcache_off++) {
+            for (uint32_t load = 0; load < 2u; load++) {
+                for (uint32_t region = 0; region < MEMBENCH_REGION_COUNT; region++) {
+                    const uint32_t *values = membench_results[core][dcache_off][load][region];
+                    char text[MEMBENCH_SUMMARY_COLUMNS][16];
+                    const char *column[MEMBENCH_SUMMARY_COLUMNS];
+                    bool any = false;
+
+                    for (uint32_t c = 0; c < MEMBENCH_SUMMARY_COLUMNS; c++) {
+                        uint32_t value = values[membench_summary_cases[c]];
+
+                        column[c] = membench_format(value, text[c], sizeof(text[c]));
+                        any = any || (value != MEMBENCH_NOT_RUN);
+                    }
+                    if (!any) {
+                        continue;
+                    }
+                    membench_out("# %-4s %-6s %-4s %-6s %9s %9s %9s %9s %9s %9s %9s",
+                                 (core == MEMBENCH_CORE_CM33) ? "cm33" : "cm55",
+                                 (core == MEMBENCH_CORE_CM33) ? "-" : (dcache_off ? "off" : "on"),
+                                 load ? "load" : "idle",
+                                 membench_region_name(core, (membench_region_t)region),
+                                 column[0], column[1], column[2], column[3], column[4],
+                                 column[5], column[6]);
+                }
+            }
+        }
+    }
+}
+
+/*******************************************************************************
+* Function Name: membench_run
+********************************************************************************
+* Summary:
+*  Run the benchmark on the selected cores and print CSV lines and a summary
+*  - The caller must make sure recording and playback are stopped: the tests
+*    mask interrupts and load the memories the audio buffers live in
+*  - The CM55 answers only when proj_cm55 is built with MEMBENCH_CM55;
+*    without it the CM55 tests and the load runs are skipped
+*
+* Parameters:
+*  options: MEMBENCH_OPT_* flags
+*
+* Return:
+*  0 on success, -1 on error
+*
+*******************************************************************************/
+int membench_run(uint32_t options)
+{
+    membench_mailbox_t *mailbox = MEMBENCH_MAILBOX;
+    capture_buffer_t *buffer;
+    uintptr_t base;
+    int result = 0;
+
+    if (!isr_timing_start()) {
+        printf("MEMBENCH_ERROR,DWT cycle counter not running\r\n");
+        return -1;
+    }
+
+    buffer = capture_pool_acquire();
+    if ((buffer == NULL) ||
+        ((buffer->capacity * sizeof(int16_t)) < ((MEMBENCH_SLICES * MEMBENCH_SLICE_BYTES) + MEMBENCH_LINE_BYTES))) {
+        printf("MEMBENCH_ERROR,capture pool busy, wait for takes to be saved\r\n");
+        capture_pool_release(buffer);
+        return -1;
+    }
+    base = ((uintptr_t)buffer->samples + MEMBENCH_LINE_BYTES - 1u) & ~(uintptr_t)(MEMBENCH_LINE_BYTES - 1u);
+    if ((base < (uintptr_t)mailbox) &&
+        ((base + (MEMBENCH_SLICES * MEMBENCH_SLICE_BYTES)) > (uintptr_t)mailbox)) {
+        printf("MEMBENCH_ERROR,capture pool overlaps the CM55 mailbox\r\n");
+        capture_pool_release(buffer);
+        return -1;
+    }
+    membench_socmem = (uint8_t *)base;
+
+    if (((options & (MEMBENCH_OPT_CM55 | MEMBENCH_OPT_LOAD)) != 0u) &&
+        (mailbox->ready != MEMBENCH_READY_MAGIC)) {
+        printf("MEMBENCH_ERROR,cm55,not running (build proj_cm55 with DEFINES+=MEMBENCH_CM55)\r\n");
+        options &= ~(MEMBENCH_OPT_CM55 | MEMBENCH_OPT_LOAD);
+        result = -1;
+    }
+    if ((options & (MEMBENCH_OPT_CM33 | MEMBENCH_OPT_CM55)) == 0u) {
+        capture_pool_release(buffer);
+        return -1;
+    }
+    membench_cm55_hz = ((options & (MEMBENCH_OPT_CM55 | MEMBENCH_OPT_LOAD)) != 0u) ? mailbox->clock_hz : 0u;
+    membench_sequence = mailbox->done;
+
+    membench_file = NULL;
+    if ((options & MEMBENCH_OPT_SAVE) != 0u) {
+        membench_file = FS_FOpen(MEMBENCH_FILENAME, "w");
+        if (membench_file == NULL) {
+            printf("MEMBENCH_ERROR,cannot create %s\r\n", MEMBENCH_FILENAME);
+            capture_pool_release(buffer);
+            return -1;
+        }
+    }
+
+    memset(membench_results, 0xFF, sizeof(membench_results));     /* MEMBENCH_NOT_RUN */
+    membench_rows = 0;
+
+    membench_out("MEMBENCH_INFO,cm33_hz,%u,cm55_hz,%u,reps,%u,socmem,0x%08x,build,%s %s",
+                 (unsigned int)SystemCoreClock, (unsigned int)membench_cm55_hz,
+                 (unsigned int)MEMBENCH_REPS, (unsigned int)base, __DATE__, __TIME__);
+    membench_out("MEMBENCH,core,region,dcache,load,test,bytes,param,cycles,value,unit");
+
+    if ((options & MEMBENCH_OPT_CM33) != 0u) {
+        membench_cm33_pass(false);
+        if ((options & MEMBENCH_OPT_LOAD) != 0u) {
+            if (membench_cm55_send(MEMBENCH_CMD_LOAD, MEMBENCH_REGION_SOCMEM, MEMBENCH_TEST_COPY,
+                                   MEMBENCH_SLICE_BYTES, 0, 0, false, NULL) == 0) {
+                membench_cm33_pass(true);
+            } else {
+                membench_out("MEMBENCH_ERROR,cm55,load not started");
+                result = -1;
+            }
+            (void)membench_cm55_send(MEMBENCH_CMD_STOP, MEMBENCH_REGION_SOCMEM, MEMBENCH_TEST_COPY,
+                                     0, 0, 0, false, NULL);
+        }
+    }
+
+    if ((options & MEMBENCH_OPT_CM55) != 0u) {
+        int cm55_result = 0;
+
+        for (uint32_t dcache_off = 0; (dcache_off < 2u) && (cm55_result == 0); dcache_off++) {
+            cm55_result = membench_cm55_pass(dcache_off != 0u, false);
+            if ((cm55_result == 0) && ((options & MEMBENCH_OPT_LOAD) != 0u)) {
+                cm55_result = membench_cm55_pass(dcache_off != 0u, true);
+            }
+        }
+        if (cm55_result != 0) {
+            result = -1;
+        }
+    }
+
+    membench_summary();
+    membench_out("MEMBENCH_END,%u", (unsigned int)membench_rows);
+
+    if (membench_file != NULL) {
+        if (FS_FClose(membench_file) != 0) {
+            printf("MEMBENCH_ERROR,cannot write %s\r\n", MEMBENCH_FILENAME);
+            result = -1;
+        } else {
+            printf("Results saved to %s\r\n", MEMBENCH_FILENAME);
+        }
+        membench_file = NULL;
+    }
+    capture_pool_release(buffer);
+    membench_socmem = NULL;
+    return result;
+}
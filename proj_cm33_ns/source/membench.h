@@ -0,0 +1,45 @@
+/******************************************************************************
+* File Name: membench.h
+*
+* Description: Memory bandwidth and latency of SRAM, SOCMEM and XIP flash
+*              Runs the loops of shared/source/membench_kernels.c on the CM33
+*              and, through the mailbox of shared/include/membench_ipc.h, on
+*              the CM55; with the CM55 D-cache on and off, and with the other
+*              core copying SOCMEM meanwhile. Results are printed as CSV
+*              lines, then as a table per core and region for deciding where
+*              buffers and code go.
+*
+*******************************************************************************/
+
+#ifndef __MEMBENCH_H__
+#define __MEMBENCH_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define MEMBENCH_FILENAME           "membench.csv"
+#define MEMBENCH_CM55_TIMEOUT_MS    (2000u)     /* One CM55 test, or a load acknowledgement */
+
+/* Options of membench_run() */
+#define MEMBENCH_OPT_CM33           (1u << 0)
+#define MEMBENCH_OPT_CM55           (1u << 1)
+#define MEMBENCH_OPT_LOAD           (1u << 2)   /* Also run each test with the other core copying */
+#define MEMBENCH_OPT_SAVE           (1u << 3)   /* Write the output to MEMBENCH_FILENAME too */
+
+/*******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+int membench_run(uint32_t options);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MEMBENCH_H__ */
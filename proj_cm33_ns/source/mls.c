@@ -0,0 +1,197 @@
+/******************************************************************************
+* File Name: mls.c
+*
+* Description: Maximum length sequence and its cross-correlation
+*              An MLS correlates with itself to L at lag 0 and -1 elsewhere,
+*              so with the positions of its ones listed the correlation at
+*              each lag is 2 * (sum of the input at those positions) minus a
+*              sliding sum: L/2 additions per lag and no multiplies.
+*
+*              The capture comes through band-limited filters (DAC, PDM
+*              decimation), so around the peak the correlation is a
+*              band-limited pulse rather than a parabola. The fractional lag
+*              is the maximum of its Lanczos interpolation, searched on a
+*              1/MLS_INTERP_STEPS frame grid and refined by a parabola
+*              through the three best grid points.
+*
+*******************************************************************************/
+
+#include "mls.h"
+#include <stdlib.h>
+#include <math.h>
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define MLS_ONES                    (1u << (MLS_ORDER - 1u))
+#define MLS_TAP                     (3u)        /* a[n+10] = a[n] ^ a[n+3] */
+#define MLS_PI                      (3.14159265358979f)
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static uint8_t mls_bits[MLS_FRAMES];            /* 0 or 1 per frame */
+static uint16_t mls_ones[MLS_ONES];             /* Frames where the MLS is 1 */
+static bool mls_ready = false;
+
+/*******************************************************************************
+* Function Name: mls_sequence
+********************************************************************************
+* Summary:
+*  Generate the sequence from a Fibonacci LFSR on first use and list its ones
+*
+* Return:
+*  MLS_FRAMES values, 0 or 1
+*
+*******************************************************************************/
+const uint8_t *mls_sequence(void)
+{
+    uint32_t state = 1u;
+    uint32_t ones = 0;
+
+    if (mls_ready) {
+        return mls_bits;
+    }
+    for (uint32_t i = 0; i < MLS_FRAMES; i++) {
+        uint32_t bit = state & 1u;
+        uint32_t feedback = (state ^ (state >> MLS_TAP)) & 1u;
+
+        mls_bits[i] = (uint8_t)bit;
+        if ((bit != 0u) && (ones < MLS_ONES)) {
+            mls_ones[ones++] = (uint16_t)i;
+        }
+        state = (state >> 1) | (feedback << (MLS_ORDER - 1u));
+    }
+    mls_ready = true;
+
+    return mls_bits;
+}
+
+/*******************************************************************************
+* Function Name: mls_lanczos
+********************************************************************************
+* Summary:
+*  Lanczos kernel with MLS_INTERP_TAPS lobes
+*
+*******************************************************************************/
+static float mls_lanczos(float x)
+{
+    float px = MLS_PI * x;
+
+    if (fabsf(x) < 1e-6f) {
+        return 1.0f;
+    }
+    if (fabsf(x) >= (float)MLS_INTERP_TAPS) {
+        return 0.0f;
+    }
+    return (float)MLS_INTERP_TAPS * sinf(px) * sinf(px / (float)MLS_INTERP_TAPS) / (px * px);
+}
+
+/*******************************************************************************
+* Function Name: mls_interpolate
+********************************************************************************
+* Summary:
+*  Correlation at a fractional lag, from the MLS_INTERP_TAPS values on each
+*  side that lie inside the searched range
+*
+*******************************************************************************/
+static float mls_interpolate(const int32_t *corr, uint32_t lags, float lag)
+{
+    int32_t first = (int32_t)floorf(lag) - (int32_t)MLS_INTERP_TAPS + 1;
+    float sum = 0.0f;
+
+    for (int32_t k = first; k < first + (int32_t)(2u * MLS_INTERP_TAPS); k++) {
+        if ((k >= 0) && (k < (int32_t)lags)) {
+            sum += (float)corr[k] * mls_lanczos(lag - (float)k);
+        }
+    }
+    return sum;
+}
+
+/*******************************************************************************
+* Function Name: mls_correlate
+********************************************************************************
+* Summary:
+*  Correlate a mono window with the MLS and find the strongest lag, to a
+*  fraction of a frame
+*
+* Parameters:
+*  x: lags + MLS_FRAMES - 1 samples, lag 0 at x[0]
+*  lags: Lags searched, 0..lags-1
+*  corr: Scratch, lags values
+*  peak: Output - lag, peak level and polarity
+*
+*******************************************************************************/
+void mls_correlate(const int16_t *x, uint32_t lags, int32_t *corr, mls_peak_t *peak)
+{
+    int32_t window_sum = 0;
+    int32_t best = 0;
+    uint32_t best_lag = 0;
+    uint64_t energy = 0;
+    uint32_t count = 0;
+    float sign;
+
+    (void)mls_sequence();
+
+    for (uint32_t n = 0; n < MLS_FRAMES; n++) {
+        window_sum += x[n];
+    }
+
+    for (uint32_t k = 0; k < lags; k++) {
+        const int16_t *base = &x[k];
+        int32_t ones = 0;
+
+        for (uint32_t j = 0; j < MLS_ONES; j++) {
+            ones += base[mls_ones[j]];
+        }
+        corr[k] = (2 * ones) - window_sum;
+        if (k + 1u < lags) {
+            window_sum += x[k + MLS_FRAMES] - x[k];
+        }
+
+        if (abs(corr[k]) > abs(best)) {
+            best = corr[k];
+            best_lag = k;
+        }
+    }
+
+    peak->lag = (float)best_lag;
+    peak->inverted = (best < 0);
+    sign = peak->inverted ? -1.0f : 1.0f;
+    if ((best_lag > 0u) && (best_lag + 1u < lags)) {
+        const float step = 1.0f / (float)MLS_INTERP_STEPS;
+        float best_value = 0.0f;
+        float start = (float)best_lag - 1.0f;
+
+        for (uint32_t s = 0; s <= 2u * MLS_INTERP_STEPS; s++) {
+            float lag = start + ((float)s * step);
+            float value = sign * mls_interpolate(corr, lags, lag);
+
+            if ((s == 0u) || (value > best_value)) {
+                best_value = value;
+                peak->lag = lag;
+            }
+        }
+        if ((peak->lag > start) && (peak->lag < start + 2.0f)) {
+            float a = sign * mls_interpolate(corr, lags, peak->lag - step);
+            float c = sign * mls_interpolate(corr, lags, peak->lag + step);
+            float curve = a - (2.0f * best_value) + c;
+
+            if (curve != 0.0f) {
+                peak->lag += 0.5f * step * (a - c) / curve;
+            }
+        }
+    }
+
+    for (uint32_t k = 0; k < lags; k++) {
+        if ((k + MLS_PEAK_GUARD_FRAMES < best_lag) || (k > best_lag + MLS_PEAK_GUARD_FRAMES)) {
+            energy += (uint64_t)((int64_t)corr[k] * corr[k]);
+            count++;
+        }
+    }
+    if ((energy == 0u) || (count == 0u)) {
+        peak->peak_db = (best != 0) ? 99.0f : 0.0f;
+    } else {
+        peak->peak_db = 20.0f * log10f((float)abs(best) / sqrtf((float)energy / (float)count));
+    }
+}
@@ -0,0 +1,49 @@
+/******************************************************************************
+* File Name: mls.h
+*
+* Description: Maximum length sequence and its cross-correlation
+*              A 1023-frame MLS from a Fibonacci LFSR, and the search for
+*              the lag at which a capture best matches it, to a fraction of
+*              a frame. Used by the round-trip latency measurement.
+*
+*******************************************************************************/
+
+#ifndef __MLS_H__
+#define __MLS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define MLS_ORDER                   (10u)
+#define MLS_FRAMES                  ((1u << MLS_ORDER) - 1u)   /* 64 ms at 16 kHz */
+#define MLS_PEAK_GUARD_FRAMES       (32u)       /* Left out of the off-peak level around the peak */
+#define MLS_INTERP_TAPS             (8u)        /* Correlation values each side of a fractional lag */
+#define MLS_INTERP_STEPS            (64u)       /* Search points per frame around the peak */
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+typedef struct {
+    float lag;                  /* Frames from x[0] to the start of the sequence */
+    float peak_db;              /* Correlation peak over the off-peak RMS */
+    bool inverted;              /* Negative peak: the path inverts polarity */
+} mls_peak_t;
+
+/*******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+const uint8_t *mls_sequence(void);
+void mls_correlate(const int16_t *x, uint32_t lags, int32_t *corr, mls_peak_t *peak);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MLS_H__ */
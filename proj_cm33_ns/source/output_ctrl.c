@@ -0,0 +1,428 @@
+/******************************************************************************
+* File Name: output_ctrl.c
+*
+* Description: Playback volume, mute and output routing without clicks
+*              - The ramp the I2S ISR runs is changed by tasks inside a
+*                critical section. Without a play running a new gain takes
+*                effect at once; with one, the task waits for the ramp to
+*                reach it before switching anything on the codec.
+*              - Codec registers go through codec_ctrl.c, so a switch costs
+*                the task no I2C time; codec_ctrl_sync() orders the steps
+*                that must reach the codec one after the other.
+*              - The speaker and headphone paths are switched off first and
+*                on second, each driver unmuted last and muted first.
+*
+*******************************************************************************/
+
+#include "output_ctrl.h"
+#include "codec_ctrl.h"
+#include "audio_ramfunc.h"
+#include "app_i2s.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define OUTPUT_RAMP_FRAMES          ((OUTPUT_RAMP_MS * SAMPLE_RATE_HZ) / 1000u)
+#define OUTPUT_SAMPLE_SHIFT         (OUTPUT_RAMP_SHIFT - 15u)   /* Q23 gain to Q15 */
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static output_ramp_t output_ramp = {        /* Run by the I2S ISR */
+    .gain = OUTPUT_RAMP_UNITY,
+    .target = OUTPUT_RAMP_UNITY,
+    .step = 1
+};
+
+static struct {
+    bool running;               /* Between output_ctrl_begin() and output_ctrl_end() */
+    bool muted;
+    int32_t volume_db;
+    output_route_t route;
+    uint32_t fades;
+    uint32_t codec_errors;
+} output_state = {
+    .volume_db = OUTPUT_DEFAULT_VOLUME_DB,
+    .route = OUTPUT_ROUTE_SPEAKER
+};
+
+static const char *const output_route_names[OUTPUT_ROUTE_COUNT] = { "spk", "hp", "both" };
+
+/*******************************************************************************
+* Function Name: output_ramp_start
+********************************************************************************
+* Summary:
+*  Ramp from the current gain to a new one
+*
+* Parameters:
+*  ramp: Ramp
+*  target: Q23 gain, 0..OUTPUT_RAMP_UNITY
+*  frames: Length of a full-scale ramp; a shorter change takes a share of it
+*
+*******************************************************************************/
+void output_ramp_start(output_ramp_t *ramp, int32_t target, uint32_t frames)
+{
+    int32_t step = (frames == 0u) ? OUTPUT_RAMP_UNITY : (OUTPUT_RAMP_UNITY / (int32_t)frames);
+
+    ramp->target = target;
+    ramp->step = (step > 0) ? step : 1;
+}
+
+/*******************************************************************************
+* Function Name: output_ramp_process
+********************************************************************************
+* Summary:
+*  Apply the ramp to interleaved L/R frames in place
+*  - At unity nothing is touched, at zero the samples are cleared; while
+*    the gain moves it costs one add per frame and one multiply per sample
+*
+* Parameters:
+*  ramp: Ramp
+*  samples: Interleaved L/R
+*  frames: Frames at samples
+*
+*******************************************************************************/
+AUDIO_RAMFUNC_BEGIN
+void output_ramp_process(output_ramp_t *ramp, int16_t *samples, uint32_t frames)
+{
+    int32_t gain = ramp->gain;
+    int32_t target = ramp->target;
+
+    if (gain == target) {
+        if (gain == OUTPUT_RAMP_UNITY) {
+            return;
+        }
+        if (gain == 0) {
+            memset(samples, 0, frames * 2u * sizeof(int16_t));
+            return;
+        }
+        for (uint32_t i = 0; i < frames * 2u; i++) {
+            samples[i] = (int16_t)(((int32_t)samples[i] * (gain >> OUTPUT_SAMPLE_SHIFT)) >> 15);
+        }
+        return;
+    }
+
+    {
+        int32_t delta = (target > gain) ? ramp->step : -ramp->step;
+        uint32_t steps = (uint32_t)(abs(target - gain) / ramp->step);     /* Before the target */
+
+        for (uint32_t i = 0; i < frames; i++) {
+            int32_t g;
+
+            gain = (i < steps) ? (gain + delta) : target;
+            g = gain >> OUTPUT_SAMPLE_SHIFT;
+            samples[2u * i] = (int16_t)(((int32_t)samples[2u * i] * g) >> 15);
+            samples[2u * i + 1u] = (int16_t)(((int32_t)samples[2u * i + 1u] * g) >> 15);
+        }
+        ramp->gain = gain;
+    }
+}
+AUDIO_RAMFUNC_END
+
+/*******************************************************************************
+* Function Name: output_ctrl_process
+********************************************************************************
+* Summary:
+*  The playback ramp on one refill; called from the I2S stream's process
+*  hook after the DSP chain
+*  - A play that runs out fades too: once no more than OUTPUT_RAMP_FRAMES
+*    are left, the ramp heads for silence and reaches it on the last frame
+*
+* Parameters:
+*  samples: Interleaved L/R
+*  frames: Frames at samples
+*  frames_left: Frames left in the play, this refill included; UINT32_MAX
+*               while its end is not known
+*
+*******************************************************************************/
+AUDIO_RAMFUNC_BEGIN
+void output_ctrl_process(int16_t *samples, uint32_t frames, uint32_t frames_left)
+{
+    if ((frames_left <= OUTPUT_RAMP_FRAMES) && (output_ramp.target != 0)) {
+        output_ramp_start(&output_ramp, 0, frames_left);
+        output_state.fades++;
+    }
+    output_ramp_process(&output_ramp, samples, frames);
+}
+AUDIO_RAMFUNC_END
+
+/*******************************************************************************
+* Function Name: output_ctrl_level
+********************************************************************************
+* Summary:
+*  Ramp gain while nothing is fading: silence if muted
+*
+*******************************************************************************/
+static int32_t output_ctrl_level(void)
+{
+    return output_state.muted ? 0 : OUTPUT_RAMP_UNITY;
+}
+
+/*******************************************************************************
+* Function Name: output_ctrl_ramp_to
+********************************************************************************
+* Summary:
+*  Move the ramp to a gain and wait until the ISR has got there
+*
+* Return:
+*  0 on success, -1 if the stream stopped taking samples on the way
+*
+*******************************************************************************/
+static int output_ctrl_ramp_to(int32_t target)
+{
+    TickType_t start = xTaskGetTickCount();
+
+    taskENTER_CRITICAL();
+    if (output_state.running) {
+        output_ramp_start(&output_ramp, target, OUTPUT_RAMP_FRAMES);
+    } else {
+        output_ramp.gain = target;
+        output_ramp.target = target;
+    }
+    taskEXIT_CRITICAL();
+
+    for (;;) {
+        bool done;
+
+        taskENTER_CRITICAL();
+        done = !output_state.running || (output_ramp.gain == output_ramp.target);
+        taskEXIT_CRITICAL();
+        if (done) {
+            return 0;
+        }
+        if ((xTaskGetTickCount() - start) >= pdMS_TO_TICKS(OUTPUT_RAMP_TIMEOUT_MS)) {
+            return -1;
+        }
+        vTaskDelay(1);
+    }
+}
+
+/*******************************************************************************
+* Function Name: output_ctrl_begin
+********************************************************************************
+* Summary:
+*  Start a play from silence, ramping up unless muted. Called by
+*  PlaybackTask before the stream is enabled.
+*
+*******************************************************************************/
+void output_ctrl_begin(void)
+{
+    taskENTER_CRITICAL();
+    output_state.running = true;
+    output_ramp.gain = 0;
+    output_ramp_start(&output_ramp, output_ctrl_level(), OUTPUT_RAMP_FRAMES);
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+* Function Name: output_ctrl_end
+********************************************************************************
+* Summary:
+*  The stream has stopped; later changes apply at once
+*
+*******************************************************************************/
+void output_ctrl_end(void)
+{
+    taskENTER_CRITICAL();
+    output_state.running = false;
+    output_ramp.gain = output_ctrl_level();
+    output_ramp.target = output_ramp.gain;
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+* Function Name: output_ctrl_fade_out
+********************************************************************************
+* Summary:
+*  Ramp the play down to silence, e.g. before it is cut off
+*
+* Return:
+*  0 once silent, -1 if the stream stalled
+*
+*******************************************************************************/
+int output_ctrl_fade_out(void)
+{
+    taskENTER_CRITICAL();
+    output_state.fades++;
+    taskEXIT_CRITICAL();
+    return output_ctrl_ramp_to(0);
+}
+
+/*******************************************************************************
+* Function Name: output_ctrl_fade_in
+********************************************************************************
+* Summary:
+*  Ramp back up after output_ctrl_fade_out(), unless muted
+*
+*******************************************************************************/
+int output_ctrl_fade_in(void)
+{
+    return output_ctrl_ramp_to(output_ctrl_level());
+}
+
+/*******************************************************************************
+* Function Name: output_ctrl_codec
+********************************************************************************
+* Summary:
+*  Change bits of a codec register through the cache, counting failures
+*
+*******************************************************************************/
+static int output_ctrl_codec(codec_reg_t reg, uint8_t mask, uint8_t value)
+{
+    if (codec_ctrl_update(reg, mask, value) != 0) {
+        output_state.codec_errors++;
+        return -1;
+    }
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: output_ctrl_set_volume
+********************************************************************************
+* Summary:
+*  Set the DAC digital volume of both channels; the codec soft-steps it
+*
+* Parameters:
+*  volume_db: OUTPUT_MIN_VOLUME_DB..OUTPUT_MAX_VOLUME_DB
+*
+* Return:
+*  0 on success, -1 if out of range or the codec cannot be written
+*
+*******************************************************************************/
+int output_ctrl_set_volume(int32_t volume_db)
+{
+    uint8_t value = (uint8_t)(int8_t)(volume_db * 2);     /* 0.5 dB steps */
+    uint8_t values[2] = { value, value };
+    int result;
+
+    if ((volume_db < OUTPUT_MIN_VOLUME_DB) || (volume_db > OUTPUT_MAX_VOLUME_DB)) {
+        return -1;
+    }
+    output_state.volume_db = volume_db;
+
+    /* Soft-stepping one 0.5 dB step per sample, then the new level */
+    result = output_ctrl_codec(CODEC_P0_DAC_DATA_PATH, 0x03u, 0x00u);
+    if (codec_ctrl_write_block(CODEC_P0_DAC_LEFT_VOLUME, values, 2u) != 0) {
+        output_state.codec_errors++;
+        result = -1;
+    }
+    return result;
+}
+
+/*******************************************************************************
+* Function Name: output_ctrl_set_mute
+********************************************************************************
+* Summary:
+*  Mute: ramp to silence, then mute the DAC. Unmute: the reverse.
+*
+* Return:
+*  0 on success, -1 if the ramp stalled or the codec cannot be written
+*
+*******************************************************************************/
+int output_ctrl_set_mute(bool mute)
+{
+    int result = 0;
+
+    output_state.muted = mute;
+    if (mute) {
+        result |= output_ctrl_ramp_to(0);
+        result |= output_ctrl_codec(CODEC_P0_DAC_VOLUME_CTRL, 0x0Cu, 0x0Cu);
+    } else {
+        result |= output_ctrl_codec(CODEC_P0_DAC_VOLUME_CTRL, 0x0Cu, 0x00u);
+        result |= codec_ctrl_sync(CODEC_CTRL_SYNC_TIMEOUT_MS);
+        result |= output_ctrl_ramp_to(OUTPUT_RAMP_UNITY);
+    }
+    return (result != 0) ? -1 : 0;
+}
+
+/*******************************************************************************
+* Function Name: output_ctrl_set_route
+********************************************************************************
+* Summary:
+*  Switch between speaker and headphones, or drive both, faded out around
+*  the switch if a play is running
+*
+* Return:
+*  0 on success, -1 if the ramp stalled or the codec cannot be written
+*
+*******************************************************************************/
+int output_ctrl_set_route(output_route_t route)
+{
+    bool spk = (route != OUTPUT_ROUTE_HEADPHONE);
+    bool hp = (route != OUTPUT_ROUTE_SPEAKER);
+    int result = 0;
+
+    if ((uint32_t)route >= OUTPUT_ROUTE_COUNT) {
+        return -1;
+    }
+    output_state.route = route;
+    result |= output_ctrl_fade_out();
+
+    /* Off first: driver muted, then powered down */
+    if (!spk) {
+        result |= output_ctrl_codec(CODEC_P1_SPK_DRIVER, 0x04u, 0x00u);
+        result |= output_ctrl_codec(CODEC_P1_SPK_AMP, 0x80u, 0x00u);
+    }
+    if (!hp) {
+        result |= output_ctrl_codec(CODEC_P1_HPL_DRIVER, 0x04u, 0x00u);
+        result |= output_ctrl_codec(CODEC_P1_HPR_DRIVER, 0x04u, 0x00u);
+        result |= output_ctrl_codec(CODEC_P1_HP_DRIVERS, 0xC0u, 0x00u);
+    }
+    result |= codec_ctrl_sync(CODEC_CTRL_SYNC_TIMEOUT_MS);
+
+    /* On second: DAC to the mixers, routed, powered up, then unmuted */
+    result |= output_ctrl_codec(CODEC_P1_DAC_MIXER_ROUTING, 0xCCu, 0x44u);
+    if (spk) {
+        result |= output_ctrl_codec(CODEC_P1_SPK_ANALOG_VOLUME, 0x80u, 0x80u);
+        result |= output_ctrl_codec(CODEC_P1_SPK_AMP, 0x80u, 0x80u);
+    }
+    if (hp) {
+        result |= output_ctrl_codec(CODEC_P1_HPL_ANALOG_VOLUME, 0x80u, 0x80u);
+        result |= output_ctrl_codec(CODEC_P1_HPR_ANALOG_VOLUME, 0x80u, 0x80u);
+        result |= output_ctrl_codec(CODEC_P1_HP_DRIVERS, 0xC0u, 0xC0u);
+    }
+    result |= codec_ctrl_sync(CODEC_CTRL_SYNC_TIMEOUT_MS);
+    if (spk) {
+        result |= output_ctrl_codec(CODEC_P1_SPK_DRIVER, 0x04u, 0x04u);
+    }
+    if (hp) {
+        result |= output_ctrl_codec(CODEC_P1_HPL_DRIVER, 0x04u, 0x04u);
+        result |= output_ctrl_codec(CODEC_P1_HPR_DRIVER, 0x04u, 0x04u);
+    }
+    result |= codec_ctrl_sync(CODEC_CTRL_SYNC_TIMEOUT_MS);
+
+    result |= output_ctrl_fade_in();
+    return (result != 0) ? -1 : 0;
+}
+
+/*******************************************************************************
+* Function Name: output_ctrl_get_status
+*******************************************************************************/
+void output_ctrl_get_status(output_status_t *status)
+{
+    taskENTER_CRITICAL();
+    status->volume_db = output_state.volume_db;
+    status->muted = output_state.muted;
+    status->route = output_state.route;
+    status->running = output_state.running;
+    status->ramp_gain = (float)output_ramp.gain / (float)OUTPUT_RAMP_UNITY;
+    status->fades = output_state.fades;
+    status->codec_errors = output_state.codec_errors;
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+* Function Name: output_route_name
+********************************************************************************
+* Summary:
+*  Name of a route as the 'route' command takes it
+*
+*******************************************************************************/
+const char *output_route_name(output_route_t route)
+{
+    return ((uint32_t)route < OUTPUT_ROUTE_COUNT) ? output_route_names[route] : "?";
+}
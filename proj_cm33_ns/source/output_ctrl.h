@@ -0,0 +1,91 @@
+/******************************************************************************
+* File Name: output_ctrl.h
+*
+* Description: Playback volume, mute and output routing without clicks
+*              The level is the codec's DAC digital volume, which the codec
+*              soft-steps by 0.5 dB per sample. Mute, the start and end of a
+*              play and route changes use a linear gain ramp that the I2S
+*              refill runs on the samples: OUTPUT_RAMP_MS down to silence
+*              before the codec is switched, and up again after it. A file
+*              or clip that plays to its end fades out over its last
+*              OUTPUT_RAMP_MS; 'stop' fades out a play before it is cut.
+*              Volume and route are settings ('config'); mute is not kept.
+*
+*******************************************************************************/
+
+#ifndef __OUTPUT_CTRL_H__
+#define __OUTPUT_CTRL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define OUTPUT_RAMP_MS              (10u)
+#define OUTPUT_RAMP_TIMEOUT_MS      (100u)      /* Ramp not done: the stream stalled */
+#define OUTPUT_MIN_VOLUME_DB        (-63)       /* DAC digital volume range used */
+#define OUTPUT_MAX_VOLUME_DB        (0)         /* The normalizer boosts, not the DAC */
+#define OUTPUT_DEFAULT_VOLUME_DB    (0)
+
+/* Ramp gain, Q23 so a step per frame keeps its precision; samples are
+ * scaled by the top 15 bits */
+#define OUTPUT_RAMP_SHIFT           (23u)
+#define OUTPUT_RAMP_UNITY           (1 << OUTPUT_RAMP_SHIFT)
+
+/*******************************************************************************
+* Enumerations
+*******************************************************************************/
+typedef enum {
+    OUTPUT_ROUTE_SPEAKER,       /* Class-D speaker driver only */
+    OUTPUT_ROUTE_HEADPHONE,     /* HPL/HPR drivers only */
+    OUTPUT_ROUTE_BOTH,
+    OUTPUT_ROUTE_COUNT
+} output_route_t;
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+/* Linear gain ramp over interleaved L/R frames */
+typedef struct {
+    int32_t gain;               /* Q23, 0..OUTPUT_RAMP_UNITY */
+    int32_t target;
+    int32_t step;               /* Per frame, positive */
+} output_ramp_t;
+
+typedef struct {
+    int32_t volume_db;
+    bool muted;
+    output_route_t route;
+    bool running;               /* A play is using the ramp */
+    float ramp_gain;            /* Now, 0..1 */
+    uint32_t fades;             /* Ramps to silence since boot */
+    uint32_t codec_errors;      /* Codec register writes refused */
+} output_status_t;
+
+/*******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+void output_ramp_start(output_ramp_t *ramp, int32_t target, uint32_t frames);
+void output_ramp_process(output_ramp_t *ramp, int16_t *samples, uint32_t frames);
+
+void output_ctrl_begin(void);
+void output_ctrl_end(void);
+void output_ctrl_process(int16_t *samples, uint32_t frames, uint32_t frames_left);
+int output_ctrl_fade_out(void);
+int output_ctrl_fade_in(void);
+int output_ctrl_set_volume(int32_t volume_db);
+int output_ctrl_set_mute(bool mute);
+int output_ctrl_set_route(output_route_t route);
+void output_ctrl_get_status(output_status_t *status);
+const char *output_route_name(output_route_t route);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __OUTPUT_CTRL_H__ */
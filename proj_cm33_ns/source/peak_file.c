@@ -0,0 +1,477 @@
+/******************************************************************************
+* File Name: peak_file.c
+*
+* Description: Waveform peak sidecar files
+*              Only the finest level is kept while recording; coarser levels
+*              are reduced from it when the file is written. The file is
+*              written under a temporary name after the WAV is closed and
+*              renamed into place, so a sidecar that exists always describes
+*              a complete WAV. peak_file_check() rejects a sidecar whose
+*              frame count or WAV size no longer match, and
+*              peak_file_rebuild() regenerates it from the audio.
+*
+*******************************************************************************/
+
+#include "peak_file.h"
+#include "wav_file.h"
+#include "crc32.h"
+#include <string.h>
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define PEAK_WRITE_ROWS             (64u)       /* Entries buffered per FS_Write */
+#define PEAK_READ_SAMPLES           (256u)      /* Samples per FS_Read when rebuilding */
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static uint8_t peak_rows[PEAK_WRITE_ROWS * PEAK_MAX_CHANNELS * sizeof(peak_entry_t)];
+static int16_t peak_samples[PEAK_READ_SAMPLES];
+
+/*******************************************************************************
+* Function Name: peak_entry_clear
+********************************************************************************
+* Summary:
+*  Set a range so that any sample widens it
+*
+*******************************************************************************/
+static void peak_entry_clear(peak_entry_t *entry, uint16_t num_channels)
+{
+    for (uint16_t ch = 0; ch < num_channels; ch++) {
+        entry[ch].min = INT16_MAX;
+        entry[ch].max = INT16_MIN;
+    }
+}
+
+/*******************************************************************************
+* Function Name: peak_entry_merge
+********************************************************************************
+* Summary:
+*  Widen dst to cover src
+*
+*******************************************************************************/
+static void peak_entry_merge(peak_entry_t *dst, const peak_entry_t *src, uint16_t num_channels)
+{
+    for (uint16_t ch = 0; ch < num_channels; ch++) {
+        if (src[ch].min < dst[ch].min) {
+            dst[ch].min = src[ch].min;
+        }
+        if (src[ch].max > dst[ch].max) {
+            dst[ch].max = src[ch].max;
+        }
+    }
+}
+
+/*******************************************************************************
+* Function Name: peak_builder_reset
+********************************************************************************
+* Summary:
+*  Start a new set of peaks
+*
+* Parameters:
+*  builder: Builder to reset
+*  num_channels: Interleaved channels in the samples (1..PEAK_MAX_CHANNELS)
+*  sample_rate: Stored in the file header
+*
+*******************************************************************************/
+void peak_builder_reset(peak_builder_t *builder, uint16_t num_channels, uint32_t sample_rate)
+{
+    builder->num_channels = num_channels;
+    builder->sample_rate = sample_rate;
+    builder->frames = 0;
+    builder->frames_per_entry = PEAK_BASE_FRAMES;
+    builder->num_entries = 0;
+    builder->partial_frames = 0;
+    peak_entry_clear(builder->partial, num_channels);
+}
+
+/*******************************************************************************
+* Function Name: peak_builder_commit
+********************************************************************************
+* Summary:
+*  Move the partial entry into the finest level; when that is full, merge
+*  neighbouring entries so the level keeps covering the whole take at half
+*  the resolution
+*
+*******************************************************************************/
+static void peak_builder_commit(peak_builder_t *builder)
+{
+    memcpy(builder->entries[builder->num_entries], builder->partial,
+           builder->num_channels * sizeof(peak_entry_t));
+    builder->num_entries++;
+    builder->partial_frames = 0;
+    peak_entry_clear(builder->partial, builder->num_channels);
+
+    if (builder->num_entries == PEAK_MAX_ENTRIES) {
+        for (uint32_t i = 0; i < PEAK_MAX_ENTRIES / 2u; i++) {
+            memcpy(builder->entries[i], builder->entries[2u * i],
+                   builder->num_channels * sizeof(peak_entry_t));
+            peak_entry_merge(builder->entries[i], builder->entries[2u * i + 1u],
+                             builder->num_channels);
+        }
+        builder->num_entries = PEAK_MAX_ENTRIES / 2u;
+        builder->frames_per_entry *= 2u;
+    }
+}
+
+/*******************************************************************************
+* Function Name: peak_builder_update
+********************************************************************************
+* Summary:
+*  Fold newly captured samples into the peaks
+*
+* Parameters:
+*  builder: Builder set up by peak_builder_reset()
+*  pcm: Interleaved samples
+*  num_samples: Sample count, a whole number of frames
+*
+*******************************************************************************/
+void peak_builder_update(peak_builder_t *builder, const int16_t *pcm, uint32_t num_samples)
+{
+    uint16_t num_channels = builder->num_channels;
+    uint32_t frames = num_samples / num_channels;
+
+    for (uint32_t i = 0; i < frames; i++) {
+        for (uint16_t ch = 0; ch < num_channels; ch++) {
+            int16_t sample = *pcm++;
+            if (sample < builder->partial[ch].min) {
+                builder->partial[ch].min = sample;
+            }
+            if (sample > builder->partial[ch].max) {
+                builder->partial[ch].max = sample;
+            }
+        }
+        if (++builder->partial_frames == builder->frames_per_entry) {
+            peak_builder_commit(builder);
+        }
+    }
+    builder->frames += frames;
+}
+
+/*******************************************************************************
+* Function Name: peak_file_name
+********************************************************************************
+* Summary:
+*  Sidecar name for a WAV file: the extension is replaced by ".pk"
+*
+* Parameters:
+*  wav_name: WAV file name
+*  peak_name: Output buffer
+*  size: Size of peak_name
+*
+* Return:
+*  0 on success, -1 if the name does not fit
+*
+*******************************************************************************/
+int peak_file_name(const char *wav_name, char *peak_name, size_t size)
+{
+    const char *dot = strrchr(wav_name, '.');
+    size_t stem = (dot != NULL) ? (size_t)(dot - wav_name) : strlen(wav_name);
+
+    if (stem + sizeof(PEAK_FILE_EXTENSION) > size) {
+        return -1;
+    }
+    memcpy(peak_name, wav_name, stem);
+    memcpy(&peak_name[stem], PEAK_FILE_EXTENSION, sizeof(PEAK_FILE_EXTENSION));
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: peak_file_write
+********************************************************************************
+* Summary:
+*  Save the peaks next to a WAV file that has already been closed
+*  - Coarser levels are reduced from the finest one here
+*  - The trailing partial entry is written as a short last entry
+*
+* Parameters:
+*  wav_name: WAV file the peaks were built from
+*  builder: Peaks of exactly the frames in that file
+*
+* Return:
+*  0 on success, -1 on error (any previous sidecar is left alone)
+*
+*******************************************************************************/
+int peak_file_write(const char *wav_name, const peak_builder_t *builder)
+{
+    char peak_name[40];
+    peak_file_header_t header;
+    uint16_t num_channels = builder->num_channels;
+    uint32_t entry_size = num_channels * sizeof(peak_entry_t);
+    uint32_t count = builder->num_entries + ((builder->partial_frames > 0u) ? 1u : 0u);
+    uint32_t offset = sizeof(header);
+    uint32_t span = 1;
+    uint32_t crc;
+    FS_FILE *file;
+
+    if (peak_file_name(wav_name, peak_name, sizeof(peak_name)) != 0) {
+        return -1;
+    }
+
+    file = FS_FOpen(wav_name, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    memset(&header, 0, sizeof(header));
+    header.wav_size = FS_GetFileSize(file);
+    FS_FClose(file);
+
+    memcpy(header.magic, PEAK_FILE_MAGIC, 4);
+    header.version = PEAK_FILE_VERSION;
+    header.num_channels = num_channels;
+    header.sample_rate = builder->sample_rate;
+    header.frames = builder->frames;
+    header.num_levels = PEAK_NUM_LEVELS;
+    header.entry_size = (uint16_t)entry_size;
+    for (uint32_t level = 0; level < PEAK_NUM_LEVELS; level++) {
+        header.level[level].frames_per_entry = builder->frames_per_entry * span;
+        header.level[level].num_entries = (count + span - 1u) / span;
+        header.level[level].offset = offset;
+        offset += header.level[level].num_entries * entry_size;
+        span *= PEAK_LEVEL_FACTOR;
+    }
+
+    file = FS_FOpen(PEAK_TEMP_FILENAME, "w");
+    if (file == NULL) {
+        return -1;
+    }
+
+    /* Header goes in again once the CRC is known */
+    if (FS_Write(file, &header, sizeof(header)) != sizeof(header)) {
+        goto fail;
+    }
+    crc = crc32_update(CRC32_INIT, &header, offsetof(peak_file_header_t, crc));
+
+    span = 1;
+    for (uint32_t level = 0; level < PEAK_NUM_LEVELS; level++) {
+        uint32_t rows = 0;
+
+        for (uint32_t j = 0; j < header.level[level].num_entries; j++) {
+            peak_entry_t row[PEAK_MAX_CHANNELS];
+            uint32_t first = j * span;
+            uint32_t last = (first + span < count) ? (first + span) : count;
+
+            peak_entry_clear(row, num_channels);
+            for (uint32_t k = first; k < last; k++) {
+                const peak_entry_t *src = (k < builder->num_entries) ? builder->entries[k]
+                                                                     : builder->partial;
+                peak_entry_merge(row, src, num_channels);
+            }
+            memcpy(&peak_rows[rows * entry_size], row, entry_size);
+
+            if ((++rows == PEAK_WRITE_ROWS) || (j + 1u == header.level[level].num_entries)) {
+                if (FS_Write(file, peak_rows, rows * entry_size) != rows * entry_size) {
+                    goto fail;
+                }
+                crc = crc32_update(crc, peak_rows, rows * entry_size);
+                rows = 0;
+            }
+        }
+        span *= PEAK_LEVEL_FACTOR;
+    }
+
+    header.crc = crc32_final(crc);
+    if ((FS_FSeek(file, 0, FS_SEEK_SET) != 0) ||
+        (FS_Write(file, &header, sizeof(header)) != sizeof(header))) {
+        goto fail;
+    }
+    if (FS_FClose(file) != 0) {
+        (void)FS_Remove(PEAK_TEMP_FILENAME);
+        return -1;
+    }
+
+    (void)FS_Remove(peak_name);
+    if (FS_Rename(PEAK_TEMP_FILENAME, peak_name) != 0) {
+        (void)FS_Remove(PEAK_TEMP_FILENAME);
+        return -1;
+    }
+    return 0;
+
+fail:
+    FS_FClose(file);
+    (void)FS_Remove(PEAK_TEMP_FILENAME);
+    return -1;
+}
+
+/*******************************************************************************
+* Function Name: peak_file_check
+********************************************************************************
+* Summary:
+*  Check that a WAV file has a complete, current sidecar
+*
+* Parameters:
+*  wav_name: WAV file name
+*  header: Output - sidecar header when valid
+*
+* Return:
+*  0 if the sidecar is valid, -1 if it is missing, damaged or stale
+*
+*******************************************************************************/
+int peak_file_check(const char *wav_name, peak_file_header_t *header)
+{
+    char peak_name[40];
+    wav_info_t info;
+    uint32_t wav_size;
+    uint32_t expected;
+    uint32_t remaining;
+    uint32_t crc;
+    FS_FILE *file;
+    int result;
+
+    if (peak_file_name(wav_name, peak_name, sizeof(peak_name)) != 0) {
+        return -1;
+    }
+
+    file = FS_FOpen(wav_name, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    result = wav_parse(file, &info);
+    wav_size = FS_GetFileSize(file);
+    FS_FClose(file);
+    if ((result != 0) || (info.block_align == 0u)) {
+        return -1;
+    }
+
+    file = FS_FOpen(peak_name, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    if ((FS_Read(file, header, sizeof(*header)) != sizeof(*header)) ||
+        (memcmp(header->magic, PEAK_FILE_MAGIC, 4) != 0) ||
+        (header->version != PEAK_FILE_VERSION) ||
+        (header->num_levels != PEAK_NUM_LEVELS) ||
+        (header->num_channels != info.num_channels) ||
+        (header->num_channels > PEAK_MAX_CHANNELS) ||
+        (header->entry_size != header->num_channels * sizeof(peak_entry_t)) ||
+        (header->frames != info.data_bytes / info.block_align) ||
+        (header->wav_size != wav_size)) {
+        FS_FClose(file);
+        return -1;
+    }
+
+    expected = sizeof(*header);
+    for (uint32_t level = 0; level < PEAK_NUM_LEVELS; level++) {
+        if (header->level[level].offset != expected) {
+            FS_FClose(file);
+            return -1;
+        }
+        expected += header->level[level].num_entries * header->entry_size;
+    }
+    if (FS_GetFileSize(file) != expected) {
+        FS_FClose(file);
+        return -1;
+    }
+
+    /* Entries follow the header to the end of the file */
+    crc = crc32_update(CRC32_INIT, header, offsetof(peak_file_header_t, crc));
+    remaining = expected - sizeof(*header);
+    while (remaining > 0u) {
+        uint32_t chunk = (remaining < sizeof(peak_samples)) ? remaining : sizeof(peak_samples);
+        if (FS_Read(file, peak_samples, chunk) != chunk) {
+            FS_FClose(file);
+            return -1;
+        }
+        crc = crc32_update(crc, peak_samples, chunk);
+        remaining -= chunk;
+    }
+    FS_FClose(file);
+
+    return (crc32_final(crc) == header->crc) ? 0 : -1;
+}
+
+/*******************************************************************************
+* Function Name: peak_file_rebuild
+********************************************************************************
+* Summary:
+*  Regenerate a sidecar by reading the audio, for files recorded before
+*  sidecars existed, uploaded files, or a sidecar lost to a power cut
+*
+* Parameters:
+*  wav_name: 16-bit PCM WAV file, 1 or 2 channels
+*  builder: Scratch builder
+*
+* Return:
+*  0 on success, -1 on error
+*
+*******************************************************************************/
+int peak_file_rebuild(const char *wav_name, peak_builder_t *builder)
+{
+    wav_info_t info;
+    uint32_t remaining;
+    FS_FILE *file;
+
+    file = FS_FOpen(wav_name, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    if ((wav_parse(file, &info) != 0) ||
+        (info.bits_per_sample != WAV_BITS_PER_SAMPLE) ||
+        (info.num_channels == 0u) || (info.num_channels > PEAK_MAX_CHANNELS)) {
+        FS_FClose(file);
+        return -1;
+    }
+
+    peak_builder_reset(builder, info.num_channels, info.sample_rate);
+    remaining = info.data_bytes - (info.data_bytes % info.block_align);
+    while (remaining > 0u) {
+        uint32_t chunk = (remaining < sizeof(peak_samples)) ? remaining : sizeof(peak_samples);
+        chunk -= chunk % info.block_align;
+        if (FS_Read(file, peak_samples, chunk) != chunk) {
+            FS_FClose(file);
+            return -1;
+        }
+        peak_builder_update(builder, peak_samples, chunk / sizeof(int16_t));
+        remaining -= chunk;
+    }
+    FS_FClose(file);
+
+    return peak_file_write(wav_name, builder);
+}
+
+/*******************************************************************************
+* Function Name: peak_file_read_entry
+********************************************************************************
+* Summary:
+*  Read one entry of an open sidecar
+*
+* Parameters:
+*  file: Sidecar opened for reading
+*  header: Header from peak_file_check()
+*  level: Zoom level, 0 = finest
+*  index: Entry within the level
+*  entry: Output - num_channels ranges
+*
+* Return:
+*  0 on success, -1 if out of range or on a read error
+*
+*******************************************************************************/
+int peak_file_read_entry(FS_FILE *file, const peak_file_header_t *header, uint32_t level,
+                         uint32_t index, peak_entry_t *entry)
+{
+    if ((level >= PEAK_NUM_LEVELS) || (index >= header->level[level].num_entries)) {
+        return -1;
+    }
+    if (FS_FSeek(file, (I32)(header->level[level].offset + index * header->entry_size),
+                 FS_SEEK_SET) != 0) {
+        return -1;
+    }
+    return (FS_Read(file, entry, header->entry_size) == header->entry_size) ? 0 : -1;
+}
+
+/*******************************************************************************
+* Function Name: peak_file_remove
+********************************************************************************
+* Summary:
+*  Delete the sidecar of a WAV file that is about to be replaced or deleted
+*
+*******************************************************************************/
+void peak_file_remove(const char *wav_name)
+{
+    char peak_name[40];
+
+    if (peak_file_name(wav_name, peak_name, sizeof(peak_name)) == 0) {
+        (void)FS_Remove(peak_name);
+    }
+}
@@ -0,0 +1,95 @@
+/******************************************************************************
+* File Name: peak_file.h
+*
+* Description: Waveform peak sidecar files
+*              Min/max per block of frames at several zoom levels, built
+*              while recording and saved next to the WAV ("audio_001.pk"
+*              for "audio_001.wav") so a host can draw an overview without
+*              reading the audio
+*
+*******************************************************************************/
+
+#ifndef __PEAK_FILE_H__
+#define __PEAK_FILE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "FS.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define PEAK_FILE_EXTENSION         ".pk"
+#define PEAK_FILE_MAGIC             "PEAK"
+#define PEAK_FILE_VERSION           (1u)
+#define PEAK_TEMP_FILENAME          "peak.tmp"  /* Written here, renamed when complete */
+#define PEAK_BASE_FRAMES            (256u)      /* Finest level: 16 ms at 16 kHz */
+#define PEAK_LEVEL_FACTOR           (8u)        /* Each level is 8x coarser than the one below */
+#define PEAK_NUM_LEVELS             (3u)
+#define PEAK_MAX_CHANNELS           (2u)
+#define PEAK_MAX_ENTRIES            (512u)      /* Finest level entries; resolution halves past this */
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+/* Range of one channel over one block of frames */
+typedef struct __attribute__((packed)) {
+    int16_t min;
+    int16_t max;
+} peak_entry_t;
+
+/* One zoom level; entries are num_channels peak_entry_t each */
+typedef struct __attribute__((packed)) {
+    uint32_t frames_per_entry;      /* Last entry may cover fewer */
+    uint32_t num_entries;
+    uint32_t offset;                /* File offset of the first entry */
+} peak_level_t;
+
+/* File header, little endian, followed by the levels finest first */
+typedef struct __attribute__((packed)) {
+    char     magic[4];              /* "PEAK" */
+    uint16_t version;
+    uint16_t num_channels;
+    uint32_t sample_rate;
+    uint32_t frames;                /* Audio frames covered, equals the WAV data length */
+    uint32_t wav_size;              /* Size of the WAV file the peaks describe */
+    uint16_t num_levels;
+    uint16_t entry_size;            /* Bytes per entry: num_channels * 4 */
+    peak_level_t level[PEAK_NUM_LEVELS];
+    uint32_t crc;                   /* CRC-32 of the header before this field and all entries */
+} peak_file_header_t;
+
+/* Finest level, folded in as samples arrive */
+typedef struct {
+    uint16_t num_channels;
+    uint32_t sample_rate;
+    uint32_t frames;                /* Frames folded in so far */
+    uint32_t frames_per_entry;      /* Doubles each time entries[] fills up */
+    uint32_t num_entries;           /* Complete entries */
+    uint32_t partial_frames;        /* Frames in partial[] */
+    peak_entry_t partial[PEAK_MAX_CHANNELS];
+    peak_entry_t entries[PEAK_MAX_ENTRIES][PEAK_MAX_CHANNELS];
+} peak_builder_t;
+
+/*******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+void peak_builder_reset(peak_builder_t *builder, uint16_t num_channels, uint32_t sample_rate);
+void peak_builder_update(peak_builder_t *builder, const int16_t *pcm, uint32_t num_samples);
+int peak_file_name(const char *wav_name, char *peak_name, size_t size);
+int peak_file_write(const char *wav_name, const peak_builder_t *builder);
+int peak_file_check(const char *wav_name, peak_file_header_t *header);
+int peak_file_rebuild(const char *wav_name, peak_builder_t *builder);
+int peak_file_read_entry(FS_FILE *file, const peak_file_header_t *header, uint32_t level,
+                         uint32_t index, peak_entry_t *entry);
+void peak_file_remove(const char *wav_name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PEAK_FILE_H__ */
@@ -0,0 +1,446 @@
+/******************************************************************************
+* File Name: playback_dsp.c
+*
+* Description: Equalizer, loudness normalizer and limiter on the playback path
+*              Samples enter as Q15 times the preamp, shifted down so full
+*              scale is 2^28: the bands run on int32 with 18 dB of headroom
+*              and nothing is rounded between them. The normalizer gain is
+*              Q24. The limiter works in float on a linked-stereo peak
+*              envelope with instant attack, so no sample exceeds the
+*              ceiling and no look-ahead delay is needed; its soft knee
+*              approaches the ceiling as u / (1 + u) above the knee.
+*              Settings are designed in task context and copied into the
+*              chain the ISR runs inside a critical section.
+*
+*******************************************************************************/
+
+#include "playback_dsp.h"
+#include "loudness.h"
+#include "audio_ramfunc.h"
+#include "app_i2s.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "cy_pdl.h"
+#include <math.h>
+#include <string.h>
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define PLAYBACK_DSP_CHANNELS       (2u)
+#define PLAYBACK_DSP_BLOCK_FRAMES   (HW_FIFO_HALF_SIZE / 2u)    /* One I2S refill */
+#define PLAYBACK_DSP_UNITY_PREAMP   (32768)                     /* Q15 */
+#define PLAYBACK_DSP_INPUT_SHIFT    (2u)                        /* Q15 x Q15 down to 2^28 */
+#define PLAYBACK_DSP_OUTPUT_SHIFT   (13u)                       /* 2^28 back to 16 bits */
+#define PLAYBACK_DSP_FULL_SCALE     (268435456.0f)              /* 2^28 */
+#define PLAYBACK_DSP_GAIN_SHIFT     (24u)
+#define PLAYBACK_DSP_UNITY_GAIN     (1 << PLAYBACK_DSP_GAIN_SHIFT)
+#define PLAYBACK_DSP_GRID_POINTS    (48u)       /* Log spaced, where the curve's peak is searched */
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+/* What the ISR runs; changed only inside a critical section */
+typedef struct {
+    bool active;
+    uint8_t enabled;            /* Bit per band */
+    biquad_t band[PLAYBACK_DSP_MAX_BANDS];
+    int32_t preamp;             /* Q15 */
+    int32_t gain;               /* Q24 */
+    bool limit;
+    float ceiling;              /* Linear, 1.0 at full scale */
+    float knee;
+    float release;              /* Envelope decay per frame */
+    float envelope;
+    float min_gain;             /* Deepest limiter gain this play */
+    uint32_t clipped;
+    uint32_t refills;
+    uint32_t max_cycles;
+    uint32_t budget_cycles;
+    uint32_t over_budget;
+} playback_dsp_chain_t;
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static playback_dsp_config_t dsp_config = {
+    .normalize = false,
+    .target_lu = PLAYBACK_DSP_DEFAULT_TARGET_LU,
+    .limit = false,
+    .ceiling_db = PLAYBACK_DSP_DEFAULT_CEILING_DB
+};
+static playback_dsp_chain_t dsp_chain;          /* Run by the I2S ISR */
+static biquad_t dsp_staging[PLAYBACK_DSP_MAX_BANDS];
+static float dsp_preamp_db;
+static float dsp_loudness = LOUDNESS_UNKNOWN;
+
+static const char *const dsp_type_names[] = {
+    "peak", "lowshelf", "highshelf", "lowpass", "highpass"
+};
+
+/*******************************************************************************
+* Function Name: playback_dsp_gain
+********************************************************************************
+* Summary:
+*  Normalizer gain in dB for a file's loudness, within the gain limits; 0 if
+*  normalizing is off or the loudness is unknown
+*
+*******************************************************************************/
+static float playback_dsp_gain(const playback_dsp_config_t *config, float loudness)
+{
+    float gain_db;
+
+    if (!config->normalize || (loudness <= LOUDNESS_UNKNOWN)) {
+        return 0.0f;
+    }
+    gain_db = -(float)config->target_lu - loudness;
+    if (gain_db > PLAYBACK_DSP_MAX_BOOST_DB) {
+        gain_db = PLAYBACK_DSP_MAX_BOOST_DB;
+    } else if (gain_db < -PLAYBACK_DSP_MAX_CUT_DB) {
+        gain_db = -PLAYBACK_DSP_MAX_CUT_DB;
+    }
+    return gain_db;
+}
+
+/*******************************************************************************
+* Function Name: playback_dsp_gain_q24
+********************************************************************************
+* Summary:
+*  The normalizer gain as the ISR applies it
+*
+*******************************************************************************/
+static int32_t playback_dsp_gain_q24(float gain_db)
+{
+    return (int32_t)lrintf(powf(10.0f, gain_db / 20.0f) * (float)PLAYBACK_DSP_UNITY_GAIN);
+}
+
+/*******************************************************************************
+* Function Name: playback_dsp_curve_peak
+********************************************************************************
+* Summary:
+*  Largest boost of the cascaded bands, searched on a log frequency grid and
+*  at each band's own frequency; 0 dB if the curve only cuts
+*
+*******************************************************************************/
+static float playback_dsp_curve_peak(const playback_dsp_config_t *config)
+{
+    const float low = (float)BIQUAD_MIN_HZ;
+    const float high = 0.45f * (float)SAMPLE_RATE_HZ;
+    float peak = 0.0f;
+
+    for (uint32_t i = 0; i < PLAYBACK_DSP_GRID_POINTS + PLAYBACK_DSP_MAX_BANDS; i++) {
+        float freq;
+        float sum = 0.0f;
+
+        if (i < PLAYBACK_DSP_GRID_POINTS) {
+            freq = low * powf(high / low, (float)i / (float)(PLAYBACK_DSP_GRID_POINTS - 1u));
+        } else if (config->band[i - PLAYBACK_DSP_GRID_POINTS].enabled) {
+            freq = (float)config->band[i - PLAYBACK_DSP_GRID_POINTS].freq_hz;
+        } else {
+            continue;
+        }
+        for (uint32_t b = 0; b < PLAYBACK_DSP_MAX_BANDS; b++) {
+            if (config->band[b].enabled) {
+                sum += biquad_response_db(&dsp_staging[b], freq, SAMPLE_RATE_HZ);
+            }
+        }
+        if (sum > peak) {
+            peak = sum;
+        }
+    }
+    return peak;
+}
+
+/*******************************************************************************
+* Function Name: playback_dsp_set_config
+********************************************************************************
+* Summary:
+*  Check and apply new settings; they take effect from the next refill, also
+*  during playback
+*  - A band that stays enabled keeps its history, so changing it does not click
+*  - The preamp is recomputed from the whole curve
+*
+* Parameters:
+*  config: New settings
+*
+* Return:
+*  0 on success, -1 if a band cannot be designed or a level is out of range
+*
+*******************************************************************************/
+int playback_dsp_set_config(const playback_dsp_config_t *config)
+{
+    float peak_db;
+    float ceiling;
+    float release;
+    int32_t preamp;
+    uint8_t enabled = 0;
+
+    if ((config->target_lu < PLAYBACK_DSP_MIN_TARGET_LU) ||
+        (config->target_lu > PLAYBACK_DSP_MAX_TARGET_LU) ||
+        (config->ceiling_db > PLAYBACK_DSP_MAX_CEILING_DB)) {
+        return -1;
+    }
+    for (uint32_t b = 0; b < PLAYBACK_DSP_MAX_BANDS; b++) {
+        const playback_dsp_band_t *band = &config->band[b];
+
+        if (!band->enabled) {
+            continue;
+        }
+        if (biquad_design(&dsp_staging[b], band->type, band->freq_hz, (float)band->gain_db,
+                          (float)band->q_x100 / 100.0f, SAMPLE_RATE_HZ,
+                          PLAYBACK_DSP_CHANNELS) != 0) {
+            return -1;
+        }
+        enabled |= (uint8_t)(1u << b);
+    }
+
+    peak_db = playback_dsp_curve_peak(config);
+    preamp = (int32_t)lrintf(powf(10.0f, -peak_db / 20.0f) * (float)PLAYBACK_DSP_UNITY_PREAMP);
+    ceiling = powf(10.0f, -(float)config->ceiling_db / 20.0f);
+    release = expf(-1000.0f / ((float)PLAYBACK_DSP_RELEASE_MS * (float)SAMPLE_RATE_HZ));
+
+    taskENTER_CRITICAL();
+    for (uint32_t b = 0; b < PLAYBACK_DSP_MAX_BANDS; b++) {
+        biquad_t *live = &dsp_chain.band[b];
+
+        if ((enabled & (1u << b)) == 0u) {
+            continue;
+        }
+        live->b0 = dsp_staging[b].b0;
+        live->b1 = dsp_staging[b].b1;
+        live->b2 = dsp_staging[b].b2;
+        live->a1 = dsp_staging[b].a1;
+        live->a2 = dsp_staging[b].a2;
+        live->num_channels = PLAYBACK_DSP_CHANNELS;
+        if ((dsp_chain.enabled & (1u << b)) == 0u) {
+            biquad_reset(live);
+        }
+    }
+    dsp_chain.enabled = enabled;
+    dsp_chain.preamp = preamp;
+    dsp_chain.gain = playback_dsp_gain_q24(playback_dsp_gain(config, dsp_loudness));
+    dsp_chain.limit = config->limit;
+    dsp_chain.ceiling = ceiling;
+    dsp_chain.knee = ceiling * powf(10.0f, -PLAYBACK_DSP_KNEE_DB / 20.0f);
+    dsp_chain.release = release;
+    dsp_chain.active = (enabled != 0u) || config->normalize || config->limit;
+    dsp_config = *config;
+    dsp_preamp_db = -peak_db;
+    taskEXIT_CRITICAL();
+
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: playback_dsp_get_config
+********************************************************************************
+* Summary:
+*  Copy the current settings, e.g. to change one of them
+*
+*******************************************************************************/
+void playback_dsp_get_config(playback_dsp_config_t *config)
+{
+    taskENTER_CRITICAL();
+    *config = dsp_config;
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+* Function Name: playback_dsp_begin
+********************************************************************************
+* Summary:
+*  Start a play: clear the filter history, the limiter and the counters, and
+*  set the normalizer gain for this file. Called by PlaybackTask before the
+*  stream is enabled.
+*
+* Parameters:
+*  loudness: Integrated loudness of the file, LUFS, or LOUDNESS_UNKNOWN
+*
+*******************************************************************************/
+void playback_dsp_begin(float loudness)
+{
+    uint32_t budget = (uint32_t)(((uint64_t)SystemCoreClock * PLAYBACK_DSP_BLOCK_FRAMES *
+                                  PLAYBACK_DSP_BUDGET_PERCENT) / (SAMPLE_RATE_HZ * 100u));
+
+    taskENTER_CRITICAL();
+    for (uint32_t b = 0; b < PLAYBACK_DSP_MAX_BANDS; b++) {
+        biquad_reset(&dsp_chain.band[b]);
+    }
+    dsp_loudness = loudness;
+    dsp_chain.gain = playback_dsp_gain_q24(playback_dsp_gain(&dsp_config, loudness));
+    dsp_chain.envelope = 0.0f;
+    dsp_chain.min_gain = 1.0f;
+    dsp_chain.clipped = 0;
+    dsp_chain.refills = 0;
+    dsp_chain.max_cycles = 0;
+    dsp_chain.budget_cycles = budget;
+    dsp_chain.over_budget = 0;
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+* Function Name: playback_dsp_process
+********************************************************************************
+* Summary:
+*  Run the chain on one refill, in place; the I2S stream's process hook
+*  - Timed with the DWT cycle counter when it is running ('bench' starts it)
+*
+* Parameters:
+*  context: Unused
+*  samples: Interleaved L/R
+*  frames: At most one refill (HW_FIFO_HALF_SIZE / 2)
+*
+*******************************************************************************/
+AUDIO_RAMFUNC_BEGIN
+void playback_dsp_process(void *context, int16_t *samples, uint32_t frames)
+{
+    playback_dsp_chain_t *chain = &dsp_chain;
+    int32_t block[PLAYBACK_DSP_BLOCK_FRAMES * PLAYBACK_DSP_CHANNELS];
+    bool timed;
+    uint32_t start;
+    uint32_t count;
+
+    (void)context;
+    if (!chain->active) {
+        return;
+    }
+    timed = ((DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk) != 0u);
+    start = DWT->CYCCNT;
+    if (frames > PLAYBACK_DSP_BLOCK_FRAMES) {
+        frames = PLAYBACK_DSP_BLOCK_FRAMES;
+    }
+    count = frames * PLAYBACK_DSP_CHANNELS;
+
+    for (uint32_t i = 0; i < count; i++) {
+        block[i] = ((int32_t)samples[i] * chain->preamp) >> PLAYBACK_DSP_INPUT_SHIFT;
+    }
+
+    for (uint32_t b = 0; b < PLAYBACK_DSP_MAX_BANDS; b++) {
+        if ((chain->enabled & (1u << b)) != 0u) {
+            biquad_process_q31(&chain->band[b], block, frames);
+        }
+    }
+
+    if (chain->gain != PLAYBACK_DSP_UNITY_GAIN) {
+        for (uint32_t i = 0; i < count; i++) {
+            int64_t value = ((int64_t)block[i] * chain->gain) >> PLAYBACK_DSP_GAIN_SHIFT;
+
+            if (value > INT32_MAX) {
+                value = INT32_MAX;
+            } else if (value < INT32_MIN) {
+                value = INT32_MIN;
+            }
+            block[i] = (int32_t)value;
+        }
+    }
+
+    if (chain->limit) {
+        const float scale = 1.0f / PLAYBACK_DSP_FULL_SCALE;
+        const float knee = chain->knee;
+        const float width = chain->ceiling - knee;
+        float envelope = chain->envelope;
+
+        for (uint32_t i = 0; i < count; i += PLAYBACK_DSP_CHANNELS) {
+            float left = (float)block[i] * scale;
+            float right = (float)block[i + 1u] * scale;
+            float peak = fmaxf(fabsf(left), fabsf(right));
+
+            envelope *= chain->release;
+            if (peak > envelope) {
+                envelope = peak;
+            }
+            if (envelope > knee) {
+                /* Output level knee + width * d / (width + d), d = envelope - knee */
+                float over = envelope - knee;
+                float gain = (knee * (width + over) + width * over) / (envelope * (width + over));
+
+                left *= gain;
+                right *= gain;
+                if (gain < chain->min_gain) {
+                    chain->min_gain = gain;
+                }
+            }
+            block[i] = (int32_t)lrintf(left * PLAYBACK_DSP_FULL_SCALE);
+            block[i + 1u] = (int32_t)lrintf(right * PLAYBACK_DSP_FULL_SCALE);
+        }
+        chain->envelope = envelope;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        int32_t value = (int32_t)(((int64_t)block[i] + (1 << (PLAYBACK_DSP_OUTPUT_SHIFT - 1u))) >>
+                                  PLAYBACK_DSP_OUTPUT_SHIFT);
+
+        if (value > INT16_MAX) {
+            value = INT16_MAX;
+            chain->clipped++;
+        } else if (value < INT16_MIN) {
+            value = INT16_MIN;
+            chain->clipped++;
+        }
+        samples[i] = (int16_t)value;
+    }
+
+    chain->refills++;
+    if (timed) {
+        uint32_t cycles = DWT->CYCCNT - start;
+
+        if (cycles > chain->max_cycles) {
+            chain->max_cycles = cycles;
+        }
+        if (cycles > chain->budget_cycles) {
+            chain->over_budget++;
+        }
+    }
+}
+AUDIO_RAMFUNC_END
+
+/*******************************************************************************
+* Function Name: playback_dsp_get_status
+********************************************************************************
+* Summary:
+*  Read the chain's settings summary and the counters of the current or last
+*  play
+*
+*******************************************************************************/
+void playback_dsp_get_status(playback_dsp_status_t *status)
+{
+    uint8_t enabled;
+    float min_gain;
+
+    taskENTER_CRITICAL();
+    status->active = dsp_chain.active;
+    enabled = dsp_chain.enabled;
+    status->preamp_db = dsp_preamp_db;
+    status->loudness = dsp_loudness;
+    status->gain_db = playback_dsp_gain(&dsp_config, dsp_loudness);
+    min_gain = dsp_chain.min_gain;
+    status->clipped = dsp_chain.clipped;
+    status->refills = dsp_chain.refills;
+    status->max_cycles = dsp_chain.max_cycles;
+    status->budget_cycles = dsp_chain.budget_cycles;
+    status->over_budget = dsp_chain.over_budget;
+    taskEXIT_CRITICAL();
+
+    status->bands = 0;
+    for (uint32_t b = 0; b < PLAYBACK_DSP_MAX_BANDS; b++) {
+        if ((enabled & (1u << b)) != 0u) {
+            status->bands++;
+        }
+    }
+    status->reduction_db = ((min_gain > 0.0f) && (min_gain < 1.0f)) ? -20.0f * log10f(min_gain) : 0.0f;
+}
+
+/*******************************************************************************
+* Function Name: playback_dsp_type_name
+********************************************************************************
+* Summary:
+*  Name of a band type, as the 'eq' command takes it
+*
+*******************************************************************************/
+const char *playback_dsp_type_name(biquad_type_t type)
+{
+    if ((uint32_t)type >= (sizeof(dsp_type_names) / sizeof(dsp_type_names[0]))) {
+        return "?";
+    }
+    return dsp_type_names[type];
+}
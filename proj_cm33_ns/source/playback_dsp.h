@@ -0,0 +1,90 @@
+/******************************************************************************
+* File Name: playback_dsp.h
+*
+* Description: Equalizer, loudness normalizer and limiter on the playback path
+*              Runs from the I2S refill interrupt on each block of 32 frames
+*              just before it goes to the FIFO. Up to PLAYBACK_DSP_MAX_BANDS
+*              biquads are cascaded on 32-bit values with 3 bits of headroom,
+*              after a preamp that takes out the largest boost of the
+*              equalizer curve; the normalizer applies one gain per file, from
+*              the file's integrated loudness, and a soft-knee peak limiter
+*              keeps the result under the ceiling. With everything off the
+*              samples pass through untouched.
+*
+*******************************************************************************/
+
+#ifndef __PLAYBACK_DSP_H__
+#define __PLAYBACK_DSP_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "biquad.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define PLAYBACK_DSP_MAX_BANDS          (8u)
+#define PLAYBACK_DSP_DEFAULT_Q_X100     (71u)       /* Q of 0.71; the slope of a shelf */
+#define PLAYBACK_DSP_DEFAULT_TARGET_LU  (16u)       /* -16 LUFS */
+#define PLAYBACK_DSP_MIN_TARGET_LU      (10u)
+#define PLAYBACK_DSP_MAX_TARGET_LU      (40u)
+#define PLAYBACK_DSP_MAX_BOOST_DB       (12.0f)     /* Normalizer gain limits */
+#define PLAYBACK_DSP_MAX_CUT_DB         (24.0f)
+#define PLAYBACK_DSP_DEFAULT_CEILING_DB (1u)        /* Limiter output peak, below full scale */
+#define PLAYBACK_DSP_MAX_CEILING_DB     (20u)
+#define PLAYBACK_DSP_KNEE_DB            (6.0f)      /* Limiting starts this far below the ceiling */
+#define PLAYBACK_DSP_RELEASE_MS         (50u)
+#define PLAYBACK_DSP_BUDGET_PERCENT     (10u)       /* Of one refill period, per refill */
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+typedef struct {
+    bool enabled;
+    biquad_type_t type;
+    uint16_t freq_hz;
+    int8_t gain_db;             /* Peak and shelves, +/-BIQUAD_MAX_GAIN_DB */
+    uint16_t q_x100;            /* Q, or a shelf's slope, times 100 */
+} playback_dsp_band_t;
+
+typedef struct {
+    playback_dsp_band_t band[PLAYBACK_DSP_MAX_BANDS];
+    bool normalize;
+    uint8_t target_lu;          /* Normalized loudness, LU below full scale */
+    bool limit;
+    uint8_t ceiling_db;         /* Limiter ceiling below full scale */
+} playback_dsp_config_t;
+
+typedef struct {
+    bool active;                /* Anything to do; false passes samples through */
+    uint8_t bands;              /* Enabled */
+    float preamp_db;            /* Taken off before the bands: minus the curve's peak */
+    float loudness;             /* Of the file playing, LUFS; LOUDNESS_UNKNOWN if not measured */
+    float gain_db;              /* Normalizer gain for that file */
+    float reduction_db;         /* Deepest limiter gain reduction this play */
+    uint32_t clipped;           /* Samples clamped to 16 bits this play */
+    uint32_t refills;           /* Processed this play */
+    uint32_t max_cycles;        /* Longest refill, 0 without the DWT cycle counter */
+    uint32_t budget_cycles;     /* PLAYBACK_DSP_BUDGET_PERCENT of a refill period */
+    uint32_t over_budget;       /* Refills that took longer */
+} playback_dsp_status_t;
+
+/*******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+int playback_dsp_set_config(const playback_dsp_config_t *config);
+void playback_dsp_get_config(playback_dsp_config_t *config);
+void playback_dsp_begin(float loudness);
+void playback_dsp_process(void *context, int16_t *samples, uint32_t frames);
+void playback_dsp_get_status(playback_dsp_status_t *status);
+const char *playback_dsp_type_name(biquad_type_t type);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PLAYBACK_DSP_H__ */
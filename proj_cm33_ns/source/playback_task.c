@@ -2,7 +2,11 @@
 * File Name: playback_task.c
 *
 * Description: WAV file playback task implementation
-*              Receives PCM chunks from FileReadTask and streams to I2S
+*              Receives PCM chunks from FileReadTask, or a whole clip from
+*              RAM ('replay', cached files), and streams them to I2S; a test
+*              signal ('gen') is rendered by the I2S ISR itself; the
+*              playback DSP chain and the output ramp run on every refill
+*              of all of them
 *
 *******************************************************************************/
 
@@ -10,6 +14,11 @@
 #include "file_read_task.h"
 #include "wav_file.h"
 #include "app_i2s.h"
+#include "playback_dsp.h"
+#include "output_ctrl.h"
+#include "tdm_slots.h"
+#include "audio_ramfunc.h"
+#include "freertos_setup.h"
 #include <stdio.h>
 #include <string.h>
 
@@ -19,21 +28,169 @@
 QueueHandle_t playback_queue = NULL;
 TaskHandle_t playback_task_handle = NULL;
 
-/* Playback state variables (shared with I2S ISR) */
-volatile int16_t *playback_buffer_ptr = NULL;
-volatile uint32_t playback_samples_remaining = 0;
+/* True from the first chunk of a file until its last sample is sent */
 volatile bool playback_active = false;
 
+/* Set by 'stop' once the output has faded out: the rest of the play is
+ * dropped. Cleared when the session has ended. */
+volatile bool playback_stop_requested = false;
+
 /*******************************************************************************
 * Local Variables
 *******************************************************************************/
-/* Ping-pong buffers removed - using recorded_data buffer directly */
+/* Playback session: the I2S stream and the buffers it holds, either
+ * FileReadTask's or one clip in RAM owned elsewhere */
+typedef struct {
+    app_i2s_stream_t stream;    /* Read by the I2S ISR */
+    uint32_t buffers_queued;
+    uint32_t buffers_released;  /* Given back through buffer_free_sem */
+    uint32_t samples;
+    void (*release)(void *owner);   /* RAM clip: called instead of giving buffer_free_sem */
+    void *owner;
+} playback_session_t;
+
+static playback_session_t playback_session;
+
+/*******************************************************************************
+* Function Name: playback_release_buffers
+********************************************************************************
+* Summary:
+*  Hand the buffers the ISR has finished with back to FileReadTask, or a
+*  RAM clip back to its owner
+*
+*******************************************************************************/
+static void playback_release_buffers(playback_session_t *session)
+{
+    while (session->buffers_released != session->stream.buffers_done) {
+        session->buffers_released++;
+        if (session->release != NULL) {
+            session->release(session->owner);
+            session->release = NULL;
+        } else {
+            xSemaphoreGive(buffer_free_sem);
+        }
+    }
+}
+
+/*******************************************************************************
+* Function Name: playback_drop_chunk
+********************************************************************************
+* Summary:
+*  Give back a chunk that is not played
+*
+*******************************************************************************/
+static void playback_drop_chunk(const pcm_playback_msg_t *pcm_msg)
+{
+    if (pcm_msg->release != NULL) {
+        pcm_msg->release(pcm_msg->owner);
+    } else if (pcm_msg->buffer_ptr != NULL) {
+        xSemaphoreGive(buffer_free_sem);
+    }
+}
+
+/*******************************************************************************
+* Function Name: playback_process
+********************************************************************************
+* Summary:
+*  The I2S stream's process hook: DSP chain, then the fade and mute ramp,
+*  which also fades out the end of the file or clip
+*
+*******************************************************************************/
+AUDIO_RAMFUNC_BEGIN
+static void playback_process(void *context, int16_t *samples, uint32_t frames)
+{
+    playback_dsp_process(context, samples, frames);
+    output_ctrl_process(samples, frames,
+                        app_i2s_stream_frames_left(&playback_session.stream));
+}
+AUDIO_RAMFUNC_END
+
+/*******************************************************************************
+* Function Name: playback_start
+********************************************************************************
+* Summary:
+*  Enable the I2S transmitter on a cleared stream; playback_task() activates
+*  it once the first buffer is queued
+*  - The DSP chain starts over with the normalizer gain for this loudness
+*  - The output fades in from silence
+*  - The TDM slot map is taken from the settings
+*
+*******************************************************************************/
+static void playback_start(playback_session_t *session, float loudness)
+{
+    memset(session, 0, sizeof(*session));
+    if (tdm_slots_begin() != 0) {
+        printf("[Playback] TDM slot count not supported, keeping the last map\r\n");
+    }
+    playback_dsp_begin(loudness);
+    output_ctrl_begin();
+    session->stream.process = playback_process;
+    app_i2s_set_stream(&session->stream);
+    app_i2s_enable();
+    playback_active = true;
+}
+
+/*******************************************************************************
+* Function Name: playback_stop
+********************************************************************************
+* Summary:
+*  Wait for the queued samples to be sent, then stop the transmitter and
+*  end the session. Once the stream is marked as ending, the output ramp
+*  fades out its last OUTPUT_RAMP_MS. The last refill is given one more
+*  PLAYBACK_POLL_MS to leave the FIFO before the transmitter stops.
+*  After 'stop' the output is already silent; the samples still queued are
+*  not sent.
+*
+* Return:
+*  True if the play was stopped before its end
+*
+*******************************************************************************/
+static bool playback_stop(playback_session_t *session)
+{
+    bool cut = false;
+    
+    session->stream.ending = true;
+    while (session->stream.buffers_done != session->buffers_queued) {
+        if (playback_stop_requested) {
+            cut = true;
+            break;
+        }
+        playback_release_buffers(session);
+        vTaskDelay(pdMS_TO_TICKS(PLAYBACK_POLL_MS));
+    }
+    if (!cut) {
+        vTaskDelay(pdMS_TO_TICKS(PLAYBACK_POLL_MS));
+    }
+    
+    app_i2s_deactivate();
+    app_i2s_disable();
+    app_i2s_set_stream(NULL);
+    /* The ISR is off: buffers it did not get to are free again */
+    session->stream.buffers_done = session->buffers_queued;
+    playback_release_buffers(session);
+    output_ctrl_end();
+    playback_active = false;
+    return cut;
+}
 
 /*******************************************************************************
 * Function Name: playback_task
 ********************************************************************************
 * Summary:
 *  Playback task - receives PCM chunks from FileReadTask and streams to I2S
+*  - Each chunk is queued behind the one being sent, so the ISR moves from
+*    buffer to buffer without a gap
+*  - A chunk's buffer goes back to FileReadTask once the ISR has sent it;
+*    while a file plays, the task wakes every PLAYBACK_POLL_MS for this even
+*    when no chunk arrives, since FileReadTask cannot send the next chunk
+*    before it has a buffer
+*  - A clip from RAM comes as one last chunk; it is released to its owner
+*    once the ISR has sent it
+*  - A test signal also comes as one last chunk, with a render function
+*    instead of samples; the ISR renders it into each FIFO refill
+*  - A last chunk without samples ends a file that could not be read, or
+*    one that 'stop' ended early; until then, chunks that arrive after the
+*    stop are dropped
 *
 * Parameters:
 *  pvParameters: Task parameters (unused)
@@ -45,7 +202,10 @@ volatile bool playback_active = false;
 void playback_task(void *pvParameters)
 {
     (void)pvParameters;
+    playback_session_t *session = &playback_session;
     pcm_playback_msg_t pcm_msg;
+    playback_dsp_status_t dsp_status;
+    bool queued;
     
     /* Add startup delay to prevent printf collision */
     vTaskDelay(pdMS_TO_TICKS(400));
@@ -53,39 +213,93 @@ void playback_task(void *pvParameters)
     printf("=== Playback Task Started ===\r\n");
     
     while (1) {
-        /* Wait for PCM chunk from FileReadTask */
-        if (xQueueReceive(pcm_playback_queue, &pcm_msg, portMAX_DELAY) != pdTRUE) {
+        /* Wait for PCM chunk from FileReadTask, or a clip in RAM */
+        if (xQueueReceive(pcm_playback_queue, &pcm_msg,
+                          playback_active ? pdMS_TO_TICKS(PLAYBACK_POLL_MS) : portMAX_DELAY) != pdTRUE) {
+            playback_release_buffers(session);
             continue;
         }
         
-        printf("[PlaybackTask] Received %u samples%s\r\n",
-               (unsigned int)pcm_msg.sample_count,
-               pcm_msg.is_last_chunk ? " (LAST)" : "");
-        
-        /* Set up I2S playback for this chunk */
-        taskENTER_CRITICAL();
-        playback_buffer_ptr = pcm_msg.buffer_ptr;
-        playback_samples_remaining = pcm_msg.sample_count;
-        playback_active = true;
-        taskEXIT_CRITICAL();
-        
-        /* Wait for I2S ISR to finish consuming this chunk */
-        while (playback_samples_remaining > 0 && playback_active) {
-            vTaskDelay(pdMS_TO_TICKS(50));
+        queued = false;
+        if (((pcm_msg.sample_count >= 2u) || (pcm_msg.render != NULL)) &&
+            !playback_stop_requested) {
+            /* Start the I2S transmitter on the first chunk of a file */
+            if (!playback_active) {
+                playback_start(session, pcm_msg.loudness);
+            }
+            
+            /* Wait for the pending slot; the ISR frees it at a buffer boundary.
+             * A render source waits until the stream is empty. */
+            while (!playback_stop_requested) {
+                queued = (pcm_msg.render != NULL) ?
+                         app_i2s_stream_render(&session->stream, pcm_msg.render, pcm_msg.owner) :
+                         app_i2s_stream_queue(&session->stream, pcm_msg.buffer_ptr,
+                                              pcm_msg.sample_count);
+                if (queued) {
+                    break;
+                }
+                playback_release_buffers(session);
+                vTaskDelay(pdMS_TO_TICKS(PLAYBACK_POLL_MS));
+            }
         }
+        if (queued) {
+            if (pcm_msg.release != NULL) {
+                session->release = pcm_msg.release;
+                session->owner = pcm_msg.owner;
+            }
+            session->buffers_queued++;
+            session->samples += pcm_msg.sample_count;
+            if (session->buffers_queued == 1u) {
+                app_i2s_activate();
+            }
+        } else {
+            /* Too short to send, or stopped; the buffer is free again right away */
+            playback_drop_chunk(&pcm_msg);
+        }
+        playback_release_buffers(session);
         
-        /* Check if this was the last chunk */
         if (pcm_msg.is_last_chunk) {
-            taskENTER_CRITICAL();
-            playback_active = false;
-            playback_buffer_ptr = NULL;
-            taskEXIT_CRITICAL();
-            
-            printf("[PlaybackTask] Playback complete\r\n");
+            if (playback_active) {
+                bool cut = playback_stop(session);
+                printf("[PlaybackTask] Playback %s: %u samples, %u starved refills, "
+                       "%u FIFO underflows\r\n",
+                       cut ? "stopped" : "complete",
+                       (unsigned int)session->samples,
+                       (unsigned int)session->stream.starved_refills,
+                       (unsigned int)session->stream.fifo_underflows);
+                playback_dsp_get_status(&dsp_status);
+                if (dsp_status.active) {
+                    printf("[PlaybackTask] DSP: %+.1f dB gain, %.1f dB limited, %u clipped, "
+                           "max %u cycles per refill\r\n",
+                           (double)dsp_status.gain_db, (double)dsp_status.reduction_db,
+                           (unsigned int)dsp_status.clipped, (unsigned int)dsp_status.max_cycles);
+                }
+            }
+            playback_stop_requested = false;
+            xEventGroupClearBits(audio_state_events, EVENT_PLAYING);
+            xEventGroupSetBits(audio_state_events, EVENT_PLAYBACK_DONE);
         }
     }
 }
 
+/*******************************************************************************
+* Function Name: playback_get_status
+********************************************************************************
+* Summary:
+*  Read the counters of the current or last playback session
+*
+* Parameters:
+*  status: Output
+*
+*******************************************************************************/
+void playback_get_status(playback_status_t *status)
+{
+    status->active = playback_active;
+    status->samples = playback_session.samples;
+    status->starved_refills = playback_session.stream.starved_refills;
+    status->fifo_underflows = playback_session.stream.fifo_underflows;
+}
+
 /*******************************************************************************
 * Function Name: playback_task_create
 ********************************************************************************
@@ -22,8 +22,9 @@ extern "C" {
 * Macros
 *******************************************************************************/
 #define PLAYBACK_TASK_STACK_SIZE    (2048u)
-#define PLAYBACK_TASK_PRIORITY      (3u)
+#define PLAYBACK_TASK_PRIORITY      (4u)     /* Above FileWriteTask, like FileReadTask */
 #define PLAYBACK_CHUNK_SIZE         (4096u)  /* Samples per buffer */
+#define PLAYBACK_POLL_MS            (10u)    /* Well inside one 128 ms chunk */
 
 /*******************************************************************************
 * Structures
@@ -32,20 +33,28 @@ typedef struct {
     char filename[32];
 } playback_msg_t;
 
+/* Counters of the current or last playback session */
+typedef struct {
+    bool active;
+    uint32_t samples;           /* Queued to the I2S stream */
+    uint32_t starved_refills;   /* FIFO refills with no PCM queued */
+    uint32_t fifo_underflows;
+} playback_status_t;
+
 /*******************************************************************************
 * Global Variables
 *******************************************************************************/
 extern QueueHandle_t playback_queue;
 extern TaskHandle_t playback_task_handle;
-extern volatile int16_t *playback_buffer_ptr;  /* Pointer for I2S ISR */
-extern volatile uint32_t playback_samples_remaining;
 extern volatile bool playback_active;
+extern volatile bool playback_stop_requested;
 
 /*******************************************************************************
 * Function Prototypes
 *******************************************************************************/
 void playback_task_create(void);
 void playback_task(void *pvParameters);
+void playback_get_status(playback_status_t *status);
 
 #ifdef __cplusplus
 }
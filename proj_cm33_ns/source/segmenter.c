@@ -0,0 +1,193 @@
+/******************************************************************************
+* File Name: segmenter.c
+*
+* Description: Silence trimming and splitting of recordings
+*              A segment opens at the first active block, reaching back by
+*              the pre-padding into the previous block. It closes once a
+*              silence of gap_ms has been seen, ending post_pad_ms after its
+*              last active block; post_pad_ms is limited to gap_ms so the end
+*              is always inside audio that has already been seen.
+*
+*******************************************************************************/
+
+#include "segmenter.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <math.h>
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static segment_config_t segment_config = {
+    .mode = SEGMENT_MODE_OFF,
+    .level_db = SEGMENT_DEFAULT_LEVEL_DB,
+    .gap_ms = SEGMENT_DEFAULT_GAP_MS,
+    .pre_pad_ms = SEGMENT_DEFAULT_PRE_PAD_MS,
+    .post_pad_ms = SEGMENT_DEFAULT_POST_PAD_MS,
+};
+
+/*******************************************************************************
+* Function Name: segment_config_get
+********************************************************************************
+* Summary:
+*  Copy the settings used for the next recording
+*
+*******************************************************************************/
+void segment_config_get(segment_config_t *config)
+{
+    taskENTER_CRITICAL();
+    *config = segment_config;
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+* Function Name: segment_config_set
+********************************************************************************
+* Summary:
+*  Change the settings used for the next recording
+*
+* Parameters:
+*  config: New settings; padding beyond its limits is clamped when applied
+*
+* Return:
+*  0 on success, -1 if a field is out of range
+*
+*******************************************************************************/
+int segment_config_set(const segment_config_t *config)
+{
+    if ((config->mode > SEGMENT_MODE_SPLIT) ||
+        (config->level_db == 0u) || (config->level_db > SEGMENT_MAX_LEVEL_DB) ||
+        (config->gap_ms == 0u)) {
+        return -1;
+    }
+
+    taskENTER_CRITICAL();
+    segment_config = *config;
+    taskEXIT_CRITICAL();
+
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: segmenter_init
+********************************************************************************
+* Summary:
+*  Prepare to segment one take
+*
+* Parameters:
+*  seg: Segmenter state
+*  config: Settings from segment_config_get()
+*  num_channels: Interleaved channels; any channel can make a block active
+*  sample_rate: Converts the millisecond settings to frames
+*
+*******************************************************************************/
+void segmenter_init(segmenter_t *seg, const segment_config_t *config,
+                    uint16_t num_channels, uint32_t sample_rate)
+{
+    float level = 32768.0f * powf(10.0f, -(float)config->level_db / 20.0f);
+
+    seg->num_channels = num_channels;
+    seg->threshold = (level >= 32767.0f) ? INT16_MAX : (int16_t)level;
+    seg->split = (config->mode == SEGMENT_MODE_SPLIT);
+    seg->gap_frames = (uint32_t)(((uint64_t)config->gap_ms * sample_rate) / 1000u);
+    seg->pre_frames = (uint32_t)(((uint64_t)config->pre_pad_ms * sample_rate) / 1000u);
+    seg->post_frames = (uint32_t)(((uint64_t)config->post_pad_ms * sample_rate) / 1000u);
+    if (seg->pre_frames > SEGMENT_BLOCK_FRAMES) {
+        seg->pre_frames = SEGMENT_BLOCK_FRAMES;
+    }
+    if (seg->split && (seg->post_frames > seg->gap_frames)) {
+        seg->post_frames = seg->gap_frames;
+    }
+    seg->position = 0;
+    seg->floor = 0;
+    seg->active = false;
+    seg->start = 0;
+    seg->active_end = 0;
+}
+
+/*******************************************************************************
+* Function Name: segmenter_close
+********************************************************************************
+* Summary:
+*  End the open segment after its post-padding
+*
+*******************************************************************************/
+static bool segmenter_close(segmenter_t *seg, segment_t *segment)
+{
+    uint32_t end = seg->active_end + seg->post_frames;
+
+    if (end > seg->position) {
+        end = seg->position;
+    }
+    segment->start = seg->start;
+    segment->frames = end - seg->start;
+    seg->floor = end;
+    seg->active = false;
+    return true;
+}
+
+/*******************************************************************************
+* Function Name: segmenter_process
+********************************************************************************
+* Summary:
+*  Classify the next block of a take
+*
+* Parameters:
+*  seg: Segmenter state
+*  pcm: Interleaved samples of the block
+*  frames: Block length, at most SEGMENT_BLOCK_FRAMES
+*  segment: Output - the segment that ended, when true is returned
+*
+* Return:
+*  true if a segment is complete
+*
+*******************************************************************************/
+bool segmenter_process(segmenter_t *seg, const int16_t *pcm, uint32_t frames, segment_t *segment)
+{
+    uint32_t block_start = seg->position;
+    uint32_t num_samples = frames * seg->num_channels;
+    int32_t threshold = seg->threshold;
+    bool loud = false;
+
+    for (uint32_t i = 0; i < num_samples; i++) {
+        int32_t sample = pcm[i];
+        if ((sample > threshold) || (sample < -threshold)) {
+            loud = true;
+            break;
+        }
+    }
+    seg->position += frames;
+
+    if (loud) {
+        if (!seg->active) {
+            uint32_t start = (block_start > seg->pre_frames) ? (block_start - seg->pre_frames) : 0u;
+            seg->start = (start > seg->floor) ? start : seg->floor;
+            seg->active = true;
+        }
+        seg->active_end = seg->position;
+        return false;
+    }
+
+    if (seg->active && seg->split && ((seg->position - seg->active_end) >= seg->gap_frames)) {
+        return segmenter_close(seg, segment);
+    }
+    return false;
+}
+
+/*******************************************************************************
+* Function Name: segmenter_finish
+********************************************************************************
+* Summary:
+*  End of the take: close the open segment, trimming trailing silence
+*
+* Return:
+*  true if a segment is complete
+*
+*******************************************************************************/
+bool segmenter_finish(segmenter_t *seg, segment_t *segment)
+{
+    if (!seg->active) {
+        return false;
+    }
+    return segmenter_close(seg, segment);
+}
@@ -0,0 +1,87 @@
+/******************************************************************************
+* File Name: segmenter.h
+*
+* Description: Silence trimming and splitting of recordings
+*              Classifies blocks of frames as active or silent by their peak
+*              level and reports the frame ranges worth saving. Blocks are
+*              handed over in order and only the previous block is looked
+*              back on, so the same code works on a take in RAM or on blocks
+*              streamed to the writer.
+*
+*******************************************************************************/
+
+#ifndef __SEGMENTER_H__
+#define __SEGMENTER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define SEGMENT_BLOCK_FRAMES        (1024u)     /* Decision granularity: 64 ms at 16 kHz */
+#define SEGMENT_DEFAULT_LEVEL_DB    (45u)       /* Active above -45 dBFS */
+#define SEGMENT_DEFAULT_GAP_MS      (1000u)
+#define SEGMENT_DEFAULT_PRE_PAD_MS  (64u)
+#define SEGMENT_DEFAULT_POST_PAD_MS (250u)
+#define SEGMENT_MAX_LEVEL_DB        (90u)
+
+/*******************************************************************************
+* Enumerations
+*******************************************************************************/
+typedef enum {
+    SEGMENT_MODE_OFF,           /* Save the whole take */
+    SEGMENT_MODE_TRIM,          /* Drop leading and trailing silence */
+    SEGMENT_MODE_SPLIT          /* Also start a new file at each long silence */
+} segment_mode_t;
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+typedef struct {
+    segment_mode_t mode;
+    uint32_t level_db;          /* Active when a sample exceeds -level_db dBFS */
+    uint32_t gap_ms;            /* SPLIT: silence that ends a segment */
+    uint32_t pre_pad_ms;        /* Kept before activity, at most one block */
+    uint32_t post_pad_ms;       /* Kept after activity, at most gap_ms */
+} segment_config_t;
+
+/* Range of a take to save */
+typedef struct {
+    uint32_t start;             /* First frame */
+    uint32_t frames;
+} segment_t;
+
+typedef struct {
+    uint16_t num_channels;
+    int16_t threshold;          /* Peak magnitude of an active block */
+    bool split;
+    uint32_t gap_frames;
+    uint32_t pre_frames;
+    uint32_t post_frames;
+    uint32_t position;          /* Frames seen so far */
+    uint32_t floor;             /* End of the last segment */
+    bool active;                /* Inside a segment */
+    uint32_t start;             /* Of the open segment */
+    uint32_t active_end;        /* End of its last active block */
+} segmenter_t;
+
+/*******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+void segment_config_get(segment_config_t *config);
+int segment_config_set(const segment_config_t *config);
+void segmenter_init(segmenter_t *seg, const segment_config_t *config,
+                    uint16_t num_channels, uint32_t sample_rate);
+bool segmenter_process(segmenter_t *seg, const int16_t *pcm, uint32_t frames, segment_t *segment);
+bool segmenter_finish(segmenter_t *seg, segment_t *segment);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SEGMENTER_H__ */
@@ -0,0 +1,585 @@
+/******************************************************************************
+* File Name: settings.c
+*
+* Description: Persistent configuration store
+*              The table below is the only list of parameters: the 'config'
+*              command, the file format and the defaults all come from it.
+*              Records are keyed by id, so a file saved by older firmware
+*              still loads; unknown ids are skipped and values that fail the
+*              current range check keep their default.
+*
+*******************************************************************************/
+
+#include "settings.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "app_pdm_pcm.h"
+#include "capture_pool.h"
+#include "wav_file.h"
+#include "file_read_task.h"
+#include "crc32.h"
+#include "output_ctrl.h"
+#include "tdm_slots.h"
+#include "FS.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+static void settings_apply_gain(void);
+static void settings_apply_settle(void);
+static void settings_apply_volume(void);
+static void settings_apply_route(void);
+
+/*******************************************************************************
+* Global Variables
+*******************************************************************************/
+settings_t app_settings = {
+    .mic_gain_db = PDM_MIC_GAIN_VALUE,
+    .file_prefix = SETTINGS_DEFAULT_PREFIX,
+    .take_ms = CAPTURE_POOL_DEFAULT_TAKE_MS,
+    .write_slice_bytes = WAV_WRITE_SLICE_BYTES,
+    .read_chunk_samples = PCM_CHUNK_SIZE,
+    .sample_rate = SAMPLE_RATE_HZ,
+    .num_channels = NUM_CHANNELS,
+    .volume_db = OUTPUT_DEFAULT_VOLUME_DB,
+    .route = OUTPUT_ROUTE_SPEAKER,
+    .tdm_map = TDM_DEFAULT_MAP,
+    .settle_frames = IGNORED_SAMPLES,
+};
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static const setting_desc_t settings_table[] = {
+    { "mic_gain", 1u, SETTING_INT, 0u, offsetof(settings_t, mic_gain_db),
+      (int32_t)PDM_PCM_MIN_GAIN, (int32_t)PDM_PCM_MAX_GAIN, 1, PDM_MIC_GAIN_VALUE, NULL,
+      "dB", settings_apply_gain, NULL },
+    { "file_prefix", 2u, SETTING_TEXT, 0u, offsetof(settings_t, file_prefix),
+      1, SETTINGS_PREFIX_SIZE - 1, 1, 0, SETTINGS_DEFAULT_PREFIX, "", NULL, NULL },
+    { "take_ms", 3u, SETTING_INT, SETTING_NEXT_SESSION, offsetof(settings_t, take_ms),
+      100, RECORDING_DURATION_SEC * 1000u, 1, CAPTURE_POOL_DEFAULT_TAKE_MS, NULL,
+      "ms", NULL, NULL },
+    { "write_slice", 4u, SETTING_INT, SETTING_NEXT_SESSION, offsetof(settings_t, write_slice_bytes),
+      WAV_DATA_ALIGN, WAV_WRITE_SLICE_BYTES, WAV_DATA_ALIGN, WAV_WRITE_SLICE_BYTES, NULL,
+      "bytes", NULL, NULL },
+    { "read_chunk", 5u, SETTING_INT, SETTING_NEXT_SESSION, offsetof(settings_t, read_chunk_samples),
+      SETTINGS_MIN_READ_CHUNK, PCM_CHUNK_SIZE, WAV_DATA_ALIGN / sizeof(int16_t), PCM_CHUNK_SIZE, NULL,
+      "samples", NULL, NULL },
+    { "sample_rate", 6u, SETTING_INT, SETTING_READ_ONLY, offsetof(settings_t, sample_rate),
+      SAMPLE_RATE_HZ, SAMPLE_RATE_HZ, 1, SAMPLE_RATE_HZ, NULL, "Hz", NULL, NULL },
+    { "channels", 7u, SETTING_INT, SETTING_READ_ONLY, offsetof(settings_t, num_channels),
+      NUM_CHANNELS, NUM_CHANNELS, 1, NUM_CHANNELS, NULL, "", NULL, NULL },
+    { "volume", 8u, SETTING_INT, 0u, offsetof(settings_t, volume_db),
+      OUTPUT_MIN_VOLUME_DB, OUTPUT_MAX_VOLUME_DB, 1, OUTPUT_DEFAULT_VOLUME_DB, NULL,
+      "dB", settings_apply_volume, NULL },
+    { "route", 9u, SETTING_INT, 0u, offsetof(settings_t, route),
+      0, OUTPUT_ROUTE_COUNT - 1, 1, OUTPUT_ROUTE_SPEAKER, NULL,
+      "(0 spk, 1 hp, 2 both)", settings_apply_route, NULL },
+    { "tdm_map", 10u, SETTING_TEXT, SETTING_NEXT_SESSION, offsetof(settings_t, tdm_map),
+      TDM_MIN_SLOTS, TDM_MAX_SLOTS, 1, 0, TDM_DEFAULT_MAP, "(L, R, M, - per slot)", NULL,
+      tdm_slots_check_map },
+    { "settle", 11u, SETTING_INT, SETTING_NEXT_SESSION, offsetof(settings_t, settle_frames),
+      0, PDM_PCM_MAX_SETTLE_FRAMES, 1, IGNORED_SAMPLES, NULL, "frames", settings_apply_settle,
+      NULL },
+};
+
+#define SETTINGS_TABLE_SIZE         (sizeof(settings_table) / sizeof(settings_table[0]))
+
+/* File image, built by save and parsed by load */
+static uint8_t settings_file_data[SETTINGS_FILE_MAX_BYTES] __attribute__((aligned(4)));
+
+/*******************************************************************************
+* Function Name: settings_apply_gain
+********************************************************************************
+* Summary:
+*  Program the PDM channel gain, rounded to the hardware's 6 dB steps
+*
+*******************************************************************************/
+static void settings_apply_gain(void)
+{
+    set_pdm_pcm_gain(convert_db_to_pdm_scale((double)app_settings.mic_gain_db));
+}
+
+/*******************************************************************************
+* Function Name: settings_apply_settle
+********************************************************************************
+* Summary:
+*  Set the frames the record task discards while the decimation filters
+*  settle, from the next take
+*
+*******************************************************************************/
+static void settings_apply_settle(void)
+{
+    app_pdm_pcm_set_settle((uint16_t)app_settings.settle_frames);
+}
+
+/*******************************************************************************
+* Function Name: settings_apply_volume / settings_apply_route
+********************************************************************************
+* Summary:
+*  Program the codec's playback volume or output route
+*
+*******************************************************************************/
+static void settings_apply_volume(void)
+{
+    (void)output_ctrl_set_volume(app_settings.volume_db);
+}
+
+static void settings_apply_route(void)
+{
+    (void)output_ctrl_set_route((output_route_t)app_settings.route);
+}
+
+/*******************************************************************************
+* Function Name: settings_field
+********************************************************************************
+* Summary:
+*  Locate a parameter's field in app_settings
+*
+*******************************************************************************/
+static void *settings_field(const setting_desc_t *desc)
+{
+    return (uint8_t *)&app_settings + desc->offset;
+}
+
+/*******************************************************************************
+* Function Name: settings_check_int
+********************************************************************************
+* Summary:
+*  Check a value against a parameter's range and step
+*
+* Return:
+*  0 if valid, -1 otherwise
+*
+*******************************************************************************/
+static int settings_check_int(const setting_desc_t *desc, int32_t value)
+{
+    if ((value < desc->min) || (value > desc->max) || ((value % desc->step) != 0)) {
+        return -1;
+    }
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: settings_check_text
+********************************************************************************
+* Summary:
+*  Check a text value: its length, characters that are safe in a file name,
+*  and the parameter's own check
+*
+* Return:
+*  0 if valid, -1 otherwise
+*
+*******************************************************************************/
+static int settings_check_text(const setting_desc_t *desc, const char *text, uint32_t length)
+{
+    if ((length < (uint32_t)desc->min) || (length > (uint32_t)desc->max)) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < length; i++) {
+        char c = text[i];
+        if (!(((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) ||
+              ((c >= '0') && (c <= '9')) || (c == '_') || (c == '-'))) {
+            return -1;
+        }
+    }
+    if ((desc->check != NULL) && (desc->check(text, length) != 0)) {
+        return -1;
+    }
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: settings_store_text
+********************************************************************************
+* Summary:
+*  Replace a text field; the caller has checked the value
+*
+*******************************************************************************/
+static void settings_store_text(const setting_desc_t *desc, const char *text, uint32_t length)
+{
+    char *field = settings_field(desc);
+
+    taskENTER_CRITICAL();
+    memcpy(field, text, length);
+    field[length] = '\0';
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+* Function Name: settings_store_int
+********************************************************************************
+* Summary:
+*  Replace an integer field; the caller has checked the value
+*
+*******************************************************************************/
+static void settings_store_int(const setting_desc_t *desc, int32_t value)
+{
+    taskENTER_CRITICAL();
+    *(int32_t *)settings_field(desc) = value;
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+* Function Name: settings_parse_file
+********************************************************************************
+* Summary:
+*  Validate a settings file and store the values it holds
+*
+* Parameters:
+*  filename: File to read
+*  count: Output - values stored
+*
+* Return:
+*  0 if the file is complete and its CRC matches, -1 otherwise; nothing is
+*  stored from a file that fails
+*
+*******************************************************************************/
+static int settings_parse_file(const char *filename, uint32_t *count)
+{
+    settings_file_header_t header;
+    FS_FILE *file;
+    uint32_t crc;
+    uint32_t pos;
+
+    *count = 0;
+    file = FS_FOpen(filename, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    if ((FS_Read(file, &header, sizeof(header)) != sizeof(header)) ||
+        (memcmp(header.magic, SETTINGS_FILE_MAGIC, 4) != 0) ||
+        (header.version != SETTINGS_VERSION) ||
+        (header.length > sizeof(settings_file_data)) ||
+        (FS_Read(file, settings_file_data, header.length) != header.length)) {
+        FS_FClose(file);
+        return -1;
+    }
+    FS_FClose(file);
+
+    crc = crc32_update(CRC32_INIT, &header, offsetof(settings_file_header_t, crc));
+    crc = crc32_update(crc, settings_file_data, header.length);
+    if (crc32_final(crc) != header.crc) {
+        return -1;
+    }
+
+    /* Every record must lie inside the file before any is used */
+    pos = 0;
+    for (uint32_t i = 0; i < header.count; i++) {
+        uint16_t length;
+
+        if (pos + 4u > header.length) {
+            return -1;
+        }
+        memcpy(&length, &settings_file_data[pos + 2u], sizeof(length));
+        pos += 4u + ((length + 3u) & ~3u);
+        if (pos > header.length) {
+            return -1;
+        }
+    }
+
+    pos = 0;
+    for (uint32_t i = 0; i < header.count; i++) {
+        uint16_t id;
+        uint16_t length;
+        const uint8_t *value;
+        const setting_desc_t *desc = NULL;
+
+        memcpy(&id, &settings_file_data[pos], sizeof(id));
+        memcpy(&length, &settings_file_data[pos + 2u], sizeof(length));
+        value = &settings_file_data[pos + 4u];
+        pos += 4u + ((length + 3u) & ~3u);
+
+        for (uint32_t j = 0; j < SETTINGS_TABLE_SIZE; j++) {
+            if (settings_table[j].id == id) {
+                desc = &settings_table[j];
+                break;
+            }
+        }
+        if ((desc == NULL) || ((desc->flags & SETTING_READ_ONLY) != 0u)) {
+            continue;
+        }
+        if (desc->type == SETTING_INT) {
+            int32_t number;
+
+            if (length != sizeof(number)) {
+                continue;
+            }
+            memcpy(&number, value, sizeof(number));
+            if (settings_check_int(desc, number) != 0) {
+                printf("[Config] %s = %ld out of range, using %ld\r\n", desc->name,
+                       (long)number, (long)*(int32_t *)settings_field(desc));
+                continue;
+            }
+            settings_store_int(desc, number);
+        } else {
+            if (settings_check_text(desc, (const char *)value, length) != 0) {
+                printf("[Config] %s not valid, using the default\r\n", desc->name);
+                continue;
+            }
+            settings_store_text(desc, (const char *)value, length);
+        }
+        (*count)++;
+    }
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: settings_load
+********************************************************************************
+* Summary:
+*  Load the stored settings once at boot, before any session starts, and
+*  program the ones that live in hardware
+*  - If only the temporary file is valid, a save was cut short after the
+*    old store was removed; it is loaded and the rename completed
+*
+* Return:
+*  0 if a store was loaded, -1 if the defaults are in use
+*
+*******************************************************************************/
+int settings_load(void)
+{
+    uint32_t count = 0;
+    int result;
+
+    result = settings_parse_file(SETTINGS_FILENAME, &count);
+    if (result == 0) {
+        printf("[Config] Loaded %u settings from %s\r\n", (unsigned int)count, SETTINGS_FILENAME);
+    } else if (settings_parse_file(SETTINGS_TEMP_FILENAME, &count) == 0) {
+        printf("[Config] Loaded %u settings from %s, finishing the last save\r\n",
+               (unsigned int)count, SETTINGS_TEMP_FILENAME);
+        (void)FS_Remove(SETTINGS_FILENAME);
+        (void)FS_Rename(SETTINGS_TEMP_FILENAME, SETTINGS_FILENAME);
+        result = 0;
+    } else {
+        printf("[Config] No valid %s, using defaults\r\n", SETTINGS_FILENAME);
+    }
+
+    for (uint32_t i = 0; i < SETTINGS_TABLE_SIZE; i++) {
+        if (settings_table[i].apply != NULL) {
+            settings_table[i].apply();
+        }
+    }
+    return result;
+}
+
+/*******************************************************************************
+* Function Name: settings_save
+********************************************************************************
+* Summary:
+*  Write every settable parameter to the store
+*  - The new store is written and closed under SETTINGS_TEMP_FILENAME, then
+*    replaces the old one by rename; settings_load() recovers a save cut
+*    short between the two
+*
+* Return:
+*  0 on success, -1 on a file system error (the old store is kept)
+*
+*******************************************************************************/
+int settings_save(void)
+{
+    settings_file_header_t header;
+    settings_t snapshot;
+    FS_FILE *file;
+    uint32_t pos = 0;
+    uint32_t crc;
+
+    taskENTER_CRITICAL();
+    snapshot = app_settings;
+    taskEXIT_CRITICAL();
+
+    memset(settings_file_data, 0, sizeof(settings_file_data));
+    memcpy(header.magic, SETTINGS_FILE_MAGIC, 4);
+    header.version = SETTINGS_VERSION;
+    header.count = 0;
+    for (uint32_t i = 0; i < SETTINGS_TABLE_SIZE; i++) {
+        const setting_desc_t *desc = &settings_table[i];
+        const uint8_t *value = (const uint8_t *)&snapshot + desc->offset;
+        uint16_t length;
+
+        if ((desc->flags & SETTING_READ_ONLY) != 0u) {
+            continue;
+        }
+        length = (desc->type == SETTING_INT) ? sizeof(int32_t) : (uint16_t)strlen((const char *)value);
+        memcpy(&settings_file_data[pos], &desc->id, sizeof(desc->id));
+        memcpy(&settings_file_data[pos + 2u], &length, sizeof(length));
+        memcpy(&settings_file_data[pos + 4u], value, length);
+        pos += 4u + ((length + 3u) & ~3u);
+        header.count++;
+    }
+    header.length = pos;
+    crc = crc32_update(CRC32_INIT, &header, offsetof(settings_file_header_t, crc));
+    header.crc = crc32_final(crc32_update(crc, settings_file_data, pos));
+
+    file = FS_FOpen(SETTINGS_TEMP_FILENAME, "w");
+    if (file == NULL) {
+        return -1;
+    }
+    if ((FS_Write(file, &header, sizeof(header)) != sizeof(header)) ||
+        (FS_Write(file, settings_file_data, pos) != pos)) {
+        FS_FClose(file);
+        (void)FS_Remove(SETTINGS_TEMP_FILENAME);
+        return -1;
+    }
+    if (FS_FClose(file) != 0) {
+        (void)FS_Remove(SETTINGS_TEMP_FILENAME);
+        return -1;
+    }
+
+    (void)FS_Remove(SETTINGS_FILENAME);
+    if (FS_Rename(SETTINGS_TEMP_FILENAME, SETTINGS_FILENAME) != 0) {
+        return -1;      /* Temporary file kept: the next boot loads it */
+    }
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: settings_count
+********************************************************************************
+* Summary:
+*  Number of parameters in the table
+*
+*******************************************************************************/
+uint32_t settings_count(void)
+{
+    return SETTINGS_TABLE_SIZE;
+}
+
+/*******************************************************************************
+* Function Name: settings_at
+********************************************************************************
+* Summary:
+*  Parameter by position in the table, NULL past the end
+*
+*******************************************************************************/
+const setting_desc_t *settings_at(uint32_t index)
+{
+    return (index < SETTINGS_TABLE_SIZE) ? &settings_table[index] : NULL;
+}
+
+/*******************************************************************************
+* Function Name: settings_find
+********************************************************************************
+* Summary:
+*  Parameter by name, NULL if there is none
+*
+*******************************************************************************/
+const setting_desc_t *settings_find(const char *name)
+{
+    for (uint32_t i = 0; i < SETTINGS_TABLE_SIZE; i++) {
+        if (strcmp(settings_table[i].name, name) == 0) {
+            return &settings_table[i];
+        }
+    }
+    return NULL;
+}
+
+/*******************************************************************************
+* Function Name: settings_set
+********************************************************************************
+* Summary:
+*  Change a parameter from its text form; the store on the card is not
+*  touched until settings_save()
+*
+* Parameters:
+*  desc: Parameter
+*  text: New value
+*
+* Return:
+*  0 on success, -1 if the parameter is read-only or the value does not
+*  parse or is out of range
+*
+*******************************************************************************/
+int settings_set(const setting_desc_t *desc, const char *text)
+{
+    if ((desc->flags & SETTING_READ_ONLY) != 0u) {
+        return -1;
+    }
+
+    if (desc->type == SETTING_INT) {
+        char *end;
+        long value = strtol(text, &end, 10);
+
+        if ((end == text) || (*end != '\0') ||
+            (value < INT32_MIN) || (value > INT32_MAX) ||
+            (settings_check_int(desc, (int32_t)value) != 0)) {
+            return -1;
+        }
+        settings_store_int(desc, (int32_t)value);
+    } else {
+        uint32_t length = (uint32_t)strlen(text);
+
+        if (settings_check_text(desc, text, length) != 0) {
+            return -1;
+        }
+        settings_store_text(desc, text, length);
+    }
+
+    if (desc->apply != NULL) {
+        desc->apply();
+    }
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: settings_format
+********************************************************************************
+* Summary:
+*  Current value of a parameter as text
+*
+* Parameters:
+*  desc: Parameter
+*  text: Output
+*  size: Size of text, SETTINGS_MAX_VALUE_LENGTH is always enough
+*
+*******************************************************************************/
+void settings_format(const setting_desc_t *desc, char *text, uint32_t size)
+{
+    if (desc->type == SETTING_INT) {
+        snprintf(text, size, "%ld", (long)*(int32_t *)settings_field(desc));
+    } else {
+        settings_copy_text(settings_field(desc), text, size);
+    }
+}
+
+/*******************************************************************************
+* Function Name: settings_is_default
+********************************************************************************
+* Summary:
+*  Whether a parameter holds its built-in default
+*
+*******************************************************************************/
+bool settings_is_default(const setting_desc_t *desc)
+{
+    char text[SETTINGS_MAX_VALUE_LENGTH];
+
+    if (desc->type == SETTING_INT) {
+        return *(int32_t *)settings_field(desc) == desc->def;
+    }
+    settings_copy_text(settings_field(desc), text, sizeof(text));
+    return strcmp(text, desc->def_text) == 0;
+}
+
+/*******************************************************************************
+* Function Name: settings_copy_text
+********************************************************************************
+* Summary:
+*  Copy a text field of app_settings, which another task may be changing
+*
+* Parameters:
+*  field: Field, e.g. app_settings.file_prefix
+*  dst: Output, always terminated
+*  size: Size of dst
+*
+*******************************************************************************/
+void settings_copy_text(const char *field, char *dst, uint32_t size)
+{
+    taskENTER_CRITICAL();
+    strncpy(dst, field, size - 1u);
+    taskEXIT_CRITICAL();
+    dst[size - 1u] = '\0';
+}
@@ -0,0 +1,121 @@
+/******************************************************************************
+* File Name: settings.h
+*
+* Description: Persistent configuration store
+*              A table of typed parameters, each with a range and a default,
+*              kept in one compact struct that the tasks read directly. The
+*              values are loaded once at boot from SETTINGS_FILENAME on the
+*              SD card and written back only by an explicit save, through a
+*              temporary file so a power cut leaves either the old or the new
+*              store. Buffer sizes are picked up at the start of the next
+*              take, file or playback; the sample rate and channel count are
+*              built into the PDM, I2S and codec setup and are read-only.
+*
+*******************************************************************************/
+
+#ifndef __SETTINGS_H__
+#define __SETTINGS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define SETTINGS_FILENAME           "config.bin"
+#define SETTINGS_TEMP_FILENAME      "config.tmp"    /* Written here, renamed when complete */
+#define SETTINGS_FILE_MAGIC         "ACFG"
+#define SETTINGS_VERSION            (1u)
+#define SETTINGS_PREFIX_SIZE        (9u)            /* File name prefix, NUL included */
+#define SETTINGS_DEFAULT_PREFIX     "audio"
+#define SETTINGS_TDM_MAP_SIZE       (9u)            /* One letter per TDM slot, NUL included */
+#define SETTINGS_MAX_VALUE_LENGTH   (16u)           /* Longest value as text */
+#define SETTINGS_FILE_MAX_BYTES     (256u)
+#define SETTINGS_MIN_READ_CHUNK     (1024u)         /* 32 ms at 16 kHz stereo, several playback polls */
+
+/* Parameter flags */
+#define SETTING_READ_ONLY           (1u << 0)       /* Fixed at build time */
+#define SETTING_NEXT_SESSION        (1u << 1)       /* Used from the next take, file or playback */
+
+/*******************************************************************************
+* Enumerations
+*******************************************************************************/
+typedef enum {
+    SETTING_INT,                /* int32_t; a multiple of step within min..max */
+    SETTING_TEXT                /* char[]; min..max characters of [A-Za-z0-9_-] */
+} setting_type_t;
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+/* Every parameter, as the tasks read it */
+typedef struct {
+    int32_t mic_gain_db;        /* PDM channel gain, applied when set */
+    char file_prefix[SETTINGS_PREFIX_SIZE]; /* Recordings are <prefix>_NNN.wav */
+    int32_t take_ms;            /* Longest take without a length */
+    int32_t write_slice_bytes;  /* Take samples per FS_Write */
+    int32_t read_chunk_samples; /* Playback samples per FS_Read */
+    int32_t sample_rate;        /* Read-only */
+    int32_t num_channels;       /* Read-only */
+    int32_t volume_db;          /* Codec DAC volume, applied when set */
+    int32_t route;              /* output_route_t, applied when set */
+    char tdm_map[SETTINGS_TDM_MAP_SIZE];    /* Source of each TDM slot, see tdm_slots.h */
+    int32_t settle_frames;      /* Discarded at the start of a take, applied when set */
+} settings_t;
+
+typedef struct {
+    const char *name;           /* As typed in 'config' */
+    uint16_t id;                /* Key in the file; never reused for another parameter */
+    uint8_t type;               /* setting_type_t */
+    uint8_t flags;
+    uint16_t offset;            /* Field in settings_t */
+    int32_t min;                /* Text: length range */
+    int32_t max;
+    int32_t step;
+    int32_t def;
+    const char *def_text;       /* Text default */
+    const char *unit;
+    void (*apply)(void);        /* Called after the value changes, NULL if read when used */
+    int (*check)(const char *text, uint32_t length);   /* Text: further check, NULL if none */
+} setting_desc_t;
+
+/* Header of SETTINGS_FILENAME, followed by one record per stored parameter:
+ * uint16 id, uint16 length, then the value in length bytes (int32 or text
+ * without the NUL) padded to 4 */
+typedef struct __attribute__((packed)) {
+    char magic[4];              /* SETTINGS_FILE_MAGIC */
+    uint16_t version;
+    uint16_t count;             /* Records */
+    uint32_t length;            /* Bytes of records */
+    uint32_t crc;               /* CRC-32 of the header up to here and the records */
+} settings_file_header_t;
+
+/*******************************************************************************
+* Global Variables
+*******************************************************************************/
+/* Written only by the settings functions, with interrupts masked; an aligned
+ * int32_t field can be read directly, text with settings_copy_text() */
+extern settings_t app_settings;
+
+/*******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+int settings_load(void);
+int settings_save(void);
+uint32_t settings_count(void);
+const setting_desc_t *settings_at(uint32_t index);
+const setting_desc_t *settings_find(const char *name);
+int settings_set(const setting_desc_t *desc, const char *text);
+void settings_format(const setting_desc_t *desc, char *text, uint32_t size);
+bool settings_is_default(const setting_desc_t *desc);
+void settings_copy_text(const char *field, char *dst, uint32_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SETTINGS_H__ */
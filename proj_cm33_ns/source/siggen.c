@@ -0,0 +1,308 @@
+/******************************************************************************
+* File Name: siggen.c
+*
+* Description: Test-signal generator for the playback path
+*              Sines come from a Q32 phase accumulator and a Q30 table with
+*              linear interpolation: the frequency error is below
+*              sample_rate / 2^33 and the interpolation error below -100 dB.
+*              A sweep multiplies the phase increment by a constant ratio
+*              each frame and recomputes it from the start every
+*              SIGGEN_SWEEP_SYNC_FRAMES, so float rounding cannot accumulate
+*              over a long sweep. Noise is xorshift32; pink noise sums
+*              Voss-McCartney rows with one white term.
+*
+*******************************************************************************/
+
+#include "siggen.h"
+#include "audio_ramfunc.h"
+#include <math.h>
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define SIGGEN_FRAC_BITS            (32u - SIGGEN_LUT_BITS)
+#define SIGGEN_FRAC_MASK            ((1u << SIGGEN_FRAC_BITS) - 1u)
+#define SIGGEN_LUT_SCALE            (1073741824.0)      /* Q30 */
+#define SIGGEN_FULL_SCALE           (32767.0)
+#define SIGGEN_NOISE_SEED           (0x2545F491u)
+#define SIGGEN_SWEEP_MAX_FRAMES     (1u << 24)          /* Frame index exact as a float */
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+/* One full cycle plus a guard entry for the interpolation */
+static int32_t siggen_lut[SIGGEN_LUT_SIZE + 1u];
+static bool siggen_lut_ready = false;
+
+/*******************************************************************************
+* Function Name: siggen_lut_init
+********************************************************************************
+* Summary:
+*  Fill the sine table once, in task context
+*
+*******************************************************************************/
+static void siggen_lut_init(void)
+{
+    if (siggen_lut_ready) {
+        return;
+    }
+    for (uint32_t i = 0; i < SIGGEN_LUT_SIZE; i++) {
+        siggen_lut[i] = (int32_t)lround(sin(2.0 * M_PI * (double)i / SIGGEN_LUT_SIZE) * SIGGEN_LUT_SCALE);
+    }
+    siggen_lut[SIGGEN_LUT_SIZE] = siggen_lut[0];
+    siggen_lut_ready = true;
+}
+
+/*******************************************************************************
+* Function Name: siggen_sine
+********************************************************************************
+* Summary:
+*  Interpolated sine at a phase, scaled to a peak in sample units and rounded
+*
+*******************************************************************************/
+static inline int16_t siggen_sine(uint32_t phase, int32_t amplitude)
+{
+    uint32_t index = phase >> SIGGEN_FRAC_BITS;
+    int32_t frac = (int32_t)(phase & SIGGEN_FRAC_MASK);
+    int32_t low = siggen_lut[index];
+    int32_t value = low + (int32_t)(((int64_t)(siggen_lut[index + 1u] - low) * frac) >> SIGGEN_FRAC_BITS);
+
+    return (int16_t)((((int64_t)value * amplitude) + (1LL << 29)) >> 30);
+}
+
+/*******************************************************************************
+* Function Name: siggen_random
+********************************************************************************
+* Summary:
+*  Next xorshift32 value as a signed 16-bit sample scaled by a Q15 gain
+*
+*******************************************************************************/
+static inline int16_t siggen_random(siggen_t *gen, int32_t gain)
+{
+    uint32_t x = gen->noise;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    gen->noise = x;
+
+    return (int16_t)((((int32_t)x >> 16) * gain) >> 15);
+}
+
+/*******************************************************************************
+* Function Name: siggen_init
+********************************************************************************
+* Summary:
+*  Check a configuration and set a generator up to render it from frame 0
+*
+* Parameters:
+*  gen: Generator
+*  config: Signal, level and length
+*  sample_rate: Of the stream the generator feeds
+*
+* Return:
+*  0 on success, -1 if a parameter is out of range
+*
+*******************************************************************************/
+int siggen_init(siggen_t *gen, const siggen_config_t *config, uint32_t sample_rate)
+{
+    uint32_t nyquist = sample_rate / 2u;
+    double amplitude;
+
+    if ((config->frames == 0u) || (config->atten_db > SIGGEN_MAX_ATTEN_DB)) {
+        return -1;
+    }
+    switch (config->type) {
+        case SIGGEN_TONE:
+            if ((config->freq_hz == 0u) || (config->freq_hz >= nyquist)) {
+                return -1;
+            }
+            break;
+        case SIGGEN_SWEEP:
+            if ((config->freq_hz == 0u) || (config->freq_hz >= nyquist) ||
+                (config->end_freq_hz == 0u) || (config->end_freq_hz >= nyquist) ||
+                (config->frames > SIGGEN_SWEEP_MAX_FRAMES)) {
+                return -1;
+            }
+            break;
+        case SIGGEN_CLICK:
+            if (config->period_frames == 0u) {
+                return -1;
+            }
+            break;
+        case SIGGEN_WHITE:
+        case SIGGEN_PINK:
+            break;
+        default:
+            return -1;
+    }
+
+    siggen_lut_init();
+
+    amplitude = SIGGEN_FULL_SCALE * pow(10.0, -(double)config->atten_db / 20.0);
+
+    gen->type = config->type;
+    gen->stop = false;
+    gen->frames_left = config->frames;
+    gen->position = 0;
+    gen->amplitude = (int32_t)lround(amplitude);
+    gen->phase = 0;
+    gen->phase_inc = (uint32_t)((((uint64_t)config->freq_hz << 32) + (sample_rate / 2u)) / sample_rate);
+    gen->sweep_start_inc = (float)gen->phase_inc;
+    gen->sweep_octaves = 0.0f;
+    gen->sweep_ratio = 1.0f;
+    if (config->type == SIGGEN_SWEEP) {
+        gen->sweep_octaves = (float)(log2((double)config->end_freq_hz / (double)config->freq_hz) /
+                                     (double)config->frames);
+        gen->sweep_ratio = exp2f(gen->sweep_octaves);
+    }
+    gen->sweep_inc = gen->sweep_start_inc;
+    gen->noise = SIGGEN_NOISE_SEED;
+    gen->pink_counter = 0;
+    /* Rows and the white term share the peak, so the sum cannot clip */
+    gen->pink_gain = (int32_t)lround(amplitude / (SIGGEN_PINK_ROWS + 1u));
+    gen->pink_sum = 0;
+    for (uint32_t i = 0; i < SIGGEN_PINK_ROWS; i++) {
+        gen->pink_rows[i] = siggen_random(gen, gen->pink_gain);
+        gen->pink_sum += gen->pink_rows[i];
+    }
+    gen->click_period = config->period_frames;
+    gen->click_countdown = 0;
+    gen->active = true;
+
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: siggen_render
+********************************************************************************
+* Summary:
+*  Render the next frames of the signal; safe to call from an interrupt
+*
+* Parameters:
+*  gen: Generator set up with siggen_init()
+*  samples: Output, frames * 2 interleaved L/R samples
+*  frames: Frames wanted
+*
+* Return:
+*  Frames rendered; fewer than asked once the signal ends, then 0
+*
+*******************************************************************************/
+AUDIO_RAMFUNC_BEGIN
+uint32_t siggen_render(siggen_t *gen, int16_t *samples, uint32_t frames)
+{
+    int16_t value;
+
+    if (gen->stop) {
+        gen->frames_left = 0;
+    }
+    if (frames > gen->frames_left) {
+        frames = gen->frames_left;
+    }
+
+    switch (gen->type) {
+        case SIGGEN_TONE:
+            for (uint32_t i = 0; i < frames; i++) {
+                value = siggen_sine(gen->phase, gen->amplitude);
+                gen->phase += gen->phase_inc;
+                samples[2u * i] = value;
+                samples[2u * i + 1u] = value;
+            }
+            break;
+
+        case SIGGEN_SWEEP:
+            for (uint32_t i = 0; i < frames; i++) {
+                uint32_t position = gen->position + i;
+                if ((position % SIGGEN_SWEEP_SYNC_FRAMES) == 0u) {
+                    gen->sweep_inc = gen->sweep_start_inc * exp2f(gen->sweep_octaves * (float)position);
+                }
+                value = siggen_sine(gen->phase, gen->amplitude);
+                gen->phase += (uint32_t)gen->sweep_inc;
+                gen->sweep_inc *= gen->sweep_ratio;
+                samples[2u * i] = value;
+                samples[2u * i + 1u] = value;
+            }
+            break;
+
+        case SIGGEN_WHITE:
+            for (uint32_t i = 0; i < frames; i++) {
+                value = siggen_random(gen, gen->amplitude);
+                samples[2u * i] = value;
+                samples[2u * i + 1u] = value;
+            }
+            break;
+
+        case SIGGEN_PINK:
+            for (uint32_t i = 0; i < frames; i++) {
+                /* Row k changes every 2^(k+1) frames: the trailing zeros of the count */
+                uint32_t count = ++gen->pink_counter;
+                uint32_t row = 0;
+                while (((count & 1u) == 0u) && (row < SIGGEN_PINK_ROWS)) {
+                    count >>= 1;
+                    row++;
+                }
+                if (row < SIGGEN_PINK_ROWS) {
+                    int16_t next = siggen_random(gen, gen->pink_gain);
+                    gen->pink_sum += next - gen->pink_rows[row];
+                    gen->pink_rows[row] = next;
+                }
+                value = (int16_t)(gen->pink_sum + siggen_random(gen, gen->pink_gain));
+                samples[2u * i] = value;
+                samples[2u * i + 1u] = value;
+            }
+            break;
+
+        case SIGGEN_CLICK:
+        default:
+            for (uint32_t i = 0; i < frames; i++) {
+                value = 0;
+                if (gen->click_countdown == 0u) {
+                    value = (int16_t)gen->amplitude;
+                    gen->click_countdown = gen->click_period;
+                }
+                gen->click_countdown--;
+                samples[2u * i] = value;
+                samples[2u * i + 1u] = value;
+            }
+            break;
+    }
+
+    if (gen->frames_left != SIGGEN_CONTINUOUS) {
+        gen->frames_left -= frames;
+    }
+    gen->position += frames;
+
+    return frames;
+}
+AUDIO_RAMFUNC_END
+
+/*******************************************************************************
+* Function Name: siggen_stop
+********************************************************************************
+* Summary:
+*  End the signal at the next render, e.g. a continuous tone
+*
+*******************************************************************************/
+void siggen_stop(siggen_t *gen)
+{
+    gen->stop = true;
+}
+
+/*******************************************************************************
+* Function Name: siggen_type_name
+********************************************************************************
+* Summary:
+*  Name of a signal type as the 'gen' command takes it
+*
+*******************************************************************************/
+const char *siggen_type_name(siggen_type_t type)
+{
+    switch (type) {
+        case SIGGEN_TONE:   return "tone";
+        case SIGGEN_SWEEP:  return "sweep";
+        case SIGGEN_WHITE:  return "noise";
+        case SIGGEN_PINK:   return "pink";
+        case SIGGEN_CLICK:  return "click";
+        default:            return "?";
+    }
+}
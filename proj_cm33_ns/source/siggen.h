@@ -0,0 +1,92 @@
+/******************************************************************************
+* File Name: siggen.h
+*
+* Description: Test-signal generator for the playback path
+*              Tones, logarithmic sweeps, white and pink noise and click
+*              trains, rendered in blocks of interleaved L/R frames with the
+*              same signal on both channels. The length and click spacing
+*              are counted in frames, so a signal starts and ends on an exact
+*              sample. Rendering uses integer arithmetic apart from one
+*              exp2f() per SIGGEN_SWEEP_SYNC_FRAMES of a sweep, cheap enough
+*              to run from the I2S refill interrupt.
+*
+*******************************************************************************/
+
+#ifndef __SIGGEN_H__
+#define __SIGGEN_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define SIGGEN_LUT_BITS             (9u)        /* Full-cycle sine table, Q30 */
+#define SIGGEN_LUT_SIZE             (1u << SIGGEN_LUT_BITS)
+#define SIGGEN_PINK_ROWS            (12u)       /* Voss-McCartney rows; the slowest changes every 2^12 frames */
+#define SIGGEN_SWEEP_SYNC_FRAMES    (32u)       /* Sweep increment recomputed exactly this often */
+#define SIGGEN_MAX_ATTEN_DB         (96u)
+#define SIGGEN_CONTINUOUS           (UINT32_MAX)    /* Length: until siggen_stop() */
+
+/*******************************************************************************
+* Enumerations
+*******************************************************************************/
+typedef enum {
+    SIGGEN_TONE,
+    SIGGEN_SWEEP,               /* Logarithmic, freq_hz to end_freq_hz over the length */
+    SIGGEN_WHITE,
+    SIGGEN_PINK,
+    SIGGEN_CLICK                /* One-sample impulses, the first at frame 0 */
+} siggen_type_t;
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+typedef struct {
+    siggen_type_t type;
+    uint32_t freq_hz;           /* Tone; start of a sweep */
+    uint32_t end_freq_hz;       /* Sweep */
+    uint32_t period_frames;     /* Click spacing */
+    uint32_t frames;            /* Length, or SIGGEN_CONTINUOUS (not for sweeps) */
+    uint32_t atten_db;          /* Peak level below full scale */
+} siggen_config_t;
+
+typedef struct {
+    siggen_type_t type;
+    volatile bool active;       /* From siggen_init() until the owner releases it */
+    volatile bool stop;         /* Set by siggen_stop(), seen by the next render */
+    uint32_t frames_left;
+    uint32_t position;          /* Frames rendered */
+    int32_t amplitude;          /* Peak, in sample units */
+    uint32_t phase;             /* Q32, one cycle per wrap */
+    uint32_t phase_inc;
+    float sweep_start_inc;      /* Sweep: phase_inc at frame 0 */
+    float sweep_octaves;        /* Sweep: log2 of the increment growth per frame */
+    float sweep_inc;
+    float sweep_ratio;          /* Sweep: growth per frame between syncs */
+    uint32_t noise;             /* xorshift32 state */
+    uint32_t pink_counter;
+    int32_t pink_gain;          /* Q15, per row */
+    int32_t pink_sum;
+    int16_t pink_rows[SIGGEN_PINK_ROWS];
+    uint32_t click_period;
+    uint32_t click_countdown;
+} siggen_t;
+
+/*******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+int siggen_init(siggen_t *gen, const siggen_config_t *config, uint32_t sample_rate);
+uint32_t siggen_render(siggen_t *gen, int16_t *samples, uint32_t frames);
+void siggen_stop(siggen_t *gen);
+const char *siggen_type_name(siggen_type_t type);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SIGGEN_H__ */
@@ -0,0 +1,417 @@
+/******************************************************************************
+* File Name: tdm_slots.c
+*
+* Description: N-slot TDM output with a source per slot
+*              - A kernel writes whole TDM frames to the TX FIFO. The layouts
+*                that repeat L/R are plain copies; any other map loads a
+*                small bus (silence, L, R, mix) per frame and writes the
+*                slots from it by index, unrolled for the slot count.
+*              - The layout and the transmitter's slot count change only at
+*                the start of a playback, while the transmitter is off.
+*
+*******************************************************************************/
+
+#include "tdm_slots.h"
+#include "app_i2s.h"
+#include "codec_ctrl.h"
+#include "settings.h"
+#include "audio_ramfunc.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <string.h>
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define TDM_WRITE(word)             Cy_AudioTDM_WriteTxData(TDM_STRUCT0_TX, (uint32_t)(word))
+#define TDM_CODEC_FORMAT_MASK       (0xC0u)     /* Page 0 register 27, bits 7:6 */
+#define TDM_CODEC_FORMAT_I2S        (0x00u)
+#define TDM_CODEC_FORMAT_DSP        (0x40u)
+
+/*******************************************************************************
+* Data Types
+*******************************************************************************/
+typedef void (*tdm_kernel_fn_t)(const uint8_t *source, const int16_t *src, uint32_t frames);
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static tdm_layout_t tdm_active = {         /* Run by the I2S ISR */
+    .slots = 2u,
+    .source = { TDM_SOURCE_LEFT, TDM_SOURCE_RIGHT },
+    .kernel = TDM_KERNEL_STEREO,
+    .refill_frames = HW_FIFO_HALF_SIZE / 2u
+};
+
+static char tdm_active_map[TDM_MAX_SLOTS + 1u] = TDM_DEFAULT_MAP;
+static uint32_t tdm_codec_errors = 0;
+
+static const char *const tdm_kernel_names[TDM_KERNEL_COUNT] = {
+    "stereo", "pairs4", "pairs8", "map2", "map4", "map8"
+};
+
+/*******************************************************************************
+* Function Name: tdm_kernel_stereo / tdm_kernel_pairs4 / tdm_kernel_pairs8
+********************************************************************************
+* Summary:
+*  L/R repeated over 2, 4 or 8 slots
+*
+*******************************************************************************/
+AUDIO_RAMFUNC_BEGIN
+static void tdm_kernel_stereo(const uint8_t *source, const int16_t *src, uint32_t frames)
+{
+    (void)source;
+    for (uint32_t i = 0; i < frames; i++) {
+        TDM_WRITE(src[0]);
+        TDM_WRITE(src[1]);
+        src += 2;
+    }
+}
+
+static void tdm_kernel_pairs4(const uint8_t *source, const int16_t *src, uint32_t frames)
+{
+    (void)source;
+    for (uint32_t i = 0; i < frames; i++) {
+        int16_t left = src[0];
+        int16_t right = src[1];
+
+        TDM_WRITE(left);
+        TDM_WRITE(right);
+        TDM_WRITE(left);
+        TDM_WRITE(right);
+        src += 2;
+    }
+}
+
+static void tdm_kernel_pairs8(const uint8_t *source, const int16_t *src, uint32_t frames)
+{
+    (void)source;
+    for (uint32_t i = 0; i < frames; i++) {
+        int16_t left = src[0];
+        int16_t right = src[1];
+
+        TDM_WRITE(left);
+        TDM_WRITE(right);
+        TDM_WRITE(left);
+        TDM_WRITE(right);
+        TDM_WRITE(left);
+        TDM_WRITE(right);
+        TDM_WRITE(left);
+        TDM_WRITE(right);
+        src += 2;
+    }
+}
+AUDIO_RAMFUNC_END
+
+/*******************************************************************************
+* Function Name: tdm_kernel_map2 / tdm_kernel_map4 / tdm_kernel_map8
+********************************************************************************
+* Summary:
+*  Any map: each slot takes the bus entry of its source
+*
+*******************************************************************************/
+AUDIO_RAMFUNC_BEGIN
+static void tdm_kernel_map2(const uint8_t *source, const int16_t *src, uint32_t frames)
+{
+    int32_t bus[TDM_SOURCE_COUNT] = { 0 };
+    uint32_t s0 = source[0];
+    uint32_t s1 = source[1];
+
+    for (uint32_t i = 0; i < frames; i++) {
+        bus[TDM_SOURCE_LEFT] = src[0];
+        bus[TDM_SOURCE_RIGHT] = src[1];
+        bus[TDM_SOURCE_MIX] = (src[0] + src[1]) >> 1;
+        TDM_WRITE(bus[s0]);
+        TDM_WRITE(bus[s1]);
+        src += 2;
+    }
+}
+
+static void tdm_kernel_map4(const uint8_t *source, const int16_t *src, uint32_t frames)
+{
+    int32_t bus[TDM_SOURCE_COUNT] = { 0 };
+    uint32_t s0 = source[0];
+    uint32_t s1 = source[1];
+    uint32_t s2 = source[2];
+    uint32_t s3 = source[3];
+
+    for (uint32_t i = 0; i < frames; i++) {
+        bus[TDM_SOURCE_LEFT] = src[0];
+        bus[TDM_SOURCE_RIGHT] = src[1];
+        bus[TDM_SOURCE_MIX] = (src[0] + src[1]) >> 1;
+        TDM_WRITE(bus[s0]);
+        TDM_WRITE(bus[s1]);
+        TDM_WRITE(bus[s2]);
+        TDM_WRITE(bus[s3]);
+        src += 2;
+    }
+}
+
+static void tdm_kernel_map8(const uint8_t *source, const int16_t *src, uint32_t frames)
+{
+    int32_t bus[TDM_SOURCE_COUNT] = { 0 };
+
+    /* The sources stay in the table: eight more registers would spill */
+    for (uint32_t i = 0; i < frames; i++) {
+        bus[TDM_SOURCE_LEFT] = src[0];
+        bus[TDM_SOURCE_RIGHT] = src[1];
+        bus[TDM_SOURCE_MIX] = (src[0] + src[1]) >> 1;
+        TDM_WRITE(bus[source[0]]);
+        TDM_WRITE(bus[source[1]]);
+        TDM_WRITE(bus[source[2]]);
+        TDM_WRITE(bus[source[3]]);
+        TDM_WRITE(bus[source[4]]);
+        TDM_WRITE(bus[source[5]]);
+        TDM_WRITE(bus[source[6]]);
+        TDM_WRITE(bus[source[7]]);
+        src += 2;
+    }
+}
+AUDIO_RAMFUNC_END
+
+static const tdm_kernel_fn_t tdm_kernels[TDM_KERNEL_COUNT] = {
+    tdm_kernel_stereo, tdm_kernel_pairs4, tdm_kernel_pairs8,
+    tdm_kernel_map2, tdm_kernel_map4, tdm_kernel_map8
+};
+
+/*******************************************************************************
+* Function Name: tdm_slots_write
+********************************************************************************
+* Summary:
+*  One FIFO refill in a layout: the frames at src, then silent frames once
+*  the source runs out
+*
+* Parameters:
+*  layout: Compiled map
+*  src: Interleaved L/R samples (may be NULL when samples is 0)
+*  samples: Samples available at src (L and R counted separately)
+*
+* Return:
+*  Samples consumed from src
+*
+*******************************************************************************/
+AUDIO_RAMFUNC_BEGIN
+uint32_t tdm_slots_write(const tdm_layout_t *layout, const int16_t *src, uint32_t samples)
+{
+    uint32_t frames = samples / 2u;
+    uint32_t words;
+
+    if (frames > layout->refill_frames) {
+        frames = layout->refill_frames;
+    }
+    if (frames > 0u) {
+        tdm_kernels[layout->kernel](layout->source, src, frames);
+    }
+    words = (layout->refill_frames - frames) * layout->slots;
+    while (words-- > 0u) {
+        TDM_WRITE(0);
+    }
+    return frames * 2u;
+}
+
+/*******************************************************************************
+* Function Name: tdm_slots_write_fifo
+********************************************************************************
+* Summary:
+*  tdm_slots_write() in the layout of the current playback; the refill of
+*  i2s_tx_interrupt_handler()
+*
+*******************************************************************************/
+uint32_t tdm_slots_write_fifo(const int16_t *src, uint32_t samples)
+{
+    return tdm_slots_write(&tdm_active, src, samples);
+}
+AUDIO_RAMFUNC_END
+
+/*******************************************************************************
+* Function Name: tdm_slots_source
+********************************************************************************
+* Summary:
+*  Source of a map letter, TDM_SOURCE_COUNT if it is none
+*
+*******************************************************************************/
+static tdm_source_t tdm_slots_source(char letter)
+{
+    switch (letter) {
+        case '-': return TDM_SOURCE_OFF;
+        case 'L': return TDM_SOURCE_LEFT;
+        case 'R': return TDM_SOURCE_RIGHT;
+        case 'M': return TDM_SOURCE_MIX;
+        default:  return TDM_SOURCE_COUNT;
+    }
+}
+
+/*******************************************************************************
+* Function Name: tdm_slots_check_map
+********************************************************************************
+* Summary:
+*  Check a slot map: 2, 4 or 8 letters of L, R, M and -
+*
+* Parameters:
+*  map: Letters, not necessarily terminated
+*  length: Letters at map
+*
+* Return:
+*  0 if valid, -1 otherwise
+*
+*******************************************************************************/
+int tdm_slots_check_map(const char *map, uint32_t length)
+{
+    if ((length != 2u) && (length != 4u) && (length != 8u)) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < length; i++) {
+        if (tdm_slots_source(map[i]) == TDM_SOURCE_COUNT) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: tdm_slots_compile
+********************************************************************************
+* Summary:
+*  Turn a slot map into a layout and pick its kernel
+*
+* Parameters:
+*  map: Terminated map, e.g. "LRLR" or "LRM--MLR"
+*  layout: Output
+*
+* Return:
+*  0 on success, -1 if the map is not valid
+*
+*******************************************************************************/
+int tdm_slots_compile(const char *map, tdm_layout_t *layout)
+{
+    uint32_t slots = (uint32_t)strlen(map);
+    bool pairs = true;
+
+    if (tdm_slots_check_map(map, slots) != 0) {
+        return -1;
+    }
+
+    memset(layout, 0, sizeof(*layout));
+    layout->slots = slots;
+    layout->refill_frames = HW_FIFO_HALF_SIZE / slots;
+    for (uint32_t i = 0; i < slots; i++) {
+        layout->source[i] = (uint8_t)tdm_slots_source(map[i]);
+        if (layout->source[i] != (((i & 1u) == 0u) ? TDM_SOURCE_LEFT : TDM_SOURCE_RIGHT)) {
+            pairs = false;
+        }
+    }
+
+    if (slots == 2u) {
+        layout->kernel = pairs ? TDM_KERNEL_STEREO : TDM_KERNEL_MAP2;
+    } else if (slots == 4u) {
+        layout->kernel = pairs ? TDM_KERNEL_PAIRS4 : TDM_KERNEL_MAP4;
+    } else {
+        layout->kernel = pairs ? TDM_KERNEL_PAIRS8 : TDM_KERNEL_MAP8;
+    }
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: tdm_slots_begin
+********************************************************************************
+* Summary:
+*  Take the "tdm_map" setting for a playback. Called by PlaybackTask while
+*  the transmitter is off; a new slot count reconfigures it and switches
+*  the codec between I2S and DSP format.
+*
+* Return:
+*  0 on success, -1 if the transmitter refused the slot count (the last
+*  layout it accepted stays)
+*
+*******************************************************************************/
+int tdm_slots_begin(void)
+{
+    char map[SETTINGS_TDM_MAP_SIZE];
+    tdm_layout_t layout;
+
+    settings_copy_text(app_settings.tdm_map, map, sizeof(map));
+    if (tdm_slots_compile(map, &layout) != 0) {
+        return -1;
+    }
+
+    if (layout.slots != app_i2s_get_slots()) {
+        if (!app_i2s_set_slots(layout.slots)) {
+            return -1;
+        }
+        if ((codec_ctrl_update(CODEC_P0_CODEC_INTERFACE, TDM_CODEC_FORMAT_MASK,
+                               (layout.slots == 2u) ? TDM_CODEC_FORMAT_I2S : TDM_CODEC_FORMAT_DSP) != 0) ||
+            (codec_ctrl_sync(CODEC_CTRL_SYNC_TIMEOUT_MS) != 0)) {
+            tdm_codec_errors++;
+        }
+    }
+
+    taskENTER_CRITICAL();
+    tdm_active = layout;
+    strcpy(tdm_active_map, map);
+    taskEXIT_CRITICAL();
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: tdm_slots_refill_frames / tdm_slots_count
+********************************************************************************
+* Summary:
+*  Frames in one FIFO refill, and slots in a frame, of the current layout
+*
+*******************************************************************************/
+AUDIO_RAMFUNC_BEGIN
+uint32_t tdm_slots_refill_frames(void)
+{
+    return tdm_active.refill_frames;
+}
+
+uint32_t tdm_slots_count(void)
+{
+    return tdm_active.slots;
+}
+AUDIO_RAMFUNC_END
+
+/*******************************************************************************
+* Function Name: tdm_slots_get_layout
+********************************************************************************
+* Summary:
+*  The layout in use and its map
+*
+* Parameters:
+*  layout: Output
+*  map: Output, TDM_MAX_SLOTS + 1 bytes is always enough
+*  size: Size of map
+*
+*******************************************************************************/
+void tdm_slots_get_layout(tdm_layout_t *layout, char *map, uint32_t size)
+{
+    taskENTER_CRITICAL();
+    *layout = tdm_active;
+    strncpy(map, tdm_active_map, size - 1u);
+    taskEXIT_CRITICAL();
+    map[size - 1u] = '\0';
+}
+
+/*******************************************************************************
+* Function Name: tdm_slots_codec_errors
+********************************************************************************
+* Summary:
+*  Codec format switches that did not reach the codec
+*
+*******************************************************************************/
+uint32_t tdm_slots_codec_errors(void)
+{
+    return tdm_codec_errors;
+}
+
+/*******************************************************************************
+* Function Name: tdm_kernel_name
+********************************************************************************
+* Summary:
+*  Name of a kernel, for the 'tdm' command
+*
+*******************************************************************************/
+const char *tdm_kernel_name(tdm_kernel_t kernel)
+{
+    return (kernel < TDM_KERNEL_COUNT) ? tdm_kernel_names[kernel] : "?";
+}
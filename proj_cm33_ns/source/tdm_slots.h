@@ -0,0 +1,86 @@
+/******************************************************************************
+* File Name: tdm_slots.h
+*
+* Description: N-slot TDM output with a source per slot
+*              The playback chain stays stereo; the I2S refill interleaves
+*              each L/R frame into a TDM frame of 2, 4 or 8 slots. Each slot
+*              carries the left or right channel, the mono mix bus or
+*              silence, as set by the "tdm_map" setting: one letter per slot
+*              (L, R, M, -), so its length is the slot count. A layout is
+*              compiled once, at the start of a playback, into one of a few
+*              specialized interleave kernels; the ISR then runs the kernel
+*              with no per-sample test of the layout.
+*
+*              The codec listens to slots 0 and 1: in I2S format with 2
+*              slots, in DSP format with more.
+*
+*******************************************************************************/
+
+#ifndef __TDM_SLOTS_H__
+#define __TDM_SLOTS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define TDM_MIN_SLOTS               (2u)
+#define TDM_MAX_SLOTS               (8u)        /* A refill of half the FIFO is 8 frames */
+#define TDM_DEFAULT_MAP             "LR"
+
+/*******************************************************************************
+* Enumerations
+*******************************************************************************/
+typedef enum {
+    TDM_SOURCE_OFF,             /* '-' */
+    TDM_SOURCE_LEFT,            /* 'L' */
+    TDM_SOURCE_RIGHT,           /* 'R' */
+    TDM_SOURCE_MIX,             /* 'M': (L + R) / 2 */
+    TDM_SOURCE_COUNT
+} tdm_source_t;
+
+typedef enum {
+    TDM_KERNEL_STEREO,          /* LR: the plain I2S copy */
+    TDM_KERNEL_PAIRS4,          /* LRLR */
+    TDM_KERNEL_PAIRS8,          /* LRLRLRLR */
+    TDM_KERNEL_MAP2,            /* Any other 2-slot map */
+    TDM_KERNEL_MAP4,            /* Any other 4-slot map */
+    TDM_KERNEL_MAP8,            /* Any other 8-slot map */
+    TDM_KERNEL_COUNT
+} tdm_kernel_t;
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+/* A map compiled for the ISR */
+typedef struct {
+    uint32_t slots;
+    uint8_t source[TDM_MAX_SLOTS];  /* tdm_source_t of each slot */
+    tdm_kernel_t kernel;
+    uint32_t refill_frames;     /* Frames in one refill, half the FIFO */
+} tdm_layout_t;
+
+/*******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+int tdm_slots_check_map(const char *map, uint32_t length);
+int tdm_slots_compile(const char *map, tdm_layout_t *layout);
+int tdm_slots_begin(void);
+uint32_t tdm_slots_write(const tdm_layout_t *layout, const int16_t *src, uint32_t samples);
+uint32_t tdm_slots_write_fifo(const int16_t *src, uint32_t samples);
+uint32_t tdm_slots_refill_frames(void);
+uint32_t tdm_slots_count(void);
+void tdm_slots_get_layout(tdm_layout_t *layout, char *map, uint32_t size);
+uint32_t tdm_slots_codec_errors(void);
+const char *tdm_kernel_name(tdm_kernel_t kernel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TDM_SLOTS_H__ */
@@ -0,0 +1,223 @@
+/******************************************************************************
+* File Name: wall_clock.c
+*
+* Description: Calendar time kept from the RTOS tick
+*              The clock is an offset in milliseconds from 2000-01-01 plus
+*              the tick count when it was set. The 32-bit tick count wraps
+*              after 49 days at 1 kHz; the offset is moved forward each time
+*              the time is read so a wrap is never missed between reads that
+*              are less than 49 days apart.
+*
+*******************************************************************************/
+
+#include "wall_clock.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define WALL_CLOCK_MS_PER_DAY       (86400000u)
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static uint64_t clock_base_ms;          /* Milliseconds since 2000-01-01 at clock_base_tick */
+static TickType_t clock_base_tick;
+static bool clock_initialized = false;
+static bool clock_valid = false;
+
+/*******************************************************************************
+* Function Name: wall_clock_days_from_civil
+********************************************************************************
+* Summary:
+*  Days since 2000-01-01 for a Gregorian date (valid for 2000..2099)
+*
+*******************************************************************************/
+static uint32_t wall_clock_days_from_civil(uint32_t year, uint32_t month, uint32_t day)
+{
+    static const uint16_t days_before_month[12] = {
+        0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334
+    };
+    uint32_t years = year - 2000u;
+    uint32_t days = years * 365u + (years + 3u) / 4u;   /* 2000 is a leap year */
+
+    days += days_before_month[month - 1u] + (day - 1u);
+    if ((month > 2u) && ((year % 4u) == 0u)) {
+        days++;
+    }
+    return days;
+}
+
+/*******************************************************************************
+* Function Name: wall_clock_civil_from_days
+********************************************************************************
+* Summary:
+*  Inverse of wall_clock_days_from_civil()
+*
+*******************************************************************************/
+static void wall_clock_civil_from_days(uint32_t days, wall_clock_time_t *time)
+{
+    static const uint8_t days_in_month[12] = {
+        31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31
+    };
+    uint32_t year = 2000u;
+    uint32_t month = 0;
+
+    for (;;) {
+        uint32_t length = ((year % 4u) == 0u) ? 366u : 365u;
+        if (days < length) {
+            break;
+        }
+        days -= length;
+        year++;
+    }
+    for (;;) {
+        uint32_t length = days_in_month[month] + (((month == 1u) && ((year % 4u) == 0u)) ? 1u : 0u);
+        if (days < length) {
+            break;
+        }
+        days -= length;
+        month++;
+    }
+
+    time->year = (uint16_t)year;
+    time->month = (uint8_t)(month + 1u);
+    time->day = (uint8_t)(days + 1u);
+}
+
+/*******************************************************************************
+* Function Name: wall_clock_from_ms
+********************************************************************************
+* Summary:
+*  Split milliseconds since 2000-01-01 into date and time fields
+*
+*******************************************************************************/
+static void wall_clock_from_ms(uint64_t ms, wall_clock_time_t *time)
+{
+    uint32_t ms_of_day = (uint32_t)(ms % WALL_CLOCK_MS_PER_DAY);
+
+    wall_clock_civil_from_days((uint32_t)(ms / WALL_CLOCK_MS_PER_DAY), time);
+    time->hour = (uint8_t)(ms_of_day / 3600000u);
+    time->minute = (uint8_t)((ms_of_day / 60000u) % 60u);
+    time->second = (uint8_t)((ms_of_day / 1000u) % 60u);
+    time->millisecond = (uint16_t)(ms_of_day % 1000u);
+}
+
+/*******************************************************************************
+* Function Name: wall_clock_now_ms
+********************************************************************************
+* Summary:
+*  Milliseconds since 2000-01-01, folding elapsed ticks into the base
+*
+*******************************************************************************/
+static uint64_t wall_clock_now_ms(void)
+{
+    TickType_t now;
+    uint64_t result;
+
+    taskENTER_CRITICAL();
+    if (!clock_initialized) {
+        clock_base_ms = (uint64_t)wall_clock_days_from_civil(WALL_CLOCK_DEFAULT_YEAR,
+                                                             WALL_CLOCK_DEFAULT_MONTH,
+                                                             WALL_CLOCK_DEFAULT_DAY) * WALL_CLOCK_MS_PER_DAY
+                        + (uint64_t)WALL_CLOCK_DEFAULT_HOUR * 3600000u;
+        clock_base_tick = xTaskGetTickCount();
+        clock_initialized = true;
+    }
+    now = xTaskGetTickCount();
+    clock_base_ms += (uint64_t)(TickType_t)(now - clock_base_tick) * portTICK_PERIOD_MS;
+    clock_base_tick = now;
+    result = clock_base_ms;
+    taskEXIT_CRITICAL();
+
+    return result;
+}
+
+/*******************************************************************************
+* Function Name: wall_clock_set
+********************************************************************************
+* Summary:
+*  Set the calendar time
+*
+* Parameters:
+*  time: New time (millisecond and valid are ignored)
+*
+* Return:
+*  0 on success, -1 if a field is out of range
+*
+*******************************************************************************/
+int wall_clock_set(const wall_clock_time_t *time)
+{
+    uint64_t ms;
+
+    if ((time->year < 2000u) || (time->year > 2099u) ||
+        (time->month < 1u) || (time->month > 12u) ||
+        (time->day < 1u) || (time->day > 31u) ||
+        (time->hour > 23u) || (time->minute > 59u) || (time->second > 59u)) {
+        return -1;
+    }
+
+    ms = (uint64_t)wall_clock_days_from_civil(time->year, time->month, time->day) * WALL_CLOCK_MS_PER_DAY
+         + ((uint64_t)time->hour * 3600u + (uint64_t)time->minute * 60u + time->second) * 1000u;
+
+    taskENTER_CRITICAL();
+    clock_base_ms = ms;
+    clock_base_tick = xTaskGetTickCount();
+    clock_initialized = true;
+    clock_valid = true;
+    taskEXIT_CRITICAL();
+
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: wall_clock_get
+********************************************************************************
+* Summary:
+*  Read the calendar time
+*
+* Parameters:
+*  time: Output - current time; valid is false until the clock has been set
+*
+*******************************************************************************/
+void wall_clock_get(wall_clock_time_t *time)
+{
+    wall_clock_from_ms(wall_clock_now_ms(), time);
+    time->valid = clock_valid;
+}
+
+/*******************************************************************************
+* Function Name: wall_clock_ms_since_midnight
+********************************************************************************
+* Summary:
+*  Time of day of a wall_clock_get() result in milliseconds
+*
+*******************************************************************************/
+uint32_t wall_clock_ms_since_midnight(const wall_clock_time_t *time)
+{
+    return ((uint32_t)time->hour * 3600u + (uint32_t)time->minute * 60u + time->second) * 1000u
+           + time->millisecond;
+}
+
+/*******************************************************************************
+* Function Name: wall_clock_add_ms
+********************************************************************************
+* Summary:
+*  Time a number of milliseconds after another, e.g. of a sample in a take
+*
+* Parameters:
+*  base: Starting time from wall_clock_get()
+*  ms: Offset
+*  result: Output - base + ms, with the same valid flag
+*
+*******************************************************************************/
+void wall_clock_add_ms(const wall_clock_time_t *base, uint32_t ms, wall_clock_time_t *result)
+{
+    uint64_t total = (uint64_t)wall_clock_days_from_civil(base->year, base->month, base->day)
+                     * WALL_CLOCK_MS_PER_DAY + wall_clock_ms_since_midnight(base) + ms;
+    bool valid = base->valid;
+
+    wall_clock_from_ms(total, result);
+    result->valid = valid;
+}
@@ -0,0 +1,55 @@
+/******************************************************************************
+* File Name: wall_clock.h
+*
+* Description: Calendar time kept from the RTOS tick
+*              Set from the CLI ('time'); until then it runs from a fixed
+*              default so file timestamps stay plausible
+*
+*******************************************************************************/
+
+#ifndef __WALL_CLOCK_H__
+#define __WALL_CLOCK_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+/* Time reported before the clock is set */
+#define WALL_CLOCK_DEFAULT_YEAR     (2026u)
+#define WALL_CLOCK_DEFAULT_MONTH    (1u)
+#define WALL_CLOCK_DEFAULT_DAY      (21u)
+#define WALL_CLOCK_DEFAULT_HOUR     (12u)
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+typedef struct {
+    uint16_t year;              /* 2000..2099 */
+    uint8_t  month;             /* 1..12 */
+    uint8_t  day;               /* 1..31 */
+    uint8_t  hour;
+    uint8_t  minute;
+    uint8_t  second;
+    uint16_t millisecond;
+    bool     valid;             /* Set by wall_clock_set() since boot */
+} wall_clock_time_t;
+
+/*******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+int wall_clock_set(const wall_clock_time_t *time);
+void wall_clock_get(wall_clock_time_t *time);
+uint32_t wall_clock_ms_since_midnight(const wall_clock_time_t *time);
+void wall_clock_add_ms(const wall_clock_time_t *base, uint32_t ms, wall_clock_time_t *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __WALL_CLOCK_H__ */
@@ -1,12 +1,16 @@
 /******************************************************************************
 * File Name: wav_file.c
 *
-* Description: WAV file header generation implementation
+* Description: WAV file header generation and parsing implementation
 *
 *******************************************************************************/
 
 #include "wav_file.h"
+#include "settings.h"
 #include "FS.h"
+#include <stdbool.h>
+#include <math.h>
+#include <stdio.h>
 #include <string.h>
 
 /*******************************************************************************
@@ -118,3 +122,650 @@ int wav_file_save(const char *filename,
     
     return 0;  /* Success */
 }
+
+/* KSDATAFORMAT_SUBTYPE_PCM, as stored in WAVEFORMATEXTENSIBLE.SubFormat */
+static const uint8_t wav_subformat_pcm[16] = {
+    0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00,
+    0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71
+};
+
+/*******************************************************************************
+* Function Name: wav_le16 / wav_le32
+********************************************************************************
+* Summary:
+*  Read a little endian field from a byte buffer
+*
+*******************************************************************************/
+static uint16_t wav_le16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t wav_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/*******************************************************************************
+* Function Name: wav_chunk_first
+********************************************************************************
+* Summary:
+*  Validate the RIFF/WAVE header and find where the chunk list ends
+*  - The RIFF size is trusted only if it fits in the file; a truncated file
+*    or one whose writer never patched the size ends at the file size
+*  - The first chunk header is at WAV_RIFF_HEADER_SIZE
+*
+* Parameters:
+*  file: Opened file handle
+*  riff_end: Output - file offset just past the last chunk
+*
+* Return:
+*  0 on success, -1 on error
+*
+*******************************************************************************/
+int wav_chunk_first(FS_FILE *file, uint32_t *riff_end)
+{
+    uint8_t header[WAV_RIFF_HEADER_SIZE];
+    uint32_t file_size;
+    uint64_t end;
+
+    if ((FS_FSeek(file, 0, FS_SEEK_SET) != 0) ||
+        (FS_Read(file, header, sizeof(header)) != sizeof(header))) {
+        printf("[WavFile] Error: Failed to read RIFF header\r\n");
+        return -1;
+    }
+
+    if (memcmp(&header[0], "RIFF", 4) != 0) {
+        printf("[WavFile] Error: Invalid RIFF header\r\n");
+        return -1;
+    }
+    if (memcmp(&header[8], "WAVE", 4) != 0) {
+        printf("[WavFile] Error: Invalid WAVE header\r\n");
+        return -1;
+    }
+
+    file_size = FS_GetFileSize(file);
+    end = (uint64_t)wav_le32(&header[4]) + 8u;
+    if (end > file_size) {
+        end = file_size;
+    }
+    if (end > INT32_MAX) {
+        end = INT32_MAX;    /* FS_FSeek() takes a signed offset */
+    }
+
+    *riff_end = (uint32_t)end;
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: wav_chunk_next
+********************************************************************************
+* Summary:
+*  Read the chunk header at a file offset without reading the body
+*  - A chunk must end inside the RIFF list; only a "data" chunk that runs
+*    past it is accepted, shortened to what is in the file (recordings cut
+*    off before the header was finalized)
+*  - chunk->next includes the pad byte of odd-sized chunks
+*
+* Parameters:
+*  file: Opened file handle
+*  position: File offset of the chunk header (chunk->next of the previous one)
+*  riff_end: From wav_chunk_first()
+*  chunk: Output - chunk ID, size and location
+*
+* Return:
+*  0 on success, -1 at the end of the list or on a malformed chunk
+*
+*******************************************************************************/
+int wav_chunk_next(FS_FILE *file, uint32_t position, uint32_t riff_end, wav_chunk_t *chunk)
+{
+    uint8_t header[WAV_CHUNK_HEADER_SIZE];
+    uint64_t body_end;
+
+    if ((riff_end < WAV_CHUNK_HEADER_SIZE) || (position > riff_end - WAV_CHUNK_HEADER_SIZE)) {
+        return -1;
+    }
+    if ((FS_FSeek(file, (I32)position, FS_SEEK_SET) != 0) ||
+        (FS_Read(file, header, sizeof(header)) != sizeof(header))) {
+        return -1;
+    }
+
+    memcpy(chunk->id, header, sizeof(chunk->id));
+    chunk->size = wav_le32(&header[4]);
+    chunk->offset = position + WAV_CHUNK_HEADER_SIZE;
+
+    body_end = (uint64_t)chunk->offset + chunk->size;
+    if (body_end > riff_end) {
+        if (memcmp(chunk->id, "data", 4) != 0) {
+            printf("[WavFile] Error: Chunk '%.4s' exceeds the file\r\n", (const char *)chunk->id);
+            return -1;
+        }
+        chunk->size = riff_end - chunk->offset;
+        body_end = riff_end;
+    }
+
+    body_end += (chunk->size & 1u);
+    chunk->next = (body_end > riff_end) ? riff_end : (uint32_t)body_end;
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: wav_parse_fmt
+********************************************************************************
+* Summary:
+*  Decode a "fmt " chunk body; WAVE_FORMAT_EXTENSIBLE is accepted when its
+*  sub-format is integer PCM and is reported as WAV_FORMAT_PCM
+*
+* Parameters:
+*  file: Positioned at the chunk body
+*  chunk: The "fmt " chunk
+*  info: Output - format fields
+*
+* Return:
+*  0 on success, -1 on error
+*
+*******************************************************************************/
+static int wav_parse_fmt(FS_FILE *file, const wav_chunk_t *chunk, wav_info_t *info)
+{
+    uint8_t fmt[WAV_FMT_EXTENSIBLE_SIZE];
+    uint32_t length = (chunk->size < sizeof(fmt)) ? chunk->size : sizeof(fmt);
+
+    if (chunk->size < WAV_FMT_MIN_SIZE) {
+        printf("[WavFile] Error: fmt chunk too short (%u bytes)\r\n", (unsigned int)chunk->size);
+        return -1;
+    }
+    if (FS_Read(file, fmt, length) != length) {
+        printf("[WavFile] Error: Failed to read fmt chunk\r\n");
+        return -1;
+    }
+
+    info->audio_format = wav_le16(&fmt[0]);
+    info->num_channels = wav_le16(&fmt[2]);
+    info->sample_rate = wav_le32(&fmt[4]);
+    info->block_align = wav_le16(&fmt[12]);
+    info->bits_per_sample = wav_le16(&fmt[14]);
+
+    if (info->audio_format == WAV_FORMAT_EXTENSIBLE) {
+        /* cbSize, wValidBitsPerSample, dwChannelMask, SubFormat */
+        if ((length < WAV_FMT_EXTENSIBLE_SIZE) || (wav_le16(&fmt[16]) < 22u)) {
+            printf("[WavFile] Error: Truncated WAVE_FORMAT_EXTENSIBLE\r\n");
+            return -1;
+        }
+        if (memcmp(&fmt[24], wav_subformat_pcm, sizeof(wav_subformat_pcm)) != 0) {
+            printf("[WavFile] Error: Only PCM sub-format supported\r\n");
+            return -1;
+        }
+        if (wav_le16(&fmt[18]) > info->bits_per_sample) {
+            printf("[WavFile] Error: %d valid bits in a %d-bit container\r\n",
+                   wav_le16(&fmt[18]), info->bits_per_sample);
+            return -1;
+        }
+        info->audio_format = WAV_FORMAT_PCM;
+    }
+
+    if (info->audio_format != WAV_FORMAT_PCM) {
+        printf("[WavFile] Error: Only PCM format supported (format=%d)\r\n",
+               info->audio_format);
+        return -1;
+    }
+
+    if ((info->num_channels == 0) || (info->bits_per_sample == 0) ||
+        (info->block_align != info->num_channels * ((info->bits_per_sample + 7u) / 8u))) {
+        printf("[WavFile] Error: Inconsistent fmt chunk\r\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: wav_parse
+********************************************************************************
+* Summary:
+*  Walk the RIFF chunks of a WAV file and locate its format and samples
+*  - Only chunk headers are read; LIST, fact, JUNK, bext and other chunks
+*    are skipped with one seek each
+*  - "fmt " and "data" may appear in either order
+*  - At most WAV_MAX_CHUNKS chunks are examined
+*  - On success the file is positioned at the first sample and data_bytes
+*    is a whole number of frames
+*
+* Parameters:
+*  file: Opened file handle
+*  info: Output - format and data location
+*
+* Return:
+*  0 on success, -1 on error
+*
+*******************************************************************************/
+int wav_parse(FS_FILE *file, wav_info_t *info)
+{
+    wav_chunk_t chunk;
+    uint32_t riff_end;
+    uint32_t position = WAV_RIFF_HEADER_SIZE;
+    bool fmt_found = false;
+    bool data_found = false;
+    uint32_t count;
+
+    memset(info, 0, sizeof(*info));
+
+    if (wav_chunk_first(file, &riff_end) != 0) {
+        return -1;
+    }
+
+    for (count = 0; (count < WAV_MAX_CHUNKS) && !(fmt_found && data_found); count++) {
+        if (wav_chunk_next(file, position, riff_end, &chunk) != 0) {
+            break;
+        }
+
+        if (!fmt_found && (memcmp(chunk.id, "fmt ", 4) == 0)) {
+            if (wav_parse_fmt(file, &chunk, info) != 0) {
+                return -1;
+            }
+            fmt_found = true;
+        } else if (!data_found && (memcmp(chunk.id, "data", 4) == 0)) {
+            info->data_offset = chunk.offset;
+            info->data_bytes = chunk.size;
+            data_found = true;
+        }
+
+        position = chunk.next;
+    }
+
+    if (!fmt_found) {
+        printf("[WavFile] Error: No fmt chunk\r\n");
+        return -1;
+    }
+    if (!data_found) {
+        printf("[WavFile] Error: No data chunk\r\n");
+        return -1;
+    }
+
+    info->data_bytes -= info->data_bytes % info->block_align;
+
+    if (FS_FSeek(file, (I32)info->data_offset, FS_SEEK_SET) != 0) {
+        printf("[WavFile] Error: Seek to data failed\r\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: parse_wav_header
+********************************************************************************
+* Summary:
+*  Parse and validate a WAV file for playback
+*  - Accepts only the stereo 16-bit PCM the codec path plays
+*  - Leaves the file positioned at the first sample
+*
+* Parameters:
+*  file: Opened file handle
+*  total_samples: Output - total samples (stereo counted as 2)
+*
+* Return:
+*  0 on success, -1 on error
+*
+*******************************************************************************/
+int parse_wav_header(FS_FILE *file, uint32_t *total_samples)
+{
+    wav_info_t info;
+
+    if (wav_parse(file, &info) != 0) {
+        return -1;
+    }
+    
+    /* Validate sample rate */
+    if (info.sample_rate != WAV_SAMPLE_RATE) {
+        printf("[WavFile] Warning: Sample rate %u Hz (expected %d Hz)\r\n", 
+               (unsigned int)info.sample_rate, WAV_SAMPLE_RATE);
+    }
+    
+    /* Validate channels */
+    if (info.num_channels != WAV_NUM_CHANNELS) {
+        printf("[WavFile] Error: Expected %d channels, got %d\r\n",
+               WAV_NUM_CHANNELS, info.num_channels);
+        return -1;
+    }
+    
+    /* Validate bit depth */
+    if (info.bits_per_sample != WAV_BITS_PER_SAMPLE) {
+        printf("[WavFile] Error: Expected %d-bit, got %d-bit\r\n",
+               WAV_BITS_PER_SAMPLE, info.bits_per_sample);
+        return -1;
+    }
+    
+    /* Calculate total samples (L+R counted separately) */
+    *total_samples = info.data_bytes / sizeof(int16_t);
+    
+    printf("[WavFile] WAV: %u Hz, %d ch, %d bit, %u samples at offset %u\r\n",
+           (unsigned int)info.sample_rate, info.num_channels, 
+           info.bits_per_sample, (unsigned int)*total_samples,
+           (unsigned int)info.data_offset);
+    
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: wav_stats_reset
+********************************************************************************
+* Summary:
+*  Clear the running statistics at the start of a take
+*
+*******************************************************************************/
+void wav_stats_reset(wav_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+/*******************************************************************************
+* Function Name: wav_stats_update
+********************************************************************************
+* Summary:
+*  Fold newly captured samples into the running statistics, so the take
+*  chunk can be written without a second pass over the audio
+*
+* Parameters:
+*  stats: Running statistics
+*  pcm: Interleaved samples (WAV_NUM_CHANNELS per frame)
+*  num_samples: Samples at pcm; a partial trailing frame is ignored
+*
+*******************************************************************************/
+void wav_stats_update(wav_stats_t *stats, const int16_t *pcm, uint32_t num_samples)
+{
+    uint32_t frames = num_samples / WAV_NUM_CHANNELS;
+
+    for (uint32_t ch = 0; ch < WAV_NUM_CHANNELS; ch++) {
+        const int16_t *sample = &pcm[ch];
+        uint32_t peak = stats->peak[ch];
+        uint32_t clipped = 0;
+        uint64_t sum = 0;
+
+        for (uint32_t i = 0; i < frames; i++) {
+            int32_t value = *sample;
+            uint32_t magnitude = (uint32_t)((value < 0) ? -value : value);
+
+            if (magnitude > peak) {
+                peak = magnitude;
+            }
+            if ((value == INT16_MAX) || (value == INT16_MIN)) {
+                clipped++;
+            }
+            sum += (uint32_t)(value * value);
+            sample += WAV_NUM_CHANNELS;
+        }
+
+        stats->peak[ch] = (uint16_t)peak;
+        stats->clipped[ch] += clipped;
+        stats->sum_squares[ch] += sum;
+    }
+    stats->frames += frames;
+}
+
+/*******************************************************************************
+* Function Name: wav_bext_init
+********************************************************************************
+* Summary:
+*  Fill a Broadcast Wave bext chunk for a take
+*
+* Parameters:
+*  bext: Output
+*  description: Free text, truncated to 255 characters
+*  device_id: Silicon unique ID, stored as the originator reference
+*  start: Wall clock time of the first sample
+*  sample_rate: Used to express the time reference in samples
+*
+*******************************************************************************/
+void wav_bext_init(wav_bext_t *bext, const char *description, uint64_t device_id,
+                   const wall_clock_time_t *start, uint32_t sample_rate)
+{
+    char text[24];
+    uint64_t time_reference;
+
+    memset(bext, 0, sizeof(*bext));
+
+    strncpy(bext->description, description, sizeof(bext->description) - 1);
+    strncpy(bext->originator, WAV_BEXT_ORIGINATOR, sizeof(bext->originator));
+    snprintf(bext->originator_reference, sizeof(bext->originator_reference), "E84-%08X%08X",
+             (unsigned int)(device_id >> 32), (unsigned int)device_id);
+
+    /* Fixed-width text fields, not NUL terminated */
+    snprintf(text, sizeof(text), "%04u-%02u-%02u",
+             (unsigned int)start->year, (unsigned int)start->month, (unsigned int)start->day);
+    memcpy(bext->origination_date, text, sizeof(bext->origination_date));
+    snprintf(text, sizeof(text), "%02u:%02u:%02u",
+             (unsigned int)start->hour, (unsigned int)start->minute, (unsigned int)start->second);
+    memcpy(bext->origination_time, text, sizeof(bext->origination_time));
+
+    time_reference = ((uint64_t)wall_clock_ms_since_midnight(start) * sample_rate) / 1000u;
+    bext->time_reference_low = (uint32_t)time_reference;
+    bext->time_reference_high = (uint32_t)(time_reference >> 32);
+    bext->version = WAV_BEXT_VERSION;
+}
+
+/*******************************************************************************
+* Function Name: wav_take_init
+********************************************************************************
+* Summary:
+*  Fill the take chunk from the running statistics; the caller adds the
+*  gain, fault counters and flags
+*
+*******************************************************************************/
+void wav_take_init(wav_take_t *take, const wav_stats_t *stats, uint32_t sample_rate)
+{
+    memset(take, 0, sizeof(*take));
+
+    take->version = WAV_TAKE_VERSION;
+    take->sample_rate = sample_rate;
+    take->num_channels = WAV_NUM_CHANNELS;
+    take->frames = stats->frames;
+
+    for (uint32_t ch = 0; ch < WAV_NUM_CHANNELS; ch++) {
+        take->peak[ch] = stats->peak[ch];
+        take->clipped[ch] = stats->clipped[ch];
+        if (stats->frames > 0) {
+            take->rms[ch] = (uint16_t)sqrtf((float)(stats->sum_squares[ch] / stats->frames));
+        }
+    }
+
+    snprintf(take->firmware, sizeof(take->firmware), "%s %s", APP_VERSION_STRING, __DATE__);
+}
+
+/*******************************************************************************
+* Function Name: wav_write_chunk_header
+********************************************************************************
+* Summary:
+*  Write an 8-byte chunk header
+*
+*******************************************************************************/
+static int wav_write_chunk_header(FS_FILE *file, const char *id, uint32_t size)
+{
+    uint8_t header[WAV_CHUNK_HEADER_SIZE];
+
+    memcpy(header, id, 4);
+    memcpy(&header[4], &size, sizeof(size));
+    return (FS_Write(file, header, sizeof(header)) == sizeof(header)) ? 0 : -1;
+}
+
+/*******************************************************************************
+* Function Name: wav_write_samples
+********************************************************************************
+* Summary:
+*  Write samples in pieces of the 'write_slice' setting, at most
+*  WAV_WRITE_SLICE_BYTES. emFile holds its lock for a whole FS_Write call,
+*  so one call for a long take would hold off a playback read for its full
+*  duration.
+*
+*******************************************************************************/
+static int wav_write_samples(FS_FILE *file, const int16_t *pcm, uint32_t num_bytes)
+{
+    const uint8_t *data = (const uint8_t *)pcm;
+    uint32_t slice = (uint32_t)app_settings.write_slice_bytes;
+
+    while (num_bytes > 0u) {
+        uint32_t length = (num_bytes < slice) ? num_bytes : slice;
+        if (FS_Write(file, data, length) != length) {
+            return -1;
+        }
+        data += length;
+        num_bytes -= length;
+    }
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: wav_write_take
+********************************************************************************
+* Summary:
+*  Write a complete recording:
+*    RIFF | fmt | bext | JUNK | data | take [| gred]
+*  - JUNK pads the header so the samples start at WAV_DATA_ALIGN, letting
+*    emFile write the data chunk in whole sectors
+*  - take follows the data so a writer that streams samples can append it
+*    once capture ends; readers find it by walking chunk headers
+*
+* Parameters:
+*  file: Opened for writing, positioned at 0
+*  pcm: Interleaved samples
+*  num_samples: Samples at pcm (L+R counted separately)
+*  bext: Broadcast Wave chunk body
+*  take: Statistics chunk body
+*  gred: Compressor chunk header, or NULL for none
+*  reduction: gred->count trace entries following it
+*
+* Return:
+*  0 on success, -1 on error
+*
+*******************************************************************************/
+int wav_write_take(FS_FILE *file, const int16_t *pcm, uint32_t num_samples,
+                   const wav_bext_t *bext, const wav_take_t *take,
+                   const wav_gred_t *gred, const uint8_t *reduction)
+{
+    static const uint8_t zeros[64] = { 0 };
+    wav_header_t header;
+    uint32_t data_bytes = num_samples * sizeof(int16_t);
+    uint32_t position;
+    uint32_t junk_bytes;
+    uint32_t gred_bytes = (gred != NULL) ? (sizeof(wav_gred_t) + gred->count) : 0u;
+    uint32_t riff_size;
+
+    /* Header layout up to the data chunk body */
+    position = 36u + WAV_CHUNK_HEADER_SIZE + sizeof(wav_bext_t);
+    junk_bytes = WAV_DATA_ALIGN - ((position + 2u * WAV_CHUNK_HEADER_SIZE) % WAV_DATA_ALIGN);
+    if (junk_bytes == WAV_DATA_ALIGN) {
+        junk_bytes = 0;
+    }
+
+    riff_size = (position - 8u) + WAV_CHUNK_HEADER_SIZE + junk_bytes +
+                WAV_CHUNK_HEADER_SIZE + data_bytes + (data_bytes & 1u) +
+                WAV_CHUNK_HEADER_SIZE + sizeof(wav_take_t);
+    if (gred != NULL) {
+        riff_size += WAV_CHUNK_HEADER_SIZE + gred_bytes + (gred_bytes & 1u);
+    }
+
+    /* RIFF and fmt come from the canonical header; the data header is
+     * written separately */
+    wav_header_init(&header, num_samples / WAV_NUM_CHANNELS);
+    header.wav_size = riff_size;
+    if (FS_Write(file, &header, 36u) != 36u) {
+        return -1;
+    }
+
+    if ((wav_write_chunk_header(file, "bext", sizeof(wav_bext_t)) != 0) ||
+        (FS_Write(file, bext, sizeof(wav_bext_t)) != sizeof(wav_bext_t))) {
+        return -1;
+    }
+
+    if (wav_write_chunk_header(file, "JUNK", junk_bytes) != 0) {
+        return -1;
+    }
+    while (junk_bytes > 0) {
+        uint32_t length = (junk_bytes < sizeof(zeros)) ? junk_bytes : sizeof(zeros);
+        if (FS_Write(file, zeros, length) != length) {
+            return -1;
+        }
+        junk_bytes -= length;
+    }
+
+    if ((wav_write_chunk_header(file, "data", data_bytes) != 0) ||
+        (wav_write_samples(file, pcm, data_bytes) != 0)) {
+        return -1;
+    }
+    if (((data_bytes & 1u) != 0) && (FS_Write(file, zeros, 1u) != 1u)) {
+        return -1;
+    }
+
+    if ((wav_write_chunk_header(file, "take", sizeof(wav_take_t)) != 0) ||
+        (FS_Write(file, take, sizeof(wav_take_t)) != sizeof(wav_take_t))) {
+        return -1;
+    }
+
+    if (gred != NULL) {
+        if ((wav_write_chunk_header(file, "gred", gred_bytes) != 0) ||
+            (FS_Write(file, gred, sizeof(wav_gred_t)) != sizeof(wav_gred_t)) ||
+            (FS_Write(file, reduction, gred->count) != gred->count)) {
+            return -1;
+        }
+        if (((gred_bytes & 1u) != 0) && (FS_Write(file, zeros, 1u) != 1u)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: wav_read_metadata
+********************************************************************************
+* Summary:
+*  Read the bext date/time and the take chunk by walking chunk headers; the
+*  audio is skipped with a seek, never read
+*
+* Parameters:
+*  file: Opened file handle
+*  meta: Output - has_bext/has_take tell which parts were found
+*
+* Return:
+*  0 if the file is a RIFF/WAVE file, -1 otherwise
+*
+*******************************************************************************/
+int wav_read_metadata(FS_FILE *file, wav_metadata_t *meta)
+{
+    wav_chunk_t chunk;
+    uint32_t riff_end;
+    uint32_t position = WAV_RIFF_HEADER_SIZE;
+    char stamp[18];
+
+    memset(meta, 0, sizeof(*meta));
+
+    if (wav_chunk_first(file, &riff_end) != 0) {
+        return -1;
+    }
+
+    for (uint32_t count = 0; count < WAV_MAX_CHUNKS; count++) {
+        if ((meta->has_bext && meta->has_take) ||
+            (wav_chunk_next(file, position, riff_end, &chunk) != 0)) {
+            break;
+        }
+
+        if (!meta->has_bext && (memcmp(chunk.id, "bext", 4) == 0) &&
+            (chunk.size >= WAV_BEXT_TIME_OFFSET + sizeof(stamp)) &&
+            (FS_FSeek(file, (I32)(chunk.offset + WAV_BEXT_TIME_OFFSET), FS_SEEK_SET) == 0) &&
+            (FS_Read(file, stamp, sizeof(stamp)) == sizeof(stamp))) {
+            memcpy(meta->date, &stamp[0], 10);
+            memcpy(meta->time, &stamp[10], 8);
+            meta->has_bext = true;
+        } else if (!meta->has_take && (memcmp(chunk.id, "take", 4) == 0)) {
+            uint32_t length = (chunk.size < sizeof(wav_take_t)) ? chunk.size : sizeof(wav_take_t);
+            if ((FS_Read(file, &meta->take, length) == length) &&
+                (meta->take.version == WAV_TAKE_VERSION)) {
+                meta->has_take = true;
+            }
+        }
+
+        position = chunk.next;
+    }
+
+    return 0;
+}
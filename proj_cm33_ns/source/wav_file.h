@@ -1,7 +1,7 @@
 /******************************************************************************
 * File Name: wav_file.h
 *
-* Description: WAV file header generation utilities
+* Description: WAV file header generation and parsing utilities
 *
 *******************************************************************************/
 
@@ -9,6 +9,9 @@
 #define __WAV_FILE_H__
 
 #include <stdint.h>
+#include <stdbool.h>
+#include "FS.h"
+#include "wall_clock.h"
 
 #if defined(__cplusplus)
 extern "C" {
@@ -22,6 +25,32 @@ extern "C" {
 #define WAV_BITS_PER_SAMPLE         (16u)
 #define WAV_NUM_CHANNELS            (2u)
 
+/* RIFF chunk walking */
+#define WAV_RIFF_HEADER_SIZE        (12u)       /* "RIFF", size, "WAVE" */
+#define WAV_CHUNK_HEADER_SIZE       (8u)        /* Chunk ID, body size */
+#define WAV_MAX_CHUNKS              (32u)       /* Chunks examined before giving up */
+#define WAV_FMT_MIN_SIZE            (16u)       /* WAVEFORMAT + bits per sample */
+#define WAV_FMT_EXTENSIBLE_SIZE     (40u)       /* WAVEFORMATEXTENSIBLE */
+#define WAV_FORMAT_PCM              (0x0001u)
+#define WAV_FORMAT_EXTENSIBLE       (0xFFFEu)
+
+/* Recording metadata */
+#define WAV_DATA_ALIGN              (512u)      /* Samples start on a sector boundary */
+#define WAV_WRITE_SLICE_BYTES       (16384u)    /* Samples written per FS_Write; emFile's lock is
+                                                 * free between slices for playback reads */
+#define WAV_BEXT_VERSION            (1u)        /* EBU Tech 3285 v1, no loudness fields */
+#define WAV_BEXT_TIME_OFFSET        (320u)      /* OriginationDate within the bext body */
+#define WAV_BEXT_ORIGINATOR         "PSoC Edge E84 PDM recorder"
+#define WAV_TAKE_VERSION            (1u)
+#define WAV_TAKE_FLAG_CLOCK_SET     (1u << 0)   /* bext date/time came from a set clock */
+#define WAV_TAKE_FLAG_TRUNCATED     (1u << 1)   /* Capture ran past the record buffer */
+#define WAV_TAKE_FLAG_COMPRESSED    (1u << 2)   /* Capture compressor/limiter was on */
+#define WAV_GRED_VERSION            (1u)
+
+#ifndef APP_VERSION_STRING
+#define APP_VERSION_STRING          "1.0.0"
+#endif
+
 /*******************************************************************************
 * Structures
 *******************************************************************************/
@@ -47,6 +76,93 @@ typedef struct __attribute__((packed)) {
     uint32_t data_bytes;            /* num_samples * num_channels * bits_per_sample/8 */
 } wav_header_t;
 
+/* Header of one RIFF chunk, located in the file */
+typedef struct {
+    uint8_t  id[4];                 /* Chunk ID, e.g. "fmt ", "data", "LIST" */
+    uint32_t size;                  /* Body size from the file (no pad byte) */
+    uint32_t offset;                /* File offset of the body */
+    uint32_t next;                  /* File offset of the next chunk header */
+} wav_chunk_t;
+
+/* Format and data location of a parsed WAV file */
+typedef struct {
+    uint16_t audio_format;          /* WAV_FORMAT_PCM or WAV_FORMAT_EXTENSIBLE */
+    uint16_t num_channels;
+    uint32_t sample_rate;
+    uint16_t block_align;
+    uint16_t bits_per_sample;
+    uint32_t data_offset;           /* File offset of the first sample */
+    uint32_t data_bytes;            /* Sample bytes, limited to the file size */
+} wav_info_t;
+
+/* Broadcast Wave "bext" chunk body (EBU Tech 3285), no coding history */
+typedef struct __attribute__((packed)) {
+    char     description[256];
+    char     originator[32];
+    char     originator_reference[32];
+    char     origination_date[10];  /* yyyy-mm-dd */
+    char     origination_time[8];   /* hh:mm:ss */
+    uint32_t time_reference_low;    /* First sample, counted from midnight */
+    uint32_t time_reference_high;
+    uint16_t version;               /* WAV_BEXT_VERSION */
+    uint8_t  umid[64];
+    int16_t  loudness[5];           /* v2 loudness fields, zero in v1 */
+    uint8_t  reserved[180];
+} wav_bext_t;                       /* 602 bytes */
+
+/* Per-take statistics, "take" chunk body (little endian) */
+typedef struct __attribute__((packed)) {
+    uint16_t version;               /* WAV_TAKE_VERSION */
+    uint16_t flags;                 /* WAV_TAKE_FLAG_* */
+    uint32_t sample_rate;
+    uint16_t num_channels;
+    int16_t  gain_db;               /* PDM gain setting */
+    uint32_t frames;                /* Frames in the data chunk */
+    uint32_t pdm_overflows;         /* PDM FIFO/filter overflow interrupts */
+    uint32_t pdm_underflows;        /* PDM FIFO underflow interrupts */
+    uint32_t frames_dropped;        /* Captured after the record buffer was full */
+    uint16_t peak[WAV_NUM_CHANNELS];    /* Largest |sample| */
+    uint16_t rms[WAV_NUM_CHANNELS];     /* Root mean square */
+    uint32_t clipped[WAV_NUM_CHANNELS]; /* Samples at full scale */
+    char     firmware[24];          /* APP_VERSION_STRING and build date */
+} wav_take_t;
+
+/* Capture compressor settings and gain reduction trace, "gred" chunk body
+ * (little endian); count entries of one byte follow, each the largest gain
+ * reduction in one interval, in steps of 1/steps_per_db dB */
+typedef struct __attribute__((packed)) {
+    uint16_t version;               /* WAV_GRED_VERSION */
+    uint16_t steps_per_db;
+    uint32_t interval_frames;
+    uint32_t lead_frames;           /* First interval starts this long before the data */
+    uint32_t count;
+    uint8_t  threshold_db;          /* Below full scale */
+    uint8_t  ratio;                 /* n:1 */
+    uint8_t  ceiling_db;            /* Below full scale */
+    uint8_t  makeup_db;
+    uint16_t attack_ms;
+    uint16_t release_ms;
+    uint16_t lookahead_ms;
+    uint16_t reserved;
+} wav_gred_t;
+
+/* Running sums behind wav_take_t, updated as samples arrive */
+typedef struct {
+    uint32_t frames;
+    uint16_t peak[WAV_NUM_CHANNELS];
+    uint32_t clipped[WAV_NUM_CHANNELS];
+    uint64_t sum_squares[WAV_NUM_CHANNELS];
+} wav_stats_t;
+
+/* Metadata read back by the catalog */
+typedef struct {
+    bool has_bext;
+    bool has_take;
+    char date[11];                  /* From bext, NUL terminated */
+    char time[9];
+    wav_take_t take;
+} wav_metadata_t;
+
 /*******************************************************************************
 * Function Prototypes
 *******************************************************************************/
@@ -55,6 +171,19 @@ int wav_file_save(const char *filename,
                   const wav_header_t *wav_header, 
                   const int16_t *pcm_buffer, 
                   uint32_t num_samples);
+int wav_chunk_first(FS_FILE *file, uint32_t *riff_end);
+int wav_chunk_next(FS_FILE *file, uint32_t position, uint32_t riff_end, wav_chunk_t *chunk);
+int wav_parse(FS_FILE *file, wav_info_t *info);
+int parse_wav_header(FS_FILE *file, uint32_t *total_samples);
+void wav_stats_reset(wav_stats_t *stats);
+void wav_stats_update(wav_stats_t *stats, const int16_t *pcm, uint32_t num_samples);
+void wav_bext_init(wav_bext_t *bext, const char *description, uint64_t device_id,
+                   const wall_clock_time_t *start, uint32_t sample_rate);
+void wav_take_init(wav_take_t *take, const wav_stats_t *stats, uint32_t sample_rate);
+int wav_write_take(FS_FILE *file, const int16_t *pcm, uint32_t num_samples,
+                   const wav_bext_t *bext, const wav_take_t *take,
+                   const wav_gred_t *gred, const uint8_t *reduction);
+int wav_read_metadata(FS_FILE *file, wav_metadata_t *meta);
 
 #ifdef __cplusplus
 }
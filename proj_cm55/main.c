@@ -43,6 +43,9 @@
 *******************************************************************************/
 
 #include "cybsp.h"
+#if defined(MEMBENCH_CM55)
+#include "membench_server.h"
+#endif
 
 /*******************************************************************************
 * Function Name: main
@@ -53,6 +56,9 @@
 * CM33 application enables the CM55 CPU and then the CM55 CPU enters 
 * deep sleep.
 * 
+* Built with MEMBENCH_CM55, the CM55 instead serves memory benchmark
+* requests from the CM33 ('membench' command) and does not sleep.
+* 
 * Parameters:
 *  void
 *
@@ -76,6 +82,11 @@ int main(void)
     /* Enable global interrupts */
     __enable_irq();
 
+#if defined(MEMBENCH_CM55)
+    /* Does not return */
+    membench_server();
+#endif
+
     /* Put the CPU to Deep Sleep */
     for (;;)
     {
@@ -0,0 +1,198 @@
+/******************************************************************************
+* File Name: membench_server.c
+*
+* Description: CM55 side of the memory benchmark
+*              - LOCAL is a buffer in DTCM, XIP the table in this image's
+*                flash, SOCMEM the slice of m33_m55_shared the request names
+*              - The D-cache is on unless a request asks otherwise; the
+*                mailbox lines are invalidated before reading and cleaned
+*                after writing, and a SOCMEM slice is cleaned and
+*                invalidated after a test so the CM33 sees what was written
+*
+*******************************************************************************/
+
+#include "membench_server.h"
+#include "membench_kernels.h"
+#include "cybsp.h"
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define MEMBENCH_SHARED_START       ((uintptr_t)CYMEM_CM55_0_m33_m55_shared_START)
+#define MEMBENCH_SHARED_SIZE        ((uint32_t)CYMEM_CM55_0_m33_m55_shared_SIZE)
+#define MEMBENCH_MAILBOX            ((membench_mailbox_t *)(MEMBENCH_SHARED_START + \
+                                     MEMBENCH_SHARED_SIZE - MEMBENCH_MAILBOX_BYTES))
+
+/*******************************************************************************
+* Local Variables
+*******************************************************************************/
+static uint32_t membench_local[MEMBENCH_LOCAL_BYTES / sizeof(uint32_t)] CY_ALIGN(MEMBENCH_LINE_BYTES);
+
+/*******************************************************************************
+* Function Name: membench_request_line
+********************************************************************************
+* Summary:
+*  Drop the cached copy of the request line before reading it
+*
+*******************************************************************************/
+static void membench_request_line(membench_mailbox_t *mailbox)
+{
+    SCB_InvalidateDCache_by_Addr((void *)&mailbox->request, MEMBENCH_LINE_BYTES);
+}
+
+/*******************************************************************************
+* Function Name: membench_reply
+********************************************************************************
+* Summary:
+*  Write the reply, done last, and push the line out to SOCMEM
+*
+*******************************************************************************/
+static void membench_reply(membench_mailbox_t *mailbox, uint32_t request, int32_t status,
+                           uint32_t cycles)
+{
+    mailbox->status = status;
+    mailbox->cycles = cycles;
+    mailbox->clock_hz = SystemCoreClock;
+    __DSB();
+    mailbox->done = request;
+    SCB_CleanDCache_by_Addr((void *)&mailbox->ready, MEMBENCH_LINE_BYTES);
+    __DSB();
+}
+
+/*******************************************************************************
+* Function Name: membench_slice_valid
+********************************************************************************
+* Summary:
+*  Check that a SOCMEM slice lies inside m33_m55_shared, clear of the mailbox
+*
+*******************************************************************************/
+static bool membench_slice_valid(uint32_t offset)
+{
+    return ((offset % MEMBENCH_LINE_BYTES) == 0u) &&
+           (offset <= (MEMBENCH_SHARED_SIZE - MEMBENCH_MAILBOX_BYTES - MEMBENCH_SLICE_BYTES));
+}
+
+/*******************************************************************************
+* Function Name: membench_run_request
+********************************************************************************
+* Summary:
+*  Run one MEMBENCH_CMD_RUN request
+*
+* Return:
+*  0 on success, -1 if the request is not valid
+*
+*******************************************************************************/
+static int membench_run_request(const membench_mailbox_t *mailbox, uint32_t *cycles)
+{
+    membench_region_t region = (membench_region_t)mailbox->region;
+    membench_test_t test = (membench_test_t)mailbox->test;
+    uint32_t bytes = mailbox->bytes;
+    uint32_t param = mailbox->param;
+    bool dcache_off = ((mailbox->flags & MEMBENCH_FLAG_DCACHE_OFF) != 0u);
+    uint32_t *buf;
+
+    if (region == MEMBENCH_REGION_LOCAL) {
+        buf = membench_local;
+    } else if (region == MEMBENCH_REGION_SOCMEM) {
+        if (!membench_slice_valid(mailbox->socmem_offset)) {
+            return -1;
+        }
+        buf = (uint32_t *)(MEMBENCH_SHARED_START + mailbox->socmem_offset);
+    } else if (region == MEMBENCH_REGION_XIP) {
+        buf = (uint32_t *)(uintptr_t)membench_xip_table;
+    } else {
+        return -1;
+    }
+    if (!membench_test_valid(test, bytes, param, membench_region_bytes(region),
+                             region != MEMBENCH_REGION_XIP)) {
+        return -1;
+    }
+
+    if (dcache_off) {
+        SCB_DisableDCache();        /* Cleans and invalidates first */
+    }
+    *cycles = membench_measure(buf, test, bytes, param, region != MEMBENCH_REGION_XIP);
+    if (dcache_off) {
+        SCB_EnableDCache();         /* Invalidates first */
+    } else if (region == MEMBENCH_REGION_SOCMEM) {
+        SCB_CleanInvalidateDCache_by_Addr((void *)buf, (int32_t)MEMBENCH_SLICE_BYTES);
+    }
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: membench_load
+********************************************************************************
+* Summary:
+*  Copy the first half of a SOCMEM slice to the second until the CM33 sends
+*  the next request. Each copy is cleaned and invalidated, so every pass
+*  reaches SOCMEM instead of staying in the D-cache.
+*
+*******************************************************************************/
+static void membench_load(membench_mailbox_t *mailbox, uint32_t request)
+{
+    uint32_t *slice = (uint32_t *)(MEMBENCH_SHARED_START + mailbox->socmem_offset);
+
+    membench_reply(mailbox, request, 0, 0);
+    do {
+        membench_copy(&slice[MEMBENCH_SLICE_BYTES / (2u * sizeof(uint32_t))], slice,
+                      MEMBENCH_SLICE_BYTES / 2u);
+        SCB_CleanInvalidateDCache_by_Addr((void *)slice, (int32_t)MEMBENCH_SLICE_BYTES);
+        membench_request_line(mailbox);
+    } while (mailbox->request == request);
+}
+
+/*******************************************************************************
+* Function Name: membench_server
+********************************************************************************
+* Summary:
+*  Announce the server in the mailbox, then handle requests forever
+*
+*******************************************************************************/
+void membench_server(void)
+{
+    membench_mailbox_t *mailbox = MEMBENCH_MAILBOX;
+    uint32_t handled;
+
+    DCB->DEMCR |= DCB_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    SCB_EnableDCache();
+
+    /* Requests sent before the server started are not answered */
+    membench_request_line(mailbox);
+    handled = mailbox->request;
+    mailbox->ready = MEMBENCH_READY_MAGIC;
+    membench_reply(mailbox, handled, 0, 0);
+
+    for (;;) {
+        uint32_t request;
+        uint32_t cycles = 0;
+        int32_t status = 0;
+
+        membench_request_line(mailbox);
+        request = mailbox->request;
+        if (request == handled) {
+            continue;
+        }
+        handled = request;
+
+        switch ((membench_cmd_t)mailbox->command) {
+            case MEMBENCH_CMD_RUN:
+                status = membench_run_request(mailbox, &cycles);
+                break;
+            case MEMBENCH_CMD_LOAD:
+                if (membench_slice_valid(mailbox->socmem_offset)) {
+                    membench_load(mailbox, request);
+                    continue;       /* Ended by the next request */
+                }
+                status = -1;
+                break;
+            case MEMBENCH_CMD_STOP:
+                break;
+            default:
+                status = -1;
+                break;
+        }
+        membench_reply(mailbox, request, status, cycles);
+    }
+}
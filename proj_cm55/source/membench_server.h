@@ -0,0 +1,27 @@
+/******************************************************************************
+* File Name: membench_server.h
+*
+* Description: CM55 side of the memory benchmark
+*              Runs the tests the CM33 sends through the mailbox of
+*              shared/include/membench_ipc.h. Built only with MEMBENCH_CM55:
+*              the server polls, so the CM55 no longer sleeps.
+*
+*******************************************************************************/
+
+#ifndef __MEMBENCH_SERVER_H__
+#define __MEMBENCH_SERVER_H__
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+void membench_server(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MEMBENCH_SERVER_H__ */
@@ -0,0 +1,97 @@
+/******************************************************************************
+* File Name: membench_ipc.h
+*
+* Description: Memory benchmark requests from the CM33 to the CM55
+*              The CM33 application drives the benchmark and prints the
+*              results; the CM55 runs the tests it is sent, or copies memory
+*              in a loop as traffic while the CM33 measures. The two talk
+*              through a mailbox in the last MEMBENCH_MAILBOX_BYTES of the
+*              m33_m55_shared SOCMEM region, which the CM33 does not
+*              allocate. The request and the reply each fill one 32-byte
+*              line, so the CM55 can invalidate the one and clean the other
+*              with its D-cache on.
+*
+*              Protocol: the CM33 writes the request fields, then request =
+*              done + 1. The CM55 runs it and writes the reply fields, then
+*              done = request. A load request is acknowledged when the
+*              traffic starts and runs until the next request.
+*
+*******************************************************************************/
+
+#ifndef __MEMBENCH_IPC_H__
+#define __MEMBENCH_IPC_H__
+
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Macros
+*******************************************************************************/
+#define MEMBENCH_MAILBOX_BYTES      (64u)
+#define MEMBENCH_READY_MAGIC        (0x4D42454Eu)   /* "MBEN": CM55 polling */
+#define MEMBENCH_LINE_BYTES         (32u)           /* CM55 D-cache line */
+#define MEMBENCH_LOCAL_BYTES        (16384u)        /* CM33 SRAM / CM55 DTCM buffer */
+#define MEMBENCH_XIP_BYTES          (65536u)        /* Read-only table in each image's flash */
+#define MEMBENCH_SLICE_BYTES        (65536u)        /* SOCMEM per user: CM33 tests, CM55 tests, traffic */
+#define MEMBENCH_BANDWIDTH_BYTES    (16384u)        /* Working set of the read and write tests */
+#define MEMBENCH_LATENCY_LOADS      (2048u)
+#define MEMBENCH_REPS               (5u)            /* Timed runs per test; the median is kept */
+
+/* Request flags */
+#define MEMBENCH_FLAG_DCACHE_OFF    (1u << 0)       /* CM55: run with the D-cache disabled */
+
+/*******************************************************************************
+* Enumerations
+*******************************************************************************/
+typedef enum {
+    MEMBENCH_CMD_RUN = 1,       /* One test; cycles in the reply */
+    MEMBENCH_CMD_LOAD,          /* Copy the slice at socmem_offset until the next request */
+    MEMBENCH_CMD_STOP           /* Ends a load */
+} membench_cmd_t;
+
+typedef enum {
+    MEMBENCH_REGION_LOCAL,      /* CM33 system SRAM, CM55 DTCM */
+    MEMBENCH_REGION_SOCMEM,     /* Slice of m33_m55_shared */
+    MEMBENCH_REGION_XIP,        /* External flash through the XIP cache, read-only */
+    MEMBENCH_REGION_COUNT
+} membench_region_t;
+
+typedef enum {
+    MEMBENCH_TEST_READ,         /* Sequential 32-bit loads over bytes */
+    MEMBENCH_TEST_WRITE,        /* Sequential 32-bit stores over bytes */
+    MEMBENCH_TEST_COPY,         /* First half of bytes to the second half */
+    MEMBENCH_TEST_STRIDE,       /* One load every param bytes over bytes */
+    MEMBENCH_TEST_LATENCY,      /* MEMBENCH_LATENCY_LOADS dependent loads over bytes */
+    MEMBENCH_TEST_COUNT
+} membench_test_t;
+
+/*******************************************************************************
+* Structures
+*******************************************************************************/
+typedef struct {
+    /* Request line, written by the CM33; request last */
+    volatile uint32_t request;      /* Sequence number of the command */
+    volatile uint32_t command;      /* membench_cmd_t */
+    volatile uint32_t region;       /* membench_region_t */
+    volatile uint32_t test;         /* membench_test_t */
+    volatile uint32_t bytes;        /* Working set */
+    volatile uint32_t param;        /* Stride for MEMBENCH_TEST_STRIDE */
+    volatile uint32_t flags;
+    volatile uint32_t socmem_offset;    /* Slice, from the start of m33_m55_shared */
+    /* Reply line, written by the CM55; done last */
+    volatile uint32_t ready;        /* MEMBENCH_READY_MAGIC */
+    volatile uint32_t done;         /* Sequence number of the last command handled */
+    volatile int32_t status;        /* 0, or -1 if the request was not valid */
+    volatile uint32_t cycles;       /* Median of MEMBENCH_REPS runs */
+    volatile uint32_t clock_hz;     /* CM55 core clock */
+    volatile uint32_t reserved[3];
+} membench_mailbox_t;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MEMBENCH_IPC_H__ */
@@ -0,0 +1,49 @@
+/******************************************************************************
+* File Name: membench_kernels.h
+*
+* Description: Memory access loops timed by the memory benchmark
+*              The same code runs on the CM33 and the CM55, from each core's
+*              RAM code region, so the numbers of the two cores differ only
+*              in the memory path. All accesses are single 32-bit loads and
+*              stores through volatile pointers: the compiler neither merges
+*              nor drops them.
+*
+*******************************************************************************/
+
+#ifndef __MEMBENCH_KERNELS_H__
+#define __MEMBENCH_KERNELS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "membench_ipc.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Global Variables
+*******************************************************************************/
+/* MEMBENCH_REGION_XIP: in flash, read through the XIP cache */
+extern const uint32_t membench_xip_table[MEMBENCH_XIP_BYTES / sizeof(uint32_t)];
+
+/*******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+uint32_t membench_read(const uint32_t *buf, uint32_t bytes);
+void membench_write(uint32_t *buf, uint32_t bytes, uint32_t value);
+void membench_copy(uint32_t *dst, const uint32_t *src, uint32_t bytes);
+uint32_t membench_read_stride(const uint32_t *buf, uint32_t stride, uint32_t accesses);
+uint32_t membench_chase(const uint32_t *buf, uint32_t bytes, uint32_t loads);
+bool membench_test_valid(membench_test_t test, uint32_t bytes, uint32_t param,
+                         uint32_t buffer_bytes, bool writable);
+uint32_t membench_measure(uint32_t *buf, membench_test_t test, uint32_t bytes, uint32_t param,
+                          bool writable);
+uint32_t membench_accesses(membench_test_t test, uint32_t bytes, uint32_t param);
+uint32_t membench_region_bytes(membench_region_t region);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MEMBENCH_KERNELS_H__ */
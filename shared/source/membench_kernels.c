@@ -0,0 +1,336 @@
+/******************************************************************************
+* File Name: membench_kernels.c
+*
+* Description: Memory access loops timed by the memory benchmark
+*              Each test is run once untimed, then MEMBENCH_REPS times with
+*              interrupts masked and timed with the DWT cycle counter of the
+*              core running it; the median is returned. The loops run from
+*              RAM (.cy_ramfunc: code SRAM on the CM33, ITCM on the CM55),
+*              so instruction fetches do not share the XIP path with the
+*              loads being measured.
+*
+*******************************************************************************/
+
+#include "membench_kernels.h"
+#include "cy_pdl.h"
+
+/*******************************************************************************
+* Global Variables
+*******************************************************************************/
+/* Zeros, so the latency chain works on it; kept in flash by its own section */
+CY_SECTION(".rodata.membench_xip") CY_ALIGN(MEMBENCH_LINE_BYTES)
+const uint32_t membench_xip_table[MEMBENCH_XIP_BYTES / sizeof(uint32_t)] = { 0 };
+
+/*******************************************************************************
+* Function Name: membench_read
+********************************************************************************
+* Summary:
+*  Sequential loads over a buffer, four per iteration
+*
+* Parameters:
+*  buf: Word aligned
+*  bytes: Multiple of 16
+*
+* Return:
+*  Sum of the words, so the loads have a use
+*
+*******************************************************************************/
+CY_SECTION_RAMFUNC_BEGIN
+uint32_t membench_read(const uint32_t *buf, uint32_t bytes)
+{
+    const volatile uint32_t *p = buf;
+    uint32_t words = bytes / sizeof(uint32_t);
+    uint32_t sum = 0;
+
+    for (uint32_t i = 0; i < words; i += 4u) {
+        sum += p[i] + p[i + 1u] + p[i + 2u] + p[i + 3u];
+    }
+    return sum;
+}
+CY_SECTION_RAMFUNC_END
+
+/*******************************************************************************
+* Function Name: membench_write
+********************************************************************************
+* Summary:
+*  Sequential stores over a buffer, four per iteration
+*
+* Parameters:
+*  buf: Word aligned
+*  bytes: Multiple of 16
+*  value: Stored in every word
+*
+*******************************************************************************/
+CY_SECTION_RAMFUNC_BEGIN
+void membench_write(uint32_t *buf, uint32_t bytes, uint32_t value)
+{
+    volatile uint32_t *p = buf;
+    uint32_t words = bytes / sizeof(uint32_t);
+
+    for (uint32_t i = 0; i < words; i += 4u) {
+        p[i] = value;
+        p[i + 1u] = value;
+        p[i + 2u] = value;
+        p[i + 3u] = value;
+    }
+}
+CY_SECTION_RAMFUNC_END
+
+/*******************************************************************************
+* Function Name: membench_copy
+********************************************************************************
+* Summary:
+*  Word copy, four words per iteration; a stand-in for memcpy() whose access
+*  pattern is the same on both cores and every toolchain
+*
+* Parameters:
+*  dst, src: Word aligned, not overlapping
+*  bytes: Multiple of 16
+*
+*******************************************************************************/
+CY_SECTION_RAMFUNC_BEGIN
+void membench_copy(uint32_t *dst, const uint32_t *src, uint32_t bytes)
+{
+    volatile uint32_t *d = dst;
+    const volatile uint32_t *s = src;
+    uint32_t words = bytes / sizeof(uint32_t);
+
+    for (uint32_t i = 0; i < words; i += 4u) {
+        uint32_t a = s[i];
+        uint32_t b = s[i + 1u];
+        uint32_t c = s[i + 2u];
+        uint32_t e = s[i + 3u];
+
+        d[i] = a;
+        d[i + 1u] = b;
+        d[i + 2u] = c;
+        d[i + 3u] = e;
+    }
+}
+CY_SECTION_RAMFUNC_END
+
+/*******************************************************************************
+* Function Name: membench_read_stride
+********************************************************************************
+* Summary:
+*  One load every stride bytes: the cost of touching a new cache line or
+*  XIP fetch for each sample, as in deinterleaving or a sparse scan
+*
+* Parameters:
+*  buf: Word aligned
+*  stride: Bytes between loads, a multiple of 4
+*  accesses: Loads
+*
+* Return:
+*  Sum of the words loaded
+*
+*******************************************************************************/
+CY_SECTION_RAMFUNC_BEGIN
+uint32_t membench_read_stride(const uint32_t *buf, uint32_t stride, uint32_t accesses)
+{
+    const volatile uint32_t *p = buf;
+    uint32_t step = stride / sizeof(uint32_t);
+    uint32_t sum = 0;
+
+    for (uint32_t i = 0; i < accesses; i++) {
+        sum += p[i * step];
+    }
+    return sum;
+}
+CY_SECTION_RAMFUNC_END
+
+/*******************************************************************************
+* Function Name: membench_chase
+********************************************************************************
+* Summary:
+*  Dependent loads: the address of each load includes the value of the
+*  previous one, so no two are in flight together and the time per load is
+*  the latency. The loads visit every MEMBENCH_LINE_BYTES line of the window
+*  in an order that jumps about 0.62 of the window each time, which defeats
+*  sequential prefetch. The buffer must hold zeros.
+*
+* Parameters:
+*  buf: Window of zeros, MEMBENCH_LINE_BYTES aligned
+*  bytes: Window, a power of two of at least two lines
+*  loads: Dependent loads
+*
+* Return:
+*  Last line index, so the chain has a use
+*
+*******************************************************************************/
+CY_SECTION_RAMFUNC_BEGIN
+uint32_t membench_chase(const uint32_t *buf, uint32_t bytes, uint32_t loads)
+{
+    const volatile uint32_t *p = buf;
+    uint32_t lines = bytes / MEMBENCH_LINE_BYTES;
+    uint32_t step = ((lines * 79u) / 128u) | 1u;    /* Odd: every line once per lap */
+    uint32_t line = 0;
+
+    for (uint32_t i = 0; i < loads; i++) {
+        uint32_t value = p[line * (MEMBENCH_LINE_BYTES / sizeof(uint32_t))];
+        line = (line + step + value) & (lines - 1u);
+    }
+    return line;
+}
+CY_SECTION_RAMFUNC_END
+
+/*******************************************************************************
+* Function Name: membench_test_valid
+********************************************************************************
+* Summary:
+*  Check a request against the buffer it would run on
+*
+* Parameters:
+*  test: Test to run
+*  bytes: Working set
+*  param: Stride of MEMBENCH_TEST_STRIDE
+*  buffer_bytes: Size of the region's buffer
+*  writable: False for flash
+*
+* Return:
+*  true if the test can run
+*
+*******************************************************************************/
+bool membench_test_valid(membench_test_t test, uint32_t bytes, uint32_t param,
+                         uint32_t buffer_bytes, bool writable)
+{
+    if ((bytes == 0u) || (bytes > buffer_bytes) || ((bytes % 32u) != 0u)) {
+        return false;
+    }
+    switch (test) {
+        case MEMBENCH_TEST_READ:
+            return true;
+        case MEMBENCH_TEST_WRITE:
+        case MEMBENCH_TEST_COPY:
+            return writable;
+        case MEMBENCH_TEST_STRIDE:
+            return (param >= sizeof(uint32_t)) && ((param % sizeof(uint32_t)) == 0u) &&
+                   (param <= bytes);
+        case MEMBENCH_TEST_LATENCY:
+            /* Power of two, at least two lines */
+            return (bytes >= 2u * MEMBENCH_LINE_BYTES) && ((bytes & (bytes - 1u)) == 0u);
+        default:
+            return false;
+    }
+}
+
+/*******************************************************************************
+* Function Name: membench_accesses
+********************************************************************************
+* Summary:
+*  Loads of a stride or latency test, for the time per access
+*
+*******************************************************************************/
+uint32_t membench_accesses(membench_test_t test, uint32_t bytes, uint32_t param)
+{
+    if (test == MEMBENCH_TEST_STRIDE) {
+        return bytes / param;
+    }
+    if (test == MEMBENCH_TEST_LATENCY) {
+        return MEMBENCH_LATENCY_LOADS;
+    }
+    return 0;
+}
+
+/*******************************************************************************
+* Function Name: membench_region_bytes
+********************************************************************************
+* Summary:
+*  Size of a region's buffer; the same on both cores, so a test that is valid
+*  on one is valid on the other
+*
+*******************************************************************************/
+uint32_t membench_region_bytes(membench_region_t region)
+{
+    switch (region) {
+        case MEMBENCH_REGION_LOCAL:
+            return MEMBENCH_LOCAL_BYTES;
+        case MEMBENCH_REGION_SOCMEM:
+            return MEMBENCH_SLICE_BYTES;
+        case MEMBENCH_REGION_XIP:
+            return MEMBENCH_XIP_BYTES;
+        default:
+            return 0;
+    }
+}
+
+/*******************************************************************************
+* Function Name: membench_run_once
+********************************************************************************
+* Summary:
+*  One run of a test
+*
+*******************************************************************************/
+static uint32_t membench_run_once(uint32_t *buf, membench_test_t test, uint32_t bytes,
+                                  uint32_t param)
+{
+    switch (test) {
+        case MEMBENCH_TEST_READ:
+            return membench_read(buf, bytes);
+        case MEMBENCH_TEST_WRITE:
+            membench_write(buf, bytes, 0);
+            return 0;
+        case MEMBENCH_TEST_COPY:
+            membench_copy(&buf[bytes / (2u * sizeof(uint32_t))], buf, bytes / 2u);
+            return 0;
+        case MEMBENCH_TEST_STRIDE:
+            return membench_read_stride(buf, param, bytes / param);
+        case MEMBENCH_TEST_LATENCY:
+            return membench_chase(buf, bytes, MEMBENCH_LATENCY_LOADS);
+        default:
+            return 0;
+    }
+}
+
+/*******************************************************************************
+* Function Name: membench_measure
+********************************************************************************
+* Summary:
+*  Time a test on the calling core. The DWT cycle counter must be running.
+*  - A writable buffer is zeroed first; the latency chain needs zeros
+*  - One untimed run fills the caches the way the timed runs will see them
+*
+* Parameters:
+*  buf: Region buffer, MEMBENCH_LINE_BYTES aligned
+*  test, bytes, param: Checked with membench_test_valid()
+*  writable: The buffer may be written
+*
+* Return:
+*  Median cycles of MEMBENCH_REPS runs
+*
+*******************************************************************************/
+uint32_t membench_measure(uint32_t *buf, membench_test_t test, uint32_t bytes, uint32_t param,
+                          bool writable)
+{
+    uint32_t cycles[MEMBENCH_REPS];
+    volatile uint32_t sink;
+
+    if (writable) {
+        membench_write(buf, bytes, 0);
+    }
+    sink = membench_run_once(buf, test, bytes, param);
+
+    for (uint32_t rep = 0; rep < MEMBENCH_REPS; rep++) {
+        uint32_t state = Cy_SysLib_EnterCriticalSection();
+        uint32_t start = DWT->CYCCNT;
+
+        /* Writes store zero, so a latency test can follow on the same buffer */
+        sink = membench_run_once(buf, test, bytes, param);
+        cycles[rep] = DWT->CYCCNT - start;
+        Cy_SysLib_ExitCriticalSection(state);
+    }
+    (void)sink;
+
+    /* Insertion sort; MEMBENCH_REPS is small */
+    for (uint32_t i = 1; i < MEMBENCH_REPS; i++) {
+        uint32_t value = cycles[i];
+        uint32_t j = i;
+
+        while ((j > 0u) && (cycles[j - 1u] > value)) {
+            cycles[j] = cycles[j - 1u];
+            j--;
+        }
+        cycles[j] = value;
+    }
+    return cycles[MEMBENCH_REPS / 2u];
+}
@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+"""
+A/B timing of the audio interrupts between two firmware builds.
+
+`run` drives the board over the console UART: it starts a stream on both
+audio interrupts (a test signal on I2S, a take on PDM, or a file instead of
+the test signal), clears the counters once they run with `isr reset`, waits
+and saves the `isr` output. Several runs go into one file. `compare` reads
+the files of two builds, normally an AUDIO_XIP_ONLY build and a default
+(SRAM) one, and prints the Markdown table kept in
+docs/design_and_implementation.md.
+
+Usage:
+    isrtime.py run /dev/ttyACM0 -o xip.txt [--runs 5] [--seconds 2] [--play FILE]
+    isrtime.py compare xip.txt sram.txt
+
+`run` requires pyserial (pip install pyserial); `compare` does not.
+"""
+
+import argparse
+import re
+import statistics
+import sys
+import time
+
+CONSOLE_BAUD = 115200
+SETTLE_S = 1.0              # Stream running before the counters are cleared
+SAVE_S = 3.0                # For the take to be saved before the next run
+MAX_TAKE_S = 4.0            # The capture pool
+
+HEADER_RE = re.compile(r"ISR timing, audio code in (.+?), (\d+) Hz core clock")
+LINE_RE = re.compile(r"^\s*(.+?): (\d+) entries, inside mean (\d+) max (\d+) ns"
+                     r"(?:, interval (\d+)\.\.(\d+) ns \(mean (\d+)\), jitter (\d+) ns)?")
+
+
+def console(ser, line, idle_s=0.3, timeout_s=5.0):
+    """Type a CLI line and return what the board printed until it went quiet."""
+    ser.reset_input_buffer()
+    ser.write(line.encode("ascii") + b"\r")
+    out = bytearray()
+    deadline = time.monotonic() + timeout_s
+    last = time.monotonic()
+    while time.monotonic() < deadline and time.monotonic() - last < idle_s:
+        chunk = ser.read(256)
+        if chunk:
+            out += chunk
+            last = time.monotonic()
+    return out.decode("ascii", "replace").replace("\r\n", "\n")
+
+
+def run(args):
+    import serial
+
+    record_s = args.seconds + SETTLE_S + 0.5
+    if record_s > MAX_TAKE_S:
+        sys.exit("--seconds %.1f: the take would not fit the %.0f s capture pool"
+                 % (args.seconds, MAX_TAKE_S))
+    ser = serial.Serial(args.port, CONSOLE_BAUD, timeout=0.05)
+    with open(args.output, "w") as log:
+        for n in range(args.runs):
+            if args.play:
+                console(ser, "play %s" % args.play)
+            else:
+                console(ser, "gen noise 0 20")
+            console(ser, "record %.3f" % record_s)
+            time.sleep(SETTLE_S)
+            console(ser, "isr reset")
+            time.sleep(args.seconds)
+            text = console(ser, "isr")
+            console(ser, "stop" if args.play else "gen stop")
+            if not HEADER_RE.search(text):
+                sys.exit("run %d: no 'isr' report in:\n%s" % (n + 1, text))
+            log.write("# run %d\n%s\n" % (n + 1, text.strip()))
+            print(text.strip())
+            time.sleep(record_s - args.seconds - SETTLE_S + SAVE_S)
+    ser.close()
+
+
+def parse(path):
+    """Placement name and {handler: [per-run dict]} from a saved file."""
+    placement = None
+    handlers = {}
+    with open(path) as f:
+        for line in f:
+            header = HEADER_RE.search(line)
+            if header:
+                if placement not in (None, header.group(1)):
+                    sys.exit("%s mixes runs of two builds" % path)
+                placement = header.group(1)
+                continue
+            match = LINE_RE.match(line)
+            if not match or match.group(5) is None:
+                continue
+            values = [int(v) for v in match.groups()[1:]]
+            handlers.setdefault(match.group(1), []).append(dict(zip(
+                ("entries", "mean", "max", "interval_min", "interval_max", "interval_mean",
+                 "jitter"), values)))
+    if placement is None:
+        sys.exit("%s holds no 'isr' report" % path)
+    return placement, handlers
+
+
+def compare(args):
+    before_name, before = parse(args.before)
+    after_name, after = parse(args.after)
+
+    def cell(runs, key, worst):
+        values = [r[key] for r in runs]
+        value = max(values) if worst else statistics.median(values)
+        return value, "%.2f" % (value / 1000.0)
+
+    print("| Handler | Runs | Inside mean, %s (us) | Inside mean, %s (us) | "
+          "Inside max, %s (us) | Inside max, %s (us) | Jitter, %s (us) | Jitter, %s (us) |"
+          % (before_name, after_name, before_name, after_name, before_name, after_name))
+    print("|---------|-----:|---:|---:|---:|---:|---:|---:|")
+    for handler in sorted(set(before) & set(after)):
+        cells = []
+        for key, worst in (("mean", False), ("max", True), ("jitter", True)):
+            for runs in (before[handler], after[handler]):
+                cells.append(cell(runs, key, worst)[1])
+        print("| %s | %d / %d | %s |" % (handler, len(before[handler]), len(after[handler]),
+                                          " | ".join(cells)))
+    print()
+    print("Mean: median over the runs. Max and jitter: worst run.")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("run", help="time the interrupts of the build on the board")
+    p.add_argument("port")
+    p.add_argument("-o", "--output", required=True, help="file the 'isr' reports go to")
+    p.add_argument("--runs", type=int, default=5)
+    p.add_argument("--seconds", type=float, default=2.0, help="counted time per run, up to 2.5")
+    p.add_argument("--play", metavar="FILE", help="play FILE instead of 'gen noise'")
+    p.set_defaults(func=run)
+
+    p = sub.add_parser("compare", help="table of two builds")
+    p.add_argument("before", help="runs of the AUDIO_XIP_ONLY build")
+    p.add_argument("after", help="runs of the default build")
+    p.set_defaults(func=compare)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
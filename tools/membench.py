@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+"""
+Markdown table of a `membench` run.
+
+Reads the MEMBENCH CSV lines that `membench <cm33|cm55|all> [load] [save]`
+prints, from membench.csv (fetched with `xfer.py get`) or a console log, and
+prints the table kept in docs/design_and_implementation.md: one row per core,
+D-cache state, load state and region, with the columns of the device's own
+summary. Lines that are not MEMBENCH results are ignored.
+
+Usage:
+    membench.py membench.csv
+    membench.py console.log --all        # every case, not only the summary's
+
+Needs no board and no pyserial.
+"""
+
+import argparse
+import csv
+import sys
+
+FIELDS = ("tag", "core", "region", "dcache", "load", "test", "bytes", "param", "cycles",
+          "value", "unit")
+
+# (heading, test, bytes or None for any, param or None for any); the first
+# seven are the device summary's columns
+COLUMNS = (
+    ("read MB/s", "read", None, None),
+    ("write MB/s", "write", None, None),
+    ("copy MB/s", "copy", None, None),
+    ("stride128 ns", "stride", None, 128),
+    ("lat1K ns", "latency", 1024, None),
+    ("lat16K ns", "latency", 16384, None),
+    ("lat64K ns", "latency", 65536, None),
+    ("stride32 ns", "stride", None, 32),
+    ("lat4K ns", "latency", 4096, None),
+)
+SUMMARY_COLUMNS = 7
+
+CORES = ("cm33", "cm55")
+DCACHE = ("-", "on", "off")
+LOADS = ("idle", "load")
+REGIONS = ("sram", "dtcm", "socmem", "xip")
+
+
+def read_results(path):
+    """{(core, dcache, load, region): {(test, bytes, param): value}}"""
+    rows = {}
+    with open(path, newline="") as f:
+        for fields in csv.reader(f):
+            if len(fields) != len(FIELDS) or fields[0] != "MEMBENCH":
+                continue
+            r = dict(zip(FIELDS, (v.strip() for v in fields)))
+            key = (r["core"], r["dcache"], r["load"], r["region"])
+            rows.setdefault(key, {})[(r["test"], int(r["bytes"]), int(r["param"]))] = r["value"]
+    return rows
+
+
+def cell(results, test, size, param):
+    for (t, b, p), value in results.items():
+        if t == test and size in (None, b) and param in (None, p):
+            return value
+    return "-"
+
+
+def order(key):
+    core, dcache, load, region = key
+    rank = lambda seq, v: seq.index(v) if v in seq else len(seq)
+    return (rank(CORES, core), rank(DCACHE, dcache), rank(LOADS, load), rank(REGIONS, region))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("path", help="membench.csv or a console log")
+    parser.add_argument("--all", action="store_true", help="add the cases the summary leaves out")
+    args = parser.parse_args()
+
+    rows = read_results(args.path)
+    if not rows:
+        sys.exit("%s holds no MEMBENCH lines" % args.path)
+    columns = COLUMNS if args.all else COLUMNS[:SUMMARY_COLUMNS]
+
+    print("| Core | D-cache | Load | Region | %s |" % " | ".join(c[0] for c in columns))
+    print("|------|---------|------|--------|%s" % ("---:|" * len(columns)))
+    for key in sorted(rows, key=order):
+        values = [cell(rows[key], test, size, param) for _, test, size, param in columns]
+        print("| %s | %s |" % (" | ".join(key), " | ".join(values)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+"""
+Draw an overview of a waveform peak sidecar (.pk) and list where the
+activity is, without the WAV file.
+
+The format is defined in proj_cm33_ns/source/peak_file.h:
+
+    header = magic("PEAK") version:u16 channels:u16 rate:u32 frames:u32
+             wav_size:u32 levels:u16 entry_size:u16
+             3 x (frames_per_entry:u32 entries:u32 offset:u32) crc32:u32
+    entry  = channels x (min:i16 max:i16)
+
+Levels are stored finest first. crc32 = zlib.crc32 of the header up to the
+crc field followed by all entries.
+
+Usage:
+    peaks.py audio_001.pk [--width 72] [--threshold -40] [--gap 0.5]
+
+Fetch sidecars from the board with `xfer.py peaks`.
+"""
+
+import argparse
+import math
+import struct
+import sys
+import zlib
+
+HEADER = struct.Struct("<4sHHIIIHH" + "III" * 3 + "I")
+MAGIC = b"PEAK"
+VERSION = 1
+FULL_SCALE = 32768.0
+BARS = " .:-=+*#%@"
+
+
+class Peaks:
+    """Parsed sidecar: levels[n][entry][channel] = (min, max)."""
+
+    def __init__(self, data):
+        if len(data) < HEADER.size:
+            raise ValueError("file shorter than the header")
+        fields = HEADER.unpack_from(data)
+        magic, version, self.channels, self.rate, self.frames, self.wav_size, \
+            num_levels, entry_size = fields[:8]
+        if magic != MAGIC or version != VERSION:
+            raise ValueError("not a version %d peak file" % VERSION)
+        if entry_size != 4 * self.channels:
+            raise ValueError("entry size %d does not match %d channels" % (entry_size, self.channels))
+        crc = zlib.crc32(data[: HEADER.size - 4] + data[HEADER.size :]) & 0xFFFFFFFF
+        if crc != fields[-1]:
+            raise ValueError("CRC mismatch")
+
+        row = struct.Struct("<" + "hh" * self.channels)
+        self.frames_per_entry = []
+        self.levels = []
+        for i in range(num_levels):
+            fpe, count, offset = fields[8 + 3 * i : 11 + 3 * i]
+            entries = []
+            for j in range(count):
+                values = row.unpack_from(data, offset + j * entry_size)
+                entries.append([(values[2 * c], values[2 * c + 1]) for c in range(self.channels)])
+            self.frames_per_entry.append(fpe)
+            self.levels.append(entries)
+
+    def seconds(self, level, index):
+        return index * self.frames_per_entry[level] / float(self.rate)
+
+
+def dbfs(level):
+    return 20.0 * math.log10(level / FULL_SCALE) if level > 0 else -math.inf
+
+
+def magnitude(rng):
+    lo, hi = rng
+    return max(abs(lo), abs(hi))
+
+
+def overview(peaks, width):
+    """One line per channel, one character per column, height by peak dBFS."""
+    # Coarsest level that still has a column's worth of entries
+    level = 0
+    for i, entries in enumerate(peaks.levels):
+        if len(entries) >= width:
+            level = i
+    entries = peaks.levels[level]
+    if not entries:
+        return []
+    columns = min(width, len(entries))
+    lines = []
+    for ch in range(peaks.channels):
+        text = []
+        for col in range(columns):
+            first = col * len(entries) // columns
+            last = max(first + 1, (col + 1) * len(entries) // columns)
+            peak = max(magnitude(e[ch]) for e in entries[first:last])
+            # -60 dBFS and below is blank, 0 dBFS is the last character
+            db = max(-60.0, dbfs(peak))
+            text.append(BARS[min(len(BARS) - 1, int((db + 60.0) / 60.0 * (len(BARS) - 1) + 0.5))])
+        lines.append("ch%d |%s|" % (ch, "".join(text)))
+    return lines
+
+
+def activity(peaks, threshold_db, gap_seconds):
+    """Runs of finest-level entries above the threshold, merged across short gaps."""
+    entries = peaks.levels[0]
+    limit = FULL_SCALE * 10.0 ** (threshold_db / 20.0)
+    gap = max(1, int(gap_seconds * peaks.rate / peaks.frames_per_entry[0]))
+    runs = []
+    for i, e in enumerate(entries):
+        peak = max(magnitude(r) for r in e)
+        if peak < limit:
+            continue
+        if runs and i - runs[-1][1] <= gap:
+            runs[-1][1] = i + 1
+            runs[-1][2] = max(runs[-1][2], peak)
+        else:
+            runs.append([i, i + 1, peak])
+    duration = peaks.frames / float(peaks.rate)
+    return [(peaks.seconds(0, a), min(duration, peaks.seconds(0, b)), p) for a, b, p in runs]
+
+
+def report(peaks, width=72, threshold_db=-40.0, gap_seconds=0.5, out=sys.stdout):
+    duration = peaks.frames / float(peaks.rate)
+    out.write("%d frames, %.2f s at %d Hz, %d channel(s); levels %s frames per entry\n"
+              % (peaks.frames, duration, peaks.rate, peaks.channels,
+                 "/".join(str(f) for f in peaks.frames_per_entry)))
+    for line in overview(peaks, width):
+        out.write(line + "\n")
+    runs = activity(peaks, threshold_db, gap_seconds)
+    if not runs:
+        out.write("no activity above %.0f dBFS\n" % threshold_db)
+    for start, end, peak in runs:
+        out.write("activity %8.3f - %8.3f s  peak %6.1f dBFS\n" % (start, end, dbfs(peak)))
+
+
+def add_report_arguments(parser):
+    parser.add_argument("--width", type=int, default=72, help="overview columns")
+    parser.add_argument("--threshold", type=float, default=-40.0,
+                        help="activity level in dBFS (default -40)")
+    parser.add_argument("--gap", type=float, default=0.5,
+                        help="join activity separated by less than this many seconds")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("filename")
+    add_report_arguments(parser)
+    args = parser.parse_args()
+
+    with open(args.filename, "rb") as f:
+        data = f.read()
+    try:
+        peaks = Peaks(data)
+    except ValueError as exc:
+        sys.exit("%s: %s" % (args.filename, exc))
+    report(peaks, args.width, args.threshold, args.gap)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,1136 @@
+#!/usr/bin/env python3
+"""
+Discrete-event model of the audio pipeline on the CM33 non-secure core.
+
+Simulates the capture chain (PDM ISR -> capture pool -> FileWriteTask -> SD)
+and the playback chain (SD -> FileReadTask -> pcm_playback_queue -> I2S ISR)
+in virtual time. The ISRs run at the period set by
+the FIFO trigger levels. Tasks are scheduled preemptively by priority on one
+CPU, and SD requests take latencies drawn from a distribution. Defaults are
+read from the firmware headers so the model follows the code.
+
+For each configuration the tool reports worst-case buffer occupancy, lost
+audio (capture overruns, playback underruns and buffers overwritten before
+they were played), the probability of any loss per run, and latency.
+
+Usage:
+    pipesim.py                                   # firmware as configured
+    pipesim.py --seconds 30 --runs 50 --sd-stall 0.01,150
+    pipesim.py --scenario duplex --sd-write const:5 --set sd_write_kbps=500
+    pipesim.py --set playback_mode=poll --set reader_waits=0
+    pipesim.py --sweep chunk_samples=1024,2048,4096 --sweep read_buffers=2,3,4 \\
+               --target-loss 1e-6
+
+SD latency SPEC: const:MS | uniform:MIN,MAX | lognormal:MEDIAN,SIGMA |
+file:PATH. A file holds one latency in ms per line, or "op,bytes,ms" lines
+(op = read/write); '#' starts a comment.
+"""
+
+import argparse
+import collections
+import heapq
+import itertools
+import math
+import os
+import random
+import re
+import sys
+
+REPO_ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+SOURCE_DIR = os.path.join(REPO_ROOT, "proj_cm33_ns", "source")
+
+TICK_US = 1000.0
+FOREVER = float("inf")
+
+
+# ---------------------------------------------------------------------------
+# Configuration
+# ---------------------------------------------------------------------------
+
+# Values not expressed as macros in the firmware (location in brackets)
+DEFAULTS = {
+    "sample_rate": 16000,           # SAMPLE_RATE_HZ (codec driver constant)
+    "channels": 2,                  # NUM_CHANNELS
+    "pdm_fifo": 64,                 # PDM_HW_FIFO_SIZE
+    "rx_trig": 32,                  # RX_FIFO_TRIG_LEVEL
+    "i2s_fifo_words": 128,          # I2S_HW_FIFO_SIZE
+    "chunk_samples": 4096,          # PCM_CHUNK_SIZE
+    "read_buffers": 2,              # read_ping_buffer/read_pong_buffer [file_read_task.c]
+    "playback_queue": 4,            # pcm_playback_queue length [freertos_setup.c]
+    "playback_poll_ms": 50,         # poll mode: PlaybackTask wait loop
+    "playback_mode": "queue",       # queue: the ISR takes the next chunk itself
+                                    # (app_i2s_stream_t current/pending buffer)
+                                    # poll: PlaybackTask hands chunks to the ISR
+    "reader_waits": 1,              # 1: FileReadTask takes buffer_free_sem
+                                    # 0: it refills a buffer still playing
+    "send_timeout_ms": 500,         # xQueueSend timeout [file_read_task.c]
+    "capture_mode": "pool",         # pool: a take records into a run of pool
+                                    # blocks, written in slices at stop
+                                    # whole: one RAM buffer, written at stop
+                                    # stream: write blocks while recording
+    "buffer_seconds": 4,            # RECORDING_DURATION_SEC
+    "record_stop": "isr",           # isr: the PDM ISR stops at the take's last
+                                    # frame and wakes AudioRecordTask
+                                    # poll: the task notices at its next poll
+    "record_poll_ms": 100,          # AudioRecordTask poll [audio_record_task.c]
+    "capture_blocks": 8,            # CAPTURE_POOL_BLOCKS
+    "capture_block_samples": 16000, # CAPTURE_POOL_BLOCK_SAMPLES, L+R
+    "pool_max_takes": 3,            # CAPTURE_POOL_MAX_TAKES
+    "write_slice_bytes": 16384,     # WAV_WRITE_SLICE_BYTES
+    "prio_record": 4,               # AUDIO_RECORD_TASK_PRIORITY
+    "prio_write": 3,                # FILE_WRITE_TASK_PRIORITY
+    "prio_read": 3,                 # FILE_READ_TASK_PRIORITY
+    "prio_playback": 3,             # PLAYBACK_TASK_PRIORITY
+    "isr_us": 4.0,                  # CPU time per PDM or I2S interrupt
+    "sd_cpu_us": 40.0,              # CPU time per FS call outside the SD wait
+    "sd_read_kbps": 12000,          # SD read bandwidth, KB/s (0 = latency only)
+    "sd_write_kbps": 6000,          # SD write bandwidth, KB/s (0 = latency only)
+}
+
+# Firmware macros that override DEFAULTS when the source tree is present
+MACROS = {
+    "chunk_samples": "PCM_CHUNK_SIZE",
+    "channels": "NUM_CHANNELS",
+    "pdm_fifo": "PDM_HW_FIFO_SIZE",
+    "rx_trig": "RX_FIFO_TRIG_LEVEL",
+    "i2s_fifo_words": "I2S_HW_FIFO_SIZE",
+    "buffer_seconds": "RECORDING_DURATION_SEC",
+    "capture_blocks": "CAPTURE_POOL_BLOCKS",
+    "capture_block_samples": "CAPTURE_POOL_BLOCK_SAMPLES",
+    "pool_max_takes": "CAPTURE_POOL_MAX_TAKES",
+    "write_slice_bytes": "WAV_WRITE_SLICE_BYTES",
+    "prio_record": "AUDIO_RECORD_TASK_PRIORITY",
+    "prio_write": "FILE_WRITE_TASK_PRIORITY",
+    "prio_read": "FILE_READ_TASK_PRIORITY",
+    "prio_playback": "PLAYBACK_TASK_PRIORITY",
+}
+
+DEFINE_RE = re.compile(r"^\s*#define\s+(\w+)\s+(.+?)\s*(?:/[*/].*)?$")
+
+
+def read_firmware_macros(source_dir):
+    """Collect integer #defines from the firmware headers."""
+    raw = {}
+    for root, _dirs, files in os.walk(source_dir):
+        for name in files:
+            if name.endswith(".h"):
+                with open(os.path.join(root, name), encoding="utf-8", errors="replace") as f:
+                    for line in f:
+                        m = DEFINE_RE.match(line)
+                        if m:
+                            raw.setdefault(m.group(1), m.group(2))
+
+    values = {}
+
+    def evaluate(name, depth=0):
+        if name in values:
+            return values[name]
+        if name not in raw or depth > 8:
+            return None
+        expr = re.sub(r"\b(\d+)[uUlL]+\b", r"\1", raw[name])
+        for ident in set(re.findall(r"[A-Za-z_]\w*", expr)):
+            value = evaluate(ident, depth + 1)
+            if value is None:
+                return None
+            expr = re.sub(r"\b%s\b" % ident, str(value), expr)
+        if not re.fullmatch(r"[\d\s()+\-*/<>]+", expr):
+            return None
+        try:
+            values[name] = int(eval(expr, {"__builtins__": {}}))  # digits and operators only
+        except (SyntaxError, ZeroDivisionError):
+            return None
+        return values[name]
+
+    return {key: evaluate(macro) for key, macro in MACROS.items()}
+
+
+def default_config(use_source=True):
+    config = dict(DEFAULTS)
+    if use_source and os.path.isdir(SOURCE_DIR):
+        for key, value in read_firmware_macros(SOURCE_DIR).items():
+            if value is not None:
+                config[key] = value
+    return config
+
+
+def parse_value(key, text, config):
+    if key not in config:
+        raise SystemExit("unknown parameter '%s' (see --list)" % key)
+    if isinstance(config[key], str):
+        return text
+    if isinstance(config[key], float):
+        return float(text)
+    return int(float(text))
+
+
+def memory_bytes(config, chains="both"):
+    """RAM held by the audio buffers of the simulated chains."""
+    capture = playback = 0
+    if chains != "playback":
+        if config["capture_mode"] in ("pool", "stream"):
+            capture = config["capture_blocks"] * config["capture_block_samples"] * 2
+        else:
+            capture = config["buffer_seconds"] * config["sample_rate"] * config["channels"] * 2
+    if chains != "capture":
+        playback = config["read_buffers"] * config["chunk_samples"] * 2
+    return capture + playback
+
+
+# ---------------------------------------------------------------------------
+# Latency distributions
+# ---------------------------------------------------------------------------
+
+class Distribution:
+    """Latency in milliseconds, sampled per SD request."""
+
+    def __init__(self, spec, op):
+        kind, _, args = spec.partition(":")
+        self.spec = spec
+        if kind == "const":
+            value = float(args)
+            self.sample = lambda rng: value
+        elif kind == "uniform":
+            lo, hi = (float(x) for x in args.split(","))
+            self.sample = lambda rng: rng.uniform(lo, hi)
+        elif kind == "lognormal":
+            median, sigma = (float(x) for x in args.split(","))
+            mu = math.log(median)
+            self.sample = lambda rng: rng.lognormvariate(mu, sigma)
+        elif kind == "file":
+            samples = self._load(args, op)
+            if not samples:
+                raise SystemExit("%s: no %s latencies" % (args, op))
+            self.sample = lambda rng: rng.choice(samples)
+        else:
+            raise SystemExit("bad latency spec '%s'" % spec)
+
+    @staticmethod
+    def _load(path, op):
+        samples = []
+        with open(path, encoding="utf-8") as f:
+            for line in f:
+                fields = [x.strip() for x in line.split("#")[0].split(",") if x.strip()]
+                if len(fields) == 1:
+                    samples.append(float(fields[0]))
+                elif len(fields) >= 3 and fields[0].lower() == op:
+                    samples.append(float(fields[2]))
+        return samples
+
+
+# ---------------------------------------------------------------------------
+# Kernel: event queue, preemptive priority scheduler, queues
+# ---------------------------------------------------------------------------
+
+class Task:
+    def __init__(self, name, prio, body):
+        self.name = name
+        self.prio = prio
+        self.gen = body(self)
+        self.value = None
+        self.remaining = 0.0        # CPU time left in the current 'cpu' action
+        self.run_start = 0.0
+        self.version = 0            # Invalidates stale completion/timeout events
+        self.state = "ready"
+        self.order = 0
+        self.cpu_time = 0.0
+
+
+class Queue:
+    def __init__(self, kernel, name, capacity):
+        self.kernel = kernel
+        self.name = name
+        self.capacity = capacity
+        self.items = collections.deque()
+        self.receivers = []         # blocked tasks
+        self.senders = []           # (task, item)
+        self.max_depth = 0
+
+    def _push(self, item):
+        if self.receivers:
+            task = max(self.receivers, key=lambda t: t.prio)
+            self.receivers.remove(task)
+            self.kernel.wake(task, item)
+            return
+        self.items.append(item)
+        self.max_depth = max(self.max_depth, len(self.items))
+
+    def _pop(self):
+        item = self.items.popleft()
+        if self.senders:
+            task, pending = max(self.senders, key=lambda s: s[0].prio)
+            self.senders.remove((task, pending))
+            self.items.append(pending)
+            self.kernel.wake(task, True)
+        return item
+
+    def isr_send(self, item):
+        if len(self.items) >= self.capacity and not self.receivers:
+            return False
+        self._push(item)
+        return True
+
+    def isr_recv(self):
+        return self._pop() if self.items else None
+
+
+class Kernel:
+    def __init__(self, config, rng):
+        self.config = config
+        self.rng = rng
+        self.now = 0.0
+        self.events = []
+        self.seq = itertools.count()
+        self.order = itertools.count()
+        self.ready = []
+        self.current = None
+        self.isr_busy_until = 0.0
+        self.advancing = False
+        self.tasks = []
+
+    # Events
+    def at(self, time, fn):
+        heapq.heappush(self.events, (time, next(self.seq), fn))
+
+    def run(self, until):
+        while self.events and self.events[0][0] <= until:
+            time, _, fn = heapq.heappop(self.events)
+            self.now = time
+            fn()
+        self.now = until
+
+    # Tasks
+    def spawn(self, name, prio, body):
+        task = Task(name, prio, body)
+        self.tasks.append(task)
+        self.make_ready(task)
+        return task
+
+    def make_ready(self, task):
+        task.state = "ready"
+        task.order = next(self.order)
+        self.ready.append(task)
+        if not self.advancing:
+            self.schedule()
+
+    def wake(self, task, value):
+        task.version += 1
+        task.value = value
+        self.make_ready(task)
+
+    def schedule(self):
+        if not self.ready:
+            return
+        best = max(self.ready, key=lambda t: (t.prio, -t.order))
+        if self.current is not None:
+            if best.prio <= self.current.prio:
+                return
+            self._preempt(self.current)
+        self.ready.remove(best)
+        self._dispatch(best)
+
+    def _preempt(self, task):
+        consumed = max(0.0, self.now - task.run_start)
+        task.cpu_time += min(consumed, task.remaining)
+        task.remaining = max(0.0, task.remaining - consumed)
+        task.version += 1
+        task.state = "ready"
+        task.order = -next(self.order)      # Back to the head of its priority
+        self.ready.append(task)
+        self.current = None
+
+    def _dispatch(self, task):
+        self.current = task
+        task.state = "running"
+        if task.remaining > 0.0:
+            self._start_cpu(task)
+        else:
+            self._advance(task)
+
+    def _start_cpu(self, task):
+        task.run_start = max(self.now, self.isr_busy_until)
+        task.version += 1
+        version = task.version
+        self.at(task.run_start + task.remaining, lambda: self._cpu_done(task, version))
+
+    def _cpu_done(self, task, version):
+        if task.version != version or self.current is not task:
+            return
+        task.cpu_time += task.remaining
+        task.remaining = 0.0
+        self._advance(task)
+
+    def _block(self, task):
+        task.state = "blocked"
+        task.version += 1
+        self.current = None
+
+    def _timeout(self, task, waiters, timeout_us, entry):
+        if timeout_us == FOREVER:
+            return
+        version = task.version
+
+        def expire():
+            if task.version == version and task.state == "blocked":
+                waiters.remove(entry)
+                self.wake(task, None if entry is task else False)
+        self.at(self.now + timeout_us, expire)
+
+    def _advance(self, task):
+        """Run the task body until it needs CPU time or blocks."""
+        self.advancing = True
+        try:
+            while True:
+                try:
+                    action = task.gen.send(task.value)
+                except StopIteration:
+                    task.state = "done"
+                    self.current = None
+                    break
+                task.value = None
+                kind = action[0]
+
+                if kind == "cpu":
+                    if action[1] <= 0.0:
+                        continue
+                    task.remaining = action[1]
+                    self._start_cpu(task)
+                    break
+
+                if kind == "delay_ms":
+                    # vTaskDelay: wakes on the n-th tick interrupt from now
+                    ticks = max(1, int(math.ceil(action[1] * 1000.0 / TICK_US)))
+                    wake_at = (math.floor(self.now / TICK_US) + ticks) * TICK_US
+                    self._block(task)
+                    version = task.version
+                    self.at(wake_at, lambda t=task, v=version: (
+                        self.wake(t, None) if t.version == v else None))
+                    break
+
+                if kind == "recv":
+                    queue, timeout_us = action[1], action[2]
+                    if queue.items:
+                        task.value = queue._pop()
+                        continue
+                    if timeout_us == 0:
+                        continue
+                    self._block(task)
+                    queue.receivers.append(task)
+                    self._timeout(task, queue.receivers, timeout_us, task)
+                    break
+
+                if kind == "send":
+                    queue, item, timeout_us = action[1], action[2], action[3]
+                    if len(queue.items) < queue.capacity or queue.receivers:
+                        queue._push(item)
+                        task.value = True
+                        continue
+                    if timeout_us == 0:
+                        task.value = False
+                        continue
+                    self._block(task)
+                    entry = (task, item)
+                    queue.senders.append(entry)
+                    self._timeout(task, queue.senders, timeout_us, entry)
+                    break
+
+                if kind == "sd":
+                    self._block(task)
+                    self.sd.submit(task, action[1], action[2])
+                    break
+
+                raise ValueError("unknown action %r" % (action,))
+        finally:
+            self.advancing = False
+        self.schedule()
+
+    # Interrupts
+    def isr(self, cost_us):
+        """Account an interrupt's CPU time; it delays the running task."""
+        start = max(self.now, self.isr_busy_until)
+        self.isr_busy_until = start + cost_us
+        task = self.current
+        if task is not None and task.remaining > 0.0:
+            consumed = max(0.0, self.now - task.run_start)
+            task.cpu_time += min(consumed, task.remaining)
+            task.remaining = max(0.0, task.remaining - consumed)
+            self._start_cpu(task)
+        return start - self.now         # Time the interrupt waited for others
+
+
+class SdCard:
+    """One request at a time, in arrival order (emFile holds a volume lock)."""
+
+    def __init__(self, kernel, read_dist, write_dist, stall):
+        self.kernel = kernel
+        self.dist = {"read": read_dist, "write": write_dist}
+        self.stall = stall
+        self.queue = collections.deque()
+        self.busy = False
+        self.latencies = {"read": [], "write": []}
+
+    def submit(self, task, op, nbytes):
+        self.queue.append((task, op, nbytes, self.kernel.now))
+        if not self.busy:
+            self._start()
+
+    def _start(self):
+        kernel = self.kernel
+        config = kernel.config
+        task, op, nbytes, submitted = self.queue.popleft()
+        self.busy = True
+        ms = self.dist[op].sample(kernel.rng)
+        kbps = config["sd_%s_kbps" % op]
+        if kbps > 0:
+            ms += nbytes / float(kbps)          # KB/s = bytes per ms
+        if self.stall and kernel.rng.random() < self.stall[0]:
+            ms += self.stall[1]
+
+        def done():
+            self.latencies[op].append(kernel.now - submitted)
+            self.busy = False
+            kernel.wake(task, True)
+            if self.queue:
+                self._start()
+        kernel.at(kernel.now + ms * 1000.0, done)
+
+
+# ---------------------------------------------------------------------------
+# Pipeline models
+# ---------------------------------------------------------------------------
+
+class Stats:
+    def __init__(self):
+        self.counters = collections.Counter()
+        self.latency = collections.defaultdict(list)
+        self.peak = collections.Counter()
+
+    def high_water(self, key, value):
+        self.peak[key] = max(self.peak[key], value)
+
+
+def sd_call(config, op, nbytes):
+    """FS_Read/FS_Write: CPU time in the file system, then wait for the card."""
+    yield ("cpu", config["sd_cpu_us"])
+    yield ("sd", op, nbytes)
+
+
+class Capture:
+    """PDM ISR -> record buffer(s) -> FileWriteTask -> SD."""
+
+    def __init__(self, kernel, stats, takes):
+        self.k = kernel
+        self.c = kernel.config
+        self.stats = stats
+        self.frame_us = 1e6 / self.c["sample_rate"]
+        self.captured = 0
+        if self.c["capture_mode"] == "pool":
+            # [(start in us, frames)], one 'record' command each
+            self.takes = [(start * 1e6, int(seconds * self.c["sample_rate"]))
+                          for start, seconds in takes]
+            self.block_frames = self.c["capture_block_samples"] // self.c["channels"]
+            self.owner = [None] * self.c["capture_blocks"]     # take holding each block
+            self.held = 0               # takes holding blocks, recording or unsaved
+            self.take = None            # take the ISR fills
+            self.records = Queue(kernel, "audio_record", self.c["pool_max_takes"])
+            self.wake = Queue(kernel, "record_notify", 1)
+            kernel.spawn("AudioRecord", self.c["prio_record"], self.pool_record_task)
+            kernel.spawn("FileWrite", self.c["prio_write"], self.pool_writer)
+            return
+        if len(takes) != 1 or takes[0][0] != 0.0:
+            raise SystemExit("capture_mode=%s models a single take" % self.c["capture_mode"])
+        seconds = takes[0][1]
+        self.seconds = seconds
+        self.frames_wanted = int(seconds * self.c["sample_rate"])
+        self.active = True
+        if self.c["capture_mode"] == "stream":
+            self.free_blocks = self.c["capture_blocks"]
+            self.block_frames = self.c["capture_block_samples"] // self.c["channels"]
+            self.filling = None         # [frames, time of first frame]
+            self.full = Queue(kernel, "capture", self.c["capture_blocks"])
+            kernel.spawn("FileWrite", self.c["prio_write"], self.stream_writer)
+        else:
+            self.buffer_frames = self.c["buffer_seconds"] * self.c["sample_rate"]
+            self.index = 0
+            self.records = Queue(kernel, "audio_record", 2)
+            self.stop_at = seconds * 1e6
+            kernel.spawn("AudioRecord", self.c["prio_record"], self.record_task)
+            kernel.spawn("FileWrite", self.c["prio_write"], self.whole_writer)
+        self._schedule_isr(0.0)
+
+    # PDM interrupt: every rx_trig frames while the channels are active
+    def _schedule_isr(self, trigger_time):
+        period = self.c["rx_trig"] * self.frame_us
+        self.k.at(trigger_time + period, lambda: self._isr(trigger_time + period))
+
+    def _isr(self, trigger_time):
+        if not self.active:
+            return
+        waited = self.k.isr(self.c["isr_us"])
+        slack = (self.c["pdm_fifo"] - self.c["rx_trig"]) * self.frame_us
+        if waited > slack:
+            lost = int((waited - slack) / self.frame_us)
+            self.stats.counters["capture_fifo_overflow"] += lost
+        frames = self.c["rx_trig"]
+        if self.captured + frames > self.frames_wanted:
+            frames = self.frames_wanted - self.captured
+        self.captured += frames
+        if self.c["capture_mode"] == "stream":
+            self._stream_frames(frames, trigger_time)
+        else:
+            self._whole_frames(frames)
+        if self.captured < self.frames_wanted:
+            self._schedule_isr(trigger_time)
+        elif self.c["capture_mode"] == "stream":
+            self.active = False
+            if self.filling is not None:
+                self.full.isr_send(self.filling)
+                self.filling = None
+
+    # Firmware: one RAM buffer, AudioRecordTask polls for full/stop
+    def _whole_frames(self, frames):
+        room = self.buffer_frames - self.index
+        if frames > room:
+            # The ISR keeps writing until AudioRecordTask notices the full buffer
+            self.stats.counters["capture_past_end"] += frames - max(room, 0)
+        self.index += frames
+        self.stats.high_water("capture_frames", self.index)
+
+    def record_task(self, task):
+        config = self.c
+        # The poll loop is not aligned with the start of the recording
+        yield ("delay_ms", self.k.rng.uniform(0.0, config["record_poll_ms"]))
+        while True:
+            yield ("delay_ms", config["record_poll_ms"])
+            yield ("cpu", 20.0)
+            if self.k.now >= self.stop_at or self.index >= self.buffer_frames:
+                self.active = False
+                saved = min(self.index, self.buffer_frames)
+                self.stats.counters["capture_truncated"] += max(0, self.frames_wanted - saved)
+                self.stats.counters["capture_frames"] += self.frames_wanted
+                yield ("send", self.records, (saved, self.k.now), 100e3)
+                return
+
+    def whole_writer(self, task):
+        saved, stopped = yield ("recv", self.records, FOREVER)
+        yield from sd_call(self.c, "write", 44)
+        yield ("cpu", 50.0)
+        yield from sd_call(self.c, "write", saved * self.c["channels"] * 2)
+        self.stats.latency["capture_stop_to_saved"].append(self.k.now - stopped)
+
+    # Streaming: blocks from a pool, written while recording continues
+    def _stream_frames(self, frames, trigger_time):
+        while frames > 0:
+            if self.filling is None:
+                if self.free_blocks == 0:
+                    self.stats.counters["capture_overrun"] += frames
+                    return
+                self.free_blocks -= 1
+                in_use = self.c["capture_blocks"] - self.free_blocks
+                self.stats.high_water("capture_blocks", in_use)
+                first = trigger_time - (frames - 1) * self.frame_us
+                self.filling = [0, first]
+            take = min(frames, self.block_frames - self.filling[0])
+            self.filling[0] += take
+            frames -= take
+            if self.filling[0] == self.block_frames:
+                self.full.isr_send(self.filling)
+                self.filling = None
+
+    def stream_writer(self, task):
+        while True:
+            block = yield ("recv", self.full, FOREVER)
+            frames, first = block
+            yield from sd_call(self.c, "write", frames * self.c["channels"] * 2)
+            self.stats.latency["capture_sample_to_sd"].append(self.k.now - first)
+            self.stats.counters["capture_frames"] += frames
+            self.free_blocks += 1
+
+    # Pool: AudioRecordTask claims the longest free run of blocks per take
+    def _acquire(self):
+        if self.held >= self.c["pool_max_takes"]:
+            return None
+        best, run, first = 0, 0, 0
+        for i, owner in enumerate(self.owner):
+            run = 0 if owner is not None else run + 1
+            if run > best:
+                best, first = run, i + 1 - run
+        if best == 0:
+            return None
+        take = {"blocks": list(range(first, first + best)), "frames": 0}
+        for i in take["blocks"]:
+            self.owner[i] = take
+        self.held += 1
+        self.stats.high_water("capture_blocks", sum(1 for o in self.owner if o is not None))
+        self.stats.high_water("capture_takes", self.held)
+        return take
+
+    def _release(self, take, keep=0):
+        for i in take["blocks"][keep:]:
+            self.owner[i] = None
+        take["blocks"] = take["blocks"][:keep]
+        if keep == 0:
+            self.held -= 1
+
+    def pool_record_task(self, task):
+        config = self.c
+        for start, wanted in self.takes:
+            if self.k.now < start:
+                yield ("delay_ms", (start - self.k.now) / 1e3)
+            yield ("cpu", 50.0)
+            self.stats.counters["capture_frames"] += wanted
+            take = self._acquire()
+            if take is None:
+                # Refused rather than recorded over a take not yet saved
+                self.stats.counters["capture_refused_takes"] += 1
+                self.stats.counters["capture_refused"] += wanted
+                continue
+            # A timed take shorter than the run stops at its last frame
+            take["capacity"] = min(wanted, len(take["blocks"]) * self.block_frames)
+            self.stats.counters["capture_truncated"] += wanted - take["capacity"]
+            take["stop_at"] = self.k.now + wanted * self.frame_us
+            self.take = take
+            self._schedule_pool_isr(self.k.now, take)
+            while True:
+                if config["record_stop"] == "isr":
+                    # ulTaskNotifyTake: the ISR's wake-up, or the poll timeout
+                    yield ("recv", self.wake, config["record_poll_ms"] * 1e3)
+                else:
+                    yield ("delay_ms", config["record_poll_ms"])
+                yield ("cpu", 20.0)
+                if take["frames"] >= take["capacity"] or self.k.now >= take["stop_at"]:
+                    break
+            self.take = None
+            stopped = self.k.now
+            self.stats.latency["capture_end_to_stop"].append(stopped - take.get("full_at", stopped))
+            keep = max(1, -(-take["frames"] // self.block_frames))
+            self._release(take, keep)
+            yield ("send", self.records, (take, stopped), 100e3)
+
+    def _schedule_pool_isr(self, trigger_time, take):
+        period = self.c["rx_trig"] * self.frame_us
+        self.k.at(trigger_time + period, lambda: self._pool_isr(trigger_time + period, take))
+
+    def _pool_isr(self, trigger_time, take):
+        if self.take is not take:
+            return                      # PDM deactivated
+        waited = self.k.isr(self.c["isr_us"])
+        slack = (self.c["pdm_fifo"] - self.c["rx_trig"]) * self.frame_us
+        if waited > slack:
+            lost = int((waited - slack) / self.frame_us)
+            self.stats.counters["capture_fifo_overflow"] += lost
+            self.stats.counters["capture_fifo_overflow_events"] += 1
+        frames = self.c["rx_trig"]
+        room = take["capacity"] - take["frames"]
+        if room <= 0:
+            # Still running until the task notices; nothing is written
+            self.stats.counters["capture_overshoot"] += frames
+        else:
+            take["frames"] += min(frames, room)
+            if take["frames"] == take["capacity"]:
+                take["full_at"] = self.k.now
+                if self.c["record_stop"] == "isr":
+                    self.wake.isr_send(True)
+                    return              # The ISR stops the stream itself
+        self._schedule_pool_isr(trigger_time, take)
+
+    def pool_writer(self, task):
+        config = self.c
+        while True:
+            take, stopped = yield ("recv", self.records, FOREVER)
+            yield from sd_call(config, "write", 44)
+            remaining = take["frames"] * config["channels"] * 2
+            while remaining > 0:
+                # emFile holds its lock for one FS_Write, so reads get in between
+                size = min(remaining, config["write_slice_bytes"])
+                yield from sd_call(config, "write", size)
+                remaining -= size
+            yield from sd_call(config, "write", 44)     # Header update at close
+            self.stats.latency["capture_stop_to_saved"].append(self.k.now - stopped)
+            self._release(take)
+
+    def finish(self):
+        if self.c["capture_mode"] == "stream":
+            self.stats.counters["capture_frames"] += self.stats.counters["capture_overrun"]
+
+
+class Playback:
+    """FileReadTask -> pcm_playback_queue -> (PlaybackTask) -> I2S ISR."""
+
+    def __init__(self, kernel, stats, seconds):
+        self.k = kernel
+        self.c = kernel.config
+        self.stats = stats
+        self.frame_us = 1e6 / self.c["sample_rate"]
+        self.isr_frames = self.c["i2s_fifo_words"] // 2 // self.c["channels"]
+        self.total_samples = int(seconds * self.c["sample_rate"]) * self.c["channels"]
+        self.queue = Queue(kernel, "pcm_playback", self.c["playback_queue"])
+        self.buffers = [None] * self.c["read_buffers"]     # chunk using each buffer
+        self.buffer_freed = Queue(kernel, "buffer_free", self.c["read_buffers"])
+        self.chunk = None               # chunk the ISR is playing
+        self.tx_on = False
+        self.started = False            # first data frame sent
+        self.finished = False           # last data frame sent
+        self.gap = 0                    # zero frames since the last data frame
+        self.command_time = 0.0
+        kernel.spawn("FileRead", self.c["prio_read"], self.reader)
+        kernel.spawn("Playback", self.c["prio_playback"], self.player)
+
+    # FileReadTask
+    def reader(self, task):
+        config = self.c
+        yield from sd_call(config, "read", 512)     # FS_FOpen
+        yield from sd_call(config, "read", 44)      # parse_wav_header
+        remaining = self.total_samples
+        index = 0
+        while remaining > 0:
+            buffer = index % config["read_buffers"]
+            owner = self.buffers[buffer]
+            if owner is not None and not owner["done"]:
+                if config["reader_waits"]:
+                    while self.buffers[buffer] is not None and not self.buffers[buffer]["done"]:
+                        yield ("recv", self.buffer_freed, FOREVER)
+                else:
+                    # The firmware reuses the buffer while it is queued or playing
+                    owner["overwritten"] = True
+                    self.stats.counters["playback_overwrites"] += 1
+            samples = min(remaining, config["chunk_samples"])
+            read_start = self.k.now
+            yield from sd_call(config, "read", samples * 2)
+            chunk = {"frames": samples // config["channels"], "played": 0, "done": False,
+                     "overwritten": False, "last": remaining <= samples,
+                     "read_start": read_start, "buffer": buffer}
+            self.buffers[buffer] = chunk
+            ok = yield ("send", self.queue, chunk, config["send_timeout_ms"] * 1000.0)
+            if not ok:
+                self.stats.counters["playback_aborted"] += (remaining // config["channels"])
+                return
+            self.stats.high_water("playback_queue", len(self.queue.items))
+            remaining -= samples
+            index += 1
+
+    # PlaybackTask
+    def player(self, task):
+        config = self.c
+        while True:
+            chunk = yield ("recv", self.queue, FOREVER)
+            if not self.tx_on:
+                yield ("cpu", 30.0)
+                self._start_tx()
+            if config["playback_mode"] == "queue":
+                # ISR pulls chunks from the queue; the task only starts it
+                self.chunk = chunk
+                return
+            self.chunk = chunk
+            while chunk["played"] < chunk["frames"]:
+                yield ("delay_ms", config["playback_poll_ms"])
+            if chunk["last"]:
+                return
+
+    # I2S transmitter: ISR every isr_frames frames while enabled
+    def _start_tx(self):
+        self.tx_on = True
+        # app_i2s_enable() preloads half a FIFO of zeros
+        self.k.at(self.k.now + self.isr_frames * self.frame_us, self._isr)
+
+    def _isr(self):
+        if not self.tx_on:
+            return
+        self.k.isr(self.c["isr_us"])
+        frames = self.isr_frames
+        while frames > 0:
+            chunk = self.chunk
+            if chunk is None or chunk["played"] >= chunk["frames"]:
+                if self.c["playback_mode"] == "queue":
+                    chunk = self.queue.isr_recv()
+                    self.chunk = chunk
+                if chunk is None or chunk["played"] >= chunk["frames"]:
+                    if self.started and not self.finished:
+                        # app_i2s_stream_t.starved_refills
+                        self.gap += frames
+                        self.stats.counters["playback_starved_refills"] += 1
+                    break
+            take = min(frames, chunk["frames"] - chunk["played"])
+            if chunk["played"] == 0:
+                # Data reaches the pins after the FIFO content ahead of it
+                out = self.k.now + (self.c["i2s_fifo_words"] // self.c["channels"]) * self.frame_us
+                self.stats.latency["playback_read_to_out"].append(out - chunk["read_start"])
+                if not self.started:
+                    self.started = True
+                    self.stats.latency["playback_start"].append(out - self.command_time)
+            if self.gap:
+                self.stats.counters["playback_underrun"] += self.gap
+                self.stats.counters["playback_underrun_events"] += 1
+                self.gap = 0
+            if chunk["overwritten"]:
+                self.stats.counters["playback_corrupt"] += take
+            chunk["played"] += take
+            self.stats.counters["playback_frames"] += take
+            frames -= take
+            if chunk["played"] == chunk["frames"]:
+                chunk["done"] = True
+                self.buffer_freed.isr_send(chunk["buffer"])
+                if chunk["last"]:
+                    self.finished = True
+                    self.tx_on = False
+                    return
+        self.k.at(self.k.now + self.isr_frames * self.frame_us, self._isr)
+
+    def finish(self):
+        expected = self.total_samples // self.c["channels"]
+        missing = expected - self.stats.counters["playback_frames"]
+        if missing > 0:
+            self.stats.counters["playback_missing"] += missing
+        self.stats.counters["playback_expected"] += expected
+
+
+def background_load(spec):
+    prio, period_ms, busy_ms = (float(x) for x in spec.split(":"))
+
+    def body(task):
+        while True:
+            yield ("cpu", busy_ms * 1000.0)
+            yield ("delay_ms", period_ms)
+    return int(prio), body
+
+
+def simulate(config, args, seed):
+    rng = random.Random(seed)
+    kernel = Kernel(config, rng)
+    kernel.sd = SdCard(kernel, Distribution(args.sd_read, "read"),
+                       Distribution(args.sd_write, "write"), args.sd_stall)
+    stats = Stats()
+    for spec in args.load:
+        prio, body = background_load(spec)
+        kernel.spawn("Load%d" % prio, prio, body)
+    chains = []
+    end = args.seconds
+    if args.chains in ("capture", "both"):
+        take_seconds = args.take_seconds or args.seconds
+        interval = take_seconds + args.take_gap_ms / 1e3
+        takes = [(i * interval, take_seconds) for i in range(args.takes)]
+        end = max(end, takes[-1][0] + take_seconds)
+        chains.append(Capture(kernel, stats, takes))
+    if args.chains in ("playback", "both"):
+        chains.append(Playback(kernel, stats, args.seconds))
+    # Long enough for the last file write or the last chunk to drain
+    kernel.run((end + max(end, 5.0)) * 1e6)
+    for chain in chains:
+        chain.finish()
+
+    c = stats.counters
+    lost = (c["capture_fifo_overflow"] + c["capture_overrun"] + c["capture_truncated"] +
+            c["capture_refused"] + c["playback_underrun"] + c["playback_corrupt"] + c["playback_aborted"] +
+            c["playback_missing"])
+    total = c["capture_frames"] + c["playback_expected"]
+    stats.lost = lost
+    stats.loss_rate = lost / float(total) if total else 0.0
+    stats.cpu = {t.name: t.cpu_time for t in kernel.tasks}
+    stats.sd = kernel.sd.latencies
+    return stats
+
+
+# ---------------------------------------------------------------------------
+# Reporting
+# ---------------------------------------------------------------------------
+
+def percentile(values, p):
+    if not values:
+        return float("nan")
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(p / 100.0 * len(ordered)))]
+
+
+def evaluate(config, args):
+    runs = [simulate(config, args, args.seed + i) for i in range(args.runs)]
+    result = {
+        "memory": memory_bytes(config, args.chains),
+        "loss_rate": sum(r.loss_rate for r in runs) / len(runs),
+        "p_loss": sum(1 for r in runs if r.lost) / float(len(runs)),
+        "counters": collections.Counter(),
+        "peak": collections.Counter(),
+        "latency": collections.defaultdict(list),
+        "sd": collections.defaultdict(list),
+        "runs": runs,
+    }
+    for r in runs:
+        result["counters"].update(r.counters)
+        for key, value in r.peak.items():
+            result["peak"][key] = max(result["peak"][key], value)
+        for key, values in r.latency.items():
+            result["latency"][key].extend(values)
+        for key, values in r.sd.items():
+            result["sd"][key].extend(values)
+    return result
+
+
+LOSS_LABELS = [
+    ("capture_fifo_overflow", "capture: PDM FIFO overflow frames"),
+    ("capture_overrun", "capture: frames dropped, no free block"),
+    ("capture_truncated", "capture: frames beyond the record buffer"),
+    ("capture_refused", "capture: frames of takes refused, pool full"),
+    ("capture_past_end", "capture: frames written past the buffer end"),
+    ("playback_underrun", "playback: silent frames inside the file"),
+    ("playback_underrun_events", "playback: underrun events"),
+    ("playback_overwrites", "playback: buffers refilled before played"),
+    ("playback_corrupt", "playback: frames played from a refilled buffer"),
+    ("playback_aborted", "playback: frames dropped after a send timeout"),
+    ("playback_missing", "playback: frames never played"),
+]
+
+
+EVENT_LABELS = [
+    ("playback_starved_refills", "starved refills", "playback"),
+    ("capture_fifo_overflow_events", "PDM FIFO overflows", "capture"),
+    ("capture_refused_takes", "takes refused", "capture"),
+]
+
+# Named runs: defaults for the command line options
+SCENARIOS = {
+    "duplex": {
+        "help": "play a 12 s file while recording 2 s takes back to back, 0.2 s apart",
+        "chains": "both", "seconds": 12.0, "takes": 5, "take_seconds": 2.0, "take_gap_ms": 200.0,
+    },
+}
+
+
+def report(config, result, args):
+    n = args.runs
+    print("Configuration")
+    for key in sorted(config):
+        print("  %-22s %s" % (key, config[key]))
+    print("  %-22s %s / %s, stall %s" % ("sd latency", args.sd_read, args.sd_write,
+                                         args.sd_stall or "none"))
+    print()
+    print("%d run(s) of %.1f s, audio buffers %d bytes" % (n, args.seconds, result["memory"]))
+    print("  loss rate              %.3g" % result["loss_rate"])
+    print("  runs with any loss     %.0f%%" % (100.0 * result["p_loss"]))
+    for key, label in LOSS_LABELS:
+        if result["counters"][key]:
+            print("  %-46s %10.1f per run" % (label, result["counters"][key] / float(n)))
+    print()
+    # The counters 'status' prints on the target, per run
+    print("Events per run               mean       max")
+    for key, label, chain in EVENT_LABELS:
+        if args.chains in (chain, "both"):
+            values = [r.counters[key] for r in result["runs"]]
+            print("  %-24s %9.2f %9d" % (label, sum(values) / float(n), max(values)))
+    print()
+    print("Worst-case occupancy")
+    peak = result["peak"]
+    if "capture_takes" in peak:
+        print("  takes held             %d of %d" % (peak["capture_takes"], config["pool_max_takes"]))
+    if "capture_blocks" in peak:
+        print("  capture blocks in use  %d of %d" % (peak["capture_blocks"], config["capture_blocks"]))
+    if "capture_frames" in peak:
+        print("  record buffer frames   %d of %d" % (peak["capture_frames"],
+                                                     config["buffer_seconds"] * config["sample_rate"]))
+    if "playback_queue" in peak:
+        print("  pcm_playback_queue     %d of %d" % (peak["playback_queue"], config["playback_queue"]))
+    print()
+    print("Latency (ms)              p50       p99       max")
+    for key, values in sorted(result["latency"].items()):
+        print("  %-20s %9.1f %9.1f %9.1f" % (key, percentile(values, 50) / 1e3,
+                                             percentile(values, 99) / 1e3, max(values) / 1e3))
+    for op, values in sorted(result["sd"].items()):
+        if values:
+            print("  %-20s %9.1f %9.1f %9.1f" % ("sd " + op, percentile(values, 50) / 1e3,
+                                                 percentile(values, 99) / 1e3, max(values) / 1e3))
+
+
+def sweep(base, args):
+    axes = []
+    for item in args.sweep:
+        key, _, values = item.partition("=")
+        axes.append([(key, parse_value(key, v, base)) for v in values.split(",")])
+
+    rows = []
+    for combo in itertools.product(*axes):
+        config = dict(base)
+        config.update(combo)
+        result = evaluate(config, args)
+        rows.append((combo, result))
+
+    names = [axis[0][0] for axis in axes]
+    header = "".join("%-22s" % n for n in names)
+    print("%s%10s %10s %8s %8s" % (header, "memory", "loss", "P(loss)", "meets"))
+    best = None
+    for combo, result in sorted(rows, key=lambda row: row[1]["memory"]):
+        meets = result["loss_rate"] <= args.target_loss
+        if meets and best is None:
+            best = (combo, result)
+        print("%s%10d %10.3g %7.0f%% %8s" % ("".join("%-22s" % v for _, v in combo),
+                                            result["memory"], result["loss_rate"],
+                                            100.0 * result["p_loss"], "yes" if meets else ""))
+    print()
+    if best is None:
+        print("No configuration meets a loss rate of %g" % args.target_loss)
+        return 1
+    print("Smallest configuration with loss rate <= %g: %s (%d bytes)" % (
+        args.target_loss, ", ".join("%s=%s" % kv for kv in best[0]), best[1]["memory"]))
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--chains", choices=("capture", "playback", "both"), default="both",
+                        help="pipelines to run (both share the CPU and the SD card)")
+    parser.add_argument("--scenario", choices=sorted(SCENARIOS),
+                        help="; ".join("%s: %s" % (name, s["help"]) for name, s in sorted(SCENARIOS.items())))
+    parser.add_argument("--seconds", type=float, default=4.0,
+                        help="audio per run; whole-buffer capture keeps at most buffer_seconds")
+    parser.add_argument("--takes", type=int, default=1,
+                        help="'record' commands in a run (pool capture only)")
+    parser.add_argument("--take-seconds", type=float, default=None,
+                        help="length of each take (default --seconds)")
+    parser.add_argument("--take-gap-ms", type=float, default=500.0,
+                        help="time from the end of a take to the next 'record'")
+    parser.add_argument("--runs", type=int, default=20, help="Monte Carlo runs per configuration")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--set", action="append", default=[], metavar="KEY=VALUE",
+                        help="override a parameter (see --list)")
+    parser.add_argument("--sweep", action="append", default=[], metavar="KEY=V1,V2,...",
+                        help="evaluate every combination of the given values")
+    parser.add_argument("--target-loss", type=float, default=0.0,
+                        help="loss rate a sweep result must meet (default 0)")
+    parser.add_argument("--sd-read", default="lognormal:1.0,0.5", metavar="SPEC",
+                        help="SD read access latency in ms (default lognormal:1.0,0.5)")
+    parser.add_argument("--sd-write", default="lognormal:2.5,0.6", metavar="SPEC",
+                        help="SD write access latency in ms (default lognormal:2.5,0.6)")
+    parser.add_argument("--sd-stall", default=None, metavar="P,MS",
+                        help="with probability P a request takes MS longer (card housekeeping)")
+    parser.add_argument("--load", action="append", default=[], metavar="PRIO:PERIOD_MS:BUSY_MS",
+                        help="extra CPU load, e.g. 2:10:1 for a 10%% load at priority 2")
+    parser.add_argument("--no-source", action="store_true",
+                        help="use built-in defaults instead of the firmware headers")
+    parser.add_argument("--list", action="store_true", help="print the parameters and exit")
+    args = parser.parse_args()
+    if args.scenario:
+        # Options given on the command line still win
+        parser.set_defaults(**{k: v for k, v in SCENARIOS[args.scenario].items() if k != "help"})
+        args = parser.parse_args()
+
+    config = default_config(not args.no_source)
+    if args.list:
+        for key in sorted(config):
+            print("%-22s %s" % (key, config[key]))
+        return 0
+    for item in args.set:
+        key, _, value = item.partition("=")
+        config[key] = parse_value(key, value, config)
+    if args.sd_stall:
+        p, ms = (float(x) for x in args.sd_stall.split(","))
+        args.sd_stall = (p, ms)
+    if args.runs < 1:
+        parser.error("--runs must be at least 1")
+    if args.takes < 1:
+        parser.error("--takes must be at least 1")
+
+    if args.sweep:
+        return sweep(config, args)
+    report(config, evaluate(config, args), args)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
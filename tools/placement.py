@@ -0,0 +1,204 @@
+#!/usr/bin/env python3
+"""
+Report where the linker put the audio interrupt path.
+
+Reads the application ELF file and lists:
+
+  - every allocated output section with its address, size and the bytes of
+    functions in it,
+  - each function marked AUDIO_RAMFUNC_BEGIN in the firmware sources (found
+    by scanning proj_cm33_ns/source, so the list follows the code), with the
+    section it ended up in,
+  - the data the audio interrupts touch, with its section.
+
+Functions in .app_code_ram run from the CM33 code SRAM; functions in
+.app_code_main run from external flash through the XIP cache. A marked
+function that is missing from the symbol table was inlined into its caller or
+removed as unused.
+
+Usage:
+    placement.py build/APP_KIT_PSE84_EVAL_EPC2/Debug/proj_cm33_ns.elf
+    placement.py proj_cm33_ns.elf --list .app_code_ram    # every function there
+    placement.py proj_cm33_ns.elf --check                 # exit 1 if a marked function is not in SRAM
+
+With an AUDIO_XIP_ONLY build the marked functions are reported in flash; use
+--check only on a default build.
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+REPO_ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+SOURCE_DIR = os.path.join(REPO_ROOT, "proj_cm33_ns", "source")
+
+# Output sections that run from SRAM (GNU/LLVM ld; Arm Compiler region names)
+RAM_SECTIONS = (".app_code_ram", "app_code_ram")
+
+# Written or read by the PDM and I2S handlers on every entry
+HOT_DATA = ("pdm_stream", "i2s_stream", "isr_timing", "dsp_chain",
+            "siggen_lut", "mls_bits", "latency_stimulus")
+
+SHT_SYMTAB = 2
+SHF_ALLOC = 0x2
+STT_OBJECT = 1
+STT_FUNC = 2
+
+MARK_RE = re.compile(r"^\s*AUDIO_RAMFUNC_BEGIN\s*$")
+FUNC_RE = re.compile(r"(\w+)\s*\(")
+
+
+class Elf:
+    """Section headers and symbols of a 32- or 64-bit little-endian ELF file."""
+
+    def __init__(self, data):
+        if data[:4] != b"\x7fELF":
+            raise ValueError("not an ELF file")
+        if data[5] != 1:
+            raise ValueError("big-endian ELF files are not supported")
+        wide = data[4] == 2
+        if wide:
+            shoff, = struct.unpack_from("<Q", data, 0x28)
+            shentsize, shnum, shstrndx = struct.unpack_from("<HHH", data, 0x3A)
+            shdr = struct.Struct("<IIQQQQIIQQ")
+            sym = struct.Struct("<IBBHQQ")
+        else:
+            shoff, = struct.unpack_from("<I", data, 0x20)
+            shentsize, shnum, shstrndx = struct.unpack_from("<HHH", data, 0x2E)
+            shdr = struct.Struct("<IIIIIIIIII")
+            sym = struct.Struct("<IIIBBH")
+        if shoff == 0 or shentsize != shdr.size:
+            raise ValueError("no section headers")
+
+        raw = [shdr.unpack_from(data, shoff + i * shentsize) for i in range(shnum)]
+        names = raw[shstrndx]
+        self.sections = []
+        for name, stype, flags, addr, offset, size, link, _info, _align, entsize in raw:
+            self.sections.append({
+                "name": self._string(data, names[4], name),
+                "type": stype, "flags": flags, "addr": addr,
+                "offset": offset, "size": size, "link": link, "entsize": entsize,
+            })
+
+        self.symbols = []
+        for sec in self.sections:
+            if sec["type"] != SHT_SYMTAB:
+                continue
+            strtab = self.sections[sec["link"]]["offset"]
+            for i in range(sec["size"] // sym.size):
+                fields = sym.unpack_from(data, sec["offset"] + i * sym.size)
+                if wide:
+                    name, info, _other, shndx, value, size = fields
+                else:
+                    name, value, size, info, _other, shndx = fields
+                stype = info & 0xF
+                if stype not in (STT_FUNC, STT_OBJECT) or not 0 < shndx < len(self.sections):
+                    continue
+                self.symbols.append({
+                    "name": self._string(data, strtab, name),
+                    # Thumb functions have bit 0 of the address set
+                    "addr": value & ~1 if stype == STT_FUNC else value,
+                    "size": size, "func": stype == STT_FUNC,
+                    "section": self.sections[shndx]["name"],
+                })
+
+    @staticmethod
+    def _string(data, table, index):
+        end = data.index(b"\0", table + index)
+        return data[table + index : end].decode("ascii", "replace")
+
+    def find(self, name):
+        """All symbols of that name; static functions can repeat across files."""
+        return [s for s in self.symbols if s["name"] == name]
+
+
+def marked_functions(source_dir):
+    """(function, file) for each definition after AUDIO_RAMFUNC_BEGIN."""
+    found = []
+    for root, _dirs, files in os.walk(source_dir):
+        for name in sorted(files):
+            if not name.endswith(".c"):
+                continue
+            path = os.path.join(root, name)
+            with open(path, encoding="utf-8", errors="replace") as f:
+                lines = f.read().splitlines()
+            for i, line in enumerate(lines[:-1]):
+                if MARK_RE.match(line):
+                    m = FUNC_RE.search(lines[i + 1])
+                    if m:
+                        found.append((m.group(1), os.path.relpath(path, source_dir)))
+    return found
+
+
+def report(elf, marked, out=sys.stdout):
+    """Print the three tables; return the marked functions not in SRAM."""
+    out.write("%-24s %10s %8s %10s\n" % ("section", "address", "bytes", "code"))
+    for sec in elf.sections:
+        if not sec["flags"] & SHF_ALLOC or sec["size"] == 0:
+            continue
+        code = sum(s["size"] for s in elf.symbols if s["func"] and s["section"] == sec["name"])
+        out.write("%-24s 0x%08x %8d %10s\n" % (sec["name"], sec["addr"], sec["size"],
+                                                code if code else ""))
+
+    misplaced = []
+    out.write("\nAUDIO_RAMFUNC functions\n")
+    for name, path in marked:
+        symbols = [s for s in elf.find(name) if s["func"]]
+        if not symbols:
+            out.write("  %-28s %-24s inlined or removed (%s)\n" % (name, "-", path))
+            continue
+        for s in symbols:
+            where = "SRAM" if s["section"] in RAM_SECTIONS else "flash"
+            if where != "SRAM":
+                misplaced.append(name)
+            out.write("  %-28s %-24s %-5s 0x%08x %6d bytes (%s)\n"
+                      % (name, s["section"], where, s["addr"], s["size"], path))
+
+    out.write("\nInterrupt data\n")
+    for name in HOT_DATA:
+        for s in elf.find(name):
+            if not s["func"]:
+                out.write("  %-28s %-24s 0x%08x %6d bytes\n"
+                          % (name, s["section"], s["addr"], s["size"]))
+    return misplaced
+
+
+def list_section(elf, section, out=sys.stdout):
+    functions = sorted((s for s in elf.symbols if s["func"] and s["section"] == section),
+                       key=lambda s: -s["size"])
+    for s in functions:
+        out.write("0x%08x %6d %s\n" % (s["addr"], s["size"], s["name"]))
+    out.write("%d functions, %d bytes\n" % (len(functions), sum(s["size"] for s in functions)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("elf")
+    parser.add_argument("--list", metavar="SECTION",
+                        help="list the functions in one output section, largest first")
+    parser.add_argument("--check", action="store_true",
+                        help="fail if a marked function was linked outside SRAM")
+    parser.add_argument("--source", default=SOURCE_DIR,
+                        help="firmware sources to scan for AUDIO_RAMFUNC_BEGIN")
+    args = parser.parse_args()
+
+    with open(args.elf, "rb") as f:
+        data = f.read()
+    try:
+        elf = Elf(data)
+    except (ValueError, struct.error) as exc:
+        sys.exit("%s: %s" % (args.elf, exc))
+
+    if args.list:
+        list_section(elf, args.list)
+        return
+    misplaced = report(elf, marked_functions(args.source))
+    if args.check and misplaced:
+        sys.exit("not in SRAM: %s" % ", ".join(sorted(set(misplaced))))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,414 @@
+#!/usr/bin/env python3
+"""
+Host side of the UART file transfer protocol.
+
+The device end lives in proj_cm33_ns/source/file_xfer_task.c; frame layout and
+constants must match file_xfer_task.h.
+
+    frame = header | payload | crc32
+    header = sync(A5 5A) type:u8 flags:u8 seq:u16 length:u16 offset:u32
+    crc32 = zlib.crc32(header[2:] + payload), little endian
+
+Usage:
+    xfer.py get  /dev/ttyACM0 audio_001.wav [-o out.wav] [--resume] [--baud N]
+    xfer.py put  /dev/ttyACM0 prompt.wav [--name NAME] [--play] [--baud N]
+    xfer.py peaks /dev/ttyACM0 audio_001.wav [--width N] [--threshold DBFS]
+
+Requires pyserial (pip install pyserial).
+"""
+
+import argparse
+import os
+import struct
+import sys
+import time
+import zlib
+
+import serial
+
+import peaks as peakfile
+
+CONSOLE_BAUD = 115200
+DEFAULT_BAUD = 921600
+
+SYNC = b"\xa5\x5a"
+HEADER = struct.Struct("<2sBBHHI")
+CRC = struct.Struct("<I")
+INFO = struct.Struct("<IIHH")
+END = struct.Struct("<IIII")
+
+FRAME_INFO = 0x01
+FRAME_DATA = 0x02
+FRAME_END = 0x03
+FRAME_ERROR = 0x04
+FRAME_ACK = 0x10
+FRAME_NAK = 0x11
+FRAME_ABORT = 0x12
+
+MAX_PAYLOAD = 1024
+BAD_FRAME = -1
+
+
+class Link:
+    """Framed access to the device's debug UART."""
+
+    def __init__(self, port, baud=CONSOLE_BAUD):
+        self.ser = serial.Serial(port, baud, timeout=0.02)
+        self.buf = bytearray()
+        self.seq = 0
+        self.bad_frames = 0
+
+    def set_baud(self, baud):
+        self.ser.baudrate = baud
+
+    def command(self, line):
+        """Send a CLI command line at the console rate."""
+        self.ser.reset_input_buffer()
+        self.buf.clear()
+        self.ser.write(line.encode("ascii") + b"\r")
+
+    def send(self, ftype, offset, payload=b""):
+        header = HEADER.pack(SYNC, ftype, 0, self.seq & 0xFFFF, len(payload), offset)
+        self.seq += 1
+        crc = zlib.crc32(header[2:] + payload) & 0xFFFFFFFF
+        self.ser.write(header + payload + CRC.pack(crc))
+
+    def receive(self, timeout):
+        """Return (type, offset, payload), (BAD_FRAME, 0, b"") or None on timeout."""
+        deadline = time.monotonic() + timeout
+        while True:
+            frame = self._parse()
+            if frame is not None:
+                return frame
+            if time.monotonic() >= deadline:
+                return None
+            chunk = self.ser.read(max(1, self.ser.in_waiting))
+            self.buf += chunk
+
+    def _parse(self):
+        start = self.buf.find(SYNC)
+        if start < 0:
+            # Keep a trailing first sync byte, drop console text
+            del self.buf[: max(0, len(self.buf) - 1)]
+            return None
+        del self.buf[:start]
+        if len(self.buf) < HEADER.size:
+            return None
+        _, ftype, _, _, length, offset = HEADER.unpack_from(self.buf)
+        if length > MAX_PAYLOAD:
+            del self.buf[:2]
+            self.bad_frames += 1
+            return (BAD_FRAME, 0, b"")
+        total = HEADER.size + length + CRC.size
+        if len(self.buf) < total:
+            return None
+        body = bytes(self.buf[2 : HEADER.size + length])
+        (crc,) = CRC.unpack_from(self.buf, HEADER.size + length)
+        if crc != (zlib.crc32(body) & 0xFFFFFFFF):
+            del self.buf[:2]
+            self.bad_frames += 1
+            return (BAD_FRAME, 0, b"")
+        del self.buf[:total]
+        return (ftype, offset, body[HEADER.size - 2 :])
+
+
+def percent_of_link(nbytes, seconds, baud):
+    """Payload throughput as a share of raw 8N1 capacity (10 bits per byte)."""
+    rate = nbytes / seconds if seconds > 0 else 0.0
+    return rate, 100.0 * rate / (baud / 10.0)
+
+
+def cmd_get(args):
+    out_path = args.output or os.path.basename(args.filename)
+    offset = 0
+    if args.resume and os.path.exists(out_path):
+        offset = os.path.getsize(out_path)
+    out = open(out_path, "r+b" if offset else "wb")
+    out.seek(offset)
+    out.truncate()
+
+    link = Link(args.port)
+    link.command("get %s %d %d" % (args.filename, offset, args.baud))
+
+    frame = link.receive(5.0)
+    while frame is not None and frame[0] not in (FRAME_INFO, FRAME_ERROR):
+        frame = link.receive(5.0)
+    if frame is None:
+        sys.exit("no response from device (is the file name right?)")
+    if frame[0] == FRAME_ERROR:
+        sys.exit("device error: %s" % frame[2].decode(errors="replace"))
+
+    file_size, baud, block_size, window = INFO.unpack(frame[2])
+    print("%s: %d bytes, resuming at %d, %d baud, %d x %d byte window"
+          % (args.filename, file_size, offset, baud, window, block_size))
+    link.set_baud(baud)
+
+    expected = offset
+    crc = 0
+    nak_sent = False
+    timeouts = 0
+    started = None
+    last_report = 0.0
+
+    # Announce ourselves at the new rate until data flows
+    while True:
+        link.send(FRAME_ACK, expected)
+        frame = link.receive(0.1)
+        if frame is not None and frame[0] != BAD_FRAME:
+            break
+        if started is None:
+            started = time.monotonic()
+        elif time.monotonic() - started > 3.0:
+            sys.exit("device did not start sending")
+    started = time.monotonic()
+
+    while True:
+        if frame is None:
+            timeouts += 1
+            if timeouts > 6:
+                out.close()
+                sys.exit("link lost at %d bytes - rerun with --resume" % expected)
+            link.send(FRAME_ACK, expected)
+        elif frame[0] == BAD_FRAME:
+            if not nak_sent:
+                link.send(FRAME_NAK, expected)
+                nak_sent = True
+        elif frame[0] == FRAME_DATA:
+            timeouts = 0
+            _, foffset, payload = frame
+            if foffset == expected:
+                out.write(payload)
+                crc = zlib.crc32(payload, crc)
+                expected += len(payload)
+                nak_sent = False
+                link.send(FRAME_ACK, expected)
+            elif foffset > expected:
+                if not nak_sent:
+                    link.send(FRAME_NAK, expected)
+                    nak_sent = True
+            else:
+                link.send(FRAME_ACK, expected)
+        elif frame[0] == FRAME_END:
+            break
+        elif frame[0] == FRAME_ERROR:
+            out.close()
+            sys.exit("device error at %d: %s" % (frame[1], frame[2].decode(errors="replace")))
+
+        now = time.monotonic()
+        if now - last_report > 0.5 and file_size:
+            last_report = now
+            sys.stdout.write("\r%5.1f%%  %d/%d" % (100.0 * expected / file_size, expected, file_size))
+            sys.stdout.flush()
+
+        frame = link.receive(1.0)
+
+    elapsed = time.monotonic() - started
+    out.close()
+    link.set_baud(CONSOLE_BAUD)
+
+    dev_crc, dev_ms, dev_sent, dev_resends = END.unpack(frame[2])
+    crc &= 0xFFFFFFFF
+    received = expected - offset
+    rate, pct = percent_of_link(received, elapsed, baud)
+    dev_rate, dev_pct = percent_of_link(received, dev_ms / 1000.0, baud)
+    print("\r%s: %d bytes in %.2f s" % (out_path, received, elapsed))
+    print("  host   : %.0f B/s = %.1f%% of %d baud link" % (rate, pct, baud))
+    print("  device : %.0f B/s = %.1f%% of link, %d resends, %d bytes on wire"
+          % (dev_rate, dev_pct, dev_resends, dev_sent))
+    print("  host bad frames: %d" % link.bad_frames)
+    if expected != file_size or crc != dev_crc:
+        sys.exit("VERIFY FAILED: crc %08x (device %08x), %d of %d bytes"
+                 % (crc, dev_crc, expected, file_size))
+    print("  CRC32 %08x verified" % crc)
+
+
+def cmd_put(args):
+    with open(args.filename, "rb") as f:
+        data = f.read()
+    name = args.name or os.path.basename(args.filename)
+    if len(name) > 31:
+        sys.exit("device file name %r is longer than 31 characters" % name)
+
+    link = Link(args.port)
+    link.command("put %s %d %d" % (name, len(data), args.baud))
+
+    frame = link.receive(5.0)
+    while frame is not None and frame[0] not in (FRAME_INFO, FRAME_ERROR):
+        frame = link.receive(5.0)
+    if frame is None:
+        sys.exit("no response from device (not enough free space?)")
+    if frame[0] == FRAME_ERROR:
+        sys.exit("device error: %s" % frame[2].decode(errors="replace"))
+
+    _, baud, block_size, window = INFO.unpack(frame[2])
+    print("%s -> %s: %d bytes, %d baud, %d x %d byte window"
+          % (args.filename, name, len(data), baud, window, block_size))
+    link.set_baud(baud)
+
+    # Announce ourselves at the new rate until the device answers
+    deadline = time.monotonic() + 3.0
+    while True:
+        link.send(FRAME_ACK, 0)
+        frame = link.receive(0.1)
+        if frame is not None and frame[0] == FRAME_ACK:
+            break
+        if time.monotonic() > deadline:
+            sys.exit("device did not answer at %d baud" % baud)
+
+    size = len(data)
+    window_bytes = window * block_size
+    base = 0
+    next_offset = 0
+    rewind = None
+    timeouts = 0
+    resends = 0
+    high_water = 0
+    started = time.monotonic()
+    last_report = 0.0
+    result = None
+
+    while result is None:
+        # Fill the window
+        while next_offset < size and next_offset - base < window_bytes:
+            chunk = data[next_offset : next_offset + block_size]
+            link.send(FRAME_DATA, next_offset, chunk)
+            if next_offset < high_water:
+                resends += 1
+            next_offset += len(chunk)
+            high_water = max(high_water, next_offset)
+
+        # Once everything is ACKed the device validates and renames the
+        # file before it sends END, so give it longer
+        frame = link.receive(1.0 if base < size else 10.0)
+        if frame is None:
+            timeouts += 1
+            if timeouts > 6:
+                sys.exit("link lost at %d bytes" % base)
+            next_offset = base
+            continue
+        timeouts = 0
+        ftype, foffset, payload = frame
+        if ftype == FRAME_ACK:
+            if base < foffset <= next_offset:
+                base = foffset
+                if rewind is not None and base > rewind:
+                    rewind = None
+        elif ftype == FRAME_NAK:
+            # One rewind per gap - later NAKs for it were already in flight
+            if base <= foffset < next_offset and foffset != rewind:
+                next_offset = foffset
+                rewind = foffset
+        elif ftype in (FRAME_END, FRAME_ERROR):
+            result = frame
+
+        now = time.monotonic()
+        if now - last_report > 0.5:
+            last_report = now
+            sys.stdout.write("\r%5.1f%%  %d/%d" % (100.0 * base / size, base, size))
+            sys.stdout.flush()
+
+    elapsed = time.monotonic() - started
+    link.set_baud(CONSOLE_BAUD)
+    ftype, foffset, payload = result
+    if ftype == FRAME_ERROR:
+        sys.exit("\ndevice rejected upload at %d: %s" % (foffset, payload.decode(errors="replace")))
+
+    dev_crc, dev_ms, dev_received, dev_dropped = END.unpack(payload)
+    crc = zlib.crc32(data) & 0xFFFFFFFF
+    rate, pct = percent_of_link(size, elapsed, baud)
+    dev_rate, dev_pct = percent_of_link(size, dev_ms / 1000.0, baud)
+    print("\r%s: %d bytes in %.2f s" % (name, size, elapsed))
+    print("  host   : %.0f B/s = %.1f%% of %d baud link, %d resends" % (rate, pct, baud, resends))
+    print("  device : %.0f B/s = %.1f%% of link, %d dropped frames, %d bytes received"
+          % (dev_rate, dev_pct, dev_dropped, dev_received))
+    if crc != dev_crc:
+        sys.exit("VERIFY FAILED: crc %08x (device %08x)" % (crc, dev_crc))
+    print("  CRC32 %08x verified, saved as %s" % (crc, name))
+
+    if args.play:
+        time.sleep(0.1)
+        link.command("play %s" % name)
+
+
+def cmd_peaks(args):
+    """Have the device check or rebuild the sidecar, download it and draw it."""
+    link = Link(args.port)
+    link.command("peaks %s" % args.filename)
+    deadline = time.monotonic() + args.timeout
+    text = b""
+    reply = None
+    while reply is None:
+        if time.monotonic() >= deadline:
+            sys.exit("no PEAKS reply from device (is the file name right?)")
+        text += link.ser.read(max(1, link.ser.in_waiting))
+        for line in text.split(b"\n"):
+            line = line.strip().decode(errors="replace")
+            if line.startswith("PEAKS_ERROR"):
+                sys.exit("device error: %s" % line.split(",", 1)[-1])
+            if line.startswith("PEAKS,") and text.endswith(b"\n"):
+                reply = line
+    link.ser.close()
+
+    sidecar = reply.split(",")[1]
+    args.filename = sidecar
+    args.output = args.output or os.path.basename(sidecar)
+    args.resume = False
+    cmd_get(args)
+
+    with open(args.output, "rb") as f:
+        data = f.read()
+    try:
+        peaks = peakfile.Peaks(data)
+    except ValueError as exc:
+        sys.exit("%s: %s" % (args.output, exc))
+    print()
+    peakfile.report(peaks, args.width, args.threshold, args.gap)
+
+
+def run(func, args):
+    """Turn a dropped port (USB unplugged, board reset) into a resume hint."""
+    try:
+        func(args)
+    except serial.SerialException as exc:
+        hint = " - rerun with --resume" if func is cmd_get else ""
+        sys.exit("serial link failed: %s%s" % (exc, hint))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    get = sub.add_parser("get", help="download a file from the device")
+    get.add_argument("port")
+    get.add_argument("filename")
+    get.add_argument("-o", "--output")
+    get.add_argument("--resume", action="store_true",
+                     help="continue from the size of an existing output file")
+    get.add_argument("--baud", type=int, default=DEFAULT_BAUD)
+    get.set_defaults(func=cmd_get)
+
+    put = sub.add_parser("put", help="upload a WAV file to the device")
+    put.add_argument("port")
+    put.add_argument("filename")
+    put.add_argument("--name", help="file name on the SD card (default: local name)")
+    put.add_argument("--play", action="store_true", help="play the file once it is stored")
+    put.add_argument("--baud", type=int, default=DEFAULT_BAUD)
+    put.set_defaults(func=cmd_put)
+
+    pk = sub.add_parser("peaks", help="download and draw the waveform peaks of a WAV file")
+    pk.add_argument("port")
+    pk.add_argument("filename", help="WAV file on the SD card")
+    pk.add_argument("-o", "--output", help="local sidecar name (default: device name)")
+    pk.add_argument("--timeout", type=float, default=30.0,
+                    help="seconds to wait while the device rebuilds a missing sidecar")
+    pk.add_argument("--baud", type=int, default=DEFAULT_BAUD)
+    peakfile.add_report_arguments(pk)
+    pk.set_defaults(func=cmd_peaks)
+
+    args = parser.parse_args()
+    run(args.func, args)
+
+
+if __name__ == "__main__":
+    main()